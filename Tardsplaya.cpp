@@ -39,6 +39,7 @@ struct StreamTab {
     std::vector<std::wstring> qualities;
     std::map<std::wstring, std::wstring> qualityToUrl;
     std::map<std::wstring, std::wstring> standardToOriginalQuality;
+    std::vector<PlaylistQuality> variants; // Master playlist variants, for automatic quality switching
     std::thread streamThread;
     std::atomic<bool> cancelToken{false};
     std::atomic<bool> userRequestedStop{false}; // Track if user explicitly requested stop
@@ -60,6 +61,7 @@ struct StreamTab {
         , qualities(std::move(other.qualities))
         , qualityToUrl(std::move(other.qualityToUrl))
         , standardToOriginalQuality(std::move(other.standardToOriginalQuality))
+        , variants(std::move(other.variants))
         , streamThread(std::move(other.streamThread))
         , cancelToken(other.cancelToken.load())  // Preserve cancel state (moves should not happen with reserved capacity)
         , userRequestedStop(other.userRequestedStop.load())  // Preserve user stop state
@@ -98,6 +100,7 @@ struct StreamTab {
             qualities = std::move(other.qualities);
             qualityToUrl = std::move(other.qualityToUrl);
             standardToOriginalQuality = std::move(other.standardToOriginalQuality);
+            variants = std::move(other.variants);
             streamThread = std::move(other.streamThread);
             cancelToken = other.cancelToken.load();  // Preserve cancel state (moves should not happen)
             userRequestedStop = other.userRequestedStop.load();  // Preserve user stop state
@@ -462,14 +465,26 @@ std::string HttpGet(const wchar_t* host, const wchar_t* path, const wchar_t* hea
         WinHttpReceiveResponse(hRequest, NULL);
     std::string data;
     if (bResult) {
+        // Read in place: Content-Length reserved once, otherwise geometric growth
+        DWORD contentLength = 0, lengthSize = sizeof(contentLength);
+        if (WinHttpQueryHeaders(hRequest, WINHTTP_QUERY_CONTENT_LENGTH | WINHTTP_QUERY_FLAG_NUMBER,
+            WINHTTP_HEADER_NAME_BY_INDEX, &contentLength, &lengthSize, WINHTTP_NO_HEADER_INDEX)) {
+            data.reserve(contentLength);
+        }
         DWORD dwSize = 0;
         do {
             DWORD dwDownloaded = 0;
             WinHttpQueryDataAvailable(hRequest, &dwSize);
             if (!dwSize) break;
-            std::vector<char> buf(dwSize);
-            WinHttpReadData(hRequest, buf.data(), dwSize, &dwDownloaded);
-            data.append(buf.data(), dwDownloaded);
+            size_t prevSize = data.size();
+            if (prevSize + dwSize > data.capacity()) {
+                data.reserve((std::max)(prevSize + dwSize, 2 * data.capacity()));
+            }
+            data.resize(prevSize + dwSize);
+            if (!WinHttpReadData(hRequest, &data[prevSize], dwSize, &dwDownloaded)) {
+                dwDownloaded = 0;
+            }
+            data.resize(prevSize + dwDownloaded);
         } while (dwSize > 0);
     }
     WinHttpCloseHandle(hRequest);
@@ -788,6 +803,7 @@ void LoadChannel(StreamTab& tab) {
     }
     AddLog(L"Parsing qualities...");
     tab.qualityToUrl = ParsePlaylist(m3u8);
+    tab.variants = ParseM3U8MasterPlaylist(m3u8);
     tab.qualities.clear();
     for (const auto& pair : tab.qualityToUrl)
         tab.qualities.push_back(pair.first);
@@ -944,7 +960,8 @@ void WatchStream(StreamTab& tab, size_t tabIndex) {
         tabIndex, // tab index for identifying which stream to auto-stop
         originalQuality, // selected quality for ad recovery
         mode, // streaming mode (HLS or Transport Stream)
-        &tab.playerProcess // player process handle for monitoring
+        &tab.playerProcess, // player process handle for monitoring
+        tab.variants // variants to switch between when throughput drops (transport stream mode)
     );
     
     AddDebugLog(L"WatchStream: Stream thread created successfully for tab " + std::to_wstring(tabIndex));
@@ -0,0 +1,148 @@
+#include "abr_controller.h"
+#include <algorithm>
+#include <cmath>
+
+namespace tsduck_transport {
+
+ThroughputEstimator::ThroughputEstimator(const Config& config) : config_(config) {
+}
+
+void ThroughputEstimator::Reset() {
+    fast_bps_ = slow_bps_ = 0.0;
+    fast_weight_ = slow_weight_ = 0.0;
+    window_.clear();
+    samples_ = 0;
+}
+
+void ThroughputEstimator::AddSample(uint64_t bytes, std::chrono::milliseconds duration) {
+    if (bytes < config_.min_sample_bytes) {
+        return;
+    }
+    // Faster than the clock can tell is counted as one millisecond
+    double seconds = std::max<double>(static_cast<double>(duration.count()), 1.0) / 1000.0;
+    double bps = static_cast<double>(bytes) * 8.0 / seconds;
+
+    // A download counts in proportion to how long it took, so short ones move the averages less
+    double fast_keep = std::pow(0.5, seconds / config_.fast_half_life_s);
+    double slow_keep = std::pow(0.5, seconds / config_.slow_half_life_s);
+    fast_bps_ = fast_keep * fast_bps_ + (1.0 - fast_keep) * bps;
+    slow_bps_ = slow_keep * slow_bps_ + (1.0 - slow_keep) * bps;
+    fast_weight_ = fast_keep * fast_weight_ + (1.0 - fast_keep);
+    slow_weight_ = slow_keep * slow_weight_ + (1.0 - slow_keep);
+
+    window_.push_back(bps);
+    while (window_.size() > config_.window_samples) {
+        window_.pop_front();
+    }
+    samples_++;
+}
+
+double ThroughputEstimator::GetFastBps() const {
+    return fast_weight_ > 0.0 ? fast_bps_ / fast_weight_ : 0.0;
+}
+
+double ThroughputEstimator::GetSlowBps() const {
+    return slow_weight_ > 0.0 ? slow_bps_ / slow_weight_ : 0.0;
+}
+
+double ThroughputEstimator::GetEstimateBps() const {
+    return std::min(GetFastBps(), GetSlowBps());
+}
+
+double ThroughputEstimator::GetPercentileBps(double fraction) const {
+    if (window_.empty()) {
+        return 0.0;
+    }
+    std::vector<double> sorted(window_.begin(), window_.end());
+    std::sort(sorted.begin(), sorted.end());
+    double rank = std::ceil(std::min(std::max(fraction, 0.0), 1.0) * static_cast<double>(sorted.size()));
+    size_t index = rank < 1.0 ? 0 : static_cast<size_t>(rank) - 1;
+    return sorted[index];
+}
+
+AbrController::AbrController(const std::vector<uint64_t>& bitrates, size_t ceiling, const Config& config,
+                             const ThroughputEstimator::Config& estimator_config)
+    : bitrates_(bitrates), ceiling_(bitrates.empty() ? 0 : std::min(ceiling, bitrates.size() - 1)), current_(ceiling_),
+      config_(config), estimator_(estimator_config) {
+}
+
+size_t AbrController::Sustainable(double bps) const {
+    size_t variant = 0;
+    for (size_t i = 0; i <= ceiling_ && i < bitrates_.size(); ++i) {
+        if (static_cast<double>(bitrates_[i]) <= bps) {
+            variant = i;
+        }
+    }
+    return variant;
+}
+
+AbrController::Decision AbrController::Decide(std::chrono::milliseconds buffered, Clock::time_point now) {
+    Decision decision;
+    stats_.decisions++;
+    if (bitrates_.empty()) {
+        return decision;
+    }
+
+    bool known_buffer = buffered.count() >= 0;
+    bool have_estimate = estimator_.HasEstimate();
+    double estimate = estimator_.GetEstimateBps();
+    size_t target = current_;
+
+    if (known_buffer && buffered < config_.low_buffer) {
+        // Running dry: whatever the estimate sustains now, and a step lower if close to a stall
+        if (have_estimate) {
+            target = std::min(current_, Sustainable(estimate * config_.safety_factor));
+        }
+        if (buffered < config_.panic_buffer && target == current_ && current_ > 0) {
+            target = current_ - 1;
+        }
+        decision.reason = Reason::LOW_BUFFER;
+        up_votes_ = 0;
+    } else if (have_estimate && static_cast<double>(bitrates_[current_]) > estimate) {
+        // The current bitrate cannot be sustained; switch down before the buffer shows it
+        target = std::min(current_, Sustainable(estimate * config_.safety_factor));
+        decision.reason = Reason::THROUGHPUT;
+        up_votes_ = 0;
+    } else if (have_estimate && current_ < ceiling_ && (!known_buffer || buffered >= config_.up_switch_buffer)) {
+        // One step up once the next bitrate fits the stricter margin of the average and most recent downloads
+        double next = static_cast<double>(bitrates_[current_ + 1]);
+        if (next <= estimate * config_.up_switch_factor && next <= estimator_.GetPercentileBps(config_.up_switch_percentile)) {
+            up_votes_++;
+            bool settled = !has_switched_ || now - last_switch_ >= config_.min_up_switch_interval;
+            if (up_votes_ >= config_.up_switch_confirmations && settled) {
+                target = current_ + 1;
+                decision.reason = Reason::UP;
+            }
+        } else {
+            up_votes_ = 0;
+        }
+    } else {
+        up_votes_ = 0;
+    }
+
+    if (target != current_) {
+        if (target > current_) {
+            stats_.switches_up++;
+        } else {
+            stats_.switches_down++;
+        }
+        current_ = target;
+        has_switched_ = true;
+        last_switch_ = now;
+        up_votes_ = 0;
+        decision.switched = true;
+    } else {
+        decision.reason = Reason::NONE;
+    }
+    decision.variant = current_;
+    return decision;
+}
+
+AbrController::Stats AbrController::GetStats() const {
+    Stats stats = stats_;
+    stats.variant = current_;
+    stats.estimate_bps = estimator_.GetEstimateBps();
+    return stats;
+}
+
+} // namespace tsduck_transport
@@ -0,0 +1,121 @@
+#pragma once
+// Throughput estimation and automatic quality (ABR) switching
+// Segment downloads feed the estimator: two moving averages weighted by download time - a fast one
+// that follows a drop and a slow one that ignores a burst; the lower counts - and a low percentile of
+// recent downloads. Before each playlist refresh the controller picks the variant to play next from
+// that estimate and the stream time buffered: down at once when the buffer runs low or the current
+// bitrate exceeds the estimate, up one step only while the buffer is healthy and the higher bitrate
+// fits a stricter margin several decisions in a row, and not again soon after a switch. The quality
+// the user chose is the ceiling.
+
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <deque>
+#include <vector>
+
+namespace tsduck_transport {
+
+    struct ThroughputEstimatorConfig {
+        double fast_half_life_s = 2.0;          // Seconds of download time
+        double slow_half_life_s = 8.0;
+        size_t window_samples = 20;             // Recent downloads kept for percentiles
+        uint64_t min_sample_bytes = 16 * 1024;  // Smaller downloads measure the round trip more than bandwidth
+    };
+
+    class ThroughputEstimator {
+    public:
+        using Config = ThroughputEstimatorConfig;
+
+        explicit ThroughputEstimator(const Config& config = Config());
+
+        // One download: bytes received over duration
+        void AddSample(uint64_t bytes, std::chrono::milliseconds duration);
+
+        bool HasEstimate() const { return samples_ > 0; }
+        double GetEstimateBps() const;                  // Lower of the two averages; 0 before a sample
+        double GetFastBps() const;
+        double GetSlowBps() const;
+        double GetPercentileBps(double fraction) const; // Nearest rank over the recent window; 0 before a sample
+        uint64_t GetSampleCount() const { return samples_; }
+        void Reset();
+
+    private:
+        Config config_;
+        double fast_bps_ = 0.0;             // Averages start at 0 and are corrected for the missing history
+        double slow_bps_ = 0.0;
+        double fast_weight_ = 0.0;          // Share of the average the samples so far make up
+        double slow_weight_ = 0.0;
+        std::deque<double> window_;
+        uint64_t samples_ = 0;
+    };
+
+    struct AbrConfig {
+        double safety_factor = 0.8;                             // Share of the estimate a variant may use
+        double up_switch_factor = 0.7;                          // Stricter share when switching up (hysteresis)
+        double up_switch_percentile = 0.2;                      // ...and fit this low percentile of recent downloads
+        std::chrono::milliseconds low_buffer{1000};             // Below: down to what the estimate sustains
+        std::chrono::milliseconds panic_buffer{500};            // Below: at least one step down
+        std::chrono::milliseconds up_switch_buffer{1500};       // Needed before switching up
+        int up_switch_confirmations = 3;                        // Consecutive decisions agreeing on a step up
+        std::chrono::milliseconds min_up_switch_interval{10000}; // Since the last switch, before a step up
+    };
+
+    class AbrController {
+    public:
+        using Config = AbrConfig;
+        using Clock = std::chrono::steady_clock;
+
+        // Buffer level to pass when it is not meaningful; throughput alone decides
+        static constexpr std::chrono::milliseconds UNKNOWN_BUFFER{-1};
+
+        enum class Reason {
+            NONE,
+            LOW_BUFFER,     // Buffer below low_buffer (or panic_buffer)
+            THROUGHPUT,     // Current bitrate above the estimate
+            UP              // Higher variant fit the stricter margin long enough
+        };
+
+        struct Decision {
+            size_t variant = 0;
+            bool switched = false;
+            Reason reason = Reason::NONE;
+        };
+
+        struct Stats {
+            uint64_t decisions = 0;
+            uint64_t switches_up = 0;
+            uint64_t switches_down = 0;
+            size_t variant = 0;
+            double estimate_bps = 0.0;
+        };
+
+        // Bitrates ascending; playback starts at, and never goes above, the ceiling
+        AbrController(const std::vector<uint64_t>& bitrates, size_t ceiling, const Config& config = Config(),
+                      const ThroughputEstimator::Config& estimator_config = ThroughputEstimator::Config());
+
+        void OnSegmentDownloaded(uint64_t bytes, std::chrono::milliseconds duration) { estimator_.AddSample(bytes, duration); }
+
+        // Variant for the next segments, at a segment boundary
+        Decision Decide(std::chrono::milliseconds buffered, Clock::time_point now);
+
+        size_t GetVariant() const { return current_; }
+        const ThroughputEstimator& GetEstimator() const { return estimator_; }
+        Stats GetStats() const;
+
+    private:
+        std::vector<uint64_t> bitrates_;
+        size_t ceiling_;
+        size_t current_;
+        Config config_;
+        ThroughputEstimator estimator_;
+        int up_votes_ = 0;
+        bool has_switched_ = false;
+        Clock::time_point last_switch_;
+        Stats stats_;
+
+        // Highest variant up to the ceiling whose bitrate fits bps, or the lowest
+        size_t Sustainable(double bps) const;
+    };
+
+} // namespace tsduck_transport
@@ -0,0 +1,216 @@
+// Automatic quality switching replayed over bandwidth traces
+// A simulated live client plays 2 s segments of a Twitch-like ladder (160p to 1080p60), starting two
+// segments behind the live edge. Each segment is downloaded once it is published, at the trace's
+// bandwidth plus a round trip, then feeds the throughput estimator; the controller picks the variant
+// for the next one from the estimate and the buffered stream time. Per trace the fixed user quality,
+// the controller, and the controller without hysteresis (any fitting step up at once) are compared
+// by stall time, average bitrate and switches. Time is simulated, so traces replay instantly.
+//
+// Build: g++ -std=c++17 -O2 abr_trace_bench.cpp abr_controller.cpp -o abr_trace_bench
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <cmath>
+#include "abr_controller.h"
+
+using tsduck_transport::AbrController;
+using tsduck_transport::AbrConfig;
+using tsduck_transport::ThroughputEstimator;
+using Clock = AbrController::Clock;
+
+namespace {
+
+    const double SEGMENT_S = 2.0;
+    const double RTT_S = 0.05;
+    const std::vector<uint64_t> LADDER = {230000, 630000, 1400000, 3000000, 4500000, 6500000};
+    const char* LADDER_NAMES[] = {"160p", "360p", "480p", "720p30", "720p60", "1080p60"};
+
+    bool Check(bool condition, const std::string& what) {
+        std::cout << (condition ? "  PASS  " : "  FAIL  ") << what << std::endl;
+        return condition;
+    }
+
+    // Piecewise constant bandwidth
+    struct Trace {
+        std::string name;
+        std::vector<std::pair<double, double>> steps;   // Seconds, bits per second
+
+        double Duration() const {
+            double total = 0.0;
+            for (const auto& step : steps) {
+                total += step.first;
+            }
+            return total;
+        }
+
+        // Time to receive bits starting at t; the last step lasts forever
+        double TransferTime(double t, double bits) const {
+            double start = 0.0;
+            double now = t;
+            for (size_t i = 0; i < steps.size() && bits > 0.0; ++i) {
+                double end = i + 1 == steps.size() ? 1e18 : start + steps[i].first;
+                if (now < end) {
+                    double available = (end - now) * steps[i].second;
+                    if (available >= bits) {
+                        return now + bits / steps[i].second - t;
+                    }
+                    bits -= available;
+                    now = end;
+                }
+                start = end;
+            }
+            return now - t;
+        }
+    };
+
+    Trace Noisy(const std::string& name, double seconds, double mean_bps, double spread) {
+        Trace trace{name, {}};
+        uint32_t state = 2024;
+        for (double t = 0.0; t < seconds; t += 2.0) {
+            state = state * 1103515245u + 12345u;
+            double unit = static_cast<double>((state >> 8) & 0xFFFF) / 65535.0 * 2.0 - 1.0;
+            trace.steps.push_back({2.0, mean_bps * (1.0 + spread * unit)});
+        }
+        return trace;
+    }
+
+    enum class Policy { FIXED, ABR, ABR_NO_HYSTERESIS };
+
+    struct Result {
+        double stall_s = 0.0;
+        double mean_bitrate = 0.0;
+        uint64_t switches = 0;
+        size_t highest = 0;
+        size_t final_variant = 0;
+    };
+
+    Result Replay(const Trace& trace, Policy policy, size_t ceiling) {
+        AbrConfig config;
+        if (policy == Policy::ABR_NO_HYSTERESIS) {
+            config.up_switch_factor = config.safety_factor;
+            config.up_switch_percentile = 1.0;
+            config.up_switch_buffer = config.low_buffer;
+            config.up_switch_confirmations = 1;
+            config.min_up_switch_interval = std::chrono::milliseconds(0);
+        }
+        AbrController abr(LADDER, ceiling, config);
+        Clock::time_point origin{};
+        Result result;
+        size_t variant = ceiling;
+        size_t previous = ceiling;
+
+        // Segment k is published at (k + 1) * SEGMENT_S; start two behind the edge
+        int64_t segment = 3;
+        double t = (segment + 2) * SEGMENT_S;
+        double buffer = 0.0;
+        bool playing = false;
+        double bits_total = 0.0;
+        int64_t segments = 0;
+        double end = trace.Duration();
+
+        auto advance = [&](double until) {
+            if (playing && until > t) {
+                buffer -= until - t;
+                if (buffer < 0.0) {
+                    result.stall_s -= buffer;
+                    buffer = 0.0;
+                }
+            }
+            t = std::max(t, until);
+        };
+
+        while (t < end) {
+            advance(std::max(t, (segment + 1) * SEGMENT_S));
+            if (policy != Policy::FIXED) {
+                auto buffered = std::chrono::milliseconds(static_cast<int64_t>(buffer * 1000.0));
+                variant = abr.Decide(playing ? buffered : AbrController::UNKNOWN_BUFFER,
+                                     origin + std::chrono::milliseconds(static_cast<int64_t>(t * 1000.0))).variant;
+            }
+            if (variant != previous) {
+                result.switches++;
+                previous = variant;
+            }
+            double bits = static_cast<double>(LADDER[variant]) * SEGMENT_S;
+            double download = RTT_S + trace.TransferTime(t + RTT_S, bits);
+            advance(t + download);
+            abr.OnSegmentDownloaded(static_cast<uint64_t>(bits / 8.0), std::chrono::milliseconds(static_cast<int64_t>(download * 1000.0)));
+            buffer += SEGMENT_S;
+            playing = true;
+            bits_total += bits;
+            segments++;
+            result.highest = std::max(result.highest, variant);
+            segment++;
+        }
+        result.mean_bitrate = segments > 0 ? bits_total / (segments * SEGMENT_S) : 0.0;
+        result.final_variant = variant;
+        return result;
+    }
+
+    void Print(const char* name, const Result& result) {
+        std::cout << "    " << std::left << std::setw(20) << name << std::right << std::fixed << std::setprecision(1)
+                  << "stalled " << std::setw(5) << result.stall_s << " s, " << std::setprecision(2)
+                  << std::setw(5) << result.mean_bitrate / 1e6 << " Mbit/s average, " << std::setw(3) << result.switches
+                  << " switches, ends at " << LADDER_NAMES[result.final_variant] << std::endl;
+    }
+
+    struct Outcome {
+        Result fixed, abr, eager;
+    };
+
+    Outcome Run(const Trace& trace, size_t ceiling) {
+        Outcome outcome{Replay(trace, Policy::FIXED, ceiling), Replay(trace, Policy::ABR, ceiling),
+                        Replay(trace, Policy::ABR_NO_HYSTERESIS, ceiling)};
+        std::cout << "  " << trace.name << " (" << std::fixed << std::setprecision(0) << trace.Duration() << " s, ceiling " << LADDER_NAMES[ceiling] << ")" << std::endl;
+        Print("fixed quality", outcome.fixed);
+        Print("abr", outcome.abr);
+        Print("abr, no hysteresis", outcome.eager);
+        return outcome;
+    }
+
+} // namespace
+
+int main() {
+    bool ok = true;
+
+    std::cout << "Estimator" << std::endl;
+    ThroughputEstimator estimator;
+    ok &= Check(!estimator.HasEstimate() && estimator.GetEstimateBps() == 0.0, "no estimate before a download");
+    for (int i = 0; i < 10; ++i) {
+        estimator.AddSample(1250000, std::chrono::milliseconds(1000));       // 10 Mbit/s
+    }
+    ok &= Check(std::fabs(estimator.GetEstimateBps() - 10e6) < 1e3, "steady downloads: estimate equals their rate");
+    estimator.AddSample(250000, std::chrono::milliseconds(2000));            // 1 Mbit/s
+    ok &= Check(estimator.GetFastBps() < estimator.GetSlowBps() && estimator.GetEstimateBps() < 6e6,
+                "a slow download pulls the fast average, and the estimate, down at once");
+    ok &= Check(estimator.GetPercentileBps(0.05) == 1e6 && estimator.GetPercentileBps(0.5) == 10e6, "percentiles of recent downloads");
+    estimator.AddSample(1000, std::chrono::milliseconds(500));
+    ok &= Check(estimator.GetSampleCount() == 11, "tiny downloads are not counted");
+
+    std::cout << std::endl << "Traces" << std::endl;
+    const size_t top = LADDER.size() - 1;
+
+    Outcome ample = Run(Trace{"ample 20 Mbit/s", {{300.0, 20e6}}}, top);
+    ok &= Check(ample.abr.switches == 0 && ample.abr.stall_s == 0.0 && ample.abr.final_variant == top,
+                "ample bandwidth: stays at the user's quality");
+
+    Outcome drop = Run(Trace{"drop to 3 Mbit/s for 2 min", {{60.0, 12e6}, {120.0, 3e6}, {180.0, 12e6}}}, top);
+    ok &= Check(drop.fixed.stall_s > 30.0 && drop.abr.stall_s < drop.fixed.stall_s / 10.0, "bandwidth drop: a tenth of the fixed quality's stalls");
+    ok &= Check(drop.abr.final_variant == top, "bandwidth drop: back at the user's quality afterwards");
+
+    Outcome congested = Run(Trace{"congested 2 Mbit/s", {{300.0, 2e6}}}, top);
+    ok &= Check(congested.abr.stall_s < 5.0 && congested.abr.final_variant == 2, "congested link: settles on 480p");
+
+    Outcome noisy = Run(Noisy("noisy 7 Mbit/s +-60%", 600.0, 7e6, 0.6), top);
+    ok &= Check(noisy.abr.switches * 2 < noisy.eager.switches, "noisy link: hysteresis halves the switches");
+    ok &= Check(noisy.abr.stall_s <= noisy.eager.stall_s && noisy.abr.stall_s < noisy.fixed.stall_s, "noisy link: stalls no more than without hysteresis, less than the fixed quality");
+
+    Outcome capped = Run(Trace{"ample 20 Mbit/s", {{300.0, 20e6}}}, 3);
+    Outcome capped_drop = Run(Trace{"drop to 1 Mbit/s", {{30.0, 20e6}, {60.0, 1e6}, {210.0, 20e6}}}, 3);
+    ok &= Check(capped.abr.highest == 3 && capped_drop.abr.highest == 3 && capped_drop.abr.final_variant == 3,
+                "the user's quality is a ceiling, also when recovering");
+
+    std::cout << std::endl << (ok ? "All checks passed" : "SOME CHECKS FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
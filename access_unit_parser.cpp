@@ -0,0 +1,501 @@
+#include "access_unit_parser.h"
+#include "ts_crc32.h"
+#include <algorithm>
+#include <cstring>
+
+namespace tsduck_transport {
+
+namespace {
+
+    constexpr int64_t TIMESTAMP_MASK = (int64_t(1) << 33) - 1;  // PTS/DTS wrap at 33 bits
+    constexpr int64_t TICKS_PER_SECOND = 90000;
+
+    bool IsVideoCodec(StreamCodec codec) {
+        return codec == StreamCodec::H264 || codec == StreamCodec::HEVC;
+    }
+
+    StreamCodec CodecFromStreamType(uint8_t stream_type) {
+        switch (stream_type) {
+        case 0x1B: return StreamCodec::H264;
+        case 0x24: return StreamCodec::HEVC;
+        case 0x03: case 0x04: case 0x0F: case 0x11: case 0x81: case 0x87:
+            return StreamCodec::AUDIO;
+        default:
+            return StreamCodec::OTHER;
+        }
+    }
+
+    int64_t ReadTimestamp(const uint8_t* p) {
+        return (static_cast<int64_t>((p[0] >> 1) & 0x07) << 30) |
+               (static_cast<int64_t>(p[1]) << 22) |
+               (static_cast<int64_t>(p[2] >> 1) << 15) |
+               (static_cast<int64_t>(p[3]) << 7) |
+               static_cast<int64_t>(p[4] >> 1);
+    }
+
+} // namespace
+
+AccessUnitParser::AccessUnitParser() {
+    Reset();
+}
+
+void AccessUnitParser::Reset() {
+    pids_.clear();
+    pmt_pids_.clear();
+    last_lookup_ = 0;
+    video_pid_ = 0;
+    key_frames_ = 0;
+    last_key_time_ = NO_TIMESTAMP;
+    key_interval_ms_ = 0;
+    events_ = 0;
+    access_units_started_ = 0;
+}
+
+AccessUnitParser::PidState* AccessUnitParser::FindPid(uint16_t pid) {
+    // Streams carry a handful of PIDs and consecutive packets usually share one
+    if (last_lookup_ < pids_.size() && pids_[last_lookup_].pid == pid) {
+        return &pids_[last_lookup_];
+    }
+    for (size_t i = 0; i < pids_.size(); ++i) {
+        if (pids_[i].pid == pid) {
+            last_lookup_ = i;
+            return &pids_[i];
+        }
+    }
+    return nullptr;
+}
+
+const AccessUnitParser::PidState* AccessUnitParser::FindPid(uint16_t pid) const {
+    for (const PidState& state : pids_) {
+        if (state.pid == pid) {
+            return &state;
+        }
+    }
+    return nullptr;
+}
+
+AccessUnitParser::PidState& AccessUnitParser::GetOrAddPid(uint16_t pid) {
+    if (PidState* state = FindPid(pid)) {
+        return *state;
+    }
+    pids_.emplace_back();
+    pids_.back().pid = pid;
+    last_lookup_ = pids_.size() - 1;
+    return pids_.back();
+}
+
+StreamCodec AccessUnitParser::GetCodec(uint16_t pid) const {
+    const PidState* state = FindPid(pid);
+    return state ? state->codec : StreamCodec::UNKNOWN;
+}
+
+StreamCodec AccessUnitParser::GetVideoCodec() const {
+    return video_pid_ ? GetCodec(video_pid_) : StreamCodec::UNKNOWN;
+}
+
+const AccessUnit& AccessUnitParser::GetCurrentAccessUnit() const {
+    static const AccessUnit none;
+    const PidState* state = video_pid_ ? FindPid(video_pid_) : nullptr;
+    return state ? state->current : none;
+}
+
+double AccessUnitParser::GetFrameRate() const {
+    const PidState* state = video_pid_ ? FindPid(video_pid_) : nullptr;
+    if (!state || state->avg_frame_ticks <= 0.0) {
+        return 0.0;
+    }
+    return TICKS_PER_SECOND / state->avg_frame_ticks;
+}
+
+bool AccessUnitParser::GetLastTimestamps(uint16_t pid, int64_t& pts, int64_t& dts) const {
+    const PidState* state = FindPid(pid);
+    if (!state || state->pes_pts == NO_TIMESTAMP) {
+        return false;
+    }
+    pts = state->pes_pts;
+    dts = state->pes_dts;
+    return true;
+}
+
+uint32_t AccessUnitParser::ParsePacket(const uint8_t* packet, PacketMeta& meta) {
+    events_ = 0;
+    access_units_started_ = 0;
+
+    if (packet[0] != 0x47) {
+        return 0;
+    }
+
+    const uint16_t pid = static_cast<uint16_t>(((packet[1] & 0x1F) << 8) | packet[2]);
+    const bool payload_start = (packet[1] & 0x40) != 0;
+    const uint8_t adaptation_control = (packet[3] >> 4) & 0x03;
+
+    size_t offset = 4;
+    bool discontinuity = false;
+    if (adaptation_control & 0x02) {
+        uint8_t adaptation_length = packet[4];
+        discontinuity = adaptation_length > 0 && (packet[5] & 0x80) != 0;
+        offset += 1 + adaptation_length;
+    }
+    bool has_payload = (adaptation_control & 0x01) != 0 && offset < TS_PACKET_SIZE;
+
+    // Program tables
+    if (pid == 0x0000 || std::find(pmt_pids_.begin(), pmt_pids_.end(), pid) != pmt_pids_.end()) {
+        if (has_payload && payload_start) {
+            ParsePSI(pid, packet + offset, TS_PACKET_SIZE - offset);
+        }
+        return 0;
+    }
+    if (pid == 0x1FFF) {
+        return 0; // Null packets
+    }
+
+    PidState* existing = FindPid(pid);
+    if (!has_payload && !existing) {
+        return 0; // PCR-only packets of a PID that carries nothing else
+    }
+    PidState& state = existing ? *existing : GetOrAddPid(pid);
+
+    if (has_payload) {
+        // Continuity counter only advances on packets with payload
+        int cc = packet[3] & 0x0F;
+        bool duplicate = false;
+        if (state.last_cc >= 0 && !discontinuity) {
+            if (cc == state.last_cc) {
+                duplicate = true; // Retransmitted packet, already parsed
+            } else if (cc != ((state.last_cc + 1) & 0x0F)) {
+                // Lost packets: the partial PES header or start code can't be trusted
+                ResetNalState(state);
+                state.pes_active = false;
+                state.pes_header_need = 0;
+                events_ |= EVENT_CONTINUITY_ERROR;
+            }
+        }
+        state.last_cc = cc;
+
+        if (!duplicate) {
+            const uint8_t* payload = packet + offset;
+            size_t size = TS_PACKET_SIZE - offset;
+
+            if (payload_start) {
+                state.pes_active = true;
+                state.pes_header_have = 0;
+                state.pes_header_need = 9;
+                ResetNalState(state);
+            }
+
+            if (state.pes_active) {
+                size_t used = state.pes_header_need ? ConsumePESHeader(state, payload, size) : 0;
+                if (state.pes_active && state.pes_header_need == 0 && IsVideoCodec(state.codec) && used < size) {
+                    ScanNalUnits(state, payload + used, size - used);
+                }
+            }
+        }
+    }
+
+    // Classify and tag the packet
+    if (IsVideoCodec(state.codec)) {
+        meta.flags |= PacketMeta::VIDEO;
+    } else if (state.codec == StreamCodec::AUDIO) {
+        meta.flags |= PacketMeta::AUDIO;
+    }
+
+    if (pid == video_pid_) {
+        if (events_ & EVENT_CONTINUITY_ERROR) {
+            meta.flags |= PacketMeta::VIDEO_SYNC_LOST;
+        }
+        if (access_units_started_ > 0) {
+            meta.frame_number = state.current.index;
+            meta.video_frame_number = static_cast<uint32_t>(state.current.index);
+            meta.access_units = access_units_started_;
+            meta.frame_duration_ms = static_cast<uint16_t>(state.avg_frame_ticks / (TICKS_PER_SECOND / 1000) + 0.5);
+            if (state.current.key_frame) {
+                meta.flags |= PacketMeta::KEY_FRAME;
+            }
+        }
+    } else {
+        events_ &= ~(EVENT_ACCESS_UNIT_START | EVENT_KEY_FRAME);
+    }
+
+    return events_;
+}
+
+void AccessUnitParser::ParsePSI(uint16_t pid, const uint8_t* payload, size_t size) {
+    size_t pointer = payload[0];
+    if (1 + pointer + 3 > size) {
+        return;
+    }
+    const uint8_t* section = payload + 1 + pointer;
+    size_t available = size - 1 - pointer;
+    size_t total = 3 + (((section[1] & 0x0F) << 8) | section[2]);
+    if (total > available) {
+        return; // Sections spanning packets don't occur in HLS segments; wait for the next copy
+    }
+    if (total < 4 || CRC32MPEG(section, total) != 0) {
+        return; // Corrupt table; keep what the last good copy said
+    }
+
+    if (pid == 0x0000 && section[0] == 0x00) {
+        ParsePAT(section, total);
+    } else if (section[0] == 0x02) {
+        ParsePMT(section, total);
+    }
+}
+
+void AccessUnitParser::ParsePAT(const uint8_t* section, size_t size) {
+    if (size < 12) {
+        return;
+    }
+    // Program loop runs from after the 8-byte header to before the CRC
+    for (size_t i = 8; i + 4 <= size - 4; i += 4) {
+        uint16_t program_number = static_cast<uint16_t>((section[i] << 8) | section[i + 1]);
+        uint16_t pmt_pid = static_cast<uint16_t>(((section[i + 2] & 0x1F) << 8) | section[i + 3]);
+        if (program_number != 0 &&
+            std::find(pmt_pids_.begin(), pmt_pids_.end(), pmt_pid) == pmt_pids_.end()) {
+            pmt_pids_.push_back(pmt_pid);
+        }
+    }
+}
+
+void AccessUnitParser::ParsePMT(const uint8_t* section, size_t size) {
+    if (size < 16) {
+        return;
+    }
+    size_t program_info_length = ((section[10] & 0x0F) << 8) | section[11];
+    size_t end = size - 4;
+    for (size_t i = 12 + program_info_length; i + 5 <= end; ) {
+        uint8_t stream_type = section[i];
+        uint16_t es_pid = static_cast<uint16_t>(((section[i + 1] & 0x1F) << 8) | section[i + 2]);
+        size_t es_info_length = ((section[i + 3] & 0x0F) << 8) | section[i + 4];
+
+        PidState& state = GetOrAddPid(es_pid);
+        state.codec = CodecFromStreamType(stream_type);
+        state.codec_from_pmt = true;
+        if (video_pid_ == 0 && IsVideoCodec(state.codec)) {
+            video_pid_ = es_pid;
+        }
+        i += 5 + es_info_length;
+    }
+}
+
+size_t AccessUnitParser::ConsumePESHeader(PidState& state, const uint8_t* data, size_t size) {
+    size_t used = 0;
+    while (state.pes_header_need > 0 && used < size) {
+        size_t take = std::min(state.pes_header_need - state.pes_header_have, size - used);
+        memcpy(state.pes_header + state.pes_header_have, data + used, take);
+        state.pes_header_have += take;
+        used += take;
+        if (state.pes_header_have < state.pes_header_need) {
+            break; // Header continues in the next packet
+        }
+
+        const uint8_t* header = state.pes_header;
+        if (state.pes_header_need == 9) {
+            uint8_t stream_id = header[3];
+            bool has_optional_header = stream_id != 0xBC && stream_id != 0xBE && stream_id != 0xBF &&
+                                       stream_id != 0xF0 && stream_id != 0xF1 && stream_id != 0xF2 &&
+                                       stream_id != 0xF8 && stream_id != 0xFF;
+            if (header[0] != 0x00 || header[1] != 0x00 || header[2] != 0x01 || !has_optional_header) {
+                // Not an audio/video PES; ignore the payload until the next unit start
+                state.pes_active = false;
+                state.pes_header_need = 0;
+                return size;
+            }
+
+            // Without a PMT, fall back to the stream_id ranges
+            if (!state.codec_from_pmt && state.codec == StreamCodec::UNKNOWN) {
+                if (stream_id >= 0xE0 && stream_id <= 0xEF) {
+                    state.codec = StreamCodec::H264; // The HLS default
+                    if (video_pid_ == 0) {
+                        video_pid_ = state.pid;
+                    }
+                } else if (stream_id >= 0xC0 && stream_id <= 0xDF) {
+                    state.codec = StreamCodec::AUDIO;
+                } else {
+                    state.codec = StreamCodec::OTHER;
+                }
+            }
+
+            state.pes_header_need = 9 + header[8];
+            if (state.pes_header_have < state.pes_header_need) {
+                continue;
+            }
+        }
+
+        // Whole header present: pick up PTS/DTS for the next access unit
+        uint8_t pts_dts_flags = header[7] >> 6;
+        size_t header_data_length = header[8];
+        state.pes_pts = NO_TIMESTAMP;
+        state.pes_dts = NO_TIMESTAMP;
+        if ((pts_dts_flags & 0x02) && header_data_length >= 5) {
+            state.pes_pts = ReadTimestamp(header + 9);
+            if (pts_dts_flags == 0x03 && header_data_length >= 10) {
+                state.pes_dts = ReadTimestamp(header + 14);
+            }
+            state.pes_timestamps_unused = true;
+        }
+        state.pes_header_need = 0;
+    }
+    return used;
+}
+
+void AccessUnitParser::ScanNalUnits(PidState& state, const uint8_t* data, size_t size) {
+    const uint8_t prefix_need = state.codec == StreamCodec::HEVC ? 3 : 2;
+
+    size_t i = 0;
+    while (i < size) {
+        // Finish collecting the header bytes of a NAL unit whose start code was already seen
+        if (state.nal_prefix_need > 0) {
+            state.nal_prefix[state.nal_prefix_have++] = data[i++];
+            if (state.nal_prefix_have == state.nal_prefix_need) {
+                state.nal_prefix_need = 0;
+                OnNalUnit(state);
+            }
+            continue;
+        }
+
+        // Start codes end in 0x01; memchr finds candidates at memory speed and the zeros are checked after
+        const void* found = memchr(data + i, 0x01, size - i);
+        if (!found) {
+            break;
+        }
+        size_t one = static_cast<const uint8_t*>(found) - data;
+
+        size_t zeros = 0;
+        size_t k = one;
+        while (k > 0 && zeros < 2 && data[k - 1] == 0x00) {
+            zeros++;
+            k--;
+        }
+        if (k == 0 && zeros < 2) {
+            zeros += state.zero_run; // Start code split across packets
+        }
+
+        if (zeros >= 2) {
+            state.nal_prefix_have = 0;
+            state.nal_prefix_need = prefix_need;
+        }
+        i = one + 1;
+    }
+
+    // Remember trailing zeros for a start code that continues in the next packet
+    size_t trailing = 0;
+    while (trailing < size && trailing < 2 && data[size - 1 - trailing] == 0x00) {
+        trailing++;
+    }
+    if (trailing == size) {
+        state.zero_run = static_cast<uint8_t>(std::min<size_t>(2, state.zero_run + size));
+    } else {
+        state.zero_run = static_cast<uint8_t>(trailing);
+    }
+}
+
+void AccessUnitParser::OnNalUnit(PidState& state) {
+    const uint8_t* header = state.nal_prefix;
+    if (header[0] & 0x80) {
+        return; // forbidden_zero_bit set: not a NAL unit
+    }
+
+    bool vcl = false;
+    bool key = false;
+    bool first_slice = false;
+    bool starts_access_unit = false;
+
+    if (state.codec == StreamCodec::H264) {
+        uint8_t type = header[0] & 0x1F;
+        vcl = type >= 1 && type <= 5;
+        key = type == 5;                        // IDR slice
+        first_slice = (header[1] & 0x80) != 0;  // first_mb_in_slice == 0 (ue(v) '1')
+        // AUD, SEI, SPS, PPS and prefix NALs begin a new access unit once the previous one has a slice
+        starts_access_unit = type == 6 || type == 7 || type == 8 || type == 9 || (type >= 14 && type <= 18);
+    } else {
+        uint8_t type = (header[0] >> 1) & 0x3F;
+        vcl = type <= 31;
+        key = type >= 16 && type <= 23;         // BLA/IDR/CRA (IRAP)
+        first_slice = (header[2] & 0x80) != 0;  // first_slice_segment_in_pic_flag
+        // VPS, SPS, PPS, AUD, prefix SEI and reserved prefix types
+        starts_access_unit = (type >= 32 && type <= 35) || type == 39 || (type >= 41 && type <= 44) || (type >= 48 && type <= 55);
+    }
+
+    if (starts_access_unit) {
+        if (state.au_has_vcl || state.current.index == 0) {
+            StartAccessUnit(state);
+        }
+    } else if (vcl) {
+        if (state.current.index == 0 || (state.au_has_vcl && first_slice)) {
+            StartAccessUnit(state);
+        }
+        state.au_has_vcl = true;
+        if (key && !state.current.key_frame) {
+            MarkKeyFrame(state);
+        }
+    }
+}
+
+void AccessUnitParser::StartAccessUnit(PidState& state) {
+    uint64_t index = state.current.index + 1;
+    state.current = AccessUnit();
+    state.current.index = index;
+    state.au_has_vcl = false;
+
+    // The first access unit after a PES header owns its timestamps
+    if (state.pes_timestamps_unused) {
+        state.current.pts = state.pes_pts;
+        state.current.dts = state.pes_dts;
+        state.pes_timestamps_unused = false;
+    }
+
+    // Frame duration from decode-order timestamps, averaged over access units without their own
+    int64_t timestamp = state.current.dts != NO_TIMESTAMP ? state.current.dts : state.current.pts;
+    state.current.decode_time = timestamp;
+    if (timestamp == NO_TIMESTAMP && state.last_timed_dts != NO_TIMESTAMP && state.avg_frame_ticks > 0.0) {
+        int64_t elapsed = static_cast<int64_t>(state.avg_frame_ticks * static_cast<double>(index - state.last_timed_index) + 0.5);
+        state.current.decode_time = (state.last_timed_dts + elapsed) & TIMESTAMP_MASK;
+    }
+    if (timestamp != NO_TIMESTAMP) {
+        if (state.last_timed_dts != NO_TIMESTAMP && index > state.last_timed_index) {
+            int64_t delta = (timestamp - state.last_timed_dts) & TIMESTAMP_MASK;
+            double per_frame = static_cast<double>(delta) / static_cast<double>(index - state.last_timed_index);
+            // Ignore jumps (splices, wraps on discontinuity) outside 1-240 fps
+            if (per_frame >= TICKS_PER_SECOND / 240.0 && per_frame <= TICKS_PER_SECOND) {
+                state.avg_frame_ticks = state.avg_frame_ticks <= 0.0 ? per_frame
+                                      : state.avg_frame_ticks + (per_frame - state.avg_frame_ticks) / 8.0;
+            }
+        }
+        state.last_timed_dts = timestamp;
+        state.last_timed_index = index;
+    }
+
+    if (state.pid == video_pid_) {
+        events_ |= EVENT_ACCESS_UNIT_START;
+        if (access_units_started_ < UINT8_MAX) {
+            access_units_started_++;
+        }
+    }
+}
+
+void AccessUnitParser::MarkKeyFrame(PidState& state) {
+    state.current.key_frame = true;
+    if (state.pid != video_pid_) {
+        return;
+    }
+
+    events_ |= EVENT_KEY_FRAME;
+    key_frames_++;
+    if (state.current.decode_time != NO_TIMESTAMP) {
+        if (last_key_time_ != NO_TIMESTAMP) {
+            int64_t interval = (state.current.decode_time - last_key_time_) & TIMESTAMP_MASK;
+            if (interval <= 60 * TICKS_PER_SECOND) {
+                key_interval_ms_ = static_cast<uint32_t>((interval + (TICKS_PER_SECOND / 2000)) / (TICKS_PER_SECOND / 1000));
+            }
+        }
+        last_key_time_ = state.current.decode_time;
+    }
+}
+
+void AccessUnitParser::ResetNalState(PidState& state) {
+    state.zero_run = 0;
+    state.nal_prefix_have = 0;
+    state.nal_prefix_need = 0;
+}
+
+} // namespace tsduck_transport
@@ -0,0 +1,138 @@
+#pragma once
+// Incremental H.264/HEVC access unit parser for the transport stream router
+// Follows PAT/PMT to learn each PID's codec, reassembles PES headers for PTS/DTS and scans the
+// video elementary stream for NAL start codes packet by packet. Access unit boundaries, IDR/IRAP
+// key frames and the frame rate come from the bitstream itself, and nothing is buffered beyond a
+// PES header and the few bytes of a start code split across packets.
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "ts_packet.h"
+
+namespace tsduck_transport {
+
+    // Elementary stream codec of a PID, from the PMT stream_type (or PES stream_id before a PMT is seen)
+    enum class StreamCodec : uint8_t {
+        UNKNOWN,
+        H264,
+        HEVC,
+        AUDIO,
+        OTHER   // Timed metadata, subtitles, private data
+    };
+
+    // 90 kHz PTS/DTS value meaning "not present"
+    static constexpr int64_t NO_TIMESTAMP = -1;
+
+    // Video access unit currently being received on a PID
+    struct AccessUnit {
+        uint64_t index = 0;          // 1-based access unit number on the PID (0 = none yet)
+        int64_t pts = NO_TIMESTAMP;  // From the PES header that started this access unit
+        int64_t dts = NO_TIMESTAMP;
+        int64_t decode_time = NO_TIMESTAMP; // DTS (or PTS), else extrapolated at the average frame spacing
+        bool key_frame = false;      // H.264 IDR or HEVC IRAP slice seen
+    };
+
+    class AccessUnitParser {
+    public:
+        // Per-packet results of ParsePacket
+        enum Events : uint32_t {
+            EVENT_ACCESS_UNIT_START = 0x01, // One or more access units of the main video PID start in this packet
+            EVENT_KEY_FRAME         = 0x02, // The current access unit of the main video PID is a key frame (may have started earlier)
+            EVENT_CONTINUITY_ERROR  = 0x04, // Packets were lost on this PID; in-progress NAL state was dropped
+        };
+
+        AccessUnitParser();
+
+        // Parse one 188-byte packet. Classifies meta as VIDEO/AUDIO; on main video PID packets where
+        // access units start, fills frame_number/video_frame_number (the last access unit started),
+        // access_units and frame_duration_ms, and sets KEY_FRAME/VIDEO_SYNC_LOST. Returns Events bits.
+        uint32_t ParsePacket(const uint8_t* packet, PacketMeta& meta);
+
+        // Forget all stream state (new stream or discontinuity)
+        void Reset();
+
+        // Main video stream: the first H.264/HEVC PID announced by the PMT or seen in a PES
+        uint16_t GetVideoPID() const { return video_pid_; }
+        StreamCodec GetVideoCodec() const;
+        StreamCodec GetCodec(uint16_t pid) const;
+        const AccessUnit& GetCurrentAccessUnit() const;
+        uint64_t GetAccessUnitCount() const { return GetCurrentAccessUnit().index; }
+        uint64_t GetKeyFrameCount() const { return key_frames_; }
+
+        // Frame rate from DTS spacing of consecutive access units (0 until two timestamps are seen)
+        double GetFrameRate() const;
+
+        // Decode time of the most recent key frame and the distance to the one before it (0 if unknown)
+        int64_t GetLastKeyFrameTime() const { return last_key_time_; }
+        uint32_t GetKeyFrameIntervalMs() const { return key_interval_ms_; }
+
+        // Latest PES timestamps seen on any PID; false if the PID has had no PES header yet
+        bool GetLastTimestamps(uint16_t pid, int64_t& pts, int64_t& dts) const;
+
+    private:
+        static constexpr size_t PES_HEADER_MAX = 9 + 255;
+
+        struct PidState {
+            uint16_t pid = 0;
+            StreamCodec codec = StreamCodec::UNKNOWN;
+            bool codec_from_pmt = false;
+            int last_cc = -1;
+
+            // PES header reassembly (payload bytes after it are streamed, not stored)
+            uint8_t pes_header[PES_HEADER_MAX];
+            size_t pes_header_have = 0;
+            size_t pes_header_need = 0;     // 0 = not inside a PES header
+            bool pes_active = false;        // A PES has started since the last error
+            int64_t pes_pts = NO_TIMESTAMP;
+            int64_t pes_dts = NO_TIMESTAMP;
+            bool pes_timestamps_unused = false; // Not yet claimed by an access unit
+
+            // NAL start code scanning across packet boundaries
+            uint8_t zero_run = 0;           // Trailing 0x00 bytes of the previous payload (capped at 2)
+            uint8_t nal_prefix[3];          // NAL header plus first slice header byte
+            uint8_t nal_prefix_have = 0;
+            uint8_t nal_prefix_need = 0;    // 0 = not collecting
+
+            // Access unit tracking
+            AccessUnit current;
+            bool au_has_vcl = false;
+
+            // Frame timing
+            int64_t last_timed_dts = NO_TIMESTAMP;
+            uint64_t last_timed_index = 0;
+            double avg_frame_ticks = 0.0;
+        };
+
+        std::vector<PidState> pids_;
+        size_t last_lookup_ = 0;
+        std::vector<uint16_t> pmt_pids_;
+        uint16_t video_pid_ = 0;
+
+        uint64_t key_frames_ = 0;
+        int64_t last_key_time_ = NO_TIMESTAMP;
+        uint32_t key_interval_ms_ = 0;
+
+        // Scratch for the packet being parsed
+        uint32_t events_ = 0;
+        uint8_t access_units_started_ = 0;
+
+        PidState* FindPid(uint16_t pid);
+        const PidState* FindPid(uint16_t pid) const;
+        PidState& GetOrAddPid(uint16_t pid);
+
+        void ParsePSI(uint16_t pid, const uint8_t* payload, size_t size);
+        void ParsePAT(const uint8_t* section, size_t size);
+        void ParsePMT(const uint8_t* section, size_t size);
+
+        // Returns the number of payload bytes consumed by the PES header
+        size_t ConsumePESHeader(PidState& state, const uint8_t* data, size_t size);
+        void ScanNalUnits(PidState& state, const uint8_t* data, size_t size);
+        void OnNalUnit(PidState& state);
+        void StartAccessUnit(PidState& state);
+        void MarkKeyFrame(PidState& state);
+        void ResetNalState(PidState& state);
+    };
+
+} // namespace tsduck_transport
@@ -0,0 +1,396 @@
+// Test for the incremental access unit parser
+// Muxes synthetic H.264 and HEVC streams with known access units (AUD/SPS/PPS/SEI + slices,
+// several access units per PES, tiny frames, large SEI pushing the IDR slice into later packets)
+// into TS packets, then checks access unit counts, key frames, frame rate, key frame spacing,
+// per-packet frame numbering and continuity error handling, and reports parser throughput.
+//
+// Build: g++ -std=c++17 -O2 access_unit_parser_test.cpp access_unit_parser.cpp hls_ts_converter.cpp ts_sync.cpp ts_crc32.cpp ts_packet.cpp -o access_unit_parser_test
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <string>
+#include <cmath>
+#include "access_unit_parser.h"
+#include "hls_ts_converter.h"
+#include "ts_crc32.h"
+
+using namespace tsduck_transport;
+
+static const uint16_t kPmtPid = 0x1000;
+static const uint16_t kVideoPid = 0x100;
+static const uint16_t kAudioPid = 0x101;
+static const uint16_t kMetadataPid = 0x102;
+
+static int g_failures = 0;
+
+static void Check(bool condition, const std::string& what) {
+    std::cout << (condition ? "  PASS  " : "  FAIL  ") << what << std::endl;
+    if (!condition) {
+        g_failures++;
+    }
+}
+
+// Minimal TS muxer ---------------------------------------------------------------------
+
+class Muxer {
+public:
+    std::vector<uint8_t> stream;
+
+    void WritePSI(uint16_t pid, const std::vector<uint8_t>& section) {
+        uint8_t packet[TS_PACKET_SIZE];
+        memset(packet, 0xFF, sizeof(packet));
+        WriteHeader(packet, pid, true, false);
+        packet[4] = 0x00; // Pointer field
+        memcpy(packet + 5, section.data(), section.size());
+        stream.insert(stream.end(), packet, packet + TS_PACKET_SIZE);
+    }
+
+    void WritePES(uint16_t pid, uint8_t stream_id, int64_t pts, int64_t dts, const std::vector<uint8_t>& es) {
+        std::vector<uint8_t> pes = { 0x00, 0x00, 0x01, stream_id, 0x00, 0x00, 0x80 };
+        bool has_dts = dts != NO_TIMESTAMP && dts != pts;
+        pes.push_back(has_dts ? 0xC0 : 0x80);
+        pes.push_back(has_dts ? 10 : 5);
+        PushTimestamp(pes, has_dts ? 0x30 : 0x20, pts);
+        if (has_dts) {
+            PushTimestamp(pes, 0x10, dts);
+        }
+        pes.insert(pes.end(), es.begin(), es.end());
+
+        size_t pos = 0;
+        bool first = true;
+        while (pos < pes.size()) {
+            uint8_t packet[TS_PACKET_SIZE];
+            size_t remaining = pes.size() - pos;
+            size_t room = TS_PACKET_SIZE - 4;
+            if (remaining >= room) {
+                WriteHeader(packet, pid, first, false);
+                memcpy(packet + 4, pes.data() + pos, room);
+                pos += room;
+            } else {
+                // Adaptation field stuffing fills the last packet
+                WriteHeader(packet, pid, first, true);
+                size_t adaptation_length = room - remaining - 1;
+                packet[4] = static_cast<uint8_t>(adaptation_length);
+                if (adaptation_length > 0) {
+                    packet[5] = 0x00;
+                    memset(packet + 6, 0xFF, adaptation_length - 1);
+                }
+                memcpy(packet + 5 + adaptation_length, pes.data() + pos, remaining);
+                pos += remaining;
+            }
+            stream.insert(stream.end(), packet, packet + TS_PACKET_SIZE);
+            first = false;
+        }
+    }
+
+private:
+    uint8_t cc_[0x2000] = {};
+
+    void WriteHeader(uint8_t* packet, uint16_t pid, bool unit_start, bool adaptation) {
+        packet[0] = 0x47;
+        packet[1] = static_cast<uint8_t>((unit_start ? 0x40 : 0x00) | (pid >> 8));
+        packet[2] = static_cast<uint8_t>(pid & 0xFF);
+        packet[3] = static_cast<uint8_t>((adaptation ? 0x30 : 0x10) | (cc_[pid]++ & 0x0F));
+    }
+
+    static void PushTimestamp(std::vector<uint8_t>& out, uint8_t prefix, int64_t ts) {
+        out.push_back(static_cast<uint8_t>(prefix | ((ts >> 29) & 0x0E) | 0x01));
+        out.push_back(static_cast<uint8_t>(ts >> 22));
+        out.push_back(static_cast<uint8_t>(((ts >> 14) & 0xFE) | 0x01));
+        out.push_back(static_cast<uint8_t>(ts >> 7));
+        out.push_back(static_cast<uint8_t>(((ts << 1) & 0xFE) | 0x01));
+    }
+};
+
+// Sections are CRC-checked by the parser
+static void AppendCRC(std::vector<uint8_t>& section) {
+    uint32_t crc = CRC32MPEG(section.data(), section.size());
+    section.insert(section.end(), { static_cast<uint8_t>(crc >> 24), static_cast<uint8_t>(crc >> 16),
+                                    static_cast<uint8_t>(crc >> 8), static_cast<uint8_t>(crc) });
+}
+
+static std::vector<uint8_t> MakePAT() {
+    std::vector<uint8_t> pat = { 0x00, 0xB0, 0x0D, 0x00, 0x01, 0xC1, 0x00, 0x00,
+                                 0x00, 0x01, static_cast<uint8_t>(0xE0 | (kPmtPid >> 8)), static_cast<uint8_t>(kPmtPid & 0xFF) };
+    AppendCRC(pat);
+    return pat;
+}
+
+static std::vector<uint8_t> MakePMT(uint8_t video_stream_type) {
+    std::vector<uint8_t> pmt = { 0x02, 0xB0, 0x00, 0x00, 0x01, 0xC1, 0x00, 0x00,
+                                 static_cast<uint8_t>(0xE0 | (kVideoPid >> 8)), static_cast<uint8_t>(kVideoPid & 0xFF), 0xF0, 0x00 };
+    auto add_stream = [&](uint8_t type, uint16_t pid) {
+        pmt.insert(pmt.end(), { type, static_cast<uint8_t>(0xE0 | (pid >> 8)), static_cast<uint8_t>(pid & 0xFF), 0xF0, 0x00 });
+    };
+    add_stream(video_stream_type, kVideoPid);
+    add_stream(0x0F, kAudioPid);      // AAC
+    add_stream(0x15, kMetadataPid);   // ID3 timed metadata, carried as private PES 0xBD
+    pmt[2] = static_cast<uint8_t>(pmt.size() + 4 - 3);
+    AppendCRC(pmt);
+    return pmt;
+}
+
+// Elementary stream generation -----------------------------------------------------------
+
+struct StreamSpec {
+    bool hevc = false;
+    bool access_unit_delimiters = true;
+    int frames = 600;
+    int gop = 60;
+    int64_t frame_ticks = 3000;   // 30 fps
+    bool large_sei = false;       // 500-byte SEI before every IDR slice
+};
+
+struct Expected {
+    uint64_t access_units = 0;
+    uint64_t key_frames = 0;
+};
+
+// Random slice data with emulation prevention applied: never two zero bytes in a row
+static void AppendSliceData(std::vector<uint8_t>& es, size_t size, std::mt19937& rng) {
+    uint8_t previous = 0xFF;
+    for (size_t i = 0; i < size; ++i) {
+        uint8_t value = static_cast<uint8_t>(rng());
+        if (value == 0x00 && previous == 0x00) {
+            value = 0x03;
+        }
+        es.push_back(value);
+        previous = value;
+    }
+}
+
+static void AppendNal(std::vector<uint8_t>& es, bool four_byte_start, std::initializer_list<uint8_t> header) {
+    if (four_byte_start) {
+        es.push_back(0x00);
+    }
+    es.insert(es.end(), { 0x00, 0x00, 0x01 });
+    es.insert(es.end(), header);
+}
+
+static void AppendAccessUnit(std::vector<uint8_t>& es, const StreamSpec& spec, bool key, size_t slice_size, std::mt19937& rng) {
+    if (spec.hevc) {
+        if (spec.access_unit_delimiters) AppendNal(es, true, { 0x46, 0x01, 0x50 });
+        if (key) {
+            AppendNal(es, true, { 0x40, 0x01 }); AppendSliceData(es, 20, rng);   // VPS
+            AppendNal(es, true, { 0x42, 0x01 }); AppendSliceData(es, 40, rng);   // SPS
+            AppendNal(es, true, { 0x44, 0x01 }); AppendSliceData(es, 8, rng);    // PPS
+            if (spec.large_sei) { AppendNal(es, true, { 0x4E, 0x01 }); AppendSliceData(es, 500, rng); }
+            AppendNal(es, false, { 0x26, 0x01, 0xAF });                          // IDR_W_RADL, first slice
+        } else {
+            AppendNal(es, false, { 0x02, 0x01, 0x80 });                          // TRAIL_R, first slice
+        }
+    } else {
+        if (spec.access_unit_delimiters) AppendNal(es, true, { 0x09, 0xF0 });
+        if (key) {
+            AppendNal(es, true, { 0x67 }); AppendSliceData(es, 30, rng);         // SPS
+            AppendNal(es, true, { 0x68 }); AppendSliceData(es, 6, rng);          // PPS
+            if (spec.large_sei) { AppendNal(es, true, { 0x06 }); AppendSliceData(es, 500, rng); }
+            AppendNal(es, false, { 0x65, 0x88 });                                // IDR, first_mb_in_slice 0
+        } else {
+            AppendNal(es, false, { 0x41, 0x9A });                                // Non-IDR, first_mb_in_slice 0
+        }
+    }
+    AppendSliceData(es, slice_size, rng);
+    // A second slice of the same picture must not start a new access unit
+    if (spec.hevc) {
+        AppendNal(es, false, { static_cast<uint8_t>(key ? 0x26 : 0x02), 0x01, 0x40 });
+    } else {
+        AppendNal(es, false, { static_cast<uint8_t>(key ? 0x65 : 0x41), 0x40 });
+    }
+    AppendSliceData(es, slice_size / 2, rng);
+}
+
+static Expected MakeStream(const StreamSpec& spec, Muxer& mux, uint32_t seed) {
+    std::mt19937 rng(seed);
+    Expected expected;
+    mux.WritePSI(0x0000, MakePAT());
+    mux.WritePSI(kPmtPid, MakePMT(spec.hevc ? 0x24 : 0x1B));
+
+    int64_t dts = 900000;
+    int frame = 0;
+    while (frame < spec.frames) {
+        // Mostly one access unit per PES; now and then two or three tiny ones share a PES
+        int group = (rng() % 10 == 0) ? 2 + static_cast<int>(rng() % 2) : 1;
+        std::vector<uint8_t> es;
+        int64_t pes_dts = dts;
+        for (int g = 0; g < group && frame < spec.frames; ++g, ++frame) {
+            bool key = frame % spec.gop == 0;
+            size_t slice_size = group > 1 ? 10 + rng() % 30 : (key ? 20000 : 500 + rng() % 6000);
+            AppendAccessUnit(es, spec, key, slice_size, rng);
+            expected.access_units++;
+            expected.key_frames += key ? 1 : 0;
+            dts += spec.frame_ticks;
+        }
+        mux.WritePES(kVideoPid, 0xE0, pes_dts + 2 * spec.frame_ticks, pes_dts, es);
+
+        // Audio and timed metadata interleaved
+        std::vector<uint8_t> audio;
+        AppendSliceData(audio, 300, rng);
+        mux.WritePES(kAudioPid, 0xC0, pes_dts, NO_TIMESTAMP, audio);
+        if (frame % 90 == 0) {
+            std::vector<uint8_t> id3(64, 0x49);
+            mux.WritePES(kMetadataPid, 0xBD, pes_dts, NO_TIMESTAMP, id3);
+        }
+    }
+    return expected;
+}
+
+// Tests --------------------------------------------------------------------------------
+
+struct ParseOutcome {
+    uint64_t frames_tagged = 0;
+    uint64_t key_packets = 0;
+    uint64_t drops = 0;
+    uint64_t duplicates = 0;
+    uint64_t sync_lost_packets = 0;
+    bool metadata_misclassified = false;
+};
+
+// Same drop/duplicate rule as TransportStreamRouter::TrackFrameStatistics
+static void TrackFrames(const PacketMeta& meta, ParseOutcome& outcome, uint64_t& last_frame) {
+    if (meta.Has(PacketMeta::VIDEO_SYNC_LOST)) {
+        outcome.sync_lost_packets++;
+    }
+    if (meta.pid == kMetadataPid && (meta.Has(PacketMeta::VIDEO) || meta.Has(PacketMeta::AUDIO))) {
+        outcome.metadata_misclassified = true;
+    }
+    if (meta.Has(PacketMeta::KEY_FRAME)) {
+        outcome.key_packets++;
+    }
+    if (meta.frame_number == 0) {
+        return;
+    }
+    uint64_t in_packet = meta.access_units > 0 ? meta.access_units : 1;
+    uint64_t first = meta.frame_number - (in_packet - 1);
+    if (first > last_frame + 1) {
+        outcome.drops += first - last_frame - 1;
+    } else if (meta.frame_number <= last_frame && last_frame > 0) {
+        outcome.duplicates++;
+    }
+    last_frame = meta.frame_number;
+    outcome.frames_tagged += in_packet;
+}
+
+static void RunStreamCase(const std::string& name, const StreamSpec& spec) {
+    std::cout << std::endl << name << std::endl;
+    Muxer mux;
+    Expected expected = MakeStream(spec, mux, 7);
+
+    // Through the converter, which moves late key frame flags back to the access unit's first packet
+    HLSToTSConverter converter;
+    std::vector<PacketView> views;
+    converter.ConvertSegmentViews(mux.stream, views, true);
+
+    ParseOutcome outcome;
+    uint64_t last_frame = 0;
+    for (const PacketView& view : views) {
+        TrackFrames(view.meta, outcome, last_frame);
+    }
+    const AccessUnitParser& parser = converter.GetAccessUnitParser();
+    double expected_fps = 90000.0 / spec.frame_ticks;
+
+    Check(parser.GetVideoPID() == kVideoPid, "main video PID taken from PMT");
+    Check(parser.GetVideoCodec() == (spec.hevc ? StreamCodec::HEVC : StreamCodec::H264), "codec taken from PMT stream_type");
+    Check(parser.GetAccessUnitCount() == expected.access_units,
+          "access units: " + std::to_string(parser.GetAccessUnitCount()) + " of " + std::to_string(expected.access_units));
+    Check(outcome.frames_tagged == expected.access_units, "every access unit tagged on a packet");
+    Check(parser.GetKeyFrameCount() == expected.key_frames,
+          "key frames: " + std::to_string(parser.GetKeyFrameCount()) + " of " + std::to_string(expected.key_frames));
+    Check(outcome.key_packets == expected.key_frames, "one KEY_FRAME packet per key frame");
+    Check(outcome.drops == 0 && outcome.duplicates == 0, "no false frame drops or duplicates");
+    Check(std::fabs(parser.GetFrameRate() - expected_fps) < 0.01, "frame rate " + std::to_string(parser.GetFrameRate()));
+    Check(parser.GetKeyFrameIntervalMs() == static_cast<uint32_t>(spec.gop * spec.frame_ticks / 90),
+          "key frame interval " + std::to_string(parser.GetKeyFrameIntervalMs()) + " ms");
+    Check(!outcome.metadata_misclassified, "ID3 metadata PID is neither video nor audio");
+
+    // Key flags must sit on the packet where the access unit starts (a frame_number packet)
+    bool key_on_start = true;
+    for (const PacketView& view : views) {
+        if (view.meta.Has(PacketMeta::KEY_FRAME) && view.meta.frame_number == 0) {
+            key_on_start = false;
+        }
+    }
+    Check(key_on_start, "KEY_FRAME marks the access unit's first packet");
+}
+
+static void RunLossCase() {
+    std::cout << std::endl << "H.264 with a lost video packet" << std::endl;
+    StreamSpec spec;
+    Muxer mux;
+    Expected expected = MakeStream(spec, mux, 11);
+
+    // Drop the 500th video packet
+    std::vector<uint8_t> damaged;
+    size_t video_seen = 0;
+    for (size_t pos = 0; pos + TS_PACKET_SIZE <= mux.stream.size(); pos += TS_PACKET_SIZE) {
+        const uint8_t* p = &mux.stream[pos];
+        if ((((p[1] & 0x1F) << 8) | p[2]) == kVideoPid && ++video_seen == 500) {
+            continue;
+        }
+        damaged.insert(damaged.end(), p, p + TS_PACKET_SIZE);
+    }
+
+    AccessUnitParser parser;
+    ParseOutcome outcome;
+    uint64_t last_frame = 0;
+    uint32_t errors = 0;
+    for (size_t pos = 0; pos < damaged.size(); pos += TS_PACKET_SIZE) {
+        PacketMeta meta = PacketMeta::FromHeader(&damaged[pos]);
+        if (parser.ParsePacket(&damaged[pos], meta) & AccessUnitParser::EVENT_CONTINUITY_ERROR) {
+            errors++;
+        }
+        TrackFrames(meta, outcome, last_frame);
+    }
+    Check(errors == 1 && outcome.sync_lost_packets == 1, "continuity error reported once, packet flagged VIDEO_SYNC_LOST");
+    Check(parser.GetAccessUnitCount() + 1 >= expected.access_units && parser.GetAccessUnitCount() <= expected.access_units,
+          "parsing recovers after the loss (" + std::to_string(parser.GetAccessUnitCount()) + " of " + std::to_string(expected.access_units) + " access units)");
+}
+
+static void RunThroughput() {
+    StreamSpec spec;
+    spec.frames = 3000;
+    Muxer mux;
+    MakeStream(spec, mux, 3);
+
+    AccessUnitParser parser;
+    const int rounds = 20;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r) {
+        parser.Reset();
+        for (size_t pos = 0; pos < mux.stream.size(); pos += TS_PACKET_SIZE) {
+            PacketMeta meta = PacketMeta::FromHeader(&mux.stream[pos]);
+            parser.ParsePacket(&mux.stream[pos], meta);
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double mb_per_second = static_cast<double>(mux.stream.size()) * rounds / seconds / 1e6;
+    std::cout << std::endl << "Throughput: " << static_cast<int>(mb_per_second) << " MB/s ("
+              << static_cast<int>(mb_per_second * 8 / 6) << "x a 6 Mbps stream)" << std::endl;
+}
+
+int main() {
+    std::cout << "=== Access unit parser test ===" << std::endl;
+
+    StreamSpec h264;
+    RunStreamCase("H.264 with access unit delimiters", h264);
+
+    StreamSpec h264_no_aud;
+    h264_no_aud.access_unit_delimiters = false;
+    h264_no_aud.large_sei = true;
+    h264_no_aud.frame_ticks = 1500; // 60 fps
+    h264_no_aud.gop = 120;
+    RunStreamCase("H.264 without delimiters, 60 fps, large SEI before IDR", h264_no_aud);
+
+    StreamSpec hevc;
+    hevc.hevc = true;
+    hevc.large_sei = true;
+    RunStreamCase("HEVC with delimiters, large SEI before IRAP", hevc);
+
+    RunLossCase();
+    RunThroughput();
+
+    std::cout << std::endl << (g_failures == 0 ? "All checks passed" : std::to_string(g_failures) + " checks FAILED") << std::endl;
+    return g_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,275 @@
+// Deadline-bound segment downloads with hedged requests against a loopback origin
+// The origin answers most segment requests after a round trip, but every tenth request stalls
+// before its first byte, as an overloaded edge or a lost SYN does. Segments are downloaded one
+// after another by a plain client and by the deadline fetcher, comparing tail download time; the
+// fetcher hedges the stalled requests once they pass the recent time-to-first-byte percentile.
+// Then checks what must not break: a segment stuck for good is given up at its deadline instead of
+// after the receive timeout, the prefetcher reports it as late, a cut-off body is resumed without
+// handing a byte twice, client errors are not retried, the sink is never called once Get has
+// returned, and the histogram percentiles are right.
+//
+// Build: g++ -std=c++17 -O2 -pthread deadline_fetch_bench.cpp deadline_fetcher.cpp segment_prefetcher.cpp segment_pool.cpp http_client.cpp http_client_posix.cpp inflater.cpp loopback_server.cpp -o deadline_fetch_bench
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include "deadline_fetcher.h"
+#include "segment_prefetcher.h"
+#include "loopback_server.h"
+
+using namespace tardsplaya;
+using tsduck_transport::SegmentPool;
+using tsduck_transport::SegmentPrefetcher;
+
+namespace {
+
+    const int RTT_MS = 20;
+    const int STALL_EVERY = 10;                     // Segment requests; the rest answer after a round trip
+    const int STALL_MS = 1200;
+    const size_t SEGMENT_BYTES = 256 * 1024;
+    const int WARM_UP = 12;                         // Unstalled downloads that time first bytes for the hedge threshold
+    const int SEGMENTS = 40;
+
+    bool Check(bool condition, const std::string& what) {
+        std::cout << (condition ? "  PASS  " : "  FAIL  ") << what << std::endl;
+        return condition;
+    }
+
+    uint8_t BodyByte(size_t index) {
+        return static_cast<uint8_t>((index * 2654435761u) >> 13);
+    }
+
+    bool BodyOk(const std::vector<uint8_t>& body) {
+        if (body.size() != SEGMENT_BYTES) {
+            return false;
+        }
+        for (size_t i = 0; i < SEGMENT_BYTES; ++i) {
+            if (body[i] != BodyByte(i)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    double Milliseconds(std::chrono::steady_clock::duration duration) {
+        return std::chrono::duration<double, std::milli>(duration).count();
+    }
+
+    LoopbackServer* origin = nullptr;
+    std::atomic<int> segment_requests{0};
+    std::atomic<int> flaky_requests{0};
+
+    // Routes of the loopback origin
+    //   /fast       SEGMENT_BYTES after a round trip
+    //   /segment    like /fast, but every STALL_EVERY-th request waits STALL_MS before the headers
+    //   /stuck      never answers while the bench runs
+    //   /flaky      the first answer breaks off halfway
+    //   /missing    404
+    void Respond(const LoopbackRequest& request, LoopbackResponse& response) {
+        const std::string& path = request.path;
+        if (path == "/missing") {
+            response.status = 404;
+            return;
+        }
+        if (path == "/stuck") {
+            origin->Sleep(std::chrono::seconds(60));
+            response.status = 503;
+            return;
+        }
+        response.body.resize(SEGMENT_BYTES);
+        for (size_t i = 0; i < SEGMENT_BYTES; ++i) {
+            response.body[i] = static_cast<char>(BodyByte(i));
+        }
+        if (path == "/segment" && ++segment_requests % STALL_EVERY == STALL_EVERY / 2) {
+            response.delay = std::chrono::milliseconds(STALL_MS);
+        }
+        if (path == "/flaky" && flaky_requests++ == 0) {
+            response.abort_after = SEGMENT_BYTES / 2;
+        }
+    }
+
+    HttpBodySink Collect(std::vector<uint8_t>& body) {
+        return [&body](const uint8_t* data, size_t size) {
+            body.insert(body.end(), data, data + size);
+            return true;
+        };
+    }
+
+    void PrintRow(const std::string& name, const LatencyHistogram& times) {
+        std::cout << std::left << std::setw(20) << ("  " + name) << std::right << std::fixed << std::setprecision(0)
+                  << std::setw(8) << times.Percentile(0.5) << std::setw(8) << times.Percentile(0.9)
+                  << std::setw(8) << times.Percentile(0.99) << std::setw(8) << times.GetMax() << std::endl;
+    }
+
+} // namespace
+
+int main() {
+    std::cout << "=== Deadline-bound downloads with hedging ===" << std::endl;
+    bool ok = true;
+
+    LoopbackServer server(Respond);
+    origin = &server;
+    server.rtt_ms = RTT_MS;
+    if (!Check(server.Start(), "loopback server listening")) {
+        return 1;
+    }
+
+    HttpClient::Config client_config;
+    client_config.retry_delay = std::chrono::milliseconds(50);
+
+    // Plain client: a stalled request costs the whole stall
+    LatencyHistogram plain_times;
+    bool plain_ok = true;
+    {
+        HttpClient client(CreatePlatformHttpBackend(), client_config);
+        for (int i = 0; i < SEGMENTS; ++i) {
+            std::vector<uint8_t> body;
+            auto start = std::chrono::steady_clock::now();
+            plain_ok = client.Get(server.Url("/segment"), Collect(body)) && BodyOk(body) && plain_ok;
+            plain_times.Add(Milliseconds(std::chrono::steady_clock::now() - start));
+        }
+    }
+    ok = Check(plain_ok, "plain client: every segment complete") && ok;
+
+    // Deadline fetcher: the same sequence of stalls, hedged past the p95 of time to first byte
+    LatencyHistogram hedged_times;
+    bool hedged_ok = true;
+    DeadlineFetcher::Stats hedged_stats;
+    {
+        segment_requests = 0;
+        HttpClient client(CreatePlatformHttpBackend(), client_config);
+        DeadlineFetcher fetcher(client);
+        for (int i = 0; i < WARM_UP; ++i) {
+            std::vector<uint8_t> body;
+            fetcher.Get(server.Url("/fast"), std::chrono::steady_clock::now() + std::chrono::seconds(5), Collect(body));
+        }
+        std::cout << std::endl << "  hedge threshold after " << WARM_UP << " downloads: " << fetcher.GetHedgeDelay().count() << "ms" << std::endl;
+        for (int i = 0; i < SEGMENTS; ++i) {
+            std::vector<uint8_t> body;
+            auto start = std::chrono::steady_clock::now();
+            DeadlineFetcher::Result result = fetcher.Get(server.Url("/segment"), start + std::chrono::seconds(5), Collect(body));
+            hedged_times.Add(Milliseconds(std::chrono::steady_clock::now() - start));
+            hedged_ok = result == DeadlineFetcher::Result::OK && BodyOk(body) && hedged_ok;
+        }
+        hedged_stats = fetcher.GetStats();
+    }
+    ok = Check(hedged_ok, "deadline fetcher: every segment complete, each byte once") && ok;
+
+    std::cout << std::endl << SEGMENTS << " segments of " << SEGMENT_BYTES / 1024 << " KB, " << RTT_MS << " ms round trip, every "
+              << STALL_EVERY << "th request stalled " << STALL_MS << " ms" << std::endl;
+    std::cout << std::left << std::setw(20) << "  download ms" << std::right << std::setw(8) << "p50" << std::setw(8) << "p90"
+              << std::setw(8) << "p99" << std::setw(8) << "max" << std::endl;
+    PrintRow("plain", plain_times);
+    PrintRow("deadline+hedge", hedged_times);
+    std::cout << "  " << hedged_stats.hedges << " hedged requests, " << hedged_stats.hedges_won << " answered first; first byte p50 "
+              << hedged_stats.time_to_first_byte.Percentile(0.5) << "ms, p99 " << hedged_stats.time_to_first_byte.Percentile(0.99) << "ms" << std::endl;
+    std::cout << std::endl;
+    ok = Check(plain_times.Percentile(0.99) >= STALL_MS, "plain client: p99 includes the stall") && ok;
+    ok = Check(hedged_times.Percentile(0.99) * 4 < plain_times.Percentile(0.99), "hedging cuts p99 download time at least 4x") && ok;
+    ok = Check(hedged_stats.hedges_won >= SEGMENTS / STALL_EVERY && hedged_stats.hedges <= hedged_stats.hedges_won + SEGMENTS / 10,
+               "every stalled request won by its hedge, few hedges wasted") && ok;
+
+    // A segment that never arrives is given up at its deadline, not after the 30 s receive timeout
+    {
+        HttpClient client(CreatePlatformHttpBackend(), client_config);
+        DeadlineFetcher fetcher(client);
+        std::vector<uint8_t> body;
+        auto start = std::chrono::steady_clock::now();
+        DeadlineFetcher::Result result = fetcher.Get(server.Url("/stuck"), start + std::chrono::milliseconds(1500), Collect(body));
+        double elapsed = Milliseconds(std::chrono::steady_clock::now() - start);
+        std::cout << "  stuck segment given up after " << static_cast<int>(elapsed) << "ms" << std::endl;
+        ok = Check(result == DeadlineFetcher::Result::LATE && elapsed < 1800 && fetcher.GetStats().late == 1 && fetcher.GetStats().hedges == 1,
+                   "stuck segment: hedged once, LATE at the deadline") && ok;
+
+        for (int i = 0; i < 10; ++i) {
+            fetcher.Get(server.Url("/fast"), std::chrono::steady_clock::now() + std::chrono::seconds(5), Collect(body));
+        }
+        start = std::chrono::steady_clock::now();
+        result = fetcher.Get(server.Url("/fast"), start + std::chrono::milliseconds(2), Collect(body));
+        ok = Check(result == DeadlineFetcher::Result::LATE && Milliseconds(std::chrono::steady_clock::now() - start) < 2,
+                   "deadline shorter than a typical first byte: LATE without a request") && ok;
+
+        DeadlineFetcher::Stats before = fetcher.GetStats();
+        result = fetcher.Get(server.Url("/missing"), std::chrono::steady_clock::now() + std::chrono::seconds(5), Collect(body));
+        ok = Check(result == DeadlineFetcher::Result::FAILED && fetcher.GetStats().retries == before.retries, "404: failed, not retried") && ok;
+
+        body.clear();
+        result = fetcher.Get(server.Url("/flaky"), std::chrono::steady_clock::now() + std::chrono::seconds(5), Collect(body));
+        ok = Check(result == DeadlineFetcher::Result::OK && BodyOk(body) && fetcher.GetStats().retries == before.retries + 1,
+                   "body cut off halfway: retried, bytes handed on once") && ok;
+
+        std::atomic<bool> cancel{false};
+        std::thread canceller([&cancel] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            cancel = true;
+        });
+        start = std::chrono::steady_clock::now();
+        result = fetcher.Get(server.Url("/stuck"), start + std::chrono::seconds(10), Collect(body), &cancel);
+        canceller.join();
+        ok = Check(result == DeadlineFetcher::Result::CANCELLED && Milliseconds(std::chrono::steady_clock::now() - start) < 500,
+                   "cancel token ends a waiting download") && ok;
+
+        // The deadline passes while the winner is inside the sink: Get returns once it is out, and the sink, which
+        // goes with the caller, is not called again
+        std::atomic<bool> in_sink{false};
+        std::atomic<bool> returned{false};
+        std::atomic<bool> called_after{false};
+        HttpBodySink slow = [&](const uint8_t*, size_t) {
+            called_after = called_after || returned;
+            in_sink = true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            in_sink = false;
+            return true;
+        };
+        result = fetcher.Get(server.Url("/fast"), std::chrono::steady_clock::now() + std::chrono::milliseconds(250), slow);
+        bool out_of_sink = !in_sink;
+        returned = true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        ok = Check(result == DeadlineFetcher::Result::LATE && out_of_sink && !called_after,
+                   "deadline during a sink call: waited out, the sink not called again") && ok;
+    }
+
+    // The prefetcher gives the deadline to the download and reports the segment late
+    {
+        HttpClient client(CreatePlatformHttpBackend(), client_config);
+        DeadlineFetcher fetcher(client);
+        SegmentPool pool;
+        SegmentPrefetcher prefetcher(
+            [&fetcher](const std::wstring& url, const SegmentPrefetcher::ChunkSink& sink, std::atomic<bool>* token,
+                       std::chrono::steady_clock::time_point deadline) {
+                return fetcher.Get(url, deadline, sink, token) == DeadlineFetcher::Result::OK;
+            },
+            pool);
+        auto wide = [](const std::string& url) { return std::wstring(url.begin(), url.end()); };
+        auto start = std::chrono::steady_clock::now();
+        prefetcher.Enqueue(1, wide(server.Url("/stuck")), start + std::chrono::milliseconds(500));
+        prefetcher.Enqueue(2, wide(server.Url("/fast")), start + std::chrono::seconds(5));
+        SegmentPrefetcher::Segment segment;
+        SegmentPrefetcher::Result result = prefetcher.Take(1, segment);
+        double elapsed = Milliseconds(std::chrono::steady_clock::now() - start);
+        ok = Check(result == SegmentPrefetcher::Result::LATE && elapsed < 800 && prefetcher.GetStats().late == 1,
+                   "prefetcher: segment past its deadline taken as LATE") && ok;
+        result = prefetcher.Take(2, segment);
+        ok = Check(result == SegmentPrefetcher::Result::READY && segment.data && segment.data->size() == SEGMENT_BYTES,
+                   "prefetcher: the next segment is ready after the late one") && ok;
+    }
+
+    // Percentiles are bucket upper bounds, within a quarter doubling of the exact value
+    LatencyHistogram histogram;
+    for (int ms = 1; ms <= 1000; ++ms) {
+        histogram.Add(ms);
+    }
+    double p50 = histogram.Percentile(0.5);
+    double p99 = histogram.Percentile(0.99);
+    ok = Check(p50 >= 500 && p50 < 500 * 1.19 && p99 >= 990 && p99 < 990 * 1.19 && histogram.GetMax() == 1000 &&
+               histogram.GetCount() == 1000, "histogram: p50 and p99 within a bucket of the exact value") && ok;
+    histogram.Decay();
+    ok = Check(histogram.GetCount() < 520 && histogram.Percentile(0.5) >= 450, "histogram: decay halves the counts, keeps the shape") && ok;
+
+    server.Stop();
+    std::cout << std::endl << (ok ? "All checks passed" : "SOME CHECKS FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,338 @@
+#include "deadline_fetcher.h"
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <memory>
+#include <thread>
+
+namespace tardsplaya {
+
+// The requests of one download race for the first byte; the winner's body goes to the caller
+struct DeadlineFetcher::Race {
+    static const int CLOSED = -2;   // Get has returned: nobody may win any more
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    int winner = -1;                // Index into the requests of the download
+    int attempt_first = 0;          // Requests before this belong to failed attempts and may not win
+    std::chrono::steady_clock::time_point first_byte;
+    uint64_t delivered = 0;         // Bytes the caller's sink has taken, over all attempts
+    bool refused = false;
+    bool in_sink = false;           // The winner is passing bytes to the caller's sink; Get waits for it before returning
+};
+
+// One request of an attempt, on its own thread. Losers may still be unwinding when Get returns.
+struct DeadlineFetcher::Request {
+    std::shared_ptr<Race> race;
+    std::thread thread;
+    std::atomic<bool> cancel{false};
+    std::atomic<bool> finished{false};
+    std::chrono::steady_clock::time_point start;
+    bool done = false;              // Under the race mutex
+    bool ok = false;
+    int status = 0;
+};
+
+namespace {
+
+    const uint64_t RECENT_SAMPLES = 256;                    // Hedge threshold samples before they are decayed
+    const std::chrono::milliseconds POLL_SLICE(20);         // How often a waiting download looks at the cancel token
+
+    double Milliseconds(std::chrono::steady_clock::duration duration) {
+        return std::chrono::duration<double, std::milli>(duration).count();
+    }
+
+    bool Cancelled(std::atomic<bool>* cancel_token) {
+        return cancel_token && cancel_token->load();
+    }
+
+} // namespace
+
+void LatencyHistogram::Add(double ms) {
+    size_t bucket = 0;
+    if (ms > 1.0) {
+        bucket = std::min(BUCKETS - 1, static_cast<size_t>(std::floor(std::log2(ms) * 4.0)) + 1);
+    }
+    buckets_[bucket]++;
+    count_++;
+    max_ = std::max(max_, ms);
+}
+
+void LatencyHistogram::Decay() {
+    count_ = 0;
+    for (uint64_t& bucket : buckets_) {
+        bucket /= 2;
+        count_ += bucket;
+    }
+}
+
+double LatencyHistogram::GetBucketLimit(size_t bucket) {
+    return bucket == 0 ? 1.0 : std::pow(2.0, static_cast<double>(bucket) / 4.0);
+}
+
+double LatencyHistogram::Percentile(double fraction) const {
+    if (count_ == 0) {
+        return 0.0;
+    }
+    uint64_t rank = static_cast<uint64_t>(std::ceil(std::min(std::max(fraction, 0.0), 1.0) * static_cast<double>(count_)));
+    rank = std::max<uint64_t>(rank, 1);
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < BUCKETS; ++bucket) {
+        seen += buckets_[bucket];
+        if (seen >= rank) {
+            return std::min(GetBucketLimit(bucket), max_);
+        }
+    }
+    return max_;
+}
+
+DeadlineFetcher::DeadlineFetcher(HttpClient& client, const Config& config) : client_(client), config_(config) {
+    config_.max_attempts = std::max(1, config_.max_attempts);
+    config_.min_samples = std::max<size_t>(1, config_.min_samples);
+}
+
+DeadlineFetcher::~DeadlineFetcher() {
+    ReapStragglers(true);
+}
+
+void DeadlineFetcher::ReapStragglers(bool wait) {
+    std::vector<std::shared_ptr<Request>> finished;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto keep = std::partition(stragglers_.begin(), stragglers_.end(),
+                                   [wait](const std::shared_ptr<Request>& request) { return !wait && !request->finished; });
+        finished.assign(keep, stragglers_.end());
+        stragglers_.erase(keep, stragglers_.end());
+    }
+    for (const auto& request : finished) {
+        request->thread.join();
+    }
+}
+
+std::chrono::milliseconds DeadlineFetcher::GetHedgeDelay() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (recent_first_byte_.GetCount() < config_.min_samples) {
+        return config_.initial_hedge_delay;
+    }
+    auto threshold = std::chrono::milliseconds(static_cast<int64_t>(std::ceil(recent_first_byte_.Percentile(config_.hedge_percentile))));
+    return std::max(threshold, config_.min_hedge_delay);
+}
+
+DeadlineFetcher::Result DeadlineFetcher::Get(const std::wstring& url, Clock::time_point deadline, const HttpBodySink& sink,
+                                             std::atomic<bool>* cancel_token) {
+    return Get(NarrowUrl(url), deadline, sink, cancel_token);
+}
+
+DeadlineFetcher::Result DeadlineFetcher::Get(const std::string& url, Clock::time_point deadline, const HttpBodySink& sink,
+                                             std::atomic<bool>* cancel_token) {
+    ReapStragglers(false);
+    const Clock::time_point download_start = Clock::now();
+    auto race = std::make_shared<Race>();
+    std::vector<std::shared_ptr<Request>> requests;     // Of every attempt
+    Result result = Result::FAILED;
+    uint64_t retries = 0;
+    uint64_t hedges = 0;
+    bool hedge_won = false;
+    double first_byte_ms = -1.0;
+
+    // The request thread only touches the caller's sink as the winner, and Get closes the race and waits out
+    // a sink call in progress before it returns
+    auto launch = [&]() {
+        auto request = std::make_shared<Request>();
+        request->race = race;
+        request->start = Clock::now();
+        const int index = static_cast<int>(requests.size());
+        Request* self = request.get();
+        request->thread = std::thread([this, url, &sink, self, index]() {
+            Race& race = *self->race;
+            uint64_t offset = 0;
+            HttpBodySink relay = [&](const uint8_t* data, size_t size) {
+                size_t skip = 0;
+                {
+                    std::lock_guard<std::mutex> lock(race.mutex);
+                    if (race.winner == -1 && index >= race.attempt_first) {
+                        race.winner = index;
+                        race.first_byte = Clock::now();
+                        race.changed.notify_all();
+                    }
+                    if (race.winner != index) {
+                        return false;
+                    }
+                    // A retry starts the body over; bytes the caller has already are skipped
+                    skip = offset < race.delivered ? static_cast<size_t>(std::min<uint64_t>(size, race.delivered - offset)) : 0;
+                    offset += size;
+                    if (skip == size) {
+                        return true;
+                    }
+                    race.in_sink = true;
+                }
+                bool accepted = sink(data + skip, size - skip);
+                std::lock_guard<std::mutex> lock(race.mutex);
+                race.in_sink = false;
+                race.delivered += size - skip;
+                race.refused = !accepted;
+                race.changed.notify_all();
+                return accepted;
+            };
+            HttpResponse response;
+            bool ok = client_.Get(url, relay, &self->cancel, &response, 1);
+            {
+                std::lock_guard<std::mutex> lock(race.mutex);
+                self->ok = ok;
+                self->status = response.status;
+                self->done = true;
+                race.changed.notify_all();
+            }
+            self->finished = true;
+        });
+        requests.push_back(std::move(request));
+    };
+
+    for (int attempt = 0; attempt < config_.max_attempts; ++attempt) {
+        if (attempt > 0) {
+            retries++;
+            Clock::time_point retry_at = std::min(deadline, Clock::now() + config_.retry_delay);
+            while (!Cancelled(cancel_token) && Clock::now() < retry_at) {
+                std::this_thread::sleep_for(std::min<Clock::duration>(POLL_SLICE, retry_at - Clock::now()));
+            }
+        }
+        if (Cancelled(cancel_token)) {
+            result = Result::CANCELLED;
+            break;
+        }
+        if (Clock::now() >= deadline) {
+            result = Result::LATE;
+            break;
+        }
+        // Not even a typical first byte fits before the deadline: give up now rather than at it
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (recent_first_byte_.GetCount() >= config_.min_samples &&
+                Milliseconds(deadline - Clock::now()) < recent_first_byte_.Percentile(0.5)) {
+                result = Result::LATE;
+                break;
+            }
+        }
+
+        const size_t first_of_attempt = requests.size();
+        {
+            std::lock_guard<std::mutex> lock(race->mutex);
+            race->winner = -1;
+            race->attempt_first = static_cast<int>(first_of_attempt);
+        }
+        launch();
+        Clock::time_point hedge_at = Clock::now() + GetHedgeDelay();
+        size_t attempt_hedges = 0;
+        Result outcome = Result::FAILED;
+        Request* winner = nullptr;
+        bool client_error = true;
+        {
+            std::unique_lock<std::mutex> lock(race->mutex);
+            while (true) {
+                Clock::time_point now = Clock::now();
+                bool cancelled = Cancelled(cancel_token);
+                if (cancelled || now >= deadline) {
+                    outcome = cancelled ? Result::CANCELLED : Result::LATE;
+                    break;
+                }
+                winner = race->winner >= 0 ? requests[race->winner].get() : nullptr;
+                bool all_done = std::all_of(requests.begin() + first_of_attempt, requests.end(),
+                                            [](const std::shared_ptr<Request>& request) { return request->done; });
+                if (all_done || (winner && winner->done)) {
+                    break;
+                }
+                if (!winner && now >= hedge_at && attempt_hedges < config_.max_hedges) {
+                    // Still no answer: the same request again on another connection
+                    lock.unlock();
+                    launch();
+                    Clock::time_point next_hedge = Clock::now() + GetHedgeDelay();
+                    lock.lock();
+                    attempt_hedges++;
+                    hedges++;
+                    hedge_at = next_hedge;
+                    continue;
+                }
+                Clock::time_point wake = std::min(deadline, now + POLL_SLICE);
+                if (!winner && attempt_hedges < config_.max_hedges) {
+                    wake = std::min(wake, hedge_at);
+                }
+                race->changed.wait_until(lock, wake);
+            }
+            winner = race->winner >= 0 ? requests[race->winner].get() : nullptr;
+            if (winner && first_byte_ms < 0.0) {
+                first_byte_ms = Milliseconds(race->first_byte - winner->start);
+                hedge_won = race->winner > static_cast<int>(first_of_attempt);
+            }
+            for (size_t i = first_of_attempt; i < requests.size(); ++i) {
+                client_error = client_error && requests[i]->done && requests[i]->status >= 400 && requests[i]->status < 500;
+            }
+            if (outcome != Result::FAILED) {
+                race->winner = Race::CLOSED;
+            }
+        }
+        // Losers are cancelled and left to unwind; waiting for them would add their cancellation to this download
+        for (size_t i = first_of_attempt; i < requests.size(); ++i) {
+            if (requests[i].get() != winner || outcome != Result::FAILED) {
+                requests[i]->cancel = true;
+            }
+        }
+
+        if (outcome != Result::FAILED) {
+            result = outcome;
+            break;
+        }
+        if (winner && winner->ok) {
+            result = Result::OK;
+            break;
+        }
+        bool refused = false;
+        {
+            std::lock_guard<std::mutex> lock(race->mutex);
+            refused = race->refused;
+        }
+        if (refused) {
+            result = Result::CANCELLED;
+            break;
+        }
+        if (client_error) {
+            break;      // Asking again gets the same answer
+        }
+    }
+    {
+        // A winner left behind at the deadline may be inside the sink, which is the caller's and goes when Get returns
+        std::unique_lock<std::mutex> lock(race->mutex);
+        race->winner = Race::CLOSED;
+        race->changed.wait(lock, [&] { return !race->in_sink; });
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& request : requests) {
+        stragglers_.push_back(std::move(request));
+    }
+    stats_.retries += retries;
+    stats_.hedges += hedges;
+    if (first_byte_ms >= 0.0) {
+        stats_.time_to_first_byte.Add(first_byte_ms);
+        recent_first_byte_.Add(first_byte_ms);
+        if (recent_first_byte_.GetCount() >= RECENT_SAMPLES) {
+            recent_first_byte_.Decay();
+        }
+        stats_.hedges_won += hedge_won ? 1 : 0;
+    }
+    if (result == Result::OK) {
+        stats_.downloads++;
+        stats_.download_time.Add(Milliseconds(Clock::now() - download_start));
+    } else if (result == Result::LATE) {
+        stats_.late++;
+    } else if (result == Result::FAILED) {
+        stats_.failures++;
+    }
+    return result;
+}
+
+DeadlineFetcher::Stats DeadlineFetcher::GetStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+} // namespace tardsplaya
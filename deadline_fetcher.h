@@ -0,0 +1,110 @@
+#pragma once
+// Segment downloads against a playback deadline, with hedged requests
+// A segment is only worth having before the player needs it. Each download carries that deadline:
+// failed attempts are retried at once while time remains, instead of after fixed sleeps, and at the
+// deadline the download is abandoned so the caller can jump to the live edge rather than stall on it.
+// A request that has not answered by a high percentile of recent time-to-first-byte is most likely
+// stuck behind a slow edge or a lost packet; a duplicate request is sent on another connection and
+// whichever answers first is kept. Time to first byte and download time are kept as histograms.
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+
+#include "http_client.h"
+
+namespace tardsplaya {
+
+    // Milliseconds in logarithmic buckets, four per doubling, from 1 ms to about a minute
+    class LatencyHistogram {
+    public:
+        static const size_t BUCKETS = 64;
+
+        void Add(double ms);
+        void Decay();       // Halves every count, so older samples weigh less
+        uint64_t GetCount() const { return count_; }
+        double GetMax() const { return max_; }
+
+        // Upper bound of the bucket holding the fraction's sample, at most the maximum; 0 without samples
+        double Percentile(double fraction) const;
+
+        // Samples per bucket and the bucket's upper bound in milliseconds
+        uint64_t GetBucketCount(size_t bucket) const { return buckets_[bucket]; }
+        static double GetBucketLimit(size_t bucket);
+
+    private:
+        uint64_t buckets_[BUCKETS] = {};
+        uint64_t count_ = 0;
+        double max_ = 0.0;
+    };
+
+    struct DeadlineFetcherConfig {
+        double hedge_percentile = 0.95;                     // Of recent time to first byte, before a duplicate is sent
+        std::chrono::milliseconds min_hedge_delay{100};
+        std::chrono::milliseconds initial_hedge_delay{800};  // Until min_samples first bytes have been timed
+        size_t min_samples = 10;
+        size_t max_hedges = 1;                              // Duplicates per attempt
+        int max_attempts = 4;                               // While the deadline allows
+        std::chrono::milliseconds retry_delay{100};
+    };
+
+    class DeadlineFetcher {
+    public:
+        using Config = DeadlineFetcherConfig;
+        using Clock = std::chrono::steady_clock;
+
+        enum class Result {
+            OK,
+            FAILED,         // Every attempt failed before the deadline
+            LATE,           // The deadline passed or cannot be met
+            CANCELLED
+        };
+
+        struct Stats {
+            uint64_t downloads = 0;
+            uint64_t failures = 0;
+            uint64_t late = 0;
+            uint64_t retries = 0;
+            uint64_t hedges = 0;                    // Duplicate requests sent
+            uint64_t hedges_won = 0;                // Duplicates that answered first
+            LatencyHistogram time_to_first_byte;    // Of the request that answered first
+            LatencyHistogram download_time;         // Request to last byte, successful downloads
+        };
+
+        explicit DeadlineFetcher(HttpClient& client, const Config& config = Config());
+        ~DeadlineFetcher();
+
+        DeadlineFetcher(const DeadlineFetcher&) = delete;
+        DeadlineFetcher& operator=(const DeadlineFetcher&) = delete;
+
+        // Stream the body to sink, each byte once, by the deadline (time_point::max() for none)
+        Result Get(const std::string& url, Clock::time_point deadline, const HttpBodySink& sink,
+                   std::atomic<bool>* cancel_token = nullptr);
+        Result Get(const std::wstring& url, Clock::time_point deadline, const HttpBodySink& sink,
+                   std::atomic<bool>* cancel_token = nullptr);
+
+        // How long a request may go unanswered before it is hedged
+        std::chrono::milliseconds GetHedgeDelay() const;
+
+        Stats GetStats() const;
+
+    private:
+        struct Race;
+        struct Request;
+
+        HttpClient& client_;
+        Config config_;
+        mutable std::mutex mutex_;
+        Stats stats_;
+        LatencyHistogram recent_first_byte_;    // Decayed every few hundred samples so the threshold follows the network
+        std::vector<std::shared_ptr<Request>> stragglers_;  // Cancelled requests still unwinding; joined later
+
+        void ReapStragglers(bool wait);
+    };
+
+} // namespace tardsplaya
@@ -0,0 +1,386 @@
+#include "hls_origin.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+#include "psi_tables.h"
+
+namespace tardsplaya {
+
+namespace {
+
+    const size_t PACKET_SIZE = 188;
+    const size_t PACKET_PAYLOAD = 184;
+    const size_t PCR_ADAPTATION = 8;                    // Length, flags and the PCR
+    const size_t VIDEO_PES_HEADER = 19;                 // With PTS and DTS
+    const size_t AUDIO_PES_HEADER = 14;                 // With PTS
+    const size_t ADTS_HEADER = 7;
+    const int64_t CLOCK = 90000;
+    const int64_t AUDIO_FRAME_TICKS = 1920;             // 1024 AAC samples at 48 kHz
+    const int64_t PCR_LEAD = 9000;                      // The PCR runs 100 ms ahead of decoding
+    const int64_t MAIN_TIMELINE = 10 * CLOCK;
+    const int64_t AD_TIMELINE = 3600 * CLOCK;           // The ad encoder's clock has nothing to do with ours
+    const uint64_t TIMESTAMP_MASK = (1ull << 33) - 1;
+
+    const uint8_t START_CODE[] = { 0x00, 0x00, 0x00, 0x01 };
+    const uint8_t ACCESS_UNIT_DELIMITER[] = { 0x09, 0xF0 };
+    const uint8_t SPS[] = { 0x67, 0x64, 0x00, 0x1F, 0xAC, 0xD9, 0x40, 0x50, 0x05, 0xBB, 0x01, 0x10, 0x00, 0x00, 0x03,
+                            0x00, 0x10, 0x00, 0x00, 0x03, 0x03, 0xC0, 0xF1, 0x83, 0x19, 0x60 };
+    const uint8_t PPS[] = { 0x68, 0xEB, 0xE3, 0xCB, 0x22, 0xC0 };
+    const uint8_t IDR_SLICE[] = { 0x65, 0x88 };         // first_mb_in_slice 0, I slice
+    const uint8_t P_SLICE[] = { 0x41, 0x9A };           // first_mb_in_slice 0, P slice
+
+    // Smallest elementary stream an access unit can have
+    size_t MinimumFrameBytes(bool key_frame) {
+        size_t bytes = sizeof(START_CODE) + sizeof(ACCESS_UNIT_DELIMITER) + sizeof(START_CODE) + sizeof(IDR_SLICE) + 1;
+        if (key_frame) {
+            bytes += sizeof(START_CODE) + sizeof(SPS) + sizeof(START_CODE) + sizeof(PPS);
+        }
+        return bytes;
+    }
+
+    // TS packets for a PES whose first packet carries an adaptation field of the given size
+    uint64_t PacketsFor(size_t pes_bytes, size_t first_adaptation) {
+        size_t first = PACKET_PAYLOAD - first_adaptation;
+        return pes_bytes <= first ? 1 : 1 + (pes_bytes - first + PACKET_PAYLOAD - 1) / PACKET_PAYLOAD;
+    }
+
+    void PushTimestamp(std::vector<uint8_t>& out, uint8_t prefix, uint64_t timestamp) {
+        timestamp &= TIMESTAMP_MASK;
+        out.push_back(static_cast<uint8_t>(prefix | ((timestamp >> 29) & 0x0E) | 0x01));
+        out.push_back(static_cast<uint8_t>(timestamp >> 22));
+        out.push_back(static_cast<uint8_t>(((timestamp >> 14) & 0xFE) | 0x01));
+        out.push_back(static_cast<uint8_t>(timestamp >> 7));
+        out.push_back(static_cast<uint8_t>(((timestamp << 1) & 0xFE) | 0x01));
+    }
+
+    // Stand-in for coded data: never zero, so no start code is emulated
+    void PushFiller(std::vector<uint8_t>& out, size_t size, uint64_t seed) {
+        for (size_t i = 0; i < size; ++i) {
+            out.push_back(static_cast<uint8_t>(((seed * 131 + i * 7) & 0x7F) | 0x80));
+        }
+    }
+
+    // One PES as TS packets. The first packet carries the PCR and random access flag when given; the
+    // last is filled up with adaptation field stuffing.
+    void WritePes(std::string& out, uint16_t pid, const std::vector<uint8_t>& pes, uint64_t continuity,
+                  const uint64_t* pcr, bool random_access) {
+        for (size_t offset = 0; offset < pes.size(); ++continuity) {
+            const bool first = offset == 0;
+            std::vector<uint8_t> adaptation;                // Flags onwards
+            if (first && pcr) {
+                uint64_t base = *pcr & TIMESTAMP_MASK;
+                adaptation = { static_cast<uint8_t>((random_access ? 0x40 : 0x00) | 0x10),
+                               static_cast<uint8_t>(base >> 25), static_cast<uint8_t>(base >> 17),
+                               static_cast<uint8_t>(base >> 9), static_cast<uint8_t>(base >> 1),
+                               static_cast<uint8_t>(((base & 1) << 7) | 0x7E), 0x00 };
+            }
+            size_t adaptation_size = adaptation.empty() ? 0 : 1 + adaptation.size();
+            size_t remaining = pes.size() - offset;
+            if (remaining < PACKET_PAYLOAD - adaptation_size) {
+                size_t stuffing = PACKET_PAYLOAD - adaptation_size - remaining;
+                if (adaptation_size == 0 && stuffing > 1) {
+                    adaptation.push_back(0x00);
+                    stuffing -= 2;
+                    adaptation_size = 2;
+                } else if (adaptation_size == 0) {
+                    stuffing = 0;
+                    adaptation_size = 1;
+                }
+                adaptation.insert(adaptation.end(), stuffing, 0xFF);
+                adaptation_size += stuffing;
+            }
+            size_t payload = std::min(remaining, PACKET_PAYLOAD - adaptation_size);
+
+            char packet[PACKET_SIZE];
+            packet[0] = 0x47;
+            packet[1] = static_cast<char>((first ? 0x40 : 0x00) | (pid >> 8));
+            packet[2] = static_cast<char>(pid & 0xFF);
+            packet[3] = static_cast<char>((adaptation_size ? 0x30 : 0x10) | (continuity & 0x0F));
+            if (adaptation_size) {
+                packet[4] = static_cast<char>(adaptation_size - 1);
+                std::copy(adaptation.begin(), adaptation.end(), packet + 5);
+            }
+            std::copy(pes.begin() + offset, pes.begin() + offset + payload, packet + 4 + adaptation_size);
+            out.append(packet, PACKET_SIZE);
+            offset += payload;
+        }
+    }
+
+    void WriteSection(std::string& out, uint16_t pid, const std::vector<uint8_t>& section, uint64_t continuity) {
+        std::string packet(PACKET_SIZE, '\xFF');
+        packet[0] = 0x47;
+        packet[1] = static_cast<char>(0x40 | (pid >> 8));
+        packet[2] = static_cast<char>(pid & 0xFF);
+        packet[3] = static_cast<char>(0x10 | (continuity & 0x0F));
+        packet[4] = 0x00;       // Pointer field
+        std::copy(section.begin(), section.end(), packet.begin() + 5);
+        out += packet;
+    }
+
+} // namespace
+
+HlsOrigin::HlsOrigin(const Config& config) : config_(config) {
+    config_.segment_ms = std::max(1, config_.segment_ms);
+    config_.frame_rate = std::max(1, config_.frame_rate);
+    config_.gop_frames = std::max(1, config_.gop_frames);
+    config_.key_frame_weight = std::max(1, config_.key_frame_weight);
+    config_.live_segments = std::max(config_.live_segments, config_.window_segments);
+    config_.ad_break_segments = std::max(0, std::min(config_.ad_break_segments, config_.ad_break_every - 1));
+
+    const size_t gop = static_cast<size_t>(config_.gop_frames);
+    const uint64_t weights = static_cast<uint64_t>(config_.key_frame_weight) + gop - 1;
+    for (const HlsVariant& variant : config_.variants) {
+        Layout layout;
+        const uint64_t gop_bytes = variant.video_bits_per_second * gop / static_cast<uint64_t>(config_.frame_rate) / 8;
+        for (size_t frame = 0; frame < gop; ++frame) {
+            uint64_t weight = frame == 0 ? static_cast<uint64_t>(config_.key_frame_weight) : 1;
+            size_t bytes = std::max(static_cast<size_t>(gop_bytes * weight / weights), MinimumFrameBytes(frame == 0));
+            layout.frame_bytes.push_back(bytes);
+            layout.packets_before.push_back(layout.gop_packets);
+            layout.gop_packets += PacketsFor(VIDEO_PES_HEADER + bytes, PCR_ADAPTATION);
+        }
+        layouts_.push_back(std::move(layout));
+    }
+    audio_frame_bytes_ = static_cast<size_t>(std::min<uint64_t>(8191, std::max<uint64_t>(ADTS_HEADER + 1,
+                                             config_.audio_bits_per_second * AUDIO_FRAME_TICKS / CLOCK / 8)));
+    audio_pes_packets_ = PacketsFor(AUDIO_PES_HEADER + audio_frame_bytes_, 0);
+
+    server_.reset(new LoopbackServer([this](const LoopbackRequest& request, LoopbackResponse& response) {
+        Respond(request, response);
+    }));
+}
+
+bool HlsOrigin::Start() {
+    // A stream that has been live for a while: the first playlist lists a full window
+    auto running = std::chrono::milliseconds(static_cast<int64_t>(config_.live_segments) * config_.segment_ms);
+    start_ = std::chrono::steady_clock::now() - running;
+    wall_start_ = std::chrono::system_clock::now() - running;
+    return server_->Start();
+}
+
+void HlsOrigin::Stop() {
+    server_->Stop();
+}
+
+std::string HlsOrigin::MasterUrl() const {
+    return server_->Url("/master.m3u8");
+}
+
+std::string HlsOrigin::PlaylistUrl(size_t variant) const {
+    return server_->Url("/" + config_.variants[variant].name + "/live.m3u8");
+}
+
+std::string HlsOrigin::SegmentUrl(size_t variant, int64_t media_sequence) const {
+    return server_->Url("/" + config_.variants[variant].name + "/seg/" + std::to_string(media_sequence) + ".ts");
+}
+
+int64_t HlsOrigin::LiveEdge() const {
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_);
+    return elapsed.count() / config_.segment_ms;
+}
+
+bool HlsOrigin::IsAd(int64_t media_sequence) const {
+    return config_.ad_break_segments > 0 && media_sequence >= 0 &&
+           media_sequence % config_.ad_break_every >= config_.ad_break_every - config_.ad_break_segments;
+}
+
+std::string HlsOrigin::Segment(size_t variant, int64_t media_sequence) const {
+    const Layout& layout = layouts_[variant];
+    const bool ad = IsAd(media_sequence);
+    // Segments counted on the timeline of the encoder that made this one
+    const int64_t position = ad ? media_sequence % config_.ad_break_every - (config_.ad_break_every - config_.ad_break_segments)
+                                : media_sequence;
+    const int64_t timeline = ad ? AD_TIMELINE : MAIN_TIMELINE;
+    const int64_t frames = static_cast<int64_t>(config_.segment_ms) * config_.frame_rate / 1000;
+    const int64_t frame_ticks = CLOCK / config_.frame_rate;
+    const int64_t gop = config_.gop_frames;
+    const int64_t first_frame = position * frames;
+
+    std::string out;
+    std::vector<uint8_t> section;
+    tsduck_transport::ProgramAssociationTable pat;
+    pat.transport_stream_id = ad ? 2 : 1;
+    pat.version = ad ? 1 : 0;
+    pat.programs.push_back({ 1, PMT_PID });
+    tsduck_transport::BuildPATSection(pat, section);
+    WriteSection(out, tsduck_transport::PAT_PID, section, static_cast<uint64_t>(position));
+    tsduck_transport::ProgramMapTable pmt;
+    pmt.program_number = 1;
+    pmt.version = pat.version;
+    pmt.pcr_pid = VIDEO_PID;
+    pmt.streams.push_back({ 0x1B, VIDEO_PID, {} });     // H.264
+    pmt.streams.push_back({ 0x0F, AUDIO_PID, {} });     // AAC in ADTS
+    tsduck_transport::BuildPMTSection(pmt, section);
+    WriteSection(out, PMT_PID, section, static_cast<uint64_t>(position));
+
+    // Audio frames that start within the segment, each ahead of the video frame it plays with
+    const int64_t segment_start = first_frame * frame_ticks;
+    const int64_t segment_end = segment_start + frames * frame_ticks;
+    int64_t audio_frame = (segment_start + AUDIO_FRAME_TICKS - 1) / AUDIO_FRAME_TICKS;
+    const int64_t audio_end = (segment_end + AUDIO_FRAME_TICKS - 1) / AUDIO_FRAME_TICKS;
+
+    std::vector<uint8_t> pes;
+    for (int64_t frame = first_frame; frame < first_frame + frames; ++frame) {
+        const int64_t dts = frame * frame_ticks;
+        for (; audio_frame < audio_end && audio_frame * AUDIO_FRAME_TICKS < dts + frame_ticks; ++audio_frame) {
+            const size_t length = audio_frame_bytes_;
+            const size_t pes_length = 3 + 5 + length;
+            pes = { 0x00, 0x00, 0x01, 0xC0, static_cast<uint8_t>(pes_length >> 8), static_cast<uint8_t>(pes_length), 0x84, 0x80, 0x05 };
+            PushTimestamp(pes, 0x20, static_cast<uint64_t>(timeline + audio_frame * AUDIO_FRAME_TICKS));
+            // ADTS: AAC LC, 48 kHz, stereo
+            pes.insert(pes.end(), { 0xFF, 0xF1, 0x4C, static_cast<uint8_t>(0x80 | ((length >> 11) & 0x03)),
+                                    static_cast<uint8_t>(length >> 3), static_cast<uint8_t>(((length & 0x07) << 5) | 0x1F), 0xFC });
+            PushFiller(pes, length - ADTS_HEADER, static_cast<uint64_t>(audio_frame));
+            WritePes(out, AUDIO_PID, pes, static_cast<uint64_t>(audio_frame) * audio_pes_packets_, nullptr, false);
+        }
+
+        const size_t in_gop = static_cast<size_t>(frame % gop);
+        const bool key_frame = in_gop == 0;
+        pes = { 0x00, 0x00, 0x01, 0xE0, 0x00, 0x00, 0x84, 0xC0, 0x0A };
+        PushTimestamp(pes, 0x30, static_cast<uint64_t>(timeline + dts + frame_ticks));  // One frame of reordering delay
+        PushTimestamp(pes, 0x10, static_cast<uint64_t>(timeline + dts));
+        const size_t es_start = pes.size();
+        pes.insert(pes.end(), START_CODE, START_CODE + sizeof(START_CODE));
+        pes.insert(pes.end(), ACCESS_UNIT_DELIMITER, ACCESS_UNIT_DELIMITER + sizeof(ACCESS_UNIT_DELIMITER));
+        if (key_frame) {
+            pes.insert(pes.end(), START_CODE, START_CODE + sizeof(START_CODE));
+            pes.insert(pes.end(), SPS, SPS + sizeof(SPS));
+            pes.insert(pes.end(), START_CODE, START_CODE + sizeof(START_CODE));
+            pes.insert(pes.end(), PPS, PPS + sizeof(PPS));
+        }
+        pes.insert(pes.end(), START_CODE, START_CODE + sizeof(START_CODE));
+        const uint8_t* slice = key_frame ? IDR_SLICE : P_SLICE;
+        pes.insert(pes.end(), slice, slice + sizeof(IDR_SLICE));
+        PushFiller(pes, layout.frame_bytes[in_gop] - (pes.size() - es_start), static_cast<uint64_t>(frame));
+        const uint64_t pcr = static_cast<uint64_t>(timeline + dts - PCR_LEAD);
+        const uint64_t continuity = static_cast<uint64_t>(frame / gop) * layout.gop_packets + layout.packets_before[in_gop];
+        WritePes(out, VIDEO_PID, pes, continuity, &pcr, key_frame);
+    }
+    return out;
+}
+
+std::string HlsOrigin::ProgramDateTime(int64_t media_sequence) const {
+    auto at = wall_start_ + std::chrono::milliseconds(media_sequence * config_.segment_ms);
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(at.time_since_epoch()).count();
+    std::time_t seconds = static_cast<std::time_t>(ms / 1000);
+    std::tm utc = {};
+    gmtime_r(&seconds, &utc);
+    char text[64];
+    std::snprintf(text, sizeof(text), "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ", utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday,
+                  utc.tm_hour, utc.tm_min, utc.tm_sec, static_cast<int>(ms % 1000));
+    return text;
+}
+
+std::string HlsOrigin::MasterPlaylist() const {
+    char frame_rate[16];
+    std::snprintf(frame_rate, sizeof(frame_rate), "%.3f", static_cast<double>(config_.frame_rate));
+    std::string playlist = "#EXTM3U\n#EXT-X-INDEPENDENT-SEGMENTS\n";
+    for (size_t i = 0; i < config_.variants.size(); ++i) {
+        const HlsVariant& variant = config_.variants[i];
+        const Layout& layout = layouts_[i];
+        // What the segments carry on the wire, TS overhead included
+        uint64_t bits = layout.gop_packets * PACKET_SIZE * 8 * static_cast<uint64_t>(config_.frame_rate) / static_cast<uint64_t>(config_.gop_frames) +
+                        audio_pes_packets_ * PACKET_SIZE * 8 * CLOCK / AUDIO_FRAME_TICKS +
+                        2 * PACKET_SIZE * 8 * 1000 / static_cast<uint64_t>(config_.segment_ms);
+        playlist += "#EXT-X-MEDIA:TYPE=VIDEO,GROUP-ID=\"" + variant.name + "\",NAME=\"" + variant.name +
+                    "\",AUTOSELECT=YES,DEFAULT=" + (i == 0 ? "YES" : "NO") + "\n";
+        playlist += "#EXT-X-STREAM-INF:BANDWIDTH=" + std::to_string(bits) + ",RESOLUTION=" + std::to_string(variant.width) + "x" +
+                    std::to_string(variant.height) + ",CODECS=\"avc1.64001F,mp4a.40.2\",VIDEO=\"" + variant.name +
+                    "\",FRAME-RATE=" + frame_rate + "\n";
+        playlist += variant.name + "/live.m3u8\n";
+    }
+    return playlist;
+}
+
+std::string HlsOrigin::MediaPlaylist(size_t variant, int64_t live_edge) const {
+    const int64_t first = std::max<int64_t>(0, live_edge - config_.window_segments);
+    char duration[16];
+    std::snprintf(duration, sizeof(duration), "%.3f", config_.segment_ms / 1000.0);
+    auto boundary = [this](int64_t sequence) { return sequence > 0 && IsAd(sequence) != IsAd(sequence - 1); };
+
+    int64_t discontinuities = 0;
+    for (int64_t sequence = 1; sequence < first; ++sequence) {
+        discontinuities += boundary(sequence) ? 1 : 0;
+    }
+    std::string playlist = "#EXTM3U\n#EXT-X-VERSION:3\n";
+    playlist += "#EXT-X-TARGETDURATION:" + std::to_string((config_.segment_ms + 999) / 1000) + "\n";
+    playlist += "#EXT-X-MEDIA-SEQUENCE:" + std::to_string(first) + "\n";
+    playlist += "#EXT-X-DISCONTINUITY-SEQUENCE:" + std::to_string(discontinuities) + "\n";
+    for (int64_t sequence = first; sequence < live_edge; ++sequence) {
+        if (boundary(sequence)) {
+            playlist += "#EXT-X-DISCONTINUITY\n";
+        }
+        if (IsAd(sequence) && (sequence == 0 || !IsAd(sequence - 1))) {
+            // As Twitch marks a stitched ad pod
+            char length[16];
+            std::snprintf(length, sizeof(length), "%.3f", config_.ad_break_segments * config_.segment_ms / 1000.0);
+            playlist += "#EXT-X-DATERANGE:ID=\"stitched-ad-" + std::to_string(sequence) + "\",CLASS=\"twitch-stitched-ad\",START-DATE=\"" +
+                        ProgramDateTime(sequence) + "\",DURATION=" + length + ",X-TV-TWITCH-AD-POD-LENGTH=\"" +
+                        std::to_string(config_.ad_break_segments) + "\"\n";
+        }
+        playlist += "#EXT-X-PROGRAM-DATE-TIME:" + ProgramDateTime(sequence) + "\n";
+        playlist += "#EXTINF:" + std::string(duration) + (IsAd(sequence) ? ",Amazon|" + std::to_string(sequence) : ",live") + "\n";
+        playlist += "seg/" + std::to_string(sequence) + ".ts\n";
+    }
+    // Absolute, as Twitch lists them; not across a discontinuity, which Twitch does not prefetch either
+    for (int64_t sequence = live_edge; sequence < live_edge + config_.prefetch_segments && !boundary(sequence); ++sequence) {
+        playlist += "#EXT-X-TWITCH-PREFETCH:" + SegmentUrl(variant, sequence) + "\n";
+    }
+    return playlist;
+}
+
+void HlsOrigin::Respond(const LoopbackRequest& request, LoopbackResponse& response) {
+    std::string path = request.path.substr(0, request.path.find('?'));
+    if (path == "/master.m3u8") {
+        stats_.master_playlists++;
+        response.headers.emplace_back("Content-Type", "application/vnd.apple.mpegurl");
+        response.body = MasterPlaylist();
+        return;
+    }
+
+    size_t slash = path.find('/', 1);
+    size_t variant = 0;
+    while (slash != std::string::npos && variant < config_.variants.size() && config_.variants[variant].name != path.substr(1, slash - 1)) {
+        variant++;
+    }
+    if (slash == std::string::npos || variant == config_.variants.size()) {
+        stats_.not_found++;
+        response.status = 404;
+        return;
+    }
+    std::string rest = path.substr(slash);
+    const int64_t live_edge = LiveEdge();
+    if (rest == "/live.m3u8") {
+        stats_.playlists++;
+        response.headers.emplace_back("Content-Type", "application/vnd.apple.mpegurl");
+        response.body = MediaPlaylist(variant, live_edge);
+        return;
+    }
+
+    long long sequence = 0;
+    char tail = 0;
+    if (std::sscanf(rest.c_str(), "/seg/%lld.t%c", &sequence, &tail) != 2 || tail != 's' ||
+        sequence < std::max<int64_t>(0, live_edge - 2 * config_.window_segments) || sequence >= live_edge + config_.prefetch_segments) {
+        stats_.not_found++;
+        response.status = 404;
+        return;
+    }
+    stats_.segments++;
+    response.headers.emplace_back("Content-Type", "video/mp2t");
+    response.body = Segment(variant, sequence);
+    if (sequence >= live_edge) {
+        // Still being produced: bytes go out as the encoder would have them, spread over the segment
+        stats_.prefetched++;
+        const auto begin = start_ + std::chrono::milliseconds(static_cast<int64_t>(sequence) * config_.segment_ms);
+        const uint64_t size = response.body.size();
+        const uint64_t segment_us = static_cast<uint64_t>(config_.segment_ms) * 1000;
+        response.chunked = true;
+        response.ready_at = [begin, size, segment_us](size_t end_offset) {
+            return begin + std::chrono::microseconds(end_offset * segment_us / size);
+        };
+    }
+}
+
+} // namespace tardsplaya
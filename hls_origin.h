@@ -0,0 +1,108 @@
+#pragma once
+// Live HLS origin on the loopback server, for benches and tests (POSIX, not part of the Windows build)
+// Serves a master playlist and, per variant, a sliding-window live media playlist that advances on a
+// wall clock, with program date times, Twitch-style stitched ad breaks between discontinuities and
+// #EXT-X-TWITCH-PREFETCH entries streamed while they are produced. Segments are real MPEG-TS: PAT
+// and PMT, H.264 access units (AUD, SPS/PPS and an IDR slice at each GOP start) in PES packets with
+// PTS/DTS and a PCR, and ADTS AAC, sized to the variant's bitrate, with continuity counters and
+// timestamps that carry on from one segment to the next. An ad break is another encoder: its own
+// timeline, counters and table versions. Network conditions are those of GetServer().
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <memory>
+
+#include "loopback_server.h"
+
+namespace tardsplaya {
+
+    struct HlsVariant {
+        std::string name;                       // Path of its playlist and segments
+        int width = 0;
+        int height = 0;
+        uint64_t video_bits_per_second = 0;
+    };
+
+    struct HlsOriginConfig {
+        int segment_ms = 2000;
+        int window_segments = 6;                // Listed in the media playlist
+        int live_segments = 300;                // Produced before Start, at least a window's worth
+        int frame_rate = 30;                    // Whole frames per second
+        int gop_frames = 60;                    // Key frame interval; a segment should hold whole GOPs
+        int key_frame_weight = 6;               // An IDR frame is this many times the size of a P frame
+        uint64_t audio_bits_per_second = 160000;
+        std::vector<HlsVariant> variants = {
+            { "720p30", 1280, 720, 3000000 },
+            { "480p30", 852, 480, 1400000 },
+            { "160p30", 284, 160, 230000 },
+        };
+        int prefetch_segments = 2;              // Upcoming segments advertised with #EXT-X-TWITCH-PREFETCH
+        int ad_break_every = 0;                 // Segments from the start of one ad break to the next; 0 for none
+        int ad_break_segments = 0;              // Ad segments at the end of each such period
+    };
+
+    class HlsOrigin {
+    public:
+        using Config = HlsOriginConfig;
+
+        static constexpr uint16_t PMT_PID = 0x1000;
+        static constexpr uint16_t VIDEO_PID = 0x100;
+        static constexpr uint16_t AUDIO_PID = 0x101;
+
+        struct Stats {
+            std::atomic<uint64_t> master_playlists{0};
+            std::atomic<uint64_t> playlists{0};
+            std::atomic<uint64_t> segments{0};
+            std::atomic<uint64_t> prefetched{0};        // Requested while still being produced
+            std::atomic<uint64_t> not_found{0};         // Out of the window, too far ahead, or unknown
+        };
+
+        explicit HlsOrigin(const Config& config = Config());
+
+        bool Start();
+        void Stop();
+
+        std::string MasterUrl() const;
+        std::string PlaylistUrl(size_t variant) const;
+        std::string SegmentUrl(size_t variant, int64_t media_sequence) const;
+
+        // Segments completed so far; the newest listed one is LiveEdge() - 1
+        int64_t LiveEdge() const;
+        bool IsAd(int64_t media_sequence) const;
+
+        // The bytes served for a segment
+        std::string Segment(size_t variant, int64_t media_sequence) const;
+
+        // Loopback server the origin runs on; set its network conditions before Start
+        LoopbackServer& GetServer() { return *server_; }
+        const Stats& GetStats() const { return stats_; }
+        const Config& GetConfig() const { return config_; }
+
+    private:
+        // Frame sizes of one GOP of a variant, repeated for the whole stream
+        struct Layout {
+            std::vector<size_t> frame_bytes;        // Elementary stream bytes
+            std::vector<uint64_t> packets_before;   // Video packets before each frame of the GOP
+            uint64_t gop_packets = 0;
+        };
+
+        Config config_;
+        std::vector<Layout> layouts_;
+        size_t audio_frame_bytes_ = 0;
+        uint64_t audio_pes_packets_ = 0;
+        std::chrono::steady_clock::time_point start_;       // Segment 0 began
+        std::chrono::system_clock::time_point wall_start_;  // The same moment in program date time
+        std::unique_ptr<LoopbackServer> server_;
+        Stats stats_;
+
+        std::string MasterPlaylist() const;
+        std::string MediaPlaylist(size_t variant, int64_t live_edge) const;
+        std::string ProgramDateTime(int64_t media_sequence) const;
+        void Respond(const LoopbackRequest& request, LoopbackResponse& response);
+    };
+
+} // namespace tardsplaya
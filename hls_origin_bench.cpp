@@ -0,0 +1,398 @@
+// Live HLS origin with emulated network conditions, and the segment fetch path against it
+// Checks first that the origin's segments are MPEG-TS a player would take: PAT and PMT with valid
+// CRCs, H.264 access units with a key frame opening every GOP and every segment, timestamps, PCR and
+// continuity counters that carry on across segments, ad segments on a timeline of their own, and the
+// bitrate the master playlist states. Then the playlists: variants, the sliding window, ad break
+// discontinuities and prefetch entries. Last, a client follows the live edge the way the router does
+// (polls every half segment, downloads new segments in order against a deadline, skips to live when
+// one is late) over a clean link, a long and jittery round trip, a capped link, packet loss and
+// stalling responses, and reports time to first byte, download time and throughput.
+// The router and the TX-Queue producer need Windows; this drives the fetch layers they share.
+//
+// Build: g++ -std=c++17 -O2 -pthread hls_origin_bench.cpp hls_origin.cpp psi_tables.cpp ts_crc32.cpp access_unit_parser.cpp ts_packet.cpp playlist_parser.cpp tsduck_hls_wrapper.cpp deadline_fetcher.cpp http_client.cpp http_client_posix.cpp inflater.cpp loopback_server.cpp -o hls_origin_bench
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <functional>
+#include <chrono>
+#include <thread>
+#include "hls_origin.h"
+#include "psi_tables.h"
+#include "access_unit_parser.h"
+#include "playlist_parser.h"
+#include "tsduck_hls_wrapper.h"
+#include "deadline_fetcher.h"
+#include "http_client.h"
+
+using tardsplaya::HlsOrigin;
+using tardsplaya::HlsOriginConfig;
+using tardsplaya::HttpClient;
+using tardsplaya::HttpResponse;
+using tardsplaya::DeadlineFetcher;
+using tardsplaya::LoopbackServer;
+using tsduck_transport::AccessUnitParser;
+using tsduck_transport::PacketMeta;
+
+namespace {
+
+    const size_t PACKET_SIZE = 188;
+    const auto FOLLOW_TIME = std::chrono::seconds(6);
+
+    bool Check(bool condition, const std::string& what) {
+        std::cout << "  " << (condition ? "PASS  " : "FAIL  ") << what << std::endl;
+        return condition;
+    }
+
+    std::string Text(const std::vector<uint8_t>& body) {
+        return std::string(body.begin(), body.end());
+    }
+
+    std::wstring Wide(const std::string& text) {
+        return std::wstring(text.begin(), text.end());
+    }
+
+    uint16_t Pid(const uint8_t* packet) {
+        return static_cast<uint16_t>(((packet[1] & 0x1F) << 8) | packet[2]);
+    }
+
+    // What a player's demuxer sees in a run of segments played back to back
+    struct Demuxed {
+        bool synced = true;
+        bool tables = true;                 // Every segment opens with a valid PAT and PMT
+        uint16_t transport_stream_id = 0;
+        uint8_t version = 0xFF;
+        size_t continuity_errors = 0;
+        size_t segments_opening_on_key_frame = 0;
+        bool pcr_rising = true;
+        uint64_t first_pcr = 0;
+        uint64_t key_frames = 0;
+        uint64_t access_units = 0;
+        double frame_rate = 0.0;
+        uint32_t key_frame_interval_ms = 0;
+    };
+
+    Demuxed Demux(const std::vector<std::string>& segments) {
+        Demuxed result;
+        AccessUnitParser parser;
+        uint64_t last_pcr = 0;
+        bool have_pcr = false;
+        for (const std::string& segment : segments) {
+            const uint8_t* data = reinterpret_cast<const uint8_t*>(segment.data());
+            result.synced = result.synced && segment.size() % PACKET_SIZE == 0;
+
+            tsduck_transport::ProgramAssociationTable pat;
+            tsduck_transport::ProgramMapTable pmt;
+            const uint8_t* section;
+            size_t size;
+            bool tables = segment.size() >= 2 * PACKET_SIZE &&
+                          tsduck_transport::FindSectionInPacket(data, section, size) && tsduck_transport::ParsePATSection(section, size, pat) &&
+                          pat.GetFirstPMTPID() == HlsOrigin::PMT_PID && Pid(data + PACKET_SIZE) == HlsOrigin::PMT_PID &&
+                          tsduck_transport::FindSectionInPacket(data + PACKET_SIZE, section, size) &&
+                          tsduck_transport::ParsePMTSection(section, size, pmt) && pmt.pcr_pid == HlsOrigin::VIDEO_PID &&
+                          pmt.streams.size() == 2 && pmt.streams[0].stream_type == 0x1B && pmt.streams[1].stream_type == 0x0F;
+            result.tables = result.tables && tables;
+            result.transport_stream_id = pat.transport_stream_id;
+            result.version = pmt.version;
+
+            bool first_access_unit = true;
+            for (size_t offset = 0; offset + PACKET_SIZE <= segment.size(); offset += PACKET_SIZE) {
+                const uint8_t* packet = data + offset;
+                result.synced = result.synced && packet[0] == 0x47;
+                // PCR: adaptation field present with the PCR flag
+                if ((packet[3] & 0x20) && packet[4] >= 7 && (packet[5] & 0x10)) {
+                    uint64_t pcr = (static_cast<uint64_t>(packet[6]) << 25) | (static_cast<uint64_t>(packet[7]) << 17) |
+                                   (static_cast<uint64_t>(packet[8]) << 9) | (static_cast<uint64_t>(packet[9]) << 1) | (packet[10] >> 7);
+                    result.pcr_rising = result.pcr_rising && (!have_pcr || pcr > last_pcr);
+                    if (!have_pcr) {
+                        result.first_pcr = pcr;
+                    }
+                    last_pcr = pcr;
+                    have_pcr = true;
+                }
+                PacketMeta meta = PacketMeta::FromHeader(packet);
+                uint32_t events = parser.ParsePacket(packet, meta);
+                if (events & AccessUnitParser::EVENT_CONTINUITY_ERROR) {
+                    result.continuity_errors++;
+                }
+                if (first_access_unit && (events & AccessUnitParser::EVENT_ACCESS_UNIT_START)) {
+                    first_access_unit = false;
+                    result.segments_opening_on_key_frame += (events & AccessUnitParser::EVENT_KEY_FRAME) ? 1 : 0;
+                }
+            }
+        }
+        result.key_frames = parser.GetKeyFrameCount();
+        result.access_units = parser.GetAccessUnitCount();
+        result.frame_rate = parser.GetFrameRate();
+        result.key_frame_interval_ms = parser.GetKeyFrameIntervalMs();
+        return result;
+    }
+
+    bool CheckSegments() {
+        std::cout << "=== Segments ===" << std::endl;
+        bool ok = true;
+        HlsOriginConfig config;
+        config.ad_break_every = 5;          // Segments 3 and 4 of every 5 are an ad break
+        config.ad_break_segments = 2;
+        HlsOrigin origin(config);
+        const int frames = config.segment_ms * config.frame_rate / 1000;
+
+        std::vector<std::string> main = { origin.Segment(0, 0), origin.Segment(0, 1), origin.Segment(0, 2) };
+        Demuxed content = Demux(main);
+        ok = Check(content.synced && content.tables, "every packet in sync, PAT and PMT at the start of each segment with valid CRCs") && ok;
+        ok = Check(content.continuity_errors == 0, "continuity counters carry on across segment boundaries") && ok;
+        ok = Check(content.access_units == 3u * frames, "an access unit per frame: " + std::to_string(content.access_units)) && ok;
+        ok = Check(content.key_frames == 3u * frames / config.gop_frames && content.segments_opening_on_key_frame == 3,
+                   "a key frame opens every GOP and every segment") && ok;
+        ok = Check(content.frame_rate > config.frame_rate - 0.01 && content.frame_rate < config.frame_rate + 0.01 &&
+                   content.key_frame_interval_ms == static_cast<uint32_t>(config.gop_frames * 1000 / config.frame_rate),
+                   "frame rate and key frame interval from the timestamps") && ok;
+        ok = Check(content.pcr_rising, "PCR rises steadily across segments") && ok;
+
+        std::vector<std::string> ads = { origin.Segment(0, 3), origin.Segment(0, 4) };
+        Demuxed ad = Demux(ads);
+        ok = Check(origin.IsAd(3) && origin.IsAd(4) && !origin.IsAd(5), "segments 3 and 4 are the ad break") && ok;
+        ok = Check(ad.synced && ad.tables && ad.continuity_errors == 0 && ad.segments_opening_on_key_frame == 2,
+                   "the ad break plays through on its own") && ok;
+        ok = Check(ad.transport_stream_id != content.transport_stream_id && ad.version != content.version &&
+                   ad.first_pcr != content.first_pcr, "ad break: another transport stream, table version and clock") && ok;
+        std::vector<std::string> resumed = { origin.Segment(0, 5), origin.Segment(0, 6) };
+        Demuxed after = Demux(resumed);
+        ok = Check(after.tables && after.continuity_errors == 0 && after.transport_stream_id == content.transport_stream_id,
+                   "content resumes after the break") && ok;
+
+        std::cout << std::endl << std::left << std::setw(12) << "  variant" << std::right << std::setw(16) << "nominal kbit/s"
+                  << std::setw(16) << "on wire kbit/s" << std::setw(12) << "overhead" << std::endl;
+        bool rates = true;
+        for (size_t i = 0; i < config.variants.size(); ++i) {
+            double nominal = static_cast<double>(config.variants[i].video_bits_per_second + config.audio_bits_per_second);
+            double wire = origin.Segment(i, 0).size() * 8.0 * 1000.0 / config.segment_ms;
+            std::cout << std::left << std::setw(12) << ("  " + config.variants[i].name) << std::right << std::fixed << std::setprecision(0)
+                      << std::setw(16) << nominal / 1000 << std::setw(16) << wire / 1000 << std::setprecision(1)
+                      << std::setw(11) << (wire / nominal - 1.0) * 100 << "%" << std::endl;
+            rates = rates && wire >= nominal && wire < nominal * (i == 0 ? 1.06 : 1.2);
+        }
+        ok = Check(rates, "every variant's segments carry its bitrate plus TS overhead, which weighs most at low rates") && ok;
+        return ok;
+    }
+
+    bool CheckPlaylists() {
+        std::cout << std::endl << "=== Playlists ===" << std::endl;
+        bool ok = true;
+        HlsOriginConfig config;
+        config.segment_ms = 1000;
+        config.gop_frames = 30;
+        config.ad_break_every = 6;
+        config.ad_break_segments = 2;
+        HlsOrigin origin(config);
+        if (!Check(origin.Start(), "origin listening")) {
+            return false;
+        }
+        HttpClient client(tardsplaya::CreatePlatformHttpBackend());
+        std::vector<uint8_t> body;
+
+        bool fetched = client.Get(origin.MasterUrl(), body);
+        std::vector<PlaylistQuality> qualities = ParseM3U8MasterPlaylist(Wide(Text(body)), Wide(origin.MasterUrl()));
+        bool listed = fetched && qualities.size() == config.variants.size();
+        for (size_t i = 0; listed && i < qualities.size(); ++i) {
+            listed = qualities[i].url == Wide(origin.PlaylistUrl(i)) && qualities[i].bandwidth > config.variants[i].video_bits_per_second &&
+                     qualities[i].resolution == Wide(std::to_string(config.variants[i].width) + "x" + std::to_string(config.variants[i].height));
+        }
+        ok = Check(listed, "master playlist lists every variant with bandwidth and resolution") && ok;
+
+        tsduck_hls::PlaylistParser parser;
+        int64_t edge = origin.LiveEdge();
+        ok = Check(client.Get(origin.PlaylistUrl(0), body) && parser.ParsePlaylist(Text(body)), "media playlist parses") && ok;
+        std::string playlist = Text(body);
+        ok = Check(parser.GetSegmentCount() == static_cast<size_t>(config.window_segments) &&
+                   parser.GetMediaSequence() + config.window_segments == edge, "a full window of the newest segments") && ok;
+        ok = Check(parser.HasDiscontinuities() && playlist.find("CLASS=\"twitch-stitched-ad\"") != std::string::npos &&
+                   playlist.find("#EXT-X-PROGRAM-DATE-TIME:") != std::string::npos, "ad break between discontinuities, program date times") && ok;
+        const auto& prefetch = parser.GetPrefetchSegments();
+        ok = Check(prefetch.size() <= static_cast<size_t>(config.prefetch_segments) &&
+                   (prefetch.empty() || prefetch[0].url == Wide(origin.SegmentUrl(0, edge))), "prefetch entries follow the newest segment") && ok;
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(config.segment_ms + 100));
+        tsduck_hls::PlaylistParser later;
+        ok = Check(client.Get(origin.PlaylistUrl(0), body) && later.ParsePlaylist(Text(body)) &&
+                   later.GetMediaSequence() > parser.GetMediaSequence(), "the window slides with the clock") && ok;
+
+        int64_t newest = later.GetMediaSequence() + static_cast<int64_t>(later.GetSegmentCount()) - 1;
+        ok = Check(client.Get(origin.SegmentUrl(0, newest), body) && Text(body) == origin.Segment(0, newest), "a listed segment as generated") && ok;
+
+        // The segment in production arrives as it is made, ending about when it is complete
+        int64_t producing = origin.LiveEdge();
+        auto start = std::chrono::steady_clock::now();
+        bool whole = client.Get(origin.SegmentUrl(0, producing), body) && Text(body) == origin.Segment(0, producing);
+        bool complete_now = origin.LiveEdge() > producing;
+        auto took = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        ok = Check(whole && complete_now && origin.GetStats().prefetched == 1,
+                   "a prefetched segment streams while it is produced (" + std::to_string(took) + " ms)") && ok;
+
+        HttpResponse response;
+        client.Get(origin.SegmentUrl(0, std::max<int64_t>(0, origin.LiveEdge() - 3 * config.window_segments)), body, nullptr, &response);
+        ok = Check(response.status == 404, "segments long out of the window are gone") && ok;
+        client.Get(origin.SegmentUrl(0, origin.LiveEdge() + config.prefetch_segments), body, nullptr, &response);
+        ok = Check(response.status == 404, "segments not yet advertised do not exist") && ok;
+        origin.Stop();
+        return ok;
+    }
+
+    struct Scenario {
+        std::string name;
+        std::function<void(LoopbackServer&)> apply;
+    };
+
+    struct Followed {
+        uint64_t downloads = 0;
+        uint64_t intact = 0;            // Byte for byte what the origin generated
+        uint64_t late = 0;
+        uint64_t failed = 0;
+        uint64_t skipped = 0;           // Passed over to get back to the live edge
+        uint64_t bytes = 0;
+        double download_seconds = 0.0;
+        DeadlineFetcher::Stats stats;
+        uint64_t lost_segments = 0;
+        uint64_t stalls = 0;
+
+        double Mbps() const { return download_seconds > 0 ? bytes * 8.0 / download_seconds / 1e6 : 0.0; }
+    };
+
+    // The router's loop: poll every half segment, newest two entries at startup, downloads in
+    // order against a deadline, and back to the live edge after a late one
+    Followed Follow(const Scenario& scenario) {
+        HlsOriginConfig config;
+        config.segment_ms = 1000;
+        config.gop_frames = 30;
+        config.prefetch_segments = 0;
+        HlsOrigin origin(config);
+        scenario.apply(origin.GetServer());
+        origin.Start();
+
+        HttpClient client(tardsplaya::CreatePlatformHttpBackend());
+        DeadlineFetcher fetcher(client);
+        Followed result;
+        int64_t next = -1;
+        std::vector<uint8_t> body;
+        auto end = std::chrono::steady_clock::now() + FOLLOW_TIME;
+        while (std::chrono::steady_clock::now() < end) {
+            auto poll_at = std::chrono::steady_clock::now() + std::chrono::milliseconds(config.segment_ms / 2);
+            tsduck_hls::PlaylistParser parser;
+            if (client.Get(origin.PlaylistUrl(0), body) && parser.ParsePlaylist(Text(body)) && parser.GetSegmentCount() > 0) {
+                const int64_t first = parser.GetMediaSequence();
+                const int64_t newest = first + static_cast<int64_t>(parser.GetSegmentCount()) - 1;
+                if (next < 0) {
+                    next = std::max(first, newest - 1);
+                }
+                if (next < first) {
+                    result.skipped += static_cast<uint64_t>(first - next);
+                    next = first;
+                }
+                while (next <= newest && std::chrono::steady_clock::now() < end) {
+                    std::string segment;
+                    auto start = std::chrono::steady_clock::now();
+                    auto deadline = start + std::chrono::milliseconds(2 * config.segment_ms);
+                    DeadlineFetcher::Result fetched = fetcher.Get(origin.SegmentUrl(0, next), deadline, [&](const uint8_t* data, size_t size) {
+                        segment.append(reinterpret_cast<const char*>(data), size);
+                        return true;
+                    });
+                    if (fetched == DeadlineFetcher::Result::OK) {
+                        result.downloads++;
+                        result.intact += segment == origin.Segment(0, next) ? 1 : 0;
+                        result.bytes += segment.size();
+                        result.download_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                        next++;
+                    } else {
+                        result.late += fetched == DeadlineFetcher::Result::LATE ? 1 : 0;
+                        result.failed += fetched == DeadlineFetcher::Result::FAILED ? 1 : 0;
+                        // Behind now: give up on what is left and go on from the newest entry
+                        result.skipped += static_cast<uint64_t>(newest - next);
+                        next = newest + 1;
+                    }
+                }
+            }
+            std::this_thread::sleep_until(poll_at);
+        }
+        result.stats = fetcher.GetStats();
+        result.lost_segments = origin.GetServer().lost_segments;
+        result.stalls = origin.GetServer().stalls;
+        origin.Stop();
+        return result;
+    }
+
+    bool CheckFollowing() {
+        std::cout << std::endl << "=== Following the live edge, 1 s segments of 3.2 Mbit/s, deadline 2 s ===" << std::endl;
+        const uint64_t capped_bytes_per_second = 750000;
+        std::vector<Scenario> scenarios = {
+            { "clean, 5 ms RTT", [](LoopbackServer& server) { server.rtt_ms = 5; } },
+            { "80 ms RTT, 60 ms jitter", [](LoopbackServer& server) {
+                server.handshake_ms = 160;
+                server.rtt_ms = 80;
+                server.jitter_ms = 60;
+            } },
+            { "6 Mbit/s link", [=](LoopbackServer& server) {
+                server.rtt_ms = 20;
+                server.total_bytes_per_second = capped_bytes_per_second;
+            } },
+            { "0.5% packet loss", [](LoopbackServer& server) {
+                server.rtt_ms = 20;
+                server.loss_rate = 0.005;
+            } },
+            { "stalls of 3 s", [](LoopbackServer& server) {
+                server.rtt_ms = 20;
+                server.stall_rate = 0.5;
+                server.stall_ms = 3000;
+            } },
+        };
+
+        std::vector<Followed> runs;
+        for (const Scenario& scenario : scenarios) {
+            runs.push_back(Follow(scenario));
+        }
+
+        std::cout << std::left << std::setw(26) << "  network" << std::right << std::setw(6) << "ok" << std::setw(6) << "late"
+                  << std::setw(8) << "skipped" << std::setw(10) << "TTFB p50" << std::setw(12) << "fetch p50" << std::setw(11) << "fetch max"
+                  << std::setw(9) << "Mbit/s" << std::setw(7) << "lost" << std::setw(8) << "stalls" << std::endl;
+        for (size_t i = 0; i < runs.size(); ++i) {
+            const Followed& run = runs[i];
+            std::cout << std::left << std::setw(26) << ("  " + scenarios[i].name) << std::right << std::setw(6) << run.downloads
+                      << std::setw(6) << run.late << std::setw(8) << run.skipped << std::fixed << std::setprecision(0)
+                      << std::setw(7) << run.stats.time_to_first_byte.Percentile(0.5) << " ms"
+                      << std::setw(9) << run.stats.download_time.Percentile(0.5) << " ms"
+                      << std::setw(8) << run.stats.download_time.GetMax() << " ms" << std::setprecision(1)
+                      << std::setw(9) << run.Mbps() << std::setw(7) << run.lost_segments << std::setw(8) << run.stalls << std::endl;
+        }
+        std::cout << "  (TTFB and fetch times are bucket bounds; segments are fetched one at a time, so throughput is that of one connection)" << std::endl;
+        std::cout << std::endl;
+
+        bool ok = true;
+        const Followed& clean = runs[0];
+        const Followed& far = runs[1];
+        const Followed& capped = runs[2];
+        const Followed& lossy = runs[3];
+        const Followed& stalled = runs[4];
+        bool intact = true;
+        for (const Followed& run : runs) {
+            intact = intact && run.intact == run.downloads;
+        }
+        ok = Check(intact, "every segment delivered is byte for byte the generated one") && ok;
+        ok = Check(clean.downloads >= 5 && clean.late == 0 && clean.skipped == 0, "clean link: every segment, none late") && ok;
+        ok = Check(far.late == 0 && far.stats.time_to_first_byte.Percentile(0.5) >= 80, "long round trip: slower first bytes, still in time") && ok;
+        ok = Check(capped.late == 0 && capped.Mbps() < capped_bytes_per_second * 8 * 1.1 / 1e6 && capped.Mbps() > 4.0,
+                   "capped link: throughput held to the cap") && ok;
+        ok = Check(lossy.lost_segments > 0 && lossy.stats.download_time.GetMax() > clean.stats.download_time.GetMax(),
+                   "lossy link: retransmission timeouts lengthen downloads") && ok;
+        ok = Check(stalled.stalls > 0 && stalled.late > 0 && stalled.downloads > 0, "stalling origin: stuck segments are given up at the deadline, the rest play") && ok;
+        return ok;
+    }
+
+} // namespace
+
+int main() {
+    bool ok = CheckSegments();
+    ok = CheckPlaylists() && ok;
+    ok = CheckFollowing() && ok;
+    std::cout << std::endl << (ok ? "All checks passed" : "SOME CHECKS FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,146 @@
+#include "hls_ts_converter.h"
+#include <algorithm>
+#include <cstring>
+
+namespace tsduck_transport {
+
+HLSToTSConverter::HLSToTSConverter() {
+    Reset();
+}
+
+void HLSToTSConverter::Reset() {
+    continuity_counter_ = 0;
+    
+    // Frame Number Tagging: access unit parser restarts with the stream
+    access_unit_parser_.Reset();
+    segment_frame_counter_ = 0;
+    
+    // Reset sync statistics
+    last_sync_scan_ = SyncScanResult();
+    total_bytes_skipped_ = 0;
+    total_resyncs_ = 0;
+}
+
+std::vector<TSPacket> HLSToTSConverter::ConvertSegment(const std::vector<uint8_t>& hls_data, bool is_first_segment) {
+    std::vector<PacketView> views;
+    ConvertSegmentViews(hls_data, views, is_first_segment);
+    
+    // Copy each viewed packet out into a standalone TSPacket
+    std::vector<TSPacket> ts_packets(views.size());
+    for (size_t i = 0; i < views.size(); ++i) {
+        memcpy(ts_packets[i].data, hls_data.data() + views[i].offset, TS_PACKET_SIZE);
+        views[i].meta.ApplyTo(ts_packets[i]);
+    }
+    
+    return ts_packets;
+}
+
+size_t HLSToTSConverter::ConvertSegmentViews(const std::vector<uint8_t>& hls_data, std::vector<PacketView>& views, bool is_first_segment) {
+    views.clear();
+    
+    // HLS segments are already MPEG-TS formatted data
+    // Split into runs of aligned packets; corrupt stretches are skipped and sync is re-acquired
+    size_t data_size = hls_data.size();
+    const uint8_t* data_ptr = hls_data.data();
+    
+    last_sync_scan_ = ScanSyncRuns(data_ptr, data_size, sync_runs_);
+    total_bytes_skipped_ += last_sync_scan_.bytes_skipped;
+    total_resyncs_ += last_sync_scan_.resyncs;
+    
+    if (sync_runs_.empty()) {
+        return 0; // No valid sync found
+    }
+    
+    // Frame Number Tagging: a new stream starts with fresh parser state; frame numbers within a
+    // segment count from its first access unit
+    if (is_first_segment) {
+        access_unit_parser_.Reset();
+    }
+    segment_frame_counter_ = 0;
+    size_t access_unit_view = SIZE_MAX; // View where the current access unit started, if in this segment
+    
+    // Process each run in 188-byte TS packet chunks
+    views.reserve(last_sync_scan_.packets);
+    for (const SyncRun& run : sync_runs_) {
+        const size_t run_end = run.offset + run.packets * TS_PACKET_SIZE;
+        for (size_t offset = run.offset; offset < run_end; offset += TS_PACKET_SIZE) {
+            const uint8_t* packet_data = data_ptr + offset;
+            
+            // Parse packet header
+            PacketView view;
+            view.offset = static_cast<uint32_t>(offset);
+            PacketMeta& meta = view.meta;
+            meta = PacketMeta::FromHeader(packet_data);
+            
+            // Classify video/audio and find access unit boundaries and key frames in the bitstream
+            uint32_t events = access_unit_parser_.ParsePacket(packet_data, meta);
+            
+            if (events & AccessUnitParser::EVENT_ACCESS_UNIT_START) {
+                segment_frame_counter_ += meta.access_units;
+                meta.segment_frame_number = segment_frame_counter_;
+                access_unit_view = views.size();
+            }
+            
+            // The IDR/IRAP slice can arrive a few packets after the access unit delimiter and parameter
+            // sets; tag the packet that started the access unit so it marks the cut point
+            if ((events & AccessUnitParser::EVENT_KEY_FRAME) && !meta.Has(PacketMeta::KEY_FRAME)) {
+                if (access_unit_view < views.size()) {
+                    views[access_unit_view].meta.flags |= PacketMeta::KEY_FRAME;
+                } else {
+                    meta.flags |= PacketMeta::KEY_FRAME;
+                }
+            }
+            
+            // Don't modify continuity counters - preserve original TS packet timing and sequencing
+            // The original HLS TS segments should have correct continuity counters
+            
+            views.push_back(view);
+        }
+    }
+    
+    return views.size();
+}
+
+std::vector<TSPacket> HLSToTSConverter::WrapDataInTS(const uint8_t* data, size_t size, uint16_t pid, bool payload_start) {
+    std::vector<TSPacket> packets;
+    
+    size_t remaining = size;
+    const uint8_t* current_data = data;
+    bool first_packet = payload_start;
+    
+    while (remaining > 0) {
+        TSPacket packet;
+        packet.pid = pid;
+        packet.payload_unit_start = first_packet;
+        
+        // TS Header
+        packet.data[0] = 0x47; // Sync byte
+        packet.data[1] = (first_packet ? 0x40 : 0x00) | ((pid >> 8) & 0x1F); // Payload unit start + PID high
+        packet.data[2] = pid & 0xFF; // PID low
+        packet.data[3] = 0x10 | (continuity_counter_ & 0x0F); // No adaptation, payload present, continuity
+        
+        // Calculate payload size
+        size_t payload_offset = 4;
+        size_t max_payload = TS_PACKET_SIZE - payload_offset;
+        size_t payload_size = std::min(remaining, max_payload);
+        
+        // Copy payload data
+        memcpy(&packet.data[payload_offset], current_data, payload_size);
+        
+        // Fill remaining bytes with padding if needed
+        for (size_t i = payload_offset + payload_size; i < TS_PACKET_SIZE; ++i) {
+            packet.data[i] = 0xFF;
+        }
+        
+        packets.push_back(packet);
+        
+        remaining -= payload_size;
+        current_data += payload_size;
+        first_packet = false;
+        continuity_counter_ = (continuity_counter_ + 1) & 0x0F;
+    }
+    
+    return packets;
+}
+
+} // namespace tsduck_transport
@@ -0,0 +1,55 @@
+#pragma once
+// HLS segment to Transport Stream packet converter for the transport stream router
+// Splits downloaded MPEG-TS segments into 188-byte packets tagged with frame/stream metadata,
+// either as copied TSPackets or as zero-copy views into the shared segment buffer.
+
+#include <cstdint>
+#include <vector>
+
+#include "ts_packet.h"
+#include "ts_sync.h"
+#include "access_unit_parser.h"
+
+namespace tsduck_transport {
+
+    // HLS to Transport Stream converter
+    class HLSToTSConverter {
+    public:
+        HLSToTSConverter();
+
+        // Convert HLS segment data to TS packets
+        std::vector<TSPacket> ConvertSegment(const std::vector<uint8_t>& hls_data, bool is_first_segment = false);
+
+        // Zero-copy conversion: fills views with packet offsets into hls_data plus their metadata.
+        // views is cleared first and reused, so steady-state conversion does not allocate. Returns views.size().
+        size_t ConvertSegmentViews(const std::vector<uint8_t>& hls_data, std::vector<PacketView>& views, bool is_first_segment = false);
+
+        // Reset converter state for new stream
+        void Reset();
+
+        // Sync statistics: corrupt or misaligned bytes skipped while resynchronizing
+        const SyncScanResult& GetLastSyncScan() const { return last_sync_scan_; }
+        uint64_t GetTotalBytesSkipped() const { return total_bytes_skipped_; }
+        uint64_t GetTotalResyncs() const { return total_resyncs_; }
+
+        // Video timing from the bitstream: frame rate, key frame spacing, access unit counts
+        const AccessUnitParser& GetAccessUnitParser() const { return access_unit_parser_; }
+
+    private:
+        uint8_t continuity_counter_ = 0;
+
+        // Frame Number Tagging state
+        AccessUnitParser access_unit_parser_;  // Real access unit boundaries, key frames and frame rate
+        uint32_t segment_frame_counter_ = 0;    // Access units started in the current segment
+
+        // Sync scanning state (runs reused across segments)
+        std::vector<SyncRun> sync_runs_;
+        SyncScanResult last_sync_scan_;
+        uint64_t total_bytes_skipped_ = 0;
+        uint64_t total_resyncs_ = 0;
+
+        // Wrap data in TS packets
+        std::vector<TSPacket> WrapDataInTS(const uint8_t* data, size_t size, uint16_t pid, bool payload_start = false);
+    };
+
+} // namespace tsduck_transport
@@ -0,0 +1,491 @@
+#include "http_client.h"
+#include "inflater.h"
+#include <algorithm>
+#include <thread>
+#include <cctype>
+#include <cstdlib>
+
+namespace tardsplaya {
+
+namespace {
+
+    const uint64_t MAX_RESERVE_BYTES = 64 * 1024 * 1024;    // Larger Content-Length values grow as they arrive
+
+    std::string ToLowerAscii(std::string text) {
+        std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return text;
+    }
+
+    bool Cancelled(std::atomic<bool>* cancel_token) {
+        return cancel_token && cancel_token->load();
+    }
+
+    // A request that asks for a compressed body gets its body through the decoder
+    bool AcceptsEncoding(const HttpHeaders* headers) {
+        if (headers) {
+            for (const auto& header : *headers) {
+                if (ToLowerAscii(header.first) == "accept-encoding") {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    // Retry delay that gives up early when the stream is stopped
+    void SleepCancellable(std::chrono::milliseconds delay, std::atomic<bool>* cancel_token) {
+        const auto deadline = std::chrono::steady_clock::now() + delay;
+        while (!Cancelled(cancel_token) && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::min(std::chrono::milliseconds(50), delay));
+        }
+    }
+
+} // namespace
+
+std::string NarrowUrl(const std::wstring& url) {
+    std::string out;
+    out.reserve(url.size());
+    for (wchar_t wc : url) {
+        uint32_t c = static_cast<uint32_t>(wc);
+        if (c < 0x80) {
+            out += static_cast<char>(c);
+        } else if (c < 0x800) {
+            out += static_cast<char>(0xC0 | (c >> 6));
+            out += static_cast<char>(0x80 | (c & 0x3F));
+        } else {
+            out += static_cast<char>(0xE0 | ((c >> 12) & 0x0F));
+            out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (c & 0x3F));
+        }
+    }
+    return out;
+}
+
+uint8_t* AppendSpace(std::vector<uint8_t>& body, size_t more, HttpResponse& response) {
+    size_t size = body.size();
+    if (size + more > body.capacity()) {
+        response.body_bytes_copied += size;
+        body.reserve(std::max(size + more, body.capacity() * 2));
+    }
+    body.resize(size + more);
+    return body.data() + size;
+}
+
+void ReserveBody(std::vector<uint8_t>& body, const HttpResponse& response) {
+    const std::string* content_length = response.FindHeader("content-length");
+    if (content_length) {
+        uint64_t length = std::strtoull(content_length->c_str(), nullptr, 10);
+        body.reserve(body.size() + static_cast<size_t>(std::min(length, MAX_RESERVE_BYTES)));
+    }
+}
+
+bool HttpUrl::Parse(const std::string& url, HttpUrl& out) {
+    size_t scheme_end = url.find("://");
+    if (scheme_end == std::string::npos) {
+        return false;
+    }
+    std::string scheme = ToLowerAscii(url.substr(0, scheme_end));
+    if (scheme == "https") {
+        out.secure = true;
+    } else if (scheme == "http") {
+        out.secure = false;
+    } else {
+        return false;
+    }
+
+    size_t authority_start = scheme_end + 3;
+    size_t authority_end = url.find_first_of("/?#", authority_start);
+    std::string authority = url.substr(authority_start, authority_end == std::string::npos ? std::string::npos : authority_end - authority_start);
+    size_t at = authority.rfind('@');
+    if (at != std::string::npos) {
+        authority.erase(0, at + 1);
+    }
+
+    // [v6 address]:port or host:port
+    size_t port_sep = std::string::npos;
+    if (!authority.empty() && authority[0] == '[') {
+        size_t close = authority.find(']');
+        if (close == std::string::npos) {
+            return false;
+        }
+        out.host = authority.substr(1, close - 1);
+        if (close + 1 < authority.size() && authority[close + 1] == ':') {
+            port_sep = close + 1;
+        }
+    } else {
+        port_sep = authority.rfind(':');
+        out.host = authority.substr(0, port_sep);
+    }
+    if (out.host.empty()) {
+        return false;
+    }
+    out.host = ToLowerAscii(out.host);
+
+    out.port = out.secure ? 443 : 80;
+    if (port_sep != std::string::npos) {
+        char* end = nullptr;
+        long port = std::strtol(authority.c_str() + port_sep + 1, &end, 10);
+        if (end == authority.c_str() + port_sep + 1 || *end != '\0' || port <= 0 || port > 65535) {
+            return false;
+        }
+        out.port = static_cast<uint16_t>(port);
+    }
+
+    out.path = authority_end == std::string::npos ? std::string() : url.substr(authority_end);
+    size_t fragment = out.path.find('#');
+    if (fragment != std::string::npos) {
+        out.path.erase(fragment);
+    }
+    if (out.path.empty() || out.path[0] != '/') {
+        out.path.insert(0, "/");
+    }
+    return true;
+}
+
+std::string HttpUrl::HostKey() const {
+    return (secure ? "https://" : "http://") + host + ":" + std::to_string(port);
+}
+
+const std::string* HttpResponse::FindHeader(const std::string& name) const {
+    for (const auto& header : headers) {
+        if (header.first == name) {
+            return &header.second;
+        }
+    }
+    return nullptr;
+}
+
+const HttpHeaders& CompressedTextHeaders() {
+    static const HttpHeaders headers = { { "Accept-Encoding", ACCEPT_COMPRESSED } };
+    return headers;
+}
+
+double HttpClient::Stats::ReuseRatio() const {
+    uint64_t answered = new_connection_requests + connections_reused;
+    return answered ? static_cast<double>(connections_reused) / answered : 0.0;
+}
+
+double HttpClient::Stats::HandshakeMsSaved() const {
+    if (!new_connection_requests || !connections_reused) {
+        return 0.0;
+    }
+    double new_avg_us = static_cast<double>(new_connection_us) / new_connection_requests;
+    double reused_avg_us = static_cast<double>(reused_connection_us) / connections_reused;
+    return std::max(0.0, new_avg_us - reused_avg_us) * connections_reused / 1000.0;
+}
+
+double HttpClient::Stats::CompressionSavings() const {
+    return decoded_bytes ? 1.0 - static_cast<double>(encoded_bytes) / decoded_bytes : 0.0;
+}
+
+double HttpClient::Stats::CopyRatio() const {
+    return body_bytes ? static_cast<double>(body_bytes_copied) / body_bytes : 0.0;
+}
+
+HttpClient::HttpClient(std::unique_ptr<HttpBackend> backend, const Config& config)
+    : backend_(std::move(backend)), config_(config) {
+    config_.max_connections_per_host = std::max<size_t>(1, config_.max_connections_per_host);
+    config_.max_attempts = std::max(1, config_.max_attempts);
+}
+
+HttpClient::~HttpClient() {
+    // Connections go before the backend that created them
+    hosts_.clear();
+}
+
+HttpClient& HttpClient::Shared() {
+    // Never destroyed: stream threads may still be fetching while the process exits
+    static HttpClient* client = new HttpClient(CreatePlatformHttpBackend());
+    return *client;
+}
+
+void HttpClient::TakeExpiredLocked(std::chrono::steady_clock::time_point now, std::vector<std::unique_ptr<HttpConnection>>& expired) {
+    for (auto& entry : hosts_) {
+        std::vector<IdleConnection>& idle = entry.second.idle;
+        // Oldest first; stop at the first one still within the timeout
+        size_t count = 0;
+        while (count < idle.size() && now - idle[count].since >= config_.idle_timeout) {
+            expired.push_back(std::move(idle[count].connection));
+            count++;
+        }
+        idle.erase(idle.begin(), idle.begin() + count);
+    }
+    stats_.idle_evictions += expired.size();
+    stats_.open_connections -= expired.size();
+}
+
+void HttpClient::EvictIdle() {
+    std::vector<std::unique_ptr<HttpConnection>> expired;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        TakeExpiredLocked(std::chrono::steady_clock::now(), expired);
+    }
+    if (!expired.empty()) {
+        slot_freed_.notify_all();
+    }
+    // Closed here, outside the lock
+}
+
+std::unique_ptr<HttpConnection> HttpClient::Checkout(const HttpUrl& url, const std::string& key, std::atomic<bool>* cancel_token,
+                                                     bool& reused, std::chrono::microseconds& connect_time) {
+    std::vector<std::unique_ptr<HttpConnection>> expired;
+    std::unique_lock<std::mutex> lock(mutex_);
+    TakeExpiredLocked(std::chrono::steady_clock::now(), expired);
+    if (!expired.empty()) {
+        slot_freed_.notify_all();
+    }
+
+    Host& host = hosts_[key];
+    bool waited = false;
+    while (host.idle.empty() && host.active >= config_.max_connections_per_host) {
+        if (!waited) {
+            stats_.pool_waits++;
+            waited = true;
+        }
+        slot_freed_.wait_for(lock, std::chrono::milliseconds(100));
+        if (Cancelled(cancel_token)) {
+            return nullptr;
+        }
+    }
+
+    host.active++;
+    if (!host.idle.empty()) {
+        std::unique_ptr<HttpConnection> connection = std::move(host.idle.back().connection);
+        host.idle.pop_back();
+        reused = true;
+        return connection;
+    }
+    reused = false;
+    lock.unlock();
+    expired.clear();
+
+    // Connecting holds a slot of the host but not the lock
+    auto start = std::chrono::steady_clock::now();
+    std::unique_ptr<HttpConnection> connection = backend_->Connect(url, cancel_token);
+    connect_time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+    lock.lock();
+    if (!connection) {
+        host.active--;
+        lock.unlock();
+        slot_freed_.notify_one();
+        return nullptr;
+    }
+    stats_.connections_opened++;
+    stats_.connect_us += connect_time.count();
+    stats_.open_connections++;
+    stats_.open_connections_high_water = std::max(stats_.open_connections_high_water, stats_.open_connections);
+    return connection;
+}
+
+void HttpClient::Checkin(const std::string& key, std::unique_ptr<HttpConnection> connection, bool keep) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Host& host = hosts_[key];
+        host.active--;
+        if (keep && config_.keep_alive && connection->IsReusable()) {
+            host.idle.push_back({ std::move(connection), std::chrono::steady_clock::now() });
+        } else {
+            stats_.open_connections--;
+        }
+    }
+    slot_freed_.notify_one();
+    // A connection not kept is closed here, outside the lock
+}
+
+bool HttpClient::Get(const std::wstring& url, std::vector<uint8_t>& body, std::atomic<bool>* cancel_token,
+                     HttpResponse* response, int max_attempts, const HttpHeaders* headers) {
+    return Get(NarrowUrl(url), body, cancel_token, response, max_attempts, headers);
+}
+
+bool HttpClient::Get(const std::string& url, std::vector<uint8_t>& body, std::atomic<bool>* cancel_token,
+                     HttpResponse* response, int max_attempts, const HttpHeaders* headers) {
+    return Fetch(url, body, nullptr, cancel_token, response, max_attempts, headers);
+}
+
+bool HttpClient::Get(const std::wstring& url, const HttpBodySink& sink, std::atomic<bool>* cancel_token,
+                     HttpResponse* response, int max_attempts, const HttpHeaders* headers) {
+    return Get(NarrowUrl(url), sink, cancel_token, response, max_attempts, headers);
+}
+
+bool HttpClient::Get(const std::string& url, const HttpBodySink& sink, std::atomic<bool>* cancel_token,
+                     HttpResponse* response, int max_attempts, const HttpHeaders* headers) {
+    std::vector<uint8_t> error_body;
+    return Fetch(url, error_body, &sink, cancel_token, response, max_attempts, headers);
+}
+
+bool HttpClient::Fetch(const std::string& url, std::vector<uint8_t>& body, const HttpBodySink* sink, std::atomic<bool>* cancel_token,
+                       HttpResponse* response, int max_attempts, const HttpHeaders* headers) {
+    HttpResponse local_response;
+    HttpResponse& result = response ? *response : local_response;
+    result = HttpResponse();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.requests++;
+    }
+
+    HttpUrl parsed;
+    bool ok = HttpUrl::Parse(url, parsed);
+    const std::string key = parsed.HostKey();
+    const int attempts = max_attempts > 0 ? max_attempts : config_.max_attempts;
+    uint64_t delivered = 0;         // Streamed bytes the caller's sink has taken
+    bool refused = false;
+    bool oversized = false;         // Decoded past the cap; asking again would only repeat that
+    const bool decode_into_body = !sink && AcceptsEncoding(headers);
+    std::vector<uint8_t> receive;   // Encoded bodies arrive here before they are decoded into body
+    std::vector<uint8_t> decoded;
+
+    for (int attempt = 0; ok && attempt < attempts; ++attempt) {
+        if (attempt > 0) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stats_.retries++;
+            }
+            SleepCancellable(config_.retry_delay, cancel_token);
+        }
+        if (Cancelled(cancel_token)) {
+            break;
+        }
+
+        // Each idle connection of the host may have been dropped by the server; those cost no attempt
+        HttpResult outcome = HttpResult::FAILED;
+        for (size_t stale = 0; stale <= config_.max_connections_per_host; ++stale) {
+            bool reused = false;
+            std::chrono::microseconds connect_time{0};
+            std::unique_ptr<HttpConnection> connection = Checkout(parsed, key, cancel_token, reused, connect_time);
+            if (!connection) {
+                outcome = Cancelled(cancel_token) ? HttpResult::CANCELLED : HttpResult::FAILED;
+                break;
+            }
+
+            result = HttpResponse();
+            // A body with Content-Encoding gzip or deflate is decoded between the connection and the caller
+            std::unique_ptr<Inflater> inflater;
+            bool checked_encoding = false;
+            bool undecodable = false;
+            auto encoded = [&]() {
+                if (!checked_encoding) {
+                    checked_encoding = true;
+                    Inflater::Format format = Inflater::Format::GZIP;
+                    const std::string* encoding = result.FindHeader("content-encoding");
+                    if (encoding && Inflater::FormatOf(*encoding, format)) {
+                        inflater.reset(new Inflater(format, config_.max_decoded_bytes));
+                    }
+                }
+                return inflater != nullptr;
+            };
+            auto inflate = [&](const uint8_t* data, size_t size, std::vector<uint8_t>& out) {
+                Inflater::Status status = inflater->Write(data, size, out);
+                undecodable = status == Inflater::Status::FAILED;
+                oversized = status == Inflater::Status::TOO_LARGE;
+                return !undecodable && !oversized;
+            };
+
+            if (sink) {
+                // Every attempt starts the body over; bytes the caller already has are skipped
+                if (delivered > 0) {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    stats_.resumes++;
+                }
+                uint64_t offset = 0;
+                HttpBodySink resume = [&](const uint8_t* data, size_t size) {
+                    size_t skip = offset < delivered ? static_cast<size_t>(std::min<uint64_t>(size, delivered - offset)) : 0;
+                    offset += size;
+                    if (skip == size) {
+                        return true;
+                    }
+                    delivered += size - skip;
+                    refused = !(*sink)(data + skip, size - skip);
+                    return !refused;
+                };
+                HttpBodySink decode = [&](const uint8_t* data, size_t size) {
+                    if (!encoded()) {
+                        return resume(data, size);
+                    }
+                    decoded.clear();
+                    return inflate(data, size, decoded) && (decoded.empty() || resume(decoded.data(), decoded.size()));
+                };
+                outcome = connection->Get(parsed, body, result, cancel_token, &decode, headers);
+            } else if (decode_into_body) {
+                // Only an encoded body is streamed through the inflater; one sent as is is read in place
+                body.clear();
+                HttpStreamFilter stream = [&](const HttpResponse&) { return encoded(); };
+                HttpBodySink decode = [&](const uint8_t* data, size_t size) { return inflate(data, size, body); };
+                outcome = connection->Get(parsed, receive, result, cancel_token, &decode, headers, &stream);
+                // Bodies not streamed, those sent as is and those of other statuses, are left in the receive buffer
+                if (outcome == HttpResult::OK && (!encoded() || result.status < 200 || result.status >= 300)) {
+                    if (encoded()) {
+                        inflate(receive.data(), receive.size(), body);
+                    } else {
+                        body.swap(receive);
+                    }
+                }
+            } else {
+                outcome = connection->Get(parsed, body, result, cancel_token, nullptr, headers);
+            }
+            if (inflater && outcome == HttpResult::OK && result.status >= 200 && result.status < 300 &&
+                inflater->GetStatus() == Inflater::Status::MORE) {
+                undecodable = true;     // The encoded stream ended early
+            }
+            if ((undecodable || oversized) && outcome != HttpResult::STALE) {
+                outcome = HttpResult::FAILED;
+            }
+            result.decoded_bytes = inflater ? inflater->GetBytesOut() : result.body_bytes;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stats_.body_bytes += result.body_bytes;
+                stats_.body_bytes_copied += result.body_bytes_copied;
+                if (inflater) {
+                    stats_.encoded_bodies++;
+                    stats_.encoded_bytes += result.body_bytes;
+                    stats_.decoded_bytes += inflater->GetBytesOut();
+                    stats_.undecodable += undecodable ? 1 : 0;
+                    stats_.oversized += oversized ? 1 : 0;
+                }
+                if (outcome == HttpResult::OK) {
+                    if (reused) {
+                        stats_.connections_reused++;
+                        stats_.reused_connection_us += result.time_to_headers.count();
+                    } else {
+                        stats_.new_connection_requests++;
+                        stats_.new_connection_us += (connect_time + result.time_to_headers).count();
+                    }
+                } else if (outcome == HttpResult::STALE && reused) {
+                    stats_.stale_retries++;
+                }
+            }
+            Checkin(key, std::move(connection), outcome == HttpResult::OK);
+            if (outcome != HttpResult::STALE || !reused) {
+                break;
+            }
+        }
+
+        if (outcome == HttpResult::CANCELLED || refused || oversized) {
+            break;
+        }
+        if (outcome == HttpResult::OK) {
+            if (result.status >= 200 && result.status < 300) {
+                return true;
+            }
+            if (result.status < 500) {
+                break;      // Client errors do not go away by asking again
+            }
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.failures++;
+    return false;
+}
+
+void HttpClient::CountCopied(uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.body_bytes_copied += bytes;
+}
+
+HttpClient::Stats HttpClient::GetStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+} // namespace tardsplaya
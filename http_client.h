@@ -0,0 +1,223 @@
+#pragma once
+// Portable HTTP client with a host-keyed keep-alive connection pool
+// Playlist refreshes and segment downloads of every stream go through one client, so requests to the
+// same CDN host reuse an open connection instead of paying a TCP+TLS handshake each time. Each host
+// gets a bounded number of connections and connections left idle past a timeout are closed. The
+// transport is a backend: WinHTTP on Windows, plain POSIX sockets elsewhere for loopback load tests.
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <unordered_map>
+
+namespace tardsplaya {
+
+    struct HttpUrl {
+        bool secure = false;
+        std::string host;
+        uint16_t port = 0;
+        std::string path;                 // Path and query, "/" when the URL has none
+
+        static bool Parse(const std::string& url, HttpUrl& out);
+
+        // Connections are shared between URLs with the same key
+        std::string HostKey() const;
+    };
+
+    struct HttpResponse {
+        int status = 0;                                              // 0 when no response arrived
+        std::vector<std::pair<std::string, std::string>> headers;   // Names lowercased
+        std::chrono::microseconds time_to_headers{0};               // Request sent until headers received
+        uint64_t body_bytes = 0;                                     // Body bytes received
+        uint64_t body_bytes_copied = 0;                              // Written into memory: the read itself, copies between
+                                                                     // buffers and bytes moved when the body grew
+        uint64_t buffered_body_bytes = 0;                            // Body bytes read along with the headers or a chunk
+                                                                     // line, which are copied out of that buffer once more
+        uint64_t decoded_bytes = 0;                                  // Body bytes after Content-Encoding is undone;
+                                                                     // body_bytes when the body was not encoded
+
+        const std::string* FindHeader(const std::string& name) const;
+    };
+
+    enum class HttpResult {
+        OK,          // Response and complete body received, whatever the status code
+        STALE,       // Closed before any response byte: a kept-alive connection the server has dropped
+        FAILED,
+        CANCELLED
+    };
+
+    // Receives a body piece by piece as it arrives; false abandons the response
+    using HttpBodySink = std::function<bool(const uint8_t* data, size_t size)>;
+
+    // Decides, once the headers of a 2xx response are in, whether its body goes to the sink
+    using HttpStreamFilter = std::function<bool(const HttpResponse& response)>;
+
+    // Extra request headers, e.g. Range
+    using HttpHeaders = std::vector<std::pair<std::string, std::string>>;
+
+    // One connection to one host, used by one request at a time
+    class HttpConnection {
+    public:
+        virtual ~HttpConnection() = default;
+
+        // With a sink, the body of a 2xx response goes to it as it arrives and body stays empty; response
+        // already holds the status and headers when the sink sees the first byte. A sink that refuses more
+        // data ends the request as CANCELLED. Without one, or when stream turns the body down, the body is read
+        // straight into body, reserved once from Content-Length and grown geometrically when the length is not given.
+        virtual HttpResult Get(const HttpUrl& url, std::vector<uint8_t>& body, HttpResponse& response,
+                               std::atomic<bool>* cancel_token, const HttpBodySink* sink = nullptr,
+                               const HttpHeaders* headers = nullptr, const HttpStreamFilter* stream = nullptr) = 0;
+
+        // False once the connection cannot carry another request (Connection: close, errors, cancelled reads)
+        virtual bool IsReusable() const = 0;
+    };
+
+    class HttpBackend {
+    public:
+        virtual ~HttpBackend() = default;
+
+        // New connection to the host of url; nullptr when it cannot be reached
+        virtual std::unique_ptr<HttpConnection> Connect(const HttpUrl& url, std::atomic<bool>* cancel_token) = 0;
+        virtual const char* GetName() const = 0;
+    };
+
+    // WinHTTP on Windows, POSIX sockets (plain HTTP only) elsewhere
+    std::unique_ptr<HttpBackend> CreatePlatformHttpBackend();
+
+    // URLs are ASCII in practice; anything else is passed on as UTF-8
+    std::string NarrowUrl(const std::wstring& url);
+
+    // For backends: size more bytes appended to body to read into, returned. Capacity grows at least twofold,
+    // so a body of unknown length is moved a bounded number of times; bytes moved are added to the response.
+    uint8_t* AppendSpace(std::vector<uint8_t>& body, size_t more, HttpResponse& response);
+
+    // Request headers asking for a gzip or deflate body. For playlists and API answers: text that shrinks
+    // to a fraction. Segments are already compressed and are read in place without them.
+    const HttpHeaders& CompressedTextHeaders();
+
+    // For backends: reserve the response's Content-Length in body before reading it, so it is allocated once
+    void ReserveBody(std::vector<uint8_t>& body, const HttpResponse& response);
+
+    struct HttpClientConfig {
+        size_t max_connections_per_host = 6;
+        std::chrono::milliseconds idle_timeout{30000};
+        int max_attempts = 3;
+        std::chrono::milliseconds retry_delay{600};
+        bool keep_alive = true;       // false closes every connection after one request
+        uint64_t max_decoded_bytes = 64 * 1024 * 1024;     // A gzip or deflate body decoding to more fails, not retried
+    };
+
+    class HttpClient {
+    public:
+        using Config = HttpClientConfig;
+
+        struct Stats {
+            uint64_t requests = 0;
+            uint64_t failures = 0;                 // Requests that failed after all attempts
+            uint64_t retries = 0;
+            uint64_t connections_opened = 0;
+            uint64_t connections_reused = 0;       // Requests sent on a kept-alive connection
+            uint64_t stale_retries = 0;            // Kept-alive connections found closed; retried without using an attempt
+            uint64_t idle_evictions = 0;
+            uint64_t pool_waits = 0;               // Requests that waited for a connection slot of their host
+            size_t open_connections = 0;
+            size_t open_connections_high_water = 0;
+            uint64_t connect_us = 0;               // Spent in backend Connect
+            uint64_t new_connection_requests = 0;  // Answered on a new connection
+            uint64_t new_connection_us = 0;        // Connect plus time to headers, summed over those
+            uint64_t reused_connection_us = 0;     // Time to headers, summed over requests on reused connections
+            uint64_t resumes = 0;                  // Streamed downloads retried after part of the body was delivered
+            uint64_t body_bytes = 0;               // Response body bytes received, all attempts
+            uint64_t body_bytes_copied = 0;        // Written into memory by the client before reaching the caller's buffer or sink,
+                                                   // plus copies callers report with CountCopied
+            uint64_t encoded_bodies = 0;           // Responses with Content-Encoding gzip or deflate
+            uint64_t encoded_bytes = 0;            // Their body bytes as received
+            uint64_t decoded_bytes = 0;            // And once decoded
+            uint64_t undecodable = 0;              // Encoded bodies that were corrupt or cut short; retried as failures
+            uint64_t oversized = 0;                // Encoded bodies decoding past max_decoded_bytes; failed at once
+
+            // Share of answered requests that needed no new connection
+            double ReuseRatio() const;
+
+            // Reused requests times the extra time to headers a new connection costs on average
+            double HandshakeMsSaved() const;
+
+            // Body bytes written into memory per byte received; 1.0 when every byte is read into its final place
+            double CopyRatio() const;
+
+            // Share of the decoded size that compression saved on the wire
+            double CompressionSavings() const;
+        };
+
+        explicit HttpClient(std::unique_ptr<HttpBackend> backend, const Config& config = Config());
+        ~HttpClient();
+
+        HttpClient(const HttpClient&) = delete;
+        HttpClient& operator=(const HttpClient&) = delete;
+
+        // GET into body. True for a 2xx response; 5xx responses and transport errors are retried.
+        // response, when given, describes the last response received. max_attempts 0 uses the config.
+        // headers are added to every attempt. When they include Accept-Encoding (CompressedTextHeaders), a
+        // gzip or deflate body is decoded into body as it arrives; otherwise the body is read in place.
+        bool Get(const std::string& url, std::vector<uint8_t>& body, std::atomic<bool>* cancel_token = nullptr,
+                 HttpResponse* response = nullptr, int max_attempts = 0, const HttpHeaders* headers = nullptr);
+        bool Get(const std::wstring& url, std::vector<uint8_t>& body, std::atomic<bool>* cancel_token = nullptr,
+                 HttpResponse* response = nullptr, int max_attempts = 0, const HttpHeaders* headers = nullptr);
+
+        // GET streaming a 2xx body to sink as it arrives. An attempt that fails partway is retried and the
+        // bytes the sink already has are skipped, so it sees every byte once. A refusing sink ends it.
+        // The sink may look at response: it describes the response the bytes belong to. A gzip or deflate
+        // body is decoded on the way, so the sink sees the decoded bytes.
+        bool Get(const std::string& url, const HttpBodySink& sink, std::atomic<bool>* cancel_token = nullptr,
+                 HttpResponse* response = nullptr, int max_attempts = 0, const HttpHeaders* headers = nullptr);
+        bool Get(const std::wstring& url, const HttpBodySink& sink, std::atomic<bool>* cancel_token = nullptr,
+                 HttpResponse* response = nullptr, int max_attempts = 0, const HttpHeaders* headers = nullptr);
+
+        // For callers that copy what their sink is given into a buffer of their own: counted in body_bytes_copied,
+        // so CopyRatio covers the whole way to where the body is kept
+        void CountCopied(uint64_t bytes);
+
+        // Close connections idle past the timeout; also done on every request
+        void EvictIdle();
+
+        Stats GetStats() const;
+        const Config& GetConfig() const { return config_; }
+        const char* GetBackendName() const { return backend_->GetName(); }
+
+        // Process-wide client on the platform backend, shared by all streams
+        static HttpClient& Shared();
+
+    private:
+        struct IdleConnection {
+            std::unique_ptr<HttpConnection> connection;
+            std::chrono::steady_clock::time_point since;
+        };
+
+        struct Host {
+            std::vector<IdleConnection> idle;    // Most recently used last
+            size_t active = 0;                   // Checked out by requests, including ones still connecting
+        };
+
+        std::unique_ptr<HttpBackend> backend_;
+        Config config_;
+        mutable std::mutex mutex_;
+        std::condition_variable slot_freed_;
+        std::unordered_map<std::string, Host> hosts_;
+        Stats stats_;
+
+        std::unique_ptr<HttpConnection> Checkout(const HttpUrl& url, const std::string& key, std::atomic<bool>* cancel_token,
+                                                 bool& reused, std::chrono::microseconds& connect_time);
+        void Checkin(const std::string& key, std::unique_ptr<HttpConnection> connection, bool keep);
+        bool Fetch(const std::string& url, std::vector<uint8_t>& body, const HttpBodySink* sink, std::atomic<bool>* cancel_token,
+                   HttpResponse* response, int max_attempts, const HttpHeaders* headers);
+        void TakeExpiredLocked(std::chrono::steady_clock::time_point now, std::vector<std::unique_ptr<HttpConnection>>& expired);
+    };
+
+} // namespace tardsplaya
@@ -0,0 +1,410 @@
+// POSIX socket backend for the HTTP client
+// Plain HTTP/1.1 over TCP with keep-alive, Content-Length, chunked and read-to-close bodies. There is
+// no TLS, so it serves loopback load tests and local origins; Windows builds use the WinHTTP backend.
+
+#ifndef _WIN32
+
+#include "http_client.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace tardsplaya {
+
+namespace {
+
+    const int CONNECT_TIMEOUT_MS = 10000;
+    const int RECEIVE_TIMEOUT_MS = 30000;
+    const int POLL_SLICE_MS = 100;          // How often a blocked read looks at the cancel token
+    const size_t READ_SIZE = 64 * 1024;
+    const size_t MAX_HEAD_SIZE = 64 * 1024;
+
+    bool Cancelled(std::atomic<bool>* cancel_token) {
+        return cancel_token && cancel_token->load();
+    }
+
+    // Wait for the socket in short slices; false on timeout, error or cancellation
+    bool WaitFor(int fd, short events, int timeout_ms, std::atomic<bool>* cancel_token) {
+        for (int waited = 0; waited < timeout_ms; waited += POLL_SLICE_MS) {
+            if (Cancelled(cancel_token)) {
+                return false;
+            }
+            pollfd pfd = { fd, events, 0 };
+            int ready = poll(&pfd, 1, POLL_SLICE_MS);
+            if (ready > 0) {
+                return true;
+            }
+            if (ready < 0 && errno != EINTR) {
+                return false;
+            }
+        }
+        return false;
+    }
+
+    class PosixHttpConnection : public HttpConnection {
+    public:
+        explicit PosixHttpConnection(int fd) : fd_(fd) {}
+        ~PosixHttpConnection() override { close(fd_); }
+
+        HttpResult Get(const HttpUrl& url, std::vector<uint8_t>& body, HttpResponse& response,
+                       std::atomic<bool>* cancel_token, const HttpBodySink* sink, const HttpHeaders* headers,
+                       const HttpStreamFilter* stream) override;
+        bool IsReusable() const override { return reusable_; }
+
+    private:
+        int fd_;
+        bool reusable_ = true;
+        std::string buffer_;      // Received but not consumed yet
+        size_t pos_ = 0;
+        const HttpBodySink* sink_ = nullptr;    // Streaming the current body
+        HttpResponse* response_ = nullptr;      // Of the current request; counts body bytes and copies
+
+        enum ReadStatus { READ_DATA, READ_EOF, READ_ERROR, READ_CANCELLED };
+
+        ReadStatus Fill(std::atomic<bool>* cancel_token);
+        HttpResult Fail(ReadStatus status);
+        bool Deliver(std::vector<uint8_t>& body);
+        void TakeBuffered(size_t size, std::vector<uint8_t>& body);
+        bool ReceiveInto(size_t want, std::vector<uint8_t>& body, ssize_t& received);
+        bool SendAll(const std::string& request, std::atomic<bool>* cancel_token);
+        HttpResult ReadLine(std::string& line, std::atomic<bool>* cancel_token);
+        HttpResult ReadExactly(size_t size, std::vector<uint8_t>& body, std::atomic<bool>* cancel_token);
+        HttpResult ReadChunked(std::vector<uint8_t>& body, std::atomic<bool>* cancel_token);
+        HttpResult ReadToClose(std::vector<uint8_t>& body, std::atomic<bool>* cancel_token);
+    };
+
+    PosixHttpConnection::ReadStatus PosixHttpConnection::Fill(std::atomic<bool>* cancel_token) {
+        if (pos_ > 0 && pos_ == buffer_.size()) {
+            buffer_.clear();
+            pos_ = 0;
+        }
+        if (!WaitFor(fd_, POLLIN, RECEIVE_TIMEOUT_MS, cancel_token)) {
+            return Cancelled(cancel_token) ? READ_CANCELLED : READ_ERROR;
+        }
+        size_t previous = buffer_.size();
+        buffer_.resize(previous + READ_SIZE);
+        ssize_t received = recv(fd_, &buffer_[previous], READ_SIZE, 0);
+        buffer_.resize(previous + std::max<ssize_t>(received, 0));
+        if (received > 0) {
+            return READ_DATA;
+        }
+        return received == 0 ? READ_EOF : READ_ERROR;
+    }
+
+    HttpResult PosixHttpConnection::Fail(ReadStatus status) {
+        reusable_ = false;
+        return status == READ_CANCELLED ? HttpResult::CANCELLED : HttpResult::FAILED;
+    }
+
+    // Hand what has been read of a streamed body to the sink
+    bool PosixHttpConnection::Deliver(std::vector<uint8_t>& body) {
+        if (!sink_ || body.empty()) {
+            return true;
+        }
+        bool accepted = (*sink_)(body.data(), body.size());
+        body.clear();
+        return accepted;
+    }
+
+    // Body bytes that arrived with the headers or a chunk line: read once into buffer_, copied once more
+    void PosixHttpConnection::TakeBuffered(size_t size, std::vector<uint8_t>& body) {
+        if (size == 0) {
+            return;
+        }
+        std::memcpy(AppendSpace(body, size, *response_), &buffer_[pos_], size);
+        pos_ += size;
+        response_->body_bytes += size;
+        response_->body_bytes_copied += 2 * size;
+        response_->buffered_body_bytes += size;
+    }
+
+    // Read up to want bytes straight onto the end of body; false on error or end of stream
+    bool PosixHttpConnection::ReceiveInto(size_t want, std::vector<uint8_t>& body, ssize_t& received) {
+        size_t previous = body.size();
+        received = recv(fd_, AppendSpace(body, want, *response_), want, 0);
+        body.resize(previous + std::max<ssize_t>(received, 0));
+        if (received <= 0) {
+            return false;
+        }
+        response_->body_bytes += static_cast<uint64_t>(received);
+        response_->body_bytes_copied += static_cast<uint64_t>(received);
+        return true;
+    }
+
+    bool PosixHttpConnection::SendAll(const std::string& request, std::atomic<bool>* cancel_token) {
+        size_t sent = 0;
+        while (sent < request.size()) {
+            ssize_t count = send(fd_, request.data() + sent, request.size() - sent, MSG_NOSIGNAL);
+            if (count > 0) {
+                sent += static_cast<size_t>(count);
+            } else if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+                if (!WaitFor(fd_, POLLOUT, RECEIVE_TIMEOUT_MS, cancel_token)) {
+                    return false;
+                }
+            } else {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    HttpResult PosixHttpConnection::ReadLine(std::string& line, std::atomic<bool>* cancel_token) {
+        while (true) {
+            size_t end = buffer_.find("\r\n", pos_);
+            if (end != std::string::npos) {
+                line.assign(buffer_, pos_, end - pos_);
+                pos_ = end + 2;
+                return HttpResult::OK;
+            }
+            if (buffer_.size() - pos_ > MAX_HEAD_SIZE) {
+                return Fail(READ_ERROR);
+            }
+            ReadStatus status = Fill(cancel_token);
+            if (status != READ_DATA) {
+                return Fail(status == READ_EOF ? READ_ERROR : status);
+            }
+        }
+    }
+
+    HttpResult PosixHttpConnection::ReadExactly(size_t size, std::vector<uint8_t>& body, std::atomic<bool>* cancel_token) {
+        size_t buffered = std::min(size, buffer_.size() - pos_);
+        TakeBuffered(buffered, body);
+        size -= buffered;
+        if (!Deliver(body)) {
+            return Fail(READ_CANCELLED);
+        }
+
+        // The rest goes straight into the body
+        while (size > 0) {
+            if (!WaitFor(fd_, POLLIN, RECEIVE_TIMEOUT_MS, cancel_token)) {
+                return Fail(Cancelled(cancel_token) ? READ_CANCELLED : READ_ERROR);
+            }
+            ssize_t received = 0;
+            if (!ReceiveInto(std::min(size, READ_SIZE), body, received)) {
+                return Fail(READ_ERROR);
+            }
+            size -= static_cast<size_t>(received);
+            if (!Deliver(body)) {
+                return Fail(READ_CANCELLED);
+            }
+        }
+        return HttpResult::OK;
+    }
+
+    HttpResult PosixHttpConnection::ReadChunked(std::vector<uint8_t>& body, std::atomic<bool>* cancel_token) {
+        std::string line;
+        while (true) {
+            HttpResult result = ReadLine(line, cancel_token);
+            if (result != HttpResult::OK) {
+                return result;
+            }
+            char* end = nullptr;
+            unsigned long long chunk = std::strtoull(line.c_str(), &end, 16);
+            if (end == line.c_str()) {
+                return Fail(READ_ERROR);
+            }
+            if (chunk == 0) {
+                break;
+            }
+            result = ReadExactly(static_cast<size_t>(chunk), body, cancel_token);
+            if (result == HttpResult::OK) {
+                result = ReadLine(line, cancel_token);
+            }
+            if (result != HttpResult::OK) {
+                return result;
+            }
+        }
+        // Trailers up to the empty line
+        do {
+            HttpResult result = ReadLine(line, cancel_token);
+            if (result != HttpResult::OK) {
+                return result;
+            }
+        } while (!line.empty());
+        return HttpResult::OK;
+    }
+
+    HttpResult PosixHttpConnection::ReadToClose(std::vector<uint8_t>& body, std::atomic<bool>* cancel_token) {
+        reusable_ = false;
+        TakeBuffered(buffer_.size() - pos_, body);
+        if (!Deliver(body)) {
+            return Fail(READ_CANCELLED);
+        }
+        while (true) {
+            if (!WaitFor(fd_, POLLIN, RECEIVE_TIMEOUT_MS, cancel_token)) {
+                return Fail(Cancelled(cancel_token) ? READ_CANCELLED : READ_ERROR);
+            }
+            ssize_t received = 0;
+            if (!ReceiveInto(READ_SIZE, body, received)) {
+                return received == 0 ? HttpResult::OK : Fail(READ_ERROR);
+            }
+            if (!Deliver(body)) {
+                return Fail(READ_CANCELLED);
+            }
+        }
+    }
+
+    HttpResult PosixHttpConnection::Get(const HttpUrl& url, std::vector<uint8_t>& body, HttpResponse& response,
+                                        std::atomic<bool>* cancel_token, const HttpBodySink* sink, const HttpHeaders* headers,
+                                        const HttpStreamFilter* stream) {
+        body.clear();
+        sink_ = nullptr;
+        response_ = &response;
+        std::string host = url.host.find(':') != std::string::npos ? "[" + url.host + "]" : url.host;
+        if (url.port != 80) {
+            host += ":" + std::to_string(url.port);
+        }
+        std::string request = "GET " + url.path + " HTTP/1.1\r\nHost: " + host +
+                              "\r\nUser-Agent: Tardsplaya/1.0\r\nAccept: */*\r\nConnection: keep-alive\r\n";
+        if (headers) {
+            for (const auto& header : *headers) {
+                request += header.first + ": " + header.second + "\r\n";
+            }
+        }
+        request += "\r\n";
+
+        auto start = std::chrono::steady_clock::now();
+        if (!SendAll(request, cancel_token)) {
+            reusable_ = false;
+            return Cancelled(cancel_token) ? HttpResult::CANCELLED : HttpResult::STALE;
+        }
+
+        // Nothing at all back means the server closed the connection before reading the request
+        if (pos_ == buffer_.size()) {
+            ReadStatus status = Fill(cancel_token);
+            if (status == READ_EOF || (status == READ_ERROR && errno == ECONNRESET)) {
+                reusable_ = false;
+                return HttpResult::STALE;
+            }
+            if (status != READ_DATA) {
+                return Fail(status);
+            }
+        }
+
+        std::string line;
+        HttpResult result = ReadLine(line, cancel_token);
+        if (result != HttpResult::OK) {
+            return result;
+        }
+        // HTTP/1.x 200 OK
+        size_t space = line.find(' ');
+        if (line.compare(0, 5, "HTTP/") != 0 || space == std::string::npos) {
+            return Fail(READ_ERROR);
+        }
+        bool http10 = line.compare(0, 8, "HTTP/1.0") == 0;
+        response.status = std::atoi(line.c_str() + space + 1);
+
+        while (true) {
+            result = ReadLine(line, cancel_token);
+            if (result != HttpResult::OK) {
+                return result;
+            }
+            if (line.empty()) {
+                break;
+            }
+            size_t colon = line.find(':');
+            if (colon == std::string::npos) {
+                continue;
+            }
+            std::string name = line.substr(0, colon);
+            std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+            size_t value_start = line.find_first_not_of(" \t", colon + 1);
+            response.headers.emplace_back(name, value_start == std::string::npos ? std::string() : line.substr(value_start));
+        }
+        response.time_to_headers = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+        const std::string* connection = response.FindHeader("connection");
+        std::string connection_value = connection ? *connection : std::string();
+        std::transform(connection_value.begin(), connection_value.end(), connection_value.begin(),
+                       [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        if (connection_value.find("close") != std::string::npos || (http10 && connection_value.find("keep-alive") == std::string::npos)) {
+            reusable_ = false;
+        }
+
+        // No body for 1xx, 204 and 304
+        if ((response.status >= 100 && response.status < 200) || response.status == 204 || response.status == 304) {
+            return HttpResult::OK;
+        }
+        sink_ = (response.status >= 200 && response.status < 300 && (!stream || (*stream)(response))) ? sink : nullptr;
+        if (!sink_) {
+            ReserveBody(body, response);
+        }
+        const std::string* transfer_encoding = response.FindHeader("transfer-encoding");
+        const std::string* content_length = response.FindHeader("content-length");
+        if (transfer_encoding && transfer_encoding->find("chunked") != std::string::npos) {
+            result = ReadChunked(body, cancel_token);
+        } else if (content_length) {
+            result = ReadExactly(static_cast<size_t>(std::strtoull(content_length->c_str(), nullptr, 10)), body, cancel_token);
+        } else {
+            result = ReadToClose(body, cancel_token);
+        }
+        return result;
+    }
+
+    class PosixHttpBackend : public HttpBackend {
+    public:
+        std::unique_ptr<HttpConnection> Connect(const HttpUrl& url, std::atomic<bool>* cancel_token) override;
+        const char* GetName() const override { return "POSIX sockets"; }
+    };
+
+    std::unique_ptr<HttpConnection> PosixHttpBackend::Connect(const HttpUrl& url, std::atomic<bool>* cancel_token) {
+        if (url.secure) {
+            return nullptr;     // No TLS in this backend
+        }
+        addrinfo hints = {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* addresses = nullptr;
+        if (getaddrinfo(url.host.c_str(), std::to_string(url.port).c_str(), &hints, &addresses) != 0) {
+            return nullptr;
+        }
+
+        int fd = -1;
+        for (addrinfo* address = addresses; address && fd < 0 && !Cancelled(cancel_token); address = address->ai_next) {
+            fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+            if (fd < 0) {
+                continue;
+            }
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+            int error = 0;
+            if (connect(fd, address->ai_addr, address->ai_addrlen) != 0) {
+                error = errno;
+                if (error == EINPROGRESS && WaitFor(fd, POLLOUT, CONNECT_TIMEOUT_MS, cancel_token)) {
+                    socklen_t length = sizeof(error);
+                    getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length);
+                }
+            }
+            if (error != 0) {
+                close(fd);
+                fd = -1;
+            }
+        }
+        freeaddrinfo(addresses);
+        if (fd < 0) {
+            return nullptr;
+        }
+
+        // Requests are small and answered one at a time; do not hold them back
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        return std::unique_ptr<HttpConnection>(new PosixHttpConnection(fd));
+    }
+
+} // namespace
+
+std::unique_ptr<HttpBackend> CreatePlatformHttpBackend() {
+    return std::unique_ptr<HttpBackend>(new PosixHttpBackend());
+}
+
+} // namespace tardsplaya
+
+#endif // _WIN32
@@ -0,0 +1,336 @@
+// WinHTTP backend for the HTTP client
+// Each pooled connection owns a WinHTTP session with one connect handle. WinHTTP keeps the socket of a
+// session alive between requests, so a connection here is one kept-alive TCP+TLS connection and
+// closing it when the pool evicts or discards it really closes the socket.
+// Requests run in WinHTTP's asynchronous mode, each driven by the thread that made it: it starts an
+// operation and waits for its completion, looking at the cancel token meanwhile. A cancelled request
+// closes its own handle, which is how WinHTTP aborts an operation in flight, instead of waiting for
+// WinHTTP's timeouts (30 s without a byte), and waits until WinHTTP has let go of it.
+
+#ifdef _WIN32
+
+#include "http_client.h"
+#define NOMINMAX
+#include <windows.h>
+#include <winhttp.h>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+#pragma comment(lib, "winhttp.lib")
+
+namespace tardsplaya {
+
+namespace {
+
+    std::wstring Widen(const std::string& text) {
+        if (text.empty()) return std::wstring();
+        int size = MultiByteToWideChar(CP_UTF8, 0, text.data(), static_cast<int>(text.size()), NULL, 0);
+        std::wstring out(size, 0);
+        MultiByteToWideChar(CP_UTF8, 0, text.data(), static_cast<int>(text.size()), &out[0], size);
+        return out;
+    }
+
+    // "Name: value" lines of WINHTTP_QUERY_RAW_HEADERS_CRLF; the status line has no colon-separated name
+    void ParseRawHeaders(const std::wstring& raw, HttpResponse& response) {
+        size_t start = 0;
+        while (start < raw.size()) {
+            size_t end = raw.find(L"\r\n", start);
+            if (end == std::wstring::npos) end = raw.size();
+            std::wstring line = raw.substr(start, end - start);
+            start = end + 2;
+            size_t colon = line.find(L':');
+            if (colon == std::wstring::npos || line.compare(0, 5, L"HTTP/") == 0) continue;
+            std::string name, value;
+            for (size_t i = 0; i < colon; ++i) name += static_cast<char>(std::tolower(static_cast<unsigned char>(line[i] & 0x7F)));
+            size_t value_start = line.find_first_not_of(L" \t", colon + 1);
+            for (size_t i = value_start == std::wstring::npos ? line.size() : value_start; i < line.size(); ++i) value += static_cast<char>(line[i]);
+            response.headers.emplace_back(name, value);
+        }
+    }
+
+    const std::chrono::milliseconds CANCEL_POLL(50);     // How often a request waiting on WinHTTP looks at its cancel token
+
+    // One request handle and the completions WinHTTP reports for it on its own threads. Only the thread
+    // that made the request calls WinHTTP with the handle, and it closes it at most once.
+    class AsyncRequest {
+    public:
+        explicit AsyncRequest(HINTERNET request) : request_(request) {
+            DWORD_PTR context = reinterpret_cast<DWORD_PTR>(this);
+            WinHttpSetOption(request_, WINHTTP_OPTION_CONTEXT_VALUE, &context, sizeof(context));
+        }
+
+        ~AsyncRequest() { Close(); }
+
+        AsyncRequest(const AsyncRequest&) = delete;
+        AsyncRequest& operator=(const AsyncRequest&) = delete;
+
+        // Start an operation with start, false when it could not be started, and wait for its completion; value is
+        // what the completion reports (bytes available or read). False on failure or when the token is set, in
+        // which case the handle is closed and WinHTTP is done with it and with any buffer it was given.
+        template <typename Start>
+        bool Run(Start start, std::atomic<bool>* cancel_token, DWORD& value) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                completed_ = false;
+                failed_ = false;
+                value_ = 0;
+            }
+            if (cancelled_ || (cancel_token && cancel_token->load())) {
+                cancelled_ = true;
+                Close();
+                return false;
+            }
+            if (!start()) {
+                return false;
+            }
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (!completed_) {
+                if (cancel_token && cancel_token->load()) {
+                    lock.unlock();
+                    cancelled_ = true;
+                    Close();
+                    return false;
+                }
+                changed_.wait_for(lock, CANCEL_POLL);
+            }
+            value = value_;
+            return !failed_;
+        }
+
+        DWORD_PTR GetContext() const { return reinterpret_cast<DWORD_PTR>(this); }
+        bool IsCancelled() const { return cancelled_; }
+
+        // Status callback of every session; session and connect handles carry no context
+        static void CALLBACK Callback(HINTERNET, DWORD_PTR context, DWORD status, LPVOID info, DWORD length) {
+            AsyncRequest* request = reinterpret_cast<AsyncRequest*>(context);
+            if (!request) {
+                return;
+            }
+            std::lock_guard<std::mutex> lock(request->mutex_);
+            switch (status) {
+            case WINHTTP_CALLBACK_STATUS_SENDREQUEST_COMPLETE:
+            case WINHTTP_CALLBACK_STATUS_HEADERS_AVAILABLE:
+                request->completed_ = true;
+                break;
+            case WINHTTP_CALLBACK_STATUS_DATA_AVAILABLE:
+                request->value_ = *static_cast<DWORD*>(info);
+                request->completed_ = true;
+                break;
+            case WINHTTP_CALLBACK_STATUS_READ_COMPLETE:
+                request->value_ = length;
+                request->completed_ = true;
+                break;
+            case WINHTTP_CALLBACK_STATUS_REQUEST_ERROR:
+                request->failed_ = true;
+                request->completed_ = true;
+                break;
+            case WINHTTP_CALLBACK_STATUS_HANDLE_CLOSING:
+                request->closed_ = true;        // The last callback for the handle
+                break;
+            default:
+                return;
+            }
+            request->changed_.notify_all();
+        }
+
+    private:
+        HINTERNET request_;
+        bool closing_ = false;          // Close called; only the request's thread looks at it
+        bool cancelled_ = false;
+        std::mutex mutex_;
+        std::condition_variable changed_;
+        bool completed_ = false;        // Under mutex_, like the rest
+        bool failed_ = false;
+        DWORD value_ = 0;
+        bool closed_ = false;
+
+        void Close() {
+            if (!closing_) {
+                closing_ = true;
+                WinHttpCloseHandle(request_);
+            }
+            std::unique_lock<std::mutex> lock(mutex_);
+            changed_.wait(lock, [this] { return closed_; });
+        }
+    };
+
+    class WinHttpConnection : public HttpConnection {
+    public:
+        WinHttpConnection(HINTERNET session, HINTERNET connect) : session_(session), connect_(connect) {}
+        ~WinHttpConnection() override {
+            WinHttpCloseHandle(connect_);
+            WinHttpCloseHandle(session_);
+        }
+
+        HttpResult Get(const HttpUrl& url, std::vector<uint8_t>& body, HttpResponse& response,
+                       std::atomic<bool>* cancel_token, const HttpBodySink* sink, const HttpHeaders* headers,
+                       const HttpStreamFilter* stream) override;
+        bool IsReusable() const override { return reusable_; }
+
+    private:
+        HINTERNET session_;
+        HINTERNET connect_;
+        bool reusable_ = true;
+        bool used_ = false;
+    };
+
+    HttpResult WinHttpConnection::Get(const HttpUrl& url, std::vector<uint8_t>& body, HttpResponse& response,
+                                      std::atomic<bool>* cancel_token, const HttpBodySink* sink, const HttpHeaders* headers,
+                                      const HttpStreamFilter* stream) {
+        body.clear();
+        HINTERNET hRequest = WinHttpOpenRequest(
+            connect_, L"GET", Widen(url.path).c_str(), NULL, WINHTTP_NO_REFERER, WINHTTP_DEFAULT_ACCEPT_TYPES,
+            url.secure ? WINHTTP_FLAG_SECURE : 0);
+        if (!hRequest) {
+            reusable_ = false;
+            return HttpResult::FAILED;
+        }
+        AsyncRequest request(hRequest);
+
+        // For HTTPS, ignore certificate errors for compatibility
+        if (url.secure) {
+            DWORD dwSecurityFlags = SECURITY_FLAG_IGNORE_CERT_CN_INVALID |
+                                   SECURITY_FLAG_IGNORE_CERT_DATE_INVALID |
+                                   SECURITY_FLAG_IGNORE_UNKNOWN_CA |
+                                   SECURITY_FLAG_IGNORE_CERT_WRONG_USAGE;
+            WinHttpSetOption(hRequest, WINHTTP_OPTION_SECURITY_FLAGS, &dwSecurityFlags, sizeof(dwSecurityFlags));
+        }
+
+        std::wstring extra_headers;
+        if (headers) {
+            for (const auto& header : *headers) {
+                extra_headers += Widen(header.first) + L": " + Widen(header.second) + L"\r\n";
+            }
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        DWORD unused = 0;
+        bool answered = request.Run([&] {
+                            return WinHttpSendRequest(hRequest, extra_headers.empty() ? WINHTTP_NO_ADDITIONAL_HEADERS : extra_headers.c_str(),
+                                                      extra_headers.empty() ? 0 : static_cast<DWORD>(-1L), 0, 0, 0,
+                                                      request.GetContext()) != FALSE;
+                        }, cancel_token, unused) &&
+                        request.Run([&] { return WinHttpReceiveResponse(hRequest, NULL) != FALSE; }, cancel_token, unused);
+        if (!answered) {
+            reusable_ = false;
+            if (request.IsCancelled()) {
+                return HttpResult::CANCELLED;
+            }
+            return used_ ? HttpResult::STALE : HttpResult::FAILED;
+        }
+        used_ = true;
+        response.time_to_headers = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+        DWORD status = 0, status_size = sizeof(status);
+        WinHttpQueryHeaders(hRequest, WINHTTP_QUERY_STATUS_CODE | WINHTTP_QUERY_FLAG_NUMBER,
+                            WINHTTP_HEADER_NAME_BY_INDEX, &status, &status_size, WINHTTP_NO_HEADER_INDEX);
+        response.status = static_cast<int>(status);
+
+        DWORD headers_size = 0;
+        WinHttpQueryHeaders(hRequest, WINHTTP_QUERY_RAW_HEADERS_CRLF, WINHTTP_HEADER_NAME_BY_INDEX, NULL, &headers_size, WINHTTP_NO_HEADER_INDEX);
+        if (headers_size > 0) {
+            std::wstring raw(headers_size / sizeof(wchar_t), 0);
+            if (WinHttpQueryHeaders(hRequest, WINHTTP_QUERY_RAW_HEADERS_CRLF, WINHTTP_HEADER_NAME_BY_INDEX, &raw[0], &headers_size, WINHTTP_NO_HEADER_INDEX)) {
+                raw.resize(headers_size / sizeof(wchar_t));
+                ParseRawHeaders(raw, response);
+            }
+        }
+        const std::string* connection = response.FindHeader("connection");
+        if (connection && connection->find("close") != std::string::npos) {
+            reusable_ = false;
+        }
+
+        // Only a successful body is streamed, and only when the caller wants this one streamed
+        if (response.status < 200 || response.status >= 300 || (stream && !(*stream)(response))) {
+            sink = nullptr;
+        }
+        // A streamed body reuses one receive buffer; a kept body is read in place, allocated once when its length is known
+        if (!sink) {
+            ReserveBody(body, response);
+        }
+
+        HttpResult result = HttpResult::OK;
+        DWORD dwSize = 0;
+        do {
+            if (cancel_token && cancel_token->load()) {
+                result = HttpResult::CANCELLED;
+                break;
+            }
+
+            if (!request.Run([&] { return WinHttpQueryDataAvailable(hRequest, NULL) != FALSE; }, cancel_token, dwSize)) {
+                result = request.IsCancelled() ? HttpResult::CANCELLED : HttpResult::FAILED;
+                break;
+            }
+            if (!dwSize) break;
+
+            // WinHTTP writes into the space until the read completes or the handle is closed
+            size_t prev_size = body.size();
+            uint8_t* space = AppendSpace(body, dwSize, response);
+            DWORD dwDownloaded = 0;
+            if (!request.Run([&] { return WinHttpReadData(hRequest, space, dwSize, NULL) != FALSE; }, cancel_token, dwDownloaded) ||
+                dwDownloaded == 0) {
+                body.resize(prev_size);
+                result = request.IsCancelled() ? HttpResult::CANCELLED : HttpResult::FAILED;
+                break;
+            }
+
+            body.resize(prev_size + dwDownloaded);
+            response.body_bytes += dwDownloaded;
+            response.body_bytes_copied += dwDownloaded;
+
+            if (sink) {
+                bool accepted = (*sink)(body.data(), body.size());
+                body.clear();
+                if (!accepted) {
+                    result = HttpResult::CANCELLED;
+                    break;
+                }
+            }
+        } while (dwSize > 0);
+
+        // A body left unread would keep the socket busy for the next request
+        if (result != HttpResult::OK) {
+            reusable_ = false;
+        }
+        return result;
+    }
+
+    class WinHttpBackend : public HttpBackend {
+    public:
+        std::unique_ptr<HttpConnection> Connect(const HttpUrl& url, std::atomic<bool>* cancel_token) override;
+        const char* GetName() const override { return "WinHTTP"; }
+    };
+
+    std::unique_ptr<HttpConnection> WinHttpBackend::Connect(const HttpUrl& url, std::atomic<bool>* cancel_token) {
+        if (cancel_token && cancel_token->load()) return nullptr;
+
+        // WinHTTP connects lazily; the handshake is part of the first request on this session
+        HINTERNET hSession = WinHttpOpen(L"Tardsplaya/1.0", WINHTTP_ACCESS_TYPE_DEFAULT_PROXY, 0, 0, WINHTTP_FLAG_ASYNC);
+        if (!hSession) return nullptr;
+        // Set before the connect and request handles are made, which take it from the session
+        if (WinHttpSetStatusCallback(hSession, AsyncRequest::Callback,
+                                     WINHTTP_CALLBACK_FLAG_ALL_COMPLETIONS | WINHTTP_CALLBACK_FLAG_HANDLES, 0) ==
+            WINHTTP_INVALID_STATUS_CALLBACK) {
+            WinHttpCloseHandle(hSession);
+            return nullptr;
+        }
+        HINTERNET hConnect = WinHttpConnect(hSession, Widen(url.host).c_str(), url.port, 0);
+        if (!hConnect) {
+            WinHttpCloseHandle(hSession);
+            return nullptr;
+        }
+        return std::unique_ptr<HttpConnection>(new WinHttpConnection(hSession, hConnect));
+    }
+
+} // namespace
+
+std::unique_ptr<HttpBackend> CreatePlatformHttpBackend() {
+    return std::unique_ptr<HttpBackend>(new WinHttpBackend());
+}
+
+} // namespace tardsplaya
+
+#endif // _WIN32
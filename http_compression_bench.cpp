@@ -0,0 +1,623 @@
+// Compressed playlist and API transfers through the shared HTTP client, against a loopback origin
+// The origin gzips or deflates its answers when the request asks for it, with a small deflate encoder
+// (LZ77 with stored, fixed and dynamic Huffman blocks) standing in for the CDN's. Measures the bytes
+// on the wire for a Twitch-style media playlist, a master playlist and a verbose API answer. Checks the
+// streaming decoder on every block type and framing fed in pieces of any size, a real gzip stream,
+// corrupt and truncated streams, that decoded bodies reach body and sink byte-exact, chunked or not,
+// and that requests without Accept-Encoding (segments) still get the body as sent.
+//
+// Build: g++ -std=c++17 -O2 -pthread http_compression_bench.cpp http_client.cpp http_client_posix.cpp inflater.cpp loopback_server.cpp -o http_compression_bench
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <queue>
+#include <random>
+#include <algorithm>
+#include "http_client.h"
+#include "inflater.h"
+#include "loopback_server.h"
+
+using namespace tardsplaya;
+
+namespace {
+
+    bool Check(bool condition, const std::string& what) {
+        std::cout << (condition ? "  PASS  " : "  FAIL  ") << what << std::endl;
+        return condition;
+    }
+
+    // --- Deflate encoder for the origin ---
+
+    const uint16_t LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                       35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    const uint8_t LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                       3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    const uint16_t DISTANCE_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                         257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    const uint8_t DISTANCE_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                         7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+    const uint8_t CODE_LENGTH_ORDER[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+    enum class Block { STORED, FIXED, DYNAMIC };
+    enum class Framing { GZIP, ZLIB, RAW };
+
+    class BitWriter {
+    public:
+        std::vector<uint8_t> bytes;
+
+        void Put(uint32_t value, int count) {
+            for (int i = 0; i < count; ++i) {
+                if (used_ == 0) {
+                    bytes.push_back(0);
+                }
+                bytes.back() |= static_cast<uint8_t>(((value >> i) & 1) << used_);
+                used_ = (used_ + 1) % 8;
+            }
+        }
+
+        // Huffman codes go most significant bit first
+        void PutCode(uint32_t code, int length) {
+            for (int i = length - 1; i >= 0; --i) {
+                Put((code >> i) & 1, 1);
+            }
+        }
+
+        void Align() { used_ = 0; }
+
+    private:
+        int used_ = 0;
+    };
+
+    struct Token {
+        uint16_t length;        // 0 for a literal
+        uint16_t value;         // Literal byte or distance
+    };
+
+    // Greedy LZ77 over hash chains of three bytes
+    std::vector<Token> FindMatches(const std::string& data) {
+        const size_t WINDOW = 32768, HASH_SIZE = 1 << 15, MAX_CHAIN = 64;
+        std::vector<int64_t> head(HASH_SIZE, -1), previous(data.size(), -1);
+        auto hash = [&](size_t i) {
+            return ((static_cast<uint8_t>(data[i]) << 10) ^ (static_cast<uint8_t>(data[i + 1]) << 5) ^ static_cast<uint8_t>(data[i + 2])) & (HASH_SIZE - 1);
+        };
+        auto insert = [&](size_t i) {
+            if (i + 2 < data.size()) {
+                size_t h = hash(i);
+                previous[i] = head[h];
+                head[h] = static_cast<int64_t>(i);
+            }
+        };
+        std::vector<Token> tokens;
+        size_t i = 0;
+        while (i < data.size()) {
+            size_t best_length = 0, best_distance = 0;
+            if (i + 2 < data.size()) {
+                int64_t candidate = head[hash(i)];
+                for (size_t chain = 0; candidate >= 0 && chain < MAX_CHAIN && i - candidate <= WINDOW; ++chain) {
+                    size_t length = 0;
+                    while (length < 258 && i + length < data.size() && data[candidate + length] == data[i + length]) {
+                        length++;
+                    }
+                    if (length > best_length) {
+                        best_length = length;
+                        best_distance = i - static_cast<size_t>(candidate);
+                    }
+                    candidate = previous[candidate];
+                }
+            }
+            if (best_length >= 3) {
+                tokens.push_back({ static_cast<uint16_t>(best_length), static_cast<uint16_t>(best_distance) });
+                for (size_t k = 0; k < best_length; ++k) {
+                    insert(i + k);
+                }
+                i += best_length;
+            } else {
+                tokens.push_back({ 0, static_cast<uint8_t>(data[i]) });
+                insert(i);
+                i++;
+            }
+        }
+        return tokens;
+    }
+
+    size_t LengthCode(size_t length) {
+        size_t code = 28;
+        while (LENGTH_BASE[code] > length) {
+            code--;
+        }
+        return code;
+    }
+
+    size_t DistanceCode(size_t distance) {
+        size_t code = 29;
+        while (DISTANCE_BASE[code] > distance) {
+            code--;
+        }
+        return code;
+    }
+
+    // Huffman code lengths of at most limit bits; rare symbols are made more common until the tree fits
+    std::vector<uint8_t> CodeLengths(std::vector<uint32_t> frequencies, int limit) {
+        std::vector<uint8_t> lengths(frequencies.size(), 0);
+        while (true) {
+            typedef std::pair<uint64_t, int> Node;
+            std::priority_queue<Node, std::vector<Node>, std::greater<Node>> queue;
+            std::vector<int> parent(frequencies.size() * 2, -1);
+            for (size_t s = 0; s < frequencies.size(); ++s) {
+                if (frequencies[s] > 0) {
+                    queue.push({ frequencies[s], static_cast<int>(s) });
+                }
+            }
+            if (queue.size() == 1) {
+                lengths[queue.top().second] = 1;
+                return lengths;
+            }
+            int next = static_cast<int>(frequencies.size());
+            while (queue.size() > 1) {
+                Node a = queue.top(); queue.pop();
+                Node b = queue.top(); queue.pop();
+                parent[a.second] = parent[b.second] = next;
+                queue.push({ a.first + b.first, next++ });
+            }
+            int longest = 0;
+            for (size_t s = 0; s < frequencies.size(); ++s) {
+                int depth = 0;
+                for (int node = static_cast<int>(s); frequencies[s] > 0 && parent[node] >= 0; node = parent[node]) {
+                    depth++;
+                }
+                lengths[s] = static_cast<uint8_t>(depth);
+                longest = std::max(longest, depth);
+            }
+            if (longest <= limit) {
+                return lengths;
+            }
+            for (uint32_t& frequency : frequencies) {
+                frequency = frequency ? (frequency >> 1) | 1 : 0;
+            }
+        }
+    }
+
+    std::vector<uint32_t> CanonicalCodes(const std::vector<uint8_t>& lengths) {
+        uint32_t count[16] = {}, next[16] = {};
+        for (uint8_t length : lengths) {
+            count[length]++;
+        }
+        count[0] = 0;
+        for (int bits = 1, code = 0; bits < 16; ++bits) {
+            code = (code + count[bits - 1]) << 1;
+            next[bits] = code;
+        }
+        std::vector<uint32_t> codes(lengths.size(), 0);
+        for (size_t s = 0; s < lengths.size(); ++s) {
+            if (lengths[s]) {
+                codes[s] = next[lengths[s]]++;
+            }
+        }
+        return codes;
+    }
+
+    std::vector<uint8_t> Deflate(const std::string& data, Block block) {
+        BitWriter writer;
+        if (block == Block::STORED) {
+            size_t offset = 0;
+            do {
+                size_t size = std::min<size_t>(65535, data.size() - offset);
+                writer.Put(offset + size == data.size() ? 1 : 0, 1);
+                writer.Put(0, 2);
+                writer.Align();
+                writer.Put(static_cast<uint32_t>(size), 16);
+                writer.Put(static_cast<uint32_t>(size ^ 0xFFFF), 16);
+                writer.bytes.insert(writer.bytes.end(), data.begin() + offset, data.begin() + offset + size);
+                offset += size;
+            } while (offset < data.size());
+            return writer.bytes;
+        }
+
+        std::vector<Token> tokens = FindMatches(data);
+        std::vector<uint8_t> literal_lengths(288, 0), distance_lengths(30, 0);
+        if (block == Block::FIXED) {
+            std::fill(literal_lengths.begin(), literal_lengths.begin() + 144, 8);
+            std::fill(literal_lengths.begin() + 144, literal_lengths.begin() + 256, 9);
+            std::fill(literal_lengths.begin() + 256, literal_lengths.begin() + 280, 7);
+            std::fill(literal_lengths.begin() + 280, literal_lengths.end(), 8);
+            std::fill(distance_lengths.begin(), distance_lengths.end(), 5);
+        } else {
+            std::vector<uint32_t> literal_counts(286, 0), distance_counts(30, 0);
+            literal_counts[256] = 1;
+            for (const Token& token : tokens) {
+                if (token.length == 0) {
+                    literal_counts[token.value]++;
+                } else {
+                    literal_counts[257 + LengthCode(token.length)]++;
+                    distance_counts[DistanceCode(token.value)]++;
+                }
+            }
+            if (std::all_of(distance_counts.begin(), distance_counts.end(), [](uint32_t count) { return count == 0; })) {
+                distance_counts[0] = 1;
+            }
+            literal_lengths = CodeLengths(literal_counts, 15);
+            distance_lengths = CodeLengths(distance_counts, 15);
+        }
+        std::vector<uint32_t> literal_codes = CanonicalCodes(literal_lengths), distance_codes = CanonicalCodes(distance_lengths);
+
+        writer.Put(1, 1);
+        writer.Put(block == Block::FIXED ? 1 : 2, 2);
+        if (block == Block::DYNAMIC) {
+            size_t literals = 286, distances = 30;
+            while (literals > 257 && literal_lengths[literals - 1] == 0) {
+                literals--;
+            }
+            while (distances > 1 && distance_lengths[distances - 1] == 0) {
+                distances--;
+            }
+            std::vector<uint8_t> all(literal_lengths.begin(), literal_lengths.begin() + literals);
+            all.insert(all.end(), distance_lengths.begin(), distance_lengths.begin() + distances);
+            // Run-length coded code lengths: symbol and extra bits
+            std::vector<std::pair<uint8_t, uint8_t>> runs;
+            for (size_t i = 0; i < all.size();) {
+                size_t run = 1;
+                while (i + run < all.size() && all[i + run] == all[i]) {
+                    run++;
+                }
+                if (all[i] == 0 && run >= 11) {
+                    run = std::min<size_t>(run, 138);
+                    runs.push_back({ 18, static_cast<uint8_t>(run - 11) });
+                } else if (all[i] == 0 && run >= 3) {
+                    run = std::min<size_t>(run, 10);
+                    runs.push_back({ 17, static_cast<uint8_t>(run - 3) });
+                } else if (run >= 4) {
+                    run = std::min<size_t>(run, 7);
+                    runs.push_back({ all[i], 0 });
+                    runs.push_back({ 16, static_cast<uint8_t>(run - 4) });
+                } else {
+                    run = 1;
+                    runs.push_back({ all[i], 0 });
+                }
+                i += run;
+            }
+            std::vector<uint32_t> run_counts(19, 0);
+            for (const auto& run : runs) {
+                run_counts[run.first]++;
+            }
+            std::vector<uint8_t> run_lengths = CodeLengths(run_counts, 7);
+            std::vector<uint32_t> run_codes = CanonicalCodes(run_lengths);
+            size_t order = 19;
+            while (order > 4 && run_lengths[CODE_LENGTH_ORDER[order - 1]] == 0) {
+                order--;
+            }
+            writer.Put(static_cast<uint32_t>(literals - 257), 5);
+            writer.Put(static_cast<uint32_t>(distances - 1), 5);
+            writer.Put(static_cast<uint32_t>(order - 4), 4);
+            for (size_t i = 0; i < order; ++i) {
+                writer.Put(run_lengths[CODE_LENGTH_ORDER[i]], 3);
+            }
+            for (const auto& run : runs) {
+                writer.PutCode(run_codes[run.first], run_lengths[run.first]);
+                if (run.first >= 16) {
+                    writer.Put(run.second, run.first == 16 ? 2 : run.first == 17 ? 3 : 7);
+                }
+            }
+        }
+        for (const Token& token : tokens) {
+            if (token.length == 0) {
+                writer.PutCode(literal_codes[token.value], literal_lengths[token.value]);
+                continue;
+            }
+            size_t code = LengthCode(token.length);
+            writer.PutCode(literal_codes[257 + code], literal_lengths[257 + code]);
+            writer.Put(static_cast<uint32_t>(token.length - LENGTH_BASE[code]), LENGTH_EXTRA[code]);
+            size_t distance = DistanceCode(token.value);
+            writer.PutCode(distance_codes[distance], distance_lengths[distance]);
+            writer.Put(static_cast<uint32_t>(token.value - DISTANCE_BASE[distance]), DISTANCE_EXTRA[distance]);
+        }
+        writer.PutCode(literal_codes[256], literal_lengths[256]);
+        return writer.bytes;
+    }
+
+    uint32_t Crc32(const std::string& data) {
+        uint32_t crc = 0xFFFFFFFF;
+        for (unsigned char c : data) {
+            crc ^= c;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+            }
+        }
+        return crc ^ 0xFFFFFFFF;
+    }
+
+    uint32_t Adler32(const std::string& data) {
+        uint32_t a = 1, b = 0;
+        for (unsigned char c : data) {
+            a = (a + c) % 65521;
+            b = (b + a) % 65521;
+        }
+        return (b << 16) | a;
+    }
+
+    std::string Compress(const std::string& data, Framing framing, Block block = Block::DYNAMIC) {
+        std::vector<uint8_t> deflated = Deflate(data, block);
+        std::string out;
+        auto put32 = [&](uint32_t value, bool big_endian) {
+            for (int i = 0; i < 4; ++i) {
+                out += static_cast<char>(value >> (big_endian ? 24 - 8 * i : 8 * i));
+            }
+        };
+        if (framing == Framing::GZIP) {
+            out += std::string("\x1f\x8b\x08\x00\x00\x00\x00\x00\x00\x03", 10);
+        } else if (framing == Framing::ZLIB) {
+            out += "\x78\x9c";
+        }
+        out.append(deflated.begin(), deflated.end());
+        if (framing == Framing::GZIP) {
+            put32(Crc32(data), false);
+            put32(static_cast<uint32_t>(data.size()), false);
+        } else if (framing == Framing::ZLIB) {
+            put32(Adler32(data), true);
+        }
+        return out;
+    }
+
+    // --- Test documents ---
+
+    std::string RandomToken(std::mt19937& random, size_t size) {
+        static const char ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+        std::string token;
+        for (size_t i = 0; i < size; ++i) {
+            token += ALPHABET[random() % 64];
+        }
+        return token;
+    }
+
+    // Live media playlist as Twitch serves it: each segment URL carries an opaque token of several hundred bytes
+    std::string MediaPlaylist(std::mt19937& random) {
+        std::string playlist = "#EXTM3U\n#EXT-X-VERSION:3\n#EXT-X-TARGETDURATION:6\n#EXT-X-MEDIA-SEQUENCE:18342\n"
+                               "#EXT-X-TWITCH-LIVE-SEQUENCE:18348\n#EXT-X-TWITCH-ELAPSED-SECS:36684.000\n#EXT-X-TWITCH-TOTAL-SECS:36696.000\n"
+                               "#EXT-X-DATERANGE:ID=\"playlist-creation-1760616000\",CLASS=\"timestamp\",START-DATE=\"2026-10-16T02:00:00.000Z\","
+                               "END-ON-NEXT=YES,X-SERVER-TIME=\"1760652684.00\"\n"
+                               "#EXT-X-DATERANGE:ID=\"playlist-session-1760616000\",CLASS=\"twitch-session\",START-DATE=\"2026-10-16T02:00:00.000Z\","
+                               "END-ON-NEXT=YES,X-TV-TWITCH-SESSIONID=\"" + RandomToken(random, 32) + "\"\n";
+        for (int i = 0; i < 6; ++i) {
+            playlist += "#EXT-X-PROGRAM-DATE-TIME:2026-10-16T12:11:" + std::to_string(10 + 2 * i) + ".000Z\n#EXTINF:2.000,live\n"
+                        "https://video-edge-c2e2b4.pdx01.abs.hls.ttvnw.net/v1/segment/" + RandomToken(random, 620) + ".ts\n";
+        }
+        for (int i = 0; i < 2; ++i) {
+            playlist += "#EXT-X-TWITCH-PREFETCH:https://video-edge-c2e2b4.pdx01.abs.hls.ttvnw.net/v1/segment/" + RandomToken(random, 620) + ".ts\n";
+        }
+        return playlist;
+    }
+
+    std::string MasterPlaylist(std::mt19937& random) {
+        const char* names[] = { "1080p60", "720p60", "720p30", "480p30", "360p30", "160p30", "audio_only" };
+        const int bandwidths[] = { 8534030, 3422999, 2373000, 1427999, 630000, 230000, 160000 };
+        std::string playlist = "#EXTM3U\n#EXT-X-TWITCH-INFO:NODE=\"video-edge-c2e2b4.pdx01\",MANIFEST-NODE-TYPE=\"weaver_cluster\","
+                               "MANIFEST-NODE=\"video-weaver.pdx01\",SUPPRESS=\"false\",SERVER-TIME=\"1760652684.00\",TRANSCODESTACK=\"2023-Transcode-QS-V1\","
+                               "USER-IP=\"203.0.113.7\",SERVING-ID=\"" + RandomToken(random, 32) + "\",CLUSTER=\"pdx01\",ABS=\"false\",BROADCAST-ID=\"41234567890\","
+                               "STREAM-TIME=\"36684.0\",B=\"false\",USER-COUNTRY=\"US\",MANIFEST-CLUSTER=\"pdx01\",ORIGIN=\"pdx05\",C=\"" + RandomToken(random, 40) + "\"\n";
+        for (int i = 0; i < 7; ++i) {
+            playlist += std::string("#EXT-X-MEDIA:TYPE=VIDEO,GROUP-ID=\"") + names[i] + "\",NAME=\"" + names[i] + "\",AUTOSELECT=YES,DEFAULT=" +
+                        (i == 0 ? "YES" : "NO") + "\n#EXT-X-STREAM-INF:BANDWIDTH=" + std::to_string(bandwidths[i]) +
+                        ",RESOLUTION=1920x1080,CODECS=\"avc1.64002A,mp4a.40.2\",VIDEO=\"" + names[i] + "\",FRAME-RATE=60.000\n"
+                        "https://video-weaver.pdx01.hls.ttvnw.net/v1/playlist/" + RandomToken(random, 560) + ".m3u8\n";
+        }
+        return playlist;
+    }
+
+    // Verbose GQL answer: repeated keys and type names around short values
+    std::string ApiAnswer(std::mt19937& random) {
+        std::string json = "{\"data\":{\"user\":{\"id\":\"41234567\",\"login\":\"channel\",\"stream\":{\"id\":\"41234567890\",\"type\":\"live\","
+                           "\"viewersCount\":12345,\"__typename\":\"Stream\"},\"videos\":{\"edges\":[";
+        for (int i = 0; i < 40; ++i) {
+            json += std::string(i ? "," : "") + "{\"cursor\":\"" + RandomToken(random, 12) + "\",\"node\":{\"id\":\"" + std::to_string(2000000000 + i * 7919) +
+                    "\",\"title\":\"Stream highlight number " + std::to_string(i) + "\",\"lengthSeconds\":" + std::to_string(600 + i * 37) +
+                    ",\"previewThumbnailURL\":\"https://static-cdn.jtvnw.net/cf_vods/d2nvs31859zcd8/" + RandomToken(random, 20) +
+                    "/thumb/thumb0-320x180.jpg\",\"game\":{\"id\":\"509658\",\"name\":\"Just Chatting\",\"__typename\":\"Game\"},"
+                    "\"self\":{\"isRestricted\":false,\"viewingHistory\":null,\"__typename\":\"VideoSelfEdge\"},\"__typename\":\"Video\"},"
+                    "\"__typename\":\"VideoEdge\"}";
+        }
+        return json + "],\"__typename\":\"VideoConnection\"},\"__typename\":\"User\"}},\"extensions\":{\"durationMilliseconds\":42,"
+                      "\"operationName\":\"ChannelVideos\",\"requestID\":\"" + RandomToken(random, 26) + "\"}}";
+    }
+
+    // --- Decoder checks ---
+
+    // Fed whole, byte by byte and in random pieces
+    bool Decodes(const std::string& encoded, Inflater::Format format, const std::string& expected) {
+        std::mt19937 random(7);
+        for (int pieces = 0; pieces < 3; ++pieces) {
+            Inflater inflater(format);
+            std::vector<uint8_t> out;
+            Inflater::Status status = Inflater::Status::MORE;
+            for (size_t offset = 0; offset < encoded.size();) {
+                size_t size = pieces == 0 ? encoded.size() : pieces == 1 ? 1 : 1 + random() % 700;
+                size = std::min(size, encoded.size() - offset);
+                status = inflater.Write(reinterpret_cast<const uint8_t*>(encoded.data()) + offset, size, out);
+                offset += size;
+            }
+            if (status != Inflater::Status::DONE || std::string(out.begin(), out.end()) != expected ||
+                inflater.GetBytesOut() != expected.size() || inflater.GetBytesIn() != encoded.size()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    Inflater::Status DecodeStatus(const std::string& encoded, Inflater::Format format) {
+        Inflater inflater(format);
+        std::vector<uint8_t> out;
+        return inflater.Write(reinterpret_cast<const uint8_t*>(encoded.data()), encoded.size(), out);
+    }
+
+    // --- Origin ---
+
+    struct Documents {
+        std::string media;
+        std::string master;
+        std::string api;
+        std::string segment;
+        std::string bomb;           // Gzip of 16 MB of zeros: a few kilobytes
+    } documents;
+
+    // Routes of the loopback origin; answers are compressed only when the request accepts it
+    //   /media.m3u8, /master.m3u8, /gql      the documents; ?deflate for zlib framing, ?raw for raw deflate
+    //   /chunked.m3u8                        media playlist, chunked
+    //   /corrupt.m3u8                        media playlist, gzip with a damaged byte
+    //   /bomb.m3u8                           16 MB of zeros, gzip
+    //   /segment.ts                          never compressed
+    void Respond(const LoopbackRequest& request, LoopbackResponse& response) {
+        std::string path = request.path.substr(0, request.path.find('?'));
+        std::string query = request.path.find('?') == std::string::npos ? "" : request.path.substr(request.path.find('?') + 1);
+        const std::string* accept = request.FindHeader("accept-encoding");
+        const std::string& document = path == "/master.m3u8" ? documents.master : path == "/gql" ? documents.api :
+                                      path == "/segment.ts" ? documents.segment : documents.media;
+        response.chunked = path == "/chunked.m3u8";
+        if (!accept || path == "/segment.ts") {
+            response.body = document;
+            return;
+        }
+        if (path == "/bomb.m3u8") {
+            response.body = documents.bomb;
+            response.headers.emplace_back("Content-Encoding", "gzip");
+            return;
+        }
+        Framing framing = query == "deflate" ? Framing::ZLIB : query == "raw" ? Framing::RAW : Framing::GZIP;
+        response.body = Compress(document, framing);
+        response.headers.emplace_back("Content-Encoding", framing == Framing::GZIP ? "gzip" : "deflate");
+        if (path == "/corrupt.m3u8") {
+            response.body[response.body.size() / 2] ^= 0x20;
+        }
+    }
+
+} // namespace
+
+int main() {
+    std::cout << "=== Compressed playlist and API transfers ===" << std::endl;
+    bool ok = true;
+    std::mt19937 random(2026);
+    documents.media = MediaPlaylist(random);
+    documents.master = MasterPlaylist(random);
+    documents.api = ApiAnswer(random);
+    documents.segment = RandomToken(random, 256 * 1024);
+    documents.bomb = Compress(std::string(16 * 1024 * 1024, '\0'), Framing::GZIP);
+
+    // The decoder on its own
+    for (Block block : { Block::STORED, Block::FIXED, Block::DYNAMIC }) {
+        const char* name = block == Block::STORED ? "stored" : block == Block::FIXED ? "fixed" : "dynamic";
+        ok = Check(Decodes(Compress(documents.media, Framing::GZIP, block), Inflater::Format::GZIP, documents.media),
+                   std::string("gzip, ") + name + " blocks: decoded in pieces of any size") && ok;
+        ok = Check(Decodes(Compress(documents.api, Framing::ZLIB, block), Inflater::Format::DEFLATE, documents.api),
+                   std::string("zlib, ") + name + " blocks: decoded in pieces of any size") && ok;
+        ok = Check(Decodes(Compress(documents.master, Framing::RAW, block), Inflater::Format::DEFLATE, documents.master),
+                   std::string("raw deflate, ") + name + " blocks: decoded in pieces of any size") && ok;
+    }
+    std::string large = documents.segment + documents.media + documents.segment.substr(0, 70000);
+    ok = Check(Decodes(Compress(large, Framing::GZIP), Inflater::Format::GZIP, large), "longer than the window: back references wrap") && ok;
+    ok = Check(Decodes(Compress("", Framing::GZIP), Inflater::Format::GZIP, ""), "empty body") && ok;
+
+    // Made by gzip -9, so not only this file's encoder is understood
+    const uint8_t REAL_GZIP[] = { 0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x53, 0x76, 0x8d, 0x08, 0xf1, 0x35,
+                                  0x0e, 0xe5, 0x52, 0x06, 0xd2, 0xba, 0x11, 0xba, 0x61, 0xae, 0x41, 0xc1, 0x9e, 0xfe, 0x7e, 0x56,
+                                  0xc6, 0x60, 0x01, 0xac, 0x12, 0x00, 0x7d, 0x52, 0x42, 0x71, 0x32, 0x00, 0x00, 0x00 };
+    ok = Check(Decodes(std::string(REAL_GZIP, REAL_GZIP + sizeof(REAL_GZIP)), Inflater::Format::GZIP,
+                       "#EXTM3U\n#EXT-X-VERSION:3\n#EXTM3U\n#EXT-X-VERSION:3\n"), "stream from another encoder") && ok;
+
+    std::string damaged = Compress(documents.media, Framing::GZIP);
+    damaged[damaged.size() - 6] ^= 0x01;
+    ok = Check(DecodeStatus(damaged, Inflater::Format::GZIP) == Inflater::Status::FAILED, "CRC mismatch: failed") && ok;
+    std::string cut = Compress(documents.media, Framing::ZLIB);
+    cut.resize(cut.size() - 3);
+    ok = Check(DecodeStatus(cut, Inflater::Format::DEFLATE) == Inflater::Status::MORE, "cut short: still waiting for the rest") && ok;
+    ok = Check(DecodeStatus(std::string("\x1f\x8b\x09\x00", 4), Inflater::Format::GZIP) == Inflater::Status::FAILED, "unknown method: failed") && ok;
+    Inflater capped(Inflater::Format::GZIP, 1024 * 1024);
+    std::vector<uint8_t> expanded;
+    ok = Check(capped.Write(reinterpret_cast<const uint8_t*>(documents.bomb.data()), documents.bomb.size(), expanded) ==
+               Inflater::Status::TOO_LARGE && expanded.size() < 1024 * 1024 + 300,
+               std::to_string(documents.bomb.size()) + " bytes for 16 MB: stopped past the output cap") && ok;
+    Inflater::Format format = Inflater::Format::DEFLATE;
+    ok = Check(Inflater::FormatOf(" GZIP", format) && format == Inflater::Format::GZIP && !Inflater::FormatOf("br", format) &&
+               !Inflater::FormatOf("identity", format), "Content-Encoding values") && ok;
+
+    // Through the client
+    LoopbackServer server(Respond);
+    if (!Check(server.Start(), "loopback server listening")) {
+        return 1;
+    }
+    HttpClient client(CreatePlatformHttpBackend());
+    const HttpHeaders* compressed = &CompressedTextHeaders();
+
+    struct Transfer {
+        const char* name;
+        std::string path;
+        const std::string* document;
+        HttpResponse response;
+        bool ok = false;
+    };
+    std::vector<Transfer> transfers = {
+        { "media playlist, gzip", "/media.m3u8", &documents.media, {}, false },
+        { "media playlist, deflate", "/media.m3u8?deflate", &documents.media, {}, false },
+        { "media playlist, raw deflate", "/media.m3u8?raw", &documents.media, {}, false },
+        { "media playlist, chunked gzip", "/chunked.m3u8", &documents.media, {}, false },
+        { "master playlist, gzip", "/master.m3u8", &documents.master, {}, false },
+        { "API answer, gzip", "/gql", &documents.api, {}, false },
+    };
+    std::vector<uint8_t> body;
+    for (Transfer& transfer : transfers) {
+        transfer.ok = client.Get(server.Url(transfer.path), body, nullptr, &transfer.response, 1, compressed) &&
+                      std::string(body.begin(), body.end()) == *transfer.document;
+        ok = Check(transfer.ok && transfer.response.decoded_bytes == transfer.document->size() &&
+                   transfer.response.body_bytes < transfer.document->size(), std::string(transfer.name) + ": decoded into body") && ok;
+    }
+
+    std::string streamed;
+    HttpBodySink collect = [&](const uint8_t* data, size_t size) {
+        streamed.append(reinterpret_cast<const char*>(data), size);
+        return true;
+    };
+    ok = Check(client.Get(server.Url("/media.m3u8"), collect, nullptr, nullptr, 1, compressed) && streamed == documents.media,
+               "streamed to a sink: decoded bytes") && ok;
+
+    // Read once; only the bytes that came in with the headers, however the reads fell, are copied again
+    HttpResponse plain;
+    ok = Check(client.Get(server.Url("/media.m3u8"), body, nullptr, &plain, 1) && std::string(body.begin(), body.end()) == documents.media &&
+               !plain.FindHeader("content-encoding") && plain.decoded_bytes == plain.body_bytes &&
+               plain.body_bytes_copied == plain.body_bytes + plain.buffered_body_bytes,
+               "without Accept-Encoding: sent as is and read in place") && ok;
+    HttpResponse segment;
+    ok = Check(client.Get(server.Url("/segment.ts"), body, nullptr, &segment, 1, compressed) && body.size() == documents.segment.size() &&
+               segment.decoded_bytes == segment.body_bytes && segment.body_bytes_copied == segment.body_bytes + segment.buffered_body_bytes,
+               "answer not compressed: read in place") && ok;
+
+    HttpClient::Stats before = client.GetStats();
+    ok = Check(!client.Get(server.Url("/corrupt.m3u8"), body, nullptr, nullptr, 2, compressed) &&
+               client.GetStats().undecodable == before.undecodable + 2, "corrupt body: request fails, retried once") && ok;
+    HttpClient::Config small_config;
+    small_config.max_decoded_bytes = 1024 * 1024;
+    HttpClient small(CreatePlatformHttpBackend(), small_config);
+    ok = Check(!small.Get(server.Url("/bomb.m3u8"), body, nullptr, nullptr, 2, compressed) && small.GetStats().oversized == 1 &&
+               small.GetStats().retries == 0 && body.size() < 1024 * 1024 + 300, "body decoding past the cap: request fails, not retried") && ok;
+    ok = Check(client.Get(server.Url("/bomb.m3u8"), body, nullptr, nullptr, 1, compressed) && body.size() == 16 * 1024 * 1024,
+               "under the cap: decoded") && ok;
+
+    std::cout << std::endl << std::left << std::setw(34) << "  document" << std::right << std::setw(10) << "bytes" << std::setw(12)
+              << "on wire" << std::setw(10) << "saved" << std::endl;
+    auto print = [](const std::string& name, uint64_t size, uint64_t wire) {
+        std::cout << std::left << std::setw(34) << ("  " + name) << std::right << std::setw(10) << size << std::setw(12) << wire
+                  << std::setw(9) << std::fixed << std::setprecision(1) << 100.0 - 100.0 * wire / size << "%" << std::endl;
+    };
+    for (const Transfer& transfer : transfers) {
+        print(transfer.name, transfer.response.decoded_bytes, transfer.response.body_bytes);
+    }
+    HttpClient::Stats stats = client.GetStats();
+    std::cout << "  client: " << stats.encoded_bodies << " compressed bodies, " << stats.encoded_bytes << " bytes for "
+              << stats.decoded_bytes << " (" << std::setprecision(1) << stats.CompressionSavings() * 100.0 << "% saved)" << std::endl
+              << "  (media playlist URLs carry opaque tokens that do not compress; the tags around them do)" << std::endl << std::endl;
+
+    ok = Check(transfers[0].response.body_bytes * 100 < transfers[0].response.decoded_bytes * 75, "media playlist: at least 25% saved") && ok;
+    ok = Check(transfers[4].response.body_bytes * 100 < transfers[4].response.decoded_bytes * 75, "master playlist: at least 25% saved") && ok;
+    ok = Check(transfers[5].response.body_bytes * 100 < transfers[5].response.decoded_bytes * 25, "API answer: at least 75% saved") && ok;
+
+    server.Stop();
+    std::cout << std::endl << (ok ? "All checks passed" : "SOME CHECKS FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,199 @@
+// Body copies and allocations of the HTTP read loops, against a loopback origin
+// A source-quality segment is fetched with Content-Length, chunked, and streamed to a sink, and the
+// client's count of bytes written into memory per body byte received is compared with the old read
+// loop, which grew the body by each chunk the socket had ready. Large allocations on the fetching
+// thread are counted by replacing operator new. Checks that a segment with Content-Length is read
+// in place into one allocation, that a reused body buffer is not allocated again, that a streamed
+// body needs no segment-sized buffer, and that the bodies are byte-exact.
+//
+// Build: g++ -std=c++17 -O2 -pthread http_copy_bench.cpp http_client.cpp http_client_posix.cpp inflater.cpp loopback_server.cpp -o http_copy_bench
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include "http_client.h"
+#include "loopback_server.h"
+
+using namespace tardsplaya;
+
+namespace {
+
+    const size_t SEGMENT_BYTES = 6 * 1024 * 1024;       // 1080p60 source, 2 s at 24 Mbit/s
+    const size_t LARGE_ALLOCATION = 1024 * 1024;
+    const size_t OLD_LOOP_CHUNK = 16 * 1024;            // What WinHTTP typically reports available per call
+
+    thread_local bool counting = false;
+    std::atomic<int> large_allocations{0};
+
+    bool Check(bool condition, const std::string& what) {
+        std::cout << (condition ? "  PASS  " : "  FAIL  ") << what << std::endl;
+        return condition;
+    }
+
+    uint8_t BodyByte(size_t index) {
+        return static_cast<uint8_t>((index * 2654435761u) >> 13);
+    }
+
+    bool BodyOk(const std::vector<uint8_t>& body) {
+        if (body.size() != SEGMENT_BYTES) {
+            return false;
+        }
+        for (size_t i = 0; i < SEGMENT_BYTES; ++i) {
+            if (body[i] != BodyByte(i)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Routes of the loopback origin
+    //   /segment          SEGMENT_BYTES with Content-Length
+    //   /chunked          SEGMENT_BYTES, chunked
+    void Respond(const LoopbackRequest& request, LoopbackResponse& response) {
+        response.body.resize(SEGMENT_BYTES);
+        for (size_t i = 0; i < SEGMENT_BYTES; ++i) {
+            response.body[i] = static_cast<char>(BodyByte(i));
+        }
+        response.chunked = request.path == "/chunked";
+    }
+
+    struct Run {
+        bool ok = false;
+        HttpResponse response;
+        int large_allocations = 0;
+        double ratio = 0.0;
+    };
+
+    Run Download(HttpClient& client, const std::string& url, std::vector<uint8_t>& body, const HttpBodySink* sink = nullptr) {
+        Run run;
+        large_allocations = 0;
+        counting = true;
+        run.ok = sink ? client.Get(url, *sink, nullptr, &run.response) : client.Get(url, body, nullptr, &run.response);
+        counting = false;
+        run.large_allocations = large_allocations.load();
+        run.ratio = run.response.body_bytes ? static_cast<double>(run.response.body_bytes_copied) / run.response.body_bytes : 0.0;
+        return run;
+    }
+
+    // The old loop: resize by each chunk, no reservation; bytes read plus bytes moved by reallocation
+    double OldLoopRatio(int& allocations) {
+        std::vector<uint8_t> body;
+        uint64_t copied = 0;
+        large_allocations = 0;
+        counting = true;
+        for (size_t offset = 0; offset < SEGMENT_BYTES; offset += OLD_LOOP_CHUNK) {
+            size_t size = std::min(OLD_LOOP_CHUNK, SEGMENT_BYTES - offset);
+            size_t previous = body.size();
+            if (previous + size > body.capacity()) {
+                copied += previous;
+            }
+            body.resize(previous + size);
+            for (size_t i = 0; i < size; ++i) {
+                body[previous + i] = BodyByte(offset + i);
+            }
+            copied += size;
+        }
+        counting = false;
+        allocations = large_allocations.load();
+        return static_cast<double>(copied) / SEGMENT_BYTES;
+    }
+
+} // namespace
+
+void* operator new(size_t size) {
+    if (counting && size >= LARGE_ALLOCATION) {
+        large_allocations++;
+    }
+    void* memory = std::malloc(size ? size : 1);
+    if (!memory) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    std::free(memory);
+}
+
+int main() {
+    std::cout << "=== HTTP body copies per byte received ===" << std::endl;
+    bool ok = true;
+
+    LoopbackServer server(Respond);
+    if (!Check(server.Start(), "loopback server listening")) {
+        return 1;
+    }
+    HttpClient client(CreatePlatformHttpBackend());
+
+    std::vector<uint8_t> body;
+    Run sized = Download(client, server.Url("/segment"), body);
+    ok = Check(sized.ok && BodyOk(body), "Content-Length: body complete") && ok;
+    Run reused = Download(client, server.Url("/segment"), body);
+    ok = Check(reused.ok && BodyOk(body), "reused buffer: body complete") && ok;
+
+    std::vector<uint8_t> chunked_body;
+    Run chunked = Download(client, server.Url("/chunked"), chunked_body);
+    ok = Check(chunked.ok && BodyOk(chunked_body), "chunked: body complete") && ok;
+    Run chunked_reused = Download(client, server.Url("/chunked"), chunked_body);
+    ok = Check(chunked_reused.ok && BodyOk(chunked_body), "chunked, reused buffer: body complete") && ok;
+
+    std::vector<uint8_t> streamed;
+    HttpBodySink collect = [&](const uint8_t* data, size_t size) {
+        counting = false;
+        streamed.insert(streamed.end(), data, data + size);
+        counting = true;
+        return true;
+    };
+    std::vector<uint8_t> unused;
+    Run sink = Download(client, server.Url("/segment"), unused, &collect);
+    ok = Check(sink.ok && BodyOk(streamed), "streamed: bytes handed on in order") && ok;
+    // Like the prefetcher, this caller keeps what the sink is given in a buffer of its own: one more copy
+    uint64_t copied_before = client.GetStats().body_bytes_copied;
+    client.CountCopied(streamed.size());
+    ok = Check(client.GetStats().body_bytes_copied == copied_before + streamed.size(), "caller's copy of streamed bytes counted") && ok;
+
+    int old_allocations = 0;
+    double old_ratio = OldLoopRatio(old_allocations);
+
+    std::cout << std::endl << SEGMENT_BYTES / (1024 * 1024) << " MB segment" << std::endl;
+    std::cout << std::left << std::setw(34) << "  read loop" << std::right << std::setw(16) << "copied/received"
+              << std::setw(20) << "allocations >= 1MB" << std::endl;
+    auto print = [](const std::string& name, double ratio, int allocations) {
+        std::cout << std::left << std::setw(34) << ("  " + name) << std::right << std::fixed << std::setprecision(3)
+                  << std::setw(16) << ratio << std::setw(20) << allocations << std::endl;
+    };
+    print("old: resize per chunk", old_ratio, old_allocations);
+    print("Content-Length, new buffer", sized.ratio, sized.large_allocations);
+    print("Content-Length, reused buffer", reused.ratio, reused.large_allocations);
+    print("chunked, new buffer", chunked.ratio, chunked.large_allocations);
+    print("chunked, reused buffer", chunked_reused.ratio, chunked_reused.large_allocations);
+    print("streamed to a sink", sink.ratio, sink.large_allocations);
+    std::cout << "  (bytes that arrive with the headers or a chunk line are read into the line buffer first and count twice)" << std::endl;
+    std::cout << std::endl;
+
+    ok = Check(sized.response.body_bytes == SEGMENT_BYTES, "every body byte counted as received") && ok;
+    ok = Check(sized.ratio < 1.02, "Content-Length: about one write per byte received") && ok;
+    ok = Check(sized.large_allocations == 1, "Content-Length: one allocation, the whole segment") && ok;
+    ok = Check(reused.ratio < 1.02 && reused.large_allocations == 0, "reused buffer: read in place, nothing allocated") && ok;
+    ok = Check(chunked.large_allocations <= 4 && chunked.ratio < 4.0, "chunked: geometric growth, moves less than twice the body") && ok;
+    ok = Check(chunked_reused.ratio < 2.02 && chunked_reused.large_allocations == 0,
+               "chunked, reused buffer: only the chunk-line buffer's copy, nothing allocated") && ok;
+    ok = Check(sink.ratio < 1.02 && sink.large_allocations == 0, "streamed: one write per byte, no segment-sized buffer") && ok;
+    ok = Check(sized.ratio < old_ratio, "Content-Length reads fewer bytes into memory than the old loop") && ok;
+
+    HttpClient::Stats stats = client.GetStats();
+    ok = Check(stats.body_bytes == 5 * SEGMENT_BYTES && stats.CopyRatio() > 0.99, "client totals add up") && ok;
+
+    server.Stop();
+    std::cout << std::endl << (ok ? "All checks passed" : "SOME CHECKS FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,263 @@
+// Keep-alive connection pool load test against a loopback HTTP server
+// Several streams each alternate a playlist refresh and a segment download from one host, once with
+// a new connection per request (what every fetch used to do) and once through the pool. The loopback
+// server charges each new connection a simulated TCP+TLS handshake on top of one round trip per
+// request. Reports connections opened, reuse ratio and handshake time saved, then checks per-host
+// limits, idle eviction, connections the server drops, chunked and close-delimited bodies, status
+// handling and cancellation.
+//
+// Build: g++ -std=c++17 -O2 -pthread http_pool_bench.cpp http_client.cpp http_client_posix.cpp inflater.cpp loopback_server.cpp -o http_pool_bench
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include "http_client.h"
+#include "loopback_server.h"
+
+using namespace tardsplaya;
+
+namespace {
+
+    const int HANDSHAKE_MS = 30;          // TCP plus TLS 1.2: three round trips of 10 ms
+    const int RTT_MS = 10;
+    const size_t PLAYLIST_BYTES = 1200;
+    const size_t SEGMENT_BYTES = 256 * 1024;
+    const int STREAMS = 4;
+    const int ROUNDS = 20;
+
+    bool Check(bool condition, const std::string& what) {
+        std::cout << (condition ? "  PASS  " : "  FAIL  ") << what << std::endl;
+        return condition;
+    }
+
+    uint8_t BodyByte(size_t index) {
+        return static_cast<uint8_t>('A' + index % 26);
+    }
+
+    bool BodyOk(const std::vector<uint8_t>& body, size_t size) {
+        if (body.size() != size) {
+            return false;
+        }
+        for (size_t i = 0; i < size; i += 997) {
+            if (body[i] != BodyByte(i)) {
+                return false;
+            }
+        }
+        return body.empty() || body.back() == BodyByte(size - 1);
+    }
+
+    // Routes of the loopback origin
+    //   /playlist, /segment        fixed bodies; ?chunked and ?close change the framing
+    //   /status/<code>             empty response with that status
+    //   /slow                      answers after 2 s
+    void Respond(const LoopbackRequest& request, LoopbackResponse& response) {
+        const std::string& path = request.path;
+        if (path.compare(0, 8, "/status/") == 0) {
+            response.status = std::atoi(path.c_str() + 8);
+            return;
+        }
+        if (path == "/slow") {
+            response.delay = std::chrono::milliseconds(2000);
+        }
+        response.body.resize(path.compare(0, 8, "/segment") == 0 ? SEGMENT_BYTES : PLAYLIST_BYTES);
+        for (size_t i = 0; i < response.body.size(); ++i) {
+            response.body[i] = static_cast<char>(BodyByte(i));
+        }
+        response.headers.emplace_back("Content-Type", "application/octet-stream");
+        response.chunked = path.find("chunked") != std::string::npos;
+        response.close = path.find("close") != std::string::npos;
+    }
+
+    struct LoadResult {
+        double seconds = 0.0;
+        HttpClient::Stats stats;
+        int accepted = 0;
+        bool bodies_ok = true;
+    };
+
+    LoadResult RunLoad(LoopbackServer& server, const HttpClient::Config& config) {
+        server.ResetCounters();
+        HttpClient client(CreatePlatformHttpBackend(), config);
+        std::atomic<bool> bodies_ok{true};
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> streams;
+        for (int stream = 0; stream < STREAMS; ++stream) {
+            streams.emplace_back([&, stream] {
+                std::vector<uint8_t> body;
+                for (int round = 0; round < ROUNDS; ++round) {
+                    std::string prefix = "/stream" + std::to_string(stream);
+                    if (!client.Get(server.Url("/playlist" + prefix), body) || !BodyOk(body, PLAYLIST_BYTES)) {
+                        bodies_ok = false;
+                    }
+                    if (!client.Get(server.Url("/segment" + prefix + "/" + std::to_string(round)), body) || !BodyOk(body, SEGMENT_BYTES)) {
+                        bodies_ok = false;
+                    }
+                }
+            });
+        }
+        for (std::thread& thread : streams) {
+            thread.join();
+        }
+        LoadResult result;
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        result.stats = client.GetStats();
+        result.accepted = server.accepted.load();
+        result.bodies_ok = bodies_ok.load();
+        return result;
+    }
+
+    void PrintRow(const std::string& name, const LoadResult& result) {
+        std::cout << std::left << std::setw(26) << ("  " + name) << std::right << std::fixed
+                  << std::setw(8) << result.stats.connections_opened
+                  << std::setw(10) << std::setprecision(1) << result.stats.ReuseRatio() * 100.0 << "%"
+                  << std::setw(14) << std::setprecision(0) << result.stats.HandshakeMsSaved()
+                  << std::setw(10) << std::setprecision(2) << result.seconds << std::endl;
+    }
+
+} // namespace
+
+int main() {
+    std::cout << "=== HTTP keep-alive connection pool ===" << std::endl;
+    bool ok = true;
+
+    HttpUrl url;
+    ok = Check(HttpUrl::Parse("https://Video-Edge.example.net/v1/segment/abc.ts?token=1#frag", url) && url.secure &&
+               url.host == "video-edge.example.net" && url.port == 443 && url.path == "/v1/segment/abc.ts?token=1",
+               "URL parsed into host, default port and path with query") && ok;
+    ok = Check(HttpUrl::Parse("http://[::1]:8080", url) && url.host == "::1" && url.port == 8080 && url.path == "/" &&
+               url.HostKey() == "http://::1:8080", "IPv6 literal with port, empty path") && ok;
+    ok = Check(!HttpUrl::Parse("ftp://host/file", url) && !HttpUrl::Parse("http://host:99999/", url), "unsupported scheme and bad port rejected") && ok;
+
+    LoopbackServer server(Respond);
+    server.handshake_ms = HANDSHAKE_MS;
+    server.rtt_ms = RTT_MS;
+    if (!Check(server.Start(), "loopback server listening")) {
+        return 1;
+    }
+
+    std::cout << std::endl << STREAMS << " streams x " << ROUNDS << " rounds of playlist (" << PLAYLIST_BYTES << " B) + segment ("
+              << SEGMENT_BYTES / 1024 << " KB), " << HANDSHAKE_MS << " ms handshake, " << RTT_MS << " ms round trip" << std::endl << std::endl;
+    std::cout << std::left << std::setw(26) << "  path" << std::right << std::setw(8) << "conns" << std::setw(11) << "reused"
+              << std::setw(14) << "saved ms" << std::setw(10) << "wall s" << std::endl;
+
+    HttpClient::Config unpooled_config;
+    unpooled_config.keep_alive = false;
+    LoadResult unpooled = RunLoad(server, unpooled_config);
+    PrintRow("connection per request", unpooled);
+    LoadResult pooled = RunLoad(server, HttpClient::Config());
+    PrintRow("keep-alive pool", pooled);
+    std::cout << std::endl << "  Pool: " << pooled.stats.requests << " requests, " << pooled.accepted << " connections accepted by the server, "
+              << pooled.stats.connect_us / 1000.0 << " ms in connect, " << pooled.stats.open_connections_high_water << " open at most" << std::endl << std::endl;
+
+    const int total_requests = STREAMS * ROUNDS * 2;
+    ok = Check(unpooled.bodies_ok && pooled.bodies_ok && pooled.stats.failures == 0, "every body complete on both paths") && ok;
+    ok = Check(unpooled.accepted == total_requests && unpooled.stats.ReuseRatio() == 0.0, "old path opens a connection per request") && ok;
+    ok = Check(pooled.accepted <= STREAMS && pooled.stats.ReuseRatio() >= 0.95, "pool keeps one connection per stream and reuses it") && ok;
+    ok = Check(pooled.stats.HandshakeMsSaved() >= 0.8 * HANDSHAKE_MS * pooled.stats.connections_reused,
+               "handshake time saved matches the handshakes skipped") && ok;
+    ok = Check(pooled.seconds < unpooled.seconds * 0.5, "pooled load finishes in well under half the time") && ok;
+
+    // Per-host limit: more streams than connections share them
+    {
+        server.ResetCounters();
+        HttpClient::Config config;
+        config.max_connections_per_host = 2;
+        HttpClient client(CreatePlatformHttpBackend(), config);
+        std::atomic<int> failed{0};
+        std::vector<std::thread> threads;
+        for (int i = 0; i < 8; ++i) {
+            threads.emplace_back([&] {
+                std::vector<uint8_t> body;
+                for (int j = 0; j < 5; ++j) {
+                    if (!client.Get(server.Url("/playlist"), body)) {
+                        failed++;
+                    }
+                }
+            });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        HttpClient::Stats stats = client.GetStats();
+        ok = Check(failed == 0 && server.max_active <= 2 && stats.open_connections_high_water <= 2 && stats.pool_waits > 0,
+                   "8 threads stay within 2 connections to the host") && ok;
+    }
+
+    // Idle eviction
+    {
+        server.ResetCounters();
+        HttpClient::Config config;
+        config.idle_timeout = std::chrono::milliseconds(50);
+        HttpClient client(CreatePlatformHttpBackend(), config);
+        std::vector<uint8_t> body;
+        client.Get(server.Url("/playlist"), body);
+        std::this_thread::sleep_for(std::chrono::milliseconds(120));
+        client.EvictIdle();
+        HttpClient::Stats stats = client.GetStats();
+        ok = Check(stats.idle_evictions == 1 && stats.open_connections == 0, "connection idle past the timeout is closed") && ok;
+        client.Get(server.Url("/playlist"), body);
+        ok = Check(client.GetStats().connections_opened == 2 && server.accepted == 2, "next request opens a new one") && ok;
+    }
+
+    // Server drops kept-alive connections after 3 requests without saying so
+    {
+        server.ResetCounters();
+        server.max_requests_per_connection = 3;
+        HttpClient client(CreatePlatformHttpBackend());
+        std::vector<uint8_t> body;
+        bool all_ok = true;
+        for (int i = 0; i < 10; ++i) {
+            all_ok = client.Get(server.Url("/playlist"), body) && BodyOk(body, PLAYLIST_BYTES) && all_ok;
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        HttpClient::Stats stats = client.GetStats();
+        std::cout << "  Dropped connections: " << stats.stale_retries << " stale retries, " << stats.connections_opened << " opened" << std::endl;
+        ok = Check(all_ok && stats.stale_retries >= 2 && stats.retries == 0 && stats.failures == 0,
+                   "dropped connections are replaced without using a retry") && ok;
+        server.max_requests_per_connection = 0;
+    }
+
+    // Framing and status codes
+    {
+        HttpClient::Config config;
+        config.retry_delay = std::chrono::milliseconds(1);
+        HttpClient client(CreatePlatformHttpBackend(), config);
+        std::vector<uint8_t> body;
+        HttpResponse response;
+        ok = Check(client.Get(server.Url("/segment?chunked"), body, nullptr, &response) && BodyOk(body, SEGMENT_BYTES) &&
+                   client.GetStats().open_connections == 1, "chunked body decoded, connection kept") && ok;
+        ok = Check(client.Get(server.Url("/segment?close"), body, nullptr, &response) && BodyOk(body, SEGMENT_BYTES) &&
+                   client.GetStats().open_connections == 0, "close-delimited body read on the same connection, which is then dropped") && ok;
+        ok = Check(!client.Get(server.Url("/status/404"), body, nullptr, &response) && response.status == 404 && client.GetStats().retries == 0,
+                   "404 fails without retrying") && ok;
+        ok = Check(!client.Get(server.Url("/status/503"), body, nullptr, &response) && response.status == 503 && client.GetStats().retries == 2,
+                   "503 retried up to the attempt limit") && ok;
+        ok = Check(client.Get(server.Url("/status/204"), body, nullptr, &response) && body.empty() && client.GetStats().failures == 2,
+                   "204 succeeds with an empty body") && ok;
+    }
+
+    // Cancellation while the server is slow
+    {
+        HttpClient client(CreatePlatformHttpBackend());
+        std::atomic<bool> cancel{false};
+        std::thread canceller([&] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            cancel = true;
+        });
+        std::vector<uint8_t> body;
+        auto start = std::chrono::steady_clock::now();
+        bool got = client.Get(server.Url("/slow"), body, &cancel);
+        double waited_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        canceller.join();
+        ok = Check(!got && waited_ms < 500 && client.GetStats().open_connections == 0, "cancelled request returns promptly and drops its connection") && ok;
+    }
+
+    server.Stop();
+    std::cout << std::endl << (ok ? "All checks passed" : "SOME CHECKS FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,486 @@
+#include "inflater.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+namespace tardsplaya {
+
+const char* const ACCEPT_COMPRESSED = "gzip, deflate";
+
+namespace {
+
+    const size_t WINDOW_SIZE = 32768;
+    const int MAX_CODE_BITS = 15;
+    const size_t MAX_LITERAL_CODES = 286;
+    const size_t MAX_DISTANCE_CODES = 30;
+
+    const uint16_t LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                       35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    const uint8_t LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                       3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    const uint16_t DISTANCE_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                         257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    const uint8_t DISTANCE_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                         7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+    // Order in which the code length code's lengths are sent
+    const uint8_t CODE_LENGTH_ORDER[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+    const uint8_t GZIP_FHCRC = 0x02;
+    const uint8_t GZIP_FEXTRA = 0x04;
+    const uint8_t GZIP_FNAME = 0x08;
+    const uint8_t GZIP_FCOMMENT = 0x10;
+
+    // CRC-32 of gzip: reflected, polynomial 0xEDB88320
+    struct CRC32Table {
+        uint32_t table[256];
+    };
+
+    constexpr CRC32Table MakeCRC32Table() {
+        CRC32Table result{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+            }
+            result.table[i] = crc;
+        }
+        return result;
+    }
+
+    constexpr CRC32Table CRC32 = MakeCRC32Table();
+
+    std::string Trimmed(const std::string& value) {
+        size_t first = value.find_first_not_of(" \t");
+        size_t last = value.find_last_not_of(" \t");
+        std::string result = first == std::string::npos ? std::string() : value.substr(first, last - first + 1);
+        std::transform(result.begin(), result.end(), result.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return result;
+    }
+
+} // namespace
+
+bool Inflater::Huffman::Build(const uint8_t* lengths, size_t symbols) {
+    std::fill(std::begin(count), std::end(count), 0);
+    for (size_t i = 0; i < symbols; ++i) {
+        count[lengths[i]]++;
+    }
+    int left = 1;
+    for (int length = 1; length <= MAX_CODE_BITS; ++length) {
+        left = (left << 1) - count[length];
+        if (left < 0) {
+            return false;       // Over-subscribed
+        }
+    }
+    uint16_t offsets[16] = {};
+    for (int length = 1; length < MAX_CODE_BITS; ++length) {
+        offsets[length + 1] = offsets[length] + count[length];
+    }
+    for (size_t i = 0; i < symbols; ++i) {
+        if (lengths[i] != 0) {
+            symbol[offsets[lengths[i]]++] = static_cast<uint16_t>(i);
+        }
+    }
+    count[0] = 0;
+    return true;
+}
+
+Inflater::Inflater(Format format, uint64_t max_output)
+    : format_(format), max_output_(max_output), state_(format == Format::GZIP ? State::GZIP_HEADER : State::ZLIB_HEADER), window_(WINDOW_SIZE) {}
+
+bool Inflater::FormatOf(const std::string& content_encoding, Format& format) {
+    std::string encoding = Trimmed(content_encoding);
+    if (encoding == "gzip" || encoding == "x-gzip") {
+        format = Format::GZIP;
+        return true;
+    }
+    if (encoding == "deflate") {
+        format = Format::DEFLATE;
+        return true;
+    }
+    return false;
+}
+
+Inflater::Status Inflater::Write(const uint8_t* data, size_t size, std::vector<uint8_t>& out) {
+    bytes_in_ += size;
+    if (status_ != Status::MORE) {
+        return status_;
+    }
+    in_ = data;
+    in_end_ = data + size;
+    while (status_ == Status::MORE && Step(out)) {
+    }
+    in_ = in_end_ = nullptr;
+    if (status_ != Status::FAILED) {
+        OverLimit();
+    }
+    return status_;
+}
+
+void Inflater::Fill() {
+    while (bit_count_ <= 56 && in_ != in_end_) {
+        bits_ |= static_cast<uint64_t>(*in_++) << bit_count_;
+        bit_count_ += 8;
+    }
+}
+
+bool Inflater::Need(int count) {
+    if (bit_count_ < count) {
+        Fill();
+    }
+    return bit_count_ >= count;
+}
+
+uint32_t Inflater::Take(int count) {
+    uint32_t value = static_cast<uint32_t>(bits_ & ((uint64_t(1) << count) - 1));
+    bits_ >>= count;
+    bit_count_ -= count;
+    return value;
+}
+
+void Inflater::AlignToByte() {
+    Take(bit_count_ % 8);
+}
+
+int Inflater::Peek(const Huffman& huffman, int offset, int& length) const {
+    int code = 0;
+    int first = 0;
+    int index = 0;
+    for (length = 1; length <= MAX_CODE_BITS; ++length) {
+        if (offset + length > bit_count_) {
+            return -1;
+        }
+        code |= static_cast<int>((bits_ >> (offset + length - 1)) & 1);
+        int count = huffman.count[length];
+        if (code - count < first) {
+            return huffman.symbol[index + (code - first)];
+        }
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    return -2;
+}
+
+void Inflater::Emit(uint8_t byte, std::vector<uint8_t>& out) {
+    out.push_back(byte);
+    window_[bytes_out_ % WINDOW_SIZE] = byte;
+    bytes_out_++;
+    if (format_ == Format::GZIP) {
+        crc_ = CRC32.table[(crc_ ^ byte) & 0xFF] ^ (crc_ >> 8);
+    } else if (zlib_) {
+        uint32_t a = ((adler_ & 0xFFFF) + byte) % 65521;
+        uint32_t b = ((adler_ >> 16) + a) % 65521;
+        adler_ = (b << 16) | a;
+    }
+}
+
+void Inflater::SetFixedCodes() {
+    uint8_t lengths[288];
+    std::fill(lengths, lengths + 144, 8);
+    std::fill(lengths + 144, lengths + 256, 9);
+    std::fill(lengths + 256, lengths + 280, 7);
+    std::fill(lengths + 280, lengths + 288, 8);
+    literals_.Build(lengths, 288);
+    std::fill(lengths, lengths + 30, 5);
+    distances_.Build(lengths, 30);
+}
+
+Inflater::Status Inflater::Fail() {
+    status_ = Status::FAILED;
+    return status_;
+}
+
+bool Inflater::OverLimit() {
+    if (bytes_out_ <= max_output_) {
+        return false;
+    }
+    status_ = Status::TOO_LARGE;
+    return true;
+}
+
+// One step of the decoder; false when it needs more input or has finished
+bool Inflater::Step(std::vector<uint8_t>& out) {
+    switch (state_) {
+    case State::GZIP_HEADER: {
+        if (!Need(32)) {
+            return false;
+        }
+        uint32_t magic = static_cast<uint32_t>(bits_ & 0xFFFFFF);
+        if (magic != 0x088B1F) {        // 1F 8B, method 8
+            Fail();
+            return false;
+        }
+        Take(24);
+        gzip_flags_ = static_cast<uint8_t>(Take(8));
+        remaining_ = 6;                 // Time, extra flags and OS are not used
+        state_ = State::GZIP_EXTRA;
+        return true;
+    }
+    case State::GZIP_EXTRA_LENGTH:
+        if (!Need(16)) {
+            return false;
+        }
+        remaining_ = Take(16);
+        gzip_flags_ &= ~GZIP_FEXTRA;
+        state_ = State::GZIP_EXTRA;
+        return true;
+    case State::GZIP_EXTRA:
+        while (remaining_ > 0) {
+            if (!Need(8)) {
+                return false;
+            }
+            Take(8);
+            remaining_--;
+        }
+        state_ = (gzip_flags_ & GZIP_FEXTRA) ? State::GZIP_EXTRA_LENGTH : State::GZIP_NAME;
+        return true;
+    case State::GZIP_NAME:
+    case State::GZIP_COMMENT: {
+        uint8_t flag = state_ == State::GZIP_NAME ? GZIP_FNAME : GZIP_FCOMMENT;
+        while (gzip_flags_ & flag) {
+            if (!Need(8)) {
+                return false;
+            }
+            if (Take(8) == 0) {
+                gzip_flags_ &= ~flag;
+            }
+        }
+        state_ = state_ == State::GZIP_NAME ? State::GZIP_COMMENT : State::GZIP_HEADER_CRC;
+        return true;
+    }
+    case State::GZIP_HEADER_CRC:
+        if (gzip_flags_ & GZIP_FHCRC) {
+            if (!Need(16)) {
+                return false;
+            }
+            Take(16);
+        }
+        state_ = State::BLOCK_HEADER;
+        return true;
+    case State::ZLIB_HEADER: {
+        if (!Need(16)) {
+            return false;
+        }
+        uint32_t method = static_cast<uint32_t>(bits_ & 0xFF);
+        uint32_t flags = static_cast<uint32_t>((bits_ >> 8) & 0xFF);
+        // Method 8 with a window of at most 32 KB, a valid check value and no preset dictionary
+        zlib_ = (method & 0x0F) == 8 && (method >> 4) <= 7 && (method * 256 + flags) % 31 == 0 && !(flags & 0x20);
+        if (zlib_) {
+            Take(16);
+        }
+        state_ = State::BLOCK_HEADER;
+        return true;
+    }
+    case State::BLOCK_HEADER: {
+        if (last_block_) {
+            state_ = State::TRAILER;
+            return true;
+        }
+        if (!Need(3)) {
+            return false;
+        }
+        last_block_ = Take(1) != 0;
+        uint32_t type = Take(2);
+        if (type == 0) {
+            AlignToByte();
+            state_ = State::STORED_LENGTH;
+        } else if (type == 1) {
+            SetFixedCodes();
+            state_ = State::CODES;
+        } else if (type == 2) {
+            state_ = State::TABLE_SIZES;
+        } else {
+            Fail();
+            return false;
+        }
+        return true;
+    }
+    case State::STORED_LENGTH: {
+        if (!Need(32)) {
+            return false;
+        }
+        uint32_t length = Take(16);
+        uint32_t check = Take(16);
+        if ((length ^ 0xFFFF) != check) {
+            Fail();
+            return false;
+        }
+        remaining_ = length;
+        state_ = State::STORED;
+        return true;
+    }
+    case State::STORED:
+        // Bytes already taken into the bit buffer first, then straight from the input
+        while (remaining_ > 0 && bit_count_ >= 8) {
+            Emit(static_cast<uint8_t>(Take(8)), out);
+            remaining_--;
+        }
+        while (remaining_ > 0 && in_ != in_end_) {
+            Emit(*in_++, out);
+            remaining_--;
+        }
+        if (remaining_ > 0) {
+            return false;
+        }
+        state_ = State::BLOCK_HEADER;
+        return true;
+    case State::TABLE_SIZES:
+        if (!Need(14)) {
+            return false;
+        }
+        literal_codes_ = Take(5) + 257;
+        distance_codes_ = Take(5) + 1;
+        length_codes_ = Take(4) + 4;
+        if (literal_codes_ > MAX_LITERAL_CODES || distance_codes_ > MAX_DISTANCE_CODES) {
+            Fail();
+            return false;
+        }
+        std::fill(std::begin(lengths_), std::end(lengths_), 0);
+        index_ = 0;
+        state_ = State::CODE_LENGTH_LENGTHS;
+        return true;
+    case State::CODE_LENGTH_LENGTHS:
+        while (index_ < length_codes_) {
+            if (!Need(3)) {
+                return false;
+            }
+            lengths_[CODE_LENGTH_ORDER[index_++]] = static_cast<uint8_t>(Take(3));
+        }
+        if (!code_lengths_.Build(lengths_, 19)) {
+            Fail();
+            return false;
+        }
+        std::fill(std::begin(lengths_), std::end(lengths_), 0);
+        index_ = 0;
+        state_ = State::LENGTHS;
+        return true;
+    case State::LENGTHS: {
+        const size_t total = literal_codes_ + distance_codes_;
+        while (index_ < total) {
+            // A symbol and its repeat count are taken together, so a stop between them loses nothing
+            Fill();
+            int length = 0;
+            int symbol = Peek(code_lengths_, 0, length);
+            if (symbol == -2) {
+                Fail();
+                return false;
+            }
+            if (symbol < 0) {
+                return false;
+            }
+            if (symbol < 16) {
+                Take(length);
+                lengths_[index_++] = static_cast<uint8_t>(symbol);
+                continue;
+            }
+            int extra = symbol == 16 ? 2 : symbol == 17 ? 3 : 7;
+            if (length + extra > bit_count_) {
+                return false;
+            }
+            Take(length);
+            size_t repeat = Take(extra) + (symbol == 16 ? 3 : symbol == 17 ? 3 : 11);
+            if ((symbol == 16 && index_ == 0) || index_ + repeat > total) {
+                Fail();
+                return false;
+            }
+            uint8_t value = symbol == 16 ? lengths_[index_ - 1] : 0;
+            std::fill(lengths_ + index_, lengths_ + index_ + repeat, value);
+            index_ += repeat;
+        }
+        if (lengths_[256] == 0 || !literals_.Build(lengths_, literal_codes_) ||
+            !distances_.Build(lengths_ + literal_codes_, distance_codes_)) {
+            Fail();
+            return false;
+        }
+        state_ = State::CODES;
+        return true;
+    }
+    case State::CODES:
+        while (true) {
+            // A back reference of a couple of bits expands to up to 258 bytes, so the cap is looked at every symbol
+            if (OverLimit()) {
+                return false;
+            }
+            // A whole literal or length/distance pair at a time: at most 48 bits
+            Fill();
+            int length = 0;
+            int symbol = Peek(literals_, 0, length);
+            if (symbol == -2) {
+                Fail();
+                return false;
+            }
+            if (symbol < 0) {
+                return false;
+            }
+            if (symbol < 256) {
+                Take(length);
+                Emit(static_cast<uint8_t>(symbol), out);
+                continue;
+            }
+            if (symbol == 256) {
+                Take(length);
+                state_ = State::BLOCK_HEADER;
+                return true;
+            }
+            size_t code = static_cast<size_t>(symbol - 257);
+            if (code >= 29) {
+                Fail();
+                return false;
+            }
+            int length_extra = LENGTH_EXTRA[code];
+            int distance_length = 0;
+            int distance_symbol = Peek(distances_, length + length_extra, distance_length);
+            if (distance_symbol == -2 || distance_symbol >= 30) {
+                Fail();
+                return false;
+            }
+            if (distance_symbol < 0) {
+                return false;
+            }
+            int distance_extra = DISTANCE_EXTRA[distance_symbol];
+            if (length + length_extra + distance_length + distance_extra > bit_count_) {
+                return false;
+            }
+            Take(length);
+            size_t copy = LENGTH_BASE[code] + Take(length_extra);
+            Take(distance_length);
+            size_t distance = DISTANCE_BASE[distance_symbol] + Take(distance_extra);
+            if (distance > bytes_out_ || distance > WINDOW_SIZE) {
+                Fail();
+                return false;
+            }
+            for (size_t i = 0; i < copy; ++i) {
+                Emit(window_[(bytes_out_ - distance) % WINDOW_SIZE], out);
+            }
+        }
+    case State::TRAILER: {
+        AlignToByte();
+        if (format_ == Format::GZIP) {
+            if (!Need(64)) {
+                return false;
+            }
+            uint32_t crc = Take(32);
+            uint32_t size = Take(32);
+            if (crc != (crc_ ^ 0xFFFFFFFF) || size != static_cast<uint32_t>(bytes_out_)) {
+                Fail();
+                return false;
+            }
+        } else if (zlib_) {
+            if (!Need(32)) {
+                return false;
+            }
+            uint32_t stored = Take(32);
+            uint32_t adler = ((stored & 0xFF) << 24) | ((stored & 0xFF00) << 8) | ((stored >> 8) & 0xFF00) | (stored >> 24);
+            if (adler != adler_) {
+                Fail();
+                return false;
+            }
+        }
+        status_ = Status::DONE;
+        return false;
+    }
+    }
+    return false;
+}
+
+} // namespace tardsplaya
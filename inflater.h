@@ -0,0 +1,107 @@
+#pragma once
+// Streaming gzip/deflate decoder for compressed HTTP bodies
+// Playlists and API answers are text and shrink to a fraction with Content-Encoding: gzip. The body
+// arrives in pieces of any size, so decoding stops wherever a piece ends and resumes with the next
+// one; output is appended to the caller's buffer as it is produced. Decodes RFC 1951 deflate in
+// gzip (RFC 1952) or zlib (RFC 1950) framing, or raw, as servers differ on what "deflate" means.
+// Checksums and the gzip length are verified. Output can be capped, as a few kilobytes of deflate
+// can expand to gigabytes.
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace tardsplaya {
+
+    // Value for the Accept-Encoding request header
+    extern const char* const ACCEPT_COMPRESSED;
+
+    class Inflater {
+    public:
+        enum class Format {
+            GZIP,
+            DEFLATE         // zlib framing, or raw deflate when the first bytes are no zlib header
+        };
+
+        enum class Status {
+            MORE,           // Wants the rest of the stream
+            DONE,           // End of stream; anything after it is ignored
+            FAILED,         // Corrupt stream or checksum mismatch
+            TOO_LARGE       // Output past max_output; decoding stopped there
+        };
+
+        // Far beyond any playlist or API answer
+        static const uint64_t DEFAULT_MAX_OUTPUT = 64 * 1024 * 1024;
+
+        explicit Inflater(Format format, uint64_t max_output = DEFAULT_MAX_OUTPUT);
+
+        // Format for a Content-Encoding value; false for identity and encodings not decoded here
+        static bool FormatOf(const std::string& content_encoding, Format& format);
+
+        // Decode the next size bytes of the stream, appending the output to out
+        Status Write(const uint8_t* data, size_t size, std::vector<uint8_t>& out);
+
+        Status GetStatus() const { return status_; }
+        uint64_t GetBytesIn() const { return bytes_in_; }
+        uint64_t GetBytesOut() const { return bytes_out_; }
+
+    private:
+        enum class State {
+            GZIP_HEADER, GZIP_EXTRA_LENGTH, GZIP_EXTRA, GZIP_NAME, GZIP_COMMENT, GZIP_HEADER_CRC,
+            ZLIB_HEADER, BLOCK_HEADER, STORED_LENGTH, STORED, TABLE_SIZES, CODE_LENGTH_LENGTHS, LENGTHS,
+            CODES, TRAILER
+        };
+
+        // Canonical Huffman code: codes per length and symbols in code order
+        struct Huffman {
+            uint16_t count[16] = {};
+            uint16_t symbol[320] = {};
+
+            bool Build(const uint8_t* lengths, size_t symbols);
+        };
+
+        Format format_;
+        uint64_t max_output_;
+        State state_;
+        Status status_ = Status::MORE;
+        bool zlib_ = false;
+        bool last_block_ = false;
+
+        // Input of the current Write and bits taken from it but not used yet
+        const uint8_t* in_ = nullptr;
+        const uint8_t* in_end_ = nullptr;
+        uint64_t bits_ = 0;
+        int bit_count_ = 0;
+
+        uint8_t gzip_flags_ = 0;
+        size_t remaining_ = 0;              // Of a stored block or the gzip extra field
+        size_t literal_codes_ = 0;
+        size_t distance_codes_ = 0;
+        size_t length_codes_ = 0;
+        size_t index_ = 0;
+        uint8_t lengths_[320] = {};
+        Huffman code_lengths_;
+        Huffman literals_;
+        Huffman distances_;
+
+        std::vector<uint8_t> window_;       // The last 32 KB of output, for back references
+        uint64_t bytes_in_ = 0;
+        uint64_t bytes_out_ = 0;
+        uint32_t crc_ = 0xFFFFFFFF;
+        uint32_t adler_ = 1;
+
+        bool Need(int count);
+        uint32_t Take(int count);
+        void Fill();
+        void AlignToByte();
+        // Symbol of the code starting offset bits in; -1 when more bits are needed, -2 for an unused code
+        int Peek(const Huffman& huffman, int offset, int& length) const;
+        void Emit(uint8_t byte, std::vector<uint8_t>& out);
+        void SetFixedCodes();
+        bool Step(std::vector<uint8_t>& out);
+        Status Fail();
+        bool OverLimit();
+    };
+
+} // namespace tardsplaya
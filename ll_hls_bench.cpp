@@ -0,0 +1,316 @@
+// Live latency: polling whole segments vs. LL-HLS blocking reload with partial segments
+// The fetch loops used to reload the media playlist on a fixed sleep and play the newest whole
+// segments, so what reached the player was already several seconds old. Against a loopback LL-HLS
+// origin that publishes a 250 ms part at a time, one client polls every 500 ms and plays the last
+// two whole segments as the router did, the other plays parts through LowLatencyCursor, reloads
+// with _HLS_msn/_HLS_part and requests each preload hint ahead. Latency is how far behind capture
+// time a player starting with the first packet ends up, stalls included. The parser and cursor are
+// also checked on fixed playlists: tags, start position, continuity, gaps and jumps.
+//
+// Build: g++ -std=c++17 -O2 -pthread ll_hls_bench.cpp low_latency_hls.cpp tsduck_hls_wrapper.cpp ll_hls_origin.cpp segment_prefetcher.cpp segment_pool.cpp http_client.cpp http_client_posix.cpp inflater.cpp loopback_server.cpp -o ll_hls_bench
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <set>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "low_latency_hls.h"
+#include "tsduck_hls_wrapper.h"
+#include "ll_hls_origin.h"
+#include "segment_prefetcher.h"
+#include "http_client.h"
+
+using namespace tsduck_hls;
+using tsduck_transport::SegmentPool;
+using tsduck_transport::SegmentPrefetcher;
+using tsduck_transport::PrefetcherConfig;
+using tardsplaya::HttpClient;
+using tardsplaya::LowLatencyOrigin;
+
+namespace {
+
+    const auto RUN_TIME = std::chrono::seconds(8);
+    const size_t PACKET_SIZE = 188;
+
+    bool Check(bool condition, const std::string& what) {
+        std::cout << (condition ? "  PASS  " : "  FAIL  ") << what << std::endl;
+        return condition;
+    }
+
+    std::wstring JoinUrl(const std::wstring& base, const std::wstring& rel) {
+        if (rel.find(L"http") == 0) return rel;
+        size_t pos = base.rfind(L'/');
+        if (pos == std::wstring::npos) return rel;
+        return base.substr(0, pos + 1) + rel;
+    }
+
+    bool GetText(const std::wstring& url, std::string& text) {
+        std::vector<uint8_t> body;
+        if (!HttpClient::Shared().Get(url, body)) {
+            return false;
+        }
+        text.assign(body.begin(), body.end());
+        return true;
+    }
+
+    // Stands in for the player: a stream that starts playing with its first packet falls behind
+    // capture time by the largest delay any packet had, since it stalls until late ones arrive
+    struct Player {
+        const LowLatencyOrigin& origin;
+        int64_t last_key = -1;          // PartKey of the last packet's part
+        size_t next_index = 0;
+        bool in_order = true;
+        uint64_t packets = 0;
+        double latency_ms = 0.0;        // Behind capture time, stalls included
+
+        explicit Player(const LowLatencyOrigin& source) : origin(source) {}
+
+        void Forward(const uint8_t* data, size_t size) {
+            auto now = std::chrono::steady_clock::now();
+            for (size_t offset = 0; offset + PACKET_SIZE <= size; offset += PACKET_SIZE) {
+                int64_t sequence;
+                int part;
+                size_t index;
+                if (!LowLatencyOrigin::DecodePacket(data + offset, sequence, part, index)) {
+                    in_order = false;
+                    continue;
+                }
+                // Whole segments and parts of a segment both step through parts in order
+                int64_t key = PartKey(sequence, part);
+                bool next_packet = key == last_key && index == next_index;
+                bool next_part = index == 0 && last_key >= 0 && next_index == origin.GetConfig().packets_per_part &&
+                                 (key == last_key + 1 || (part == 0 && sequence == last_key / MAX_PARTS_PER_SEGMENT + 1));
+                if (last_key >= 0 && !next_packet && !next_part) {
+                    in_order = false;
+                }
+                last_key = key;
+                next_index = index + 1;
+
+                double delay = std::chrono::duration<double, std::milli>(now - origin.MediaTime(sequence, part, index)).count();
+                latency_ms = std::max(latency_ms, delay);
+                packets++;
+            }
+        }
+    };
+
+    struct ClientResult {
+        double latency_ms = 0.0;
+        bool in_order = false;
+        uint64_t packets = 0;
+        uint64_t playlists = 0;
+        uint64_t fetches = 0;
+    };
+
+    // The router before LL-HLS: reload on a 500 ms sleep, skip to the newest two segments, fetch whole segments
+    ClientResult RunPolling(LowLatencyOrigin& origin) {
+        ClientResult result;
+        Player player(origin);
+        std::set<int64_t> handled;
+        bool started = false;
+        auto deadline = std::chrono::steady_clock::now() + RUN_TIME;
+        while (std::chrono::steady_clock::now() < deadline) {
+            std::string text;
+            PlaylistParser playlist;
+            if (GetText(origin.PlaylistUrl(), text) && playlist.ParsePlaylist(text)) {
+                result.playlists++;
+                auto segments = playlist.GetSegments();
+                for (size_t i = 0; i < segments.size(); ++i) {
+                    int64_t sequence = static_cast<int64_t>(segments[i].sequence_number);
+                    if (handled.count(sequence)) {
+                        continue;
+                    }
+                    handled.insert(sequence);
+                    if (!started && i + 2 < segments.size()) {
+                        continue;
+                    }
+                    std::vector<uint8_t> body;
+                    if (HttpClient::Shared().Get(JoinUrl(origin.PlaylistUrl(), segments[i].url), body)) {
+                        player.Forward(body.data(), body.size());
+                        result.fetches++;
+                    }
+                }
+                started = true;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        }
+        result.latency_ms = player.latency_ms;
+        result.in_order = player.in_order;
+        result.packets = player.packets;
+        return result;
+    }
+
+    // The LL-HLS fetch loop: blocking reloads, parts in order, the preload hint requested ahead
+    ClientResult RunLowLatency(LowLatencyOrigin& origin, LowLatencyCursor& cursor) {
+        ClientResult result;
+        Player player(origin);
+        SegmentPool pool;
+        PrefetcherConfig config;
+        config.max_concurrency = 4;
+        SegmentPrefetcher prefetcher(
+            [](const std::wstring& url, const SegmentPrefetcher::ChunkSink& sink, std::atomic<bool>* token) {
+                return HttpClient::Shared().Get(url, sink, token);
+            },
+            pool, config);
+        std::wstring reload_url = origin.PlaylistUrl();
+        auto deadline = std::chrono::steady_clock::now() + RUN_TIME;
+        while (std::chrono::steady_clock::now() < deadline) {
+            std::string text;
+            PlaylistParser playlist;
+            if (!GetText(reload_url, text) || !playlist.ParsePlaylist(text)) {
+                reload_url = origin.PlaylistUrl();
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                continue;
+            }
+            result.playlists++;
+            std::vector<PartFetch> parts = cursor.NextParts(playlist);
+            for (const PartFetch& part : parts) {
+                prefetcher.Enqueue(part.key, JoinUrl(origin.PlaylistUrl(), part.url));
+            }
+            PartFetch preload;
+            if (cursor.PreloadPart(playlist, preload)) {
+                prefetcher.Enqueue(preload.key, JoinUrl(origin.PlaylistUrl(), preload.url));
+            }
+            for (const PartFetch& part : parts) {
+                SegmentPrefetcher::Segment fetched;
+                if (prefetcher.Take(part.key, fetched) == SegmentPrefetcher::Result::READY) {
+                    player.Forward(fetched.data->data(), fetched.data->size());
+                    result.fetches++;
+                }
+            }
+            reload_url = BlockingReloadUrl(playlist, origin.PlaylistUrl());
+            if (reload_url == origin.PlaylistUrl()) {
+                std::this_thread::sleep_for(playlist.GetPartTarget());
+            }
+        }
+        result.latency_ms = player.latency_ms;
+        result.in_order = player.in_order;
+        result.packets = player.packets;
+        return result;
+    }
+
+    const char* SAMPLE_PLAYLIST =
+        "#EXTM3U\n"
+        "#EXT-X-TARGETDURATION:2\n"
+        "#EXT-X-SERVER-CONTROL:CAN-BLOCK-RELOAD=YES,PART-HOLD-BACK=1.5,CAN-SKIP-UNTIL=12.0\n"
+        "#EXT-X-PART-INF:PART-TARGET=0.5\n"
+        "#EXT-X-MEDIA-SEQUENCE:100\n"
+        "#EXTINF:2.000,\n"
+        "seg100.ts\n"
+        "#EXT-X-PART:DURATION=0.5,URI=\"p101.0.ts\",INDEPENDENT=YES\n"
+        "#EXT-X-PART:DURATION=0.5,URI=\"p101.1.ts\"\n"
+        "#EXT-X-PART:DURATION=0.5,URI=\"p101.2.ts\",INDEPENDENT=YES\n"
+        "#EXT-X-PART:DURATION=0.5,URI=\"p101.3.ts\"\n"
+        "#EXTINF:2.000,\n"
+        "seg101.ts\n"
+        "#EXT-X-DISCONTINUITY\n"
+        "#EXT-X-PART:DURATION=0.5,URI=\"p102.0.ts\",INDEPENDENT=YES\n"
+        "#EXT-X-PART:DURATION=0.5,URI=\"p102.1.ts\",GAP=YES\n"
+        "#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"p102.2.ts\"\n";
+
+    // Same stream one part later, and much later with the parts in between gone
+    std::string Advanced(bool far) {
+        std::string text = SAMPLE_PLAYLIST;
+        text = text.substr(0, text.find("#EXT-X-PRELOAD-HINT"));
+        if (far) {
+            return "#EXTM3U\n#EXT-X-SERVER-CONTROL:CAN-BLOCK-RELOAD=YES,PART-HOLD-BACK=1.0\n#EXT-X-PART-INF:PART-TARGET=0.5\n"
+                   "#EXT-X-MEDIA-SEQUENCE:110\n#EXTINF:2.000,\nseg110.ts\n"
+                   "#EXT-X-PART:DURATION=0.5,URI=\"p111.0.ts\",INDEPENDENT=YES\n#EXT-X-PART:DURATION=0.5,URI=\"p111.1.ts\"\n";
+        }
+        return text + "#EXT-X-PART:DURATION=0.5,URI=\"p102.2.ts\"\n#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"p102.3.ts\"\n";
+    }
+
+    bool CheckParser() {
+        std::cout << "Parser and cursor on fixed playlists" << std::endl;
+        bool ok = true;
+        PlaylistParser playlist;
+        ok &= Check(playlist.ParsePlaylist(SAMPLE_PLAYLIST), "sample playlist parses");
+        ok &= Check(playlist.IsLowLatency() && playlist.GetPartTarget() == std::chrono::milliseconds(500), "part target read");
+        const ServerControl& control = playlist.GetServerControl();
+        ok &= Check(control.can_block_reload && control.part_hold_back == std::chrono::milliseconds(1500), "server control read");
+        const std::vector<PartialSegment>& parts = playlist.GetParts();
+        ok &= Check(parts.size() == 6 && parts[0].media_sequence == 101 && parts[3].part_index == 3 &&
+                    parts[4].media_sequence == 102 && parts[4].part_index == 0, "parts numbered by parent segment");
+        ok &= Check(parts[4].discontinuity && !parts[0].discontinuity && parts[5].gap && parts[2].independent, "part attributes read");
+        const PreloadHint& hint = playlist.GetPreloadHint();
+        ok &= Check(hint.media_sequence == 102 && hint.part_index == 2 && hint.url == L"p102.2.ts", "preload hint follows the last part");
+        ok &= Check(BlockingReloadUrl(playlist, L"http://h/live.m3u8?token=x") == L"http://h/live.m3u8?token=x&_HLS_msn=102&_HLS_part=2",
+                    "blocking reload asks for the hinted part");
+        ok &= Check(BlockingReloadUrl(playlist, L"http://h/live.m3u8", true) == L"http://h/live.m3u8?_HLS_msn=102",
+                    "whole-segment reload asks for the next segment");
+
+        // 1.5 s of hold-back from the edge is reached at p101.3; the independent part before it is p101.2
+        LowLatencyCursor cursor;
+        std::vector<PartFetch> first = cursor.NextParts(playlist);
+        ok &= Check(first.size() == 3 && first[0].key == PartKey(101, 2) && first[2].key == PartKey(102, 0),
+                    "starts at an independent part past the hold-back; gap part passed over");
+        ok &= Check(!first[0].discontinuity && !first[1].discontinuity && first[2].discontinuity && cursor.GetStats().gaps == 1, "discontinuity carried to its part");
+        ok &= Check(cursor.GetFirstMediaSequence() == 101, "first covered segment reported");
+        PartFetch preload;
+        ok &= Check(cursor.PreloadPart(playlist, preload) && preload.key == PartKey(102, 2) && !cursor.PreloadPart(playlist, preload),
+                    "preload hint handed out once");
+
+        PlaylistParser next;
+        next.ParsePlaylist(Advanced(false));
+        std::vector<PartFetch> more = cursor.NextParts(next);
+        ok &= Check(more.size() == 1 && more[0].key == PartKey(102, 2) && !more[0].discontinuity, "next reload continues in order");
+        ok &= Check(cursor.NextParts(next).empty(), "same playlist again yields nothing");
+
+        PlaylistParser far;
+        far.ParsePlaylist(Advanced(true));
+        std::vector<PartFetch> jumped = cursor.NextParts(far);
+        ok &= Check(!jumped.empty() && jumped[0].key == PartKey(111, 0) && jumped[0].discontinuity && cursor.GetStats().jumps == 1,
+                    "falling out of the playlist restarts at the live edge as a new period");
+
+        PlaylistParser plain;
+        plain.ParsePlaylist("#EXTM3U\n#EXT-X-MEDIA-SEQUENCE:7\n#EXTINF:2.0,\na.ts\n");
+        ok &= Check(!plain.IsLowLatency() && BlockingReloadUrl(plain, L"http://h/a.m3u8") == L"http://h/a.m3u8",
+                    "plain playlist reloads unchanged");
+        return ok;
+    }
+
+} // namespace
+
+int main() {
+    bool ok = CheckParser();
+
+    LowLatencyOrigin origin;
+    if (!origin.Start()) {
+        std::cout << "Could not start the loopback origin" << std::endl;
+        return 1;
+    }
+    std::cout << std::endl << "Live edge against a loopback LL-HLS origin (250 ms parts, 2 s segments, "
+              << origin.GetConfig().rtt_ms << " ms round trip), " << RUN_TIME.count() << " s per client" << std::endl;
+
+    ClientResult polling = RunPolling(origin);
+    uint64_t parts_before = origin.GetStats().parts;
+    uint64_t waits_before = origin.GetStats().preload_waits;
+    uint64_t blocked_before = origin.GetStats().blocked_reloads;
+    LowLatencyCursor cursor;
+    ClientResult low_latency = RunLowLatency(origin, cursor);
+    origin.Stop();
+
+    std::cout << std::fixed << std::setprecision(0);
+    std::cout << "  polling, whole segments:   latency " << std::setw(5) << polling.latency_ms << " ms, " << polling.playlists << " playlists, "
+              << polling.fetches << " segments" << std::endl;
+    std::cout << "  blocking reload, parts:    latency " << std::setw(5) << low_latency.latency_ms << " ms, " << low_latency.playlists << " playlists, "
+              << low_latency.fetches << " parts" << std::endl;
+    std::cout << "  origin: " << origin.GetStats().blocked_reloads - blocked_before << " reloads held, "
+              << origin.GetStats().preload_waits - waits_before << " of " << origin.GetStats().parts - parts_before
+              << " part requests arrived before the part existed; cursor: " << cursor.GetStats().parts << " parts, "
+              << cursor.GetStats().preloads << " preloads, " << cursor.GetStats().jumps << " jumps" << std::endl;
+
+    ok &= Check(polling.in_order && polling.packets > 0, "polling client plays segments in order");
+    ok &= Check(low_latency.in_order && low_latency.packets > 0, "LL-HLS client plays parts in order");
+    ok &= Check(low_latency.latency_ms < 3000.0, "LL-HLS latency under 3 s");
+    ok &= Check(low_latency.latency_ms + 1500.0 < polling.latency_ms, "LL-HLS at least 1.5 s closer to live than polling");
+    ok &= Check(cursor.GetStats().jumps == 0, "LL-HLS client never fell out of the playlist");
+    ok &= Check(origin.GetStats().blocked_reloads - blocked_before > 0 && low_latency.playlists <= low_latency.fetches + 3,
+                "reloads block instead of polling (about one per part)");
+    ok &= Check(origin.GetStats().preload_waits - waits_before > 0, "preload hints requested before their part was published");
+
+    std::cout << std::endl << (ok ? "All checks passed" : "SOME CHECKS FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
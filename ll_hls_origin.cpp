@@ -0,0 +1,228 @@
+#include "ll_hls_origin.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+namespace tardsplaya {
+
+namespace {
+
+    const size_t PACKET_SIZE = 188;
+
+    std::string Seconds(int milliseconds) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.3f", milliseconds / 1000.0);
+        return text;
+    }
+
+    // Value of a query parameter, or -1 when it is absent
+    int64_t QueryValue(const std::string& query, const std::string& name) {
+        size_t pos = query.find(name + "=");
+        if (pos == std::string::npos || (pos > 0 && query[pos - 1] != '&')) {
+            return -1;
+        }
+        return std::strtoll(query.c_str() + pos + name.size() + 1, nullptr, 10);
+    }
+
+} // namespace
+
+LowLatencyOrigin::LowLatencyOrigin(const Config& config) : config_(config) {
+    server_.reset(new LoopbackServer([this](const LoopbackRequest& request, LoopbackResponse& response) {
+        Respond(request, response);
+    }));
+    server_->rtt_ms = config_.rtt_ms;
+    server_->connection_bytes_per_second = config_.bytes_per_second;
+}
+
+bool LowLatencyOrigin::Start() {
+    // A live stream that has been running for a while: the first playlist lists a full window
+    start_ = std::chrono::steady_clock::now() -
+             std::chrono::milliseconds(static_cast<int64_t>(config_.window_segments) * config_.parts_per_segment * config_.part_ms);
+    return server_->Start();
+}
+
+void LowLatencyOrigin::Stop() {
+    server_->Stop();
+}
+
+std::wstring LowLatencyOrigin::PlaylistUrl() const {
+    std::string url = server_->Url("/live.m3u8");
+    return std::wstring(url.begin(), url.end());
+}
+
+int64_t LowLatencyOrigin::PublishedParts() const {
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_);
+    return elapsed.count() / config_.part_ms;
+}
+
+std::chrono::steady_clock::time_point LowLatencyOrigin::Published(int64_t global_part) const {
+    return start_ + std::chrono::milliseconds((global_part + 1) * config_.part_ms);
+}
+
+std::chrono::steady_clock::time_point LowLatencyOrigin::MediaTime(int64_t media_sequence, int part_index, size_t packet) const {
+    int64_t global_part = media_sequence * config_.parts_per_segment + part_index;
+    auto offset = std::chrono::duration<double, std::milli>(
+        global_part * config_.part_ms + static_cast<double>(packet) * config_.part_ms / config_.packets_per_part);
+    return start_ + std::chrono::duration_cast<std::chrono::steady_clock::duration>(offset);
+}
+
+bool LowLatencyOrigin::DecodePacket(const uint8_t* packet, int64_t& media_sequence, int& part_index, size_t& index) {
+    if (packet[0] != 0x47 || packet[1] != 0x01 || packet[2] != 0x00) {
+        return false;
+    }
+    uint64_t sequence = 0;
+    uint32_t part = 0, position = 0;
+    for (int b = 0; b < 8; ++b) sequence |= static_cast<uint64_t>(packet[4 + b]) << (8 * b);
+    for (int b = 0; b < 4; ++b) part |= static_cast<uint32_t>(packet[12 + b]) << (8 * b);
+    for (int b = 0; b < 4; ++b) position |= static_cast<uint32_t>(packet[16 + b]) << (8 * b);
+    media_sequence = static_cast<int64_t>(sequence);
+    part_index = static_cast<int>(part);
+    index = position;
+    return true;
+}
+
+std::string LowLatencyOrigin::Part(int64_t media_sequence, int part_index) const {
+    std::string body(config_.packets_per_part * PACKET_SIZE, '\xFF');
+    for (size_t i = 0; i < config_.packets_per_part; ++i) {
+        char* packet = &body[i * PACKET_SIZE];
+        packet[0] = 0x47;
+        packet[1] = 0x01;
+        packet[2] = 0x00;
+        packet[3] = static_cast<char>(0x10 | (i & 0x0F));
+        for (int b = 0; b < 8; ++b) packet[4 + b] = static_cast<char>(static_cast<uint64_t>(media_sequence) >> (8 * b));
+        for (int b = 0; b < 4; ++b) packet[12 + b] = static_cast<char>(static_cast<uint32_t>(part_index) >> (8 * b));
+        for (int b = 0; b < 4; ++b) packet[16 + b] = static_cast<char>(static_cast<uint32_t>(i) >> (8 * b));
+    }
+    return body;
+}
+
+std::string LowLatencyOrigin::Playlist(int64_t published) const {
+    const int parts = config_.parts_per_segment;
+    const int64_t complete = published / parts;
+    const int64_t first = std::max<int64_t>(0, complete - config_.window_segments);
+    const int segment_ms = parts * config_.part_ms;
+
+    auto part_line = [&](int64_t sequence, int part) {
+        std::string line = "#EXT-X-PART:DURATION=" + Seconds(config_.part_ms) + ",URI=\"part/" +
+                           std::to_string(sequence) + "." + std::to_string(part) + ".ts\"";
+        if (part % config_.independent_every == 0) {
+            line += ",INDEPENDENT=YES";
+        }
+        return line + "\n";
+    };
+
+    std::string playlist = "#EXTM3U\n";
+    playlist += config_.low_latency ? "#EXT-X-VERSION:9\n" : "#EXT-X-VERSION:3\n";
+    playlist += "#EXT-X-TARGETDURATION:" + std::to_string((segment_ms + 999) / 1000) + "\n";
+    if (config_.low_latency) {
+        playlist += "#EXT-X-SERVER-CONTROL:CAN-BLOCK-RELOAD=YES,PART-HOLD-BACK=" +
+                    Seconds(config_.part_hold_back_parts * config_.part_ms) + "\n";
+        playlist += "#EXT-X-PART-INF:PART-TARGET=" + Seconds(config_.part_ms) + "\n";
+    }
+    playlist += "#EXT-X-MEDIA-SEQUENCE:" + std::to_string(first) + "\n";
+    for (int64_t sequence = first; sequence < complete; ++sequence) {
+        if (config_.low_latency && sequence >= complete - config_.parts_listed_segments) {
+            for (int part = 0; part < parts; ++part) {
+                playlist += part_line(sequence, part);
+            }
+        }
+        playlist += "#EXTINF:" + Seconds(segment_ms) + ",\nseg/" + std::to_string(sequence) + ".ts\n";
+    }
+    if (config_.low_latency) {
+        for (int part = 0; part < published % parts; ++part) {
+            playlist += part_line(complete, part);
+        }
+        playlist += "#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"part/" + std::to_string(complete) + "." +
+                    std::to_string(published % parts) + ".ts\"\n";
+    } else {
+        // Absolute, as Twitch lists them: the segment in production and the ones after it
+        for (int i = 0; i < config_.twitch_prefetch_segments; ++i) {
+            playlist += "#EXT-X-TWITCH-PREFETCH:" + server_->Url("/seg/" + std::to_string(complete + i) + ".ts") + "\n";
+        }
+    }
+    return playlist;
+}
+
+void LowLatencyOrigin::Respond(const LoopbackRequest& request, LoopbackResponse& response) {
+    const int parts = config_.parts_per_segment;
+    size_t question = request.path.find('?');
+    std::string path = request.path.substr(0, question);
+    std::string query = question == std::string::npos ? std::string() : request.path.substr(question + 1);
+
+    // Hold the response until the given part is published; false if that is too far off to wait for
+    auto wait_for_part = [&](int64_t global_part, int64_t limit) {
+        int64_t published = PublishedParts();
+        if (global_part >= published + limit) {
+            return false;
+        }
+        while (global_part >= PublishedParts()) {
+            server_->Sleep(std::chrono::duration_cast<std::chrono::milliseconds>(Published(global_part) - std::chrono::steady_clock::now()) +
+                           std::chrono::milliseconds(1));
+        }
+        return true;
+    };
+
+    if (path == "/live.m3u8") {
+        stats_.playlists++;
+        int64_t requested = QueryValue(query, "_HLS_msn");
+        if (config_.low_latency && requested >= 0) {
+            // A part index past the end of its segment asks for the next segment's first part
+            int64_t part = QueryValue(query, "_HLS_part");
+            int64_t target = part >= 0 ? requested * parts + part : (requested + 1) * parts - 1;
+            if (target >= PublishedParts()) {
+                stats_.blocked_reloads++;
+            }
+            if (!wait_for_part(target, 3 * parts)) {
+                response.status = 400;
+                return;
+            }
+        }
+        response.headers.emplace_back("Content-Type", "application/vnd.apple.mpegurl");
+        response.body = Playlist(PublishedParts());
+        return;
+    }
+
+    long long sequence = 0;
+    int part = 0;
+    if (path.compare(0, 6, "/part/") == 0 && std::sscanf(path.c_str() + 6, "%lld.%d.ts", &sequence, &part) == 2) {
+        stats_.parts++;
+        int64_t global_part = sequence * parts + part;
+        if (global_part >= PublishedParts()) {
+            stats_.preload_waits++;
+        }
+        if (part >= parts || !wait_for_part(global_part, 2)) {
+            response.status = 404;
+            return;
+        }
+        response.headers.emplace_back("Content-Type", "video/mp2t");
+        response.body = Part(sequence, part);
+        return;
+    }
+    if (path.compare(0, 5, "/seg/") == 0 && std::sscanf(path.c_str() + 5, "%lld.ts", &sequence) == 1) {
+        stats_.segments++;
+        int64_t published = PublishedParts();
+        bool complete = (sequence + 1) * parts <= published;
+        if (!complete && (config_.low_latency || sequence >= published / parts + config_.twitch_prefetch_segments)) {
+            response.status = 404;
+            return;
+        }
+        response.headers.emplace_back("Content-Type", "video/mp2t");
+        for (int i = 0; i < parts; ++i) {
+            response.body += Part(sequence, i);
+        }
+        if (!complete) {
+            // A prefetched segment: each part goes out once it is published
+            const size_t part_bytes = config_.packets_per_part * PACKET_SIZE;
+            const int64_t first_part = static_cast<int64_t>(sequence) * parts;
+            response.chunked = true;
+            response.ready_at = [this, part_bytes, first_part](size_t end_offset) {
+                return Published(first_part + static_cast<int64_t>((end_offset - 1) / part_bytes));
+            };
+        }
+        return;
+    }
+    response.status = 404;
+}
+
+} // namespace tardsplaya
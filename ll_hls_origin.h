@@ -0,0 +1,76 @@
+#pragma once
+// Live LL-HLS origin on the loopback server, for benches and tests (POSIX, not part of the Windows build)
+// Publishes a part every part_ms on a wall clock and lists the newest segments with their parts, a
+// preload hint and CAN-BLOCK-RELOAD. Playlist reloads with _HLS_msn/_HLS_part and requests for the
+// hinted part are held until that part exists, as a real LL-HLS origin does. Every packet carries its
+// segment, part and index so a client can check order and tell how old the media it forwards is.
+// With low_latency off it serves the same stream as a plain live playlist of whole segments, which
+// can advertise upcoming segments with #EXT-X-TWITCH-PREFETCH and stream them as they are produced.
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <memory>
+
+#include "loopback_server.h"
+
+namespace tardsplaya {
+
+    struct LowLatencyOriginConfig {
+        int part_ms = 250;
+        int parts_per_segment = 8;              // 2 s segments
+        int window_segments = 6;                // Whole segments listed
+        int parts_listed_segments = 3;          // Newest whole segments still listed with their parts
+        int part_hold_back_parts = 4;           // PART-HOLD-BACK, in parts (1 s)
+        int independent_every = 4;              // Key frame every this many parts
+        size_t packets_per_part = 200;          // ~1.2 Mbit/s
+        bool low_latency = true;
+        int twitch_prefetch_segments = 0;       // Upcoming segments advertised when low_latency is off
+        int rtt_ms = 20;
+        uint64_t bytes_per_second = 0;          // Send rate of each connection; 0 for unlimited
+    };
+
+    class LowLatencyOrigin {
+    public:
+        using Config = LowLatencyOriginConfig;
+
+        struct Stats {
+            std::atomic<uint64_t> playlists{0};
+            std::atomic<uint64_t> blocked_reloads{0};   // Held until the requested part existed
+            std::atomic<uint64_t> parts{0};
+            std::atomic<uint64_t> preload_waits{0};     // Part requests that arrived before the part existed
+            std::atomic<uint64_t> segments{0};
+        };
+
+        explicit LowLatencyOrigin(const Config& config = Config());
+
+        bool Start();
+        void Stop();
+
+        std::wstring PlaylistUrl() const;
+
+        // When the media of a packet was captured: the start of its part plus its share of the part
+        std::chrono::steady_clock::time_point MediaTime(int64_t media_sequence, int part_index, size_t packet) const;
+
+        // Fields of a packet this origin served; false for anything else
+        static bool DecodePacket(const uint8_t* packet, int64_t& media_sequence, int& part_index, size_t& index);
+
+        const Stats& GetStats() const { return stats_; }
+        const Config& GetConfig() const { return config_; }
+
+    private:
+        Config config_;
+        std::chrono::steady_clock::time_point start_;     // Part 0 of segment 0 began
+        std::unique_ptr<LoopbackServer> server_;
+        Stats stats_;
+
+        int64_t PublishedParts() const;
+        std::chrono::steady_clock::time_point Published(int64_t global_part) const;
+        std::string Playlist(int64_t published) const;
+        std::string Part(int64_t media_sequence, int part_index) const;
+        void Respond(const LoopbackRequest& request, LoopbackResponse& response);
+    };
+
+} // namespace tardsplaya
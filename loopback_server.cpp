@@ -0,0 +1,314 @@
+#include "loopback_server.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace tardsplaya {
+
+namespace {
+
+    const size_t MAX_PACED_CHUNK = 16 * 1024;
+    const size_t TCP_SEGMENT = 1460;
+
+    const char* ReasonPhrase(int status) {
+        switch (status) {
+            case 200: return "OK";
+            case 204: return "No Content";
+            case 206: return "Partial Content";
+            case 304: return "Not Modified";
+            case 400: return "Bad Request";
+            case 404: return "Not Found";
+            case 416: return "Range Not Satisfiable";
+            case 500: return "Internal Server Error";
+            case 503: return "Service Unavailable";
+            default: return "Status";
+        }
+    }
+
+} // namespace
+
+const std::string* LoopbackRequest::FindHeader(const std::string& name) const {
+    for (const auto& header : headers) {
+        if (header.first == name) {
+            return &header.second;
+        }
+    }
+    return nullptr;
+}
+
+LoopbackServer::LoopbackServer(Handler handler) : handler_(std::move(handler)) {
+}
+
+LoopbackServer::~LoopbackServer() {
+    if (acceptor_.joinable()) {
+        Stop();
+    }
+}
+
+bool LoopbackServer::Start() {
+    listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    if (listen_fd_ < 0 || bind(listen_fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(listen_fd_, 128) != 0 || getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+        return false;
+    }
+    port_ = ntohs(address.sin_port);
+    random_.seed(seed);
+    stop_ = false;
+    acceptor_ = std::thread([this] { AcceptLoop(); });
+    return true;
+}
+
+void LoopbackServer::Stop() {
+    stop_ = true;
+    if (acceptor_.joinable()) {
+        acceptor_.join();
+    }
+    std::lock_guard<std::mutex> lock(threads_mutex_);
+    for (std::thread& thread : connections_) {
+        thread.join();
+    }
+    connections_.clear();
+    close(listen_fd_);
+}
+
+std::string LoopbackServer::Url(const std::string& path) const {
+    return "http://127.0.0.1:" + std::to_string(port_) + path;
+}
+
+void LoopbackServer::ResetCounters() {
+    for (int i = 0; i < 100 && active > 0; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    accepted = 0;
+    requests = 0;
+    max_active = 0;
+    bytes_sent = 0;
+    lost_segments = 0;
+    stalls = 0;
+}
+
+void LoopbackServer::Sleep(std::chrono::milliseconds duration) {
+    auto deadline = std::chrono::steady_clock::now() + duration;
+    while (!stop_ && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::min(std::chrono::milliseconds(2), duration));
+    }
+}
+
+double LoopbackServer::Random() {
+    std::lock_guard<std::mutex> lock(random_mutex_);
+    return std::uniform_real_distribution<double>(0.0, 1.0)(random_);
+}
+
+bool LoopbackServer::WaitReadable(int fd) {
+    while (!stop_) {
+        pollfd pfd = { fd, POLLIN, 0 };
+        if (poll(&pfd, 1, 20) > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void LoopbackServer::AcceptLoop() {
+    while (WaitReadable(listen_fd_)) {
+        int fd = accept(listen_fd_, nullptr, nullptr);
+        if (fd < 0) {
+            continue;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        accepted++;
+        std::lock_guard<std::mutex> lock(threads_mutex_);
+        connections_.emplace_back([this, fd] { Serve(fd); });
+    }
+}
+
+bool LoopbackServer::SendAll(int fd, const char* data, size_t size) {
+    size_t sent = 0;
+    while (sent < size) {
+        ssize_t count = send(fd, data + sent, size - sent, MSG_NOSIGNAL);
+        if (count <= 0) {
+            return false;
+        }
+        sent += static_cast<size_t>(count);
+    }
+    bytes_sent += size;
+    return true;
+}
+
+bool LoopbackServer::SendPaced(int fd, const std::string& data, std::chrono::steady_clock::time_point& connection_next_send) {
+    if (!connection_bytes_per_second && !total_bytes_per_second && loss_rate <= 0.0) {
+        return SendAll(fd, data.data(), data.size());
+    }
+    // Small slices so a throttled body arrives as a steady trickle rather than in bursts
+    uint64_t slowest = std::min(connection_bytes_per_second ? connection_bytes_per_second : UINT64_MAX,
+                                total_bytes_per_second ? total_bytes_per_second : UINT64_MAX);
+    size_t slice = static_cast<size_t>(std::max<uint64_t>(1024, std::min<uint64_t>(MAX_PACED_CHUNK, slowest / 100)));
+
+    for (size_t offset = 0; offset < data.size() && !stop_; offset += slice) {
+        size_t size = std::min(slice, data.size() - offset);
+        if (loss_rate > 0.0) {
+            // A lost segment stalls everything behind it on the connection until it is retransmitted
+            double segments = static_cast<double>((size + TCP_SEGMENT - 1) / TCP_SEGMENT);
+            if (Random() < 1.0 - std::pow(1.0 - std::min(loss_rate, 1.0), segments)) {
+                lost_segments++;
+                Sleep(std::chrono::milliseconds(retransmit_ms));
+            }
+        }
+        auto now = std::chrono::steady_clock::now();
+        auto send_at = std::max(now, connection_next_send);
+        if (connection_bytes_per_second) {
+            connection_next_send = send_at + std::chrono::microseconds(size * 1000000 / connection_bytes_per_second);
+        }
+        if (total_bytes_per_second) {
+            std::lock_guard<std::mutex> lock(throttle_mutex_);
+            send_at = std::max(send_at, total_next_send_);
+            total_next_send_ = send_at + std::chrono::microseconds(size * 1000000 / total_bytes_per_second);
+        }
+        if (send_at > now) {
+            std::this_thread::sleep_until(send_at);
+        }
+        if (!SendAll(fd, data.data() + offset, size)) {
+            return false;
+        }
+    }
+    return !stop_;
+}
+
+void LoopbackServer::Serve(int fd) {
+    int now_active = ++active;
+    int seen = max_active.load();
+    while (now_active > seen && !max_active.compare_exchange_weak(seen, now_active)) {
+    }
+
+    std::string buffer;
+    int served = 0;
+    bool keep = true;
+    auto connection_next_send = std::chrono::steady_clock::now();
+    while (keep && WaitReadable(fd)) {
+        char chunk[4096];
+        ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+        if (received <= 0) {
+            break;
+        }
+        buffer.append(chunk, static_cast<size_t>(received));
+
+        size_t head_end;
+        while (keep && (head_end = buffer.find("\r\n\r\n")) != std::string::npos) {
+            LoopbackRequest request;
+            request.index_on_connection = served;
+            size_t line_end = buffer.find("\r\n");
+            std::string request_line = buffer.substr(0, line_end);
+            size_t first_space = request_line.find(' ');
+            size_t second_space = request_line.find(' ', first_space + 1);
+            request.method = request_line.substr(0, first_space);
+            request.path = request_line.substr(first_space + 1, second_space - first_space - 1);
+            size_t line_start = line_end + 2;
+            while (line_start < head_end) {
+                line_end = buffer.find("\r\n", line_start);
+                std::string line = buffer.substr(line_start, line_end - line_start);
+                line_start = line_end + 2;
+                size_t colon = line.find(':');
+                if (colon == std::string::npos) {
+                    continue;
+                }
+                std::string name = line.substr(0, colon);
+                std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+                size_t value_start = line.find_first_not_of(" \t", colon + 1);
+                request.headers.emplace_back(name, value_start == std::string::npos ? std::string() : line.substr(value_start));
+            }
+            buffer.erase(0, head_end + 4);
+            requests++;
+
+            LoopbackResponse response;
+            handler_(request, response);
+            int jitter = jitter_ms > 0 ? static_cast<int>(Random() * (jitter_ms + 1)) : 0;
+            Sleep(std::chrono::milliseconds((served == 0 ? handshake_ms : 0) + rtt_ms + jitter) + response.delay);
+
+            std::string head = "HTTP/1.1 " + std::to_string(response.status) + " " + ReasonPhrase(response.status) + "\r\n";
+            for (const auto& header : response.headers) {
+                head += header.first + ": " + header.second + "\r\n";
+            }
+            if (response.close) {
+                head += "Connection: close\r\n";
+            }
+            std::string payload;
+            if (response.chunked && response.ready_at && request.method != "HEAD") {
+                // Released chunk by chunk as the body is produced
+                head += "Transfer-Encoding: chunked\r\n\r\n";
+                keep = SendAll(fd, head.data(), head.size());
+                for (size_t offset = 0; keep && offset < response.body.size(); offset += 10000) {
+                    size_t size = std::min<size_t>(10000, response.body.size() - offset);
+                    auto wait = response.ready_at(offset + size) - std::chrono::steady_clock::now();
+                    if (wait > std::chrono::steady_clock::duration::zero()) {
+                        Sleep(std::chrono::duration_cast<std::chrono::milliseconds>(wait) + std::chrono::milliseconds(1));
+                    }
+                    char size_line[32];
+                    snprintf(size_line, sizeof(size_line), "%zx\r\n", size);
+                    std::string chunk = size_line + response.body.substr(offset, size) + "\r\n";
+                    keep = SendPaced(fd, chunk, connection_next_send) && !stop_;
+                }
+                std::string last = "0\r\n\r\n";
+                keep = keep && SendAll(fd, last.data(), last.size()) && !response.close;
+                served++;
+                if (max_requests_per_connection > 0 && served >= max_requests_per_connection) {
+                    keep = false;
+                }
+                continue;
+            } else if (response.chunked) {
+                head += "Transfer-Encoding: chunked\r\n\r\n";
+                for (size_t offset = 0; offset < response.body.size(); offset += 10000) {
+                    size_t size = std::min<size_t>(10000, response.body.size() - offset);
+                    char size_line[32];
+                    snprintf(size_line, sizeof(size_line), "%zx\r\n", size);
+                    payload += size_line;
+                    payload.append(response.body, offset, size);
+                    payload += "\r\n";
+                }
+                payload += "0\r\n\r\n";
+            } else {
+                head += "Content-Length: " + std::to_string(response.body.size()) + "\r\n\r\n";
+                if (request.method != "HEAD") {
+                    payload = std::move(response.body);
+                }
+            }
+
+            // A transfer that breaks off partway: the headers promise the whole body
+            bool aborted = response.abort_after > 0 && response.abort_after < payload.size();
+            if (aborted) {
+                payload.resize(response.abort_after);
+            }
+
+            keep = SendAll(fd, head.data(), head.size());
+            if (keep && stall_rate > 0.0 && payload.size() > 1 && Random() < stall_rate) {
+                // The origin or a congested link goes quiet with half the body sent
+                stalls++;
+                std::string rest = payload.substr(payload.size() / 2);
+                payload.resize(payload.size() / 2);
+                keep = SendPaced(fd, payload, connection_next_send);
+                Sleep(std::chrono::milliseconds(stall_ms));
+                payload = std::move(rest);
+            }
+            keep = keep && SendPaced(fd, payload, connection_next_send) && !response.close && !aborted;
+            served++;
+            if (max_requests_per_connection > 0 && served >= max_requests_per_connection) {
+                keep = false;
+            }
+        }
+    }
+    close(fd);
+    active--;
+}
+
+} // namespace tardsplaya
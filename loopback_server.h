@@ -0,0 +1,105 @@
+#pragma once
+// Loopback HTTP/1.1 origin for benches and tests (POSIX sockets, not part of the Windows build)
+// Serves 127.0.0.1 on an ephemeral port, one thread per connection, with keep-alive. A handler
+// callback builds each response; a chunked body can be released as it is produced. Network conditions are emulated on the server side: a handshake
+// delay on the first request of a connection, a round trip with random jitter before every response,
+// send throttling per connection and across all connections, lost TCP segments that hold the
+// connection for a retransmission timeout, and bodies that stall halfway. Random choices come from a
+// seeded generator so a run can be repeated.
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <thread>
+
+namespace tardsplaya {
+
+    struct LoopbackRequest {
+        std::string method;
+        std::string path;                                             // Path and query as sent
+        std::vector<std::pair<std::string, std::string>> headers;    // Names lowercased
+        int index_on_connection = 0;                                  // 0 for the first request of a connection
+
+        const std::string* FindHeader(const std::string& name) const;
+    };
+
+    struct LoopbackResponse {
+        int status = 200;
+        std::vector<std::pair<std::string, std::string>> headers;    // Content-Length or chunking is added
+        std::string body;
+        bool chunked = false;
+        bool close = false;                                           // Connection: close after this response
+        std::chrono::milliseconds delay{0};                           // Extra wait before the headers
+        size_t abort_after = 0;                                       // Drop the connection after this many body bytes
+        // Body produced while it is sent (chunked only): each chunk goes out once the bytes up to its end are ready
+        std::function<std::chrono::steady_clock::time_point(size_t end_offset)> ready_at;
+    };
+
+    class LoopbackServer {
+    public:
+        using Handler = std::function<void(const LoopbackRequest&, LoopbackResponse&)>;
+
+        // Set before requests arrive
+        int handshake_ms = 0;                   // Added to the first response of each connection (TCP + TLS)
+        int rtt_ms = 0;                         // Added to every response
+        uint64_t connection_bytes_per_second = 0;   // Send rate of one connection; 0 for unlimited
+        uint64_t total_bytes_per_second = 0;        // Shared by all connections; 0 for unlimited
+        int max_requests_per_connection = 0;    // Close silently after this many; 0 for no limit
+        int jitter_ms = 0;                      // Up to this much more, at random, before each response
+        double loss_rate = 0.0;                 // Of 1460-byte TCP segments sent; a loss holds the connection
+        int retransmit_ms = 200;                // for this long, TCP's minimum retransmission timeout
+        double stall_rate = 0.0;                // Of response bodies, which pause for stall_ms halfway through
+        int stall_ms = 0;
+        uint32_t seed = 1;                      // Of the generator behind jitter, loss and stalls
+
+        std::atomic<int> accepted{0};
+        std::atomic<int> requests{0};
+        std::atomic<int> active{0};
+        std::atomic<int> max_active{0};
+        std::atomic<uint64_t> bytes_sent{0};
+        std::atomic<uint64_t> lost_segments{0};
+        std::atomic<uint64_t> stalls{0};
+
+        explicit LoopbackServer(Handler handler);
+        ~LoopbackServer();
+
+        bool Start();
+        void Stop();
+
+        std::string Url(const std::string& path) const;
+        uint16_t GetPort() const { return port_; }
+
+        // Waits for connections of a previous client to close, then zeroes the counters
+        void ResetCounters();
+
+        // Sleep that ends early when the server stops; for handlers that stall mid-response
+        void Sleep(std::chrono::milliseconds duration);
+
+    private:
+        Handler handler_;
+        int listen_fd_ = -1;
+        uint16_t port_ = 0;
+        std::atomic<bool> stop_{false};
+        std::thread acceptor_;
+        std::mutex threads_mutex_;
+        std::vector<std::thread> connections_;
+        std::mutex throttle_mutex_;
+        std::chrono::steady_clock::time_point total_next_send_;
+        std::mutex random_mutex_;
+        std::mt19937 random_;
+
+        double Random();    // Uniform in [0, 1)
+        bool WaitReadable(int fd);
+        void AcceptLoop();
+        void Serve(int fd);
+        bool SendAll(int fd, const char* data, size_t size);
+        bool SendPaced(int fd, const std::string& data, std::chrono::steady_clock::time_point& connection_next_send);
+    };
+
+} // namespace tardsplaya
@@ -0,0 +1,145 @@
+#include "low_latency_hls.h"
+#include <algorithm>
+
+namespace tsduck_hls {
+
+void LowLatencyCursor::Reset() {
+    last_key_ = -1;
+    last_closed_segment_ = false;
+    last_preload_key_ = -1;
+    first_media_sequence_ = -1;
+    playlist_sequence_ = -1;
+    stats_ = Stats();
+}
+
+size_t LowLatencyCursor::StartIndex(const PlaylistParser& playlist) const {
+    const std::vector<PartialSegment>& parts = playlist.GetParts();
+    std::chrono::milliseconds hold_back = playlist.GetServerControl().part_hold_back;
+    if (hold_back.count() <= 0) {
+        hold_back = playlist.GetPartTarget() * 3;   // The spec's minimum
+    }
+    // Without INDEPENDENT flags only segment starts are known to begin with a key frame
+    bool flagged = std::any_of(parts.begin(), parts.end(), [](const PartialSegment& part) { return part.independent; });
+
+    size_t start = 0;
+    bool found = false;
+    std::chrono::milliseconds behind_edge{0};
+    for (size_t i = parts.size(); i-- > 0;) {
+        behind_edge += parts[i].duration;
+        if (flagged ? parts[i].independent : parts[i].part_index == 0) {
+            start = i;
+            found = true;
+            if (behind_edge >= hold_back) {
+                break;
+            }
+        }
+    }
+    return found ? start : 0;
+}
+
+std::vector<PartFetch> LowLatencyCursor::NextParts(const PlaylistParser& playlist) {
+    std::vector<PartFetch> fetches;
+    const std::vector<PartialSegment>& parts = playlist.GetParts();
+    if (playlist_sequence_ >= 0 && playlist.GetMediaSequence() < playlist_sequence_) {
+        last_key_ = -1;     // Sequence numbers restarted
+    }
+    playlist_sequence_ = playlist.GetMediaSequence();
+    if (parts.empty()) {
+        return fetches;
+    }
+
+    size_t next = parts.size();
+    bool jumped = false;
+    if (last_key_ < 0) {
+        next = StartIndex(playlist);
+        jumped = first_media_sequence_ >= 0;
+    } else {
+        auto newer = std::find_if(parts.begin(), parts.end(), [this](const PartialSegment& part) {
+            return PartKey(part.media_sequence, part.part_index) > last_key_;
+        });
+        if (newer == parts.end()) {
+            return fetches;
+        }
+        int64_t last_sequence = last_key_ / MAX_PARTS_PER_SEGMENT;
+        bool continues = PartKey(newer->media_sequence, newer->part_index) == last_key_ + 1 ||
+                         (last_closed_segment_ && newer->media_sequence == last_sequence + 1 && newer->part_index == 0);
+        if (continues) {
+            next = static_cast<size_t>(newer - parts.begin());
+        } else {
+            // The parts in between left the playlist before they were fetched; never go back to played ones
+            next = std::max(StartIndex(playlist), static_cast<size_t>(newer - parts.begin()));
+            jumped = true;
+        }
+    }
+    if (jumped) {
+        stats_.jumps++;
+    }
+
+    const int64_t segments_end = playlist.GetMediaSequence() + static_cast<int64_t>(playlist.GetSegmentCount());
+    bool discontinuity = jumped;
+    for (size_t i = next; i < parts.size(); ++i) {
+        const PartialSegment& part = parts[i];
+        last_key_ = PartKey(part.media_sequence, part.part_index);
+        last_closed_segment_ = part.media_sequence < segments_end &&
+                               (i + 1 == parts.size() || parts[i + 1].media_sequence != part.media_sequence);
+        if (part.gap) {
+            stats_.gaps++;
+            discontinuity = true;
+            continue;
+        }
+        PartFetch fetch;
+        fetch.url = part.url;
+        fetch.key = last_key_;
+        fetch.media_sequence = part.media_sequence;
+        fetch.part_index = part.part_index;
+        fetch.discontinuity = discontinuity || part.discontinuity;
+        discontinuity = false;
+        if (first_media_sequence_ < 0) {
+            first_media_sequence_ = part.media_sequence;
+        }
+        fetches.push_back(fetch);
+        stats_.parts++;
+    }
+    return fetches;
+}
+
+bool LowLatencyCursor::PreloadPart(const PlaylistParser& playlist, PartFetch& out) {
+    const PreloadHint& hint = playlist.GetPreloadHint();
+    if (hint.media_sequence < 0 || last_key_ < 0) {
+        return false;
+    }
+    int64_t key = PartKey(hint.media_sequence, hint.part_index);
+    if (key <= last_key_ || key == last_preload_key_) {
+        return false;
+    }
+    last_preload_key_ = key;
+    out.url = hint.url;
+    out.key = key;
+    out.media_sequence = hint.media_sequence;
+    out.part_index = hint.part_index;
+    out.discontinuity = false;
+    stats_.preloads++;
+    return true;
+}
+
+std::wstring BlockingReloadUrl(const PlaylistParser& playlist, const std::wstring& playlist_url, bool whole_segments) {
+    if (!playlist.GetServerControl().can_block_reload) {
+        return playlist_url;
+    }
+    // A part index past the end of its segment asks for the next segment's first part
+    const PreloadHint& hint = playlist.GetPreloadHint();
+    const std::vector<PartialSegment>& parts = playlist.GetParts();
+    std::wstring query = L"_HLS_msn=";
+    if (whole_segments) {
+        query += std::to_wstring(playlist.GetMediaSequence() + static_cast<int64_t>(playlist.GetSegmentCount()));
+    } else if (hint.media_sequence >= 0) {
+        query += std::to_wstring(hint.media_sequence) + L"&_HLS_part=" + std::to_wstring(hint.part_index);
+    } else if (!parts.empty()) {
+        query += std::to_wstring(parts.back().media_sequence) + L"&_HLS_part=" + std::to_wstring(parts.back().part_index + 1);
+    } else {
+        query += std::to_wstring(playlist.GetMediaSequence() + static_cast<int64_t>(playlist.GetSegmentCount()));
+    }
+    return playlist_url + (playlist_url.find(L'?') == std::wstring::npos ? L"?" : L"&") + query;
+}
+
+} // namespace tsduck_hls
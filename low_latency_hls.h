@@ -0,0 +1,67 @@
+#pragma once
+// LL-HLS playback position over partial segments
+// A low-latency playlist lists the parts of its newest segments, including the segment still being
+// produced, a preload hint for the part after the last one listed, and whether the server holds a
+// reload until a given part exists. The cursor hands out each part once, in order, starting at an
+// independent part PART-HOLD-BACK from the live edge, so a fetch loop plays parts a fraction of a
+// second after they are published instead of whole segments after the next poll.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "tsduck_hls_wrapper.h"
+
+namespace tsduck_hls {
+
+    // Parts are keyed inside their parent's sequence number so part keys keep media order
+    constexpr int64_t MAX_PARTS_PER_SEGMENT = 1000;
+    inline int64_t PartKey(int64_t media_sequence, int part_index) { return media_sequence * MAX_PARTS_PER_SEGMENT + part_index; }
+
+    struct PartFetch {
+        std::wstring url;               // As listed, relative to the playlist
+        int64_t key = 0;                // PartKey
+        int64_t media_sequence = 0;
+        int part_index = 0;
+        bool discontinuity = false;     // Starts a new period: a discontinuity tag, a gap, or the cursor jumped
+    };
+
+    class LowLatencyCursor {
+    public:
+        struct Stats {
+            uint64_t parts = 0;         // Handed out
+            uint64_t gaps = 0;          // GAP parts passed over
+            uint64_t jumps = 0;         // Restarts after the playlist moved past unplayed parts
+            uint64_t preloads = 0;      // Preload hints handed out
+        };
+
+        // Parts listed after the last one handed out, in order. The first call, and any after the parts in
+        // between left the playlist or the sequence restarted, starts PART-HOLD-BACK from the live edge.
+        std::vector<PartFetch> NextParts(const PlaylistParser& playlist);
+
+        // The hinted next part, to be requested before it is listed; false without a hint or once handed out
+        bool PreloadPart(const PlaylistParser& playlist, PartFetch& out);
+
+        // First segment played from its parts (-1 before the first part); full segments from here on are covered
+        int64_t GetFirstMediaSequence() const { return first_media_sequence_; }
+
+        const Stats& GetStats() const { return stats_; }
+        void Reset();
+
+    private:
+        int64_t last_key_ = -1;             // Last part handed out
+        bool last_closed_segment_ = false;  // It was the last part of its segment
+        int64_t last_preload_key_ = -1;
+        int64_t first_media_sequence_ = -1;
+        int64_t playlist_sequence_ = -1;    // EXT-X-MEDIA-SEQUENCE of the previous playlist
+        Stats stats_;
+
+        size_t StartIndex(const PlaylistParser& playlist) const;
+    };
+
+    // Reload URL asking the server to hold the response until the part after the last one listed exists,
+    // or with whole_segments (or no parts) the next whole segment. The playlist URL unchanged unless the
+    // server can block.
+    std::wstring BlockingReloadUrl(const PlaylistParser& playlist, const std::wstring& playlist_url, bool whole_segments = false);
+
+} // namespace tsduck_hls
@@ -0,0 +1,209 @@
+#include "pcr_scheduler.h"
+#include "ts_packet.h"
+#include <cmath>
+
+namespace tsduck_transport {
+
+namespace {
+
+    int64_t ToTicks(std::chrono::milliseconds duration) {
+        return static_cast<int64_t>(duration.count()) * PCRScheduler::PCR_TICKS_PER_MS;
+    }
+
+} // namespace
+
+PCRScheduler::PCRScheduler() : PCRScheduler(Config()) {
+}
+
+PCRScheduler::PCRScheduler(const Config& config) : config_(config) {
+    if (!(config_.catch_up_rate >= 1.0)) {
+        config_.catch_up_rate = 1.0;
+    }
+}
+
+bool PCRScheduler::ReadPCR(const uint8_t* packet, uint16_t& pid, int64_t& pcr) {
+    // Adaptation field present, long enough for flags + PCR, PCR_flag set
+    if (packet[0] != 0x47 || !(packet[3] & 0x20) || packet[4] < 7 || !(packet[5] & 0x10)) {
+        return false;
+    }
+
+    int64_t base = (static_cast<int64_t>(packet[6]) << 25) |
+                   (static_cast<int64_t>(packet[7]) << 17) |
+                   (static_cast<int64_t>(packet[8]) << 9) |
+                   (static_cast<int64_t>(packet[9]) << 1) |
+                   (packet[10] >> 7);
+    int64_t extension = (static_cast<int64_t>(packet[10] & 0x01) << 8) | packet[11];
+
+    pid = static_cast<uint16_t>(((packet[1] & 0x1F) << 8) | packet[2]);
+    pcr = base * 300 + extension;
+    return true;
+}
+
+int64_t PCRScheduler::PCRDiff(int64_t a, int64_t b) {
+    int64_t diff = (a - b) % PCR_WRAP;
+    if (diff > PCR_WRAP / 2) {
+        diff -= PCR_WRAP;
+    } else if (diff < -PCR_WRAP / 2) {
+        diff += PCR_WRAP;
+    }
+    return diff;
+}
+
+void PCRScheduler::AdvanceClock(Clock::time_point now) {
+    if (now <= clock_wall_) {
+        return;
+    }
+    double speed = stats_.catching_up ? config_.catch_up_rate : 1.0;
+    auto elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(now - clock_wall_).count();
+    clock_pcr_ = (clock_pcr_ + static_cast<int64_t>(elapsed_us * 27 * speed)) % PCR_WRAP;
+    clock_wall_ = now;
+}
+
+void PCRScheduler::ResetClock(int64_t pcr, Clock::time_point now) {
+    clock_pcr_ = pcr;
+    clock_wall_ = now;
+    have_clock_ = true;
+    // Intervals across a reset say nothing about output timing or packet rate
+    have_release_ = false;
+    stats_.lag_ms = 0.0;
+}
+
+void PCRScheduler::OnPCRReleased(int64_t pcr, Clock::time_point now) {
+    if (have_release_) {
+        double wall_ms = std::chrono::duration<double, std::milli>(now - last_release_wall_).count();
+        double stream_ms = static_cast<double>(PCRDiff(pcr, last_pcr_)) / PCR_TICKS_PER_MS;
+
+        // Interarrival jitter as in RFC 3550: output spacing against the spacing the stream asks for
+        stats_.jitter_ms += (std::fabs(wall_ms - stream_ms) - stats_.jitter_ms) / 16.0;
+
+        if (stream_ms > 0.0) {
+            double rate = static_cast<double>(packets_since_pcr_) / stream_ms;
+            packets_per_ms_ = packets_per_ms_ > 0.0 ? packets_per_ms_ + (rate - packets_per_ms_) / 16.0 : rate;
+        }
+    }
+
+    have_release_ = true;
+    last_pcr_ = pcr;
+    last_release_wall_ = now;
+    packets_since_pcr_ = 0;
+    stats_.pcr_packets++;
+}
+
+bool PCRScheduler::Admit(const uint8_t* packet, Clock::time_point now, Clock::time_point& wait_until) {
+    uint16_t pid = 0;
+    int64_t pcr = 0;
+    if (!config_.enabled || !ReadPCR(packet, pid, pcr)) {
+        packets_since_pcr_++;
+        return true;
+    }
+
+    // Pace on the first PCR PID seen; PCRs of other programs ride along
+    if (pcr_pid_ == NO_PID) {
+        pcr_pid_ = pid;
+    } else if (pid != pcr_pid_) {
+        packets_since_pcr_++;
+        return true;
+    }
+
+    if (!have_clock_) {
+        ResetClock(pcr, now);
+        OnPCRReleased(pcr, now);
+        return true;
+    }
+
+    AdvanceClock(now);
+    int64_t ahead = PCRDiff(pcr, clock_pcr_); // > 0: packet belongs in the clock's future
+    const int64_t burst = ToTicks(config_.max_burst);
+
+    bool discontinuity = (packet[5] & 0x80) != 0;
+    if (discontinuity || ahead > burst + ToTicks(config_.max_pcr_jump)) {
+        ResetClock(pcr, now);
+        stats_.clock_resets++;
+        OnPCRReleased(pcr, now);
+        return true;
+    }
+
+    if (ahead < 0) {
+        // Input arrived after its slot. Restart the schedule from this packet so the backlog behind it is
+        // paced too instead of being dumped on the player; catch-up mode recovers the lost time.
+        stats_.lag_ms = static_cast<double>(-ahead) / PCR_TICKS_PER_MS;
+        if (stats_.lag_ms > stats_.max_lag_ms) {
+            stats_.max_lag_ms = stats_.lag_ms;
+        }
+        stats_.late_packets++;
+        clock_pcr_ = pcr;
+        OnPCRReleased(pcr, now);
+        return true;
+    }
+
+    if (ahead <= burst) {
+        stats_.lag_ms = 0.0;
+        OnPCRReleased(pcr, now);
+        return true;
+    }
+
+    // Due once the clock is within the burst window of this PCR
+    double speed = stats_.catching_up ? config_.catch_up_rate : 1.0;
+    auto wait_us = static_cast<int64_t>(static_cast<double>(ahead - burst) / 27.0 / speed) + 1;
+    wait_until = now + std::chrono::microseconds(wait_us);
+    stats_.waits++;
+    return false;
+}
+
+size_t PCRScheduler::Release(const uint8_t* packets, size_t count, Clock::time_point now, Clock::time_point& wait_until) {
+    for (size_t i = 0; i < count; ++i) {
+        if (!Admit(packets + i * TS_PACKET_SIZE, now, wait_until)) {
+            return i;
+        }
+    }
+    return count;
+}
+
+size_t PCRScheduler::ReleaseViews(const uint8_t* const* packets, size_t count, Clock::time_point now, Clock::time_point& wait_until) {
+    for (size_t i = 0; i < count; ++i) {
+        if (!Admit(packets[i], now, wait_until)) {
+            return i;
+        }
+    }
+    return count;
+}
+
+void PCRScheduler::SetBacklog(size_t buffered_packets, Clock::time_point now) {
+    if (packets_per_ms_ <= 0.0) {
+        return;
+    }
+    // Time up to now still runs at the old speed
+    if (have_clock_) {
+        AdvanceClock(now);
+    }
+    stats_.backlog_ms = static_cast<double>(buffered_packets) / packets_per_ms_;
+
+    // Hysteresis keeps the clock from flapping between speeds as each segment lands
+    double threshold = static_cast<double>(config_.catch_up_backlog.count());
+    if (stats_.backlog_ms > threshold) {
+        stats_.catching_up = config_.catch_up_rate > 1.0;
+    } else if (stats_.backlog_ms < threshold * 0.75) {
+        stats_.catching_up = false;
+    }
+}
+
+void PCRScheduler::Resync() {
+    if (have_clock_) {
+        stats_.clock_resets++;
+    }
+    have_clock_ = false;
+    have_release_ = false;
+}
+
+void PCRScheduler::Reset() {
+    stats_ = Stats();
+    pcr_pid_ = NO_PID;
+    have_clock_ = false;
+    have_release_ = false;
+    clock_pcr_ = 0;
+    last_pcr_ = 0;
+    packets_since_pcr_ = 0;
+    packets_per_ms_ = 0.0;
+}
+
+} // namespace tsduck_transport
@@ -0,0 +1,93 @@
+#pragma once
+// PCR-paced output scheduler for the transport stream router
+// Releases packets against a wall-clock model of the stream's Program Clock Reference, so the player
+// is fed at the rate it plays instead of a whole segment at a time. Output may run a bounded burst
+// ahead of the clock, the clock runs faster by a catch-up rate while the backlog behind live is too
+// large, and it restarts from the stream on PCR discontinuities or late input.
+
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+
+namespace tsduck_transport {
+
+    class PCRScheduler {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        static constexpr int64_t PCR_TICKS_PER_MS = 27000;              // 27 MHz system clock
+        static constexpr int64_t PCR_WRAP = (int64_t(1) << 33) * 300;   // 33-bit base * 300 + extension
+
+        struct Config {
+            bool enabled = true;
+            std::chrono::milliseconds max_burst{250};          // How far output may run ahead of the clock (also the start-up prefill)
+            double catch_up_rate = 1.25;                        // Clock speed while behind live (values below 1.0 act as 1.0)
+            std::chrono::milliseconds catch_up_backlog{2500};  // Buffered stream time that counts as behind live
+            std::chrono::milliseconds max_pcr_jump{2000};      // Larger forward PCR jumps restart the clock
+        };
+
+        struct Stats {
+            double lag_ms = 0.0;         // How late the last PCR packet arrived for its slot (0 when on time)
+            double max_lag_ms = 0.0;
+            double jitter_ms = 0.0;      // Smoothed |release interval - PCR interval| between PCR packets
+            double backlog_ms = 0.0;     // Stream time buffered behind the output
+            bool catching_up = false;
+            uint64_t pcr_packets = 0;
+            uint64_t late_packets = 0;   // PCR packets that arrived after their slot
+            uint64_t clock_resets = 0;   // Discontinuities and PCR jumps
+            uint64_t waits = 0;          // Times output was held back for a PCR that was not due yet
+        };
+
+        PCRScheduler();
+        explicit PCRScheduler(const Config& config);
+
+        // Offer one packet at now. Returns false with wait_until set when the packet carries a PCR that
+        // is not due yet; offer the same packet again once that time is reached.
+        bool Admit(const uint8_t* packet, Clock::time_point now, Clock::time_point& wait_until);
+
+        // Number of leading packets that may be written now (back-to-back payloads or pointers);
+        // wait_until is set when fewer than count are released
+        size_t Release(const uint8_t* packets, size_t count, Clock::time_point now, Clock::time_point& wait_until);
+        size_t ReleaseViews(const uint8_t* const* packets, size_t count, Clock::time_point now, Clock::time_point& wait_until);
+
+        // Packets waiting behind the output, converted to stream time with the measured packet rate
+        void SetBacklog(size_t buffered_packets, Clock::time_point now);
+
+        // Forget the clock after a gap in the input (skipped or dropped packets) so the next PCR restarts
+        // it instead of being held back or counted late; stats and the measured packet rate are kept
+        void Resync();
+
+        void Reset();
+        bool IsEnabled() const { return config_.enabled; }
+        const Stats& GetStats() const { return stats_; }
+
+        // PCR (27 MHz units) and PID of a packet whose adaptation field carries one
+        static bool ReadPCR(const uint8_t* packet, uint16_t& pid, int64_t& pcr);
+
+    private:
+        static constexpr uint16_t NO_PID = 0xFFFF;
+
+        Config config_;
+        Stats stats_;
+
+        uint16_t pcr_pid_ = NO_PID;
+        bool have_clock_ = false;
+        int64_t clock_pcr_ = 0;          // Stream time the output should have reached at clock_wall_
+        Clock::time_point clock_wall_;
+
+        bool have_release_ = false;
+        int64_t last_pcr_ = 0;           // Last PCR released and when
+        Clock::time_point last_release_wall_;
+
+        uint64_t packets_since_pcr_ = 0;
+        double packets_per_ms_ = 0.0;    // Smoothed stream packet rate, for the backlog estimate
+
+        // Signed distance a - b on the wrapping PCR timeline
+        static int64_t PCRDiff(int64_t a, int64_t b);
+
+        void AdvanceClock(Clock::time_point now);
+        void ResetClock(int64_t pcr, Clock::time_point now);
+        void OnPCRReleased(int64_t pcr, Clock::time_point now);
+    };
+
+} // namespace tsduck_transport
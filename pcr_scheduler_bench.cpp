@@ -0,0 +1,223 @@
+// Simulation of PCR-paced output against segment-at-a-time delivery
+// Feeds a synthetic 6 Mbps live stream (2 s segments, PCR every 40 ms, PCR wrapping mid-run) through the
+// router's buffer in virtual time: segments land with jitter, one arrives 1.5 s late, two arrive together
+// after a fetch stall and one starts a new PCR timeline. A player model plays at 1x once it holds 1 s.
+// Unpaced output hands every segment over as it lands (the old router); paced output goes through
+// PCRScheduler. Reports the player's buffer swing, the worst 100 ms output burst, stalls and the
+// scheduler's lag/jitter metrics.
+//
+// Build: g++ -std=c++17 -O2 pcr_scheduler_bench.cpp pcr_scheduler.cpp -o pcr_scheduler_bench
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <string>
+#include "pcr_scheduler.h"
+#include "ts_packet.h"
+
+using namespace tsduck_transport;
+
+namespace {
+
+    const size_t PACKETS_PER_MS = 4;             // ~6 Mbps
+    const int SEGMENT_MS = 2000;
+    const int PCR_INTERVAL_MS = 40;
+    const int SEGMENT_COUNT = 40;
+    const int LATE_SEGMENT = 10;                 // Lands 1.5 s late
+    const int STALLED_SEGMENT = 20;              // Held back to land together with the next one
+    const int DISCONTINUITY_SEGMENT = 30;        // New PCR timeline (ad break splice)
+    const int PLAYER_START_MS = 1000;            // Player prebuffer before playback starts
+
+    struct Stream {
+        std::vector<uint8_t> data;
+        std::vector<int> arrival_ms;             // Per segment
+        size_t packets_per_segment = SEGMENT_MS * PACKETS_PER_MS;
+    };
+
+    void WritePCR(uint8_t* packet, uint16_t pid, int64_t pcr, bool discontinuity) {
+        int64_t base = pcr / 300;
+        int64_t extension = pcr % 300;
+        packet[1] = static_cast<uint8_t>(pid >> 8);
+        packet[2] = static_cast<uint8_t>(pid);
+        packet[3] = 0x30;                        // Adaptation field + payload
+        packet[4] = 7;
+        packet[5] = static_cast<uint8_t>(0x10 | (discontinuity ? 0x80 : 0x00));
+        packet[6] = static_cast<uint8_t>(base >> 25);
+        packet[7] = static_cast<uint8_t>(base >> 17);
+        packet[8] = static_cast<uint8_t>(base >> 9);
+        packet[9] = static_cast<uint8_t>(base >> 1);
+        packet[10] = static_cast<uint8_t>(((base & 1) << 7) | 0x7E | (extension >> 8));
+        packet[11] = static_cast<uint8_t>(extension);
+    }
+
+    Stream MakeStream() {
+        Stream stream;
+        size_t total = stream.packets_per_segment * SEGMENT_COUNT;
+        stream.data.assign(total * TS_PACKET_SIZE, 0);
+
+        // Start 30 s before the 33-bit PCR wraps so the run crosses it
+        int64_t pcr_start = PCRScheduler::PCR_WRAP - 30000 * PCRScheduler::PCR_TICKS_PER_MS;
+        int64_t jump = 0;
+        const size_t pcr_every = PCR_INTERVAL_MS * PACKETS_PER_MS;
+        for (size_t i = 0; i < total; ++i) {
+            uint8_t* packet = &stream.data[i * TS_PACKET_SIZE];
+            packet[0] = 0x47;
+            packet[1] = 0x01;
+            packet[3] = 0x10;
+            size_t segment = i / stream.packets_per_segment;
+            bool splice = segment == DISCONTINUITY_SEGMENT && i % stream.packets_per_segment == 0;
+            if (splice) {
+                jump = 3600000LL * PCRScheduler::PCR_TICKS_PER_MS;
+            }
+            if (i % pcr_every == 0) {
+                int64_t stream_ms = static_cast<int64_t>(i / PACKETS_PER_MS);
+                int64_t pcr = (pcr_start + jump + stream_ms * PCRScheduler::PCR_TICKS_PER_MS) % PCRScheduler::PCR_WRAP;
+                WritePCR(packet, 0x100, pcr, splice);
+            }
+        }
+
+        // Segment k is complete at (k+1)*2 s on the origin and lands 50-450 ms later
+        std::mt19937 rng(7);
+        for (int k = 0; k < SEGMENT_COUNT; ++k) {
+            int arrival = (k + 1) * SEGMENT_MS + 50 + static_cast<int>(rng() % 400);
+            if (k == LATE_SEGMENT) {
+                arrival += 1500;
+            }
+            stream.arrival_ms.push_back(arrival);
+        }
+        stream.arrival_ms[STALLED_SEGMENT] = stream.arrival_ms[STALLED_SEGMENT + 1];
+        return stream;
+    }
+
+    struct Result {
+        double buffer_mean_ms = 0.0;
+        double buffer_stddev_ms = 0.0;
+        double buffer_max_ms = 0.0;
+        size_t max_100ms_packets = 0;
+        int stall_ms = 0;
+        int catching_up_ms = 0;
+        PCRScheduler::Stats scheduler;
+    };
+
+    Result Simulate(const Stream& stream, bool paced) {
+        PCRScheduler::Config config;
+        config.enabled = paced;
+        PCRScheduler scheduler(config);
+
+        const PCRScheduler::Clock::time_point epoch;
+        const size_t total = stream.data.size() / TS_PACKET_SIZE;
+        size_t arrived = 0;
+        size_t delivered = 0;
+        double play_ms = 0.0;
+        bool playing = false;
+        std::vector<size_t> delivered_per_ms;
+
+        Result result;
+        double sum = 0.0;
+        double sum_sq = 0.0;
+        int samples = 0;
+        int end_ms = stream.arrival_ms.back() + SEGMENT_MS * 2;
+
+        for (int t = 0; t < end_ms; ++t) {
+            auto now = epoch + std::chrono::milliseconds(t);
+            while (arrived < total && stream.arrival_ms[arrived / stream.packets_per_segment] <= t) {
+                arrived += stream.packets_per_segment;
+            }
+
+            size_t before = delivered;
+            scheduler.SetBacklog(arrived - delivered, now);
+            if (scheduler.GetStats().catching_up) {
+                result.catching_up_ms++;
+            }
+            PCRScheduler::Clock::time_point wait_until;
+            delivered += scheduler.Release(&stream.data[delivered * TS_PACKET_SIZE], arrived - delivered, now, wait_until);
+            delivered_per_ms.push_back(delivered - before);
+
+            // Player: stream time delivered minus stream time played
+            double buffered_ms = static_cast<double>(delivered) / PACKETS_PER_MS - play_ms;
+            if (!playing && buffered_ms >= PLAYER_START_MS) {
+                playing = true;
+            }
+            if (playing) {
+                if (buffered_ms >= 1.0) {
+                    play_ms += 1.0;
+                } else if (delivered < total) {
+                    result.stall_ms++;
+                }
+                sum += buffered_ms;
+                sum_sq += buffered_ms * buffered_ms;
+                samples++;
+                if (buffered_ms > result.buffer_max_ms) {
+                    result.buffer_max_ms = buffered_ms;
+                }
+            }
+        }
+
+        size_t window = 0;
+        for (size_t t = 0; t < delivered_per_ms.size(); ++t) {
+            window += delivered_per_ms[t];
+            if (t >= 100) {
+                window -= delivered_per_ms[t - 100];
+            }
+            if (window > result.max_100ms_packets) {
+                result.max_100ms_packets = window;
+            }
+        }
+
+        result.buffer_mean_ms = sum / samples;
+        result.buffer_stddev_ms = std::sqrt(sum_sq / samples - result.buffer_mean_ms * result.buffer_mean_ms);
+        result.scheduler = scheduler.GetStats();
+        return result;
+    }
+
+    void Print(const std::string& label, const Result& result) {
+        std::cout << std::left << std::setw(10) << label << std::right << std::fixed << std::setprecision(0)
+                  << std::setw(9) << result.buffer_mean_ms << std::setw(9) << result.buffer_stddev_ms
+                  << std::setw(9) << result.buffer_max_ms << std::setw(12) << result.max_100ms_packets
+                  << std::setw(9) << result.stall_ms << std::endl;
+    }
+
+    bool Check(bool condition, const std::string& what) {
+        std::cout << (condition ? "PASS: " : "FAIL: ") << what << std::endl;
+        return condition;
+    }
+
+} // namespace
+
+int main() {
+    Stream stream = MakeStream();
+    std::cout << "=== PCR pacing simulation: " << SEGMENT_COUNT << " x " << SEGMENT_MS << " ms segments, "
+              << PACKETS_PER_MS * 1000 << " packets/s ===" << std::endl << std::endl;
+
+    Result unpaced = Simulate(stream, false);
+    Result paced = Simulate(stream, true);
+
+    std::cout << "           player buffer (ms)         worst 100 ms   stall" << std::endl;
+    std::cout << "              mean   stddev      max   (packets)      (ms)" << std::endl;
+    Print("unpaced", unpaced);
+    Print("paced", paced);
+
+    const PCRScheduler::Stats& stats = paced.scheduler;
+    std::cout << std::endl << std::setprecision(1)
+              << "Scheduler: lag " << stats.lag_ms << " ms (max " << stats.max_lag_ms << " ms), jitter "
+              << stats.jitter_ms << " ms, " << stats.late_packets << " late PCRs, " << stats.clock_resets
+              << " clock resets, " << stats.waits << " waits, catching up for " << paced.catching_up_ms << " ms"
+              << std::endl << std::endl;
+
+    // Nominal 100 ms is 400 packets; the burst window lets the output run 250 ms ahead
+    const size_t nominal_100ms = 100 * PACKETS_PER_MS;
+    bool ok = true;
+    ok = Check(paced.max_100ms_packets <= nominal_100ms * 2 + 250 * PACKETS_PER_MS, "paced output bursts stay within the burst window") && ok;
+    ok = Check(unpaced.max_100ms_packets >= stream.packets_per_segment, "unpaced output delivers whole segments at once") && ok;
+    // Stall recovery swings the buffer either way; the segment sawtooth is what pacing removes
+    ok = Check(paced.buffer_stddev_ms < unpaced.buffer_stddev_ms * 0.6, "player buffer swing reduced by 40% or more") && ok;
+    ok = Check(paced.stall_ms <= unpaced.stall_ms + 300, "pacing adds no more than the burst window of stall time") && ok;
+    ok = Check(stats.clock_resets == 1, "one clock reset for the discontinuity, none for the PCR wrap") && ok;
+    ok = Check(stats.max_lag_ms >= 1000.0, "late segment shows up as scheduler lag") && ok;
+    ok = Check(paced.catching_up_ms > 0, "stalled double segment triggers catch-up") && ok;
+
+    std::cout << std::endl << (ok ? "All checks passed" : "SOME CHECKS FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -1,5 +1,6 @@
 #include "playlist_parser.h"
 #include <sstream>
+#include <cwchar>
 
 // Helper: resolve relative URL
 static std::wstring JoinUrl(const std::wstring& base_url, const std::wstring& rel_url) {
@@ -41,6 +42,19 @@ std::vector<PlaylistQuality> ParseM3U8MasterPlaylist(
                     qual.name = L"unknown";
                 }
             }
+            // Bandwidth and resolution let quality switching order the variants
+            size_t bw_pos = line.find(L"BANDWIDTH=");
+            while (bw_pos != std::wstring::npos && bw_pos > 0 && line[bw_pos - 1] != L':' && line[bw_pos - 1] != L',') {
+                bw_pos = line.find(L"BANDWIDTH=", bw_pos + 1); // Not AVERAGE-BANDWIDTH
+            }
+            if (bw_pos != std::wstring::npos) {
+                qual.bandwidth = std::wcstoull(line.c_str() + bw_pos + 10, nullptr, 10);
+            }
+            size_t res_pos = line.find(L"RESOLUTION=");
+            if (res_pos != std::wstring::npos) {
+                auto rest = line.substr(res_pos + 11);
+                qual.resolution = rest.substr(0, rest.find_first_of(L",\r\n"));
+            }
             last_inf = line;
         } else if (line[0] != L'#') {
             // This is a URL, following an EXT-X-STREAM-INF
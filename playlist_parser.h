@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -6,6 +7,8 @@
 struct PlaylistQuality {
     std::wstring name;    // e.g. "1080p (source)", "720p", "audio_only"
     std::wstring url;     // Absolute or relative URL to the stream
+    uint64_t bandwidth = 0;   // BANDWIDTH in bits per second, 0 if not given
+    std::wstring resolution;  // e.g. "1280x720", empty for audio-only variants
 };
 
 // Parses a master M3U8 playlist and extracts available qualities and their URLs.
@@ -0,0 +1,124 @@
+#include "poll_scheduler.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace tsduck_hls {
+
+namespace {
+
+    const double ERROR_WEIGHT = 0.125;      // Smoothing of the reported prediction error
+
+    double Milliseconds(PollScheduler::Clock::duration duration) {
+        return std::chrono::duration<double, std::milli>(duration).count();
+    }
+
+    PollScheduler::Clock::duration FromMilliseconds(double ms) {
+        return std::chrono::duration_cast<PollScheduler::Clock::duration>(std::chrono::duration<double, std::milli>(ms));
+    }
+
+} // namespace
+
+PollScheduler::PollScheduler(const Config& config) : config_(config) {
+}
+
+void PollScheduler::Reset() {
+    started_ = false;
+    have_publication_ = false;
+    end_sequence_ = 0;
+    cadence_ms_ = 0.0;
+    lead_ms_ = 0.0;
+    unchanged_streak_ = 0;
+    stats_ = Stats();
+}
+
+PollScheduler::Clock::time_point PollScheduler::Predicted(int64_t count) const {
+    return publication_ + FromMilliseconds(cadence_ms_ * static_cast<double>(count));
+}
+
+std::chrono::milliseconds PollScheduler::DelayFrom(Clock::time_point now) const {
+    if (!started_ || next_poll_ <= now) {
+        return std::chrono::milliseconds(0);
+    }
+    // Rounded up so a caller sleeping this long does not wake just before the poll is due
+    return std::chrono::ceil<std::chrono::milliseconds>(next_poll_ - now);
+}
+
+void PollScheduler::OnPlaylist(const PlaylistParser& playlist, Clock::time_point now) {
+    std::vector<MediaSegment> segments = playlist.GetSegments();
+    std::chrono::milliseconds duration = segments.empty() ? playlist.GetTargetDuration() : segments.back().duration;
+    OnPlaylist(playlist.GetMediaSequence() + static_cast<int64_t>(segments.size()), duration, now);
+}
+
+void PollScheduler::OnPlaylist(int64_t end_sequence, std::chrono::milliseconds segment_duration, Clock::time_point now) {
+    stats_.polls++;
+    if (segment_duration.count() > 0) {
+        segment_duration_ = segment_duration;
+    }
+    double nominal_ms = static_cast<double>(segment_duration_.count());
+    double min_ms = static_cast<double>(config_.min_interval.count());
+    double margin_ms = static_cast<double>(config_.margin.count());
+
+    if (!started_ || end_sequence < end_sequence_) {
+        // First playlist, or the sequence restarted: the phase is unknown until a segment is seen arriving
+        started_ = true;
+        have_publication_ = false;
+        end_sequence_ = end_sequence;
+        cadence_ms_ = nominal_ms;
+        lead_ms_ = margin_ms;
+        unchanged_streak_ = 0;
+    } else if (end_sequence > end_sequence_) {
+        // The newest segment appeared after the previous poll and by this one
+        int64_t count = end_sequence - end_sequence_;
+        Clock::time_point lower = last_poll_;
+        if (have_publication_ && unchanged_streak_ == 0) {
+            // Listed at the early poll: no closer bound than the lead it was polled with
+            lower = std::max(lower, now - FromMilliseconds(lead_ms_));
+            lead_ms_ = std::min(lead_ms_ * 2, cadence_ms_ / 2);
+        } else {
+            lead_ms_ = std::max(lead_ms_ / 2, margin_ms);
+        }
+        Clock::time_point observed = lower + (now - lower) / 2;
+        if (have_publication_) {
+            double error = Milliseconds(observed - Predicted(count));
+            stats_.last_error_ms = error;
+            stats_.prediction_error_ms = stats_.predictions == 0 ? std::fabs(error) :
+                stats_.prediction_error_ms + ERROR_WEIGHT * (std::fabs(error) - stats_.prediction_error_ms);
+            stats_.predictions++;
+
+            double interval = Milliseconds(observed - publication_) / static_cast<double>(count);
+            cadence_ms_ += config_.cadence_weight * (interval - cadence_ms_);
+            // A stall or a burst must not throw the estimate far from the advertised duration
+            cadence_ms_ = std::min(std::max(cadence_ms_, std::max(nominal_ms / 2, 2 * min_ms)), nominal_ms * 2);
+        }
+        publication_ = observed;
+        have_publication_ = true;
+        end_sequence_ = end_sequence;
+        unchanged_streak_ = 0;
+        stats_.changed++;
+    } else {
+        unchanged_streak_++;
+        stats_.unchanged++;
+    }
+    last_poll_ = now;
+    stats_.cadence_ms = cadence_ms_;
+
+    double delay_ms;
+    if (!have_publication_) {
+        // Half a segment apart, as the spec asks of reloads that find nothing new, until one appears
+        delay_ms = cadence_ms_ / 2;
+    } else if (unchanged_streak_ == 0) {
+        // Just ahead of the next segment, so the poll after brackets its arrival closely
+        delay_ms = Milliseconds(Predicted(1) - now) - lead_ms_;
+    } else if (unchanged_streak_ == 1) {
+        // Not there yet: the margin past the prediction
+        delay_ms = lead_ms_ + margin_ms;
+    } else {
+        // Late: doubling while nothing changes, up to half a segment
+        int shift = std::min(unchanged_streak_, 16);
+        delay_ms = std::min(margin_ms * static_cast<double>(1 << shift), cadence_ms_ / 2);
+    }
+    next_poll_ = now + FromMilliseconds(std::max(delay_ms, min_ms));
+}
+
+} // namespace tsduck_hls
@@ -0,0 +1,73 @@
+#pragma once
+// Playlist refresh timing from the segment publication cadence
+// A live playlist changes once per segment, so a fixed refresh interval either wastes requests (500 ms
+// on 2 s segments) or adds up to a whole interval of latency (2 s). The scheduler learns when segments
+// appear - each one turns up between the last poll that did not list it and the poll that did - and
+// polls just before the next one is due, then again shortly after, backing off while nothing changes.
+// A segment already listed at the early poll means the prediction ran late, so the next early poll
+// goes twice as far ahead until a poll lands before a segment again.
+
+#include <cstdint>
+#include <chrono>
+
+#include "tsduck_hls_wrapper.h"
+
+namespace tsduck_hls {
+
+    struct PollSchedulerConfig {
+        std::chrono::milliseconds margin{100};          // First poll this far ahead of the predicted publication
+        std::chrono::milliseconds min_interval{100};    // Never poll more often than this
+        double cadence_weight = 0.25;                   // Weight of a new interval in the cadence estimate
+    };
+
+    class PollScheduler {
+    public:
+        using Config = PollSchedulerConfig;
+        using Clock = std::chrono::steady_clock;
+
+        struct Stats {
+            uint64_t polls = 0;
+            uint64_t changed = 0;               // Polls that listed new segments
+            uint64_t unchanged = 0;
+            uint64_t predictions = 0;           // New segments that had a predicted publication time
+            double cadence_ms = 0.0;            // Estimated time between segments
+            double last_error_ms = 0.0;         // Estimated minus predicted publication; positive when late
+            double prediction_error_ms = 0.0;   // Smoothed absolute error
+        };
+
+        explicit PollScheduler(const Config& config = Config());
+
+        // A playlist received at now lists segments up to end_sequence (media sequence + segment count,
+        // exclusive). segment_duration seeds the cadence until intervals are observed; 0 keeps the previous one.
+        void OnPlaylist(int64_t end_sequence, std::chrono::milliseconds segment_duration, Clock::time_point now);
+
+        // Same from a parsed playlist: its newest segment's duration, or the target duration
+        void OnPlaylist(const PlaylistParser& playlist, Clock::time_point now);
+
+        // When to request the playlist next; only meaningful after the first OnPlaylist
+        Clock::time_point NextPoll() const { return next_poll_; }
+        std::chrono::milliseconds DelayFrom(Clock::time_point now) const;
+
+        bool IsStarted() const { return started_; }
+        const Stats& GetStats() const { return stats_; }
+        void Reset();
+
+    private:
+        Config config_;
+        bool started_ = false;
+        bool have_publication_ = false;     // publication_ comes from an observed change
+        int64_t end_sequence_ = 0;
+        std::chrono::milliseconds segment_duration_{2000};
+        double cadence_ms_ = 0.0;
+        double lead_ms_ = 0.0;              // How far ahead of the prediction the first poll goes
+        Clock::time_point last_poll_;
+        Clock::time_point publication_;     // Estimated publication of the newest segment
+        Clock::time_point next_poll_;
+        int unchanged_streak_ = 0;
+        Stats stats_;
+
+        // Publication of the segment count segments after the newest one
+        Clock::time_point Predicted(int64_t count) const;
+    };
+
+} // namespace tsduck_hls
@@ -0,0 +1,189 @@
+// Tests for adaptive playlist polling
+// Drives PollScheduler on a simulated clock against a live playlist that publishes a segment every
+// 2 s with some jitter, next to the fixed intervals it replaces (500 ms and 2 s). For each policy it
+// counts playlist requests per segment and how long after publication a segment is first listed in a
+// response. Also checks the backoff on unchanged playlists, a cadence that differs from the advertised
+// duration, a sequence restart, and the cadence prior taken from a parsed playlist.
+//
+// Build: g++ -std=c++17 -O2 poll_scheduler_test.cpp poll_scheduler.cpp tsduck_hls_wrapper.cpp -o poll_scheduler_test
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <cmath>
+#include "poll_scheduler.h"
+
+using namespace tsduck_hls;
+using Clock = PollScheduler::Clock;
+using std::chrono::milliseconds;
+
+namespace {
+
+    const milliseconds RTT(40);             // Playlist state is read at the request, seen at the response
+    const int SEGMENTS = 300;
+    const int WARMUP_SEGMENTS = 10;         // Not counted while the adaptive policy finds the phase
+
+    bool Check(bool condition, const std::string& what) {
+        std::cout << (condition ? "  PASS  " : "  FAIL  ") << what << std::endl;
+        return condition;
+    }
+
+    // Publication times of a live stream: every cadence, jittered by up to +-jitter
+    struct LiveStream {
+        Clock::time_point start;
+        std::vector<Clock::time_point> published;
+        int64_t first_sequence = 1000;
+        int64_t listed_at_start = 3;
+
+        LiveStream(milliseconds cadence, milliseconds jitter, Clock::time_point origin) : start(origin) {
+            uint32_t state = 12345;
+            for (int i = 0; i < SEGMENTS; ++i) {
+                state = state * 1103515245u + 12345u;
+                double unit = static_cast<double>((state >> 8) & 0xFFFF) / 65535.0 * 2.0 - 1.0;
+                auto offset = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(unit * static_cast<double>(jitter.count())));
+                published.push_back(origin + cadence * (i + 1) + offset);
+            }
+        }
+
+        // End of the listed sequence (exclusive) for a request at t
+        int64_t EndAt(Clock::time_point t) const {
+            int64_t end = first_sequence + listed_at_start;
+            for (const Clock::time_point& p : published) {
+                if (p <= t) {
+                    end++;
+                }
+            }
+            return end;
+        }
+    };
+
+    struct Result {
+        double polls_per_segment = 0.0;
+        double mean_delay_ms = 0.0;
+        double max_delay_ms = 0.0;
+        PollScheduler::Stats stats;
+    };
+
+    // fixed_interval 0 runs the scheduler
+    Result Simulate(const LiveStream& stream, milliseconds fixed_interval, milliseconds advertised) {
+        Result result;
+        PollScheduler scheduler;
+        Clock::time_point request = stream.start;
+        Clock::time_point end_time = stream.published.back();
+        int64_t seen_end = 0;
+        std::vector<double> delays(stream.published.size(), -1.0);
+        uint64_t polls = 0;
+        Clock::time_point counted_from = stream.published[WARMUP_SEGMENTS - 1];
+        while (request < end_time) {
+            int64_t end = stream.EndAt(request);
+            Clock::time_point response = request + RTT;
+            if (request >= counted_from) {
+                polls++;
+            }
+            for (int64_t sequence = std::max(seen_end, stream.first_sequence + stream.listed_at_start); sequence < end; ++sequence) {
+                size_t index = static_cast<size_t>(sequence - stream.first_sequence - stream.listed_at_start);
+                delays[index] = std::chrono::duration<double, std::milli>(response - stream.published[index]).count();
+            }
+            seen_end = std::max(seen_end, end);
+            if (fixed_interval.count() > 0) {
+                request = response + fixed_interval;
+            } else {
+                scheduler.OnPlaylist(end, advertised, response);
+                request = response + scheduler.DelayFrom(response);
+            }
+        }
+        int counted = 0;
+        double total = 0.0;
+        for (size_t i = WARMUP_SEGMENTS; i + 1 < delays.size(); ++i) {
+            if (delays[i] >= 0.0) {
+                total += delays[i];
+                result.max_delay_ms = std::max(result.max_delay_ms, delays[i]);
+                counted++;
+            }
+        }
+        result.mean_delay_ms = counted > 0 ? total / counted : 0.0;
+        result.polls_per_segment = counted > 0 ? static_cast<double>(polls) / counted : 0.0;
+        result.stats = scheduler.GetStats();
+        return result;
+    }
+
+    void Print(const std::string& name, const Result& result) {
+        std::cout << "  " << std::left << std::setw(16) << name << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(5) << result.polls_per_segment << " polls/segment, listed " << std::setprecision(0)
+                  << std::setw(5) << result.mean_delay_ms << " ms after publication on average, "
+                  << std::setw(5) << result.max_delay_ms << " ms at most" << std::endl;
+    }
+
+} // namespace
+
+int main() {
+    std::cout << "=== Poll scheduler tests ===" << std::endl;
+    bool ok = true;
+    Clock::time_point t0 = Clock::now();
+
+    // Backoff while the playlist does not change
+    PollScheduler scheduler;
+    scheduler.OnPlaylist(10, milliseconds(2000), t0);
+    ok = Check(scheduler.DelayFrom(t0) == milliseconds(1000), "phase unknown: polls half a segment apart") && ok;
+    Clock::time_point t = t0 + milliseconds(1000);
+    scheduler.OnPlaylist(11, milliseconds(2000), t);   // Appeared in (t0, t0 + 1000]: estimated at 500
+    ok = Check(scheduler.DelayFrom(t) == milliseconds(1400), "after a change: next poll just ahead of the predicted segment") && ok;
+    std::vector<long long> backoff;
+    for (int i = 0; i < 5; ++i) {
+        t += scheduler.DelayFrom(t);
+        scheduler.OnPlaylist(11, milliseconds(2000), t);
+        backoff.push_back(static_cast<long long>(scheduler.DelayFrom(t).count()));
+    }
+    ok = Check(backoff == std::vector<long long>({200, 400, 800, 1000, 1000}), "unchanged: backs off from twice the margin to half a segment") && ok;
+    ok = Check(scheduler.GetStats().polls == 7 && scheduler.GetStats().unchanged == 5 && scheduler.GetStats().changed == 1, "changed and unchanged polls counted") && ok;
+
+    // Listed already at the early poll: estimated within the lead before it, and the next lead doubles
+    PollScheduler early;
+    early.OnPlaylist(10, milliseconds(2000), t0);
+    early.OnPlaylist(11, milliseconds(2000), t0 + milliseconds(1000));     // Estimated at 500, next due at 2500
+    early.OnPlaylist(12, milliseconds(2000), t0 + milliseconds(2400));     // Early poll: estimated at 2350
+    ok = Check(early.GetStats().last_error_ms == -150.0 && early.GetStats().cadence_ms == 1962.5,
+               "early segment: error and cadence from the lead window") && ok;
+    ok = Check(early.DelayFrom(t0 + milliseconds(2400)) == milliseconds(1713), "early segment: next poll twice the margin ahead") && ok;
+
+    // A sequence restart forgets the phase
+    t += milliseconds(300);
+    scheduler.OnPlaylist(3, milliseconds(2000), t);
+    ok = Check(scheduler.DelayFrom(t) == milliseconds(1000), "sequence restart: phase searched again") && ok;
+
+    // Cadence prior from a parsed playlist: the newest segment's duration, not a larger target duration
+    PlaylistParser playlist;
+    playlist.ParsePlaylist("#EXTM3U\n#EXT-X-TARGETDURATION:6\n#EXT-X-MEDIA-SEQUENCE:500\n#EXTINF:2.000,live\na.ts\n#EXTINF:2.000,live\nb.ts\n");
+    PollScheduler parsed;
+    parsed.OnPlaylist(playlist, t0);
+    ok = Check(parsed.GetStats().cadence_ms == 2000.0 && parsed.DelayFrom(t0) == milliseconds(1000), "cadence seeded from the newest EXTINF") && ok;
+
+    // Live stream, 2 s segments, +-50 ms jitter
+    std::cout << std::endl << "2 s segments with up to 50 ms jitter, " << RTT.count() << " ms round trip, " << SEGMENTS << " segments" << std::endl;
+    LiveStream live(milliseconds(2000), milliseconds(50), t0);
+    Result fast = Simulate(live, milliseconds(500), milliseconds(2000));
+    Result slow = Simulate(live, milliseconds(2000), milliseconds(2000));
+    Result adaptive = Simulate(live, milliseconds(0), milliseconds(2000));
+    Print("fixed 500 ms", fast);
+    Print("fixed 2 s", slow);
+    Print("adaptive", adaptive);
+    std::cout << "  adaptive cadence " << std::setprecision(0) << adaptive.stats.cadence_ms << " ms, prediction error "
+              << adaptive.stats.prediction_error_ms << " ms" << std::endl;
+    ok = Check(adaptive.polls_per_segment < fast.polls_per_segment / 1.5, "fewer requests than 500 ms polling") && ok;
+    ok = Check(adaptive.mean_delay_ms < fast.mean_delay_ms && adaptive.mean_delay_ms + 500.0 < slow.mean_delay_ms,
+               "segments seen sooner than with 500 ms or 2 s polling") && ok;
+    ok = Check(std::fabs(adaptive.stats.cadence_ms - 2000.0) < 50.0, "cadence learned") && ok;
+    ok = Check(adaptive.stats.prediction_error_ms < 100.0, "prediction error under 100 ms") && ok;
+
+    // Segments shorter than advertised: the cadence is learned from arrivals
+    std::cout << std::endl << "1.5 s segments advertised as 2 s" << std::endl;
+    LiveStream short_segments(milliseconds(1500), milliseconds(50), t0);
+    Result learned = Simulate(short_segments, milliseconds(0), milliseconds(2000));
+    Print("adaptive", learned);
+    ok = Check(std::fabs(learned.stats.cadence_ms - 1500.0) < 50.0, "cadence follows the observed publication interval") && ok;
+    ok = Check(learned.mean_delay_ms < 300.0 && learned.polls_per_segment < 3.0, "still close to publication") && ok;
+
+    std::cout << std::endl << (ok ? "All checks passed" : "SOME CHECKS FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,310 @@
+// Packet latency at the live edge: whole-segment hand-over vs. progressive chunk forwarding
+// The router used to queue a segment only after its last byte arrived, so every packet waited for
+// the rest of its segment: on a throttled origin that is up to a full download time added to
+// glass-to-glass latency. Here segments come from a loopback origin with a round trip and a send
+// rate close to the stream's own, one at a time as at the live edge, and every packet's delay is
+// measured from the moment the origin sent it until it was forwarded - once whole segments, once
+// packet-aligned chunks as they arrive. Further runs check that a transfer broken off partway is
+// resumed without repeating or losing packets, that one which keeps failing leaves only whole
+// packets forwarded, and that chunks stay packet-aligned around corrupt bytes.
+//
+// Build: g++ -std=c++17 -O2 -pthread progressive_forwarding_bench.cpp ts_chunker.cpp ts_sync.cpp segment_prefetcher.cpp segment_pool.cpp http_client.cpp http_client_posix.cpp inflater.cpp loopback_server.cpp -o progressive_forwarding_bench
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include "ts_chunker.h"
+#include "segment_prefetcher.h"
+#include "http_client.h"
+#include "loopback_server.h"
+
+using namespace tsduck_transport;
+using tardsplaya::HttpClient;
+using tardsplaya::HttpClientConfig;
+using tardsplaya::LoopbackRequest;
+using tardsplaya::LoopbackResponse;
+using tardsplaya::LoopbackServer;
+
+namespace {
+
+    const int RTT_MS = 20;
+    const size_t SEGMENT_PACKETS = 5000;                     // ~940 KB, 2 s of a ~3.7 Mbit/s stream
+    const size_t SEGMENT_BYTES = SEGMENT_PACKETS * TS_PACKET_SIZE;
+    const uint64_t CONNECTION_RATE = 2 * 1024 * 1024;        // Bytes/s: ~450 ms per segment
+    const int SEGMENTS = 10;
+    const size_t ABORT_AT = 300000;                          // Not a packet boundary
+
+    bool Check(bool condition, const std::string& what) {
+        std::cout << (condition ? "  PASS  " : "  FAIL  ") << what << std::endl;
+        return condition;
+    }
+
+    // Packets carry their segment and index after the header so order can be checked on arrival
+    std::string MakeSegment(uint32_t sequence) {
+        std::string body(SEGMENT_BYTES, '\xFF');
+        for (uint32_t i = 0; i < SEGMENT_PACKETS; ++i) {
+            char* packet = &body[i * TS_PACKET_SIZE];
+            packet[0] = static_cast<char>(TS_SYNC_BYTE);
+            packet[1] = 0x01;
+            packet[2] = 0x00;
+            packet[3] = 0x10;
+            for (int b = 0; b < 4; ++b) {
+                packet[4 + b] = static_cast<char>(sequence >> (8 * b));
+                packet[8 + b] = static_cast<char>(i >> (8 * b));
+            }
+        }
+        return body;
+    }
+
+    uint32_t ReadField(const uint8_t* packet, size_t at) {
+        return packet[at] | (packet[at + 1] << 8) | (packet[at + 2] << 16) | (static_cast<uint32_t>(packet[at + 3]) << 24);
+    }
+
+    // When each path was last requested, to time packets from the moment the origin sent them
+    std::mutex requests_mutex;
+    std::map<std::string, std::chrono::steady_clock::time_point> requested_at;
+    std::map<std::string, int> request_counts;
+
+    // /seg/<n>.ts serves segment n; /abort-once/<n>.ts breaks off its first transfer partway and
+    // /abort/<n>.ts every one of them
+    void Respond(const LoopbackRequest& request, LoopbackResponse& response) {
+        size_t slash = request.path.find('/', 1);
+        std::string route = request.path.substr(0, slash + 1);
+        int count;
+        {
+            std::lock_guard<std::mutex> lock(requests_mutex);
+            requested_at[request.path] = std::chrono::steady_clock::now();
+            count = ++request_counts[request.path];
+        }
+        if (slash == std::string::npos || (route != "/seg/" && route != "/abort-once/" && route != "/abort/")) {
+            response.status = 404;
+            return;
+        }
+        response.body = MakeSegment(static_cast<uint32_t>(std::atol(request.path.c_str() + slash + 1)));
+        if (route == "/abort/" || (route == "/abort-once/" && count == 1)) {
+            response.abort_after = ABORT_AT;
+        }
+    }
+
+    // Stands in for the router: checks every forwarded packet and times it against the origin
+    struct Forwarder {
+        uint32_t sequence = 0;
+        uint32_t next_index = 0;
+        std::chrono::steady_clock::time_point origin_start;    // First body byte left the origin
+        bool in_order = true;
+        uint64_t packets = 0;
+        double latency_sum_ms = 0.0;
+        double latency_max_ms = 0.0;
+        double first_packet_ms = -1.0;                          // After the request, for the current segment
+
+        void Begin(uint32_t segment, const std::string& path) {
+            sequence = segment;
+            next_index = 0;
+            first_packet_ms = -1.0;
+            std::lock_guard<std::mutex> lock(requests_mutex);
+            origin_start = requested_at[path] + std::chrono::milliseconds(RTT_MS);
+        }
+
+        void Forward(const uint8_t* data, size_t size) {
+            auto now = std::chrono::steady_clock::now();
+            if (size % TS_PACKET_SIZE != 0) {
+                in_order = false;
+            }
+            double since_start_ms = std::chrono::duration<double, std::milli>(now - origin_start).count();
+            if (first_packet_ms < 0.0 && size >= TS_PACKET_SIZE) {
+                first_packet_ms = since_start_ms + RTT_MS;
+            }
+            for (size_t offset = 0; offset + TS_PACKET_SIZE <= size; offset += TS_PACKET_SIZE) {
+                const uint8_t* packet = data + offset;
+                uint32_t index = ReadField(packet, 8);
+                if (packet[0] != TS_SYNC_BYTE || ReadField(packet, 4) != sequence || index != next_index) {
+                    in_order = false;
+                }
+                next_index = index + 1;
+                double latency = since_start_ms - index * TS_PACKET_SIZE * 1000.0 / CONNECTION_RATE;
+                latency_sum_ms += latency;
+                latency_max_ms = std::max(latency_max_ms, latency);
+                packets++;
+            }
+        }
+    };
+
+    struct Outcome {
+        SegmentPrefetcher::Result result = SegmentPrefetcher::Result::NOT_QUEUED;
+        size_t delivered = 0;
+        size_t dropped = 0;
+    };
+
+    // The router's hand-over: whole segment, or chunks while waiting and the rest once it is complete
+    Outcome TakeSegment(SegmentPrefetcher& prefetcher, TsChunker* chunker, Forwarder& forwarder, int64_t sequence) {
+        SegmentPrefetcher::ProgressFunction progress = [&](const uint8_t* data, size_t size) {
+            chunker->Append(data, size);
+            SegmentPool::PooledSegment chunk;
+            while (chunker->NextChunk(chunk)) {
+                forwarder.Forward(chunk->data(), chunk->size());
+            }
+        };
+        if (chunker) {
+            chunker->BeginSegment();
+        }
+        SegmentPrefetcher::Segment segment;
+        Outcome outcome;
+        outcome.result = prefetcher.Take(sequence, segment, nullptr, chunker ? &progress : nullptr);
+        outcome.delivered = segment.delivered;
+        if (outcome.result == SegmentPrefetcher::Result::READY && segment.delivered > 0) {
+            progress(segment.data->data() + segment.delivered, segment.data->size() - segment.delivered);
+            SegmentPool::PooledSegment chunk;
+            if (chunker->Finish(chunk)) {
+                forwarder.Forward(chunk->data(), chunk->size());
+            }
+        } else if (outcome.result == SegmentPrefetcher::Result::READY) {
+            forwarder.Forward(segment.data->data(), segment.data->size());
+        } else if (segment.delivered > 0) {
+            outcome.dropped = chunker->Abort();
+        }
+        return outcome;
+    }
+
+    std::wstring Url(const LoopbackServer& server, const std::string& path) {
+        std::string url = server.Url(path);
+        return std::wstring(url.begin(), url.end());
+    }
+
+    SegmentPrefetcher::FetchFunction ClientFetch(HttpClient& client) {
+        return [&client](const std::wstring& url, const SegmentPrefetcher::ChunkSink& sink, std::atomic<bool>* cancel_token) {
+            return client.Get(url, sink, cancel_token);
+        };
+    }
+
+    struct LiveRun {
+        Forwarder forwarder;
+        double first_packet_sum_ms = 0.0;
+        bool complete = true;
+    };
+
+    // One segment at a time, requested as it appears, like a stream at the live edge
+    LiveRun RunLive(LoopbackServer& server, bool progressive) {
+        HttpClient client(tardsplaya::CreatePlatformHttpBackend());
+        SegmentPool pool;
+        SegmentPrefetcher prefetcher(ClientFetch(client), pool);
+        TsChunker chunker;
+        LiveRun run;
+        for (int i = 0; i < SEGMENTS; ++i) {
+            int64_t sequence = (progressive ? 2000 : 1000) + i;
+            std::string path = "/seg/" + std::to_string(sequence) + ".ts";
+            prefetcher.Enqueue(sequence, Url(server, path));
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));     // Let the request reach the origin
+            run.forwarder.Begin(static_cast<uint32_t>(sequence), path);
+            Outcome outcome = TakeSegment(prefetcher, progressive ? &chunker : nullptr, run.forwarder, sequence);
+            run.complete = run.complete && outcome.result == SegmentPrefetcher::Result::READY && run.forwarder.next_index == SEGMENT_PACKETS;
+            run.first_packet_sum_ms += run.forwarder.first_packet_ms;
+        }
+        return run;
+    }
+
+    void PrintRow(const std::string& name, const LiveRun& run) {
+        std::cout << std::left << std::setw(26) << ("  " + name) << std::right << std::fixed << std::setprecision(0)
+                  << std::setw(14) << run.first_packet_sum_ms / SEGMENTS
+                  << std::setw(14) << run.forwarder.latency_sum_ms / run.forwarder.packets
+                  << std::setw(14) << run.forwarder.latency_max_ms << std::endl;
+    }
+
+} // namespace
+
+int main() {
+    std::cout << "=== Progressive forwarding: packet latency at the live edge ===" << std::endl;
+    bool ok = true;
+
+    LoopbackServer server(Respond);
+    server.rtt_ms = RTT_MS;
+    server.connection_bytes_per_second = CONNECTION_RATE;
+    if (!Check(server.Start(), "loopback origin listening")) {
+        return 1;
+    }
+
+    std::cout << std::endl << SEGMENTS << " segments of " << SEGMENT_BYTES / 1024 << " KB, " << RTT_MS << " ms round trip, "
+              << CONNECTION_RATE / 1048576 << " MB/s per connection, " << TsChunker::DEFAULT_CHUNK_BYTES / 1024 << " KB chunks"
+              << std::endl << std::endl;
+    std::cout << std::left << std::setw(26) << "  hand-over (ms)" << std::right << std::setw(14) << "first packet"
+              << std::setw(14) << "mean delay" << std::setw(14) << "max delay" << std::endl;
+
+    LiveRun whole = RunLive(server, false);
+    PrintRow("whole segment", whole);
+    LiveRun progressive = RunLive(server, true);
+    PrintRow("progressive chunks", progressive);
+    std::cout << std::endl;
+
+    double whole_mean = whole.forwarder.latency_sum_ms / whole.forwarder.packets;
+    double progressive_mean = progressive.forwarder.latency_sum_ms / progressive.forwarder.packets;
+    ok = Check(whole.complete && whole.forwarder.in_order && progressive.complete && progressive.forwarder.in_order,
+               "every packet forwarded once, whole and in order, in both modes") && ok;
+    ok = Check(progressive_mean < 0.25 * whole_mean, "mean packet delay under a quarter of whole-segment hand-over") && ok;
+    ok = Check(progressive.first_packet_sum_ms < 0.25 * whole.first_packet_sum_ms, "first packet of a segment out in a fraction of the time") && ok;
+
+    {
+        HttpClientConfig config;
+        config.retry_delay = std::chrono::milliseconds(50);
+        HttpClient client(tardsplaya::CreatePlatformHttpBackend(), config);
+        SegmentPool pool;
+        SegmentPrefetcher prefetcher(ClientFetch(client), pool);
+        TsChunker chunker;
+
+        Forwarder resumed;
+        prefetcher.Enqueue(1, Url(server, "/abort-once/1.ts"));
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        resumed.Begin(1, "/abort-once/1.ts");
+        Outcome outcome = TakeSegment(prefetcher, &chunker, resumed, 1);
+        ok = Check(outcome.result == SegmentPrefetcher::Result::READY && resumed.in_order && resumed.packets == SEGMENT_PACKETS &&
+                   client.GetStats().resumes == 1, "transfer broken off partway resumes without repeating or losing packets") && ok;
+
+        Forwarder failed;
+        prefetcher.Enqueue(2, Url(server, "/abort/2.ts"));
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        failed.Begin(2, "/abort/2.ts");
+        outcome = TakeSegment(prefetcher, &chunker, failed, 2);
+        ok = Check(outcome.result == SegmentPrefetcher::Result::FAILED && outcome.delivered == ABORT_AT && failed.in_order &&
+                   failed.packets * TS_PACKET_SIZE + outcome.dropped == ABORT_AT && outcome.dropped < TsChunker::DEFAULT_CHUNK_BYTES + TS_PACKET_SIZE,
+                   "failed transfer leaves whole packets forwarded and drops only the unsent tail") && ok;
+        std::cout << "  (aborted segment: " << failed.packets << " packets forwarded, " << outcome.dropped << " bytes dropped)" << std::endl;
+    }
+
+    {
+        // 100 packets, 5 corrupt bytes, 100 packets and a partial packet, fed in odd-sized pieces
+        std::string segment = MakeSegment(7).substr(0, 100 * TS_PACKET_SIZE) + "\x01\x02\x03\x04\x05" +
+                              MakeSegment(7).substr(0, 100 * TS_PACKET_SIZE) + MakeSegment(7).substr(0, 100);
+        TsChunker chunker(10 * TS_PACKET_SIZE);
+        chunker.BeginSegment();
+        std::vector<SegmentPool::PooledSegment> chunks;
+        SegmentPool::PooledSegment chunk;
+        for (size_t offset = 0; offset < segment.size(); offset += 1000) {
+            size_t size = std::min<size_t>(1000, segment.size() - offset);
+            chunker.Append(reinterpret_cast<const uint8_t*>(segment.data()) + offset, size);
+            while (chunker.NextChunk(chunk)) {
+                chunks.push_back(std::move(chunk));
+            }
+        }
+        if (chunker.Finish(chunk)) {
+            chunks.push_back(std::move(chunk));
+        }
+        bool aligned = true;
+        std::string joined;
+        std::vector<SyncRun> runs;
+        for (const auto& piece : chunks) {
+            ScanSyncRuns(piece->data(), piece->size(), runs);
+            aligned = aligned && !runs.empty() && runs.back().offset + runs.back().packets * TS_PACKET_SIZE == piece->size();
+            joined.append(piece->begin(), piece->end());
+        }
+        ok = Check(aligned && joined == segment.substr(0, segment.size() - 100) && chunker.GetStats().bytes_dropped == 100,
+                   "chunks end on packet boundaries around corrupt bytes; only the partial last packet is dropped") && ok;
+    }
+
+    server.Stop();
+    std::cout << std::endl << (ok ? "All checks passed" : "SOME CHECKS FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,308 @@
+#include "psi_tables.h"
+#include "ts_crc32.h"
+#include <cstring>
+
+namespace tsduck_transport {
+
+namespace {
+
+    // Repeats carry an adaptation field with only the flags byte: discontinuity_indicator set
+    constexpr size_t REPEAT_HEADER_SIZE = 4 + 2;
+    constexpr size_t MAX_REPEAT_SECTION = TS_PACKET_SIZE - REPEAT_HEADER_SIZE - 1; // Minus pointer_field
+
+    uint16_t Read16(const uint8_t* data) {
+        return static_cast<uint16_t>((data[0] << 8) | data[1]);
+    }
+
+    uint16_t ReadPID(const uint8_t* data) {
+        return static_cast<uint16_t>(((data[0] & 0x1F) << 8) | data[1]);
+    }
+
+    size_t ReadLength12(const uint8_t* data) {
+        return static_cast<size_t>(((data[0] & 0x0F) << 8) | data[1]);
+    }
+
+    void Append16(std::vector<uint8_t>& out, uint16_t value) {
+        out.push_back(static_cast<uint8_t>(value >> 8));
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    // Reserved bits are '1' in front of 13-bit PIDs and 12-bit lengths
+    void AppendPID(std::vector<uint8_t>& out, uint16_t pid) {
+        Append16(out, static_cast<uint16_t>(0xE000 | (pid & 0x1FFF)));
+    }
+
+    void AppendLength12(std::vector<uint8_t>& out, size_t length) {
+        Append16(out, static_cast<uint16_t>(0xF000 | (length & 0x0FFF)));
+    }
+
+    // Common long-form header check: table_id, section_syntax_indicator, length, CRC, current table
+    bool CheckSection(const uint8_t* section, size_t size, uint8_t table_id, size_t min_size) {
+        if (size < min_size || section[0] != table_id || !(section[1] & 0x80)) {
+            return false;
+        }
+        if (3 + ReadLength12(section + 1) != size) {
+            return false;
+        }
+        // Tables marked "next" are not in force yet
+        return (section[5] & 0x01) != 0 && CRC32MPEG(section, size) == 0;
+    }
+
+    void BeginSection(std::vector<uint8_t>& out, uint8_t table_id, uint16_t table_id_extension, uint8_t version) {
+        out.clear();
+        out.push_back(table_id);
+        out.push_back(0xB0); // section_syntax_indicator, '0', reserved; length patched in FinishSection
+        out.push_back(0x00);
+        Append16(out, table_id_extension);
+        out.push_back(static_cast<uint8_t>(0xC1 | ((version & 0x1F) << 1))); // current_next_indicator
+        out.push_back(0x00); // section_number
+        out.push_back(0x00); // last_section_number
+    }
+
+    void FinishSection(std::vector<uint8_t>& out) {
+        size_t section_length = out.size() - 3 + 4;
+        out[1] = static_cast<uint8_t>(0xB0 | ((section_length >> 8) & 0x0F));
+        out[2] = static_cast<uint8_t>(section_length);
+        uint32_t crc = CRC32MPEG(out.data(), out.size());
+        out.push_back(static_cast<uint8_t>(crc >> 24));
+        out.push_back(static_cast<uint8_t>(crc >> 16));
+        out.push_back(static_cast<uint8_t>(crc >> 8));
+        out.push_back(static_cast<uint8_t>(crc));
+    }
+
+} // namespace
+
+uint16_t ProgramAssociationTable::GetFirstPMTPID() const {
+    for (const ProgramAssociation& program : programs) {
+        if (program.program_number != 0) {
+            return program.pid;
+        }
+    }
+    return 0;
+}
+
+bool ParsePATSection(const uint8_t* section, size_t size, ProgramAssociationTable& pat) {
+    if (!CheckSection(section, size, PAT_TABLE_ID, 12) || (size - 12) % 4 != 0) {
+        return false;
+    }
+    pat.transport_stream_id = Read16(section + 3);
+    pat.version = (section[5] >> 1) & 0x1F;
+    pat.programs.clear();
+    for (size_t i = 8; i + 4 <= size - 4; i += 4) {
+        ProgramAssociation program;
+        program.program_number = Read16(section + i);
+        program.pid = ReadPID(section + i + 2);
+        pat.programs.push_back(program);
+    }
+    return true;
+}
+
+bool ParsePMTSection(const uint8_t* section, size_t size, ProgramMapTable& pmt) {
+    if (!CheckSection(section, size, PMT_TABLE_ID, 16)) {
+        return false;
+    }
+    const size_t end = size - 4;
+    size_t program_info_length = ReadLength12(section + 10);
+    if (12 + program_info_length > end) {
+        return false;
+    }
+
+    pmt.program_number = Read16(section + 3);
+    pmt.version = (section[5] >> 1) & 0x1F;
+    pmt.pcr_pid = ReadPID(section + 8);
+    pmt.program_descriptors.assign(section + 12, section + 12 + program_info_length);
+    pmt.streams.clear();
+
+    size_t i = 12 + program_info_length;
+    while (i < end) {
+        if (i + 5 > end) {
+            return false;
+        }
+        size_t es_info_length = ReadLength12(section + i + 3);
+        if (i + 5 + es_info_length > end) {
+            return false;
+        }
+        ElementaryStreamInfo stream;
+        stream.stream_type = section[i];
+        stream.pid = ReadPID(section + i + 1);
+        stream.descriptors.assign(section + i + 5, section + i + 5 + es_info_length);
+        pmt.streams.push_back(std::move(stream));
+        i += 5 + es_info_length;
+    }
+    return true;
+}
+
+void BuildPATSection(const ProgramAssociationTable& pat, std::vector<uint8_t>& out) {
+    BeginSection(out, PAT_TABLE_ID, pat.transport_stream_id, pat.version);
+    for (const ProgramAssociation& program : pat.programs) {
+        Append16(out, program.program_number);
+        AppendPID(out, program.pid);
+    }
+    FinishSection(out);
+}
+
+void BuildPMTSection(const ProgramMapTable& pmt, std::vector<uint8_t>& out) {
+    BeginSection(out, PMT_TABLE_ID, pmt.program_number, pmt.version);
+    AppendPID(out, pmt.pcr_pid);
+    AppendLength12(out, pmt.program_descriptors.size());
+    out.insert(out.end(), pmt.program_descriptors.begin(), pmt.program_descriptors.end());
+    for (const ElementaryStreamInfo& stream : pmt.streams) {
+        out.push_back(stream.stream_type);
+        AppendPID(out, stream.pid);
+        AppendLength12(out, stream.descriptors.size());
+        out.insert(out.end(), stream.descriptors.begin(), stream.descriptors.end());
+    }
+    FinishSection(out);
+}
+
+bool FindSectionInPacket(const uint8_t* packet, const uint8_t*& section, size_t& size) {
+    if (packet[0] != 0x47 || !(packet[1] & 0x40) || !(packet[3] & 0x10)) {
+        return false;
+    }
+    size_t offset = 4;
+    if (packet[3] & 0x20) {
+        offset += 1 + packet[4];
+    }
+    if (offset >= TS_PACKET_SIZE) {
+        return false;
+    }
+    offset += 1 + packet[offset]; // pointer_field
+    if (offset + 3 > TS_PACKET_SIZE) {
+        return false;
+    }
+    size_t total = 3 + ReadLength12(packet + offset + 1);
+    if (offset + total > TS_PACKET_SIZE) {
+        return false;
+    }
+    section = packet + offset;
+    size = total;
+    return true;
+}
+
+PSIRepeater::PSIRepeater(std::chrono::milliseconds interval) : interval_(interval) {
+    Reset();
+}
+
+void PSIRepeater::Reset() {
+    pat_ = CachedTable();
+    pmt_ = CachedTable();
+    pat_.pid = PAT_PID;
+    pat_table_ = ProgramAssociationTable();
+    pmt_table_ = ProgramMapTable();
+    rebuilds_ = 0;
+    repeats_ = 0;
+}
+
+void PSIRepeater::OnPacket(const uint8_t* packet, Clock::time_point now) {
+    uint16_t pid = ReadPID(packet + 1);
+    if (pid == PAT_PID) {
+        OnTablePacket(pat_, packet, now);
+    } else if (pmt_.pid != 0 && pid == pmt_.pid) {
+        OnTablePacket(pmt_, packet, now);
+    }
+}
+
+void PSIRepeater::OnTablePacket(CachedTable& table, const uint8_t* packet, Clock::time_point now) {
+    if (packet[3] & 0x10) {
+        table.last_cc = packet[3] & 0x0F;
+    }
+
+    const uint8_t* section = nullptr;
+    size_t size = 0;
+    if (!FindSectionInPacket(packet, section, size) || size < 4) {
+        return;
+    }
+
+    // Unchanged table: the CRC covers version and content, so nothing needs parsing or rebuilding
+    uint32_t section_crc = (static_cast<uint32_t>(section[size - 4]) << 24) | (static_cast<uint32_t>(section[size - 3]) << 16) |
+                           (static_cast<uint32_t>(section[size - 2]) << 8) | section[size - 1];
+    if (table.parsed && section_crc == table.section_crc) {
+        table.last_sent = now;
+        return;
+    }
+
+    if (&table == &pat_) {
+        ProgramAssociationTable pat;
+        if (!ParsePATSection(section, size, pat)) {
+            return;
+        }
+        uint16_t pmt_pid = pat.GetFirstPMTPID();
+        if (pmt_pid != pmt_.pid) {
+            // Different program layout: the old PMT no longer applies
+            pmt_ = CachedTable();
+            pmt_.pid = pmt_pid;
+        }
+        pat_table_ = std::move(pat);
+    } else {
+        ProgramMapTable pmt;
+        uint16_t program_number = 0;
+        for (const ProgramAssociation& program : pat_table_.programs) {
+            if (program.pid == pmt_.pid && program.program_number != 0) {
+                program_number = program.program_number;
+                break;
+            }
+        }
+        if (!ParsePMTSection(section, size, pmt) || pmt.program_number != program_number) {
+            return;
+        }
+        pmt_table_ = std::move(pmt);
+    }
+
+    table.section_crc = section_crc;
+    table.parsed = true;
+    table.valid = BuildPacket(table);
+    table.last_sent = now;
+}
+
+bool PSIRepeater::BuildPacket(CachedTable& table) {
+    const uint16_t pid = table.pid;
+    if (&table == &pat_) {
+        BuildPATSection(pat_table_, section_scratch_);
+    } else {
+        BuildPMTSection(pmt_table_, section_scratch_);
+    }
+    if (section_scratch_.size() > MAX_REPEAT_SECTION) {
+        return false; // Multi-packet sections are passed through but not repeated
+    }
+
+    uint8_t* packet = table.packet;
+    packet[0] = 0x47;
+    packet[1] = static_cast<uint8_t>(0x40 | ((pid >> 8) & 0x1F)); // payload_unit_start_indicator
+    packet[2] = static_cast<uint8_t>(pid);
+    packet[3] = 0x30;  // Adaptation field + payload; continuity counter patched per repeat
+    packet[4] = 0x01;  // Adaptation field length
+    packet[5] = 0x80;  // discontinuity_indicator
+    packet[6] = 0x00;  // pointer_field
+    memcpy(packet + 7, section_scratch_.data(), section_scratch_.size());
+    memset(packet + 7 + section_scratch_.size(), 0xFF, TS_PACKET_SIZE - 7 - section_scratch_.size());
+    rebuilds_++;
+    return true;
+}
+
+bool PSIRepeater::Emit(CachedTable& table, Clock::time_point now, uint8_t* out) {
+    if (!table.valid || table.last_cc < 0 || now - table.last_sent < interval_) {
+        return false;
+    }
+    // On the PCR PID the discontinuity_indicator would also announce a new time base
+    if (&table == &pmt_ && pmt_table_.pcr_pid == table.pid) {
+        return false;
+    }
+    memcpy(out, table.packet, TS_PACKET_SIZE);
+    out[3] = static_cast<uint8_t>(0x30 | table.last_cc);
+    table.last_sent = now;
+    repeats_++;
+    return true;
+}
+
+size_t PSIRepeater::EmitIfDue(Clock::time_point now, uint8_t* out) {
+    size_t count = 0;
+    if (Emit(pat_, now, out)) {
+        count++;
+    }
+    if (pat_.valid && Emit(pmt_, now, out + count * TS_PACKET_SIZE)) {
+        count++;
+    }
+    return count;
+}
+
+} // namespace tsduck_transport
@@ -0,0 +1,109 @@
+#pragma once
+// PAT/PMT tables for the transport stream router
+// Parses the stream's own PAT and PMT (CRC-checked), rebuilds the sections from the parsed tables and
+// keeps ready-to-send packets cached per table version, so they can be repeated at a fixed interval
+// with only the continuity counter patched in.
+
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <vector>
+
+#include "ts_packet.h"
+
+namespace tsduck_transport {
+
+    static constexpr uint16_t PAT_PID = 0x0000;
+    static constexpr uint8_t PAT_TABLE_ID = 0x00;
+    static constexpr uint8_t PMT_TABLE_ID = 0x02;
+
+    struct ProgramAssociation {
+        uint16_t program_number = 0;   // 0 = network PID
+        uint16_t pid = 0;
+    };
+
+    struct ProgramAssociationTable {
+        uint16_t transport_stream_id = 0;
+        uint8_t version = 0;
+        std::vector<ProgramAssociation> programs;
+
+        // PMT PID of the first real program (0 if none)
+        uint16_t GetFirstPMTPID() const;
+    };
+
+    struct ElementaryStreamInfo {
+        uint8_t stream_type = 0;
+        uint16_t pid = 0;
+        std::vector<uint8_t> descriptors;
+    };
+
+    struct ProgramMapTable {
+        uint16_t program_number = 0;
+        uint8_t version = 0;
+        uint16_t pcr_pid = 0x1FFF;
+        std::vector<uint8_t> program_descriptors;
+        std::vector<ElementaryStreamInfo> streams;
+    };
+
+    // Parse one complete section, table_id through CRC_32. False on a bad CRC or malformed section.
+    bool ParsePATSection(const uint8_t* section, size_t size, ProgramAssociationTable& pat);
+    bool ParsePMTSection(const uint8_t* section, size_t size, ProgramMapTable& pmt);
+
+    // Serialize a table as a current, single section with its CRC_32 (out is overwritten)
+    void BuildPATSection(const ProgramAssociationTable& pat, std::vector<uint8_t>& out);
+    void BuildPMTSection(const ProgramMapTable& pmt, std::vector<uint8_t>& out);
+
+    // Locate a section starting in a packet (payload_unit_start with pointer_field). False unless the
+    // whole section is inside this packet.
+    bool FindSectionInPacket(const uint8_t* packet, const uint8_t*& section, size_t& size);
+
+    // Repeats the stream's PAT and PMT on the way to the player. Tables are re-parsed and rebuilt only
+    // when the stream's section CRC changes. Repeats carry the last continuity counter seen on their
+    // PID with the adaptation field discontinuity_indicator set, so the stream's next packet on that
+    // PID still follows on without a continuity error.
+    class PSIRepeater {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        explicit PSIRepeater(std::chrono::milliseconds interval);
+
+        // Watch a packet that is being sent
+        void OnPacket(const uint8_t* packet, Clock::time_point now);
+
+        // Write the tables whose repeat is due to out (room for two packets); returns the packet count
+        size_t EmitIfDue(Clock::time_point now, uint8_t* out);
+
+        void Reset();
+
+        bool HasTables() const { return pat_.valid && pmt_.valid; }
+        const ProgramAssociationTable& GetPAT() const { return pat_table_; }
+        const ProgramMapTable& GetPMT() const { return pmt_table_; }
+        uint64_t GetRebuilds() const { return rebuilds_; }
+        uint64_t GetRepeats() const { return repeats_; }
+
+    private:
+        struct CachedTable {
+            bool parsed = false;             // section_crc belongs to a section that parsed
+            bool valid = false;              // packet holds a repeatable copy
+            uint16_t pid = 0;
+            uint32_t section_crc = 0;        // CRC_32 of the stream's section this was built from
+            int last_cc = -1;                // Last continuity counter sent on the PID
+            Clock::time_point last_sent;     // Stream copy or repeat
+            uint8_t packet[TS_PACKET_SIZE];
+        };
+
+        std::chrono::milliseconds interval_;
+        CachedTable pat_;
+        CachedTable pmt_;
+        ProgramAssociationTable pat_table_;
+        ProgramMapTable pmt_table_;
+        std::vector<uint8_t> section_scratch_;
+        uint64_t rebuilds_ = 0;
+        uint64_t repeats_ = 0;
+
+        void OnTablePacket(CachedTable& table, const uint8_t* packet, Clock::time_point now);
+        bool BuildPacket(CachedTable& table);
+        bool Emit(CachedTable& table, Clock::time_point now, uint8_t* out);
+    };
+
+} // namespace tsduck_transport
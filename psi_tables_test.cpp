@@ -0,0 +1,128 @@
+// Tests for PAT/PMT repetition
+// Feeds the stream's own PAT/PMT packets through PSIRepeater and checks repeats: due only after the
+// interval since the last copy, built once per table version, carrying the stream's last continuity
+// counter with the discontinuity_indicator set, and parsing back to the stream's tables.
+//
+// Build: g++ -std=c++17 -O2 psi_tables_test.cpp psi_tables.cpp ts_crc32.cpp -o psi_tables_test
+
+#include <iostream>
+#include <vector>
+#include <cstring>
+#include <string>
+#include "psi_tables.h"
+
+using namespace tsduck_transport;
+
+namespace {
+
+    const uint16_t PMT_PID = 0x1000;
+
+    bool Check(bool condition, const std::string& what) {
+        std::cout << (condition ? "  PASS  " : "  FAIL  ") << what << std::endl;
+        return condition;
+    }
+
+    std::vector<uint8_t> MakePacket(uint16_t pid, uint8_t cc, const std::vector<uint8_t>& section) {
+        std::vector<uint8_t> packet(TS_PACKET_SIZE, 0xFF);
+        packet[0] = 0x47;
+        packet[1] = static_cast<uint8_t>(0x40 | (pid >> 8));
+        packet[2] = static_cast<uint8_t>(pid);
+        packet[3] = static_cast<uint8_t>(0x10 | (cc & 0x0F));
+        packet[4] = 0x00;
+        memcpy(&packet[5], section.data(), section.size());
+        return packet;
+    }
+
+    std::vector<uint8_t> MakePAT() {
+        ProgramAssociationTable pat;
+        pat.transport_stream_id = 1;
+        pat.programs.push_back({ 1, PMT_PID });
+        std::vector<uint8_t> section;
+        BuildPATSection(pat, section);
+        return section;
+    }
+
+    std::vector<uint8_t> MakePMT(uint8_t version, uint16_t pcr_pid) {
+        ProgramMapTable pmt;
+        pmt.program_number = 1;
+        pmt.version = version;
+        pmt.pcr_pid = pcr_pid;
+        pmt.streams.push_back({ 0x1B, 0x100, {} });
+        pmt.streams.push_back({ 0x0F, 0x101, { 0x0A, 0x04, 'e', 'n', 'g', 0x00 } });
+        std::vector<uint8_t> section;
+        BuildPMTSection(pmt, section);
+        return section;
+    }
+
+} // namespace
+
+int main() {
+    std::cout << "=== PSI repetition tests ===" << std::endl;
+    bool ok = true;
+
+    using Clock = PSIRepeater::Clock;
+    const Clock::time_point start;
+    auto at = [&](int ms) { return start + std::chrono::milliseconds(ms); };
+
+    PSIRepeater repeater(std::chrono::milliseconds(100));
+    uint8_t out[2 * TS_PACKET_SIZE];
+
+    ok = Check(repeater.EmitIfDue(at(1000), out) == 0, "nothing is repeated before the stream's tables are seen") && ok;
+
+    std::vector<uint8_t> pat_packet = MakePacket(PAT_PID, 5, MakePAT());
+    std::vector<uint8_t> pmt_packet = MakePacket(PMT_PID, 9, MakePMT(0, 0x100));
+    repeater.OnPacket(pat_packet.data(), at(0));
+    repeater.OnPacket(pmt_packet.data(), at(0));
+    ok = Check(repeater.HasTables() && repeater.GetRebuilds() == 2, "PAT and PMT learned and built once each") && ok;
+    ok = Check(repeater.GetPMT().streams.size() == 2 && repeater.GetPMT().streams[1].descriptors.size() == 6,
+               "PMT streams and ES descriptors taken from the stream") && ok;
+    ok = Check(repeater.EmitIfDue(at(50), out) == 0, "not due within the interval of the stream's copy") && ok;
+
+    size_t count = repeater.EmitIfDue(at(100), out);
+    ok = Check(count == 2, "PAT and PMT repeated once the interval has passed") && ok;
+    if (count == 2) {
+        const uint8_t* pat_repeat = out;
+        const uint8_t* pmt_repeat = out + TS_PACKET_SIZE;
+        ok = Check((pat_repeat[3] & 0x0F) == 5 && (pmt_repeat[3] & 0x0F) == 9, "repeats carry the last continuity counter of their PID") && ok;
+        ok = Check((pat_repeat[3] & 0x30) == 0x30 && pat_repeat[4] == 1 && (pat_repeat[5] & 0x80), "repeats set the discontinuity_indicator") && ok;
+
+        const uint8_t* section = nullptr;
+        size_t size = 0;
+        ProgramMapTable pmt;
+        ok = Check(FindSectionInPacket(pmt_repeat, section, size) && ParsePMTSection(section, size, pmt) &&
+                   pmt.pcr_pid == 0x100 && pmt.streams.size() == 2, "repeated PMT parses back to the stream's table") && ok;
+    }
+    ok = Check(repeater.EmitIfDue(at(150), out) == 0, "next repeat waits a full interval") && ok;
+
+    // The stream's own copies reset the timer and, unchanged, cost no rebuild
+    pat_packet = MakePacket(PAT_PID, 6, MakePAT());
+    pmt_packet = MakePacket(PMT_PID, 10, MakePMT(0, 0x100));
+    repeater.OnPacket(pat_packet.data(), at(190));
+    repeater.OnPacket(pmt_packet.data(), at(190));
+    ok = Check(repeater.GetRebuilds() == 2, "unchanged tables are not re-parsed or rebuilt") && ok;
+    ok = Check(repeater.EmitIfDue(at(250), out) == 0, "stream copy restarts the interval") && ok;
+    count = repeater.EmitIfDue(at(290), out);
+    ok = Check(count == 2 && (out[3] & 0x0F) == 6 && (out[TS_PACKET_SIZE + 3] & 0x0F) == 10, "repeat follows the new continuity counters") && ok;
+
+    // New PMT version is rebuilt once
+    pmt_packet = MakePacket(PMT_PID, 11, MakePMT(1, 0x100));
+    repeater.OnPacket(pmt_packet.data(), at(300));
+    ok = Check(repeater.GetRebuilds() == 3 && repeater.GetPMT().version == 1, "PMT version change rebuilds the cached packet") && ok;
+
+    // Corrupt copy is ignored; the cached table stays
+    std::vector<uint8_t> corrupt = MakePacket(PMT_PID, 12, MakePMT(2, 0x100));
+    corrupt[10] ^= 0x01;
+    repeater.OnPacket(corrupt.data(), at(310));
+    ok = Check(repeater.GetPMT().version == 1 && repeater.GetRebuilds() == 3, "corrupt PMT does not replace the cached one") && ok;
+
+    // A PMT on the PCR PID cannot carry the discontinuity_indicator without implying a new time base
+    PSIRepeater pcr_pmt_repeater(std::chrono::milliseconds(100));
+    pat_packet = MakePacket(PAT_PID, 0, MakePAT());
+    pmt_packet = MakePacket(PMT_PID, 0, MakePMT(0, PMT_PID));
+    pcr_pmt_repeater.OnPacket(pat_packet.data(), at(0));
+    pcr_pmt_repeater.OnPacket(pmt_packet.data(), at(0));
+    ok = Check(pcr_pmt_repeater.EmitIfDue(at(200), out) == 1, "PMT sharing the PCR PID is passed through but not repeated") && ok;
+
+    std::cout << std::endl << (ok ? "All checks passed" : "SOME CHECKS FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,224 @@
+// Parallel byte-range segment downloads against a loopback origin
+// The origin emulates a long fat path: every response waits a round trip, every new connection a
+// handshake, and each connection sends at most a window per round trip while all of them share the
+// link. A source-quality segment is downloaded over one connection and split over 2, 4 and 6 ranges,
+// comparing download time. Then checks what must not break: the body and the in-order hand-off are
+// byte-exact and handed on from where it lies in the body, a range cut off midway is resumed alone,
+// servers that ignore Range or do not give the size fall back to one request, small segments take one
+// request, a refusing sink stops it all and so does a deadline.
+//
+// Build: g++ -std=c++17 -O2 -pthread range_download_bench.cpp range_fetcher.cpp http_client.cpp http_client_posix.cpp inflater.cpp loopback_server.cpp -o range_download_bench
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <cstdlib>
+#include "range_fetcher.h"
+#include "loopback_server.h"
+
+using namespace tardsplaya;
+
+namespace {
+
+    const int RTT_MS = 80;
+    const int HANDSHAKE_MS = 2 * RTT_MS;                        // TCP plus TLS 1.3
+    const uint64_t WINDOW_BYTES = 128 * 1024;                   // Per connection and round trip
+    const uint64_t LINK_BYTES_PER_SECOND = 6 * 1024 * 1024;     // About 50 Mbit/s
+    const size_t SEGMENT_BYTES = 6 * 1024 * 1024;               // 1080p60 source, 2 s at 24 Mbit/s
+    const size_t SMALL_BYTES = 300 * 1024;
+
+    bool Check(bool condition, const std::string& what) {
+        std::cout << (condition ? "  PASS  " : "  FAIL  ") << what << std::endl;
+        return condition;
+    }
+
+    uint8_t BodyByte(size_t index) {
+        return static_cast<uint8_t>((index * 2654435761u) >> 13);
+    }
+
+    bool BodyOk(const std::vector<uint8_t>& body, size_t size) {
+        if (body.size() != size) {
+            return false;
+        }
+        for (size_t i = 0; i < size; ++i) {
+            if (body[i] != BodyByte(i)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::mutex cut_mutex;
+    std::map<std::string, int> cut_served;      // Requests per range end of /cut, to cut off only the first
+
+    // Routes of the loopback origin
+    //   /segment          SEGMENT_BYTES, honours Range
+    //   /small            SMALL_BYTES, honours Range
+    //   /norange          SEGMENT_BYTES, ignores Range
+    //   /nosize           SEGMENT_BYTES, Content-Range without the total
+    //   /cut              like /segment, but the first answer to a range in the second half breaks off halfway
+    void Respond(const LoopbackRequest& request, LoopbackResponse& response) {
+        const std::string& path = request.path;
+        size_t size = path == "/small" ? SMALL_BYTES : SEGMENT_BYTES;
+        const std::string* range = path == "/norange" ? nullptr : request.FindHeader("range");
+        size_t first = 0, last = size - 1;
+        if (range && range->compare(0, 6, "bytes=") == 0) {
+            char* end = nullptr;
+            first = std::strtoull(range->c_str() + 6, &end, 10);
+            if (*end == '-' && end[1] != '\0') {
+                last = std::min<size_t>(std::strtoull(end + 1, nullptr, 10), size - 1);
+            }
+            if (first > last) {
+                response.status = 416;
+                return;
+            }
+            response.status = 206;
+            response.headers.emplace_back("Content-Range", "bytes " + std::to_string(first) + "-" + std::to_string(last) + "/" +
+                                          (path == "/nosize" ? std::string("*") : std::to_string(size)));
+        }
+        response.body.resize(last + 1 - first);
+        for (size_t i = first; i <= last; ++i) {
+            response.body[i - first] = static_cast<char>(BodyByte(i));
+        }
+        if (path == "/cut" && first > size / 2) {
+            std::lock_guard<std::mutex> lock(cut_mutex);
+            if (cut_served[std::to_string(last)]++ == 0) {
+                response.abort_after = response.body.size() / 2;
+            }
+        }
+    }
+
+    struct Run {
+        double seconds = 0.0;
+        bool ok = false;
+        RangeFetcher::Stats stats;
+        int requests = 0;
+        uint64_t bytes_sent = 0;
+    };
+
+    // One fetcher, downloads of the same path; the last is timed. time_limit 0 for no deadline.
+    Run Download(LoopbackServer& server, const std::string& path, size_t connections, int downloads = 1,
+                 const HttpBodySink* sink = nullptr, std::vector<uint8_t>* out = nullptr,
+                 std::chrono::milliseconds time_limit = std::chrono::milliseconds(0)) {
+        HttpClient::Config client_config;
+        client_config.retry_delay = std::chrono::milliseconds(50);
+        HttpClient client(CreatePlatformHttpBackend(), client_config);
+        RangeFetcherConfig config;
+        config.connections = connections;
+        RangeFetcher fetcher(client, config);
+        Run run;
+        std::vector<uint8_t> body;
+        for (int i = 0; i < downloads; ++i) {
+            server.ResetCounters();
+            auto start = std::chrono::steady_clock::now();
+            auto deadline = time_limit.count() > 0 ? start + time_limit : std::chrono::steady_clock::time_point::max();
+            run.ok = fetcher.Get(server.Url(path), body, nullptr, sink, deadline);
+            run.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        run.stats = fetcher.GetStats();
+        run.requests = server.requests.load();
+        run.bytes_sent = server.bytes_sent.load();
+        if (out) {
+            *out = std::move(body);
+        }
+        return run;
+    }
+
+} // namespace
+
+int main() {
+    std::cout << "=== Parallel byte-range downloads ===" << std::endl;
+    bool ok = true;
+
+    LoopbackServer server(Respond);
+    server.rtt_ms = RTT_MS;
+    server.handshake_ms = HANDSHAKE_MS;
+    server.connection_bytes_per_second = WINDOW_BYTES * 1000 / RTT_MS;
+    server.total_bytes_per_second = LINK_BYTES_PER_SECOND;
+    if (!Check(server.Start(), "loopback server listening")) {
+        return 1;
+    }
+
+    std::cout << std::endl << SEGMENT_BYTES / (1024 * 1024) << " MB segment, " << RTT_MS << " ms round trip, "
+              << WINDOW_BYTES / 1024 << " KB window per connection (" << std::fixed << std::setprecision(1)
+              << WINDOW_BYTES * 8.0 / RTT_MS / 1000.0 << " Mbit/s), " << LINK_BYTES_PER_SECOND * 8.0 / 1e6 << " Mbit/s link" << std::endl;
+    std::cout << "  (ranges: second download of each fetcher, sized from the first)" << std::endl;
+
+    std::vector<uint8_t> body;
+    Run single = Download(server, "/segment", 1, 1, nullptr, &body);
+    ok = Check(single.ok && BodyOk(body, SEGMENT_BYTES), "one connection: body complete") && ok;
+    std::vector<Run> split;
+    for (size_t connections : { 2, 4, 6 }) {
+        split.push_back(Download(server, "/segment", connections, 2, nullptr, &body));
+        ok = Check(split.back().ok && BodyOk(body, SEGMENT_BYTES), std::to_string(connections) + " ranges: body complete") && ok;
+    }
+    std::cout << std::endl << std::left << std::setw(18) << "  connections" << std::right << std::setw(10) << "seconds"
+              << std::setw(12) << "Mbit/s" << std::setw(10) << "requests" << std::endl;
+    auto print = [](const std::string& name, const Run& run) {
+        std::cout << std::left << std::setw(18) << ("  " + name) << std::right << std::setprecision(2) << std::setw(10) << run.seconds
+                  << std::setprecision(1) << std::setw(12) << SEGMENT_BYTES * 8.0 / run.seconds / 1e6 << std::setw(10) << run.requests << std::endl;
+    };
+    print("1", single);
+    print("2", split[0]);
+    print("4", split[1]);
+    print("6", split[2]);
+    std::cout << std::endl;
+    ok = Check(split[1].seconds * 2.5 < single.seconds, "4 ranges download at least 2.5x faster than one connection") && ok;
+    ok = Check(split[1].requests == 4 && split[1].stats.split_downloads == 2, "4 ranges: the leading range and three more") && ok;
+
+    // The in-order hand-off sees exactly the body, each stretch where it lies in it, right after the one before
+    std::vector<uint8_t> handed;
+    const uint8_t* handed_end = nullptr;
+    bool in_place = true;
+    HttpBodySink collect = [&](const uint8_t* data, size_t size) {
+        in_place = in_place && (!handed_end || data == handed_end);
+        handed_end = data + size;
+        handed.insert(handed.end(), data, data + size);
+        return true;
+    };
+    Run progressive = Download(server, "/segment", 4, 1, &collect, &body);
+    ok = Check(progressive.ok && handed == body && BodyOk(handed, SEGMENT_BYTES), "bytes handed on in order, each once") && ok;
+    ok = Check(in_place, "bytes handed on from the body itself") && ok;
+
+    auto start = std::chrono::steady_clock::now();
+    Run late = Download(server, "/segment", 4, 1, nullptr, &body, std::chrono::milliseconds(500));
+    double late_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    ok = Check(!late.ok && late.stats.late == 1 && late_seconds < 1.0, "deadline passed midway: every range given up at once") && ok;
+
+    // Faults and servers without range support
+    server.connection_bytes_per_second = 0;
+    server.total_bytes_per_second = 0;
+    Run cut = Download(server, "/cut", 4, 1, nullptr, &body);
+    ok = Check(cut.ok && BodyOk(body, SEGMENT_BYTES) && cut.stats.range_retries == 1, "range cut off midway: resumed, body complete") && ok;
+    ok = Check(cut.bytes_sent < SEGMENT_BYTES + SEGMENT_BYTES / 8, "only the missing part of that range sent again") && ok;
+
+    Run norange = Download(server, "/norange", 4, 1, nullptr, &body);
+    ok = Check(norange.ok && BodyOk(body, SEGMENT_BYTES) && norange.requests == 1 && norange.stats.unsupported == 1,
+               "Range ignored: the first answer is the whole segment") && ok;
+    handed.clear();
+    handed_end = nullptr;
+    in_place = true;
+    Run whole = Download(server, "/norange", 4, 1, &collect, &body);
+    ok = Check(whole.ok && handed == body && in_place, "Range ignored: handed on from the body too") && ok;
+    Run nosize = Download(server, "/nosize", 4, 1, nullptr, &body);
+    ok = Check(nosize.ok && BodyOk(body, SEGMENT_BYTES) && nosize.stats.unsupported == 1, "size not given: one plain request") && ok;
+    Run small = Download(server, "/small", 4, 1, nullptr, &body);
+    ok = Check(small.ok && BodyOk(body, SMALL_BYTES) && small.requests == 1 && small.stats.split_downloads == 0,
+               "segment smaller than a range: one request") && ok;
+
+    size_t taken = 0;
+    HttpBodySink refuse = [&](const uint8_t*, size_t size) {
+        taken += size;
+        return taken < SEGMENT_BYTES / 8;
+    };
+    Run refused = Download(server, "/segment", 4, 1, &refuse, &body);
+    ok = Check(!refused.ok && refused.stats.failures == 1, "refusing sink: download abandoned") && ok;
+
+    server.Stop();
+    std::cout << std::endl << (ok ? "All checks passed" : "SOME CHECKS FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
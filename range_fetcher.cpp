@@ -0,0 +1,368 @@
+#include "range_fetcher.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+namespace tardsplaya {
+
+namespace {
+
+    const uint64_t UNKNOWN_SIZE = UINT64_MAX;
+
+    bool Cancelled(std::atomic<bool>* cancel_token) {
+        return cancel_token && cancel_token->load();
+    }
+
+    void SleepCancellable(std::chrono::milliseconds delay, std::atomic<bool>* cancel_token) {
+        const auto deadline = std::chrono::steady_clock::now() + delay;
+        while (!Cancelled(cancel_token) && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::min(std::chrono::milliseconds(50), delay));
+        }
+    }
+
+    // "bytes first-last/total", total UNKNOWN_SIZE for "*"
+    bool ParseContentRange(const std::string& value, uint64_t& first, uint64_t& last, uint64_t& total) {
+        if (value.compare(0, 6, "bytes ") != 0) {
+            return false;
+        }
+        const char* text = value.c_str() + 6;
+        char* end = nullptr;
+        first = std::strtoull(text, &end, 10);
+        if (end == text || *end != '-') {
+            return false;
+        }
+        text = end + 1;
+        last = std::strtoull(text, &end, 10);
+        if (end == text || *end != '/' || last < first) {
+            return false;
+        }
+        text = end + 1;
+        if (*text == '*') {
+            total = UNKNOWN_SIZE;
+            return true;
+        }
+        total = std::strtoull(text, &end, 10);
+        return end != text && last < total;
+    }
+
+    // Header for bytes [first, end)
+    HttpHeaders RangeHeader(uint64_t first, uint64_t end) {
+        return { { "Range", "bytes=" + std::to_string(first) + "-" + std::to_string(end - 1) } };
+    }
+
+    // A whole-body answer written into body: sized once from its Content-Length, each arrival passed on from
+    // where it lies. Without a length body grows as it arrives, so the sink is given it once complete.
+    class WholeBody {
+    public:
+        WholeBody(std::vector<uint8_t>& body, const HttpBodySink* sink) : body_(body), sink_(sink) {}
+
+        bool Write(const HttpResponse& response, const uint8_t* data, size_t size) {
+            if (!started_) {
+                started_ = true;
+                const std::string* content_length = response.FindHeader("content-length");
+                if (content_length) {
+                    body_.resize(static_cast<size_t>(std::strtoull(content_length->c_str(), nullptr, 10)));
+                    sized_ = true;
+                }
+            }
+            if (!sized_) {
+                body_.insert(body_.end(), data, data + size);
+                return true;
+            }
+            if (size > body_.size() - written_) {
+                return false;       // Longer than announced
+            }
+            std::memcpy(body_.data() + written_, data, size);
+            written_ += size;
+            return !sink_ || (*sink_)(body_.data() + written_ - size, size);
+        }
+
+        // Once the response is over: whether all of the body is in place and with the sink
+        bool Finish() {
+            if (!sized_) {
+                return !body_.empty() && (!sink_ || (*sink_)(body_.data(), body_.size()));
+            }
+            return written_ > 0 && written_ == body_.size();
+        }
+
+    private:
+        std::vector<uint8_t>& body_;
+        const HttpBodySink* sink_;
+        bool started_ = false;
+        bool sized_ = false;
+        size_t written_ = 0;
+    };
+
+    // Ranges of one download writing into one buffer, and the in-order hand-off of what they have written
+    class Assembly {
+    public:
+        Assembly(std::vector<uint8_t>& body, const HttpBodySink* sink) : body_(body), sink_(sink) {}
+
+        void AddRange(uint64_t first, uint64_t end) {
+            first_.push_back(first);
+            end_.push_back(end);
+            received_.push_back(0);
+        }
+
+        size_t GetRangeCount() const { return first_.size(); }
+        uint64_t GetFirst(size_t range) const { return first_[range]; }
+        uint64_t GetEnd(size_t range) const { return end_[range]; }
+
+        // size more bytes written at the end of what range has received; false once the download is abandoned
+        bool Advance(size_t range, size_t size) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            received_[range] += size;
+            uint64_t contiguous = delivered_;
+            while (next_range_ < first_.size()) {
+                contiguous = first_[next_range_] + received_[next_range_];
+                if (contiguous < end_[next_range_]) {
+                    break;
+                }
+                next_range_++;
+            }
+            if (sink_ && !abandoned_ && contiguous > delivered_) {
+                abandoned_ = !(*sink_)(body_.data() + delivered_, static_cast<size_t>(contiguous - delivered_));
+            }
+            delivered_ = std::max(delivered_, contiguous);
+            return !abandoned_;
+        }
+
+        void Abandon() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            abandoned_ = true;
+        }
+
+        bool IsAbandoned() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return abandoned_;
+        }
+
+    private:
+        std::vector<uint8_t>& body_;
+        const HttpBodySink* sink_;
+        std::mutex mutex_;
+        std::vector<uint64_t> first_;
+        std::vector<uint64_t> end_;         // Exclusive
+        std::vector<uint64_t> received_;
+        size_t next_range_ = 0;             // First range not complete
+        uint64_t delivered_ = 0;
+        bool abandoned_ = false;
+    };
+
+} // namespace
+
+RangeFetcher::RangeFetcher(HttpClient& client, const Config& config) : client_(client), config_(config) {
+    config_.connections = std::max<size_t>(1, config_.connections);
+    config_.min_range_bytes = std::max<uint64_t>(1, config_.min_range_bytes);
+    config_.range_attempts = std::max(1, config_.range_attempts);
+}
+
+bool RangeFetcher::Get(const std::wstring& url, std::vector<uint8_t>& body, std::atomic<bool>* cancel_token, const HttpBodySink* sink,
+                       std::chrono::steady_clock::time_point deadline) {
+    return Get(NarrowUrl(url), body, cancel_token, sink, deadline);
+}
+
+bool RangeFetcher::Get(const std::string& url, std::vector<uint8_t>& body, std::atomic<bool>* cancel_token, const HttpBodySink* sink,
+                       std::chrono::steady_clock::time_point deadline) {
+    if (deadline == std::chrono::steady_clock::time_point::max()) {
+        return Download(url, body, cancel_token, sink);
+    }
+
+    // The download runs on a token of its own, set by the caller's or when the deadline passes
+    std::atomic<bool> stop{false};
+    std::mutex watch_mutex;
+    std::condition_variable watch_changed;
+    bool finished = false;
+    bool late = false;
+    std::thread watchdog([&] {
+        std::unique_lock<std::mutex> lock(watch_mutex);
+        while (!finished && !Cancelled(cancel_token)) {
+            auto now = std::chrono::steady_clock::now();
+            if (now >= deadline) {
+                late = true;
+                break;
+            }
+            watch_changed.wait_until(lock, std::min(deadline, now + std::chrono::milliseconds(50)));
+        }
+        stop = true;
+    });
+    bool ok = Download(url, body, &stop, sink);
+    {
+        std::lock_guard<std::mutex> lock(watch_mutex);
+        finished = true;
+    }
+    watch_changed.notify_all();
+    watchdog.join();
+    if (late && !ok) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.late++;
+    }
+    return ok;
+}
+
+bool RangeFetcher::GetWhole(const std::string& url, std::vector<uint8_t>& body, std::atomic<bool>* cancel_token, const HttpBodySink* sink) {
+    body.clear();
+    HttpResponse response;
+    WholeBody whole(body, sink);
+    HttpBodySink write = [&](const uint8_t* data, size_t size) { return whole.Write(response, data, size); };
+    return client_.Get(url, write, cancel_token, &response) && whole.Finish();
+}
+
+bool RangeFetcher::Download(const std::string& url, std::vector<uint8_t>& body, std::atomic<bool>* cancel_token, const HttpBodySink* sink) {
+    body.clear();
+    if (config_.connections == 1) {
+        bool ok = GetWhole(url, body, cancel_token, sink);
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.downloads += ok ? 1 : 0;
+        stats_.failures += ok ? 0 : 1;
+        stats_.bytes += ok ? body.size() : 0;
+        return ok;
+    }
+
+    // The leading range is a share of the last segment's size: segments of a stream are much alike
+    uint64_t lead = std::max(config_.min_range_bytes, size_hint_.load() / config_.connections);
+    HttpHeaders lead_header = RangeHeader(0, lead);
+
+    enum class Mode { UNDECIDED, WHOLE, RANGES, UNUSABLE };
+    Mode mode = Mode::UNDECIDED;
+    Assembly assembly(body, sink);
+    std::vector<std::thread> workers;
+    std::vector<char> range_ok;             // One element per range, each written by its own thread
+    uint64_t lead_received = 0;
+    uint64_t retries = 0;
+    std::mutex retries_mutex;
+
+    // One range after the leading one, resumed from where a failed attempt stopped
+    auto fetch_range = [&](size_t range) {
+        const uint64_t first = assembly.GetFirst(range);
+        const uint64_t end = assembly.GetEnd(range);
+        uint64_t received = 0;
+        for (int attempt = 0; attempt < config_.range_attempts && received < end - first; ++attempt) {
+            if (attempt > 0) {
+                {
+                    std::lock_guard<std::mutex> lock(retries_mutex);
+                    retries++;
+                }
+                SleepCancellable(client_.GetConfig().retry_delay, cancel_token);
+            }
+            if (Cancelled(cancel_token) || assembly.IsAbandoned()) {
+                break;
+            }
+            HttpHeaders header = RangeHeader(first + received, end);
+            HttpResponse response;
+            bool checked = false;
+            bool mismatch = false;
+            HttpBodySink write = [&](const uint8_t* data, size_t size) {
+                if (!checked) {
+                    uint64_t answer_first = 0, answer_last = 0, answer_total = 0;
+                    const std::string* content_range = response.FindHeader("content-range");
+                    mismatch = response.status != 206 || !content_range ||
+                               !ParseContentRange(*content_range, answer_first, answer_last, answer_total) || answer_first != first + received;
+                    checked = true;
+                    if (mismatch) {
+                        return false;
+                    }
+                }
+                size = static_cast<size_t>(std::min<uint64_t>(size, end - first - received));
+                std::memcpy(body.data() + first + received, data, size);
+                received += size;
+                return assembly.Advance(range, size);
+            };
+            client_.Get(url, write, cancel_token, &response, 1, &header);
+            if (mismatch) {
+                break;      // Asking again would get the same answer
+            }
+        }
+        range_ok[range] = received == end - first;
+        if (!range_ok[range]) {
+            assembly.Abandon();
+        }
+    };
+
+    // Decides on the first bytes of the leading response, then writes them
+    HttpResponse lead_response;
+    WholeBody whole(body, sink);
+    HttpBodySink lead_sink = [&](const uint8_t* data, size_t size) {
+        if (mode == Mode::UNDECIDED) {
+            if (lead_response.status == 206) {
+                uint64_t first = 0, last = 0, total = 0;
+                const std::string* content_range = lead_response.FindHeader("content-range");
+                if (!content_range || !ParseContentRange(*content_range, first, last, total) || first != 0 || total == UNKNOWN_SIZE) {
+                    mode = Mode::UNUSABLE;
+                    return false;
+                }
+                // The whole segment in one allocation; the rest split evenly over the other connections
+                body.resize(static_cast<size_t>(total));
+                assembly.AddRange(0, last + 1);
+                uint64_t rest = total - (last + 1);
+                if (rest > 0) {
+                    uint64_t count = std::min<uint64_t>(config_.connections - 1, (rest + config_.min_range_bytes - 1) / config_.min_range_bytes);
+                    uint64_t share = (rest + count - 1) / count;
+                    for (uint64_t first_byte = last + 1; first_byte < total; first_byte += share) {
+                        assembly.AddRange(first_byte, std::min(total, first_byte + share));
+                    }
+                }
+                range_ok.assign(assembly.GetRangeCount(), 0);
+                mode = Mode::RANGES;
+                for (size_t range = 1; range < assembly.GetRangeCount(); ++range) {
+                    workers.emplace_back(fetch_range, range);
+                }
+            } else {
+                // Range ignored: this is the whole segment
+                mode = Mode::WHOLE;
+            }
+        }
+        if (mode == Mode::WHOLE) {
+            return whole.Write(lead_response, data, size);
+        }
+        size = static_cast<size_t>(std::min<uint64_t>(size, assembly.GetEnd(0) - lead_received));
+        std::memcpy(body.data() + lead_received, data, size);
+        lead_received += size;
+        return assembly.Advance(0, size);
+    };
+    bool lead_ok = client_.Get(url, lead_sink, cancel_token, &lead_response, 0, &lead_header);
+
+    if (!lead_ok) {
+        assembly.Abandon();
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    bool ok = false;
+    bool unsupported = false;
+    if (mode == Mode::UNUSABLE && !Cancelled(cancel_token)) {
+        unsupported = true;
+        ok = GetWhole(url, body, cancel_token, sink);
+    } else if (mode == Mode::WHOLE) {
+        unsupported = true;
+        ok = lead_ok && whole.Finish();
+    } else if (mode == Mode::RANGES) {
+        ok = lead_ok && lead_received == assembly.GetEnd(0) &&
+             std::all_of(range_ok.begin() + 1, range_ok.end(), [](char range) { return range != 0; }) && !assembly.IsAbandoned();
+    }
+    if (ok) {
+        size_hint_ = body.size();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.downloads += ok ? 1 : 0;
+    stats_.failures += ok ? 0 : 1;
+    stats_.bytes += ok ? body.size() : 0;
+    stats_.unsupported += unsupported ? 1 : 0;
+    stats_.range_retries += retries;
+    if (mode == Mode::RANGES && assembly.GetRangeCount() > 1) {
+        stats_.split_downloads++;
+        stats_.ranges += assembly.GetRangeCount() - 1;
+    }
+    return ok;
+}
+
+RangeFetcher::Stats RangeFetcher::GetStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+} // namespace tardsplaya
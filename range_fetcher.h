@@ -0,0 +1,77 @@
+#pragma once
+// Segment downloads split into parallel byte ranges
+// One TCP connection carries at most its window per round trip, which on a long path is less than the
+// link: an 8 MB source-quality segment then takes several segment durations on one connection. The
+// first request asks for a leading range and learns the segment size from its Content-Range; while
+// its body arrives, the rest of the segment is requested as further ranges on other pooled
+// connections. All of them write into one buffer allocated at the full size, and the bytes are handed
+// on in order as the leading ranges complete. A range that fails is retried from where it stopped,
+// alone. Servers that ignore Range just answer the first request with the whole segment. A download
+// given a deadline is abandoned when it passes, its requests cancelled wherever they are.
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+#include "http_client.h"
+
+namespace tardsplaya {
+
+    struct RangeFetcherConfig {
+        size_t connections = 4;                     // Ranges of one segment downloaded at once
+        uint64_t min_range_bytes = 1024 * 1024;     // Smaller segments take one request; ranges are not split below this
+        int range_attempts = 3;                     // Per range, each resuming where the previous one stopped
+    };
+
+    class RangeFetcher {
+    public:
+        using Config = RangeFetcherConfig;
+
+        struct Stats {
+            uint64_t downloads = 0;
+            uint64_t failures = 0;
+            uint64_t split_downloads = 0;       // Downloaded as more than one range
+            uint64_t ranges = 0;                // Range requests after the first, over all downloads
+            uint64_t range_retries = 0;         // Ranges resumed after a failed attempt
+            uint64_t unsupported = 0;           // Answered with the whole body or without a known size
+            uint64_t bytes = 0;
+            uint64_t late = 0;                  // Abandoned at their deadline
+        };
+
+        explicit RangeFetcher(HttpClient& client, const Config& config = Config());
+
+        RangeFetcher(const RangeFetcher&) = delete;
+        RangeFetcher& operator=(const RangeFetcher&) = delete;
+
+        // Download url into body, allocated once the size is known. With a sink, the bytes also go to it in
+        // order as soon as everything before them has arrived; a refusing sink ends the download. The sink is
+        // given them where they lie in body, which is sized before the first and not moved after, so its
+        // owner may read them from body while the rest arrives. An answer of unknown length grows body and
+        // reaches the sink whole, once complete.
+        bool Get(const std::string& url, std::vector<uint8_t>& body, std::atomic<bool>* cancel_token = nullptr,
+                 const HttpBodySink* sink = nullptr,
+                 std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max());
+        bool Get(const std::wstring& url, std::vector<uint8_t>& body, std::atomic<bool>* cancel_token = nullptr,
+                 const HttpBodySink* sink = nullptr,
+                 std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max());
+
+        Stats GetStats() const;
+
+    private:
+        HttpClient& client_;
+        Config config_;
+        std::atomic<uint64_t> size_hint_{0};    // Size of the last segment; sizes the leading range of the next
+        mutable std::mutex mutex_;
+        Stats stats_;
+
+        bool Download(const std::string& url, std::vector<uint8_t>& body, std::atomic<bool>* cancel_token, const HttpBodySink* sink);
+
+        // Plain GET, for servers that answer a range without a usable Content-Range
+        bool GetWhole(const std::string& url, std::vector<uint8_t>& body, std::atomic<bool>* cancel_token, const HttpBodySink* sink);
+    };
+
+} // namespace tardsplaya
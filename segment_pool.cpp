@@ -0,0 +1,132 @@
+#include "segment_pool.h"
+#include <algorithm>
+#include <mutex>
+
+namespace tsduck_transport {
+
+namespace {
+
+    std::atomic<size_t> g_global_limit{SegmentPool::DEFAULT_GLOBAL_LIMIT};
+    std::atomic<size_t> g_global_idle_bytes{0};
+
+    // Reserve the global budget for one idle buffer, or refuse without taking any
+    bool ReserveGlobal(size_t bytes) {
+        size_t current = g_global_idle_bytes.load();
+        do {
+            if (current + bytes > g_global_limit.load()) {
+                return false;
+            }
+        } while (!g_global_idle_bytes.compare_exchange_weak(current, current + bytes));
+        return true;
+    }
+
+} // namespace
+
+struct SegmentPool::State {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<std::vector<uint8_t>>> idle;
+    size_t max_buffers = DEFAULT_MAX_BUFFERS;
+    size_t sizes[SIZE_HISTORY] = {};     // Recent segment sizes, circular
+    size_t next_size = 0;
+    Stats stats;
+
+    ~State() {
+        for (const auto& buffer : idle) {
+            g_global_idle_bytes -= buffer->capacity();
+        }
+    }
+
+    // Largest recent segment plus headroom for size variation and spliced-in tables
+    void UpdateTarget() {
+        size_t largest = *std::max_element(sizes, sizes + SIZE_HISTORY);
+        stats.target_capacity = largest + largest / 8 + 2 * TS_PACKET_SIZE;
+    }
+
+    void Return(std::vector<uint8_t>* raw) {
+        std::unique_ptr<std::vector<uint8_t>> buffer(raw);
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.in_use--;
+
+        // Buffers from before a drop in quality would hold memory the stream no longer needs
+        size_t capacity = buffer->capacity();
+        bool oversized = stats.target_capacity > 0 && capacity > 2 * stats.target_capacity;
+        if (idle.size() >= max_buffers || oversized || !ReserveGlobal(capacity)) {
+            stats.evictions++;
+            return;
+        }
+        buffer->clear();
+        idle.push_back(std::move(buffer));
+        stats.idle = idle.size();
+        stats.idle_bytes += capacity;
+        stats.idle_bytes_high_water = std::max(stats.idle_bytes_high_water, stats.idle_bytes);
+    }
+};
+
+void SegmentPool::Recycler::operator()(std::vector<uint8_t>* buffer) const {
+    state->Return(buffer);
+}
+
+SegmentPool::SegmentPool(size_t max_buffers) : state_(std::make_shared<State>()) {
+    state_->max_buffers = max_buffers;
+}
+
+SegmentPool::PooledSegment SegmentPool::Acquire() {
+    std::unique_ptr<std::vector<uint8_t>> buffer;
+    size_t target = 0;
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        Stats& stats = state_->stats;
+        target = stats.target_capacity;
+        if (!state_->idle.empty()) {
+            buffer = std::move(state_->idle.back());
+            state_->idle.pop_back();
+            stats.idle = state_->idle.size();
+            stats.idle_bytes -= buffer->capacity();
+            g_global_idle_bytes -= buffer->capacity();
+        }
+        if (buffer && buffer->capacity() >= target) {
+            stats.hits++;
+        } else {
+            stats.misses++;
+        }
+        stats.in_use++;
+        stats.in_use_high_water = std::max(stats.in_use_high_water, stats.in_use);
+    }
+
+    // Allocation happens outside the lock; the router thread may be returning a buffer meanwhile
+    if (!buffer) {
+        buffer.reset(new std::vector<uint8_t>());
+    }
+    buffer->reserve(target);
+    return PooledSegment(buffer.release(), Recycler{ state_ });
+}
+
+SegmentBuffer SegmentPool::Share(PooledSegment&& segment) {
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        state_->sizes[state_->next_size] = segment->size();
+        state_->next_size = (state_->next_size + 1) % SIZE_HISTORY;
+        state_->UpdateTarget();
+    }
+    return SegmentBuffer(std::move(segment));
+}
+
+void SegmentPool::SetMaxBuffers(size_t max_buffers) {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->max_buffers = max_buffers;
+}
+
+SegmentPool::Stats SegmentPool::GetStats() const {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    return state_->stats;
+}
+
+void SegmentPool::SetGlobalLimit(size_t bytes) {
+    g_global_limit = bytes;
+}
+
+size_t SegmentPool::GetGlobalIdleBytes() {
+    return g_global_idle_bytes.load();
+}
+
+} // namespace tsduck_transport
@@ -0,0 +1,64 @@
+#pragma once
+// Recycled segment download buffers for the transport stream router
+// Each stream keeps a few download buffers sized from the segments it has seen. A buffer goes back to
+// its pool when the last packet view into it has been written, instead of being freed and allocated
+// again for the next segment, so long sessions do not churn multi-megabyte blocks through the heap.
+// The bytes kept idle across all pools are capped process-wide.
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <memory>
+#include <atomic>
+
+#include "ts_packet.h"
+
+namespace tsduck_transport {
+
+    class SegmentPool {
+    public:
+        static constexpr size_t DEFAULT_MAX_BUFFERS = 4;                     // Idle buffers kept per stream
+        static constexpr size_t DEFAULT_GLOBAL_LIMIT = 64 * 1024 * 1024;    // Idle bytes across all pools
+        static constexpr size_t SIZE_HISTORY = 8;                            // Segments the target size is taken from
+
+        struct Stats {
+            uint64_t hits = 0;               // Acquires served from an idle buffer large enough
+            uint64_t misses = 0;             // Acquires that allocated or grew a buffer
+            uint64_t evictions = 0;          // Returned buffers freed: pool full, over the global limit or oversized
+            size_t in_use = 0;               // Buffers downloading or queued in the buffer
+            size_t in_use_high_water = 0;
+            size_t idle = 0;
+            size_t idle_bytes = 0;
+            size_t idle_bytes_high_water = 0;
+            size_t target_capacity = 0;      // Capacity new buffers are given
+        };
+
+        struct State;
+
+        // Returns a buffer to its pool; shared by the acquire handle and the SegmentBuffer built from it
+        struct Recycler {
+            std::shared_ptr<State> state;
+            void operator()(std::vector<uint8_t>* buffer) const;
+        };
+        using PooledSegment = std::unique_ptr<std::vector<uint8_t>, Recycler>;
+
+        explicit SegmentPool(size_t max_buffers = DEFAULT_MAX_BUFFERS);
+
+        // Empty buffer with capacity for a typical segment of this stream. Dropping the handle returns it.
+        PooledSegment Acquire();
+
+        // Hand a filled buffer to the packet pipeline; it comes back when the last view is released
+        SegmentBuffer Share(PooledSegment&& segment);
+
+        void SetMaxBuffers(size_t max_buffers);
+        Stats GetStats() const;
+
+        // Process-wide cap on idle bytes; buffers returned beyond it are freed
+        static void SetGlobalLimit(size_t bytes);
+        static size_t GetGlobalIdleBytes();
+
+    private:
+        std::shared_ptr<State> state_;   // Outlives the pool while buffers are still queued
+    };
+
+} // namespace tsduck_transport
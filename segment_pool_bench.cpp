@@ -0,0 +1,196 @@
+// Heap traffic of segment download buffers: new vector per segment vs. SegmentPool
+// Downloads are modelled as the WinHTTP read loop in HttpGetBinary (resize by each chunk the
+// server has available) into ~1.5 MB segments of varying size, with three segments queued in the
+// buffer behind the download. Global operator new is counted to show allocations and bytes per
+// segment; later runs check that a drop in quality shrinks the pool and that several streams stay
+// under the global idle limit.
+//
+// Build: g++ -std=c++17 -O2 segment_pool_bench.cpp segment_pool.cpp -o segment_pool_bench
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <deque>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include "segment_pool.h"
+
+using namespace tsduck_transport;
+
+namespace {
+
+    size_t g_allocations = 0;
+    size_t g_allocated_bytes = 0;
+
+} // namespace
+
+void* operator new(size_t size) {
+    g_allocations++;
+    g_allocated_bytes += size;
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+    const size_t CHUNK = 16 * 1024;    // What WinHttpQueryDataAvailable typically reports at a time
+    const size_t QUEUED = 3;           // Segments held by the buffer behind the download
+    const int SEGMENTS = 400;
+
+    bool Check(bool condition, const std::string& what) {
+        std::cout << (condition ? "  PASS  " : "  FAIL  ") << what << std::endl;
+        return condition;
+    }
+
+    // The read loop of HttpGetBinary
+    void Download(std::vector<uint8_t>& out, size_t size, uint8_t fill) {
+        out.clear();
+        while (out.size() < size) {
+            size_t previous = out.size();
+            out.resize(previous + std::min(CHUNK, size - previous));
+            memset(out.data() + previous, fill, out.size() - previous);
+        }
+    }
+
+    std::vector<size_t> SegmentSizes(int count, size_t mean, uint32_t seed) {
+        std::mt19937 random(seed);
+        std::uniform_real_distribution<double> spread(0.85, 1.15);
+        std::vector<size_t> sizes;
+        for (int i = 0; i < count; ++i) {
+            sizes.push_back(static_cast<size_t>(mean * spread(random)) / TS_PACKET_SIZE * TS_PACKET_SIZE);
+        }
+        return sizes;
+    }
+
+    struct RunResult {
+        double allocations_per_segment = 0.0;
+        double mb_per_segment = 0.0;
+        double us_per_segment = 0.0;
+    };
+
+    RunResult RunUnpooled(const std::vector<size_t>& sizes) {
+        std::deque<SegmentBuffer> queued;
+        size_t allocations = g_allocations;
+        size_t bytes = g_allocated_bytes;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < sizes.size(); ++i) {
+            std::vector<uint8_t> segment_data;
+            Download(segment_data, sizes[i], static_cast<uint8_t>(i));
+            queued.push_back(std::make_shared<const std::vector<uint8_t>>(std::move(segment_data)));
+            if (queued.size() > QUEUED) {
+                queued.pop_front();
+            }
+        }
+        queued.clear();
+        RunResult result;
+        result.us_per_segment = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / sizes.size();
+        result.allocations_per_segment = static_cast<double>(g_allocations - allocations) / sizes.size();
+        result.mb_per_segment = (g_allocated_bytes - bytes) / 1048576.0 / sizes.size();
+        return result;
+    }
+
+    RunResult RunPooled(SegmentPool& pool, const std::vector<size_t>& sizes) {
+        std::deque<SegmentBuffer> queued;
+        size_t allocations = g_allocations;
+        size_t bytes = g_allocated_bytes;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < sizes.size(); ++i) {
+            SegmentPool::PooledSegment segment_data = pool.Acquire();
+            Download(*segment_data, sizes[i], static_cast<uint8_t>(i));
+            queued.push_back(pool.Share(std::move(segment_data)));
+            if (queued.size() > QUEUED) {
+                queued.pop_front();
+            }
+        }
+        queued.clear();
+        RunResult result;
+        result.us_per_segment = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / sizes.size();
+        result.allocations_per_segment = static_cast<double>(g_allocations - allocations) / sizes.size();
+        result.mb_per_segment = (g_allocated_bytes - bytes) / 1048576.0 / sizes.size();
+        return result;
+    }
+
+    void PrintRow(const std::string& name, const RunResult& result) {
+        std::cout << std::left << std::setw(22) << ("  " + name) << std::right << std::fixed
+                  << std::setw(14) << std::setprecision(2) << result.allocations_per_segment
+                  << std::setw(14) << std::setprecision(3) << result.mb_per_segment
+                  << std::setw(12) << std::setprecision(1) << result.us_per_segment << std::endl;
+    }
+
+} // namespace
+
+int main() {
+    std::cout << "=== Segment buffer pool ===" << std::endl;
+    std::cout << SEGMENTS << " segments of ~1.5 MB, downloaded in " << CHUNK / 1024 << " KB reads, " << QUEUED << " queued" << std::endl << std::endl;
+    bool ok = true;
+
+    const std::vector<size_t> sizes = SegmentSizes(SEGMENTS, 1500000, 1);
+    RunResult unpooled = RunUnpooled(sizes);
+
+    SegmentPool pool;
+    RunResult pooled = RunPooled(pool, sizes);
+    SegmentPool::Stats stats = pool.GetStats();
+
+    std::cout << std::left << std::setw(22) << "  path" << std::right << std::setw(14) << "allocs/seg" << std::setw(14) << "MB new/seg"
+              << std::setw(12) << "us/seg" << std::endl;
+    PrintRow("new vector", unpooled);
+    PrintRow("SegmentPool", pooled);
+    std::cout << std::endl << "  Pool: " << stats.hits << " hits, " << stats.misses << " misses, " << stats.evictions << " evictions, "
+              << stats.in_use_high_water << " buffers in use at most, " << stats.idle_bytes_high_water / 1048576.0 << " MB idle at most"
+              << std::endl << std::endl;
+
+    ok = Check(pooled.allocations_per_segment <= 1.1, "pooled path allocates only the shared_ptr control block per segment") && ok;
+    ok = Check(pooled.mb_per_segment < unpooled.mb_per_segment / 20, "pooled path allocates a small fraction of the bytes") && ok;
+    ok = Check(stats.hits >= SEGMENTS - 2 * (QUEUED + 1) && stats.in_use_high_water == QUEUED + 1,
+               "buffers recycled once the queue is primed") && ok;
+
+    // Quality drops: the large buffers are given up instead of being kept for small segments
+    const std::vector<size_t> small = SegmentSizes(40, 400000, 2);
+    RunPooled(pool, small);
+    stats = pool.GetStats();
+    size_t largest_small = 0;
+    for (size_t size : small) {
+        largest_small = std::max(largest_small, size);
+    }
+    ok = Check(stats.idle_bytes <= stats.idle * 2 * stats.target_capacity && stats.target_capacity < 2 * largest_small,
+               "pool shrinks to the smaller segments after a quality drop") && ok;
+
+    // Several streams share the global idle limit
+    const size_t limit = 8 * 1024 * 1024;
+    SegmentPool::SetGlobalLimit(limit);
+    std::vector<SegmentPool> pools(6);
+    size_t peak_idle = 0;
+    for (int round = 0; round < 20; ++round) {
+        for (SegmentPool& stream_pool : pools) {
+            RunPooled(stream_pool, SegmentSizes(QUEUED + 2, 1500000, round));
+            peak_idle = std::max(peak_idle, SegmentPool::GetGlobalIdleBytes());
+        }
+    }
+    uint64_t evictions = 0;
+    for (const SegmentPool& stream_pool : pools) {
+        evictions += stream_pool.GetStats().evictions;
+    }
+    std::cout << "  6 streams, " << limit / 1048576 << " MB limit: " << peak_idle / 1048576.0 << " MB idle at most, " << evictions
+              << " buffers freed over the limit" << std::endl;
+    ok = Check(peak_idle <= limit && evictions > 0, "idle bytes across streams stay under the global limit") && ok;
+    pools.clear();
+    pool = SegmentPool();
+    ok = Check(SegmentPool::GetGlobalIdleBytes() == 0, "destroyed pools release their share of the limit") && ok;
+
+    std::cout << std::endl << (ok ? "All checks passed" : "SOME CHECKS FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
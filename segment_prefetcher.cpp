@@ -0,0 +1,316 @@
+#include "segment_prefetcher.h"
+#include <algorithm>
+
+namespace tsduck_transport {
+
+namespace {
+
+    const double PROBE_GAIN = 1.15;          // A raised limit must deliver this much more to be kept
+    const size_t MIN_WINDOW = 4;             // Completions per throughput measurement, at least
+    const size_t PROBE_INTERVAL = 8;         // Settled measurements before trying a higher limit again
+
+} // namespace
+
+SegmentPrefetcher::SegmentPrefetcher(FetchFunction fetch, SegmentPool& pool, const Config& config)
+    : SegmentPrefetcher(DeadlineFetchFunction([fetch](const std::wstring& url, const ChunkSink& sink, std::atomic<bool>* cancel_token,
+                                                      std::chrono::steady_clock::time_point) { return fetch(url, sink, cancel_token); }),
+                        pool, config) {
+}
+
+SegmentPrefetcher::SegmentPrefetcher(DeadlineFetchFunction fetch, SegmentPool& pool, const Config& config)
+    : SegmentPrefetcher(BufferFetchFunction([fetch](const std::wstring& url, std::vector<uint8_t>&, const ChunkSink& sink,
+                                                    std::atomic<bool>* cancel_token, std::chrono::steady_clock::time_point deadline) {
+                            return fetch(url, sink, cancel_token, deadline);
+                        }),
+                        pool, config) {
+}
+
+SegmentPrefetcher::SegmentPrefetcher(BufferFetchFunction fetch, SegmentPool& pool, const Config& config)
+    : fetch_(std::move(fetch)), pool_(pool), config_(config) {
+    config_.max_concurrency = std::max<size_t>(1, config_.max_concurrency);
+    config_.initial_concurrency = std::min(std::max<size_t>(1, config_.initial_concurrency), config_.max_concurrency);
+    config_.max_ahead = std::max(config_.max_ahead, config_.max_concurrency);
+    stats_.concurrency = config_.initial_concurrency;
+
+    for (size_t i = 0; i < config_.max_concurrency; ++i) {
+        workers_.emplace_back(&SegmentPrefetcher::WorkerLoop, this);
+    }
+}
+
+SegmentPrefetcher::~SegmentPrefetcher() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        for (const auto& job : queue_) {
+            job->cancel = true;
+        }
+        queue_.clear();
+    }
+    work_ready_.notify_all();
+    job_done_.notify_all();
+    for (std::thread& worker : workers_) {
+        worker.join();
+    }
+}
+
+std::shared_ptr<SegmentPrefetcher::Job> SegmentPrefetcher::NextJobLocked() {
+    if (stats_.in_flight >= stats_.concurrency) {
+        return nullptr;
+    }
+    size_t window = std::min(queue_.size(), config_.max_ahead);
+    for (size_t i = 0; i < window; ++i) {
+        if (queue_[i]->state == JobState::PENDING) {
+            return queue_[i];
+        }
+    }
+    return nullptr;
+}
+
+void SegmentPrefetcher::AdvanceInFlightLocked() {
+    auto now = std::chrono::steady_clock::now();
+    if (in_flight_changed_ != std::chrono::steady_clock::time_point()) {
+        in_flight_integral_ += stats_.in_flight * std::chrono::duration<double>(now - in_flight_changed_).count();
+    }
+    in_flight_changed_ = now;
+}
+
+void SegmentPrefetcher::WorkerLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        std::shared_ptr<Job> job;
+        work_ready_.wait(lock, [&] { return stopping_ || (job = NextJobLocked()) != nullptr; });
+        if (stopping_) {
+            return;
+        }
+        job->state = JobState::RUNNING;
+        job->limit_at_start = stats_.concurrency;
+        AdvanceInFlightLocked();
+        job->in_flight_integral_at_start = in_flight_integral_;
+        job->data = pool_.Acquire();
+        stats_.in_flight++;
+        stats_.in_flight_high_water = std::max(stats_.in_flight_high_water, stats_.in_flight);
+        lock.unlock();
+
+        // Appended under the job's data lock, which a consumer taking the segment progressively holds while it
+        // copies what has arrived, so other downloads and consumers do not wait for the copy; bytes the fetch
+        // wrote into the buffer itself are only counted. Bytes after a pause arrived at some unknown point in
+        // it, so they are not timed; the first ones also carry the request's round trip.
+        ChunkSink sink = [this, &job](const uint8_t* data, size_t size) {
+            auto now = std::chrono::steady_clock::now();
+            if (job->cancel) {
+                return false;
+            }
+            std::lock_guard<std::mutex> data_lock(job->data_mutex);
+            if (data != job->data->data() + job->arrived || job->arrived + size > job->data->size()) {
+                job->data->insert(job->data->end(), data, data + size);
+            }
+            std::lock_guard<std::mutex> sink_lock(mutex_);
+            if (job->last_arrival != std::chrono::steady_clock::time_point() && now - job->last_arrival <= config_.idle_gap) {
+                job->transfer_bytes += size;
+                job->transfer_time += std::chrono::duration_cast<std::chrono::microseconds>(now - job->last_arrival);
+            }
+            job->last_arrival = now;
+            job->arrived += size;
+            job_done_.notify_all();
+            return true;
+        };
+        auto start = std::chrono::steady_clock::now();
+        bool ok = !job->cancel && fetch_(job->url, *job->data, sink, &job->cancel, job->deadline);
+        auto elapsed = std::chrono::steady_clock::now() - start;
+
+        std::unique_lock<std::mutex> data_lock(job->data_mutex);
+        lock.lock();
+        AdvanceInFlightLocked();
+        stats_.in_flight--;
+        if (!job->cancel) {
+            job->download_time = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed);
+            if (ok && !job->data->empty() && job->arrived == job->data->size()) {
+                uint64_t bytes = job->data->size();
+                job->state = JobState::DONE;
+                stats_.downloads++;
+                stats_.bytes += bytes;
+                RecordCompletionLocked(*job, bytes, std::chrono::duration<double>(elapsed).count());
+            } else {
+                job->state = JobState::FAILED;
+                job->data.reset();
+                stats_.failures++;
+            }
+        }
+        data_lock.unlock();
+        job_done_.notify_all();
+        work_ready_.notify_one();
+    }
+}
+
+void SegmentPrefetcher::RecordCompletionLocked(const Job& job, uint64_t bytes, double seconds) {
+    // Only downloads that ran alongside as many others as the limit allows say anything about it;
+    // at the live edge one segment at a time keeps up whatever the limit is
+    if (seconds <= 0.0 || job.limit_at_start != stats_.concurrency) {
+        return;
+    }
+    double average_in_flight = (in_flight_integral_ - job.in_flight_integral_at_start) / seconds;
+    if (average_in_flight < stats_.concurrency - 0.5) {
+        return;
+    }
+    window_weighted_bytes_ += bytes * average_in_flight;
+    window_seconds_ += seconds;
+    if (++window_completions_ < std::max(MIN_WINDOW, 2 * stats_.concurrency)) {
+        return;
+    }
+
+    double throughput = window_weighted_bytes_ * 8.0 / window_seconds_;
+    window_weighted_bytes_ = 0.0;
+    window_seconds_ = 0.0;
+    window_completions_ = 0;
+    stats_.throughput_bps = throughput;
+
+    size_t& limit = stats_.concurrency;
+    bool raise = false;
+    if (probing_) {
+        probing_ = false;
+        if (throughput > reference_bps_ * PROBE_GAIN) {
+            reference_bps_ = throughput;
+            raise = true;
+        } else {
+            // More parallel downloads only split the same bandwidth
+            limit--;
+            stats_.decreases++;
+            settled_windows_ = 0;
+        }
+    } else if (reference_bps_ == 0.0) {
+        reference_bps_ = throughput;
+        raise = true;
+    } else {
+        reference_bps_ = 0.75 * reference_bps_ + 0.25 * throughput;
+        raise = ++settled_windows_ >= PROBE_INTERVAL;
+    }
+    if (raise && limit < config_.max_concurrency) {
+        limit++;
+        stats_.increases++;
+        probing_ = true;
+        settled_windows_ = 0;
+        work_ready_.notify_one();
+    }
+}
+
+void SegmentPrefetcher::Enqueue(int64_t sequence, const std::wstring& url, std::chrono::steady_clock::time_point deadline) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_) {
+            return;
+        }
+        auto position = std::find_if(queue_.begin(), queue_.end(),
+                                     [sequence](const std::shared_ptr<Job>& job) { return job->sequence >= sequence; });
+        if (position != queue_.end() && (*position)->sequence == sequence) {
+            return;
+        }
+        auto job = std::make_shared<Job>();
+        job->sequence = sequence;
+        job->url = url;
+        job->deadline = deadline;
+        queue_.insert(position, std::move(job));
+    }
+    work_ready_.notify_one();
+}
+
+void SegmentPrefetcher::DropFrontLocked() {
+    queue_.front()->cancel = true;
+    queue_.pop_front();
+    stats_.discarded++;
+}
+
+SegmentPrefetcher::Result SegmentPrefetcher::Take(int64_t sequence, Segment& out, std::atomic<bool>* cancel_token,
+                                                  const ProgressFunction* progress) {
+    out.delivered = 0;
+    std::unique_lock<std::mutex> lock(mutex_);
+    bool dropped = false;
+    while (!queue_.empty() && queue_.front()->sequence < sequence) {
+        DropFrontLocked();
+        dropped = true;
+    }
+    if (dropped) {
+        work_ready_.notify_all();
+    }
+    if (queue_.empty() || queue_.front()->sequence != sequence) {
+        return Result::NOT_QUEUED;
+    }
+
+    std::shared_ptr<Job> job = queue_.front();
+    std::vector<uint8_t> arrived;
+    while (job->state == JobState::PENDING || job->state == JobState::RUNNING) {
+        if (cancel_token && cancel_token->load()) {
+            return Result::CANCELLED;
+        }
+        if (std::chrono::steady_clock::now() >= job->deadline) {
+            break;
+        }
+        if (progress && job->state == JobState::RUNNING && job->arrived > out.delivered) {
+            // Copied out under the job's data lock only, so other downloads go on meanwhile; the buffer may
+            // have been reset by a failure since
+            size_t end = job->arrived;
+            lock.unlock();
+            {
+                std::lock_guard<std::mutex> data_lock(job->data_mutex);
+                if (job->data) {
+                    arrived.assign(job->data->begin() + out.delivered, job->data->begin() + end);
+                } else {
+                    arrived.clear();
+                }
+            }
+            out.delivered += arrived.size();
+            if (!arrived.empty()) {
+                (*progress)(arrived.data(), arrived.size());
+            }
+            lock.lock();
+            stats_.progressive_bytes += arrived.size();
+        } else {
+            job_done_.wait_until(lock, std::min(job->deadline, std::chrono::steady_clock::now() + std::chrono::milliseconds(50)));
+        }
+        if (queue_.empty() || queue_.front() != job) {
+            return Result::NOT_QUEUED;     // Cleared meanwhile
+        }
+    }
+    queue_.pop_front();
+    work_ready_.notify_one();
+
+    out.sequence = job->sequence;
+    out.url = job->url;
+    out.download_time = job->download_time;
+    out.transfer_bytes = job->transfer_bytes;
+    out.transfer_time = job->transfer_time;
+    if (job->state != JobState::DONE && std::chrono::steady_clock::now() >= job->deadline) {
+        // Still downloading, or failed by giving up at the deadline
+        job->cancel = true;
+        stats_.late++;
+        out.data.reset();
+        return Result::LATE;
+    }
+    if (job->state == JobState::FAILED) {
+        out.data.reset();
+        return Result::FAILED;
+    }
+    out.data = std::move(job->data);
+    return Result::READY;
+}
+
+bool SegmentPrefetcher::IsQueued(int64_t sequence) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return std::any_of(queue_.begin(), queue_.end(), [sequence](const std::shared_ptr<Job>& job) { return job->sequence == sequence; });
+}
+
+void SegmentPrefetcher::Clear() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        while (!queue_.empty()) {
+            DropFrontLocked();
+        }
+    }
+    job_done_.notify_all();
+}
+
+SegmentPrefetcher::Stats SegmentPrefetcher::GetStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+} // namespace tsduck_transport
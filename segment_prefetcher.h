@@ -0,0 +1,173 @@
+#pragma once
+// Parallel segment downloads handed out in media-sequence order
+// The fetch loops queue every segment they intend to play; worker threads download up to the
+// current concurrency limit of them at once, lowest sequence first, into pooled buffers. The
+// consumer takes segments by sequence number and waits only for the one it asks for, so after a
+// stall or at startup N segments cost about one round trip instead of N. The limit adapts to
+// measured throughput: it is raised while more parallel downloads deliver more bytes per second
+// and lowered again when they stop doing so. It never exceeds the per-stream maximum.
+// A consumer that cannot wait for a whole segment may take it progressively: the bytes of the
+// segment it waits for are passed on as they arrive.
+// A segment may be queued with the time by which it must be played: the download is given that
+// deadline, and a consumer still waiting for it when it passes is told the segment is late.
+// Besides the download time, each segment reports the bytes that arrived back to back and the time
+// they took: a segment streamed while it is produced spends most of its download waiting for the
+// encoder, and only its bursts say how fast the network is.
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include "segment_pool.h"
+
+namespace tsduck_transport {
+
+    struct PrefetcherConfig {
+        size_t max_concurrency = 4;         // Per-stream limit on parallel downloads
+        size_t initial_concurrency = 2;
+        size_t max_ahead = 8;               // Downloads running or finished ahead of the consumer
+        std::chrono::milliseconds idle_gap{20};     // A longer pause between arrivals is the origin waiting, not the network
+    };
+
+    class SegmentPrefetcher {
+    public:
+        using Config = PrefetcherConfig;
+
+        // Receives body bytes as they arrive; false when the segment is no longer wanted
+        using ChunkSink = std::function<bool(const uint8_t* data, size_t size)>;
+
+        // Download url, passing the body to sink as it arrives; the token is set when the segment is no longer wanted.
+        // An empty body counts as a failed download.
+        using FetchFunction = std::function<bool(const std::wstring& url, const ChunkSink& sink, std::atomic<bool>* cancel_token)>;
+
+        // As FetchFunction, for downloads that should give up at the segment's deadline (time_point::max() for none)
+        using DeadlineFetchFunction = std::function<bool(const std::wstring& url, const ChunkSink& sink, std::atomic<bool>* cancel_token,
+                                                         std::chrono::steady_clock::time_point deadline)>;
+
+        // As DeadlineFetchFunction, for downloads that assemble the segment out of order: body is its pooled buffer.
+        // The fetch sizes it before passing sink any of it and does not move it after; sink is then given the bytes
+        // of body as they fall into place, which are kept where they are. Bytes passed from elsewhere are appended.
+        using BufferFetchFunction = std::function<bool(const std::wstring& url, std::vector<uint8_t>& body, const ChunkSink& sink,
+                                                       std::atomic<bool>* cancel_token, std::chrono::steady_clock::time_point deadline)>;
+
+        // Bytes of the awaited segment, in order, while it is still downloading
+        using ProgressFunction = std::function<void(const uint8_t* data, size_t size)>;
+
+        enum class Result {
+            READY,
+            FAILED,         // Download failed; the segment is removed from the queue
+            NOT_QUEUED,
+            CANCELLED,      // The caller's token was set while waiting
+            LATE            // The segment's deadline passed before it was complete; it is removed from the queue
+        };
+
+        struct Segment {
+            int64_t sequence = -1;
+            std::wstring url;
+            SegmentPool::PooledSegment data;                // Whole segment when READY
+            size_t delivered = 0;                           // Leading bytes already passed to the progress function
+            std::chrono::milliseconds download_time{0};
+            uint64_t transfer_bytes = 0;                    // Arrived within idle_gap of the bytes before them
+            std::chrono::microseconds transfer_time{0};     // Those arrivals' gaps, summed
+        };
+
+        struct Stats {
+            uint64_t downloads = 0;
+            uint64_t failures = 0;
+            uint64_t discarded = 0;             // Queued or finished segments the consumer passed over
+            uint64_t late = 0;                  // Not complete by their deadline
+            uint64_t bytes = 0;
+            uint64_t progressive_bytes = 0;     // Passed on to a waiting consumer before the download finished
+            size_t concurrency = 0;             // Current limit
+            size_t in_flight = 0;
+            size_t in_flight_high_water = 0;
+            uint64_t increases = 0;             // Limit raised after more throughput at the higher limit
+            uint64_t decreases = 0;             // Limit lowered after a raise gained nothing
+            double throughput_bps = 0.0;        // Aggregate rate measured at the current limit
+        };
+
+        SegmentPrefetcher(FetchFunction fetch, SegmentPool& pool, const Config& config = Config());
+        SegmentPrefetcher(DeadlineFetchFunction fetch, SegmentPool& pool, const Config& config = Config());
+        SegmentPrefetcher(BufferFetchFunction fetch, SegmentPool& pool, const Config& config = Config());
+        ~SegmentPrefetcher();
+
+        SegmentPrefetcher(const SegmentPrefetcher&) = delete;
+        SegmentPrefetcher& operator=(const SegmentPrefetcher&) = delete;
+
+        // Queue a segment for download; a sequence already queued is ignored
+        void Enqueue(int64_t sequence, const std::wstring& url,
+                     std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max());
+
+        // Wait for a queued segment. Segments queued before it are discarded, in flight or not.
+        // With progress, what arrives while waiting is passed on (outside the lock) and out.delivered counts it;
+        // a segment that was complete already is not. Waiting ends at the segment's deadline.
+        Result Take(int64_t sequence, Segment& out, std::atomic<bool>* cancel_token = nullptr,
+                    const ProgressFunction* progress = nullptr);
+
+        bool IsQueued(int64_t sequence) const;
+
+        // Drop everything queued, cancelling downloads in flight (sequence restart, fast restart)
+        void Clear();
+
+        Stats GetStats() const;
+
+    private:
+        enum class JobState { PENDING, RUNNING, DONE, FAILED };
+
+        struct Job {
+            int64_t sequence = -1;
+            std::wstring url;
+            std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+            JobState state = JobState::PENDING;
+            SegmentPool::PooledSegment data;    // Filled while RUNNING: appended under data_mutex, or in place by the fetch
+            size_t arrived = 0;                 // Bytes of data complete in order; only these may be read before DONE.
+                                                // Changed under data_mutex and mutex_ both
+            std::mutex data_mutex;              // Taken before mutex_; held while data is appended to, reset or copied from
+            std::atomic<bool> cancel{false};
+            std::chrono::milliseconds download_time{0};
+            uint64_t transfer_bytes = 0;
+            std::chrono::microseconds transfer_time{0};
+            std::chrono::steady_clock::time_point last_arrival;
+            size_t limit_at_start = 0;
+            double in_flight_integral_at_start = 0.0;
+        };
+
+        BufferFetchFunction fetch_;
+        SegmentPool& pool_;
+        Config config_;
+        mutable std::mutex mutex_;
+        std::condition_variable work_ready_;    // Workers: a job may be started
+        std::condition_variable job_done_;      // Consumer: a job finished or received data
+        std::deque<std::shared_ptr<Job>> queue_;    // Ascending sequence; front is the next the consumer may take
+        std::vector<std::thread> workers_;
+        bool stopping_ = false;
+        Stats stats_;
+
+        // Throughput measurement for the concurrency limit. Each download's rate times the average number
+        // of downloads running alongside it estimates what the stream gets in total at that concurrency.
+        double in_flight_integral_ = 0.0;       // Downloads in flight integrated over seconds
+        std::chrono::steady_clock::time_point in_flight_changed_;
+        double window_weighted_bytes_ = 0.0;
+        double window_seconds_ = 0.0;
+        size_t window_completions_ = 0;
+        double reference_bps_ = 0.0;            // Throughput before the last raise, or at the settled limit
+        bool probing_ = false;                  // Last window ran at a raised limit
+        size_t settled_windows_ = 0;
+
+        void WorkerLoop();
+        std::shared_ptr<Job> NextJobLocked();
+        void AdvanceInFlightLocked();
+        void RecordCompletionLocked(const Job& job, uint64_t bytes, double seconds);
+        void DropFrontLocked();
+    };
+
+} // namespace tsduck_transport
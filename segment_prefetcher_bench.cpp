@@ -0,0 +1,283 @@
+// Time to refill after a stall: sequential segment downloads vs. SegmentPrefetcher
+// A stream that stalled finds a playlist with several segments it has not fetched yet. The fetch
+// loops used to download them one after another, so the player waited one round trip plus one
+// transfer per segment. Here the same refill is taken from a loopback origin with injected round
+// trip time and a per-connection rate limit (a window-limited TCP connection), once one segment at
+// a time and once through the prefetcher over repeated stalls so its limit can adapt. Further runs
+// check that the limit backs off when all connections share one bottleneck, that two streams stay
+// within their own limits, and ordering, failures and discards, and a fetch writing the buffer itself.
+//
+// Build: g++ -std=c++17 -O2 -pthread segment_prefetcher_bench.cpp segment_prefetcher.cpp segment_pool.cpp http_client.cpp http_client_posix.cpp inflater.cpp loopback_server.cpp -o segment_prefetcher_bench
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include "segment_prefetcher.h"
+#include "http_client.h"
+#include "loopback_server.h"
+
+using namespace tsduck_transport;
+using tardsplaya::HttpClient;
+using tardsplaya::LoopbackRequest;
+using tardsplaya::LoopbackResponse;
+using tardsplaya::LoopbackServer;
+
+namespace {
+
+    const int RTT_MS = 40;
+    const size_t SEGMENT_BYTES = 512 * 1024;                 // 2 s at ~2 Mbit/s
+    const uint64_t CONNECTION_RATE = 4 * 1024 * 1024;        // Bytes/s one connection gets
+    const int REFILL = 8;                                    // Segments listed after a 16 s stall
+
+    bool Check(bool condition, const std::string& what) {
+        std::cout << (condition ? "  PASS  " : "  FAIL  ") << what << std::endl;
+        return condition;
+    }
+
+    // /seg/<n>.ts returns a segment starting with "SEQ=<n>;", /slow/<n>.ts the same after 2 s,
+    // anything else is missing
+    void Respond(const LoopbackRequest& request, LoopbackResponse& response) {
+        bool slow = request.path.compare(0, 6, "/slow/") == 0;
+        if (request.path.compare(0, 5, "/seg/") != 0 && !slow) {
+            response.status = 404;
+            return;
+        }
+        long sequence = std::atol(request.path.c_str() + (slow ? 6 : 5));
+        response.body.assign(SEGMENT_BYTES, '\x47');
+        std::string tag = "SEQ=" + std::to_string(sequence) + ";";
+        response.body.replace(0, tag.size(), tag);
+        if (slow) {
+            response.delay = std::chrono::milliseconds(2000);
+        }
+    }
+
+    std::wstring SegmentUrl(const LoopbackServer& server, int64_t sequence, const char* route = "/seg/") {
+        std::string url = server.Url(route + std::to_string(sequence) + ".ts");
+        return std::wstring(url.begin(), url.end());
+    }
+
+    bool HasSequence(const SegmentPrefetcher::Segment& segment) {
+        std::string tag = "SEQ=" + std::to_string(segment.sequence) + ";";
+        return segment.data && segment.data->size() == SEGMENT_BYTES && memcmp(segment.data->data(), tag.data(), tag.size()) == 0;
+    }
+
+    SegmentPrefetcher::FetchFunction ClientFetch(HttpClient& client) {
+        return [&client](const std::wstring& url, const SegmentPrefetcher::ChunkSink& sink, std::atomic<bool>* cancel_token) {
+            return client.Get(url, sink, cancel_token);
+        };
+    }
+
+    struct StallRun {
+        std::vector<double> refill_ms;      // Per stall: all REFILL segments handed over in order
+        std::vector<double> first_ms;       // Per stall: first segment handed over
+        SegmentPrefetcher::Stats stats;
+        bool in_order = true;
+    };
+
+    StallRun RunStalls(LoopbackServer& server, const PrefetcherConfig& config, int stalls) {
+        server.ResetCounters();
+        HttpClient client(tardsplaya::CreatePlatformHttpBackend());
+        SegmentPool pool;
+        SegmentPrefetcher prefetcher(ClientFetch(client), pool, config);
+        StallRun run;
+        int64_t next = 1000;
+        for (int stall = 0; stall < stalls; ++stall) {
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < REFILL; ++i) {
+                prefetcher.Enqueue(next + i, SegmentUrl(server, next + i));
+            }
+            for (int i = 0; i < REFILL; ++i) {
+                SegmentPrefetcher::Segment segment;
+                if (prefetcher.Take(next + i, segment) != SegmentPrefetcher::Result::READY || !HasSequence(segment)) {
+                    run.in_order = false;
+                }
+                if (i == 0) {
+                    run.first_ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+                }
+            }
+            run.refill_ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+            next += REFILL;
+        }
+        run.stats = prefetcher.GetStats();
+        return run;
+    }
+
+    double Average(const std::vector<double>& values, size_t from) {
+        double sum = 0.0;
+        for (size_t i = from; i < values.size(); ++i) {
+            sum += values[i];
+        }
+        return values.size() > from ? sum / (values.size() - from) : 0.0;
+    }
+
+    void PrintRow(const std::string& name, const StallRun& run) {
+        std::cout << std::left << std::setw(26) << ("  " + name) << std::right << std::fixed << std::setprecision(0)
+                  << std::setw(12) << run.refill_ms.front() << std::setw(12) << run.refill_ms.back()
+                  << std::setw(12) << Average(run.first_ms, 0) << std::setw(8) << run.stats.concurrency
+                  << std::setw(12) << std::setprecision(1) << run.stats.throughput_bps / 1e6 << std::endl;
+    }
+
+} // namespace
+
+int main() {
+    std::cout << "=== Segment prefetcher: time to refill after a stall ===" << std::endl;
+    bool ok = true;
+
+    LoopbackServer server(Respond);
+    server.handshake_ms = 2 * RTT_MS;
+    server.rtt_ms = RTT_MS;
+    server.connection_bytes_per_second = CONNECTION_RATE;
+    if (!Check(server.Start(), "loopback origin listening")) {
+        return 1;
+    }
+
+    std::cout << std::endl << REFILL << " segments of " << SEGMENT_BYTES / 1024 << " KB per stall, " << RTT_MS << " ms round trip, "
+              << CONNECTION_RATE / 1048576 << " MB/s per connection" << std::endl << std::endl;
+    std::cout << std::left << std::setw(26) << "  path" << std::right << std::setw(12) << "1st refill" << std::setw(12) << "last refill"
+              << std::setw(12) << "first seg" << std::setw(8) << "limit" << std::setw(12) << "Mbit/s" << std::endl;
+
+    PrefetcherConfig sequential_config;
+    sequential_config.max_concurrency = 1;
+    StallRun sequential = RunStalls(server, sequential_config, 2);
+    PrintRow("one at a time (ms)", sequential);
+
+    PrefetcherConfig adaptive_config;
+    adaptive_config.max_concurrency = 6;
+    StallRun adaptive = RunStalls(server, adaptive_config, 8);
+    PrintRow("prefetcher (ms)", adaptive);
+    std::cout << std::endl << "  Limit raised " << adaptive.stats.increases << " times, lowered " << adaptive.stats.decreases
+              << " times; " << adaptive.stats.in_flight_high_water << " downloads in flight at most" << std::endl << std::endl;
+
+    ok = Check(sequential.in_order && adaptive.in_order, "every segment handed over complete and in sequence order") && ok;
+    ok = Check(adaptive.stats.concurrency >= 4, "limit climbs while parallel downloads add throughput") && ok;
+    ok = Check(adaptive.refill_ms.back() < 0.4 * Average(sequential.refill_ms, 0), "refill takes well under half the sequential time") && ok;
+    ok = Check(adaptive.refill_ms.front() < 0.8 * Average(sequential.refill_ms, 0), "first refill already faster at the initial limit") && ok;
+
+    // One bottleneck shared by every connection: more downloads only split it
+    {
+        LoopbackServer shared(Respond);
+        shared.rtt_ms = 2;
+        shared.total_bytes_per_second = 8 * 1024 * 1024;
+        shared.Start();
+        StallRun bottleneck_sequential = RunStalls(shared, sequential_config, 2);
+        StallRun bottleneck = RunStalls(shared, adaptive_config, 8);
+        shared.Stop();
+        std::cout << "  Shared 8 MB/s bottleneck: " << std::fixed << std::setprecision(0) << Average(bottleneck_sequential.refill_ms, 0)
+                  << " ms one at a time, " << bottleneck.refill_ms.back() << " ms prefetched, limit " << bottleneck.stats.concurrency
+                  << " (" << bottleneck.stats.decreases << " lowered)" << std::endl;
+        ok = Check(bottleneck.in_order && bottleneck.stats.concurrency <= 3 && bottleneck.stats.decreases >= 1,
+                   "limit backs off when a raise adds no throughput") && ok;
+        ok = Check(Average(bottleneck.refill_ms, 4) < 1.15 * Average(bottleneck_sequential.refill_ms, 0),
+                   "prefetching costs nothing on a bandwidth-bound link") && ok;
+    }
+
+    // Two streams, each limited to two downloads
+    {
+        server.ResetCounters();
+        HttpClient client(tardsplaya::CreatePlatformHttpBackend());
+        PrefetcherConfig config;
+        config.max_concurrency = 2;
+        SegmentPrefetcher::Stats stream_stats[2];
+        std::vector<std::thread> streams;
+        for (int stream = 0; stream < 2; ++stream) {
+            streams.emplace_back([&, stream] {
+                SegmentPool pool;
+                SegmentPrefetcher prefetcher(ClientFetch(client), pool, config);
+                for (int64_t i = 0; i < REFILL; ++i) {
+                    prefetcher.Enqueue(i, SegmentUrl(server, stream * 100 + i));
+                }
+                SegmentPrefetcher::Segment segment;
+                for (int64_t i = 0; i < REFILL; ++i) {
+                    prefetcher.Take(i, segment);
+                }
+                stream_stats[stream] = prefetcher.GetStats();
+            });
+        }
+        for (std::thread& thread : streams) {
+            thread.join();
+        }
+        ok = Check(stream_stats[0].in_flight_high_water <= 2 && stream_stats[1].in_flight_high_water <= 2 && server.max_active <= 4 &&
+                   stream_stats[0].downloads == REFILL && stream_stats[1].downloads == REFILL,
+                   "each stream stays within its own concurrency limit") && ok;
+    }
+
+    // Failures, discards and cancellation
+    {
+        HttpClient client(tardsplaya::CreatePlatformHttpBackend());
+        SegmentPool pool;
+        SegmentPrefetcher prefetcher(ClientFetch(client), pool);
+        for (int64_t i = 0; i < 5; ++i) {
+            prefetcher.Enqueue(i, SegmentUrl(server, i, i == 2 ? "/missing/" : "/seg/"));
+        }
+        prefetcher.Enqueue(3, SegmentUrl(server, 3));
+        SegmentPrefetcher::Segment segment;
+        bool results_ok = true;
+        for (int64_t i = 0; i < 5; ++i) {
+            SegmentPrefetcher::Result result = prefetcher.Take(i, segment);
+            results_ok = results_ok && (i == 2 ? result == SegmentPrefetcher::Result::FAILED
+                                               : result == SegmentPrefetcher::Result::READY && HasSequence(segment));
+        }
+        ok = Check(results_ok && prefetcher.GetStats().downloads == 4 && prefetcher.GetStats().failures == 1,
+                   "a failed segment is reported in its place and later ones still arrive in order") && ok;
+
+        for (int64_t i = 10; i < 15; ++i) {
+            prefetcher.Enqueue(i, SegmentUrl(server, i));
+        }
+        ok = Check(prefetcher.Take(12, segment) == SegmentPrefetcher::Result::READY && segment.sequence == 12 &&
+                   prefetcher.GetStats().discarded == 2 && !prefetcher.IsQueued(11), "taking a later segment discards the ones before it") && ok;
+        ok = Check(prefetcher.Take(12, segment) == SegmentPrefetcher::Result::NOT_QUEUED, "a segment is handed over once") && ok;
+        prefetcher.Clear();
+        ok = Check(!prefetcher.IsQueued(13) && prefetcher.GetStats().discarded == 4, "clear drops what is left") && ok;
+
+        std::atomic<bool> cancel{false};
+        prefetcher.Enqueue(20, SegmentUrl(server, 20, "/slow/"));
+        std::thread canceller([&] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            cancel = true;
+        });
+        auto start = std::chrono::steady_clock::now();
+        SegmentPrefetcher::Result result = prefetcher.Take(20, segment, &cancel);
+        double waited_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        canceller.join();
+        ok = Check(result == SegmentPrefetcher::Result::CANCELLED && waited_ms < 500, "waiting consumer returns when its stream stops") && ok;
+    }
+
+    // A fetch that assembles the segment in the pooled buffer itself and hands it on in place
+    {
+        HttpClient client(tardsplaya::CreatePlatformHttpBackend());
+        SegmentPool pool;
+        std::atomic<const uint8_t*> assembled{nullptr};
+        SegmentPrefetcher prefetcher(
+            [&](const std::wstring& url, std::vector<uint8_t>& body, const SegmentPrefetcher::ChunkSink& sink,
+                std::atomic<bool>* cancel_token, std::chrono::steady_clock::time_point) {
+                if (!client.Get(url, body, cancel_token)) {
+                    return false;
+                }
+                assembled = body.data();
+                size_t half = body.size() / 2;
+                if (!sink(body.data(), half)) {
+                    return false;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                return sink(body.data() + half, body.size() - half);
+            },
+            pool);
+        prefetcher.Enqueue(30, SegmentUrl(server, 30));
+        size_t progressed = 0;
+        SegmentPrefetcher::ProgressFunction progress = [&](const uint8_t*, size_t size) { progressed += size; };
+        SegmentPrefetcher::Segment segment;
+        ok = Check(prefetcher.Take(30, segment, nullptr, &progress) == SegmentPrefetcher::Result::READY && HasSequence(segment) &&
+                   progressed > 0 && progressed == segment.delivered && segment.data->data() == assembled.load(),
+                   "a segment written in place is handed over in that buffer, its bytes passed on as they fall into place") && ok;
+    }
+
+    server.Stop();
+    std::cout << std::endl << (ok ? "All checks passed" : "SOME CHECKS FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
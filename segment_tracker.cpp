@@ -0,0 +1,109 @@
+#include "segment_tracker.h"
+#include <algorithm>
+#include <cstdlib>
+
+namespace tsduck_hls {
+
+int64_t ParseMediaSequence(const std::string& playlist) {
+    static const char TAG[] = "#EXT-X-MEDIA-SEQUENCE:";
+    size_t pos = playlist.find(TAG);
+    if (pos == std::string::npos) {
+        return 0;
+    }
+    return std::strtoll(playlist.c_str() + pos + sizeof(TAG) - 1, nullptr, 10);
+}
+
+SegmentTracker::SegmentTracker() : states_(WINDOW, PENDING) {
+}
+
+void SegmentTracker::Reset() {
+    std::fill(states_.begin(), states_.end(), PENDING);
+    base_ = 0;
+    first_ = 0;
+    listed_end_ = 0;
+    started_ = false;
+    stats_ = Stats();
+}
+
+void SegmentTracker::BeginPlaylist(int64_t media_sequence, size_t segment_count) {
+    const int64_t end = media_sequence + static_cast<int64_t>(segment_count);
+    if (started_ && media_sequence < first_) {
+        // Sequence numbers restarted; nothing tracked so far refers to the same segments
+        std::fill(states_.begin(), states_.end(), PENDING);
+        started_ = false;
+        stats_.resets++;
+    }
+    if (!started_) {
+        started_ = true;
+        base_ = media_sequence;
+        listed_end_ = media_sequence;
+    }
+
+    // Listed before but gone now without being fetched
+    const int64_t dropped_end = std::min(media_sequence, listed_end_);
+    const int64_t scan_end = std::min(dropped_end, base_ + static_cast<int64_t>(WINDOW));
+    for (int64_t sequence = base_; sequence < scan_end; ++sequence) {
+        if (State(sequence) == PENDING) {
+            stats_.missed++;
+        }
+    }
+
+    // Never listed: the playlist moved further than its own length between two refreshes
+    if (media_sequence > listed_end_) {
+        stats_.gaps++;
+        stats_.missed += static_cast<uint64_t>(media_sequence - listed_end_);
+    }
+
+    Slide(std::max(media_sequence, end - static_cast<int64_t>(WINDOW)));
+    first_ = media_sequence;
+    listed_end_ = std::max(listed_end_, end);
+}
+
+void SegmentTracker::Slide(int64_t new_base) {
+    if (new_base <= base_) {
+        return;
+    }
+    // Free the slots of sequences leaving the window for the ones entering it
+    int64_t steps = std::min<int64_t>(new_base - base_, WINDOW);
+    for (int64_t i = 0; i < steps; ++i) {
+        State(base_ + i) = PENDING;
+    }
+    base_ = new_base;
+}
+
+bool SegmentTracker::IsHandled(int64_t sequence) const {
+    if (sequence < base_) {
+        return true;
+    }
+    if (sequence >= base_ + static_cast<int64_t>(WINDOW)) {
+        return false;
+    }
+    return states_[static_cast<size_t>(sequence % WINDOW)] != PENDING;
+}
+
+void SegmentTracker::Mark(int64_t sequence, uint8_t state) {
+    if (sequence < base_) {
+        return;
+    }
+    if (sequence >= base_ + static_cast<int64_t>(WINDOW)) {
+        Slide(sequence - static_cast<int64_t>(WINDOW) + 1);
+    }
+    State(sequence) = state;
+}
+
+void SegmentTracker::MarkProcessed(int64_t sequence) {
+    if (!IsHandled(sequence)) {
+        stats_.processed++;
+    }
+    Mark(sequence, PROCESSED);
+    stats_.last_sequence = std::max(stats_.last_sequence, sequence);
+}
+
+void SegmentTracker::MarkSkipped(int64_t sequence) {
+    if (!IsHandled(sequence)) {
+        stats_.skipped++;
+    }
+    Mark(sequence, SKIPPED);
+}
+
+} // namespace tsduck_hls
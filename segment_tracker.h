@@ -0,0 +1,60 @@
+#pragma once
+// Processed-segment tracking by media sequence number, shared by the streaming modes
+// Segments are identified by EXT-X-MEDIA-SEQUENCE plus their index in the playlist instead of their
+// URL, in a fixed window of sequence numbers with O(1) lookups. Each playlist refresh reports where
+// the live window starts, so segments that left the playlist before they were fetched, or were
+// never listed at all because the playlist moved on between refreshes, are counted as missed.
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace tsduck_hls {
+
+    // EXT-X-MEDIA-SEQUENCE of a media playlist (0 when absent, as the HLS spec defines)
+    int64_t ParseMediaSequence(const std::string& playlist);
+
+    class SegmentTracker {
+    public:
+        static constexpr size_t WINDOW = 4096;   // Sequence numbers tracked; older ones count as handled
+
+        struct Stats {
+            uint64_t processed = 0;
+            uint64_t skipped = 0;       // Passed over on purpose (live edge, fast restart)
+            uint64_t missed = 0;        // Left the playlist without being fetched or skipped
+            uint64_t gaps = 0;          // Refreshes that found the playlist had moved past unseen segments
+            uint64_t resets = 0;        // Media sequence went backwards (new stream or restarted packager)
+            int64_t last_sequence = -1; // Last segment processed
+        };
+
+        SegmentTracker();
+
+        // Start of a playlist refresh listing segment_count segments from media_sequence on
+        void BeginPlaylist(int64_t media_sequence, size_t segment_count);
+
+        // Processed or skipped already (sequence = media_sequence + index in the playlist)
+        bool IsHandled(int64_t sequence) const;
+
+        void MarkProcessed(int64_t sequence);
+        void MarkSkipped(int64_t sequence);
+
+        const Stats& GetStats() const { return stats_; }
+        void Reset();
+
+    private:
+        enum : uint8_t { PENDING = 0, PROCESSED = 1, SKIPPED = 2 };
+
+        std::vector<uint8_t> states_;   // Circular, indexed by sequence % WINDOW for [base_, base_ + WINDOW)
+        int64_t base_ = 0;              // Oldest sequence still fetchable
+        int64_t first_ = 0;             // First sequence of the last playlist
+        int64_t listed_end_ = 0;        // One past the newest sequence any playlist has listed
+        bool started_ = false;
+        Stats stats_;
+
+        uint8_t& State(int64_t sequence) { return states_[static_cast<size_t>(sequence % WINDOW)]; }
+        void Mark(int64_t sequence, uint8_t state);
+        void Slide(int64_t new_base);
+    };
+
+} // namespace tsduck_hls
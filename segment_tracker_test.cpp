@@ -0,0 +1,79 @@
+// Tests for processed-segment tracking by media sequence number
+// Drives SegmentTracker through playlist refreshes the way the streaming modes do: a sliding live
+// window, playlists longer than the old 10-URL history, refreshes that jump past unseen segments,
+// failed downloads leaving the playlist, deliberate skips, and a sequence restart.
+//
+// Build: g++ -std=c++17 -O2 segment_tracker_test.cpp segment_tracker.cpp -o segment_tracker_test
+
+#include <iostream>
+#include <string>
+#include "segment_tracker.h"
+
+using namespace tsduck_hls;
+
+namespace {
+
+    bool Check(bool condition, const std::string& what) {
+        std::cout << (condition ? "  PASS  " : "  FAIL  ") << what << std::endl;
+        return condition;
+    }
+
+    // Refresh and process every segment not handled yet; returns how many were new
+    int Refresh(SegmentTracker& tracker, int64_t media_sequence, size_t count) {
+        tracker.BeginPlaylist(media_sequence, count);
+        int fetched = 0;
+        for (size_t i = 0; i < count; ++i) {
+            int64_t sequence = media_sequence + static_cast<int64_t>(i);
+            if (!tracker.IsHandled(sequence)) {
+                tracker.MarkProcessed(sequence);
+                fetched++;
+            }
+        }
+        return fetched;
+    }
+
+} // namespace
+
+int main() {
+    std::cout << "=== Segment tracker tests ===" << std::endl;
+    bool ok = true;
+
+    ok = Check(ParseMediaSequence("#EXTM3U\n#EXT-X-TARGETDURATION:2\n#EXT-X-MEDIA-SEQUENCE:81234\n#EXTINF:2.0,\na.ts\n") == 81234,
+               "media sequence read from the playlist") && ok;
+    ok = Check(ParseMediaSequence("#EXTM3U\n#EXTINF:2.0,\na.ts\n") == 0, "absent media sequence is 0") && ok;
+
+    SegmentTracker tracker;
+    ok = Check(Refresh(tracker, 100, 5) == 5, "first playlist: every segment is new") && ok;
+    ok = Check(Refresh(tracker, 101, 5) == 1 && Refresh(tracker, 101, 5) == 0, "sliding window: only the new segment is fetched") && ok;
+
+    // Longer than the 10 URLs the router used to remember
+    ok = Check(Refresh(tracker, 102, 15) == 11 && Refresh(tracker, 103, 15) == 1, "15-segment playlist is not re-downloaded") && ok;
+    ok = Check(tracker.GetStats().missed == 0 && tracker.GetStats().gaps == 0 && tracker.GetStats().last_sequence == 117,
+               "nothing missed while refreshes keep up") && ok;
+
+    // Refresh stalled: the playlist moved past segments that were never listed to us
+    ok = Check(Refresh(tracker, 125, 5) == 5, "segments after a jump are fetched") && ok;
+    ok = Check(tracker.GetStats().gaps == 1 && tracker.GetStats().missed == 7, "jump counted as one gap of 7 missed segments") && ok;
+
+    // Listed but not fetched (download failed) before leaving the playlist
+    tracker.BeginPlaylist(130, 5);
+    tracker.MarkProcessed(130);
+    tracker.MarkProcessed(131);
+    tracker.MarkSkipped(132);
+    ok = Check(Refresh(tracker, 134, 5) == 5, "later segments still fetched") && ok;
+    ok = Check(tracker.GetStats().missed == 8 && tracker.GetStats().skipped == 1 && tracker.GetStats().gaps == 1,
+               "unfetched segment that left the playlist is missed, a deliberate skip is not") && ok;
+
+    // Encoder restart: sequence numbers go backwards
+    ok = Check(Refresh(tracker, 3, 4) == 4 && tracker.GetStats().resets == 1, "sequence restart resets tracking") && ok;
+    ok = Check(tracker.GetStats().missed == 8, "restart is not counted as missed segments") && ok;
+
+    // Very long playlists keep only the newest WINDOW sequences; older ones count as handled
+    SegmentTracker long_tracker;
+    size_t long_count = SegmentTracker::WINDOW + 100;
+    ok = Check(Refresh(long_tracker, 0, long_count) == static_cast<int>(SegmentTracker::WINDOW), "playlist longer than the window fetches its newest part") && ok;
+    ok = Check(Refresh(long_tracker, 1, long_count) == 1 && long_tracker.IsHandled(0), "window slides with the playlist") && ok;
+
+    std::cout << std::endl << (ok ? "All checks passed" : "SOME CHECKS FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
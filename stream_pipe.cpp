@@ -3,6 +3,11 @@
 #include "twitch_api.h"
 #include "playlist_parser.h"
 #include "tsduck_hls_wrapper.h"
+#include "segment_tracker.h"
+#include "low_latency_hls.h"
+#include "poll_scheduler.h"
+#include "segment_prefetcher.h"
+#include "http_client.h"
 #include "stream_resource_manager.h"
 #include <winsock2.h>
 #include <ws2tcpip.h>
@@ -14,7 +19,6 @@
 #include <thread>
 #include <chrono>
 #include <sstream>
-#include <winhttp.h>
 #include <atomic>
 #include <iostream>
 #include <queue>
@@ -27,7 +31,8 @@ std::wstring FetchPlaylist(const std::wstring& channel, const std::wstring& acce
 std::map<std::wstring, std::wstring> ParsePlaylist(const std::wstring& m3u8);
 
 // Forward declarations for functions defined in other files
-bool HttpGetText(const std::wstring& url, std::string& out, std::atomic<bool>* cancel_token = nullptr);
+bool HttpGetText(const std::wstring& url, std::string& out, std::atomic<bool>* cancel_token = nullptr,
+                 tardsplaya::HttpResponse* response = nullptr);
 std::wstring Utf8ToWide(const std::string& str);
 
 // Helper functions for URL parsing
@@ -331,59 +336,19 @@ static bool WriteFileWithTimeout(HANDLE hFile, const void* lpBuffer, DWORD nNumb
     return result;
 }
 
-// Utility: HTTP GET (returns as binary), with error retries
+// Utility: HTTP GET (returns as binary), with error retries on the shared keep-alive connection pool
 static bool HttpGetBinary(const std::wstring& url, std::vector<char>& out, int max_attempts = 3, std::atomic<bool>* cancel_token = nullptr) {
-    for (int attempt = 0; attempt < max_attempts; ++attempt) {
-        if (cancel_token && cancel_token->load()) return false;
-        URL_COMPONENTS uc = { sizeof(uc) };
-        wchar_t host[256] = L"", path[2048] = L"";
-        uc.lpszHostName = host; uc.dwHostNameLength = 255;
-        uc.lpszUrlPath = path; uc.dwUrlPathLength = 2047;
-        WinHttpCrackUrl(url.c_str(), 0, 0, &uc);
-
-        HINTERNET hSession = WinHttpOpen(L"Tardsplaya/1.0", WINHTTP_ACCESS_TYPE_DEFAULT_PROXY, 0, 0, 0);
-        if (!hSession) continue;
-        HINTERNET hConnect = WinHttpConnect(hSession, host, uc.nPort, 0);
-        if (!hConnect) { WinHttpCloseHandle(hSession); continue; }
-        HINTERNET hRequest = WinHttpOpenRequest(
-            hConnect, L"GET", path, NULL, WINHTTP_NO_REFERER, WINHTTP_DEFAULT_ACCEPT_TYPES,
-            (uc.nScheme == INTERNET_SCHEME_HTTPS) ? WINHTTP_FLAG_SECURE : 0);
-        BOOL res = WinHttpSendRequest(hRequest, 0, 0, 0, 0, 0, 0) && WinHttpReceiveResponse(hRequest, 0);
-        if (!res) { 
-            WinHttpCloseHandle(hRequest); WinHttpCloseHandle(hConnect); WinHttpCloseHandle(hSession); 
-            std::this_thread::sleep_for(std::chrono::milliseconds(600)); // retry delay
-            continue; 
-        }
-
-        DWORD dwSize = 0;
-        out.clear();
-        bool error = false;
-        do {
-            if (cancel_token && cancel_token->load()) { error = true; break; }
-            DWORD dwDownloaded = 0;
-            WinHttpQueryDataAvailable(hRequest, &dwSize);
-            if (!dwSize) break;
-            size_t prev_size = out.size();
-            out.resize(prev_size + dwSize);
-            if (!WinHttpReadData(hRequest, out.data() + prev_size, dwSize, &dwDownloaded) || dwDownloaded == 0)
-            {
-                error = true;
-                break;
-            }
-            if (dwDownloaded < dwSize) out.resize(prev_size + dwDownloaded);
-        } while (dwSize > 0);
-
-        WinHttpCloseHandle(hRequest); WinHttpCloseHandle(hConnect); WinHttpCloseHandle(hSession);
-        if (!error && !out.empty()) return true;
-        std::this_thread::sleep_for(std::chrono::milliseconds(600)); // retry delay
-    }
-    return false;
+    std::vector<uint8_t> data;
+    if (!tardsplaya::HttpClient::Shared().Get(url, data, cancel_token, nullptr, max_attempts) || data.empty()) return false;
+    out.assign(data.begin(), data.end());
+    return true;
 }
 
-// Utility: HTTP GET (returns as string)
-bool HttpGetText(const std::wstring& url, std::string& out, std::atomic<bool>* cancel_token) {
-    std::vector<char> data;
-    if (!HttpGetBinary(url, data, 3, cancel_token)) return false;
+// Utility: HTTP GET (returns as string), asking for a compressed playlist; response reports the bytes received and decoded
+bool HttpGetText(const std::wstring& url, std::string& out, std::atomic<bool>* cancel_token, tardsplaya::HttpResponse* response) {
+    std::vector<uint8_t> data;
+    if (!tardsplaya::HttpClient::Shared().Get(url, data, cancel_token, response, 3, &tardsplaya::CompressedTextHeaders()) ||
+        data.empty()) return false;
     out.assign(data.begin(), data.end());
     return true;
 }
@@ -477,10 +442,11 @@ static bool ValidatePlaylistMetadata(const std::string& playlist) {
 }
 
 // Parse media segment URLs from m3u8 playlist
-// Returns pair of (segments, should_clear_buffer)
-static std::pair<std::vector<std::wstring>, bool> ParseSegments(const std::string& playlist) {
+// Returns pair of (segments, should_clear_buffer); media_sequence is the sequence number of the first segment
+static std::pair<std::vector<std::wstring>, bool> ParseSegments(const std::string& playlist, int64_t& media_sequence) {
     std::vector<std::wstring> segs;
     bool should_clear_buffer = false;
+    media_sequence = tsduck_hls::ParseMediaSequence(playlist);
     
     std::istringstream ss(playlist);
     std::string line;
@@ -821,7 +787,7 @@ bool BufferAndPipeStreamToPlayer(
     // 4. IPC streaming with background download threads and direct piping
     std::queue<std::vector<char>> buffer_queue;
     std::mutex buffer_mutex;
-    std::set<std::wstring> seen_urls;
+    tsduck_hls::SegmentTracker segment_tracker; // Segments already handled, by media sequence number
     std::atomic<bool> download_running(true);
     std::atomic<bool> stream_ended_normally(false);
     std::atomic<bool> urgent_download_needed(false); // Signal for immediate download when buffer reaches 0
@@ -854,6 +820,16 @@ bool BufferAndPipeStreamToPlayer(
         int consecutive_errors = 0;
         const int max_consecutive_errors = 15; // ~30 seconds (2 sec intervals)
         
+        // New segments of each playlist download in parallel and are taken in sequence order
+        tsduck_transport::SegmentPool segment_pool;
+        tsduck_transport::SegmentPrefetcher prefetcher(
+            [](const std::wstring& url, const tsduck_transport::SegmentPrefetcher::ChunkSink& sink, std::atomic<bool>* token) {
+                return tardsplaya::HttpClient::Shared().Get(url, sink, token);
+            },
+            segment_pool);
+        std::wstring reload_url = media_playlist_url;   // Blocking reload for the next refresh when the server supports it
+        tsduck_hls::PollScheduler poll_scheduler;       // Next refresh from the segment publication cadence
+        
         AddDebugLog(L"[DOWNLOAD] Starting download thread for " + channel_name + 
                    L", startup_delay=" + std::to_wstring(startup_delay.count()) + L"ms");
         
@@ -896,7 +872,8 @@ bool BufferAndPipeStreamToPlayer(
             // Download current playlist
             std::string playlist;
             AddDebugLog(L"[DOWNLOAD] Fetching playlist for " + channel_name);
-            if (!HttpGetText(media_playlist_url, playlist, &cancel_token)) {
+            if (!HttpGetText(reload_url, playlist, &cancel_token)) {
+                reload_url = media_playlist_url;
                 consecutive_errors++;
                 AddDebugLog(L"[DOWNLOAD] Playlist fetch FAILED for " + channel_name + 
                            L", error " + std::to_wstring(consecutive_errors) + L"/" + 
@@ -905,6 +882,7 @@ bool BufferAndPipeStreamToPlayer(
                 continue;
             }
             consecutive_errors = 0;
+            auto playlist_received = std::chrono::steady_clock::now();
             AddDebugLog(L"[DOWNLOAD] Playlist fetch SUCCESS for " + channel_name + 
                        L", size=" + std::to_wstring(playlist.size()) + L" bytes");
 
@@ -922,10 +900,28 @@ bool BufferAndPipeStreamToPlayer(
                 continue;
             }
 
-            auto parse_result = ParseSegments(playlist);
+            int64_t media_sequence = 0;
+            auto parse_result = ParseSegments(playlist, media_sequence);
             auto segments = parse_result.first;
             bool should_clear_buffer = parse_result.second;
             
+            // A server that can block holds the next reload until the segment after the last one listed exists.
+            // Segments, not LL-HLS parts, are what this mode buffers. Otherwise the parsed playlist times the next poll.
+            tsduck_hls::PlaylistParser reload_parser;
+            bool poll_scheduled = reload_parser.ParsePlaylist(playlist);
+            reload_url = tsduck_hls::BlockingReloadUrl(reload_parser, media_playlist_url, true);
+            if (poll_scheduled) {
+                poll_scheduler.OnPlaylist(reload_parser, playlist_received);
+            }
+            
+            // Segments the playlist moved past before they could be downloaded
+            uint64_t missed_before = segment_tracker.GetStats().missed;
+            segment_tracker.BeginPlaylist(media_sequence, segments.size());
+            if (segment_tracker.GetStats().missed != missed_before) {
+                AddDebugLog(L"[SEGMENTS] Missed " + std::to_wstring(segment_tracker.GetStats().missed - missed_before) + 
+                           L" segments (" + std::to_wstring(segment_tracker.GetStats().missed) + L" total) for " + channel_name);
+            }
+            
             // TSDuck-enhanced analysis for dynamic buffer optimization - run on every playlist fetch
             static int tsduck_recommended_buffer = buffer_segments;
             static bool first_analysis_done = false;
@@ -970,6 +966,7 @@ bool BufferAndPipeStreamToPlayer(
                     std::queue<std::vector<char>> empty_queue;
                     buffer_queue.swap(empty_queue); // Clear the queue efficiently
                 }
+                prefetcher.Clear();
                 AddDebugLog(L"[AD_SKIP] Cleared " + std::to_wstring(cleared_segments) + 
                            L" buffered segments when entering/exiting ad block for " + channel_name);
             }
@@ -977,9 +974,42 @@ bool BufferAndPipeStreamToPlayer(
             AddDebugLog(L"[DOWNLOAD] Parsed " + std::to_wstring(segments.size()) + 
                        L" segments from playlist for " + channel_name);
             
+            // Start downloading the new segments that fit in the buffer; the loop below takes them in order
+            {
+                size_t buffered;
+                {
+                    std::lock_guard<std::mutex> lock(buffer_mutex);
+                    buffered = buffer_queue.size();
+                }
+                size_t room = static_cast<size_t>(dynamic_max_buffer.load());
+                room = (buffered < room) ? room - buffered : 0;
+                if (urgent_download_needed.load()) {
+                    room = std::max<size_t>(room, 1);
+                }
+                for (size_t index = 0; index < segments.size() && room > 0; ++index) {
+                    const int64_t sequence = media_sequence + static_cast<int64_t>(index);
+                    if (segments[index].find(L"http") == 0 && !segment_tracker.IsHandled(sequence)) {
+                        prefetcher.Enqueue(sequence, JoinUrl(media_playlist_url, segments[index]));
+                        room--;
+                    }
+                }
+                
+                // Twitch low latency: segments advertised with #EXT-X-TWITCH-PREFETCH start downloading while the
+                // edge produces them. They are buffered once a later playlist lists them, from the download under way.
+                for (const auto& prefetch : reload_parser.GetPrefetchSegments()) {
+                    if (room == 0) {
+                        break;
+                    }
+                    prefetcher.Enqueue(static_cast<int64_t>(prefetch.sequence_number), JoinUrl(media_playlist_url, prefetch.url));
+                    room--;
+                }
+            }
+            
             // Download new segments
             int new_segments_downloaded = 0;
-            for (auto& seg : segments) {
+            for (size_t index = 0; index < segments.size(); ++index) {
+                const std::wstring& seg = segments[index];
+                const int64_t sequence = media_sequence + static_cast<int64_t>(index);
                 if (!download_running || cancel_token.load()) {
                     AddDebugLog(L"[DOWNLOAD] Breaking segment loop - download_running=" + 
                                std::to_wstring(download_running.load()) + L", cancel=" + 
@@ -998,11 +1028,12 @@ bool BufferAndPipeStreamToPlayer(
                 // Skip segments that aren't regular .ts/.aac files
                 if (seg.find(L"http") != 0) {
                     AddDebugLog(L"[DOWNLOAD] Skipping non-HTTP segment: " + seg.substr(0, 50) + L"...");
+                    segment_tracker.MarkSkipped(sequence);
                     continue;
                 }
                 
                 // Check if this is a regular segment we've already seen
-                if (seen_urls.count(seg)) continue;
+                if (segment_tracker.IsHandled(sequence)) continue;
                 
                 // Check buffer size before downloading more (unless urgent download is needed)
                 size_t current_buffer_size;
@@ -1063,19 +1094,20 @@ bool BufferAndPipeStreamToPlayer(
                     }
                 }
                 
-                seen_urls.insert(seg);
+                segment_tracker.MarkProcessed(sequence);
                 std::wstring seg_url = JoinUrl(media_playlist_url, seg);
                 std::vector<char> seg_data;
                 
-                // Download with retries
+                // Prefetched (usually already complete); segments that did not fit when queued download here.
+                // Both retry on the shared connection pool.
                 bool download_ok = false;
-                for (int retry = 0; retry < 3; ++retry) {
-                    if (HttpGetBinary(seg_url, seg_data, 1, &cancel_token)) {
-                        download_ok = true;
-                        break;
-                    }
-                    if (!download_running || cancel_token.load()) break;
-                    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+                tsduck_transport::SegmentPrefetcher::Segment prefetched;
+                auto prefetch_result = prefetcher.Take(sequence, prefetched, &cancel_token);
+                if (prefetch_result == tsduck_transport::SegmentPrefetcher::Result::READY) {
+                    seg_data.assign(prefetched.data->begin(), prefetched.data->end());
+                    download_ok = true;
+                } else if (prefetch_result == tsduck_transport::SegmentPrefetcher::Result::NOT_QUEUED) {
+                    download_ok = HttpGetBinary(seg_url, seg_data, 3, &cancel_token);
                 }
 
                 if (download_ok && !seg_data.empty()) {
@@ -1102,17 +1134,39 @@ bool BufferAndPipeStreamToPlayer(
                 urgent_download_needed.store(false); // Reset the flag
                 AddDebugLog(L"[DOWNLOAD] Urgent download completed, immediately fetching next playlist for " + channel_name);
                 std::this_thread::sleep_for(std::chrono::milliseconds(200)); // Very short delay for urgent downloads
+            } else if (reload_url != media_playlist_url) {
+                AddDebugLog(L"[DOWNLOAD] Blocking reload for the next segment for " + channel_name);
+                if (new_segments_downloaded == 0) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(100)); // Server answered without a new segment
+                }
             } else {
-                AddDebugLog(L"[DOWNLOAD] Sleeping 1.5s before next playlist fetch for " + channel_name);
+                // Just before the next segment is due, sooner again while the playlist stays unchanged
+                auto now = std::chrono::steady_clock::now();
+                auto refresh_at = poll_scheduled ? poll_scheduler.NextPoll() : now + std::chrono::milliseconds(1500);
+                AddDebugLog(L"[DOWNLOAD] Sleeping " + std::to_wstring(std::chrono::duration_cast<std::chrono::milliseconds>(refresh_at - now).count()) + 
+                           L"ms before next playlist fetch for " + channel_name);
                 // Sleep with frequent cancellation checks for responsiveness
-                for (int i = 0; i < 15 && download_running.load() && !cancel_token.load(); ++i) {
-                    std::this_thread::sleep_for(std::chrono::milliseconds(100)); // Total 1.5 seconds, but check every 100ms
+                while (download_running.load() && !cancel_token.load()) {
+                    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(refresh_at - std::chrono::steady_clock::now());
+                    if (remaining.count() <= 0) {
+                        break;
+                    }
+                    std::this_thread::sleep_for(remaining < std::chrono::milliseconds(100) ? remaining : std::chrono::milliseconds(100));
                 }
             }
         }
         
         // Log exactly why the download loop ended
         AddDebugLog(L"[DOWNLOAD] *** DOWNLOAD THREAD ENDING *** for " + channel_name);
+        tsduck_transport::SegmentPrefetcher::Stats prefetch = prefetcher.GetStats();
+        AddDebugLog(L"[PREFETCH] " + std::to_wstring(prefetch.downloads) + L" segments downloaded ahead, " + 
+                   std::to_wstring(prefetch.failures) + L" failed, " + std::to_wstring(prefetch.discarded) + L" discarded, limit " + 
+                   std::to_wstring(prefetch.concurrency) + L", " + std::to_wstring(prefetch.in_flight_high_water) + 
+                   L" in flight at most, " + std::to_wstring(static_cast<int>(prefetch.throughput_bps / 1000)) + L" kbit/s for " + channel_name);
+        const tsduck_hls::PollScheduler::Stats& polls = poll_scheduler.GetStats();
+        AddDebugLog(L"[POLL] " + std::to_wstring(polls.polls) + L" playlist polls, " + std::to_wstring(polls.unchanged) + 
+                   L" unchanged, cadence " + std::to_wstring(static_cast<int>(polls.cadence_ms)) + L"ms, prediction error " + 
+                   std::to_wstring(static_cast<int>(polls.prediction_error_ms)) + L"ms for " + channel_name);
         AddDebugLog(L"[DOWNLOAD] Exit conditions: download_running=" + std::to_wstring(download_running.load()) +
                    L", cancel_token=" + std::to_wstring(cancel_token.load()) +
                    L", process_running=" + std::to_wstring(ProcessStillRunning(pi.hProcess, channel_name + L" final_check", pi.dwProcessId)) +
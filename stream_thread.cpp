@@ -17,7 +17,8 @@ std::thread StartStreamThread(
     size_t tab_index,
     const std::wstring& selected_quality,
     StreamingMode mode,
-    HANDLE* player_process_handle
+    HANDLE* player_process_handle,
+    const std::vector<PlaylistQuality>& abr_variants
 ) {
     // Check for TX-Queue IPC mode (new high-performance mode)
     if (mode == StreamingMode::TX_QUEUE_IPC) {
@@ -153,7 +154,7 @@ std::thread StartStreamThread(
         }
         
         return StartTransportStreamThread(player_path, playlist_url, cancel_token, log_callback,
-                                         base_buffer_packets, channel_name, chunk_count, main_window, tab_index, player_process_handle);
+                                         base_buffer_packets, channel_name, chunk_count, main_window, tab_index, player_process_handle, abr_variants);
     }
     
     // Use traditional HLS streaming
@@ -202,7 +203,8 @@ std::thread StartTransportStreamThread(
     std::atomic<int>* chunk_count,
     HWND main_window,
     size_t tab_index,
-    HANDLE* player_process_handle
+    HANDLE* player_process_handle,
+    const std::vector<PlaylistQuality>& abr_variants
 ) {
     return std::thread([=, &cancel_token]() mutable {
         if (log_callback)
@@ -232,6 +234,7 @@ std::thread StartTransportStreamThread(
             config.max_segments_to_buffer = 2;  // Only buffer latest 2 segments
             config.playlist_refresh_interval = std::chrono::milliseconds(500);  // Check every 500ms
             config.skip_old_segments = true;
+            config.abr_variants = abr_variants;
             
             if (log_callback) {
                 log_callback(L"[TS_MODE] Starting TSDuck transport stream routing");
@@ -280,6 +283,53 @@ std::thread StartTransportStreamThread(
                             }
                         }
                         
+                        // Output pacing: how late the stream arrives for its slots and how evenly it goes out
+                        if (stats.output_lag_ms > 0.0 || stats.output_jitter_ms > 0.0) {
+                            status_msg += L", Lag: " + std::to_wstring(static_cast<int>(stats.output_lag_ms)) + 
+                                         L"ms, Jitter: " + std::to_wstring(static_cast<int>(stats.output_jitter_ms)) + L"ms";
+                            if (stats.output_catching_up) {
+                                status_msg += L" [CATCHING_UP]";
+                            }
+                        }
+                        
+                        // Low-latency controller: queued stream time and the GOPs skipped to hold it
+                        if (stats.buffered_latency.count() > 0 || stats.latency_skips > 0) {
+                            status_msg += L", Latency: " + std::to_wstring(stats.buffered_latency.count()) + L"ms";
+                            if (stats.latency_skips > 0) {
+                                status_msg += L" (" + std::to_wstring(stats.latency_skips) + L" skips, " + 
+                                             std::to_wstring(stats.latency_bytes_skipped / 1024) + L"KB)";
+                            }
+                        }
+                        if (stats.unaligned_drops > 0) {
+                            status_msg += L", Mid-GOP drops: " + std::to_wstring(stats.unaligned_drops);
+                        }
+                        if (stats.segments_missed > 0) {
+                            status_msg += L", Missed segments: " + std::to_wstring(stats.segments_missed);
+                        }
+                        if (stats.segments_late > 0 || stats.segment_hedges > 0) {
+                            status_msg += L", Late segments: " + std::to_wstring(stats.segments_late) + L" (first byte p99 " + 
+                                         std::to_wstring(static_cast<int>(stats.first_byte_p99_ms)) + L"ms, " + 
+                                         std::to_wstring(stats.segment_hedges_won) + L"/" + std::to_wstring(stats.segment_hedges) + L" hedges won)";
+                        }
+                        
+                        // Automatic quality: the variant playing and the throughput estimate it was chosen from
+                        if (stats.abr_bandwidth > 0) {
+                            status_msg += L", ABR: " + std::to_wstring(stats.abr_bandwidth / 1000) + L"kbit/s of " +
+                                         std::to_wstring(static_cast<uint64_t>(stats.throughput_estimate_bps / 1000)) + L"kbit/s";
+                            if (stats.abr_switches_down + stats.abr_switches_up > 0) {
+                                status_msg += L" (" + std::to_wstring(stats.abr_switches_down) + L" down, " +
+                                             std::to_wstring(stats.abr_switches_up) + L" up)";
+                            }
+                        }
+                        
+                        // Per-PID table: total rate over the last second and lost packets on any PID
+                        if (stats.pid_stats && stats.pid_stats->bitrate_bps > 0.0) {
+                            status_msg += L", Rate: " + std::to_wstring(static_cast<int>(stats.pid_stats->bitrate_bps / 1000)) + L"kbit/s";
+                            if (stats.pid_stats->cc_errors > 0) {
+                                status_msg += L", CC errors: " + std::to_wstring(stats.pid_stats->cc_errors);
+                            }
+                        }
+                        
                         // Add video/audio health information
                         if (stats.video_packets_processed > 0 || stats.audio_packets_processed > 0) {
                             status_msg += L", Video: " + std::to_wstring(stats.video_packets_processed) + 
@@ -3,10 +3,12 @@
 #include <atomic>
 #include <thread>
 #include <functional>
+#include <vector>
 #define WIN32_LEAN_AND_MEAN
 #define _WINSOCKAPI_
 #define NOMINMAX  // Prevent min/max macro conflicts
 #include <windows.h>
+#include "playlist_parser.h"
 
 // Forward declarations for debug logging
 extern bool g_verboseDebug;
@@ -21,6 +23,8 @@ enum class StreamingMode {
 
 // Launches a thread to buffer and pipe the stream.
 // The callback is called with a log/status message (can be nullptr).
+// abr_variants: the master playlist's variants; transport stream mode switches between those
+// below the selected quality as throughput allows (empty keeps the quality fixed).
 // Returns the std::thread object (detached or to be joined by caller).
 std::thread StartStreamThread(
     const std::wstring& player_path,
@@ -35,7 +39,8 @@ std::thread StartStreamThread(
     size_t tab_index = 0,
     const std::wstring& selected_quality = L"",
     StreamingMode mode = StreamingMode::TX_QUEUE_IPC,
-    HANDLE* player_process_handle = nullptr
+    HANDLE* player_process_handle = nullptr,
+    const std::vector<PlaylistQuality>& abr_variants = {}
 );
 
 // Start TSDuck transport stream routing (alternative to traditional HLS streaming)
@@ -49,5 +54,6 @@ std::thread StartTransportStreamThread(
     std::atomic<int>* chunk_count = nullptr,
     HWND main_window = nullptr,
     size_t tab_index = 0,
-    HANDLE* player_process_handle = nullptr
+    HANDLE* player_process_handle = nullptr,
+    const std::vector<PlaylistQuality>& abr_variants = {}
 );
\ No newline at end of file
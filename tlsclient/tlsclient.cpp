@@ -3,6 +3,7 @@
 #include <algorithm>
 #include <winhttp.h>
 #include "../chunked_decode.h"
+#include "../inflater.h"
 
 #define NOMINMAX
 
@@ -21,6 +22,65 @@ std::string get_http_body(const std::string& resp) {
     return resp.substr(pos + 4);
 }
 
+// Helper: request headers plus Accept-Encoding, so API answers and playlists come compressed
+static std::wstring WithAcceptEncoding(const std::string& headers) {
+    std::wstring wHeaders(headers.begin(), headers.end());
+    if (!wHeaders.empty() && (wHeaders.size() < 2 || wHeaders.compare(wHeaders.size() - 2, 2, L"\r\n") != 0)) {
+        wHeaders += L"\r\n";
+    }
+    std::string accept = tardsplaya::ACCEPT_COMPRESSED;
+    return wHeaders + L"Accept-Encoding: " + std::wstring(accept.begin(), accept.end()) + L"\r\n";
+}
+
+// Helper: append the response body, read in place. Content-Length is reserved up front;
+// without it the buffer grows geometrically instead of by each chunk WinHTTP has ready.
+// A gzip or deflate body is decoded in place of what was read; false when it is corrupt.
+static bool ReadResponseBody(HINTERNET hRequest, std::string& response) {
+    const size_t bodyStart = response.size();
+    DWORD contentLength = 0;
+    DWORD lengthSize = sizeof(contentLength);
+    if (WinHttpQueryHeaders(hRequest, WINHTTP_QUERY_CONTENT_LENGTH | WINHTTP_QUERY_FLAG_NUMBER,
+        WINHTTP_HEADER_NAME_BY_INDEX, &contentLength, &lengthSize, WINHTTP_NO_HEADER_INDEX)) {
+        response.reserve(response.size() + contentLength);
+    }
+    
+    DWORD dwSize = 0;
+    do {
+        DWORD dwDownloaded = 0;
+        if (!WinHttpQueryDataAvailable(hRequest, &dwSize) || !dwSize) break;
+        
+        size_t prevSize = response.size();
+        if (prevSize + dwSize > response.capacity()) {
+            response.reserve((std::max)(prevSize + dwSize, 2 * response.capacity()));
+        }
+        response.resize(prevSize + dwSize);
+        if (!WinHttpReadData(hRequest, &response[prevSize], dwSize, &dwDownloaded)) {
+            dwDownloaded = 0;
+        }
+        response.resize(prevSize + dwDownloaded);
+        if (!dwDownloaded) break;
+    } while (dwSize > 0);
+    
+    wchar_t encoding[64] = {};
+    DWORD encodingSize = sizeof(encoding);
+    tardsplaya::Inflater::Format format;
+    if (!WinHttpQueryHeaders(hRequest, WINHTTP_QUERY_CONTENT_ENCODING, WINHTTP_HEADER_NAME_BY_INDEX,
+        encoding, &encodingSize, WINHTTP_NO_HEADER_INDEX) ||
+        !tardsplaya::Inflater::FormatOf(std::string(encoding, encoding + wcslen(encoding)), format)) {
+        return true;
+    }
+    tardsplaya::Inflater inflater(format);
+    std::vector<uint8_t> decoded;
+    decoded.reserve((response.size() - bodyStart) * 4);
+    if (inflater.Write(reinterpret_cast<const uint8_t*>(response.data()) + bodyStart, response.size() - bodyStart, decoded) !=
+        tardsplaya::Inflater::Status::DONE) {
+        return false;
+    }
+    response.resize(bodyStart);
+    response.append(decoded.begin(), decoded.end());
+    return true;
+}
+
 TLSClient::TLSClient() {
     lastError = "";
 }
@@ -100,7 +160,7 @@ bool TLSClient::HttpGet(const std::string& url, std::string& response, const std
     // Convert to wide strings for WinHTTP
     std::wstring wHost(host.begin(), host.end());
     std::wstring wPath(path.begin(), path.end());
-    std::wstring wHeaders(headers.begin(), headers.end());
+    std::wstring wHeaders = WithAcceptEncoding(headers);
     
     // Use WinHTTP with improved error handling
     HINTERNET hSession = WinHttpOpen(L"Tardsplaya TLS Client/1.0", WINHTTP_ACCESS_TYPE_DEFAULT_PROXY, NULL, NULL, 0);
@@ -140,19 +200,10 @@ bool TLSClient::HttpGet(const std::string& url, std::string& response, const std
         WINHTTP_NO_REQUEST_DATA, 0, 0, 0) && WinHttpReceiveResponse(hRequest, NULL);
     
     if (bResult) {
-        DWORD dwSize = 0;
-        do {
-            DWORD dwDownloaded = 0;
-            WinHttpQueryDataAvailable(hRequest, &dwSize);
-            if (!dwSize) break;
-            
-            size_t prevSize = response.size();
-            response.resize(prevSize + dwSize);
-            WinHttpReadData(hRequest, &response[prevSize], dwSize, &dwDownloaded);
-            if (dwDownloaded < dwSize) {
-                response.resize(prevSize + dwDownloaded);
-            }
-        } while (dwSize > 0);
+        if (!ReadResponseBody(hRequest, response)) {
+            lastError = "Failed to decode compressed response";
+            bResult = FALSE;
+        }
     } else {
         lastError = "Failed to send request or receive response";
     }
@@ -183,7 +234,7 @@ bool TLSClient::HttpPost(const std::string& url, const std::string& postData, st
     // Convert to wide strings for WinHTTP
     std::wstring wHost(host.begin(), host.end());
     std::wstring wPath(path.begin(), path.end());
-    std::wstring wHeaders(headers.begin(), headers.end());
+    std::wstring wHeaders = WithAcceptEncoding(headers);
     
     // Use WinHTTP with improved error handling
     HINTERNET hSession = WinHttpOpen(L"Tardsplaya TLS Client/1.0", WINHTTP_ACCESS_TYPE_DEFAULT_PROXY, NULL, NULL, 0);
@@ -247,30 +298,21 @@ bool TLSClient::HttpPost(const std::string& url, const std::string& postData, st
     WinHttpQueryHeaders(hRequest, WINHTTP_QUERY_STATUS_CODE | WINHTTP_QUERY_FLAG_NUMBER, 
         NULL, &dwStatusCode, &dwSize, NULL);
     
-    // Read response body
-    dwSize = 0;
-    do {
-        DWORD dwDownloaded = 0;
-        WinHttpQueryDataAvailable(hRequest, &dwSize);
-        if (!dwSize) break;
-        
-        size_t prevSize = response.size();
-        response.resize(prevSize + dwSize);
-        WinHttpReadData(hRequest, &response[prevSize], dwSize, &dwDownloaded);
-        if (dwDownloaded < dwSize) {
-            response.resize(prevSize + dwDownloaded);
-        }
-    } while (dwSize > 0);
-    
-    // Include status code in response for debugging
+    // Include status code in response for debugging; written first so the body is not copied behind it
     std::string statusInfo = "HTTP/" + std::to_string(dwStatusCode) + "\r\n\r\n";
-    response = statusInfo + response;
+    response.insert(0, statusInfo);
+    
+    // Read response body
+    bool decoded = ReadResponseBody(hRequest, response);
+    if (!decoded) {
+        lastError = "Failed to decode compressed response";
+    }
     
     WinHttpCloseHandle(hRequest);
     WinHttpCloseHandle(hConnect);
     WinHttpCloseHandle(hSession);
     
-    return true;
+    return decoded;
 }
 
 bool TLSClient::HttpPostW(const std::wstring& url, const std::string& postData, std::string& response, const std::wstring& headers) {
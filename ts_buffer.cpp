@@ -0,0 +1,519 @@
+#include "ts_buffer.h"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+namespace tsduck_transport {
+
+namespace {
+
+    // Frame index size for the latency controller (~68 s at 60 fps)
+    constexpr size_t MAX_FRAME_MARKS = 4096;
+
+} // namespace
+
+TSBuffer::TSBuffer(size_t max_packets)
+    : max_packets_(std::max<size_t>(1, max_packets)) {
+    // Dropped packets keep their slots until the consumer skips them, so leave some headroom
+    capacity_ = max_packets_ + std::max<size_t>(64, max_packets_ / 16);
+    payloads_.resize(capacity_ * TS_PACKET_SIZE);
+}
+
+void TSBuffer::SetZeroCopyMode(bool enabled) {
+    if (enabled) {
+        views_.assign(capacity_, nullptr);
+        std::vector<uint8_t>().swap(payloads_);
+    } else {
+        std::vector<const uint8_t*>().swap(views_);
+        payloads_.resize(capacity_ * TS_PACKET_SIZE);
+    }
+}
+
+void TSBuffer::SetLowLatencyMode(bool enabled) {
+    low_latency_mode_ = enabled;
+    if (enabled) {
+        frame_marks_.assign(MAX_FRAME_MARKS, FrameMark());
+    } else {
+        std::vector<FrameMark>().swap(frame_marks_);
+    }
+    frame_marks_first_ = 0;
+    frame_marks_count_ = 0;
+}
+
+void TSBuffer::SetMetadataEnabled(bool enabled) {
+    if (enabled) {
+        metadata_.assign(capacity_, PacketMeta());
+    } else {
+        // Release the memory rather than just clearing it
+        std::vector<PacketMeta>().swap(metadata_);
+    }
+}
+
+bool TSBuffer::AddPacket(const TSPacket& packet) {
+    return AddPackets(&packet, 1) == 1;
+}
+
+size_t TSBuffer::AddPackets(const TSPacket* packets, size_t count) {
+    if (IsZeroCopyMode()) {
+        // Pointer slots need backing storage; give the copies a segment of their own
+        auto segment = std::make_shared<std::vector<uint8_t>>(count * TS_PACKET_SIZE);
+        std::vector<PacketView> views(count);
+        for (size_t i = 0; i < count; ++i) {
+            memcpy(segment->data() + i * TS_PACKET_SIZE, packets[i].data, TS_PACKET_SIZE);
+            views[i].offset = static_cast<uint32_t>(i * TS_PACKET_SIZE);
+            views[i].meta = PacketMeta::FromPacket(packets[i]);
+        }
+        return AddPacketViews(segment, views.data(), count);
+    }
+
+    return AddPacketsImpl(count, [this, packets](size_t slot, size_t i) {
+        memcpy(&payloads_[slot * TS_PACKET_SIZE], packets[i].data, TS_PACKET_SIZE);
+        if (!metadata_.empty()) {
+            metadata_[slot] = PacketMeta::FromPacket(packets[i]);
+        }
+    }, [packets](size_t i) { return PacketMeta::FromPacket(packets[i]); });
+}
+
+size_t TSBuffer::AddPackets(const uint8_t* payloads, const PacketMeta* metas, size_t count) {
+    if (IsZeroCopyMode()) {
+        auto segment = std::make_shared<std::vector<uint8_t>>(payloads, payloads + count * TS_PACKET_SIZE);
+        std::vector<PacketView> views(count);
+        for (size_t i = 0; i < count; ++i) {
+            views[i].offset = static_cast<uint32_t>(i * TS_PACKET_SIZE);
+            views[i].meta = metas ? metas[i] : PacketMeta();
+        }
+        return AddPacketViews(segment, views.data(), count);
+    }
+
+    return AddPacketsImpl(count, [this, payloads, metas](size_t slot, size_t i) {
+        memcpy(&payloads_[slot * TS_PACKET_SIZE], payloads + i * TS_PACKET_SIZE, TS_PACKET_SIZE);
+        if (!metadata_.empty()) {
+            metadata_[slot] = metas ? metas[i] : PacketMeta();
+        }
+    }, [metas](size_t i) { return metas ? metas[i] : PacketMeta(); });
+}
+
+size_t TSBuffer::AddPacketViews(const SegmentBuffer& segment, const PacketView* views, size_t count) {
+    const uint8_t* base = segment->data();
+
+    if (!IsZeroCopyMode()) {
+        return AddPacketsImpl(count, [this, base, views](size_t slot, size_t i) {
+            memcpy(&payloads_[slot * TS_PACKET_SIZE], base + views[i].offset, TS_PACKET_SIZE);
+            if (!metadata_.empty()) {
+                metadata_[slot] = views[i].meta;
+            }
+        }, [views](size_t i) { return views[i].meta; });
+    }
+
+    // Register the segment before its packets become visible; end_index is an upper bound
+    // (packets dropped on overflow only make the segment live slightly longer)
+    PushSegmentRef(segment, tail_.load(std::memory_order_relaxed) + count);
+
+    return AddPacketsImpl(count, [this, base, views](size_t slot, size_t i) {
+        views_[slot] = base + views[i].offset;
+        if (!metadata_.empty()) {
+            metadata_[slot] = views[i].meta;
+        }
+    }, [views](size_t i) { return views[i].meta; });
+}
+
+template <typename StoreFn, typename MetaFn>
+size_t TSBuffer::AddPacketsImpl(size_t count, StoreFn store, MetaFn meta) {
+    uint64_t tail = tail_.load(std::memory_order_relaxed);
+    uint64_t discard = discard_until_.load(std::memory_order_relaxed);
+    uint64_t head = head_.load(std::memory_order_acquire);
+    size_t added = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t first = std::max(head, discard);
+        size_t buffered = static_cast<size_t>(tail - first);
+
+        // Over the limit - remove oldest packet to make room. This cuts a GOP, so in low-latency mode
+        // the latency target should skip whole GOPs well before it comes to this.
+        if (buffered >= max_packets_) {
+            discard = first + 1;
+            unaligned_drops_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // Ring physically full: the consumer is stalled and has not applied earlier drops yet
+        if (tail - head >= capacity_) {
+            head = head_.load(std::memory_order_acquire);
+            if (tail - head >= capacity_) {
+                packets_dropped_.fetch_add(1, std::memory_order_relaxed);
+                unaligned_drops_.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+        }
+
+        store(static_cast<size_t>(tail % capacity_), i);
+
+        // A new frame is the only point where the queued stream time grows
+        if (low_latency_mode_) {
+            PacketMeta packet_meta = meta(i);
+            if (packet_meta.access_units > 0 && packet_meta.frame_number > 0) {
+                RecordFrame(tail, packet_meta);
+                head = head_.load(std::memory_order_acquire);
+                discard = EnforceLatencyTarget(std::max(head, discard));
+            }
+        }
+        ++tail;
+        ++added;
+    }
+
+    // Publish the packets before the drop point so the consumer never sees discard beyond tail
+    tail_.store(tail, std::memory_order_release);
+    discard_until_.store(discard, std::memory_order_release);
+
+    if (added > 0) {
+        WakeConsumer();
+    }
+    return added;
+}
+
+void TSBuffer::RecordFrame(uint64_t index, const PacketMeta& meta) {
+    if (frame_marks_.empty()) {
+        return;
+    }
+    // Frame numbers that go backwards start a new timeline; the old marks cannot be compared with it
+    if (frame_marks_count_ > 0 && meta.frame_number <= FrameMarkAt(frame_marks_count_ - 1).frame_number) {
+        DropFrameMarks(frame_marks_count_);
+    }
+    if (frame_marks_count_ == frame_marks_.size()) {
+        DropFrameMarks(1);
+    }
+
+    FrameMark& mark = FrameMarkAt(frame_marks_count_);
+    mark.index = index;
+    mark.frame_number = meta.frame_number;
+    mark.key_frame = meta.Has(PacketMeta::KEY_FRAME);
+    frame_marks_count_++;
+
+    if (meta.frame_duration_ms > 0) {
+        frame_duration_ms_ = meta.frame_duration_ms;
+    }
+}
+
+uint64_t TSBuffer::EnforceLatencyTarget(uint64_t first) {
+    // Keep the mark of the frame the first queued packet belongs to; everything older is consumed
+    size_t consumed = 0;
+    while (consumed + 1 < frame_marks_count_ && FrameMarkAt(consumed + 1).index <= first) {
+        consumed++;
+    }
+    DropFrameMarks(consumed);
+    if (frame_marks_count_ == 0 || frame_duration_ms_ == 0) {
+        return first;
+    }
+
+    const uint64_t oldest_frame = FrameMarkAt(0).frame_number;
+    const uint64_t newest_frame = FrameMarkAt(frame_marks_count_ - 1).frame_number;
+    uint32_t buffered_ms = FramesToMs(newest_frame - oldest_frame);
+    buffered_ms_.store(buffered_ms, std::memory_order_relaxed);
+    if (latency_target_ms_ == 0 || buffered_ms <= latency_target_ms_) {
+        return first;
+    }
+
+    // The earliest key frame that brings the queue within the target, or failing that the latest one.
+    // With no key frame queued yet, wait for one: cutting anywhere else would break the GOP.
+    size_t landing = frame_marks_count_;
+    for (size_t i = 0; i < frame_marks_count_; ++i) {
+        const FrameMark& mark = FrameMarkAt(i);
+        if (!mark.key_frame || mark.index <= first) {
+            continue;
+        }
+        landing = i;
+        if (FramesToMs(newest_frame - mark.frame_number) <= latency_target_ms_) {
+            break;
+        }
+    }
+    if (landing == frame_marks_count_) {
+        return first;
+    }
+
+    const uint64_t skip_to = FrameMarkAt(landing).index;
+    const uint64_t landing_frame = FrameMarkAt(landing).frame_number;
+    uint32_t remaining_ms = FramesToMs(newest_frame - landing_frame);
+    latency_skips_.fetch_add(1, std::memory_order_relaxed);
+    latency_packets_skipped_.fetch_add(skip_to - first, std::memory_order_relaxed);
+    latency_frames_skipped_.fetch_add(landing_frame - oldest_frame, std::memory_order_relaxed);
+    last_skip_from_ms_.store(buffered_ms, std::memory_order_relaxed);
+    last_skip_to_ms_.store(remaining_ms, std::memory_order_relaxed);
+    buffered_ms_.store(remaining_ms, std::memory_order_relaxed);
+
+    DropFrameMarks(landing);
+    return skip_to;
+}
+
+void TSBuffer::DropFrameMarks(size_t count) {
+    frame_marks_first_ = (frame_marks_first_ + count) % frame_marks_.size();
+    frame_marks_count_ -= count;
+}
+
+uint32_t TSBuffer::FramesToMs(uint64_t frames) const {
+    return static_cast<uint32_t>(std::min<uint64_t>(frames * frame_duration_ms_, UINT32_MAX));
+}
+
+TSBuffer::LatencyStats TSBuffer::GetLatencyStats() const {
+    LatencyStats stats;
+    stats.skips = latency_skips_.load(std::memory_order_relaxed);
+    stats.packets_skipped = latency_packets_skipped_.load(std::memory_order_relaxed);
+    stats.bytes_skipped = stats.packets_skipped * TS_PACKET_SIZE;
+    stats.frames_skipped = latency_frames_skipped_.load(std::memory_order_relaxed);
+    stats.buffered_ms = buffered_ms_.load(std::memory_order_relaxed);
+    stats.last_skip_from_ms = last_skip_from_ms_.load(std::memory_order_relaxed);
+    stats.last_skip_to_ms = last_skip_to_ms_.load(std::memory_order_relaxed);
+    stats.unaligned_drops = unaligned_drops_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+bool TSBuffer::WaitForSpace(size_t resume_below, std::chrono::milliseconds timeout) {
+    resume_below = std::max<size_t>(1, resume_below);
+    if (GetOccupiedSlots() < resume_below) {
+        return true;
+    }
+
+    std::unique_lock<std::mutex> lock(wait_mutex_);
+    producer_wait_level_.store(resume_below);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    bool ready = space_available_.wait_for(lock, timeout, [this, resume_below]() {
+        return GetOccupiedSlots() < resume_below || !producer_active_.load();
+    });
+    producer_wait_level_.store(0);
+    return ready && producer_active_.load();
+}
+
+bool TSBuffer::GetNextPacket(TSPacket& packet, std::chrono::milliseconds timeout) {
+    TSPacket result;
+    PacketMeta meta;
+    if (GetPackets(result.data, &meta, 1, timeout) != 1) {
+        return false;
+    }
+
+    // Rebuild the full packet; without metadata only the header fields are available
+    if (!metadata_.empty()) {
+        meta.ApplyTo(result);
+    } else {
+        result.ParseHeader();
+    }
+    packet = result;
+    return true;
+}
+
+size_t TSBuffer::GetPackets(uint8_t* payloads, PacketMeta* metas, size_t max_count, std::chrono::milliseconds timeout) {
+    const bool copy_metadata = metas && !metadata_.empty();
+    return WaitAndPop(max_count, timeout, [this, payloads, metas, copy_metadata](size_t slot, size_t i) {
+        const uint8_t* source = views_.empty() ? &payloads_[slot * TS_PACKET_SIZE] : views_[slot];
+        memcpy(payloads + i * TS_PACKET_SIZE, source, TS_PACKET_SIZE);
+        if (copy_metadata) {
+            metas[i] = metadata_[slot];
+        }
+    });
+}
+
+size_t TSBuffer::GetPacketViews(const uint8_t** payloads, PacketMeta* metas, size_t max_count, std::chrono::milliseconds timeout) {
+    const bool copy_metadata = metas && !metadata_.empty();
+
+    if (IsZeroCopyMode()) {
+        return WaitAndPop(max_count, timeout, [this, payloads, metas, copy_metadata](size_t slot, size_t i) {
+            payloads[i] = views_[slot];
+            if (copy_metadata) {
+                metas[i] = metadata_[slot];
+            }
+        });
+    }
+
+    // Copy mode: arena slots can be reused as soon as head_ moves, so hand out stable copies
+    if (view_staging_.size() < max_count * TS_PACKET_SIZE) {
+        view_staging_.resize(max_count * TS_PACKET_SIZE);
+    }
+    return WaitAndPop(max_count, timeout, [this, payloads, metas, copy_metadata](size_t slot, size_t i) {
+        uint8_t* copy = &view_staging_[i * TS_PACKET_SIZE];
+        memcpy(copy, &payloads_[slot * TS_PACKET_SIZE], TS_PACKET_SIZE);
+        payloads[i] = copy;
+        if (copy_metadata) {
+            metas[i] = metadata_[slot];
+        }
+    });
+}
+
+template <typename LoadFn>
+size_t TSBuffer::WaitAndPop(size_t max_count, std::chrono::milliseconds timeout, LoadFn load) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+
+    while (true) {
+        size_t count = PopAvailable(max_count, load);
+        if (count > 0) {
+            return count;
+        }
+
+        if (!producer_active_.load()) {
+            // Packets added just before end of stream are still delivered
+            return PopAvailable(max_count, load);
+        }
+
+        std::unique_lock<std::mutex> lock(wait_mutex_);
+        consumer_waiting_.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool ready = data_available_.wait_until(lock, deadline, [this]() {
+            return tail_.load(std::memory_order_acquire) > std::max(head_.load(std::memory_order_relaxed),
+                                                                    discard_until_.load(std::memory_order_acquire)) ||
+                   !producer_active_.load();
+        });
+        consumer_waiting_.store(false);
+
+        if (!ready) {
+            return 0;
+        }
+    }
+}
+
+template <typename LoadFn>
+size_t TSBuffer::PopAvailable(size_t max_count, LoadFn load) {
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    uint64_t discard = discard_until_.load(std::memory_order_acquire);
+    uint64_t tail = tail_.load(std::memory_order_acquire);
+    bool skipped = false;
+
+    // Everything before head was handed out by an earlier call, so its segments can go
+    if (IsZeroCopyMode()) {
+        ReleaseConsumedSegments(head);
+    }
+
+    // Apply drops requested by the producer (drop policy, latency skip or Clear)
+    if (discard > head) {
+        uint64_t skip_to = std::min(discard, tail);
+        packets_dropped_.fetch_add(skip_to - head, std::memory_order_relaxed);
+        gaps_.fetch_add(1, std::memory_order_release);
+        head = skip_to;
+        skipped = true;
+    }
+
+    size_t count = static_cast<size_t>(std::min<uint64_t>(tail - head, max_count));
+    size_t slot = static_cast<size_t>(head % capacity_);
+    for (size_t i = 0; i < count; ++i) {
+        load(slot, i);
+        if (++slot == capacity_) {
+            slot = 0;
+        }
+    }
+
+    if (count > 0 || skipped) {
+        head_.store(head + count, std::memory_order_release);
+        WakeProducer();
+    }
+    return count;
+}
+
+void TSBuffer::PushSegmentRef(const SegmentBuffer& segment, uint64_t end_index) {
+    std::lock_guard<std::mutex> lock(segments_mutex_);
+    if (segment_refs_count_ == segment_refs_.size()) {
+        // Grow by unrolling the circular order into a larger vector
+        std::vector<SegmentRef> grown(std::max<size_t>(16, segment_refs_.size() * 2));
+        for (size_t i = 0; i < segment_refs_count_; ++i) {
+            grown[i] = std::move(segment_refs_[(segment_refs_first_ + i) % segment_refs_.size()]);
+        }
+        segment_refs_.swap(grown);
+        segment_refs_first_ = 0;
+    }
+    SegmentRef& ref = segment_refs_[(segment_refs_first_ + segment_refs_count_) % segment_refs_.size()];
+    ref.end_index = end_index;
+    ref.segment = segment;
+    segment_refs_count_++;
+}
+
+void TSBuffer::ReleaseConsumedSegments(uint64_t head) {
+    std::lock_guard<std::mutex> lock(segments_mutex_);
+    while (segment_refs_count_ > 0) {
+        SegmentRef& ref = segment_refs_[segment_refs_first_];
+        if (ref.end_index > head) {
+            break;
+        }
+        ref.segment.reset();
+        segment_refs_first_ = (segment_refs_first_ + 1) % segment_refs_.size();
+        segment_refs_count_--;
+    }
+}
+
+size_t TSBuffer::GetBufferedPackets() const {
+    // Load order matters: head and discard never pass tail, so tail is read last
+    uint64_t head = head_.load(std::memory_order_acquire);
+    uint64_t discard = discard_until_.load(std::memory_order_acquire);
+    uint64_t tail = tail_.load(std::memory_order_acquire);
+    uint64_t first = std::max(head, discard);
+    return tail > first ? static_cast<size_t>(tail - first) : 0;
+}
+
+size_t TSBuffer::GetOccupiedSlots() const {
+    uint64_t head = head_.load(std::memory_order_acquire);
+    uint64_t tail = tail_.load(std::memory_order_acquire);
+    return tail > head ? static_cast<size_t>(tail - head) : 0;
+}
+
+bool TSBuffer::IsEmpty() const {
+    return GetBufferedPackets() == 0;
+}
+
+bool TSBuffer::IsFull() const {
+    return GetBufferedPackets() >= max_packets_;
+}
+
+void TSBuffer::Clear() {
+    discard_until_.store(tail_.load(std::memory_order_relaxed), std::memory_order_release);
+    WakeProducer();
+}
+
+void TSBuffer::Reset() {
+    {
+        std::lock_guard<std::mutex> lock(segments_mutex_);
+        for (auto& ref : segment_refs_) {
+            ref.segment.reset();
+        }
+        segment_refs_first_ = 0;
+        segment_refs_count_ = 0;
+    }
+    head_ = 0;
+    tail_ = 0;
+    discard_until_ = 0;
+    packets_dropped_ = 0;
+    gaps_ = 0;
+    producer_active_ = true;
+
+    frame_marks_first_ = 0;
+    frame_marks_count_ = 0;
+    frame_duration_ms_ = 0;
+    latency_skips_ = 0;
+    latency_packets_skipped_ = 0;
+    latency_frames_skipped_ = 0;
+    buffered_ms_ = 0;
+    last_skip_from_ms_ = 0;
+    last_skip_to_ms_ = 0;
+    unaligned_drops_ = 0;
+}
+
+void TSBuffer::SignalEndOfStream() {
+    producer_active_ = false;
+
+    // Wake both sides unconditionally so no waiter sleeps until its timeout
+    std::lock_guard<std::mutex> lock(wait_mutex_);
+    data_available_.notify_all();
+    space_available_.notify_all();
+}
+
+void TSBuffer::WakeConsumer() {
+    // Pairs with the fence in GetPackets: either the consumer sees the new tail or we see it waiting
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (consumer_waiting_.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(wait_mutex_);
+        data_available_.notify_one();
+    }
+}
+
+void TSBuffer::WakeProducer() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    size_t wait_level = producer_wait_level_.load(std::memory_order_relaxed);
+    if (wait_level > 0 && GetOccupiedSlots() < wait_level) {
+        std::lock_guard<std::mutex> lock(wait_mutex_);
+        space_available_.notify_one();
+    }
+}
+
+} // namespace tsduck_transport
@@ -0,0 +1,219 @@
+#pragma once
+// Transport Stream packet buffer between the HLS fetcher and TS router threads
+// Bounded single-producer/single-consumer ring: the fetcher thread is the only producer and the
+// router thread the only consumer, so packets move without locks and waits block instead of polling.
+// Storage is split: payloads live in a contiguous 188-byte-stride arena and the compact PacketMeta
+// array beside it is only allocated and filled when frame statistics are enabled. In zero-copy mode
+// the arena is replaced by pointers into the downloaded segments, which the buffer keeps alive.
+// In low-latency mode an index of the queued frames bounds latency: when more stream time than the
+// target is queued, the consumer is moved to a key frame in one step instead of dropping packets.
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include "ts_packet.h"
+
+namespace tsduck_transport {
+
+    // Keeps producer and consumer indices on separate cache lines
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+
+    // Transport Stream buffer for smooth re-routing
+    class TSBuffer {
+    public:
+        TSBuffer(size_t max_packets = 25000); // ~4.7MB buffer for smooth multi-stream streaming
+
+        // Producer side (HLS fetcher thread) ------------------------------------------
+
+        // Add TS packet to buffer; the oldest packets are dropped when the buffer is over its limit
+        // (in low-latency mode, whole GOPs are skipped first once the latency target is exceeded)
+        bool AddPacket(const TSPacket& packet);
+
+        // Add a run of packets with a single publish/wake-up; returns the number accepted
+        size_t AddPackets(const TSPacket* packets, size_t count);
+
+        // Add count contiguous raw packets (count * TS_PACKET_SIZE bytes); metas may be null
+        size_t AddPackets(const uint8_t* payloads, const PacketMeta* metas, size_t count);
+
+        // Add packets that live inside segment. In zero-copy mode only pointers are queued and the
+        // segment is released once the consumer is past its last packet; otherwise payloads are copied.
+        size_t AddPacketViews(const SegmentBuffer& segment, const PacketView* views, size_t count);
+
+        // Block until fewer than resume_below slots are occupied (or end of stream / timeout).
+        // Callers waiting at a high watermark should resume at a lower one so they are not woken per packet.
+        bool WaitForSpace(size_t resume_below, std::chrono::milliseconds timeout);
+
+        // Clear buffer (for discontinuities) - the consumer skips everything queued so far
+        void Clear();
+
+        // Signal end of stream (no more packets will be added)
+        void SignalEndOfStream();
+
+        // Consumer side (TS router thread) ---------------------------------------------
+
+        // Get next packet from buffer (blocking until available)
+        bool GetNextPacket(TSPacket& packet, std::chrono::milliseconds timeout = std::chrono::milliseconds(1000));
+
+        // Get up to max_count packets, blocking until at least one is available; returns the count.
+        // Payloads are copied back to back into payloads (max_count * TS_PACKET_SIZE bytes) so they can be
+        // written out in one go. metas is filled only when metadata is enabled and may be null.
+        size_t GetPackets(uint8_t* payloads, PacketMeta* metas, size_t max_count,
+                          std::chrono::milliseconds timeout = std::chrono::milliseconds(1000));
+
+        // Like GetPackets but hands out pointers to the packets instead of copying them (in zero-copy
+        // mode). The pointers stay valid until the next GetPackets/GetPacketViews call.
+        size_t GetPacketViews(const uint8_t** payloads, PacketMeta* metas, size_t max_count,
+                              std::chrono::milliseconds timeout = std::chrono::milliseconds(1000));
+
+        // Any thread -------------------------------------------------------------------
+
+        // Get buffer status
+        size_t GetBufferedPackets() const;
+        // Ring slots in use, including skipped packets the consumer has not stepped over yet. Producers
+        // flow-control on this: skips and drops only free slots once the consumer applies them.
+        size_t GetOccupiedSlots() const;
+        bool IsEmpty() const;
+        bool IsFull() const;
+        size_t GetMaxPackets() const { return max_packets_; }
+
+        // Allocated storage, and what each buffered packet costs with the current metadata setting
+        size_t GetMemoryBytes() const {
+            return payloads_.size() + views_.size() * sizeof(const uint8_t*) + metadata_.size() * sizeof(PacketMeta);
+        }
+        size_t GetBytesPerPacket() const { return GetMemoryBytes() / max_packets_; }
+
+        // Packets skipped by the drop policy, Clear() or because the consumer stalled with the ring full
+        uint64_t GetDroppedPackets() const { return packets_dropped_.load(std::memory_order_relaxed); }
+
+        // Times the consumer has jumped over skipped or dropped packets. The packets handed out after a
+        // gap do not continue the ones before it (timestamps jump), so consumers pacing output resync.
+        uint64_t GetGapCount() const { return gaps_.load(std::memory_order_acquire); }
+
+        // Low-latency controller results
+        struct LatencyStats {
+            uint64_t skips = 0;              // Jumps to a key frame
+            uint64_t packets_skipped = 0;
+            uint64_t bytes_skipped = 0;
+            uint64_t frames_skipped = 0;
+            uint32_t buffered_ms = 0;        // Queued stream time when the last frame was added
+            uint32_t last_skip_from_ms = 0;  // Queued stream time before and after the last skip
+            uint32_t last_skip_to_ms = 0;
+            uint64_t unaligned_drops = 0;    // Packets dropped mid-GOP (over the hard limit or ring full);
+                                             // the player cannot decode the frames up to the next key frame
+        };
+        LatencyStats GetLatencyStats() const;
+
+        // Reset buffer state for new stream (only while neither thread is running)
+        void Reset();
+
+        // Check if producer is still active
+        bool IsProducerActive() const { return producer_active_.load(); }
+
+        // Enable low-latency mode: keep the queued stream time at the latency target by skipping to
+        // key frames (only while neither thread is running)
+        void SetLowLatencyMode(bool enabled);
+        void SetLatencyTarget(std::chrono::milliseconds target) { latency_target_ms_ = static_cast<uint32_t>(target.count()); }
+
+        // Keep per-packet metadata for frame statistics (only while neither thread is running)
+        void SetMetadataEnabled(bool enabled);
+        bool IsMetadataEnabled() const { return !metadata_.empty(); }
+
+        // Queue pointers into shared segments instead of payload copies (only while neither thread is running)
+        void SetZeroCopyMode(bool enabled);
+        bool IsZeroCopyMode() const { return !views_.empty(); }
+
+    private:
+        size_t max_packets_;                     // Logical limit enforced by the drop policy
+        size_t capacity_;                        // Physical slots: max_packets_ plus room for drops not yet applied
+        std::vector<uint8_t> payloads_;          // capacity_ * TS_PACKET_SIZE, slot i at i * TS_PACKET_SIZE
+        std::vector<const uint8_t*> views_;      // Zero-copy mode: capacity_ packet pointers instead of payloads_
+        std::vector<PacketMeta> metadata_;       // capacity_ entries when enabled, empty otherwise
+        std::atomic<bool> producer_active_{true};
+        bool low_latency_mode_{false};
+        uint32_t latency_target_ms_{3000};
+        std::atomic<uint64_t> packets_dropped_{0};
+        std::atomic<uint64_t> gaps_{0};
+
+        // Consumer-owned: next packet to read. Indices only grow, slot = index % capacity_
+        alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> head_{0};
+        std::atomic<bool> consumer_waiting_{false};
+
+        // Producer-owned: next slot to write, and the index the consumer must skip up to.
+        // Old packets are dropped by moving discard_until_ forward, since only the consumer may advance head_.
+        alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> tail_{0};
+        std::atomic<uint64_t> discard_until_{0};
+        std::atomic<size_t> producer_wait_level_{0}; // Non-zero while the producer sleeps in WaitForSpace
+
+        // Producer-owned frame index for the latency controller: one mark per packet that starts a
+        // frame, oldest first, pruned to the last frame starting at or before the first queued packet.
+        // When full the oldest marks are forgotten, which only makes the queued time look shorter.
+        struct FrameMark {
+            uint64_t index = 0;              // Ring index of the packet
+            uint64_t frame_number = 0;
+            bool key_frame = false;
+        };
+        std::vector<FrameMark> frame_marks_;     // Circular, allocated in low-latency mode
+        size_t frame_marks_first_ = 0;
+        size_t frame_marks_count_ = 0;
+        uint32_t frame_duration_ms_ = 0;
+
+        // Latency controller stats, written by the producer
+        std::atomic<uint64_t> latency_skips_{0};
+        std::atomic<uint64_t> latency_packets_skipped_{0};
+        std::atomic<uint64_t> latency_frames_skipped_{0};
+        std::atomic<uint32_t> buffered_ms_{0};
+        std::atomic<uint32_t> last_skip_from_ms_{0};
+        std::atomic<uint32_t> last_skip_to_ms_{0};
+        std::atomic<uint64_t> unaligned_drops_{0};
+
+        // Zero-copy mode: segments referenced by queued pointers, oldest first. A segment is released
+        // once head_ reaches end_index, i.e. on the consumer call after its last packet was handed out.
+        struct SegmentRef {
+            uint64_t end_index = 0;
+            SegmentBuffer segment;
+        };
+        std::mutex segments_mutex_;
+        std::vector<SegmentRef> segment_refs_;   // Circular, grows only when more segments are queued than ever before
+        size_t segment_refs_first_ = 0;
+        size_t segment_refs_count_ = 0;
+        std::vector<uint8_t> view_staging_;      // Consumer-owned copies handed out by GetPacketViews in copy mode
+
+        // Blocking waits only touch the mutex when the other side is actually asleep
+        alignas(CACHE_LINE_SIZE) std::mutex wait_mutex_;
+        std::condition_variable data_available_;
+        std::condition_variable space_available_;
+
+        // Shared producer path; store(slot, i) fills ring slot `slot` with input packet i and
+        // meta(i) returns its metadata for the frame index
+        template <typename StoreFn, typename MetaFn>
+        size_t AddPacketsImpl(size_t count, StoreFn store, MetaFn meta);
+
+        // Frame index: record the frame starting at ring index `index`, then return where the consumer
+        // should start so no more than the latency target is queued (first if no skip is needed)
+        void RecordFrame(uint64_t index, const PacketMeta& meta);
+        uint64_t EnforceLatencyTarget(uint64_t first);
+        FrameMark& FrameMarkAt(size_t i) { return frame_marks_[(frame_marks_first_ + i) % frame_marks_.size()]; }
+        void DropFrameMarks(size_t count);
+        uint32_t FramesToMs(uint64_t frames) const;
+
+        // Shared consumer path; load(slot, i) hands ring slot `slot` out as output packet i
+        template <typename LoadFn>
+        size_t WaitAndPop(size_t max_count, std::chrono::milliseconds timeout, LoadFn load);
+
+        // Hand out whatever is readable without blocking, applying pending drops first
+        template <typename LoadFn>
+        size_t PopAvailable(size_t max_count, LoadFn load);
+
+        void PushSegmentRef(const SegmentBuffer& segment, uint64_t end_index);
+        void ReleaseConsumedSegments(uint64_t head);
+
+        void WakeConsumer();
+        void WakeProducer();
+    };
+
+} // namespace tsduck_transport
@@ -0,0 +1,264 @@
+// Contention benchmark for the TS packet buffer
+// Runs the fetcher/router producer-consumer pattern against the previous mutex + std::queue TSBuffer
+// (copied below as LegacyTSBuffer) and the SPSC ring in ts_buffer.cpp, reporting throughput and
+// how long a packet waits between being added and being picked up by the consumer, plus the memory
+// each layout needs per buffered second of stream.
+//
+// Build: g++ -std=c++17 -O2 ts_buffer_bench.cpp ts_buffer.cpp ts_packet.cpp -o ts_buffer_bench -pthread
+
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <vector>
+#include <queue>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <string>
+#include <cstring>
+#include "ts_buffer.h"
+
+using namespace tsduck_transport;
+using Clock = std::chrono::steady_clock;
+
+// The packet layout the old buffer stored: full TSPacket plus its steady_clock timestamp
+struct LegacyTSPacket {
+    TSPacket packet;
+    Clock::time_point timestamp;
+};
+
+// The TSBuffer implementation this ring replaced (standard mode only)
+class LegacyTSBuffer {
+public:
+    explicit LegacyTSBuffer(size_t max_packets) : max_packets_(max_packets) {}
+
+    bool AddPacket(const LegacyTSPacket& packet) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (packet_queue_.size() >= max_packets_) {
+            packet_queue_.pop();
+        }
+        packet_queue_.push(packet);
+        return true;
+    }
+
+    bool GetNextPacket(LegacyTSPacket& packet, std::chrono::milliseconds timeout) {
+        auto start_time = Clock::now();
+        while (Clock::now() - start_time < timeout) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (!packet_queue_.empty()) {
+                    packet = packet_queue_.front();
+                    packet_queue_.pop();
+                    return true;
+                }
+            }
+            if (!producer_active_) {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return false;
+    }
+
+    size_t GetBufferedPackets() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return packet_queue_.size();
+    }
+
+    void SignalEndOfStream() { producer_active_ = false; }
+    bool IsProducerActive() const { return producer_active_; }
+
+private:
+    mutable std::mutex mutex_;
+    std::queue<LegacyTSPacket> packet_queue_;
+    size_t max_packets_;
+    std::atomic<bool> producer_active_{true};
+};
+
+// The ring has no timestamp field, so the send time rides in the payload bytes after the header
+static void StampPayload(uint8_t* payload, Clock::time_point now) {
+    int64_t ticks = now.time_since_epoch().count();
+    memcpy(payload + 4, &ticks, sizeof(ticks));
+}
+
+static Clock::time_point PayloadStamp(const uint8_t* payload) {
+    int64_t ticks;
+    memcpy(&ticks, payload + 4, sizeof(ticks));
+    return Clock::time_point(Clock::duration(ticks));
+}
+
+struct BenchResult {
+    double seconds = 0.0;
+    uint64_t received = 0;
+    std::vector<double> wait_us; // Per-packet add -> get latency
+};
+
+// Producer pushes segments of segment_packets, waiting segment_gap between them (0 = flat out).
+// Flow control mirrors the HLS fetcher: stay under 90% of the buffer (the ring resumes at 25%).
+template <typename Producer, typename Consumer>
+static BenchResult RunPattern(size_t total_packets, size_t segment_packets, std::chrono::microseconds segment_gap,
+                              Producer produce, Consumer consume) {
+    BenchResult result;
+    result.wait_us.reserve(total_packets);
+
+    auto start = Clock::now();
+    std::thread consumer([&]() { consume(result); });
+
+    std::vector<LegacyTSPacket> segment(segment_packets);
+    for (size_t i = 0; i < segment_packets; ++i) {
+        segment[i].packet.data[0] = 0x47;
+    }
+    size_t sent = 0;
+    while (sent < total_packets) {
+        size_t count = std::min(segment_packets, total_packets - sent);
+        auto now = Clock::now();
+        for (size_t i = 0; i < count; ++i) {
+            segment[i].timestamp = now;
+            StampPayload(segment[i].packet.data, now);
+        }
+        produce(segment.data(), count);
+        sent += count;
+        if (segment_gap.count() > 0) {
+            std::this_thread::sleep_for(segment_gap);
+        }
+    }
+    produce(nullptr, 0); // End of stream
+    consumer.join();
+
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return result;
+}
+
+static BenchResult RunLegacy(size_t total, size_t segment_packets, std::chrono::microseconds gap) {
+    LegacyTSBuffer buffer(15000);
+    const size_t high_watermark = 15000 * 9 / 10;
+    return RunPattern(total, segment_packets, gap,
+        [&](const LegacyTSPacket* packets, size_t count) {
+            if (!packets) {
+                buffer.SignalEndOfStream();
+                return;
+            }
+            for (size_t i = 0; i < count; ++i) {
+                while (buffer.GetBufferedPackets() >= high_watermark) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                }
+                buffer.AddPacket(packets[i]);
+            }
+        },
+        [&](BenchResult& result) {
+            LegacyTSPacket packet;
+            while (true) {
+                if (buffer.GetNextPacket(packet, std::chrono::milliseconds(50))) {
+                    result.received++;
+                    result.wait_us.push_back(std::chrono::duration<double, std::micro>(Clock::now() - packet.timestamp).count());
+                } else if (!buffer.IsProducerActive() && buffer.GetBufferedPackets() == 0) {
+                    break;
+                }
+            }
+        });
+}
+
+static BenchResult RunRing(size_t total, size_t segment_packets, std::chrono::microseconds gap, size_t pop_batch) {
+    TSBuffer buffer(15000);
+    std::vector<TSPacket> staging(segment_packets);
+    const size_t high_watermark = 15000 * 9 / 10;
+    const size_t low_watermark = 15000 / 4;
+    return RunPattern(total, segment_packets, gap,
+        [&](const LegacyTSPacket* packets, size_t count) {
+            if (!packets) {
+                buffer.SignalEndOfStream();
+                return;
+            }
+            for (size_t i = 0; i < count; ++i) {
+                staging[i] = packets[i].packet;
+            }
+            size_t next = 0;
+            while (next < count) {
+                size_t buffered = buffer.GetBufferedPackets();
+                if (buffered >= high_watermark) {
+                    buffer.WaitForSpace(low_watermark, std::chrono::milliseconds(50));
+                    continue;
+                }
+                size_t run = std::min(high_watermark - buffered, count - next);
+                buffer.AddPackets(staging.data() + next, run);
+                next += run;
+            }
+        },
+        [&](BenchResult& result) {
+            std::vector<uint8_t> batch(pop_batch * TS_PACKET_SIZE);
+            while (true) {
+                size_t got = buffer.GetPackets(batch.data(), nullptr, pop_batch, std::chrono::milliseconds(50));
+                auto now = Clock::now();
+                for (size_t i = 0; i < got; ++i) {
+                    result.received++;
+                    result.wait_us.push_back(std::chrono::duration<double, std::micro>(now - PayloadStamp(&batch[i * TS_PACKET_SIZE])).count());
+                }
+                if (got == 0 && !buffer.IsProducerActive() && buffer.IsEmpty()) {
+                    break;
+                }
+            }
+        });
+}
+
+static double Percentile(std::vector<double>& values, double p) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    size_t index = static_cast<size_t>(p * (values.size() - 1));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+static void Report(const std::string& label, BenchResult r, size_t expected) {
+    // Latency of the first packet in each burst is what the 1ms sleep poll hurts; report the tail
+    double p50 = Percentile(r.wait_us, 0.50);
+    double p99 = Percentile(r.wait_us, 0.99);
+    double max = r.wait_us.empty() ? 0.0 : *std::max_element(r.wait_us.begin(), r.wait_us.end());
+    std::cout << std::left << std::setw(40) << label << std::right << std::fixed << std::setprecision(0)
+              << std::setw(12) << (r.received / r.seconds) << " pkt/s"
+              << std::setprecision(1)
+              << "  wait p50 " << std::setw(9) << p50 << "us"
+              << "  p99 " << std::setw(9) << p99 << "us"
+              << "  max " << std::setw(9) << max << "us"
+              << (r.received == expected ? "" : "  [LOST PACKETS]") << std::endl;
+}
+
+static void ReportMemory() {
+    // 6 Mbps is a typical Twitch source rendition
+    const double packets_per_second = 6000000.0 / 8 / TS_PACKET_SIZE;
+    const size_t max_packets = 15000;
+
+    TSBuffer without_stats(max_packets);
+    TSBuffer with_stats(max_packets);
+    with_stats.SetMetadataEnabled(true);
+
+    auto line = [&](const std::string& label, double bytes_per_packet) {
+        std::cout << std::left << std::setw(40) << label << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(8) << bytes_per_packet << " B/packet"
+                  << std::setw(10) << (bytes_per_packet * packets_per_second / 1024) << " KB per buffered second" << std::endl;
+    };
+    std::cout << std::endl << "Memory at 6 Mbps (" << static_cast<int>(packets_per_second) << " pkt/s), " << max_packets << "-packet buffer:" << std::endl;
+    line("legacy std::queue<TSPacket>", static_cast<double>(sizeof(LegacyTSPacket)));
+    line("ring, payload arena + PacketMeta", static_cast<double>(with_stats.GetMemoryBytes()) / max_packets);
+    line("ring, payload arena only (no stats)", static_cast<double>(without_stats.GetMemoryBytes()) / max_packets);
+}
+
+int main() {
+    std::cout << "=== TSBuffer contention benchmark ===" << std::endl;
+    ReportMemory();
+
+    // Throughput: producer runs flat out, consumer drains as fast as it can
+    const size_t bulk = 3000000;
+    std::cout << std::endl << "Flat out, " << bulk << " packets in 350-packet segments:" << std::endl;
+    Report("legacy mutex + queue + 1ms poll", RunLegacy(bulk, 350, std::chrono::microseconds(0)), bulk);
+    Report("SPSC ring, single pop", RunRing(bulk, 350, std::chrono::microseconds(0), 1), bulk);
+    Report("SPSC ring, batch pop (64)", RunRing(bulk, 350, std::chrono::microseconds(0), 64), bulk);
+
+    // Live pacing: small bursts with idle gaps, so the consumer repeatedly goes to sleep and wakes up
+    const size_t paced = 20000;
+    std::cout << std::endl << "Paced, " << paced << " packets in 20-packet bursts every 2ms:" << std::endl;
+    Report("legacy mutex + queue + 1ms poll", RunLegacy(paced, 20, std::chrono::microseconds(2000)), paced);
+    Report("SPSC ring, single pop", RunRing(paced, 20, std::chrono::microseconds(2000), 1), paced);
+    Report("SPSC ring, batch pop (64)", RunRing(paced, 20, std::chrono::microseconds(2000), 64), paced);
+    return 0;
+}
@@ -0,0 +1,283 @@
+// Simulation of the low-latency buffer policy: key frame skips vs. the old arbitrary packet drops
+// A 30 fps stream with 2 s GOPs goes live one frame per tick and is pushed into the buffer while it
+// is below the fetcher's high watermark; the player drains it at the stream rate and stalls a few
+// times. Every packet carries its sequence number and frame position, so the player side can tell
+// which frames arrived cut and are undecodable until the next key frame. The old policy (drop up to 10 of the oldest packets whenever the queue is past half
+// capacity) is modelled beside the real TSBuffer.
+//
+// Build: g++ -std=c++17 -O2 ts_buffer_latency_bench.cpp ts_buffer.cpp ts_packet.cpp -o ts_buffer_latency_bench
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <deque>
+#include <cstring>
+#include <string>
+#include <algorithm>
+#include "ts_buffer.h"
+
+using namespace tsduck_transport;
+
+namespace {
+
+    const size_t MAX_PACKETS = 15000;
+    const uint32_t FRAME_MS = 33;
+    const uint64_t GOP_FRAMES = 60;
+    const size_t KEY_FRAME_PACKETS = 400;
+    const size_t FRAME_PACKETS = 60;
+    const size_t DRAIN_PER_TICK = 66;      // Stream rate: (400 + 59 * 60) / 60 packets per frame
+    const size_t HIGH_WATERMARK = MAX_PACKETS * 9 / 10;
+    const uint64_t TICKS = 90000 / FRAME_MS;
+    const std::chrono::milliseconds LATENCY_TARGET(3000);
+
+    // Player stalls as (start tick, length in ticks)
+    const std::vector<std::pair<uint64_t, uint64_t>> STALLS = { { 300, 120 }, { 900, 240 }, { 1800, 60 } };
+
+    bool Check(bool condition, const std::string& what) {
+        std::cout << (condition ? "  PASS  " : "  FAIL  ") << what << std::endl;
+        return condition;
+    }
+
+    bool IsStalled(uint64_t tick) {
+        for (const auto& stall : STALLS) {
+            if (tick >= stall.first && tick < stall.first + stall.second) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Packet layout: sequence number, frame number, first/last packet of the frame, key frame
+    struct PacketInfo {
+        uint64_t sequence = 0;
+        uint64_t frame = 0;
+        bool first = false;
+        bool last = false;
+        bool key = false;
+    };
+
+    void WritePacket(uint8_t* packet, const PacketInfo& info) {
+        memset(packet, 0xFF, TS_PACKET_SIZE);
+        packet[0] = 0x47;
+        packet[1] = 0x01;
+        packet[2] = 0x00;
+        packet[3] = 0x10;
+        memcpy(packet + 4, &info.sequence, 8);
+        memcpy(packet + 12, &info.frame, 8);
+        packet[20] = info.first;
+        packet[21] = info.last;
+        packet[22] = info.key;
+    }
+
+    PacketInfo ReadPacket(const uint8_t* packet) {
+        PacketInfo info;
+        memcpy(&info.sequence, packet + 4, 8);
+        memcpy(&info.frame, packet + 12, 8);
+        info.first = packet[20] != 0;
+        info.last = packet[21] != 0;
+        info.key = packet[22] != 0;
+        return info;
+    }
+
+    // Player side: a cut that does not land on the start of a key frame leaves the frames up to the
+    // next key frame undecodable. A frame the player was part way through when the cut came is lost
+    // on its own (truncated) without breaking the frames after it.
+    struct Player {
+        bool have_last = false;
+        PacketInfo last;
+        bool broken = false;
+        uint64_t broken_frame = 0;
+        uint64_t gaps = 0;
+        uint64_t packets_missing = 0;
+        uint64_t corrupt_frames = 0;
+        uint64_t truncated_frames = 0;
+        uint64_t clean_cuts = 0;
+
+        void Receive(const PacketInfo& info) {
+            if (have_last && info.sequence != last.sequence + 1) {
+                gaps++;
+                packets_missing += info.sequence - last.sequence - 1;
+                if (info.first && info.key) {
+                    clean_cuts++;
+                    if (!last.last && !broken) {
+                        truncated_frames++;
+                    }
+                    broken = false;
+                } else {
+                    if (!last.last && !broken) {
+                        corrupt_frames++;
+                    }
+                    broken = true;
+                    broken_frame = info.frame;
+                    corrupt_frames++;
+                }
+            } else if (broken && info.first) {
+                if (info.key) {
+                    broken = false;
+                } else if (info.frame != broken_frame) {
+                    broken_frame = info.frame;
+                    corrupt_frames++;
+                }
+            }
+            have_last = true;
+            last = info;
+        }
+    };
+
+    // The pre-existing low-latency policy, on a plain queue
+    struct LegacyDropBuffer {
+        std::deque<std::vector<uint8_t>> packets;
+        uint64_t dropped = 0;
+
+        void Add(const uint8_t* packet) {
+            size_t buffered = packets.size();
+            if (buffered >= MAX_PACKETS / 2) {
+                size_t drop = std::min(buffered / 4, size_t(10));
+                packets.erase(packets.begin(), packets.begin() + drop);
+                dropped += drop;
+            } else if (buffered >= MAX_PACKETS) {
+                packets.pop_front();
+                dropped++;
+            }
+            packets.emplace_back(packet, packet + TS_PACKET_SIZE);
+        }
+    };
+
+    struct Result {
+        Player player;
+        uint64_t max_latency_ms = 0;
+        uint64_t final_latency_ms = 0;
+        uint64_t latency_sum_ms = 0;
+    };
+
+    // One frame of packets and their metas as the converter tags them
+    void MakeFrame(uint64_t frame, uint64_t& sequence, std::vector<uint8_t>& payloads, std::vector<PacketMeta>& metas) {
+        bool key = (frame - 1) % GOP_FRAMES == 0;
+        size_t count = key ? KEY_FRAME_PACKETS : FRAME_PACKETS;
+        payloads.assign(count * TS_PACKET_SIZE, 0);
+        metas.assign(count, PacketMeta());
+        for (size_t i = 0; i < count; ++i) {
+            PacketInfo info;
+            info.sequence = sequence++;
+            info.frame = frame;
+            info.first = i == 0;
+            info.last = i + 1 == count;
+            info.key = key;
+            WritePacket(&payloads[i * TS_PACKET_SIZE], info);
+            metas[i] = PacketMeta::FromHeader(&payloads[i * TS_PACKET_SIZE]);
+        }
+        metas[0].frame_number = frame;
+        metas[0].access_units = 1;
+        metas[0].frame_duration_ms = FRAME_MS;
+        if (key) {
+            metas[0].flags |= PacketMeta::KEY_FRAME;
+        }
+    }
+
+    void SampleLatency(Result& result, uint64_t produced_frame) {
+        uint64_t latency = result.player.have_last ? (produced_frame - result.player.last.frame) * FRAME_MS : 0;
+        result.max_latency_ms = std::max(result.max_latency_ms, latency);
+        result.final_latency_ms = latency;
+        result.latency_sum_ms += latency;
+    }
+
+    Result RunLegacy() {
+        Result result;
+        LegacyDropBuffer buffer;
+        uint64_t sequence = 1;
+        uint64_t next_frame = 1;
+        std::vector<uint8_t> payloads;
+        std::vector<PacketMeta> metas;
+        for (uint64_t tick = 0; tick < TICKS; ++tick) {
+            while (next_frame <= tick + 1 && buffer.packets.size() < HIGH_WATERMARK) {
+                MakeFrame(next_frame++, sequence, payloads, metas);
+                for (size_t i = 0; i < metas.size(); ++i) {
+                    buffer.Add(&payloads[i * TS_PACKET_SIZE]);
+                }
+            }
+            if (!IsStalled(tick)) {
+                for (size_t i = 0; i < DRAIN_PER_TICK && !buffer.packets.empty(); ++i) {
+                    result.player.Receive(ReadPacket(buffer.packets.front().data()));
+                    buffer.packets.pop_front();
+                }
+            }
+            SampleLatency(result, tick + 1);
+        }
+        return result;
+    }
+
+    Result RunKeyFrameSkip(TSBuffer& buffer) {
+        Result result;
+        buffer.SetLowLatencyMode(true);
+        buffer.SetLatencyTarget(LATENCY_TARGET);
+        uint64_t sequence = 1;
+        uint64_t next_frame = 1;
+        std::vector<uint8_t> payloads;
+        std::vector<PacketMeta> metas;
+        std::vector<uint8_t> out(DRAIN_PER_TICK * TS_PACKET_SIZE);
+        for (uint64_t tick = 0; tick < TICKS; ++tick) {
+            while (next_frame <= tick + 1 && buffer.GetOccupiedSlots() < HIGH_WATERMARK) {
+                MakeFrame(next_frame++, sequence, payloads, metas);
+                buffer.AddPackets(payloads.data(), metas.data(), metas.size());
+            }
+            if (!IsStalled(tick)) {
+                size_t count = buffer.GetPackets(out.data(), nullptr, DRAIN_PER_TICK, std::chrono::milliseconds(0));
+                for (size_t i = 0; i < count; ++i) {
+                    result.player.Receive(ReadPacket(&out[i * TS_PACKET_SIZE]));
+                }
+            }
+            SampleLatency(result, tick + 1);
+        }
+        return result;
+    }
+
+    void PrintRow(const std::string& name, const Result& result, uint64_t packets_dropped) {
+        std::cout << std::left << std::setw(20) << ("  " + name) << std::right
+                  << std::setw(10) << result.player.gaps
+                  << std::setw(10) << result.player.clean_cuts
+                  << std::setw(12) << result.player.corrupt_frames
+                  << std::setw(11) << result.player.truncated_frames
+                  << std::setw(12) << (packets_dropped * TS_PACKET_SIZE / 1024)
+                  << std::setw(10) << result.max_latency_ms
+                  << std::setw(10) << (result.latency_sum_ms / TICKS)
+                  << std::setw(10) << result.final_latency_ms << std::endl;
+    }
+
+} // namespace
+
+int main() {
+    std::cout << "=== Low-latency buffer: key frame skips vs. packet drops ===" << std::endl;
+    std::cout << "30 fps, " << GOP_FRAMES * FRAME_MS << "ms GOPs, " << MAX_PACKETS << " packet buffer, latency target "
+              << LATENCY_TARGET.count() << "ms, " << STALLS.size() << " player stalls" << std::endl << std::endl;
+
+    Result legacy = RunLegacy();
+    TSBuffer buffer(MAX_PACKETS);
+    Result skipping = RunKeyFrameSkip(buffer);
+    TSBuffer::LatencyStats stats = buffer.GetLatencyStats();
+
+    std::cout << std::left << std::setw(20) << "  policy" << std::right << std::setw(10) << "cuts" << std::setw(10) << "clean"
+              << std::setw(12) << "bad frames" << std::setw(11) << "truncated" << std::setw(12) << "KB dropped" << std::setw(10) << "max ms"
+              << std::setw(10) << "avg ms" << std::setw(10) << "end ms" << std::endl;
+    PrintRow("drop 10 at 50%", legacy, legacy.player.packets_missing);
+    PrintRow("key frame skip", skipping, skipping.player.packets_missing);
+    std::cout << std::endl << "  Skip stats: " << stats.skips << " skips, " << stats.frames_skipped << " frames, "
+              << stats.bytes_skipped / 1024 << "KB, last " << stats.last_skip_from_ms << "ms -> " << stats.last_skip_to_ms
+              << "ms, " << stats.unaligned_drops << " mid-GOP drops" << std::endl << std::endl;
+
+    bool ok = true;
+    ok = Check(legacy.player.corrupt_frames > 0, "old policy cuts GOPs and leaves undecodable frames") && ok;
+    ok = Check(skipping.player.corrupt_frames == 0 && skipping.player.gaps == skipping.player.clean_cuts,
+               "every key frame skip lands on the start of a key frame") && ok;
+    ok = Check(skipping.player.truncated_frames <= skipping.player.gaps, "at most the frame in flight is lost per skip") && ok;
+    ok = Check(stats.skips > 0 && skipping.player.gaps <= stats.skips && buffer.GetGapCount() == skipping.player.gaps,
+               "skips reach the consumer as single jumps (several while it is stalled become one)") && ok;
+    ok = Check(stats.bytes_skipped == skipping.player.packets_missing * TS_PACKET_SIZE && stats.unaligned_drops == 0,
+               "reported bytes skipped match what the player missed, nothing dropped mid-GOP") && ok;
+    ok = Check(stats.last_skip_to_ms <= LATENCY_TARGET.count() && stats.last_skip_from_ms > LATENCY_TARGET.count(),
+               "skips are taken past the target and land within it") && ok;
+    ok = Check(skipping.final_latency_ms <= static_cast<uint64_t>(LATENCY_TARGET.count()) + GOP_FRAMES * FRAME_MS,
+               "latency after the stalls is back within a GOP of the target") && ok;
+
+    std::cout << std::endl << (ok ? "All checks passed" : "SOME CHECKS FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,82 @@
+#include "ts_chunker.h"
+#include <algorithm>
+
+namespace tsduck_transport {
+
+TsChunker::TsChunker(size_t min_chunk_bytes)
+    : pool_(POOL_BUFFERS), min_chunk_bytes_(std::max<size_t>(TS_PACKET_SIZE, min_chunk_bytes)) {
+}
+
+void TsChunker::BeginSegment() {
+    if (!current_) {
+        current_ = pool_.Acquire();
+    }
+    current_->clear();
+    segment_chunked_ = false;
+}
+
+void TsChunker::Append(const uint8_t* data, size_t size) {
+    if (!current_) {
+        current_ = pool_.Acquire();
+    }
+    current_->insert(current_->end(), data, data + size);
+}
+
+bool TsChunker::Cut(SegmentPool::PooledSegment& chunk, bool final) {
+    if (!current_ || current_->empty()) {
+        return false;
+    }
+    ScanSyncRuns(current_->data(), current_->size(), runs_);
+    size_t end = runs_.empty() ? 0 : runs_.back().offset + runs_.back().packets * TS_PACKET_SIZE;
+    if (final) {
+        stats_.bytes_dropped += current_->size() - end;
+    } else if (end == 0 && current_->size() >= 4 * min_chunk_bytes_) {
+        // No sync at all for a while; the converter skips and counts the garbage
+        end = current_->size();
+    }
+    if (end == 0) {
+        if (final) {
+            current_->clear();
+        }
+        return false;
+    }
+
+    // The chunk takes the buffer; the partial packet after the cut starts the next one
+    chunk = std::move(current_);
+    current_ = pool_.Acquire();
+    current_->assign(chunk->begin() + end, chunk->end());
+    chunk->resize(end);
+    if (final) {
+        current_->clear();
+    }
+    if (!segment_chunked_) {
+        segment_chunked_ = true;
+        stats_.segments++;
+    }
+    stats_.chunks++;
+    stats_.bytes += end;
+    return true;
+}
+
+bool TsChunker::NextChunk(SegmentPool::PooledSegment& chunk) {
+    if (!current_ || current_->size() < min_chunk_bytes_) {
+        return false;
+    }
+    return Cut(chunk, false);
+}
+
+bool TsChunker::Finish(SegmentPool::PooledSegment& chunk) {
+    return Cut(chunk, true);
+}
+
+size_t TsChunker::Abort() {
+    size_t dropped = current_ ? current_->size() : 0;
+    if (current_) {
+        current_->clear();
+    }
+    stats_.aborted++;
+    stats_.bytes_dropped += dropped;
+    return dropped;
+}
+
+} // namespace tsduck_transport
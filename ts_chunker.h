@@ -0,0 +1,63 @@
+#pragma once
+// Packet-aligned chunks of a segment that is still downloading
+// Progressive forwarding hands the router pieces of a segment as they arrive instead of waiting for
+// the whole download. Bytes are collected into pooled chunk buffers and cut after the last whole
+// packet of the synced runs, so every chunk holds complete TS packets and the partial packet at a
+// cut carries over to the next chunk. A segment that aborts partway loses only what was not cut yet.
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "ts_packet.h"
+#include "ts_sync.h"
+#include "segment_pool.h"
+
+namespace tsduck_transport {
+
+    class TsChunker {
+    public:
+        static constexpr size_t DEFAULT_CHUNK_BYTES = TS_PACKET_SIZE * 348;   // ~64KB, like an output batch
+        static constexpr size_t POOL_BUFFERS = 16;                           // Chunks queued in the buffer at once
+
+        struct Stats {
+            uint64_t segments = 0;          // Segments forwarded in chunks
+            uint64_t chunks = 0;
+            uint64_t bytes = 0;             // Handed out in chunks
+            uint64_t aborted = 0;           // Segments whose download failed after chunks went out
+            uint64_t bytes_dropped = 0;     // Trailing partial packets and the unsent part of aborted segments
+        };
+
+        explicit TsChunker(size_t min_chunk_bytes = DEFAULT_CHUNK_BYTES);
+
+        // Start collecting a new segment; whatever is left of the previous one is dropped
+        void BeginSegment();
+
+        void Append(const uint8_t* data, size_t size);
+
+        // A chunk of whole packets once at least the minimum has arrived; false while it should wait
+        bool NextChunk(SegmentPool::PooledSegment& chunk);
+
+        // Segment complete: the rest as one chunk, false if nothing is left. An incomplete last packet is dropped.
+        bool Finish(SegmentPool::PooledSegment& chunk);
+
+        // Segment download failed partway: drop what was not handed out yet and return its size
+        size_t Abort();
+
+        // Hand a chunk to the packet pipeline; its buffer comes back to the chunk pool once written
+        SegmentBuffer Share(SegmentPool::PooledSegment&& chunk) { return pool_.Share(std::move(chunk)); }
+
+        const Stats& GetStats() const { return stats_; }
+
+    private:
+        SegmentPool pool_;
+        SegmentPool::PooledSegment current_;
+        size_t min_chunk_bytes_;
+        std::vector<SyncRun> runs_;
+        bool segment_chunked_ = false;      // A chunk of the current segment went out
+        Stats stats_;
+
+        bool Cut(SegmentPool::PooledSegment& chunk, bool final);
+    };
+
+} // namespace tsduck_transport
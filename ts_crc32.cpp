@@ -0,0 +1,183 @@
+#include "ts_crc32.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define TS_CRC32_X86 1
+#include <immintrin.h>
+#include <wmmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#else
+#define TS_CRC32_X86 0
+#endif
+
+// MSVC compiles intrinsics for any instruction set; GCC/Clang need the target enabled per function
+#if TS_CRC32_X86 && (defined(__GNUC__) || defined(__clang__))
+#define TS_CRC32_TARGET_PCLMUL __attribute__((target("pclmul,ssse3")))
+#else
+#define TS_CRC32_TARGET_PCLMUL
+#endif
+
+namespace tsduck_transport {
+
+namespace {
+
+    // table[k][b]: CRC register after byte b followed by k zero bytes
+    struct CRC32Tables {
+        uint32_t table[8][256];
+    };
+
+    constexpr CRC32Tables MakeCRC32Tables() {
+        CRC32Tables tables{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i << 24;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc & 0x80000000) ? (crc << 1) ^ CRC32_MPEG_POLYNOMIAL : crc << 1;
+            }
+            tables.table[0][i] = crc;
+        }
+        for (int k = 1; k < 8; ++k) {
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t previous = tables.table[k - 1][i];
+                tables.table[k][i] = (previous << 8) ^ tables.table[0][previous >> 24];
+            }
+        }
+        return tables;
+    }
+
+    constexpr CRC32Tables CRC32_TABLES = MakeCRC32Tables();
+
+    // x^n mod P, the folding constants for carry-less multiplication
+    constexpr uint64_t XPowModP(unsigned n) {
+        uint32_t remainder = 1;
+        for (unsigned i = 0; i < n; ++i) {
+            remainder = (remainder & 0x80000000) ? (remainder << 1) ^ CRC32_MPEG_POLYNOMIAL : remainder << 1;
+        }
+        return remainder;
+    }
+
+    // Buffers shorter than this gain nothing from the folding setup
+    constexpr size_t PCLMUL_MIN_SIZE = 128;
+
+    uint32_t CRC32SliceBy8(const uint8_t* data, size_t size, uint32_t crc) {
+        const auto& t = CRC32_TABLES.table;
+        while (size >= 8) {
+            uint32_t high = crc ^ ((static_cast<uint32_t>(data[0]) << 24) | (static_cast<uint32_t>(data[1]) << 16) |
+                                   (static_cast<uint32_t>(data[2]) << 8) | data[3]);
+            uint32_t low = (static_cast<uint32_t>(data[4]) << 24) | (static_cast<uint32_t>(data[5]) << 16) |
+                           (static_cast<uint32_t>(data[6]) << 8) | data[7];
+            crc = t[7][high >> 24] ^ t[6][(high >> 16) & 0xFF] ^ t[5][(high >> 8) & 0xFF] ^ t[4][high & 0xFF] ^
+                  t[3][low >> 24] ^ t[2][(low >> 16) & 0xFF] ^ t[1][(low >> 8) & 0xFF] ^ t[0][low & 0xFF];
+            data += 8;
+            size -= 8;
+        }
+        while (size-- > 0) {
+            crc = (crc << 8) ^ t[0][(crc >> 24) ^ *data++];
+        }
+        return crc;
+    }
+
+    CRC32Level DetectCRC32Level() {
+#if TS_CRC32_X86
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+        bool pclmul = (info[2] & (1 << 1)) != 0;
+        bool ssse3 = (info[2] & (1 << 9)) != 0;
+#else
+        __builtin_cpu_init();
+        bool pclmul = __builtin_cpu_supports("pclmul") != 0;
+        bool ssse3 = __builtin_cpu_supports("ssse3") != 0;
+#endif
+        if (pclmul && ssse3) {
+            return CRC32Level::PCLMUL;
+        }
+#endif
+        return CRC32Level::SLICE_BY_8;
+    }
+
+#if TS_CRC32_X86
+    // A 128-bit block is held byte-reversed so bit 127 is the first message bit (MSB-first CRC).
+    // Folding a block forward by d bits: hi * (x^(d+64) mod P) ^ lo * (x^d mod P), congruent mod P
+    // and at most 96 bits wide.
+    TS_CRC32_TARGET_PCLMUL
+    inline __m128i Fold(__m128i block, __m128i constants) {
+        return _mm_xor_si128(_mm_clmulepi64_si128(block, constants, 0x11),
+                             _mm_clmulepi64_si128(block, constants, 0x00));
+    }
+
+    TS_CRC32_TARGET_PCLMUL
+    inline __m128i LoadReversed(const uint8_t* data, __m128i reverse) {
+        return _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data)), reverse);
+    }
+
+    TS_CRC32_TARGET_PCLMUL
+    uint32_t CRC32PCLMUL(const uint8_t* data, size_t size, uint32_t crc) {
+        const __m128i reverse = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+        const __m128i fold_by_4 = _mm_set_epi64x(static_cast<long long>(XPowModP(512 + 64)), static_cast<long long>(XPowModP(512)));
+        const __m128i fold_by_1 = _mm_set_epi64x(static_cast<long long>(XPowModP(128 + 64)), static_cast<long long>(XPowModP(128)));
+
+        // The initial register is the same as XORing it into the first four message bytes
+        __m128i x0 = _mm_xor_si128(LoadReversed(data, reverse), _mm_set_epi32(static_cast<int>(crc), 0, 0, 0));
+        __m128i x1 = LoadReversed(data + 16, reverse);
+        __m128i x2 = LoadReversed(data + 32, reverse);
+        __m128i x3 = LoadReversed(data + 48, reverse);
+        data += 64;
+        size -= 64;
+
+        while (size >= 64) {
+            x0 = _mm_xor_si128(Fold(x0, fold_by_4), LoadReversed(data, reverse));
+            x1 = _mm_xor_si128(Fold(x1, fold_by_4), LoadReversed(data + 16, reverse));
+            x2 = _mm_xor_si128(Fold(x2, fold_by_4), LoadReversed(data + 32, reverse));
+            x3 = _mm_xor_si128(Fold(x3, fold_by_4), LoadReversed(data + 48, reverse));
+            data += 64;
+            size -= 64;
+        }
+
+        __m128i x = _mm_xor_si128(Fold(x0, fold_by_1), x1);
+        x = _mm_xor_si128(Fold(x, fold_by_1), x2);
+        x = _mm_xor_si128(Fold(x, fold_by_1), x3);
+        while (size >= 16) {
+            x = _mm_xor_si128(Fold(x, fold_by_1), LoadReversed(data, reverse));
+            data += 16;
+            size -= 16;
+        }
+
+        // x is congruent to everything so far; its CRC from a zero register is the CRC of the prefix
+        alignas(16) uint8_t remainder[16];
+        _mm_store_si128(reinterpret_cast<__m128i*>(remainder), _mm_shuffle_epi8(x, reverse));
+        crc = CRC32SliceBy8(remainder, sizeof(remainder), 0);
+        return CRC32SliceBy8(data, size, crc);
+    }
+#endif
+
+} // namespace
+
+CRC32Level GetCRC32Level() {
+    static const CRC32Level level = DetectCRC32Level();
+    return level;
+}
+
+const char* GetCRC32LevelName(CRC32Level level) {
+    switch (level) {
+    case CRC32Level::PCLMUL: return "PCLMUL";
+    default: return "slice-by-8";
+    }
+}
+
+uint32_t CRC32MPEG(const uint8_t* data, size_t size, uint32_t crc) {
+    return CRC32MPEG(data, size, crc, GetCRC32Level());
+}
+
+uint32_t CRC32MPEG(const uint8_t* data, size_t size, uint32_t crc, CRC32Level level) {
+#if TS_CRC32_X86
+    if (level == CRC32Level::PCLMUL && size >= PCLMUL_MIN_SIZE) {
+        return CRC32PCLMUL(data, size, crc);
+    }
+#else
+    (void)level;
+#endif
+    return CRC32SliceBy8(data, size, crc);
+}
+
+} // namespace tsduck_transport
@@ -0,0 +1,29 @@
+#pragma once
+// CRC-32/MPEG-2 for PSI sections in the transport stream router
+// MSB-first CRC with polynomial 0x04C11DB7, initial value 0xFFFFFFFF and no final XOR. Slice-by-8
+// tables are generated at compile time; long buffers are folded 64 bytes per step with carry-less
+// multiplication on CPUs that have PCLMULQDQ. The level is chosen once at runtime.
+
+#include <cstdint>
+#include <cstddef>
+
+namespace tsduck_transport {
+
+    static constexpr uint32_t CRC32_MPEG_POLYNOMIAL = 0x04C11DB7;
+    static constexpr uint32_t CRC32_MPEG_INIT = 0xFFFFFFFF;
+
+    // Implementation used for a CRC, best available first detected at startup
+    enum class CRC32Level : uint8_t {
+        SLICE_BY_8,
+        PCLMUL
+    };
+
+    CRC32Level GetCRC32Level();
+    const char* GetCRC32LevelName(CRC32Level level);
+
+    // CRC of data continuing from crc (pass a previous result to checksum in pieces). Over a whole
+    // section including its CRC_32 field the result is 0 when the section is intact.
+    uint32_t CRC32MPEG(const uint8_t* data, size_t size, uint32_t crc = CRC32_MPEG_INIT);
+    uint32_t CRC32MPEG(const uint8_t* data, size_t size, uint32_t crc, CRC32Level level);
+
+} // namespace tsduck_transport
@@ -0,0 +1,115 @@
+#include "ts_packet.h"
+#include <algorithm>
+
+namespace tsduck_transport {
+
+// TSPacket implementation
+void TSPacket::ParseHeader() {
+    if (!IsValid()) return;
+    
+    // Extract PID (13 bits from bytes 1-2)
+    pid = ((data[1] & 0x1F) << 8) | data[2];
+    
+    // Extract payload unit start indicator
+    payload_unit_start = (data[1] & 0x40) != 0;
+    
+    // Extract discontinuity indicator from adaptation field if present
+    bool has_adaptation = (data[3] & 0x20) != 0;
+    if (has_adaptation && data[4] > 0) {
+        discontinuity = (data[5] & 0x80) != 0;
+    }
+}
+
+// Frame Number Tagging implementations
+void TSPacket::SetFrameInfo(uint64_t global_frame, uint32_t segment_frame, bool key_frame, std::chrono::milliseconds duration) {
+    frame_number = global_frame;
+    segment_frame_number = segment_frame;
+    is_key_frame = key_frame;
+    frame_duration = duration;
+}
+
+void TSPacket::SetVideoInfo(uint64_t video_frame, bool is_video, bool is_audio) {
+    video_frame_number = video_frame;
+    is_video_packet = is_video;
+    is_audio_packet = is_audio;
+    video_sync_lost = false; // Reset sync status when setting video info
+}
+
+std::wstring TSPacket::GetFrameDebugInfo() const {
+    return PacketMeta::FromPacket(*this).GetFrameDebugInfo();
+}
+
+bool TSPacket::IsFrameDropDetected(const TSPacket& previous_packet) const {
+    // Detect frame drops by checking sequence continuity
+    if (frame_number <= previous_packet.frame_number) {
+        return false; // Not a drop, possibly duplicate or reordered
+    }
+    
+    // Check if we skipped frame numbers (indicating dropped frames)
+    uint64_t expected_frame = previous_packet.frame_number + 1;
+    return frame_number > expected_frame;
+}
+
+bool TSPacket::IsVideoSyncValid() const {
+    return is_video_packet && !video_sync_lost;
+}
+
+// PacketMeta implementation
+PacketMeta PacketMeta::FromPacket(const TSPacket& packet) {
+    PacketMeta meta;
+    meta.frame_number = packet.frame_number;
+    meta.video_frame_number = static_cast<uint32_t>(packet.video_frame_number);
+    meta.segment_frame_number = packet.segment_frame_number;
+    meta.pid = packet.pid;
+    meta.frame_duration_ms = static_cast<uint16_t>(std::min<int64_t>(packet.frame_duration.count(), UINT16_MAX));
+    if (packet.payload_unit_start) meta.flags |= PAYLOAD_UNIT_START;
+    if (packet.discontinuity) meta.flags |= DISCONTINUITY;
+    if (packet.is_video_packet) meta.flags |= VIDEO;
+    if (packet.is_audio_packet) meta.flags |= AUDIO;
+    if (packet.is_key_frame) meta.flags |= KEY_FRAME;
+    if (packet.video_sync_lost) meta.flags |= VIDEO_SYNC_LOST;
+    return meta;
+}
+
+PacketMeta PacketMeta::FromHeader(const uint8_t* data) {
+    PacketMeta meta;
+    meta.pid = ((data[1] & 0x1F) << 8) | data[2];
+    if (data[1] & 0x40) meta.flags |= PAYLOAD_UNIT_START;
+    
+    // Discontinuity indicator lives in the adaptation field if present
+    bool has_adaptation = (data[3] & 0x20) != 0;
+    if (has_adaptation && data[4] > 0 && (data[5] & 0x80)) {
+        meta.flags |= DISCONTINUITY;
+    }
+    return meta;
+}
+
+void PacketMeta::ApplyTo(TSPacket& packet) const {
+    packet.pid = pid;
+    packet.payload_unit_start = Has(PAYLOAD_UNIT_START);
+    packet.discontinuity = Has(DISCONTINUITY);
+    packet.SetFrameInfo(frame_number, segment_frame_number, Has(KEY_FRAME), std::chrono::milliseconds(frame_duration_ms));
+    packet.SetVideoInfo(video_frame_number, Has(VIDEO), Has(AUDIO));
+    packet.video_sync_lost = Has(VIDEO_SYNC_LOST);
+}
+
+std::wstring PacketMeta::GetFrameDebugInfo() const {
+    std::wstring info = L"Frame#" + std::to_wstring(frame_number) + 
+                       L" Seg#" + std::to_wstring(segment_frame_number) +
+                       L" PID:" + std::to_wstring(pid);
+    
+    if (Has(VIDEO)) info += L" [VIDEO]";
+    if (Has(AUDIO)) info += L" [AUDIO]";
+    if (Has(KEY_FRAME)) info += L" [KEY]";
+    if (Has(PAYLOAD_UNIT_START)) info += L" [START]";
+    if (Has(DISCONTINUITY)) info += L" [DISC]";
+    if (Has(VIDEO_SYNC_LOST)) info += L" [SYNC_LOST]";
+    
+    if (frame_duration_ms > 0) {
+        info += L" (" + std::to_wstring(frame_duration_ms) + L"ms)";
+    }
+    
+    return info;
+}
+
+} // namespace tsduck_transport
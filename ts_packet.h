@@ -0,0 +1,99 @@
+#pragma once
+// MPEG-TS packet definition shared by the transport stream router components
+// Kept free of Windows headers so the packet pipeline can be built and benchmarked on any platform
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <chrono>
+#include <vector>
+#include <memory>
+
+namespace tsduck_transport {
+
+    // Transport Stream packet size (MPEG-TS standard)
+    static constexpr size_t TS_PACKET_SIZE = 188;
+
+    // Transport Stream packet header structure
+    struct TSPacket {
+        uint8_t data[TS_PACKET_SIZE];
+        uint16_t pid = 0;
+        bool payload_unit_start = false;
+        bool discontinuity = false;
+
+        // Stream type identification
+        bool is_video_packet = false;     // True if this packet contains video data
+        bool is_audio_packet = false;     // True if this packet contains audio data
+
+        // Frame Number Tagging for lag reduction
+        uint64_t frame_number = 0;        // Global frame sequence number
+        uint32_t segment_frame_number = 0; // Frame number within current segment
+        bool is_key_frame = false;        // Indicates if this is a key/I-frame
+        std::chrono::milliseconds frame_duration{0}; // Expected frame duration for timing
+
+        // Video synchronization data
+        uint64_t video_frame_number = 0;  // Video-specific frame counter
+        bool video_sync_lost = false;     // True if video synchronization is lost
+
+        TSPacket() {
+            memset(data, 0, TS_PACKET_SIZE);
+        }
+
+        // Parse packet header information
+        void ParseHeader();
+
+        // Check if this is a valid TS packet
+        bool IsValid() const { return data[0] == 0x47; }
+
+        // Frame Number Tagging methods
+        void SetFrameInfo(uint64_t global_frame, uint32_t segment_frame, bool key_frame = false, std::chrono::milliseconds duration = std::chrono::milliseconds(0));
+        void SetVideoInfo(uint64_t video_frame, bool is_video, bool is_audio = false);
+        std::wstring GetFrameDebugInfo() const;
+        bool IsFrameDropDetected(const TSPacket& previous_packet) const;
+        bool IsVideoSyncValid() const;
+    };
+
+    // Compact per-packet metadata stored beside the payload arena in TSBuffer (24 bytes vs. the
+    // full TSPacket fields). Only kept when frame statistics are enabled.
+    struct PacketMeta {
+        enum Flags : uint8_t {
+            PAYLOAD_UNIT_START = 0x01,
+            DISCONTINUITY      = 0x02,
+            VIDEO              = 0x04,
+            AUDIO              = 0x08,
+            KEY_FRAME          = 0x10,
+            VIDEO_SYNC_LOST    = 0x20,
+        };
+
+        uint64_t frame_number = 0;          // Global frame sequence number (0 = no frame info)
+        uint32_t video_frame_number = 0;    // Video-specific frame counter
+        uint32_t segment_frame_number = 0;  // Frame number within current segment
+        uint16_t pid = 0;
+        uint16_t frame_duration_ms = 0;     // Expected frame duration for timing
+        uint8_t flags = 0;
+        uint8_t access_units = 0;           // Access units starting in this packet (frame_number is the last)
+
+        bool Has(Flags flag) const { return (flags & flag) != 0; }
+
+        // Extract the metadata fields of a full packet
+        static PacketMeta FromPacket(const TSPacket& packet);
+
+        // Parse pid, payload unit start and discontinuity from raw packet bytes
+        static PacketMeta FromHeader(const uint8_t* data);
+
+        // Copy the metadata back into the fields of a full packet
+        void ApplyTo(TSPacket& packet) const;
+
+        std::wstring GetFrameDebugInfo() const;
+    };
+
+    // Downloaded segment bytes shared by every packet view into them; the last holder frees the download
+    using SegmentBuffer = std::shared_ptr<const std::vector<uint8_t>>;
+
+    // Lightweight reference to one TS packet inside a segment buffer
+    struct PacketView {
+        uint32_t offset = 0;  // Byte offset of the packet within the segment
+        PacketMeta meta;
+    };
+
+} // namespace tsduck_transport
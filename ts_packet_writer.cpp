@@ -0,0 +1,162 @@
+#include "ts_packet_writer.h"
+#include <algorithm>
+#include <cstring>
+
+namespace tsduck_transport {
+
+CoalescingPacketWriter::CoalescingPacketWriter(PacketSink& sink, size_t max_batch_bytes, std::chrono::microseconds max_latency)
+    : sink_(sink), max_latency_(max_latency) {
+    // Batches always hold whole packets so every flush ends on a packet boundary
+    size_t packets = std::max<size_t>(1, max_batch_bytes / TS_PACKET_SIZE);
+    batch_.resize(packets * TS_PACKET_SIZE);
+}
+
+bool CoalescingPacketWriter::WritePacket(const uint8_t* packet) {
+    return WritePackets(packet, 1);
+}
+
+bool CoalescingPacketWriter::WritePackets(const uint8_t* packets, size_t count) {
+    const uint8_t* src = packets;
+    size_t remaining = count * TS_PACKET_SIZE;
+    stats_.packets_queued += count;
+
+    while (remaining > 0) {
+        // No room for another whole packet (possibly because the tail of a failed write is
+        // still queued) - the pending bytes have to go first to keep ordering
+        if (batch_.size() - batch_used_ < TS_PACKET_SIZE) {
+            if (!DrainBatch()) {
+                return false;
+            }
+            stats_.flushes_on_size++;
+        }
+
+        // Nothing pending and a full batch worth of input: hand it to the sink directly
+        if (batch_used_ == 0 && remaining >= batch_.size()) {
+            size_t offset = 0;
+            size_t chunk = batch_.size();
+            while (offset < chunk) {
+                size_t written = 0;
+                size_t to_write = chunk - offset;
+                stats_.write_calls++;
+                bool ok = sink_.Write(src + offset, to_write, written);
+                written = std::min(written, to_write);
+                offset += written;
+                stats_.bytes_written += written;
+                if (!ok || written == 0) {
+                    // Keep the unwritten part so a later Flush() resumes at the exact byte
+                    size_t unsent = chunk - offset;
+                    memcpy(batch_.data(), src + offset, unsent);
+                    stats_.bytes_copied += unsent;
+                    batch_used_ = unsent;
+                    batch_sent_ = 0;
+                    oldest_pending_ = std::chrono::steady_clock::now();
+                    return false;
+                }
+                if (written < to_write) {
+                    stats_.partial_writes++;
+                }
+            }
+            stats_.flushes_on_size++;
+            src += chunk;
+            remaining -= chunk;
+            continue;
+        }
+
+        if (batch_used_ == 0) {
+            oldest_pending_ = std::chrono::steady_clock::now();
+        }
+
+        // Only whole packets are gathered so a size flush never splits a packet
+        size_t space = (batch_.size() - batch_used_) / TS_PACKET_SIZE * TS_PACKET_SIZE;
+        size_t take = std::min(space, remaining);
+        memcpy(batch_.data() + batch_used_, src, take);
+        stats_.bytes_copied += take;
+        batch_used_ += take;
+        src += take;
+        remaining -= take;
+
+        if (batch_.size() - batch_used_ < TS_PACKET_SIZE) {
+            if (!DrainBatch()) {
+                return false;
+            }
+            stats_.flushes_on_size++;
+        }
+    }
+
+    return true;
+}
+
+bool CoalescingPacketWriter::WritePacketViews(const uint8_t* const* packets, size_t count) {
+    size_t run_start = 0;
+    for (size_t i = 1; i <= count; ++i) {
+        if (i == count || packets[i] != packets[i - 1] + TS_PACKET_SIZE) {
+            // A run that fills a whole batch goes out first rather than topping up the pending
+            // partial batch, which would keep every later run out of phase and copied
+            size_t run_bytes = (i - run_start) * TS_PACKET_SIZE;
+            if (HasPending() && run_bytes >= batch_.size()) {
+                if (!DrainBatch()) {
+                    return false;
+                }
+                stats_.flushes_on_size++;
+            }
+            if (!WritePackets(packets[run_start], i - run_start)) {
+                return false;
+            }
+            run_start = i;
+        }
+    }
+    return true;
+}
+
+bool CoalescingPacketWriter::Flush() {
+    if (!HasPending()) {
+        return true;
+    }
+    stats_.flushes_explicit++;
+    return DrainBatch();
+}
+
+bool CoalescingPacketWriter::FlushIfDue(std::chrono::steady_clock::time_point now) {
+    if (!HasPending() || now - oldest_pending_ < max_latency_) {
+        return true;
+    }
+    stats_.flushes_on_deadline++;
+    return DrainBatch();
+}
+
+std::chrono::microseconds CoalescingPacketWriter::TimeUntilDeadline(std::chrono::steady_clock::time_point now) const {
+    if (!HasPending()) {
+        return std::chrono::microseconds::max();
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - oldest_pending_);
+    if (elapsed >= max_latency_) {
+        return std::chrono::microseconds(0);
+    }
+    return max_latency_ - elapsed;
+}
+
+bool CoalescingPacketWriter::DrainBatch() {
+    while (batch_sent_ < batch_used_) {
+        size_t written = 0;
+        size_t to_write = batch_used_ - batch_sent_;
+        stats_.write_calls++;
+        bool ok = sink_.Write(batch_.data() + batch_sent_, to_write, written);
+        written = std::min(written, to_write);
+        batch_sent_ += written;
+        stats_.bytes_written += written;
+
+        if (!ok || written == 0) {
+            // Leave batch_sent_ where the sink stopped; the next flush picks up mid-packet
+            return false;
+        }
+        if (written < to_write) {
+            stats_.partial_writes++;
+        }
+    }
+
+    batch_used_ = 0;
+    batch_sent_ = 0;
+    return true;
+}
+
+} // namespace tsduck_transport
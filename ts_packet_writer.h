@@ -0,0 +1,82 @@
+#pragma once
+// Coalescing packet writer for the transport stream router
+// Gathers 188-byte TS packets into large batches so the player pipe sees a few big writes
+// instead of one write per packet. Platform neutral: output goes through the PacketSink interface.
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <chrono>
+
+#include "ts_packet.h"
+
+namespace tsduck_transport {
+
+    // Destination for batched TS data (player pipe, file descriptor, /dev/null, ...)
+    class PacketSink {
+    public:
+        virtual ~PacketSink() = default;
+
+        // Write up to size bytes. bytes_written receives the number of bytes accepted,
+        // which may be less than size (partial write). Returns false on a hard error.
+        virtual bool Write(const uint8_t* data, size_t size, size_t& bytes_written) = 0;
+    };
+
+    // Batches whole TS packets and flushes them when the batch is full or its latency deadline passes
+    class CoalescingPacketWriter {
+    public:
+        // max_batch_bytes is rounded down to a multiple of TS_PACKET_SIZE (minimum one packet)
+        CoalescingPacketWriter(PacketSink& sink,
+                               size_t max_batch_bytes = TS_PACKET_SIZE * 348, // ~64KB per write
+                               std::chrono::microseconds max_latency = std::chrono::milliseconds(15));
+
+        // Queue one 188-byte packet; flushes automatically when the batch fills up
+        bool WritePacket(const uint8_t* packet);
+
+        // Queue a run of contiguous packets (count * TS_PACKET_SIZE bytes)
+        bool WritePackets(const uint8_t* packets, size_t count);
+
+        // Queue packets given by pointer; neighbours that are adjacent in memory are written as one run,
+        // so packets viewed straight out of a segment can reach the sink without being copied
+        bool WritePacketViews(const uint8_t* const* packets, size_t count);
+
+        // Write everything that is pending, including the unwritten tail of a partial write
+        bool Flush();
+
+        // Flush only if the oldest pending packet has waited longer than the latency budget
+        bool FlushIfDue(std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+        // Time left until the pending batch must be flushed (max() when nothing is pending)
+        std::chrono::microseconds TimeUntilDeadline(std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now()) const;
+
+        bool HasPending() const { return batch_used_ > batch_sent_; }
+        size_t GetPendingPackets() const { return (batch_used_ - batch_sent_ + TS_PACKET_SIZE - 1) / TS_PACKET_SIZE; }
+        size_t GetMaxBatchBytes() const { return batch_.size(); }
+
+        // Writer statistics (packets vs. sink calls shows the coalescing ratio)
+        struct Stats {
+            uint64_t packets_queued = 0;
+            uint64_t bytes_written = 0;
+            uint64_t bytes_copied = 0;         // Bytes gathered into the batch buffer (the rest went out directly)
+            uint64_t write_calls = 0;          // Calls into PacketSink::Write (syscalls for real sinks)
+            uint64_t partial_writes = 0;       // Writes that accepted fewer bytes than offered
+            uint64_t flushes_on_size = 0;
+            uint64_t flushes_on_deadline = 0;
+            uint64_t flushes_explicit = 0;
+        };
+        const Stats& GetStats() const { return stats_; }
+
+    private:
+        PacketSink& sink_;
+        std::vector<uint8_t> batch_;
+        size_t batch_used_ = 0;   // Bytes gathered into batch_ (always ends on a packet boundary)
+        size_t batch_sent_ = 0;   // Bytes of batch_ already accepted by the sink
+        std::chrono::microseconds max_latency_;
+        std::chrono::steady_clock::time_point oldest_pending_;
+        Stats stats_;
+
+        // Push batch_[batch_sent_, batch_used_) to the sink, resuming after partial writes
+        bool DrainBatch();
+    };
+
+} // namespace tsduck_transport
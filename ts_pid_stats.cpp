@@ -0,0 +1,230 @@
+#include "ts_pid_stats.h"
+#include "pcr_scheduler.h"
+#include <algorithm>
+#include <cstring>
+
+namespace tsduck_transport {
+
+namespace {
+
+    const uint16_t NULL_PID = 0x1FFF;
+    const int64_t TICKS_PER_MS = PCRScheduler::PCR_TICKS_PER_MS;
+    const int64_t MAX_PCR_STEP = 1000 * TICKS_PER_MS;   // Larger forward steps are a jump, not an interval
+
+    // Signed distance a - b on the wrapping PCR timeline
+    int64_t PCRDiff(int64_t a, int64_t b) {
+        int64_t diff = (a - b) % PCRScheduler::PCR_WRAP;
+        if (diff > PCRScheduler::PCR_WRAP / 2) {
+            diff -= PCRScheduler::PCR_WRAP;
+        } else if (diff < -PCRScheduler::PCR_WRAP / 2) {
+            diff += PCRScheduler::PCR_WRAP;
+        }
+        return diff;
+    }
+
+} // namespace
+
+PIDStatistics::PIDStatistics() {
+    Reset();
+}
+
+void PIDStatistics::Reset() {
+    memset(slots_, NO_SLOT, sizeof(slots_));
+    states_.clear();
+    states_.reserve(MAX_PIDS);
+    packets_ = 0;
+    untracked_packets_ = 0;
+    segments_ = 0;
+    clock_pid_ = 0xFFFF;
+    stream_ticks_ = 0;
+    bucket_ = 0;
+    ring_index_ = 0;
+
+    std::lock_guard<std::mutex> lock(publish_mutex_);
+    snapshot_ = std::make_shared<const Snapshot>();
+}
+
+void PIDStatistics::ProcessSegment(const uint8_t* data, const PacketView* views, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        ProcessPacket(data + views[i].offset);
+    }
+    segments_++;
+    Publish();
+}
+
+void PIDStatistics::ProcessPackets(const uint8_t* packets, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        ProcessPacket(packets + i * TS_PACKET_SIZE);
+    }
+    segments_++;
+    Publish();
+}
+
+PIDStatistics::PIDState* PIDStatistics::GetState(uint16_t pid) {
+    uint8_t slot = slots_[pid];
+    if (slot != NO_SLOT) {
+        return &states_[slot];
+    }
+    if (states_.size() >= MAX_PIDS) {
+        return nullptr;
+    }
+    slots_[pid] = static_cast<uint8_t>(states_.size());
+    states_.emplace_back();
+    states_.back().counters.pid = pid;
+    return &states_.back();
+}
+
+void PIDStatistics::ProcessPacket(const uint8_t* packet) {
+    packets_++;
+    const uint16_t pid = static_cast<uint16_t>(((packet[1] & 0x1F) << 8) | packet[2]);
+    PIDState* state = GetState(pid);
+    if (!state) {
+        untracked_packets_++;
+        return;
+    }
+
+    PIDCounters& counters = state->counters;
+    counters.packets++;
+    state->bucket_bytes[ring_index_] += static_cast<uint32_t>(TS_PACKET_SIZE);
+
+    const bool transport_error = (packet[1] & 0x80) != 0;
+    const uint8_t control = packet[3];
+    if (transport_error) {
+        counters.tei_packets++;
+    }
+    if (control & 0xC0) {
+        counters.scrambled_packets++;
+    }
+
+    bool discontinuity = false;
+    if ((control & 0x20) && packet[4] > 0) {
+        discontinuity = (packet[5] & 0x80) != 0;
+        if (discontinuity) {
+            counters.discontinuities++;
+        }
+        uint16_t pcr_pid = 0;
+        int64_t pcr = 0;
+        if (!transport_error && PCRScheduler::ReadPCR(packet, pcr_pid, pcr)) {
+            OnPCR(*state, pid, pcr, discontinuity);
+        }
+    }
+
+    // Continuity: +1 per packet with payload, unchanged without; one repeat of a packet is allowed.
+    // The counter of a damaged packet cannot be trusted, so the next packet starts a new count.
+    if (pid == NULL_PID) {
+        return;
+    }
+    if (transport_error) {
+        state->last_cc = -1;
+        return;
+    }
+    const int cc = control & 0x0F;
+    const bool has_payload = (control & 0x10) != 0;
+    if (state->last_cc >= 0 && !discontinuity) {
+        if (has_payload && cc == state->last_cc) {
+            if (state->last_duplicate) {
+                counters.cc_errors++;
+            } else {
+                counters.duplicates++;
+            }
+            state->last_duplicate = true;
+            return;
+        }
+        int expected = has_payload ? ((state->last_cc + 1) & 0x0F) : state->last_cc;
+        if (cc != expected) {
+            counters.cc_errors++;
+        }
+    }
+    state->last_cc = cc;
+    state->last_duplicate = false;
+}
+
+void PIDStatistics::OnPCR(PIDState& state, uint16_t pid, int64_t pcr, bool discontinuity) {
+    PIDCounters& counters = state.counters;
+    counters.pcrs++;
+    if (clock_pid_ == 0xFFFF) {
+        clock_pid_ = pid;
+    }
+
+    if (state.have_pcr && !discontinuity) {
+        int64_t step = PCRDiff(pcr, state.last_pcr);
+        if (step <= 0 || step > MAX_PCR_STEP) {
+            counters.pcr_jumps++;
+        } else {
+            double interval_ms = static_cast<double>(step) / TICKS_PER_MS;
+            state.pcr_interval_sum_ms += interval_ms;
+            state.pcr_intervals++;
+            counters.pcr_interval_max_ms = std::max(counters.pcr_interval_max_ms, interval_ms);
+            if (interval_ms > MAX_PCR_INTERVAL_MS) {
+                counters.pcr_interval_violations++;
+            }
+            if (pid == clock_pid_) {
+                AdvanceStreamTime(step);
+            }
+        }
+    }
+    state.have_pcr = true;
+    state.last_pcr = pcr;
+}
+
+void PIDStatistics::AdvanceStreamTime(int64_t ticks) {
+    stream_ticks_ += ticks;
+    const int64_t bucket = stream_ticks_ / (BUCKET_MS * TICKS_PER_MS);
+
+    // Clear the buckets entered since the last PCR; the ring only holds one long window
+    int64_t steps = std::min<int64_t>(bucket - bucket_, RING_BUCKETS);
+    for (int64_t i = 0; i < steps; ++i) {
+        ring_index_ = (ring_index_ + 1) % RING_BUCKETS;
+        for (PIDState& state : states_) {
+            state.bucket_bytes[ring_index_] = 0;
+        }
+    }
+    ring_index_ = static_cast<size_t>(bucket % RING_BUCKETS);
+    bucket_ = bucket;
+}
+
+void PIDStatistics::Publish() {
+    auto snapshot = std::make_shared<Snapshot>();
+    snapshot->pids.reserve(states_.size());
+    snapshot->packets = packets_;
+    snapshot->untracked_packets = untracked_packets_;
+    snapshot->segments = segments_;
+
+    // Completed buckets only; the one filling now would understate the rate
+    const size_t short_buckets = static_cast<size_t>(std::min<int64_t>(bucket_, SHORT_WINDOW_BUCKETS));
+    const size_t long_buckets = static_cast<size_t>(std::min<int64_t>(bucket_, LONG_WINDOW_BUCKETS));
+    for (const PIDState& state : states_) {
+        PIDCounters counters = state.counters;
+        if (state.pcr_intervals > 0) {
+            counters.pcr_interval_avg_ms = state.pcr_interval_sum_ms / state.pcr_intervals;
+        }
+        uint64_t short_bytes = 0;
+        uint64_t long_bytes = 0;
+        for (size_t i = 1; i <= long_buckets; ++i) {
+            uint32_t bytes = state.bucket_bytes[(ring_index_ + RING_BUCKETS - i) % RING_BUCKETS];
+            long_bytes += bytes;
+            if (i <= short_buckets) {
+                short_bytes += bytes;
+            }
+        }
+        if (short_buckets > 0) {
+            counters.bitrate_bps = short_bytes * 8000.0 / (short_buckets * BUCKET_MS);
+            counters.avg_bitrate_bps = long_bytes * 8000.0 / (long_buckets * BUCKET_MS);
+        }
+        snapshot->cc_errors += counters.cc_errors;
+        snapshot->bitrate_bps += counters.bitrate_bps;
+        snapshot->avg_bitrate_bps += counters.avg_bitrate_bps;
+        snapshot->pids.push_back(counters);
+    }
+
+    std::shared_ptr<const Snapshot> published = std::move(snapshot);
+    std::lock_guard<std::mutex> lock(publish_mutex_);
+    snapshot_.swap(published);
+}
+
+std::shared_ptr<const PIDStatistics::Snapshot> PIDStatistics::GetSnapshot() const {
+    std::lock_guard<std::mutex> lock(publish_mutex_);
+    return snapshot_;
+}
+
+} // namespace tsduck_transport
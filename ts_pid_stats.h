@@ -0,0 +1,102 @@
+#pragma once
+// Per-PID transport stream statistics for the transport stream router
+// Counts continuity errors, transport_error_indicator and scrambled packets, PCR intervals and
+// bitrate per PID. Whole segments are processed in one pass on the fetcher thread; the table is
+// published as an immutable snapshot afterwards, so readers never wait on the stream threads.
+// Bitrates are measured over sliding windows of stream time (PCR), not download time, which
+// arrives a segment at a time.
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <memory>
+#include <mutex>
+
+#include "ts_packet.h"
+
+namespace tsduck_transport {
+
+    class PIDStatistics {
+    public:
+        static constexpr size_t MAX_PIDS = 64;                 // PIDs tracked individually; the rest are only counted
+        static constexpr int64_t BUCKET_MS = 100;              // Stream time per bitrate bucket
+        static constexpr size_t SHORT_WINDOW_BUCKETS = 10;     // 1 s
+        static constexpr size_t LONG_WINDOW_BUCKETS = 100;     // 10 s
+        static constexpr int64_t MAX_PCR_INTERVAL_MS = 100;    // ISO/IEC 13818-1 limit between PCRs of a PID
+
+        struct PIDCounters {
+            uint16_t pid = 0;
+            uint64_t packets = 0;
+            uint64_t cc_errors = 0;          // Lost, reordered or repeated-twice packets
+            uint64_t duplicates = 0;         // Single repeats, which the standard allows
+            uint64_t tei_packets = 0;        // transport_error_indicator set upstream
+            uint64_t scrambled_packets = 0;  // transport_scrambling_control non-zero
+            uint64_t discontinuities = 0;    // discontinuity_indicator set
+            uint64_t pcrs = 0;
+            uint64_t pcr_jumps = 0;          // PCR going backwards or jumping over a second without the indicator
+            uint64_t pcr_interval_violations = 0;
+            double pcr_interval_avg_ms = 0.0;
+            double pcr_interval_max_ms = 0.0;
+            double bitrate_bps = 0.0;        // Over the short window
+            double avg_bitrate_bps = 0.0;    // Over the long window
+        };
+
+        struct Snapshot {
+            std::vector<PIDCounters> pids;   // In order of first appearance
+            uint64_t packets = 0;
+            uint64_t untracked_packets = 0;  // On PIDs beyond MAX_PIDS
+            uint64_t segments = 0;
+            uint64_t cc_errors = 0;
+            double bitrate_bps = 0.0;
+            double avg_bitrate_bps = 0.0;
+        };
+
+        PIDStatistics();
+
+        // Account one segment's packets and publish a new snapshot
+        void ProcessSegment(const uint8_t* data, const PacketView* views, size_t count);
+        void ProcessPackets(const uint8_t* packets, size_t count);
+
+        // Latest published table; never blocks on the thread processing segments
+        std::shared_ptr<const Snapshot> GetSnapshot() const;
+
+        void Reset();
+
+    private:
+        static constexpr uint8_t NO_SLOT = 0xFF;
+        static constexpr size_t RING_BUCKETS = LONG_WINDOW_BUCKETS + 1;  // Completed buckets plus the one filling
+
+        struct PIDState {
+            PIDCounters counters;
+            int last_cc = -1;
+            bool last_duplicate = false;
+            bool have_pcr = false;
+            int64_t last_pcr = 0;
+            double pcr_interval_sum_ms = 0.0;
+            uint64_t pcr_intervals = 0;
+            uint32_t bucket_bytes[RING_BUCKETS] = {};
+        };
+
+        uint8_t slots_[0x2000];                      // PID -> index into states_
+        std::vector<PIDState> states_;
+        uint64_t packets_ = 0;
+        uint64_t untracked_packets_ = 0;
+        uint64_t segments_ = 0;
+
+        // Stream time from the first PID carrying a PCR
+        uint16_t clock_pid_ = 0xFFFF;
+        int64_t stream_ticks_ = 0;                   // 27 MHz stream time elapsed on the clock PID
+        int64_t bucket_ = 0;                         // Index of the bucket filling now
+        size_t ring_index_ = 0;                      // bucket_ % RING_BUCKETS
+
+        mutable std::mutex publish_mutex_;           // Held only to swap the snapshot pointer
+        std::shared_ptr<const Snapshot> snapshot_;
+
+        void ProcessPacket(const uint8_t* packet);
+        PIDState* GetState(uint16_t pid);
+        void OnPCR(PIDState& state, uint16_t pid, int64_t pcr, bool discontinuity);
+        void AdvanceStreamTime(int64_t ticks);
+        void Publish();
+    };
+
+} // namespace tsduck_transport
@@ -0,0 +1,218 @@
+#include "ts_splicer.h"
+#include "psi_tables.h"
+#include "ts_crc32.h"
+#include <algorithm>
+#include <cstring>
+
+namespace tsduck_transport {
+
+namespace {
+
+    uint16_t ReadPID(const uint8_t* packet) {
+        return static_cast<uint16_t>(((packet[1] & 0x1F) << 8) | packet[2]);
+    }
+
+    bool HasPayload(const uint8_t* packet) {
+        return (packet[3] & 0x10) != 0;
+    }
+
+    bool HasAdaptationField(const uint8_t* packet) {
+        return (packet[3] & 0x20) != 0 && packet[4] > 0;
+    }
+
+    void SetContinuityCounter(uint8_t* packet, uint8_t cc) {
+        packet[3] = static_cast<uint8_t>((packet[3] & 0xF0) | (cc & 0x0F));
+    }
+
+    // Same table apart from version_number and CRC_32
+    bool SameTable(const std::vector<uint8_t>& previous, const uint8_t* section, size_t size) {
+        if (previous.size() != size || size < 12) {
+            return false;
+        }
+        return memcmp(previous.data(), section, 5) == 0 && (previous[5] & 0xC1) == (section[5] & 0xC1) &&
+               memcmp(previous.data() + 6, section + 6, size - 10) == 0;
+    }
+
+} // namespace
+
+DiscontinuitySplicer::DiscontinuitySplicer() {
+    Reset();
+}
+
+void DiscontinuitySplicer::Reset() {
+    pids_.clear();
+    pat_ = TableState();
+    pmt_ = TableState();
+    pmt_pid_ = 0;
+    pcr_pending_ = false;
+    stats_ = Stats();
+}
+
+DiscontinuitySplicer::PidState& DiscontinuitySplicer::GetPid(uint16_t pid) {
+    for (PidState& state : pids_) {
+        if (state.pid == pid) {
+            return state;
+        }
+    }
+    PidState state;
+    state.pid = pid;
+    pids_.push_back(state);
+    return pids_.back();
+}
+
+void DiscontinuitySplicer::SpliceSegment(std::vector<uint8_t>& segment, bool discontinuity) {
+    // Nothing has been sent yet on the first segment, so there is nothing to join it to
+    if (discontinuity && !pids_.empty()) {
+        BeginPeriod();
+        InsertTables(segment);
+    }
+
+    ScanSyncRuns(segment.data(), segment.size(), runs_);
+    for (const SyncRun& run : runs_) {
+        uint8_t* packet = segment.data() + run.offset;
+        for (size_t i = 0; i < run.packets; ++i, packet += TS_PACKET_SIZE) {
+            RewritePacket(packet);
+        }
+    }
+}
+
+void DiscontinuitySplicer::BeginPeriod() {
+    for (PidState& state : pids_) {
+        state.resync = true;
+    }
+    pat_.resync = true;
+    pmt_.resync = true;
+    pcr_pending_ = true;
+    stats_.splices++;
+}
+
+void DiscontinuitySplicer::InsertTables(std::vector<uint8_t>& segment) {
+    ScanSyncRuns(segment.data(), segment.size(), runs_);
+    if (runs_.empty() || ReadPID(segment.data() + runs_[0].offset) == PAT_PID) {
+        return; // The new period already opens with its PAT
+    }
+
+    // The new period's first PAT and the PMT it points to
+    const uint8_t* pat_packet = nullptr;
+    const uint8_t* pmt_packet = nullptr;
+    uint16_t pmt_pid = 0;
+    for (const SyncRun& run : runs_) {
+        const uint8_t* packet = segment.data() + run.offset;
+        for (size_t i = 0; i < run.packets && !pmt_packet; ++i, packet += TS_PACKET_SIZE) {
+            uint16_t pid = ReadPID(packet);
+            const uint8_t* section = nullptr;
+            size_t size = 0;
+            if (!pat_packet && pid == PAT_PID && FindSectionInPacket(packet, section, size)) {
+                ProgramAssociationTable pat;
+                if (ParsePATSection(section, size, pat) && pat.GetFirstPMTPID() != 0) {
+                    pat_packet = packet;
+                    pmt_pid = pat.GetFirstPMTPID();
+                }
+            } else if (pat_packet && pid == pmt_pid && FindSectionInPacket(packet, section, size)) {
+                pmt_packet = packet;
+            }
+        }
+    }
+    if (!pat_packet) {
+        return;
+    }
+
+    // Copies go in front with the counter before the original's, so the originals still follow on
+    uint8_t tables[2 * TS_PACKET_SIZE];
+    size_t count = 0;
+    for (const uint8_t* packet : { pat_packet, pmt_packet }) {
+        if (packet) {
+            uint8_t* copy = tables + count * TS_PACKET_SIZE;
+            memcpy(copy, packet, TS_PACKET_SIZE);
+            SetContinuityCounter(copy, static_cast<uint8_t>((packet[3] & 0x0F) - 1));
+            count++;
+        }
+    }
+    segment.insert(segment.begin() + runs_[0].offset, tables, tables + count * TS_PACKET_SIZE);
+    stats_.tables_resent += count;
+}
+
+void DiscontinuitySplicer::RewritePacket(uint8_t* packet) {
+    const uint16_t pid = ReadPID(packet);
+    if (pid == 0x1FFF) {
+        return; // Null packets carry no counter that matters
+    }
+
+    PidState& state = GetPid(pid);
+    const uint8_t cc = packet[3] & 0x0F;
+    if (state.resync) {
+        // First packet of this PID in the new period: continue from the last counter written
+        if (state.last_cc >= 0) {
+            uint8_t expected = static_cast<uint8_t>(state.last_cc + (HasPayload(packet) ? 1 : 0));
+            uint8_t offset = static_cast<uint8_t>((expected - cc) & 0x0F);
+            if (offset != state.cc_offset) {
+                stats_.pids_remapped++;
+            }
+            state.cc_offset = offset;
+        }
+        state.resync = false;
+    }
+
+    uint8_t out_cc = static_cast<uint8_t>((cc + state.cc_offset) & 0x0F);
+    if (out_cc != cc) {
+        SetContinuityCounter(packet, out_cc);
+    }
+    state.last_cc = out_cc;
+
+    // The new time base: PCRs jump here, which the player must not take for a clock error
+    if (pcr_pending_ && HasAdaptationField(packet) && (packet[5] & 0x10)) {
+        packet[5] |= 0x80;
+        pcr_pending_ = false;
+        stats_.pcrs_marked++;
+    }
+
+    if (pid == PAT_PID) {
+        RewriteTable(pat_, packet);
+    } else if (pmt_pid_ != 0 && pid == pmt_pid_) {
+        RewriteTable(pmt_, packet);
+    }
+}
+
+void DiscontinuitySplicer::RewriteTable(TableState& table, uint8_t* packet) {
+    const uint8_t* found = nullptr;
+    size_t size = 0;
+    if (!FindSectionInPacket(packet, found, size) || size < 12 || CRC32MPEG(found, size) != 0) {
+        return;
+    }
+    uint8_t* section = packet + (found - packet);
+    const uint8_t version = (section[5] >> 1) & 0x1F;
+
+    // A changed table needs a version the player has not seen, or it keeps using the old one
+    if (table.resync) {
+        if (table.last_version >= 0) {
+            bool same = SameTable(table.last_section, section, size);
+            uint8_t next = static_cast<uint8_t>(table.last_version + (same ? 0 : 1));
+            table.version_offset = static_cast<uint8_t>((next - version) & 0x1F);
+            if (!same) {
+                stats_.tables_versioned++;
+            }
+        }
+        table.resync = false;
+    }
+
+    uint8_t out_version = static_cast<uint8_t>((version + table.version_offset) & 0x1F);
+    if (out_version != version) {
+        section[5] = static_cast<uint8_t>((section[5] & 0xC1) | (out_version << 1));
+        uint32_t crc = CRC32MPEG(section, size - 4);
+        section[size - 4] = static_cast<uint8_t>(crc >> 24);
+        section[size - 3] = static_cast<uint8_t>(crc >> 16);
+        section[size - 2] = static_cast<uint8_t>(crc >> 8);
+        section[size - 1] = static_cast<uint8_t>(crc);
+    }
+    table.last_version = out_version;
+    table.last_section.assign(section, section + size);
+
+    if (&table == &pat_) {
+        ProgramAssociationTable pat;
+        if (ParsePATSection(section, size, pat)) {
+            pmt_pid_ = pat.GetFirstPMTPID();
+        }
+    }
+}
+
+} // namespace tsduck_transport
@@ -0,0 +1,67 @@
+#pragma once
+// Discontinuity splicing for the transport stream router
+// Joins the periods of an HLS stream (#EXT-X-DISCONTINUITY, e.g. around ad breaks) into one continuous
+// transport stream instead of flushing: continuity counters are remapped per PID so they run on across
+// the boundary, the first PCR of the new period carries the discontinuity_indicator, changed PAT/PMT
+// get a new version number, and the new period's tables are re-sent at its start.
+// Segments are rewritten in place before they are split into packets, so the zero-copy path is kept.
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "ts_packet.h"
+#include "ts_sync.h"
+
+namespace tsduck_transport {
+
+    class DiscontinuitySplicer {
+    public:
+        struct Stats {
+            uint64_t splices = 0;            // Period boundaries joined
+            uint64_t tables_resent = 0;      // PAT/PMT packets inserted at a boundary
+            uint64_t tables_versioned = 0;   // Changed tables given a new version number
+            uint64_t pcrs_marked = 0;        // PCRs flagged with the discontinuity_indicator
+            uint64_t pids_remapped = 0;      // PIDs whose continuity counters were shifted at a boundary
+        };
+
+        DiscontinuitySplicer();
+
+        // Rewrite one downloaded segment so it continues the output. discontinuity marks the first
+        // segment of a new period; PAT/PMT may then be inserted at the front of segment.
+        void SpliceSegment(std::vector<uint8_t>& segment, bool discontinuity);
+
+        void Reset();
+        const Stats& GetStats() const { return stats_; }
+
+    private:
+        struct PidState {
+            uint16_t pid = 0;
+            int last_cc = -1;            // Last continuity counter written
+            uint8_t cc_offset = 0;       // Added to the stream's counters in the current period
+            bool resync = false;         // Offset is recomputed on the first packet of a new period
+        };
+
+        struct TableState {
+            int last_version = -1;       // Last version_number written
+            uint8_t version_offset = 0;  // Added to the stream's version in the current period
+            bool resync = false;
+            std::vector<uint8_t> last_section; // As written, to tell a changed table from a repeat
+        };
+
+        std::vector<PidState> pids_;
+        TableState pat_;
+        TableState pmt_;
+        uint16_t pmt_pid_ = 0;
+        bool pcr_pending_ = false;       // The next PCR starts the new period's time base
+        std::vector<SyncRun> runs_;
+        Stats stats_;
+
+        PidState& GetPid(uint16_t pid);
+        void BeginPeriod();
+        void InsertTables(std::vector<uint8_t>& segment);
+        void RewritePacket(uint8_t* packet);
+        void RewriteTable(TableState& table, uint8_t* packet);
+    };
+
+} // namespace tsduck_transport
@@ -0,0 +1,435 @@
+// Stall measurement across a synthetic ad break: buffer flush vs. discontinuity splicing
+// A live playlist of content, a three-segment ad and content again (new time base, counters and
+// audio PID in each period, PMT version left at 0 as ad servers do) is fetched one segment per
+// refresh, queued in TSBuffer and paced out with PCRScheduler in virtual time. The old path clears the
+// buffer on every refresh while the playlist shows a discontinuity; the new path splices each
+// segment. A player model then counts stalls: it needs PAT/PMT to map PIDs (a PMT with an unchanged
+// version is ignored), drops video from a continuity error to the next key frame, and flushes and
+// rebuffers on a PCR jump without the discontinuity_indicator.
+//
+// Build: g++ -std=c++17 -O2 ts_splicer_bench.cpp ts_splicer.cpp ts_buffer.cpp pcr_scheduler.cpp psi_tables.cpp ts_crc32.cpp ts_sync.cpp ts_packet.cpp -o ts_splicer_bench
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <deque>
+#include <cstring>
+#include <string>
+#include <algorithm>
+#include "ts_splicer.h"
+#include "ts_buffer.h"
+#include "pcr_scheduler.h"
+#include "psi_tables.h"
+
+using namespace tsduck_transport;
+
+namespace {
+
+    using Clock = PCRScheduler::Clock;
+
+    const uint16_t PMT_PID = 0x1000;
+    const uint16_t VIDEO_PID = 0x100;
+    const int FRAMES_PER_SEGMENT = 60;
+    const double FRAME_MS = 1000.0 / 30.0;
+    const int64_t PCR_PER_FRAME = 900000;       // 27 MHz ticks at 30 fps
+    const int SEGMENT_MS = 2000;
+    const size_t PLAYLIST_WINDOW = 4;
+    const size_t LIVE_START = 3;                // Segments behind live at start-up, as the fetcher begins
+    const double STARTUP_MS = 1000.0;           // Player buffers this much before (re)starting playback
+    const int STEP_MS = 5;
+
+    struct Period {
+        uint16_t audio_pid;
+        int64_t pcr_base;
+        uint8_t cc_seed;
+        uint8_t id;
+    };
+
+    // Content, ad, content; the ad has its own audio PID, time base and counters
+    const Period CONTENT = { 0x101, int64_t(1000) * 27000000, 3, 0 };
+    const Period AD = { 0x102, int64_t(50) * 27000000, 11, 1 };
+    const Period CONTENT_AFTER = { 0x101, int64_t(1026) * 27000000, 7, 2 };
+
+    struct PlaylistSegment {
+        Period period;
+        int frame_in_period = 0;     // First frame's index within its period
+        bool discontinuity = false;
+    };
+
+    std::vector<PlaylistSegment> MakePlaylist() {
+        std::vector<PlaylistSegment> playlist;
+        auto add = [&playlist](const Period& period, int count) {
+            for (int i = 0; i < count; ++i) {
+                PlaylistSegment segment;
+                segment.period = period;
+                segment.frame_in_period = i * FRAMES_PER_SEGMENT;
+                segment.discontinuity = i == 0 && !playlist.empty();
+                playlist.push_back(segment);
+            }
+        };
+        add(CONTENT, 10);
+        add(AD, 3);
+        add(CONTENT_AFTER, 10);
+        return playlist;
+    }
+
+    bool Check(bool condition, const std::string& what) {
+        std::cout << (condition ? "  PASS  " : "  FAIL  ") << what << std::endl;
+        return condition;
+    }
+
+    // Encoder side: per-PID counters run on within a period and start elsewhere in the next
+    class SegmentMaker {
+    public:
+        std::vector<uint8_t> Make(const PlaylistSegment& segment, uint32_t& frame_id) {
+            if (!have_period_ || segment.period.id != period_id_) {
+                have_period_ = true;
+                period_id_ = segment.period.id;
+                for (int i = 0; i < 0x2000; ++i) {
+                    cc_[i] = static_cast<uint8_t>(segment.period.cc_seed + i);
+                }
+            }
+            const Period& period = segment.period;
+            std::vector<uint8_t> data;
+
+            ProgramAssociationTable pat;
+            pat.transport_stream_id = 1;
+            pat.programs.push_back({ 1, PMT_PID });
+            std::vector<uint8_t> section;
+            BuildPATSection(pat, section);
+            AppendSection(data, PAT_PID, section);
+
+            ProgramMapTable pmt;
+            pmt.program_number = 1;
+            pmt.pcr_pid = VIDEO_PID;
+            pmt.streams.push_back({ 0x1B, VIDEO_PID, {} });
+            pmt.streams.push_back({ 0x0F, period.audio_pid, {} });
+            BuildPMTSection(pmt, section);
+            AppendSection(data, PMT_PID, section);
+
+            for (int f = 0; f < FRAMES_PER_SEGMENT; ++f) {
+                int frame = segment.frame_in_period + f;
+                bool key = f == 0;
+                int64_t pcr = period.pcr_base + frame * PCR_PER_FRAME;
+                int video_packets = key ? 40 : 10;
+                for (int i = 0; i < video_packets; ++i) {
+                    AppendPacket(data, VIDEO_PID, i == 0, i == 0 ? pcr : -1, frame_id, key, period.id);
+                }
+                for (int i = 0; i < 2; ++i) {
+                    AppendPacket(data, period.audio_pid, i == 0, -1, frame_id, false, period.id);
+                }
+                frame_id++;
+            }
+            return data;
+        }
+
+    private:
+        uint8_t cc_[0x2000];
+        bool have_period_ = false;
+        uint8_t period_id_ = 0;
+
+        uint8_t* NewPacket(std::vector<uint8_t>& data, uint16_t pid, bool unit_start) {
+            data.resize(data.size() + TS_PACKET_SIZE, 0xFF);
+            uint8_t* packet = &data[data.size() - TS_PACKET_SIZE];
+            packet[0] = 0x47;
+            packet[1] = static_cast<uint8_t>((unit_start ? 0x40 : 0x00) | (pid >> 8));
+            packet[2] = static_cast<uint8_t>(pid);
+            packet[3] = static_cast<uint8_t>(0x10 | (cc_[pid]++ & 0x0F));
+            return packet;
+        }
+
+        void AppendSection(std::vector<uint8_t>& data, uint16_t pid, const std::vector<uint8_t>& section) {
+            uint8_t* packet = NewPacket(data, pid, true);
+            packet[4] = 0x00;
+            memcpy(packet + 5, section.data(), section.size());
+        }
+
+        void AppendPacket(std::vector<uint8_t>& data, uint16_t pid, bool unit_start, int64_t pcr, uint32_t frame_id, bool key, uint8_t period) {
+            uint8_t* packet = NewPacket(data, pid, unit_start);
+            size_t offset = 4;
+            if (pcr >= 0) {
+                packet[3] |= 0x20;
+                int64_t base = pcr / 300;
+                int64_t extension = pcr % 300;
+                packet[4] = 7;
+                packet[5] = 0x10;
+                packet[6] = static_cast<uint8_t>(base >> 25);
+                packet[7] = static_cast<uint8_t>(base >> 17);
+                packet[8] = static_cast<uint8_t>(base >> 9);
+                packet[9] = static_cast<uint8_t>(base >> 1);
+                packet[10] = static_cast<uint8_t>(((base & 1) << 7) | 0x7E | (extension >> 8));
+                packet[11] = static_cast<uint8_t>(extension);
+                offset = 12;
+            }
+            if (unit_start) {
+                packet[offset] = 'F';
+                memcpy(packet + offset + 1, &frame_id, 4);
+                packet[offset + 5] = key;
+                packet[offset + 6] = period;
+            }
+        }
+    };
+
+    // Demuxer and playout buffer, stepped in virtual time
+    class PlayerModel {
+    public:
+        double stall_ms = 0.0;
+        int stalls = 0;
+        int clock_resets = 0;
+        uint64_t frames_shown = 0;
+        uint64_t frames_undecodable = 0;
+        uint64_t audio_units_lost = 0;
+        uint64_t continuity_errors = 0;
+
+        void Receive(const uint8_t* packet) {
+            uint16_t pid = static_cast<uint16_t>(((packet[1] & 0x1F) << 8) | packet[2]);
+            bool unit_start = (packet[1] & 0x40) != 0;
+            bool adaptation = (packet[3] & 0x20) && packet[4] > 0;
+            bool discontinuity = adaptation && (packet[5] & 0x80);
+            uint8_t cc = packet[3] & 0x0F;
+
+            if (pid == PAT_PID || pid == pmt_pid_) {
+                OnPSI(pid, packet);
+            }
+            if (pid != video_pid_ && pid != audio_pid_) {
+                if (unit_start && pid != PAT_PID && pid != pmt_pid_) {
+                    audio_units_lost++;
+                }
+                return;
+            }
+
+            int& last_cc = pid == video_pid_ ? video_cc_ : audio_cc_;
+            if (last_cc >= 0 && !discontinuity && cc != ((last_cc + 1) & 0x0F) && cc != last_cc) {
+                continuity_errors++;
+                if (pid == video_pid_) {
+                    video_broken_ = true;
+                }
+            }
+            last_cc = cc;
+
+            if (pid != video_pid_) {
+                return;
+            }
+            if (adaptation && (packet[5] & 0x10)) {
+                int64_t pcr = ((int64_t(packet[6]) << 25) | (int64_t(packet[7]) << 17) | (int64_t(packet[8]) << 9) |
+                               (int64_t(packet[9]) << 1) | (packet[10] >> 7)) * 300 + (((packet[10] & 1) << 8) | packet[11]);
+                if (have_pcr_ && !discontinuity && std::llabs(pcr - last_pcr_) > 27000000) {
+                    // Clock jump without a signalled new time base: flush and re-probe
+                    clock_resets++;
+                    queue_ms_ = 0.0;
+                    video_broken_ = true;
+                    if (playing_) {
+                        playing_ = false;
+                        stalls++;
+                    }
+                }
+                have_pcr_ = true;
+                last_pcr_ = pcr;
+            }
+            if (unit_start) {
+                size_t offset = adaptation ? 5 + packet[4] : 4;
+                bool key = packet[offset + 5] != 0;
+                if (key) {
+                    video_broken_ = false;
+                }
+                if (video_broken_) {
+                    frames_undecodable++;
+                } else {
+                    queue_ms_ += FRAME_MS;
+                }
+            }
+        }
+
+        void Advance(double ms) {
+            if (!playing_) {
+                if (queue_ms_ >= STARTUP_MS) {
+                    playing_ = true;
+                    started_ = true;
+                } else if (started_) {
+                    stall_ms += ms;
+                }
+                return;
+            }
+            if (queue_ms_ <= 0.0) {
+                playing_ = false;
+                stalls++;
+                stall_ms += ms;
+                return;
+            }
+            double shown = std::min(ms, queue_ms_);
+            queue_ms_ -= shown;
+            play_accumulator_ += shown;
+            while (play_accumulator_ >= FRAME_MS) {
+                play_accumulator_ -= FRAME_MS;
+                frames_shown++;
+            }
+        }
+
+    private:
+        uint16_t pmt_pid_ = 0;
+        uint16_t video_pid_ = 0;
+        uint16_t audio_pid_ = 0;
+        int pmt_version_ = -1;
+        int video_cc_ = -1;
+        int audio_cc_ = -1;
+        bool video_broken_ = true;   // Until the first key frame
+        bool have_pcr_ = false;
+        int64_t last_pcr_ = 0;
+        double queue_ms_ = 0.0;
+        double play_accumulator_ = 0.0;
+        bool playing_ = false;
+        bool started_ = false;
+
+        void OnPSI(uint16_t pid, const uint8_t* packet) {
+            const uint8_t* section = nullptr;
+            size_t size = 0;
+            if (!FindSectionInPacket(packet, section, size)) {
+                return;
+            }
+            if (pid == PAT_PID) {
+                ProgramAssociationTable pat;
+                if (ParsePATSection(section, size, pat)) {
+                    pmt_pid_ = pat.GetFirstPMTPID();
+                }
+                return;
+            }
+            ProgramMapTable pmt;
+            if (!ParsePMTSection(section, size, pmt) || pmt.version == pmt_version_) {
+                return; // Demuxers only re-map streams when the version changes
+            }
+            pmt_version_ = pmt.version;
+            for (const ElementaryStreamInfo& stream : pmt.streams) {
+                if (stream.stream_type == 0x1B) {
+                    video_pid_ = stream.pid;
+                } else if (stream.stream_type == 0x0F) {
+                    audio_pid_ = stream.pid;
+                    audio_cc_ = -1;
+                }
+            }
+        }
+    };
+
+    struct RunResult {
+        PlayerModel player;
+        uint64_t packets_flushed = 0;
+        DiscontinuitySplicer::Stats splice;
+    };
+
+    RunResult Run(bool splice) {
+        RunResult result;
+        const std::vector<PlaylistSegment> playlist = MakePlaylist();
+        SegmentMaker maker;
+        DiscontinuitySplicer splicer;
+        TSBuffer buffer(15000);
+        PCRScheduler pacer;
+        uint32_t frame_id = 0;
+
+        std::vector<uint8_t> batch(64 * TS_PACKET_SIZE);
+        size_t batch_count = 0;
+        size_t batch_released = 0;
+        uint64_t gaps = 0;
+
+        const Clock::time_point start;
+        // Ends with the last segment, before the player drains at the end of the playlist
+        const int end_ms = (static_cast<int>(playlist.size()) + 1) * SEGMENT_MS;
+        size_t next_segment = 0;
+        for (int now_ms = 0; now_ms < end_ms; now_ms += STEP_MS) {
+            Clock::time_point now = start + std::chrono::milliseconds(now_ms);
+
+            // Playlist refresh: the first playlist already lists LIVE_START segments, then one more every SEGMENT_MS
+            while (next_segment < playlist.size() && now_ms >= static_cast<int>(std::max(next_segment + 1, LIVE_START)) * SEGMENT_MS) {
+                const PlaylistSegment& segment = playlist[next_segment];
+                if (!splice) {
+                    // Old fast restart: flush whenever the playlist window holds a discontinuity
+                    size_t window_start = next_segment + 1 > PLAYLIST_WINDOW ? next_segment + 1 - PLAYLIST_WINDOW : 0;
+                    bool window_has_discontinuity = false;
+                    for (size_t i = window_start; i <= next_segment; ++i) {
+                        window_has_discontinuity = window_has_discontinuity || playlist[i].discontinuity;
+                    }
+                    if (window_has_discontinuity) {
+                        result.packets_flushed += buffer.GetBufferedPackets() + (batch_count - batch_released);
+                        buffer.Clear();
+                        batch_count = batch_released = 0;
+                    }
+                }
+                std::vector<uint8_t> data = maker.Make(segment, frame_id);
+                if (splice) {
+                    splicer.SpliceSegment(data, segment.discontinuity);
+                }
+                buffer.AddPackets(data.data(), nullptr, data.size() / TS_PACKET_SIZE);
+                next_segment++;
+            }
+
+            // Router: pop a batch, resync the pacer after gaps, release what is due
+            pacer.SetBacklog(buffer.GetBufferedPackets(), now);
+            while (true) {
+                if (batch_released == batch_count) {
+                    batch_count = buffer.GetPackets(batch.data(), nullptr, 64, std::chrono::milliseconds(0));
+                    batch_released = 0;
+                    if (buffer.GetGapCount() != gaps) {
+                        gaps = buffer.GetGapCount();
+                        pacer.Resync();
+                    }
+                    if (batch_count == 0) {
+                        break;
+                    }
+                }
+                Clock::time_point wait_until;
+                size_t ready = pacer.Release(batch.data() + batch_released * TS_PACKET_SIZE, batch_count - batch_released, now, wait_until);
+                for (size_t i = 0; i < ready; ++i) {
+                    result.player.Receive(batch.data() + (batch_released + i) * TS_PACKET_SIZE);
+                }
+                batch_released += ready;
+                if (batch_released < batch_count) {
+                    break;
+                }
+            }
+            result.player.Advance(STEP_MS);
+        }
+        result.splice = splicer.GetStats();
+        return result;
+    }
+
+    void PrintRow(const std::string& name, const RunResult& result) {
+        const PlayerModel& player = result.player;
+        std::cout << std::left << std::setw(18) << ("  " + name) << std::right
+                  << std::setw(10) << static_cast<int>(player.stall_ms)
+                  << std::setw(8) << player.stalls
+                  << std::setw(10) << player.clock_resets
+                  << std::setw(10) << player.continuity_errors
+                  << std::setw(12) << player.frames_undecodable
+                  << std::setw(12) << player.audio_units_lost
+                  << std::setw(10) << result.packets_flushed << std::endl;
+    }
+
+} // namespace
+
+int main() {
+    std::cout << "=== Ad break: buffer flush vs. discontinuity splicing ===" << std::endl;
+    std::cout << "10 content + 3 ad + 10 content segments of " << SEGMENT_MS << "ms, playlist window " << PLAYLIST_WINDOW
+              << ", player rebuffers " << static_cast<int>(STARTUP_MS) << "ms" << std::endl << std::endl;
+
+    RunResult flush = Run(false);
+    RunResult splice = Run(true);
+
+    std::cout << std::left << std::setw(18) << "  path" << std::right << std::setw(10) << "stall ms" << std::setw(8) << "stalls"
+              << std::setw(10) << "clk reset" << std::setw(10) << "cc errors" << std::setw(12) << "bad frames"
+              << std::setw(12) << "audio lost" << std::setw(10) << "flushed" << std::endl;
+    PrintRow("flush", flush);
+    PrintRow("splice", splice);
+    std::cout << std::endl << "  Splicer: " << splice.splice.splices << " boundaries, " << splice.splice.pids_remapped
+              << " PID counters remapped, " << splice.splice.tables_versioned << " tables re-versioned, "
+              << splice.splice.pcrs_marked << " PCRs marked" << std::endl << std::endl;
+
+    bool ok = true;
+    ok = Check(flush.player.stall_ms > 0.0, "flushing on the discontinuity stalls the player") && ok;
+    ok = Check(splice.player.stall_ms == 0.0 && splice.player.stalls == 0, "spliced stream plays through both boundaries without a stall") && ok;
+    ok = Check(splice.player.continuity_errors == 0 && splice.player.clock_resets == 0,
+               "no continuity errors and no unsignalled clock jumps after splicing") && ok;
+    ok = Check(splice.player.audio_units_lost == 0 && flush.player.audio_units_lost > 0,
+               "re-versioned PMT moves the player to the ad's audio PID and back") && ok;
+    ok = Check(splice.splice.splices == 2 && splice.splice.pcrs_marked == 2, "both boundaries joined, first PCR of each marked") && ok;
+
+    std::cout << std::endl << (ok ? "All checks passed" : "SOME CHECKS FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
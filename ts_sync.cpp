@@ -0,0 +1,242 @@
+#include "ts_sync.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define TS_SYNC_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#else
+#define TS_SYNC_X86 0
+#endif
+
+// MSVC compiles intrinsics for any instruction set; GCC/Clang need the target enabled per function
+#if TS_SYNC_X86 && (defined(__GNUC__) || defined(__clang__))
+#define TS_SYNC_TARGET_SSE2 __attribute__((target("sse2")))
+#define TS_SYNC_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TS_SYNC_TARGET_SSE2
+#define TS_SYNC_TARGET_AVX2
+#endif
+
+namespace tsduck_transport {
+
+namespace {
+
+    // Packets after a candidate sync byte that must also line up before a resync is accepted.
+    // A stray 0x47 in payload passes three checks with probability ~1/16M.
+    constexpr size_t RESYNC_CONFIRM_PACKETS = 2;
+
+    unsigned CountTrailingZeros(uint32_t value) {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward(&index, value);
+        return static_cast<unsigned>(index);
+#else
+        return static_cast<unsigned>(__builtin_ctz(value));
+#endif
+    }
+
+    SyncScanLevel DetectSyncScanLevel() {
+#if TS_SYNC_X86
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        int max_leaf = info[0];
+        __cpuid(info, 1);
+        bool sse2 = (info[3] & (1 << 26)) != 0;
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool avx = (info[2] & (1 << 28)) != 0;
+        bool avx2 = false;
+        // AVX2 also needs the OS to save YMM state across context switches
+        if (max_leaf >= 7 && osxsave && avx && (_xgetbv(0) & 0x6) == 0x6) {
+            __cpuidex(info, 7, 0);
+            avx2 = (info[1] & (1 << 5)) != 0;
+        }
+#else
+        __builtin_cpu_init();
+        bool sse2 = __builtin_cpu_supports("sse2") != 0;
+        bool avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+        if (avx2) {
+            return SyncScanLevel::AVX2;
+        }
+        if (sse2) {
+            return SyncScanLevel::SSE2;
+        }
+#endif
+        return SyncScanLevel::SCALAR;
+    }
+
+    size_t FindSyncByteScalar(const uint8_t* data, size_t size, size_t from) {
+        for (size_t i = from; i < size; ++i) {
+            if (data[i] == TS_SYNC_BYTE) {
+                return i;
+            }
+        }
+        return size;
+    }
+
+    size_t CountSyncedPacketsScalar(const uint8_t* data, size_t size, size_t offset) {
+        size_t count = 0;
+        for (size_t pos = offset; pos + TS_PACKET_SIZE <= size; pos += TS_PACKET_SIZE) {
+            if (data[pos] != TS_SYNC_BYTE) {
+                break;
+            }
+            count++;
+        }
+        return count;
+    }
+
+#if TS_SYNC_X86
+    TS_SYNC_TARGET_SSE2
+    size_t FindSyncByteSSE2(const uint8_t* data, size_t size, size_t from) {
+        const __m128i sync = _mm_set1_epi8(static_cast<char>(TS_SYNC_BYTE));
+        size_t i = from;
+        for (; i + 16 <= size; i += 16) {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, sync)));
+            if (mask != 0) {
+                return i + CountTrailingZeros(mask);
+            }
+        }
+        return FindSyncByteScalar(data, size, i);
+    }
+
+    TS_SYNC_TARGET_AVX2
+    size_t FindSyncByteAVX2(const uint8_t* data, size_t size, size_t from) {
+        const __m256i sync = _mm256_set1_epi8(static_cast<char>(TS_SYNC_BYTE));
+        size_t i = from;
+        for (; i + 32 <= size; i += 32) {
+            __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+            uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, sync)));
+            if (mask != 0) {
+                return i + CountTrailingZeros(mask);
+            }
+        }
+        return FindSyncByteScalar(data, size, i);
+    }
+
+    // Gathers the first 4 bytes of 8 consecutive packets per step. Each gather stays inside a whole
+    // packet, so it never reads past the buffer.
+    TS_SYNC_TARGET_AVX2
+    size_t CountSyncedPacketsAVX2(const uint8_t* data, size_t size, size_t offset) {
+        const size_t available = offset < size ? (size - offset) / TS_PACKET_SIZE : 0;
+        const int stride = static_cast<int>(TS_PACKET_SIZE);
+        const __m256i index = _mm256_setr_epi32(0, stride, 2 * stride, 3 * stride,
+                                                4 * stride, 5 * stride, 6 * stride, 7 * stride);
+        const __m256i low_byte = _mm256_set1_epi32(0xFF);
+        const __m256i sync = _mm256_set1_epi32(TS_SYNC_BYTE);
+
+        size_t count = 0;
+        for (; count + 8 <= available; count += 8) {
+            const int* base = reinterpret_cast<const int*>(data + offset + count * TS_PACKET_SIZE);
+            __m256i first_bytes = _mm256_and_si256(_mm256_i32gather_epi32(base, index, 1), low_byte);
+            uint32_t mask = static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(first_bytes, sync))));
+            if (mask != 0xFF) {
+                return count + CountTrailingZeros(~mask & 0xFF);
+            }
+        }
+        return count + CountSyncedPacketsScalar(data, size, offset + count * TS_PACKET_SIZE);
+    }
+#endif
+
+} // namespace
+
+SyncScanLevel GetSyncScanLevel() {
+    static const SyncScanLevel level = DetectSyncScanLevel();
+    return level;
+}
+
+const char* GetSyncScanLevelName(SyncScanLevel level) {
+    switch (level) {
+    case SyncScanLevel::AVX2: return "AVX2";
+    case SyncScanLevel::SSE2: return "SSE2";
+    default: return "scalar";
+    }
+}
+
+size_t FindSyncByte(const uint8_t* data, size_t size, size_t from, SyncScanLevel level) {
+    if (from >= size) {
+        return size;
+    }
+#if TS_SYNC_X86
+    switch (level) {
+    case SyncScanLevel::AVX2: return FindSyncByteAVX2(data, size, from);
+    case SyncScanLevel::SSE2: return FindSyncByteSSE2(data, size, from);
+    default: break;
+    }
+#else
+    (void)level;
+#endif
+    return FindSyncByteScalar(data, size, from);
+}
+
+size_t CountSyncedPackets(const uint8_t* data, size_t size, size_t offset, SyncScanLevel level) {
+#if TS_SYNC_X86
+    if (level == SyncScanLevel::AVX2) {
+        return CountSyncedPacketsAVX2(data, size, offset);
+    }
+#else
+    (void)level;
+#endif
+    return CountSyncedPacketsScalar(data, size, offset);
+}
+
+size_t FindSyncPosition(const uint8_t* data, size_t size, size_t from, size_t confirm_packets, SyncScanLevel level) {
+    size_t pos = from;
+    while (true) {
+        pos = FindSyncByte(data, size, pos, level);
+        if (pos >= size || pos + TS_PACKET_SIZE > size) {
+            return size;
+        }
+
+        // Check the following packet positions that exist in the buffer
+        size_t confirmed = 0;
+        bool aligned = true;
+        for (size_t k = 1; k <= confirm_packets; ++k) {
+            size_t next = pos + k * TS_PACKET_SIZE;
+            if (next >= size) {
+                break;
+            }
+            if (data[next] != TS_SYNC_BYTE) {
+                aligned = false;
+                break;
+            }
+            confirmed++;
+        }
+
+        if (aligned && (confirmed > 0 || confirm_packets == 0 || pos + TS_PACKET_SIZE == size)) {
+            return pos;
+        }
+        pos++;
+    }
+}
+
+SyncScanResult ScanSyncRuns(const uint8_t* data, size_t size, std::vector<SyncRun>& runs, SyncScanLevel level) {
+    runs.clear();
+    SyncScanResult result;
+
+    size_t offset = 0;
+    while (offset + TS_PACKET_SIZE <= size) {
+        size_t start = FindSyncPosition(data, size, offset, RESYNC_CONFIRM_PACKETS, level);
+        if (start >= size) {
+            break;
+        }
+
+        // start holds a confirmed whole packet, so the run has at least one packet
+        SyncRun run;
+        run.offset = start;
+        run.packets = CountSyncedPackets(data, size, start, level);
+        runs.push_back(run);
+
+        result.packets += run.packets;
+        offset = start + run.packets * TS_PACKET_SIZE;
+    }
+
+    result.bytes_skipped = size - result.packets * TS_PACKET_SIZE;
+    result.resyncs = runs.empty() ? 0 : runs.size() - 1;
+    return result;
+}
+
+} // namespace tsduck_transport
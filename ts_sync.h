@@ -0,0 +1,58 @@
+#pragma once
+// MPEG-TS sync byte validation and resynchronization for downloaded segments
+// Finds the runs of 188-byte aligned packets in a buffer, skipping corrupt or misaligned stretches
+// instead of giving up at the first bad sync byte. Uses SSE2/AVX2 when the CPU has them (chosen at
+// runtime) and a scalar fallback everywhere else.
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "ts_packet.h"
+
+namespace tsduck_transport {
+
+    static constexpr uint8_t TS_SYNC_BYTE = 0x47;
+
+    // Instruction set used by the scanner
+    enum class SyncScanLevel {
+        SCALAR,
+        SSE2,   // 16-byte sync byte search; stride check stays scalar (SSE2 has no gather)
+        AVX2    // 32-byte sync byte search and 8-packet gathered stride check
+    };
+
+    // Best level supported by this CPU and OS (detected once)
+    SyncScanLevel GetSyncScanLevel();
+
+    const char* GetSyncScanLevelName(SyncScanLevel level);
+
+    // One stretch of consecutive packets with valid sync bytes
+    struct SyncRun {
+        size_t offset = 0;   // Byte offset of the first packet
+        size_t packets = 0;  // Number of whole 188-byte packets in the run
+    };
+
+    // Result of scanning a whole segment
+    struct SyncScanResult {
+        size_t packets = 0;        // Packets across all runs
+        size_t bytes_skipped = 0;  // Bytes outside any run (leading garbage, corruption, trailing partial packet)
+        size_t resyncs = 0;        // Times sync was lost and found again mid-segment
+    };
+
+    // Offset of the first TS_SYNC_BYTE at or after from, or size if there is none
+    size_t FindSyncByte(const uint8_t* data, size_t size, size_t from, SyncScanLevel level);
+
+    // Number of consecutive whole packets starting at offset whose first byte is TS_SYNC_BYTE
+    size_t CountSyncedPackets(const uint8_t* data, size_t size, size_t offset, SyncScanLevel level);
+
+    // First offset at or after from where a whole packet starts and the following confirm_packets
+    // packet positions (those inside the buffer) also carry sync bytes. A lone packet is only accepted
+    // when it ends exactly at the end of the buffer. Returns size if no such position exists.
+    size_t FindSyncPosition(const uint8_t* data, size_t size, size_t from, size_t confirm_packets, SyncScanLevel level);
+
+    // Split a segment into synced packet runs. runs is cleared first and reused, so steady-state scans
+    // do not allocate. After a bad sync byte the scan resumes at the next confirmed sync position.
+    SyncScanResult ScanSyncRuns(const uint8_t* data, size_t size, std::vector<SyncRun>& runs,
+                                SyncScanLevel level = GetSyncScanLevel());
+
+} // namespace tsduck_transport
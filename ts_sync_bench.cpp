@@ -0,0 +1,188 @@
+// Throughput and recovery benchmark for TS sync validation
+// Scans synthetic 8000-packet segments (clean, and with flipped sync bytes and inserted garbage)
+// with each scanner level this CPU supports, checks every level recovers exactly the packets that
+// were left intact, and compares against the previous scan that stopped at the first bad sync byte.
+// Warm runs rescan one cache-resident segment; the cold run streams a pool larger than the LLC.
+// GB/s is segment bytes validated per second (the legacy scan is fast on corrupt input only
+// because it gives up early).
+//
+// Build: g++ -std=c++17 -O2 ts_sync_bench.cpp ts_sync.cpp -o ts_sync_bench
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <string>
+#include "ts_sync.h"
+
+using namespace tsduck_transport;
+
+struct Segment {
+    std::vector<uint8_t> data;
+    size_t intact_packets = 0;
+    size_t corrupt_bytes = 0;   // Bytes a correct scanner must skip
+};
+
+// Random payload never contains 0x47 so the expected packet count is exact; the scanner's
+// three-packet confirmation is what handles stray 0x47s in real payloads.
+static uint8_t RandomByte(std::mt19937& rng) {
+    uint8_t value = static_cast<uint8_t>(rng());
+    return value == TS_SYNC_BYTE ? 0x46 : value;
+}
+
+static Segment MakeSegment(size_t packets, size_t corrupt_every, uint32_t seed) {
+    std::mt19937 rng(seed);
+    Segment segment;
+    segment.data.reserve(packets * TS_PACKET_SIZE + packets);
+    for (size_t i = 0; i < packets; ++i) {
+        bool corrupt = corrupt_every > 0 && i > 0 && i % corrupt_every == 0;
+        if (corrupt && (i / corrupt_every) % 2 == 0) {
+            // Garbage between packets knocks the stride out of alignment
+            size_t garbage = 1 + rng() % 300;
+            for (size_t g = 0; g < garbage; ++g) {
+                segment.data.push_back(RandomByte(rng));
+            }
+            segment.corrupt_bytes += garbage;
+            corrupt = false;
+        }
+        segment.data.push_back(corrupt ? 0x00 : TS_SYNC_BYTE); // Flipped sync byte loses the packet
+        for (size_t b = 1; b < TS_PACKET_SIZE; ++b) {
+            segment.data.push_back(RandomByte(rng));
+        }
+        if (corrupt) {
+            segment.corrupt_bytes += TS_PACKET_SIZE;
+        } else {
+            segment.intact_packets++;
+        }
+    }
+    return segment;
+}
+
+// The scan ConvertSegment used before: find the first sync pair, stop at the first bad sync byte
+static size_t LegacyScan(const std::vector<uint8_t>& data) {
+    size_t size = data.size();
+    size_t sync_offset = 0;
+    for (; sync_offset < size; ++sync_offset) {
+        if (data[sync_offset] == 0x47 && sync_offset + TS_PACKET_SIZE < size && data[sync_offset + TS_PACKET_SIZE] == 0x47) {
+            break;
+        }
+    }
+    size_t packets = 0;
+    for (size_t offset = sync_offset; offset + TS_PACKET_SIZE <= size; offset += TS_PACKET_SIZE) {
+        if (data[offset] != 0x47) {
+            break;
+        }
+        packets++;
+    }
+    return packets;
+}
+
+template <typename Scan>
+static double MeasureGBps(const Segment& segment, Scan scan) {
+    const int iterations = 2000;
+    volatile size_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        sink = sink + scan();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return static_cast<double>(segment.data.size()) * iterations / seconds / 1e9;
+}
+
+static bool RunCase(const std::string& label, const Segment& segment) {
+    std::cout << std::endl << label << ": " << segment.data.size() << " bytes, " << segment.intact_packets
+              << " intact packets, " << segment.corrupt_bytes << " corrupt bytes" << std::endl;
+
+    size_t legacy_packets = LegacyScan(segment.data);
+    double legacy_gbps = MeasureGBps(segment, [&]() { return LegacyScan(segment.data); });
+    std::cout << std::left << std::setw(26) << "  legacy (stop at error)" << std::right << std::fixed << std::setprecision(2)
+              << std::setw(8) << legacy_gbps << " GB/s" << std::setw(8) << legacy_packets << " packets kept, "
+              << (segment.intact_packets - legacy_packets) << " intact packets dropped" << std::endl;
+
+    bool ok = true;
+    std::vector<SyncRun> reference;
+    std::vector<SyncScanLevel> levels = { SyncScanLevel::SCALAR };
+    if (GetSyncScanLevel() >= SyncScanLevel::SSE2) {
+        levels.push_back(SyncScanLevel::SSE2);
+    }
+    if (GetSyncScanLevel() >= SyncScanLevel::AVX2) {
+        levels.push_back(SyncScanLevel::AVX2);
+    }
+
+    for (SyncScanLevel level : levels) {
+        std::vector<SyncRun> runs;
+        SyncScanResult result = ScanSyncRuns(segment.data.data(), segment.data.size(), runs, level);
+        double gbps = MeasureGBps(segment, [&]() {
+            return ScanSyncRuns(segment.data.data(), segment.data.size(), runs, level).packets;
+        });
+
+        bool correct = result.packets == segment.intact_packets && result.bytes_skipped == segment.corrupt_bytes;
+        if (level == SyncScanLevel::SCALAR) {
+            reference = runs;
+        } else if (runs.size() != reference.size()) {
+            correct = false;
+        } else {
+            for (size_t i = 0; i < runs.size(); ++i) {
+                correct = correct && runs[i].offset == reference[i].offset && runs[i].packets == reference[i].packets;
+            }
+        }
+        ok = ok && correct;
+
+        std::cout << std::left << std::setw(26) << (std::string("  resync scan, ") + GetSyncScanLevelName(level)) << std::right
+                  << std::setw(8) << gbps << " GB/s" << std::setw(8) << result.packets << " packets kept, "
+                  << result.bytes_skipped << " bytes skipped, " << result.resyncs << " resyncs"
+                  << (correct ? "" : "  [WRONG]") << std::endl;
+    }
+    return ok;
+}
+
+// Rotate through more segment data than the last-level cache holds, so every scan streams from memory
+static bool RunColdCase(size_t segment_count) {
+    std::vector<Segment> pool;
+    size_t total_bytes = 0;
+    size_t expected_packets = 0;
+    for (size_t i = 0; i < segment_count; ++i) {
+        pool.push_back(MakeSegment(8000, 500, static_cast<uint32_t>(100 + i)));
+        total_bytes += pool.back().data.size();
+        expected_packets += pool.back().intact_packets;
+    }
+    std::cout << std::endl << "Cold cache, corruption every 500 packets: " << segment_count << " segments, "
+              << (total_bytes >> 20) << " MB rotating" << std::endl;
+
+    bool ok = true;
+    std::vector<SyncRun> runs;
+    for (SyncScanLevel level : { SyncScanLevel::SCALAR, SyncScanLevel::SSE2, SyncScanLevel::AVX2 }) {
+        if (level > GetSyncScanLevel()) {
+            continue;
+        }
+        const int rounds = 10;
+        size_t packets = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; ++r) {
+            for (const Segment& segment : pool) {
+                packets += ScanSyncRuns(segment.data.data(), segment.data.size(), runs, level).packets;
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        bool correct = packets == expected_packets * rounds;
+        ok = ok && correct;
+        std::cout << std::left << std::setw(26) << (std::string("  resync scan, ") + GetSyncScanLevelName(level)) << std::right
+                  << std::setw(8) << (static_cast<double>(total_bytes) * rounds / seconds / 1e9) << " GB/s"
+                  << (correct ? "" : "  [WRONG]") << std::endl;
+    }
+    return ok;
+}
+
+int main() {
+    std::cout << "=== TS sync scan benchmark (best level on this CPU: " << GetSyncScanLevelName(GetSyncScanLevel()) << ") ===" << std::endl;
+
+    bool ok = true;
+    ok = RunCase("Clean segment", MakeSegment(8000, 0, 1)) && ok;
+    ok = RunCase("Corruption every 500 packets", MakeSegment(8000, 500, 2)) && ok;
+    ok = RunCase("Corruption every 50 packets", MakeSegment(8000, 50, 3)) && ok;
+    ok = RunColdCase(64) && ok;
+
+    std::cout << std::endl << (ok ? "All levels recovered every intact packet" : "MISMATCH: a scanner level lost or invented packets") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -7,6 +7,55 @@
 
 namespace tsduck_hls {
 
+namespace {
+
+    // NAME=value pairs of an attribute-list tag; quoted values are unquoted
+    std::map<std::string, std::string> ParseAttributeList(const std::string& line) {
+        std::map<std::string, std::string> attributes;
+        size_t pos = line.find(':');
+        if (pos == std::string::npos) return attributes;
+        pos++;
+        while (pos < line.size()) {
+            size_t equals = line.find('=', pos);
+            if (equals == std::string::npos) break;
+            std::string name = line.substr(pos, equals - pos);
+            std::string value;
+            pos = equals + 1;
+            if (pos < line.size() && line[pos] == '"') {
+                size_t quote = line.find('"', pos + 1);
+                if (quote == std::string::npos) quote = line.size();
+                value = line.substr(pos + 1, quote - pos - 1);
+                pos = quote + 1;
+            } else {
+                size_t comma = line.find(',', pos);
+                if (comma == std::string::npos) comma = line.size();
+                value = line.substr(pos, comma - pos);
+                pos = comma;
+            }
+            attributes[name] = value;
+            if (pos < line.size() && line[pos] == ',') pos++;
+        }
+        return attributes;
+    }
+
+    std::chrono::milliseconds SecondsAttribute(const std::map<std::string, std::string>& attributes, const char* name) {
+        auto it = attributes.find(name);
+        if (it == attributes.end()) return std::chrono::milliseconds(0);
+        try {
+            return std::chrono::milliseconds(static_cast<int64_t>(std::stod(it->second) * 1000));
+        }
+        catch (const std::exception&) {
+            return std::chrono::milliseconds(0);
+        }
+    }
+
+    bool YesAttribute(const std::map<std::string, std::string>& attributes, const char* name) {
+        auto it = attributes.find(name);
+        return it != attributes.end() && it->second == "YES";
+    }
+
+} // namespace
+
 PlaylistParser::PlaylistParser() {
     // Initialize with defaults
 }
@@ -14,6 +63,12 @@ PlaylistParser::PlaylistParser() {
 bool PlaylistParser::ParsePlaylist(const std::string& m3u8_content) {
     segments_.clear();
     has_discontinuities_ = false;
+    media_sequence_ = 0; // A playlist without the tag starts at 0; never carry over the previous one's
+    parts_.clear();
+    part_target_ = std::chrono::milliseconds(0);
+    server_control_ = ServerControl();
+    preload_hint_ = PreloadHint();
+    prefetch_segments_.clear();
     
     std::istringstream stream(m3u8_content);
     std::string line;
@@ -64,6 +119,23 @@ bool PlaylistParser::ParsePlaylist(const std::string& m3u8_content) {
             else if (line.find("#EXT-X-DATERANGE") == 0) {
                 ParseDateRangeLine(line, current_segment);
             }
+            else if (line.find("#EXT-X-PART-INF:") == 0) {
+                part_target_ = SecondsAttribute(ParseAttributeList(line), "PART-TARGET");
+            }
+            else if (line.find("#EXT-X-PART:") == 0) {
+                ParsePartLine(line, current_segment);
+            }
+            else if (line.find("#EXT-X-PRELOAD-HINT:") == 0) {
+                ParsePreloadHintLine(line);
+            }
+            else if (line.find("#EXT-X-SERVER-CONTROL:") == 0) {
+                ParseServerControlLine(line);
+            }
+            else if (line.find("#EXT-X-TWITCH-PREFETCH:") == 0) {
+                std::string url = line.substr(sizeof("#EXT-X-TWITCH-PREFETCH:") - 1);
+                MediaSegment prefetch(std::wstring(url.begin(), url.end()), target_duration_);
+                prefetch_segments_.push_back(prefetch);
+            }
         }
         else if (expecting_segment_url) {
             // This is a segment URL
@@ -81,7 +153,50 @@ bool PlaylistParser::ParsePlaylist(const std::string& m3u8_content) {
     // Post-processing: calculate precise timing
     CalculatePreciseTiming();
     
-    return !segments_.empty();
+    // Prefetch lines follow the last segment; they continue its numbering
+    for (size_t i = 0; i < prefetch_segments_.size(); ++i) {
+        prefetch_segments_[i].sequence_number = static_cast<double>(media_sequence_ + segments_.size() + i);
+    }
+    
+    // A low-latency playlist right after a restart may list nothing but parts
+    return !segments_.empty() || !parts_.empty();
+}
+
+void PlaylistParser::ParsePartLine(const std::string& line, const MediaSegment& current_segment) {
+    auto attributes = ParseAttributeList(line);
+    PartialSegment part;
+    const std::string& uri = attributes["URI"];
+    part.url = std::wstring(uri.begin(), uri.end());
+    part.duration = SecondsAttribute(attributes, "DURATION");
+    part.media_sequence = media_sequence_ + static_cast<int64_t>(segments_.size());
+    if (!parts_.empty() && parts_.back().media_sequence == part.media_sequence) {
+        part.part_index = parts_.back().part_index + 1;
+    }
+    part.independent = YesAttribute(attributes, "INDEPENDENT");
+    part.gap = YesAttribute(attributes, "GAP");
+    part.discontinuity = part.part_index == 0 && current_segment.has_discontinuity;
+    if (!part.url.empty()) {
+        parts_.push_back(part);
+    }
+}
+
+void PlaylistParser::ParsePreloadHintLine(const std::string& line) {
+    auto attributes = ParseAttributeList(line);
+    if (attributes["TYPE"] != "PART" || attributes["URI"].empty()) return;   // MAP hints are of no use here
+    const std::string& uri = attributes["URI"];
+    preload_hint_.url = std::wstring(uri.begin(), uri.end());
+    preload_hint_.media_sequence = media_sequence_ + static_cast<int64_t>(segments_.size());
+    preload_hint_.part_index = 0;
+    if (!parts_.empty() && parts_.back().media_sequence == preload_hint_.media_sequence) {
+        preload_hint_.part_index = parts_.back().part_index + 1;
+    }
+}
+
+void PlaylistParser::ParseServerControlLine(const std::string& line) {
+    auto attributes = ParseAttributeList(line);
+    server_control_.can_block_reload = YesAttribute(attributes, "CAN-BLOCK-RELOAD");
+    server_control_.part_hold_back = SecondsAttribute(attributes, "PART-HOLD-BACK");
+    server_control_.hold_back = SecondsAttribute(attributes, "HOLD-BACK");
 }
 
 void PlaylistParser::ParseInfoLine(const std::string& line, MediaSegment& current_segment) {
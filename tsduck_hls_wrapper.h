@@ -28,6 +28,31 @@ namespace tsduck_hls {
         MediaSegment(const std::wstring& segment_url, std::chrono::milliseconds dur = std::chrono::milliseconds(0))
             : url(segment_url), duration(dur), precise_duration(dur) {}
     };
+
+    // LL-HLS partial segment (#EXT-X-PART), listed ahead of its parent segment
+    struct PartialSegment {
+        std::wstring url;
+        std::chrono::milliseconds duration{0};
+        int64_t media_sequence = 0;     // Parent segment; one past the last full segment while it is still being produced
+        int part_index = 0;             // Position within the parent segment
+        bool independent = false;       // Starts with a key frame
+        bool gap = false;               // Not available; must not be requested
+        bool discontinuity = false;     // First part of a segment after #EXT-X-DISCONTINUITY
+    };
+
+    // #EXT-X-SERVER-CONTROL
+    struct ServerControl {
+        bool can_block_reload = false;              // _HLS_msn/_HLS_part reloads are held until the part exists
+        std::chrono::milliseconds part_hold_back{0};    // Minimum distance from the live edge when playing parts
+        std::chrono::milliseconds hold_back{0};
+    };
+
+    // #EXT-X-PRELOAD-HINT of TYPE=PART: the part after the last one listed, requestable before it exists
+    struct PreloadHint {
+        std::wstring url;
+        int64_t media_sequence = -1;    // -1 when the playlist has no hint
+        int part_index = 0;
+    };
     
     // Enhanced playlist with TSDuck-inspired parsing
     class PlaylistParser {
@@ -48,6 +73,7 @@ namespace tsduck_hls {
         
         // Get media sequence number
         int64_t GetMediaSequence() const { return media_sequence_; }
+        size_t GetSegmentCount() const { return segments_.size(); }
         
         // Enhanced ad detection using TSDuck-style SCTE-35 analysis
 
@@ -60,6 +86,17 @@ namespace tsduck_hls {
         
         // Check for discontinuities that require buffer flushing
         bool HasDiscontinuities() const { return has_discontinuities_; }
+
+        // LL-HLS: parts in playlist order, the part target and the server's blocking reload support
+        const std::vector<PartialSegment>& GetParts() const { return parts_; }
+        std::chrono::milliseconds GetPartTarget() const { return part_target_; }
+        const ServerControl& GetServerControl() const { return server_control_; }
+        const PreloadHint& GetPreloadHint() const { return preload_hint_; }
+        bool IsLowLatency() const { return part_target_.count() > 0 && !parts_.empty(); }
+
+        // Twitch low latency: upcoming segments advertised with #EXT-X-TWITCH-PREFETCH, numbered after the
+        // listed ones. The edge streams them while they are produced; later playlists list them as regular segments.
+        const std::vector<MediaSegment>& GetPrefetchSegments() const { return prefetch_segments_; }
         
     private:
         std::vector<MediaSegment> segments_;
@@ -68,12 +105,21 @@ namespace tsduck_hls {
         int64_t media_sequence_ = 0;
 
         bool has_discontinuities_ = false;
+
+        std::vector<PartialSegment> parts_;
+        std::chrono::milliseconds part_target_{0};
+        ServerControl server_control_;
+        PreloadHint preload_hint_;
+        std::vector<MediaSegment> prefetch_segments_;
         
         // TSDuck-inspired parsing methods
         void ParseSegmentLine(const std::string& line, MediaSegment& current_segment);
         void ParseInfoLine(const std::string& line, MediaSegment& current_segment);
         void ParseDateRangeLine(const std::string& line, MediaSegment& current_segment);
         void ParseScte35Line(const std::string& line, MediaSegment& current_segment);
+        void ParsePartLine(const std::string& line, const MediaSegment& current_segment);
+        void ParsePreloadHintLine(const std::string& line);
+        void ParseServerControlLine(const std::string& line);
         
         // Enhanced timing calculations
         void CalculatePreciseTiming();
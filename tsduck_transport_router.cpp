@@ -2,141 +2,40 @@
 #include "twitch_api.h"
 #include "playlist_parser.h"
 #include "tsduck_hls_wrapper.h"
+#include "segment_tracker.h"
+#include "low_latency_hls.h"
+#include "poll_scheduler.h"
+#include "http_client.h"
+#include "range_fetcher.h"
+#include "deadline_fetcher.h"
 #include "stream_resource_manager.h"
 #define NOMINMAX
 #include <windows.h>
-#include <winhttp.h>
 #include <iostream>
 #include <sstream>
 #include <regex>
 #include <algorithm>
 #include <cstring>
+#include <deque>
 
 // Forward declarations
-extern bool HttpGetText(const std::wstring& url, std::string& out, std::atomic<bool>* cancel_token = nullptr);
+extern bool HttpGetText(const std::wstring& url, std::string& out, std::atomic<bool>* cancel_token = nullptr,
+                        tardsplaya::HttpResponse* response = nullptr);
 std::wstring Utf8ToWide(const std::string& str);
 void AddDebugLog(const std::wstring& msg);
 
-// HttpGetBinary implementation for transport stream router with retry logic
+// HttpGetBinary for the transport stream router: retries on the shared keep-alive connection pool
 bool HttpGetBinary(const std::wstring& url, std::vector<uint8_t>& out, std::atomic<bool>* cancel_token = nullptr) {
-    const int max_attempts = 3;
-    
-    for (int attempt = 0; attempt < max_attempts; ++attempt) {
-        if (cancel_token && cancel_token->load()) return false;
-        
-        URL_COMPONENTS uc = { sizeof(uc) };
-        wchar_t host[256] = L"", path[2048] = L"";
-        uc.lpszHostName = host; uc.dwHostNameLength = 255;
-        uc.lpszUrlPath = path; uc.dwUrlPathLength = 2047;
-        if (!WinHttpCrackUrl(url.c_str(), 0, 0, &uc)) {
-            if (attempt < max_attempts - 1) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(600));
-                continue;
-            }
-            return false;
-        }
-
-        HINTERNET hSession = WinHttpOpen(L"Tardsplaya/1.0", WINHTTP_ACCESS_TYPE_DEFAULT_PROXY, 0, 0, 0);
-        if (!hSession) {
-            if (attempt < max_attempts - 1) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(600));
-                continue;
-            }
-            return false;
-        }
-        
-        HINTERNET hConnect = WinHttpConnect(hSession, host, uc.nPort, 0);
-        if (!hConnect) { 
-            WinHttpCloseHandle(hSession);
-            if (attempt < max_attempts - 1) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(600));
-                continue;
-            }
-            return false; 
-        }
-        
-        HINTERNET hRequest = WinHttpOpenRequest(
-            hConnect, L"GET", path, NULL, WINHTTP_NO_REFERER, WINHTTP_DEFAULT_ACCEPT_TYPES,
-            (uc.nScheme == INTERNET_SCHEME_HTTPS) ? WINHTTP_FLAG_SECURE : 0);
-        
-        if (!hRequest) {
-            WinHttpCloseHandle(hConnect);
-            WinHttpCloseHandle(hSession);
-            if (attempt < max_attempts - 1) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(600));
-                continue;
-            }
-            return false;
-        }
-        
-        // For HTTPS, ignore certificate errors for compatibility
-        if (uc.nScheme == INTERNET_SCHEME_HTTPS) {
-            DWORD dwSecurityFlags = SECURITY_FLAG_IGNORE_CERT_CN_INVALID |
-                                   SECURITY_FLAG_IGNORE_CERT_DATE_INVALID |
-                                   SECURITY_FLAG_IGNORE_UNKNOWN_CA |
-                                   SECURITY_FLAG_IGNORE_CERT_WRONG_USAGE;
-            WinHttpSetOption(hRequest, WINHTTP_OPTION_SECURITY_FLAGS, &dwSecurityFlags, sizeof(dwSecurityFlags));
-        }
-        
-        BOOL res = WinHttpSendRequest(hRequest, 0, 0, 0, 0, 0, 0) && WinHttpReceiveResponse(hRequest, 0);
-        if (!res) { 
-            WinHttpCloseHandle(hRequest); 
-            WinHttpCloseHandle(hConnect); 
-            WinHttpCloseHandle(hSession);
-            if (attempt < max_attempts - 1) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(600));
-                continue;
-            }
-            return false; 
-        }
-
-        DWORD dwSize = 0;
-        out.clear();
-        bool error = false;
-        do {
-            if (cancel_token && cancel_token->load()) { 
-                error = true; 
-                break; 
-            }
-            
-            DWORD dwDownloaded = 0;
-            WinHttpQueryDataAvailable(hRequest, &dwSize);
-            if (!dwSize) break;
-            
-            size_t prev_size = out.size();
-            out.resize(prev_size + dwSize);
-            
-            if (!WinHttpReadData(hRequest, out.data() + prev_size, dwSize, &dwDownloaded) || dwDownloaded == 0) {
-                error = true;
-                break;
-            }
-            
-            if (dwDownloaded < dwSize) {
-                out.resize(prev_size + dwDownloaded);
-            }
-        } while (dwSize > 0);
-
-        WinHttpCloseHandle(hRequest); 
-        WinHttpCloseHandle(hConnect); 
-        WinHttpCloseHandle(hSession);
-        
-        if (!error && !out.empty()) return true;
-        
-        if (attempt < max_attempts - 1) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(600));
-        }
-    }
-    
-    return false;
+    return tardsplaya::HttpClient::Shared().Get(url, out, cancel_token) && !out.empty();
 }
 
 // Minimal HTTP implementation for standalone DLL
 #ifdef BUILD_DLL
-bool HttpGetText(const std::wstring& url, std::string& out, std::atomic<bool>* cancel_token) {
-    // Simplified HTTP implementation for DLL version
-    // In production, this would use WinHTTP or similar
-    out = ""; // Placeholder - would fetch actual content
-    return false; // Return false for now to indicate this is a stub
+bool HttpGetText(const std::wstring& url, std::string& out, std::atomic<bool>* cancel_token, tardsplaya::HttpResponse* response) {
+    std::vector<uint8_t> data;
+    if (!tardsplaya::HttpClient::Shared().Get(url, data, cancel_token, response, 0, &tardsplaya::CompressedTextHeaders())) return false;
+    out.assign(data.begin(), data.end());
+    return true;
 }
 
 std::wstring Utf8ToWide(const std::string& str) {
@@ -163,484 +62,48 @@ static std::wstring JoinUrl(const std::wstring& base, const std::wstring& rel) {
     return base.substr(0, pos + 1) + rel;
 }
 
-
-
-// TSPacket implementation
-void TSPacket::ParseHeader() {
-    if (!IsValid()) return;
-    
-    // Extract PID (13 bits from bytes 1-2)
-    pid = ((data[1] & 0x1F) << 8) | data[2];
-    
-    // Extract payload unit start indicator
-    payload_unit_start = (data[1] & 0x40) != 0;
-    
-    // Extract discontinuity indicator from adaptation field if present
-    bool has_adaptation = (data[3] & 0x20) != 0;
-    if (has_adaptation && data[4] > 0) {
-        discontinuity = (data[5] & 0x80) != 0;
+// Helper: video variants up to the requested one by bandwidth, ascending with the requested one last.
+// Empty when it is not among them (audio only, no BANDWIDTH, or not from these variants).
+static std::vector<PlaylistQuality> AbrCandidates(const std::vector<PlaylistQuality>& variants, const std::wstring& requested_url) {
+    std::vector<PlaylistQuality> candidates;
+    auto requested = std::find_if(variants.begin(), variants.end(), [&](const PlaylistQuality& variant) { return variant.url == requested_url; });
+    if (requested == variants.end() || requested->bandwidth == 0 || requested->resolution.empty()) {
+        return candidates;
     }
-}
-
-// Frame Number Tagging implementations
-void TSPacket::SetFrameInfo(uint64_t global_frame, uint32_t segment_frame, bool key_frame, std::chrono::milliseconds duration) {
-    frame_number = global_frame;
-    segment_frame_number = segment_frame;
-    is_key_frame = key_frame;
-    frame_duration = duration;
-}
-
-void TSPacket::SetVideoInfo(uint64_t video_frame, bool is_video, bool is_audio) {
-    video_frame_number = video_frame;
-    is_video_packet = is_video;
-    is_audio_packet = is_audio;
-    video_sync_lost = false; // Reset sync status when setting video info
-}
-
-std::wstring TSPacket::GetFrameDebugInfo() const {
-    std::wstring info = L"Frame#" + std::to_wstring(frame_number) + 
-                       L" Seg#" + std::to_wstring(segment_frame_number) +
-                       L" PID:" + std::to_wstring(pid);
-    
-    if (is_video_packet) info += L" [VIDEO]";
-    if (is_audio_packet) info += L" [AUDIO]";
-    if (is_key_frame) info += L" [KEY]";
-    if (payload_unit_start) info += L" [START]";
-    if (discontinuity) info += L" [DISC]";
-    if (video_sync_lost) info += L" [SYNC_LOST]";
-    
-    if (frame_duration.count() > 0) {
-        info += L" (" + std::to_wstring(frame_duration.count()) + L"ms)";
-    }
-    
-    return info;
-}
-
-bool TSPacket::IsFrameDropDetected(const TSPacket& previous_packet) const {
-    // Detect frame drops by checking sequence continuity
-    if (frame_number <= previous_packet.frame_number) {
-        return false; // Not a drop, possibly duplicate or reordered
-    }
-    
-    // Check if we skipped frame numbers (indicating dropped frames)
-    uint64_t expected_frame = previous_packet.frame_number + 1;
-    return frame_number > expected_frame;
-}
-
-bool TSPacket::IsVideoSyncValid() const {
-    return is_video_packet && !video_sync_lost;
-}
-
-// TSBuffer implementation
-TSBuffer::TSBuffer(size_t max_packets) : max_packets_(max_packets), producer_active_(true) {
-}
-
-bool TSBuffer::AddPacket(const TSPacket& packet) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
-    // In low-latency mode, more aggressively drop old packets
-    if (low_latency_mode_ && packet_queue_.size() >= max_packets_ / 2) {
-        // Drop multiple old packets to make room for new ones
-        size_t packets_to_drop = std::min(packet_queue_.size() / 4, size_t(10));
-        for (size_t i = 0; i < packets_to_drop && !packet_queue_.empty(); ++i) {
-            packet_queue_.pop();
+    for (const PlaylistQuality& variant : variants) {
+        if (variant.bandwidth > 0 && variant.bandwidth < requested->bandwidth && !variant.resolution.empty()) {
+            candidates.push_back(variant);
         }
-    } else if (packet_queue_.size() >= max_packets_) {
-        // Standard mode - remove oldest packet to make room
-        packet_queue_.pop();
     }
-    
-    packet_queue_.push(packet);
-    return true;
+    std::sort(candidates.begin(), candidates.end(), [](const PlaylistQuality& a, const PlaylistQuality& b) { return a.bandwidth < b.bandwidth; });
+    candidates.push_back(*requested);
+    return candidates;
 }
 
-bool TSBuffer::GetNextPacket(TSPacket& packet, std::chrono::milliseconds timeout) {
-    auto start_time = std::chrono::steady_clock::now();
-    
-    while (std::chrono::steady_clock::now() - start_time < timeout) {
-        {
-            std::lock_guard<std::mutex> lock(mutex_);
-            if (!packet_queue_.empty()) {
-                packet = packet_queue_.front();
-                packet_queue_.pop();
-                return true;
-            }
-        }
-        
-        if (!producer_active_) {
+// PacketSink over the player's stdin pipe - one WriteFile per coalesced batch
+class PipePacketSink : public PacketSink {
+public:
+    explicit PipePacketSink(HANDLE pipe) : pipe_(pipe) {}
+    
+    bool Write(const uint8_t* data, size_t size, size_t& bytes_written) override {
+        bytes_written = 0;
+        if (pipe_ == INVALID_HANDLE_VALUE) {
             return false;
         }
         
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
-    }
-    
-    return false;
-}
-
-size_t TSBuffer::GetBufferedPackets() const {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return packet_queue_.size();
-}
-
-bool TSBuffer::IsEmpty() const {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return packet_queue_.empty();
-}
-
-bool TSBuffer::IsFull() const {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return packet_queue_.size() >= max_packets_;
-}
-
-void TSBuffer::Clear() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    while (!packet_queue_.empty()) {
-        packet_queue_.pop();
-    }
-}
-
-void TSBuffer::Reset() {
-    Clear();
-    producer_active_ = true;
-}
-
-void TSBuffer::SignalEndOfStream() {
-    producer_active_ = false;
-}
-
-// HLSToTSConverter implementation
-HLSToTSConverter::HLSToTSConverter() {
-    Reset();
-}
-
-void HLSToTSConverter::Reset() {
-    continuity_counter_ = 0;
-    pat_sent_ = false;
-    pmt_sent_ = false;
-    
-    // Frame Number Tagging: Reset frame counters
-    global_frame_counter_ = 0;
-    segment_frame_counter_ = 0;
-    last_frame_time_ = std::chrono::steady_clock::now();
-    estimated_frame_duration_ = std::chrono::milliseconds(33); // Reset to default ~30fps
-    
-    // Reset stream type detection
-    detected_video_pid_ = 0;
-    detected_audio_pid_ = 0;
-}
-
-std::vector<TSPacket> HLSToTSConverter::ConvertSegment(const std::vector<uint8_t>& hls_data, bool is_first_segment) {
-    std::vector<TSPacket> ts_packets;
-    
-    if (hls_data.empty()) {
-        return ts_packets;
-    }
-    
-    // HLS segments are already MPEG-TS formatted data
-    // Extract and validate existing TS packets with better synchronization
-    size_t data_size = hls_data.size();
-    const uint8_t* data_ptr = hls_data.data();
-    
-    // Find first sync byte to ensure proper alignment
-    size_t sync_offset = 0;
-    for (; sync_offset < data_size; ++sync_offset) {
-        if (data_ptr[sync_offset] == 0x47) {
-            // Check if this looks like a valid TS packet start
-            if (sync_offset + TS_PACKET_SIZE <= data_size) {
-                // Look ahead to see if next packet is also aligned
-                if (sync_offset + TS_PACKET_SIZE < data_size && 
-                    data_ptr[sync_offset + TS_PACKET_SIZE] == 0x47) {
-                    break; // Found valid sync
-                }
-            }
-        }
-    }
-    
-    if (sync_offset >= data_size) {
-        return ts_packets; // No valid sync found
-    }
-    
-    // Frame Number Tagging: Reset segment frame counter for new segment
-    if (is_first_segment) {
-        segment_frame_counter_ = 0;
-        last_frame_time_ = std::chrono::steady_clock::now();
-    }
-    
-    // Process data in 188-byte TS packet chunks starting from sync position
-    for (size_t offset = sync_offset; offset + TS_PACKET_SIZE <= data_size; offset += TS_PACKET_SIZE) {
-        TSPacket packet;
-        
-        // Copy packet data
-        memcpy(packet.data, data_ptr + offset, TS_PACKET_SIZE);
-        packet.timestamp = std::chrono::steady_clock::now();
-        
-        // Validate sync byte
-        if (packet.data[0] != 0x47) {
-            // Sync lost, try to resynchronize
-            break;
-        }
-        
-        // Parse packet header
-        packet.ParseHeader();
-        
-        // Detect and classify stream types (video/audio)
-        DetectStreamTypes(packet);
-        
-        // Frame Number Tagging: Assign frame numbers for video packets
-        if (packet.is_video_packet || packet.payload_unit_start) {
-            // Increment frame counters for video packets or new payload units
-            global_frame_counter_++;
-            segment_frame_counter_++;
-            
-            // Estimate frame duration based on timing
-            auto now = std::chrono::steady_clock::now();
-            auto time_since_last = std::chrono::duration_cast<std::chrono::milliseconds>(now - last_frame_time_);
-            if (time_since_last.count() > 0 && segment_frame_counter_ > 1) {
-                estimated_frame_duration_ = time_since_last;
-            }
-            last_frame_time_ = now;
-            
-            // Check for key frame indicators in the payload
-            bool is_key_frame = false;
-            if (packet.payload_unit_start && packet.is_video_packet && packet.data[4] == 0x00) {
-                // Look for MPEG start codes that might indicate I-frames
-                if (offset + TS_PACKET_SIZE + 8 < data_size) {
-                    const uint8_t* payload = data_ptr + offset + 4;
-                    // Enhanced I-frame detection
-                    for (int i = 0; i < 32 && i < TS_PACKET_SIZE - 8; i++) {
-                        if (payload[i] == 0x00 && payload[i+1] == 0x00 && payload[i+2] == 0x01) {
-                            uint8_t frame_type = payload[i+3];
-                            // MPEG-2 I-frame detection (enhanced)
-                            if ((frame_type & 0x38) == 0x08 || frame_type == 0x00) {
-                                is_key_frame = true;
-                                break;
-                            }
-                            // H.264 IDR frame detection
-                            if ((frame_type & 0x1F) == 0x05) {
-                                is_key_frame = true;
-                                break;
-                            }
-                        }
-                    }
-                }
-            }
-            
-            // Set frame information
-            packet.SetFrameInfo(global_frame_counter_, segment_frame_counter_, is_key_frame, estimated_frame_duration_);
-            
-            // Set video-specific information for video packets
-            if (packet.is_video_packet) {
-                packet.SetVideoInfo(global_frame_counter_, true, false);
-            } else if (packet.is_audio_packet) {
-                packet.SetVideoInfo(0, false, true);
-            }
-        }
-        
-        // Don't modify continuity counters - preserve original TS packet timing and sequencing
-        // The original HLS TS segments should have correct continuity counters
-        
-        ts_packets.push_back(packet);
-    }
-    
-    return ts_packets;
-}
-
-TSPacket HLSToTSConverter::GeneratePAT() {
-    TSPacket packet;
-    
-    // TS Header for PAT (PID 0x0000)
-    packet.data[0] = 0x47; // Sync byte
-    packet.data[1] = 0x40; // Payload unit start, PID high bits
-    packet.data[2] = 0x00; // PID low bits (0x0000)
-    packet.data[3] = 0x10 | (continuity_counter_ & 0x0F); // No adaptation, payload present, continuity
-    
-    // PSI header
-    packet.data[4] = 0x00; // Pointer field
-    packet.data[5] = 0x00; // Table ID (PAT)
-    packet.data[6] = 0xB0; // Section syntax indicator, section length high
-    packet.data[7] = 0x0D; // Section length low (13 bytes)
-    packet.data[8] = 0x00; packet.data[9] = 0x01; // Transport stream ID
-    packet.data[10] = 0xC1; // Version number, current/next indicator
-    packet.data[11] = 0x00; // Section number
-    packet.data[12] = 0x00; // Last section number
-    
-    // Program info (one program)
-    packet.data[13] = (program_id_ >> 8) & 0xFF; // Program number high
-    packet.data[14] = program_id_ & 0xFF; // Program number low
-    packet.data[15] = 0xE0 | ((pmt_pid_ >> 8) & 0x1F); // PMT PID high
-    packet.data[16] = pmt_pid_ & 0xFF; // PMT PID low
-    
-    // CRC32 (simplified - would need proper calculation in production)
-    uint32_t crc = CalculateCRC32(&packet.data[5], 12);
-    packet.data[17] = (crc >> 24) & 0xFF;
-    packet.data[18] = (crc >> 16) & 0xFF;
-    packet.data[19] = (crc >> 8) & 0xFF;
-    packet.data[20] = crc & 0xFF;
-    
-    // Fill rest with padding
-    for (size_t i = 21; i < TS_PACKET_SIZE; ++i) {
-        packet.data[i] = 0xFF;
+        DWORD written = 0;
+        BOOL result = WriteFile(pipe_, data, static_cast<DWORD>(size), &written, nullptr);
+        bytes_written = written;
+        last_error_ = result ? 0 : GetLastError();
+        return result != FALSE;
     }
     
-    packet.pid = 0x0000;
-    packet.payload_unit_start = true;
-    continuity_counter_ = (continuity_counter_ + 1) & 0x0F;
+    DWORD GetLastErrorCode() const { return last_error_; }
     
-    return packet;
-}
-
-TSPacket HLSToTSConverter::GeneratePMT() {
-    TSPacket packet;
-    
-    // TS Header for PMT
-    packet.data[0] = 0x47; // Sync byte
-    packet.data[1] = 0x40 | ((pmt_pid_ >> 8) & 0x1F); // Payload unit start, PID high bits
-    packet.data[2] = pmt_pid_ & 0xFF; // PID low bits
-    packet.data[3] = 0x10 | (continuity_counter_ & 0x0F); // No adaptation, payload present, continuity
-    
-    // PSI header
-    packet.data[4] = 0x00; // Pointer field
-    packet.data[5] = 0x02; // Table ID (PMT)
-    packet.data[6] = 0xB0; // Section syntax indicator, section length high
-    packet.data[7] = 0x17; // Section length low (23 bytes)
-    packet.data[8] = (program_id_ >> 8) & 0xFF; // Program number high
-    packet.data[9] = program_id_ & 0xFF; // Program number low
-    packet.data[10] = 0xC1; // Version number, current/next indicator
-    packet.data[11] = 0x00; // Section number
-    packet.data[12] = 0x00; // Last section number
-    packet.data[13] = 0xE0 | ((video_pid_ >> 8) & 0x1F); // PCR PID high (use video PID)
-    packet.data[14] = video_pid_ & 0xFF; // PCR PID low
-    packet.data[15] = 0xF0; packet.data[16] = 0x00; // Program info length
-    
-    // Elementary stream info (video)
-    packet.data[17] = 0x1B; // Stream type (H.264 video)
-    packet.data[18] = 0xE0 | ((video_pid_ >> 8) & 0x1F); // Elementary PID high
-    packet.data[19] = video_pid_ & 0xFF; // Elementary PID low
-    packet.data[20] = 0xF0; packet.data[21] = 0x00; // ES info length
-    
-    // Elementary stream info (audio)
-    packet.data[22] = 0x0F; // Stream type (AAC audio)
-    packet.data[23] = 0xE0 | ((audio_pid_ >> 8) & 0x1F); // Elementary PID high
-    packet.data[24] = audio_pid_ & 0xFF; // Elementary PID low
-    packet.data[25] = 0xF0; packet.data[26] = 0x00; // ES info length
-    
-    // CRC32
-    uint32_t crc = CalculateCRC32(&packet.data[5], 22);
-    packet.data[27] = (crc >> 24) & 0xFF;
-    packet.data[28] = (crc >> 16) & 0xFF;
-    packet.data[29] = (crc >> 8) & 0xFF;
-    packet.data[30] = crc & 0xFF;
-    
-    // Fill rest with padding
-    for (size_t i = 31; i < TS_PACKET_SIZE; ++i) {
-        packet.data[i] = 0xFF;
-    }
-    
-    packet.pid = pmt_pid_;
-    packet.payload_unit_start = true;
-    continuity_counter_ = (continuity_counter_ + 1) & 0x0F;
-    
-    return packet;
-}
-
-std::vector<TSPacket> HLSToTSConverter::WrapDataInTS(const uint8_t* data, size_t size, uint16_t pid, bool payload_start) {
-    std::vector<TSPacket> packets;
-    
-    size_t remaining = size;
-    const uint8_t* current_data = data;
-    bool first_packet = payload_start;
-    
-    while (remaining > 0) {
-        TSPacket packet;
-        packet.pid = pid;
-        packet.payload_unit_start = first_packet;
-        
-        // TS Header
-        packet.data[0] = 0x47; // Sync byte
-        packet.data[1] = (first_packet ? 0x40 : 0x00) | ((pid >> 8) & 0x1F); // Payload unit start + PID high
-        packet.data[2] = pid & 0xFF; // PID low
-        packet.data[3] = 0x10 | (continuity_counter_ & 0x0F); // No adaptation, payload present, continuity
-        
-        // Calculate payload size
-        size_t payload_offset = 4;
-        size_t max_payload = TS_PACKET_SIZE - payload_offset;
-        size_t payload_size = std::min(remaining, max_payload);
-        
-        // Copy payload data
-        memcpy(&packet.data[payload_offset], current_data, payload_size);
-        
-        // Fill remaining bytes with padding if needed
-        for (size_t i = payload_offset + payload_size; i < TS_PACKET_SIZE; ++i) {
-            packet.data[i] = 0xFF;
-        }
-        
-        packets.push_back(packet);
-        
-        remaining -= payload_size;
-        current_data += payload_size;
-        first_packet = false;
-        continuity_counter_ = (continuity_counter_ + 1) & 0x0F;
-    }
-    
-    return packets;
-}
-
-uint32_t HLSToTSConverter::CalculateCRC32(const uint8_t* data, size_t length) {
-    // Simplified CRC32 calculation - in production would use proper CRC32-MPEG
-    uint32_t crc = 0xFFFFFFFF;
-    for (size_t i = 0; i < length; ++i) {
-        crc ^= data[i] << 24;
-        for (int j = 0; j < 8; ++j) {
-            if (crc & 0x80000000) {
-                crc = (crc << 1) ^ 0x04C11DB7;
-            } else {
-                crc <<= 1;
-            }
-        }
-    }
-    return crc;
-}
-
-void HLSToTSConverter::DetectStreamTypes(TSPacket& packet) {
-    // Detect video and audio PIDs by analyzing packet content
-    if (packet.payload_unit_start && packet.pid > 0x20) {
-        // Look for video/audio stream indicators
-        const uint8_t* payload = packet.data + 4;
-        size_t payload_size = TS_PACKET_SIZE - 4;
-        
-        // Check adaptation field
-        if ((packet.data[3] & 0x20) != 0 && payload_size > 0) {
-            uint8_t adaptation_length = payload[0];
-            if (adaptation_length < payload_size) {
-                payload += adaptation_length + 1;
-                payload_size -= adaptation_length + 1;
-            }
-        }
-        
-        // Look for PES header patterns
-        if (payload_size >= 6 && payload[0] == 0x00 && payload[1] == 0x00 && payload[2] == 0x01) {
-            uint8_t stream_id = payload[3];
-            
-            // Video stream IDs (typically 0xE0-0xEF for MPEG video)
-            if ((stream_id >= 0xE0 && stream_id <= 0xEF) || stream_id == 0xBD) {
-                packet.is_video_packet = true;
-                detected_video_pid_ = packet.pid;
-            }
-            // Audio stream IDs (typically 0xC0-0xDF for audio)
-            else if ((stream_id >= 0xC0 && stream_id <= 0xDF) || stream_id == 0xBD) {
-                packet.is_audio_packet = true;
-                detected_audio_pid_ = packet.pid;
-            }
-        }
-    } else {
-        // Use previously detected PIDs
-        if (packet.pid == detected_video_pid_) {
-            packet.is_video_packet = true;
-        } else if (packet.pid == detected_audio_pid_) {
-            packet.is_audio_packet = true;
-        }
-    }
-}
+private:
+    HANDLE pipe_;
+    DWORD last_error_ = 0;
+};
 
 // TransportStreamRouter implementation
 TransportStreamRouter::TransportStreamRouter() {
@@ -700,13 +163,42 @@ bool TransportStreamRouter::StartRouting(const std::wstring& hls_playlist_url,
     // Reset converter and buffer
     hls_converter_->Reset();
     ts_buffer_->Reset(); // This will clear packets and reset producer_active
-    ts_buffer_->SetLowLatencyMode(config.low_latency_mode); // Configure buffer for latency mode
+    // Configure buffer for latency mode; latency is bounded by skipping whole GOPs to a key frame
+    ts_buffer_->SetLowLatencyMode(config.low_latency_mode);
+    ts_buffer_->SetLatencyTarget(config.latency_target);
+    ts_buffer_->SetMetadataEnabled(config.enable_frame_stats); // Per-packet metadata only when stats are wanted
+    ts_buffer_->SetZeroCopyMode(config.zero_copy_segments); // Queue segment pointers instead of payload copies
+    pid_stats_.Reset();
+    segments_missed_ = 0;
+    segment_gaps_ = 0;
+    playlist_polls_ = 0;
+    playlist_polls_unchanged_ = 0;
+    poll_prediction_error_ms_ = 0.0;
+    abr_bandwidth_ = 0;
+    abr_switches_down_ = 0;
+    abr_switches_up_ = 0;
+    throughput_estimate_bps_ = 0.0;
+    segments_late_ = 0;
+    segment_hedges_ = 0;
+    segment_hedges_won_ = 0;
+    first_byte_p50_ms_ = 0.0;
+    first_byte_p99_ms_ = 0.0;
+    download_p99_ms_ = 0.0;
+    playlist_bytes_received_ = 0;
+    playlist_bytes_decoded_ = 0;
+    segment_pool_.SetMaxBuffers(config.segment_pool_buffers);
     
     if (log_callback_) {
         log_callback_(L"[TS_ROUTER] Starting TSDuck-inspired transport stream routing");
         log_callback_(L"[TS_ROUTER] Player: " + config.player_path);
         log_callback_(L"[TS_ROUTER] Buffer size: " + std::to_wstring(config.buffer_size_packets) + L" packets");
         
+        // At 6 Mbps a second of stream is ~3990 packets
+        size_t bytes_per_second = ts_buffer_->GetBytesPerPacket() * (6000000 / 8 / TS_PACKET_SIZE);
+        log_callback_(L"[TS_ROUTER] Buffer memory: " + std::to_wstring(ts_buffer_->GetMemoryBytes() / 1024) + L"KB (" + 
+                     std::to_wstring(ts_buffer_->GetBytesPerPacket()) + L" bytes/packet, ~" + 
+                     std::to_wstring(bytes_per_second / 1024) + L"KB per buffered second at 6 Mbps)");
+        
         if (config.low_latency_mode) {
             log_callback_(L"[LOW_LATENCY] Mode enabled - targeting minimal stream delay");
             log_callback_(L"[LOW_LATENCY] Max segments: " + std::to_wstring(config.max_segments_to_buffer) + 
@@ -776,17 +268,65 @@ TransportStreamRouter::BufferStats TransportStreamRouter::GetBufferStats() const
     stats.video_stream_healthy = IsVideoStreamHealthy();
     stats.audio_stream_healthy = IsAudioStreamHealthy();
     
-    // Calculate current FPS
+    stats.key_frames_processed = key_frames_processed_.load();
+    stats.keyframe_interval = std::chrono::milliseconds(keyframe_interval_ms_.load());
+    
+    stats.output_lag_ms = output_lag_ms_.load();
+    stats.output_jitter_ms = output_jitter_ms_.load();
+    stats.output_backlog_ms = output_backlog_ms_.load();
+    stats.output_catching_up = output_catching_up_.load();
+    
+    TSBuffer::LatencyStats latency = ts_buffer_->GetLatencyStats();
+    stats.latency_skips = latency.skips;
+    stats.latency_bytes_skipped = latency.bytes_skipped;
+    stats.latency_frames_skipped = latency.frames_skipped;
+    stats.buffered_latency = std::chrono::milliseconds(latency.buffered_ms);
+    stats.last_skip_from = std::chrono::milliseconds(latency.last_skip_from_ms);
+    stats.last_skip_to = std::chrono::milliseconds(latency.last_skip_to_ms);
+    stats.unaligned_drops = latency.unaligned_drops;
+    
+    stats.segments_missed = segments_missed_.load();
+    stats.segment_gaps = segment_gaps_.load();
+    stats.playlist_polls = playlist_polls_.load();
+    stats.playlist_polls_unchanged = playlist_polls_unchanged_.load();
+    stats.poll_prediction_error_ms = poll_prediction_error_ms_.load();
+    stats.abr_bandwidth = abr_bandwidth_.load();
+    stats.abr_switches_down = abr_switches_down_.load();
+    stats.abr_switches_up = abr_switches_up_.load();
+    stats.throughput_estimate_bps = throughput_estimate_bps_.load();
+    stats.segments_late = segments_late_.load();
+    stats.segment_hedges = segment_hedges_.load();
+    stats.segment_hedges_won = segment_hedges_won_.load();
+    stats.first_byte_p50_ms = first_byte_p50_ms_.load();
+    stats.first_byte_p99_ms = first_byte_p99_ms_.load();
+    stats.download_p99_ms = download_p99_ms_.load();
+    stats.playlist_bytes_received = playlist_bytes_received_.load();
+    stats.playlist_bytes_decoded = playlist_bytes_decoded_.load();
+    
+    SegmentPool::Stats pool = segment_pool_.GetStats();
+    stats.pool_hits = pool.hits;
+    stats.pool_misses = pool.misses;
+    stats.pool_in_use_high_water = pool.in_use_high_water;
+    stats.pool_idle_bytes_high_water = pool.idle_bytes_high_water;
+    
+    if (current_config_.enable_pid_stats) {
+        stats.pid_stats = pid_stats_.GetSnapshot();
+    }
+    
+    // Calculate current FPS: the stream's own timestamps once the parser has them, otherwise
+    // access units delivered per second of wall time
     auto now = std::chrono::steady_clock::now();
     auto time_elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - stream_start_time_);
-    if (time_elapsed.count() > 1000 && stats.total_frames_processed > 0) {
+    double stream_fps = stream_frame_rate_.load();
+    if (stream_fps > 0.0) {
+        stats.current_fps = stream_fps;
+    } else if (time_elapsed.count() > 1000 && stats.total_frames_processed > 0) {
         stats.current_fps = static_cast<double>(stats.total_frames_processed * 1000) / time_elapsed.count();
     }
     
     // Calculate average frame interval
-    if (stats.total_frames_processed > 1) {
-        auto avg_interval_ms = time_elapsed.count() / stats.total_frames_processed;
-        stats.avg_frame_interval = std::chrono::milliseconds(avg_interval_ms);
+    if (stats.current_fps > 0.0) {
+        stats.avg_frame_interval = std::chrono::milliseconds(static_cast<int64_t>(1000.0 / stats.current_fps + 0.5));
     }
     
     return stats;
@@ -797,8 +337,91 @@ void TransportStreamRouter::HLSFetcherThread(const std::wstring& playlist_url, s
         log_callback_(L"[TS_ROUTER] HLS fetcher thread started");
     }
     
-    std::vector<std::wstring> processed_segments;
+    tsduck_hls::SegmentTracker segment_tracker; // Processed segments by media sequence number
     bool first_segment = true;
+    std::vector<PacketView> packet_views; // Reused for every segment so conversion does not allocate
+    DiscontinuitySplicer splicer;         // Rewrites each segment so periods join without a flush
+    bool pending_discontinuity = false;   // Next segment sent starts a new period
+    std::unique_ptr<TsChunker> chunker;   // Packet-aligned chunks of a segment still downloading
+    if (current_config_.enable_segment_prefetch && current_config_.enable_progressive_forwarding) {
+        chunker.reset(new TsChunker(current_config_.progressive_chunk_bytes));
+    }
+    std::shared_ptr<tardsplaya::RangeFetcher> range_fetcher; // Large segments as parallel byte ranges
+    if (current_config_.enable_segment_prefetch && current_config_.enable_range_download) {
+        tardsplaya::RangeFetcherConfig range_config;
+        range_config.connections = current_config_.range_connections;
+        range_fetcher = std::make_shared<tardsplaya::RangeFetcher>(tardsplaya::HttpClient::Shared(), range_config);
+    }
+    std::shared_ptr<tardsplaya::DeadlineFetcher> deadline_fetcher; // Hedged downloads that give up at the segment's deadline
+    if (current_config_.enable_segment_prefetch && current_config_.enable_segment_deadlines) {
+        deadline_fetcher = std::make_shared<tardsplaya::DeadlineFetcher>(tardsplaya::HttpClient::Shared(), current_config_.deadline_fetch);
+    }
+    // Segments and parts the edge is still producing have no size yet and are never split. They are
+    // always the newest entries, so only the last few are remembered.
+    std::mutex produced_mutex;
+    std::deque<std::wstring> produced_urls;
+    auto mark_produced = [&](const std::wstring& url) {
+        std::lock_guard<std::mutex> lock(produced_mutex);
+        produced_urls.push_back(url);
+        if (produced_urls.size() > 16) {
+            produced_urls.pop_front();
+        }
+    };
+    std::unique_ptr<SegmentPrefetcher> prefetcher; // Downloads the segments of a refresh in parallel, taken in order
+    if (current_config_.enable_segment_prefetch) {
+        PrefetcherConfig prefetch_config;
+        prefetch_config.max_concurrency = current_config_.prefetch_max_concurrency;
+        prefetch_config.initial_concurrency = std::min<size_t>(2, prefetch_config.max_concurrency);
+        prefetcher.reset(new SegmentPrefetcher(
+            [range_fetcher, deadline_fetcher, &produced_mutex, &produced_urls](const std::wstring& url, std::vector<uint8_t>& body,
+                                                                               const SegmentPrefetcher::ChunkSink& sink, std::atomic<bool>* token,
+                                                                               std::chrono::steady_clock::time_point deadline) {
+                bool produced = false;
+                if (range_fetcher) {
+                    std::lock_guard<std::mutex> lock(produced_mutex);
+                    produced = std::find(produced_urls.begin(), produced_urls.end(), url) != produced_urls.end();
+                }
+                if (range_fetcher && !produced) {
+                    // Ranges are assembled in the segment's pooled buffer, given up at the deadline
+                    return range_fetcher->Get(url, body, token, &sink, deadline);
+                }
+                // Streamed: the prefetcher appends what the sink is given to the pooled buffer, a copy the client counts
+                SegmentPrefetcher::ChunkSink counted = [&sink](const uint8_t* data, size_t size) {
+                    if (!sink(data, size)) {
+                        return false;
+                    }
+                    tardsplaya::HttpClient::Shared().CountCopied(size);
+                    return true;
+                };
+                if (deadline_fetcher) {
+                    return deadline_fetcher->Get(url, deadline, counted, token) == tardsplaya::DeadlineFetcher::Result::OK;
+                }
+                return tardsplaya::HttpClient::Shared().Get(url, counted, token);
+            },
+            segment_pool_, prefetch_config));
+    }
+    tsduck_hls::LowLatencyCursor ll_cursor; // Position in the parts of an LL-HLS playlist
+    uint64_t twitch_prefetch_segments = 0;  // Played from #EXT-X-TWITCH-PREFETCH before they were listed
+    std::wstring reload_url = playlist_url; // Blocking reload for the next refresh when the server supports it
+    tsduck_hls::PollScheduler poll_scheduler; // Next refresh from the segment publication cadence
+    std::wstring variant_url = playlist_url; // Media playlist being played; changes with the ABR variant
+    std::vector<PlaylistQuality> abr_variants; // Ascending bandwidth, the requested quality last
+    std::unique_ptr<AbrController> abr;
+    if (current_config_.enable_abr) {
+        abr_variants = AbrCandidates(current_config_.abr_variants, playlist_url);
+        if (abr_variants.size() > 1) {
+            std::vector<uint64_t> bitrates;
+            for (const PlaylistQuality& variant : abr_variants) {
+                bitrates.push_back(variant.bandwidth);
+            }
+            abr.reset(new AbrController(bitrates, bitrates.size() - 1, current_config_.abr));
+            abr_bandwidth_ = bitrates.back();
+            if (log_callback_) {
+                log_callback_(L"[ABR] Switching between " + std::to_wstring(abr_variants.size()) + L" variants up to " + 
+                             abr_variants.back().name + L" (" + std::to_wstring(bitrates.back() / 1000) + L" kbit/s)");
+            }
+        }
+    }
     int consecutive_failures = 0;
     const int max_consecutive_failures = 5;
     
@@ -806,7 +429,12 @@ void TransportStreamRouter::HLSFetcherThread(const std::wstring& playlist_url, s
         try {
             // Fetch playlist
             std::string playlist_content;
-            if (!HttpGetText(playlist_url, playlist_content, &cancel_token)) {
+            tardsplaya::HttpResponse playlist_response;
+            bool playlist_ok = HttpGetText(reload_url, playlist_content, &cancel_token, &playlist_response);
+            playlist_bytes_received_ += playlist_response.body_bytes;
+            playlist_bytes_decoded_ += playlist_response.decoded_bytes;
+            if (!playlist_ok) {
+                reload_url = variant_url;
                 consecutive_failures++;
                 if (log_callback_) {
                     log_callback_(L"[TS_ROUTER] Failed to fetch playlist (attempt " + std::to_wstring(consecutive_failures) + L"/" + std::to_wstring(max_consecutive_failures) + L")");
@@ -819,6 +447,7 @@ void TransportStreamRouter::HLSFetcherThread(const std::wstring& playlist_url, s
             }
             
             consecutive_failures = 0; // Reset failure counter on success
+            auto playlist_received = std::chrono::steady_clock::now();
             
             // Check for stream end before processing segments
             if (playlist_content.find("#EXT-X-ENDLIST") != std::string::npos) {
@@ -832,17 +461,57 @@ void TransportStreamRouter::HLSFetcherThread(const std::wstring& playlist_url, s
             // Parse playlist with enhanced discontinuity detection
             tsduck_hls::PlaylistParser playlist_parser;
             std::vector<std::wstring> segment_urls;
+            std::vector<int64_t> segment_sequences;    // Media sequence number of each segment
+            std::vector<bool> segment_discontinuities; // Segment starts a new period
             bool has_discontinuities = false;
+            bool low_latency_parts = false;            // The lists above hold LL-HLS parts keyed by tsduck_hls::PartKey
+            size_t prefetch_entries = 0;               // Trailing entries advertised by #EXT-X-TWITCH-PREFETCH
+            bool poll_scheduled = false;               // The poll scheduler saw this playlist
             
             if (playlist_parser.ParsePlaylist(playlist_content)) {
+                if (current_config_.enable_adaptive_polling) {
+                    // Regular segments only: prefetch entries and parts are announced before they exist
+                    poll_scheduler.OnPlaylist(playlist_parser, playlist_received);
+                    poll_scheduled = true;
+                    const tsduck_hls::PollScheduler::Stats& polls = poll_scheduler.GetStats();
+                    playlist_polls_ = polls.polls;
+                    playlist_polls_unchanged_ = polls.unchanged;
+                    poll_prediction_error_ms_ = polls.prediction_error_ms;
+                }
+                
                 // Extract segment URLs from parsed playlist
                 auto segments = playlist_parser.GetSegments();
                 for (const auto& segment : segments) {
                     segment_urls.push_back(segment.url);
+                    segment_sequences.push_back(static_cast<int64_t>(segment.sequence_number));
+                    segment_discontinuities.push_back(segment.has_discontinuity);
                 }
                 
-                // Check for discontinuities that indicate ad transitions
-                has_discontinuities = playlist_parser.HasDiscontinuities();
+                // Twitch low latency: segments still being produced are fetched now and forwarded as the edge
+                // streams them. They keep their sequence numbers, so once listed regularly they are handled already.
+                if (current_config_.enable_twitch_prefetch) {
+                    for (const auto& prefetch : playlist_parser.GetPrefetchSegments()) {
+                        segment_urls.push_back(JoinUrl(variant_url, prefetch.url));
+                        mark_produced(segment_urls.back());
+                        segment_sequences.push_back(static_cast<int64_t>(prefetch.sequence_number));
+                        segment_discontinuities.push_back(false);
+                        prefetch_entries++;
+                    }
+                }
+                
+                // Sequence numbers the playlist has moved past since the last refresh
+                uint64_t missed = segment_tracker.GetStats().missed;
+                segment_tracker.BeginPlaylist(playlist_parser.GetMediaSequence(), segment_urls.size());
+                segments_missed_ = segment_tracker.GetStats().missed;
+                segment_gaps_ = segment_tracker.GetStats().gaps;
+                if (segment_tracker.GetStats().missed != missed && log_callback_) {
+                    log_callback_(L"[SEGMENTS] Missed " + std::to_wstring(segment_tracker.GetStats().missed - missed) + 
+                                 L" segments that left the playlist before they were fetched");
+                }
+                
+                // Check for discontinuities that indicate ad transitions. When splicing, the boundary
+                // segment is joined on as it is sent and nothing is flushed here.
+                has_discontinuities = playlist_parser.HasDiscontinuities() && !current_config_.enable_discontinuity_splicing;
                 
                 if (has_discontinuities) {
                     if (log_callback_) {
@@ -851,6 +520,9 @@ void TransportStreamRouter::HLSFetcherThread(const std::wstring& playlist_url, s
                     
                     // Clear buffer immediately for fast restart after ad break
                     ts_buffer_->Clear();
+                    if (prefetcher) {
+                        prefetcher->Clear();
+                    }
                     
                     // Reset frame numbering to prevent frame drop false positives
                     hls_converter_->Reset();
@@ -864,22 +536,74 @@ void TransportStreamRouter::HLSFetcherThread(const std::wstring& playlist_url, s
                     
                     // For fast restart, only process the newest segments
                     if (segment_urls.size() > 1) {
-                        // Keep only the last segment for immediate restart
+                        // Keep only the last segment for immediate restart; the rest are passed over on purpose
+                        for (size_t i = 0; i + 1 < segment_sequences.size(); ++i) {
+                            segment_tracker.MarkSkipped(segment_sequences[i]);
+                        }
                         std::vector<std::wstring> restart_segments;
                         restart_segments.push_back(segment_urls.back());
                         segment_urls = restart_segments;
+                        segment_sequences.assign(1, segment_sequences.back());
+                        segment_discontinuities.assign(1, false);
                         
                         if (log_callback_) {
                             log_callback_(L"[FAST_RESTART] Using only newest segment for immediate playback");
                         }
                     }
                 }
+                
+                // LL-HLS: play the parts the cursor hands out instead of whole segments. Whole segments
+                // whose parts were played count as processed, older ones as skipped.
+                if (current_config_.enable_low_latency_hls && playlist_parser.IsLowLatency()) {
+                    low_latency_parts = true;
+                    bool started = ll_cursor.GetFirstMediaSequence() >= 0;
+                    std::vector<tsduck_hls::PartFetch> parts = ll_cursor.NextParts(playlist_parser);
+                    for (int64_t sequence : segment_sequences) {
+                        if (!segment_tracker.IsHandled(sequence)) {
+                            if (ll_cursor.GetFirstMediaSequence() >= 0 && sequence >= ll_cursor.GetFirstMediaSequence()) {
+                                segment_tracker.MarkProcessed(sequence);
+                            } else {
+                                segment_tracker.MarkSkipped(sequence);
+                            }
+                        }
+                    }
+                    segment_urls.clear();
+                    segment_sequences.clear();
+                    segment_discontinuities.clear();
+                    for (const tsduck_hls::PartFetch& part : parts) {
+                        segment_urls.push_back(JoinUrl(variant_url, part.url));
+                        mark_produced(segment_urls.back());
+                        segment_sequences.push_back(part.key);
+                        segment_discontinuities.push_back(part.discontinuity);
+                    }
+                    if (!started && !parts.empty() && log_callback_) {
+                        log_callback_(L"[LL_HLS] Playing parts from segment " + std::to_wstring(parts.front().media_sequence) + 
+                                     L" part " + std::to_wstring(parts.front().part_index) + L" (part target " + 
+                                     std::to_wstring(playlist_parser.GetPartTarget().count()) + L"ms, blocking reload " + 
+                                     (playlist_parser.GetServerControl().can_block_reload ? L"yes)" : L"no)"));
+                    }
+                    
+                    // The hinted part is requested now; the server answers once it exists
+                    tsduck_hls::PartFetch preload;
+                    if (prefetcher && ll_cursor.PreloadPart(playlist_parser, preload)) {
+                        mark_produced(JoinUrl(variant_url, preload.url));
+                        prefetcher->Enqueue(preload.key, JoinUrl(variant_url, preload.url));
+                    }
+                }
             } else {
                 // Fallback to basic parsing if enhanced parser fails
-                segment_urls = ParseHLSPlaylist(playlist_content, playlist_url);
+                segment_urls = ParseHLSPlaylist(playlist_content, variant_url);
+                int64_t media_sequence = tsduck_hls::ParseMediaSequence(playlist_content);
+                for (size_t i = 0; i < segment_urls.size(); ++i) {
+                    segment_sequences.push_back(media_sequence + static_cast<int64_t>(i));
+                }
+                segment_tracker.BeginPlaylist(media_sequence, segment_urls.size());
+                segments_missed_ = segment_tracker.GetStats().missed;
+                segment_gaps_ = segment_tracker.GetStats().gaps;
             }
             
-            if (segment_urls.empty()) {
+            if (segment_urls.empty() && !low_latency_parts) {
+                reload_url = variant_url;
                 if (log_callback_) {
                     log_callback_(L"[TS_ROUTER] No segments found in playlist");
                 }
@@ -894,110 +618,292 @@ void TransportStreamRouter::HLSFetcherThread(const std::wstring& playlist_url, s
             int segments_processed = 0;
             size_t total_segments = segment_urls.size();
             
+            // Low-latency optimization: segments before the newest few are skipped to stay closer to live edge
+            // (the LL-HLS cursor starts parts at the server's hold-back instead)
+            size_t first_kept_segment = 0;
+            if (!low_latency_parts && current_config_.low_latency_mode && current_config_.skip_old_segments &&
+                total_segments > current_config_.max_segments_to_buffer) {
+                first_kept_segment = total_segments - current_config_.max_segments_to_buffer;
+            }
+            
+            // Start every segment that will be sent downloading now; the loop below takes them in order.
+            // Each must arrive before the player runs out: after what is buffered and the entries queued ahead
+            // of it. Until the first segment is playing there is nothing to run out of.
+            if (prefetcher) {
+                std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+                std::chrono::milliseconds entry_duration = low_latency_parts ? playlist_parser.GetPartTarget() : playlist_parser.GetTargetDuration();
+                if (entry_duration.count() <= 0) {
+                    entry_duration = std::chrono::milliseconds(2000);
+                }
+                if (deadline_fetcher && !first_segment) {
+                    std::chrono::milliseconds buffered = current_config_.enable_pcr_pacing ?
+                        std::chrono::milliseconds(ts_buffer_->GetLatencyStats().buffered_ms) : entry_duration;
+                    deadline = std::chrono::steady_clock::now() + buffered + current_config_.deadline_grace;
+                }
+                for (size_t i = first_kept_segment; i < segment_urls.size(); ++i) {
+                    if (low_latency_parts || !segment_tracker.IsHandled(segment_sequences[i])) {
+                        prefetcher->Enqueue(segment_sequences[i], segment_urls[i], deadline);
+                        if (deadline != std::chrono::steady_clock::time_point::max()) {
+                            deadline += entry_duration;
+                        }
+                    }
+                }
+            }
+            size_t late_skip_until = 0;     // Entries before this are passed over after a late segment
+            
+            // Splice, convert and queue one piece of downloaded data - a whole segment, or a chunk of one
+            // still downloading - and return the packets queued. Packet views are offsets into the data,
+            // which is shared with the buffer and kept alive until the router has written it.
+            size_t segment_packets = 0;
+            auto forward_data = [&](SegmentPool::PooledSegment data, TsChunker* chunk_source) -> size_t {
+                if (data->empty()) {
+                    return 0;
+                }
+                
+                // Join the segment onto what has been sent: counters, PCR and tables carry across periods
+                if (current_config_.enable_discontinuity_splicing) {
+                    uint64_t splices = splicer.GetStats().splices;
+                    splicer.SpliceSegment(*data, pending_discontinuity);
+                    if (splicer.GetStats().splices != splices && log_callback_) {
+                        log_callback_(L"[SPLICE] Joined discontinuity (ad transition) without flushing the buffer");
+                    }
+                }
+                pending_discontinuity = false;
+                
+                SegmentBuffer segment = chunk_source ? chunk_source->Share(std::move(data)) : segment_pool_.Share(std::move(data));
+                hls_converter_->ConvertSegmentViews(*segment, packet_views, first_segment);
+                first_segment = false;
+                
+                // Publish bitstream timing for GetBufferStats
+                const AccessUnitParser& access_units = hls_converter_->GetAccessUnitParser();
+                stream_frame_rate_ = access_units.GetFrameRate();
+                keyframe_interval_ms_ = access_units.GetKeyFrameIntervalMs();
+                
+                const SyncScanResult& sync_scan = hls_converter_->GetLastSyncScan();
+                if (sync_scan.bytes_skipped > 0 && !packet_views.empty()) {
+                    if (log_callback_) {
+                        log_callback_(L"[TS_ROUTER] Segment sync errors: skipped " + std::to_wstring(sync_scan.bytes_skipped) +
+                                     L" bytes, resynchronized " + std::to_wstring(sync_scan.resyncs) + L" times");
+                    }
+                }
+                
+                if (packet_views.empty()) {
+                    return 0;
+                }
+                
+                // Per-PID statistics in one pass over the data, published for GetBufferStats
+                if (current_config_.enable_pid_stats) {
+                    uint64_t cc_errors = pid_stats_.GetSnapshot()->cc_errors;
+                    pid_stats_.ProcessSegment(segment->data(), packet_views.data(), packet_views.size());
+                    uint64_t new_errors = pid_stats_.GetSnapshot()->cc_errors - cc_errors;
+                    if (new_errors > 0 && log_callback_) {
+                        log_callback_(L"[PID_STATS] " + std::to_wstring(new_errors) + L" continuity errors in segment");
+                    }
+                }
+                
+                // Add to buffer with special handling for post-discontinuity segments
+                size_t buffer_high_watermark, buffer_low_watermark;
+                
+                if (has_discontinuities) {
+                    // Immediately after discontinuity: minimal buffering for fastest restart
+                    buffer_high_watermark = current_config_.buffer_size_packets / 8; // 12.5% for immediate restart
+                    buffer_low_watermark = current_config_.buffer_size_packets / 16;  // 6.25% for fastest response
+                    
+                    if (log_callback_ && segments_processed == 0 && segment_packets == 0) {
+                        log_callback_(L"[FAST_RESTART] Using minimal buffering for immediate playback after ad");
+                    }
+                } else if (current_config_.low_latency_mode) {
+                    // For low-latency, the buffer skips to a key frame past the latency target, so let it fill
+                    // that far rather than blocking here and falling behind the playlist
+                    buffer_high_watermark = ts_buffer_->GetMaxPackets() * 9 / 10; // 90% of the buffer's hard limit
+                    buffer_low_watermark = ts_buffer_->GetMaxPackets() / 8;       // 12.5% full for faster response
+                } else {
+                    // Standard buffering for quality over latency
+                    buffer_high_watermark = current_config_.buffer_size_packets * 9 / 10; // 90% full for better buffering
+                    buffer_low_watermark = current_config_.buffer_size_packets / 4;       // 25% full for faster recovery
+                }
+                
+                // Push packets in runs that fit under the high watermark; when the buffer is full,
+                // block until the router drains it to the low watermark instead of polling
+                size_t next_packet = 0;
+                while (next_packet < packet_views.size() && routing_active_ && !cancel_token) {
+                    size_t buffered = ts_buffer_->GetOccupiedSlots();
+                    if (buffered >= buffer_high_watermark) {
+                        ts_buffer_->WaitForSpace(buffer_low_watermark, std::chrono::milliseconds(50));
+                        continue;
+                    }
+
+                    size_t run = std::min(buffer_high_watermark - buffered, packet_views.size() - next_packet);
+
+                    // Check stream health before adding packets
+                    for (size_t i = next_packet; i < next_packet + run; ++i) {
+                        CheckStreamHealth(packet_views[i].meta);
+                    }
+
+                    ts_buffer_->AddPacketViews(segment, &packet_views[next_packet], run);
+                    total_packets_processed_ += run;
+                    next_packet += run;
+                }
+                segment_packets += next_packet;
+                return next_packet;
+            };
+            
+            // Progressive forwarding: chunks of the awaited segment go out while the rest downloads
+            SegmentPrefetcher::ProgressFunction forward_progress = [&](const uint8_t* data, size_t size) {
+                chunker->Append(data, size);
+                SegmentPool::PooledSegment chunk;
+                while (chunker->NextChunk(chunk)) {
+                    forward_data(std::move(chunk), chunker.get());
+                }
+            };
+            
             for (size_t i = 0; i < segment_urls.size(); ++i) {
                 if (cancel_token || !routing_active_) break;
                 
                 const auto& segment_url = segment_urls[i];
+                const int64_t segment_sequence = segment_sequences[i];
                 
-                // Skip already processed segments
-                if (std::find(processed_segments.begin(), processed_segments.end(), segment_url) != processed_segments.end()) {
+                // Skip already processed segments (the cursor hands out each part once)
+                if (!low_latency_parts && segment_tracker.IsHandled(segment_sequence)) {
                     continue;
                 }
                 
+                // A boundary stays pending if its segment is skipped below; the next one sent starts the period
+                if (i < segment_discontinuities.size() && segment_discontinuities[i]) {
+                    pending_discontinuity = true;
+                }
+                
                 // Low-latency optimization: If we have multiple unprocessed segments and this isn't
                 // one of the newest ones, skip it to stay closer to live edge
-                if (current_config_.low_latency_mode && current_config_.skip_old_segments) {
-                    size_t remaining_segments = total_segments - i;
-                    if (remaining_segments > current_config_.max_segments_to_buffer && 
-                        i < (total_segments - current_config_.max_segments_to_buffer)) {
-                        
-                        processed_segments.push_back(segment_url); // Mark as processed to avoid reprocessing
-                        if (log_callback_) {
-                            log_callback_(L"[LOW_LATENCY] Skipping older segment to maintain live edge");
-                        }
-                        continue;
+                if (i < first_kept_segment) {
+                    segment_tracker.MarkSkipped(segment_sequence); // Mark as handled to avoid reprocessing
+                    if (log_callback_) {
+                        log_callback_(L"[LOW_LATENCY] Skipping older segment to maintain live edge");
                     }
+                    continue;
+                }
+                if (i < late_skip_until) {
+                    if (!low_latency_parts) {
+                        segment_tracker.MarkSkipped(segment_sequence);
+                    }
+                    continue;
                 }
                 
-                // Fetch segment data
-                std::vector<uint8_t> segment_data;
-                if (FetchHLSSegment(segment_url, segment_data, &cancel_token)) {
-                    if (segment_data.empty()) {
-                        if (log_callback_) {
-                            log_callback_(L"[TS_ROUTER] Empty segment downloaded: " + segment_url);
-                        }
-                        continue;
+                // Fetch segment data into a recycled buffer; it goes back to the pool if the download fails.
+                // Prefetched segments are usually complete or in flight by the time their turn comes; one
+                // still in flight is forwarded in chunks as it arrives when progressive forwarding is on.
+                segment_packets = 0;
+                SegmentPrefetcher::Segment prefetched;
+                SegmentPrefetcher::Result prefetch_result = SegmentPrefetcher::Result::NOT_QUEUED;
+                if (prefetcher) {
+                    if (chunker) {
+                        chunker->BeginSegment();
                     }
-                    
-                    // Convert to TS packets
-                    auto ts_packets = hls_converter_->ConvertSegment(segment_data, first_segment);
-                    first_segment = false;
-                    
-                    if (ts_packets.empty()) {
-                        if (log_callback_) {
-                            log_callback_(L"[TS_ROUTER] No valid TS packets found in segment");
-                        }
-                        continue;
+                    prefetch_result = prefetcher->Take(segment_sequence, prefetched, &cancel_token, chunker ? &forward_progress : nullptr);
+                }
+                if (prefetch_result == SegmentPrefetcher::Result::CANCELLED) {
+                    break;
+                }
+                if (deadline_fetcher) {
+                    tardsplaya::DeadlineFetcher::Stats deadline_stats = deadline_fetcher->GetStats();
+                    segment_hedges_ = deadline_stats.hedges;
+                    segment_hedges_won_ = deadline_stats.hedges_won;
+                    first_byte_p50_ms_ = deadline_stats.time_to_first_byte.Percentile(0.5);
+                    first_byte_p99_ms_ = deadline_stats.time_to_first_byte.Percentile(0.99);
+                    download_p99_ms_ = deadline_stats.download_time.Percentile(0.99);
+                }
+                if (prefetch_result == SegmentPrefetcher::Result::LATE) {
+                    // The player would stall waiting for it: give it up and go on from the newest entry, which
+                    // starts a new period. Part of it may be queued already; the packet it was cut in is dropped.
+                    if (prefetched.delivered > 0) {
+                        chunker->Abort();
                     }
-                    
-                    // Add to buffer with special handling for post-discontinuity segments
-                    size_t buffer_high_watermark, buffer_low_watermark;
-                    
-                    if (has_discontinuities) {
-                        // Immediately after discontinuity: minimal buffering for fastest restart
-                        buffer_high_watermark = current_config_.buffer_size_packets / 8; // 12.5% for immediate restart
-                        buffer_low_watermark = current_config_.buffer_size_packets / 16;  // 6.25% for fastest response
-                        
-                        if (log_callback_ && segments_processed == 0) {
-                            log_callback_(L"[FAST_RESTART] Using minimal buffering for immediate playback after ad");
-                        }
-                    } else if (current_config_.low_latency_mode) {
-                        // For low-latency, use smaller buffers and more aggressive flow control
-                        buffer_high_watermark = current_config_.buffer_size_packets * 6 / 10; // 60% full for low latency
-                        buffer_low_watermark = current_config_.buffer_size_packets / 8;       // 12.5% full for faster response
-                    } else {
-                        // Standard buffering for quality over latency
-                        buffer_high_watermark = current_config_.buffer_size_packets * 9 / 10; // 90% full for better buffering
-                        buffer_low_watermark = current_config_.buffer_size_packets / 4;       // 25% full for faster recovery
+                    pending_discontinuity = true;
+                    if (!low_latency_parts) {
+                        segment_tracker.MarkSkipped(segment_sequence);
                     }
-                    
-                    for (const auto& packet : ts_packets) {
-                        if (!routing_active_ || cancel_token) break;
-                        
-                        // Check stream health before adding packets
-                        CheckStreamHealth(packet);
-                        
-                        // Implement flow control with latency-optimized timing
-                        while (ts_buffer_->GetBufferedPackets() >= buffer_high_watermark && routing_active_ && !cancel_token) {
-                            auto sleep_duration = current_config_.low_latency_mode ? 
-                                std::chrono::milliseconds(1) :   // Faster response for low latency
-                                std::chrono::milliseconds(2);    // Standard response
-                            std::this_thread::sleep_for(sleep_duration);
-                        }
-                        
-                        ts_buffer_->AddPacket(packet);
-                        total_packets_processed_++;
+                    late_skip_until = segment_urls.size() - 1;
+                    segments_late_++;
+                    if (log_callback_) {
+                        log_callback_(L"[DEADLINE] Segment missed its deadline after " + std::to_wstring(prefetched.delivered) + 
+                                     L" bytes; jumping to live past " + std::to_wstring(i + 1 < late_skip_until ? late_skip_until - i - 1 : 0) + 
+                                     L" more entries: " + segment_url);
                     }
-                    
-                    processed_segments.push_back(segment_url);
-                    segments_processed++;
-                    
-                    // Keep only recent segments in memory
-                    if (processed_segments.size() > 10) {
-                        processed_segments.erase(processed_segments.begin());
+                    continue;
+                }
+                SegmentPool::PooledSegment segment_data = std::move(prefetched.data);
+                bool fetched = prefetch_result == SegmentPrefetcher::Result::READY;
+                if (prefetch_result == SegmentPrefetcher::Result::NOT_QUEUED && prefetched.delivered == 0) {
+                    segment_data = segment_pool_.Acquire();
+                    fetched = FetchHLSSegment(segment_url, *segment_data, &cancel_token);
+                }
+                
+                size_t segment_bytes = 0;
+                if (fetched && prefetched.delivered > 0) {
+                    // The rest of a segment that was forwarded in chunks, up to its last whole packet
+                    segment_bytes = segment_data->size();
+                    forward_progress(segment_data->data() + prefetched.delivered, segment_bytes - prefetched.delivered);
+                    SegmentPool::PooledSegment chunk;
+                    if (chunker->Finish(chunk)) {
+                        forward_data(std::move(chunk), chunker.get());
                     }
-                    
-                    if (log_callback_ && segments_processed <= 3) { // Log first few segments
-                        log_callback_(L"[TS_ROUTER] Processed segment: " + std::to_wstring(ts_packets.size()) + L" TS packets (" + std::to_wstring(segment_data.size()) + L" bytes)");
+                    segment_data.reset();
+                } else if (fetched) {
+                    segment_bytes = segment_data->size();
+                    if (forward_data(std::move(segment_data), nullptr) == 0) {
+                        if (log_callback_) {
+                            log_callback_(segment_bytes == 0 ? L"[TS_ROUTER] Empty segment downloaded: " + segment_url :
+                                                               L"[TS_ROUTER] No valid TS packets found in segment");
+                        }
+                        continue;
+                    }
+                } else if (prefetched.delivered > 0) {
+                    // Part of the segment is already queued and cannot be taken back. Drop the packet it was
+                    // cut in and start the next segment as a new period, so counters and PCR stay valid.
+                    size_t dropped = chunker->Abort();
+                    pending_discontinuity = true;
+                    if (log_callback_) {
+                        log_callback_(L"[PROGRESSIVE] Segment download aborted after " + std::to_wstring(prefetched.delivered) + 
+                                     L" bytes (" + std::to_wstring(segment_packets) + L" packets forwarded, " + std::to_wstring(dropped) + 
+                                     L" bytes dropped); next segment starts a new period: " + segment_url);
                     }
                 } else {
                     if (log_callback_) {
                         log_callback_(L"[TS_ROUTER] Failed to fetch segment: " + segment_url);
                     }
+                    continue;
+                }
+                
+                if (!low_latency_parts) {
+                    segment_tracker.MarkProcessed(segment_sequence);
+                }
+                // Throughput for quality switching. A segment that was complete when requested is timed whole; one
+                // streamed while produced waited on the encoder for most of its download, so only the bytes that
+                // arrived back to back count, over the time they took.
+                if (abr && fetched && prefetch_result == SegmentPrefetcher::Result::READY && !low_latency_parts) {
+                    bool produced = false;
+                    {
+                        std::lock_guard<std::mutex> lock(produced_mutex);
+                        produced = std::find(produced_urls.begin(), produced_urls.end(), prefetched.url) != produced_urls.end();
+                    }
+                    if (produced) {
+                        abr->OnSegmentDownloaded(prefetched.transfer_bytes,
+                                                 std::chrono::duration_cast<std::chrono::milliseconds>(prefetched.transfer_time));
+                    } else {
+                        abr->OnSegmentDownloaded(segment_bytes, prefetched.download_time);
+                    }
+                }
+                if (i + std::min(prefetch_entries, segment_urls.size()) >= segment_urls.size()) {
+                    twitch_prefetch_segments++;
+                }
+                segments_processed++;
+                
+                if (log_callback_ && segments_processed <= 3) { // Log first few segments
+                    log_callback_(L"[TS_ROUTER] Processed segment: " + std::to_wstring(segment_packets) + L" TS packets (" + std::to_wstring(segment_bytes) + L" bytes)");
                 }
             }
             
-            if (segments_processed > 0 && log_callback_) {
+            if (segments_processed > 0 && log_callback_ && !low_latency_parts) {
                 log_callback_(L"[TS_ROUTER] Batch complete: " + std::to_wstring(segments_processed) + L" new segments processed");
                 
                 if (current_config_.low_latency_mode) {
@@ -1005,21 +911,71 @@ void TransportStreamRouter::HLSFetcherThread(const std::wstring& playlist_url, s
                 }
             }
             
+            // Quality switching at a segment boundary: the next refresh loads the new variant. Its segments keep
+            // the media sequence numbering and start a new period; downloads queued from the old one are dropped.
+            bool variant_switched = false;
+            if (abr) {
+                // Unpaced, the buffer drains as fast as the player reads and its level says nothing
+                std::chrono::milliseconds buffered = current_config_.enable_pcr_pacing && !first_segment ?
+                    std::chrono::milliseconds(ts_buffer_->GetLatencyStats().buffered_ms) : AbrController::UNKNOWN_BUFFER;
+                AbrController::Decision decision = abr->Decide(buffered, std::chrono::steady_clock::now());
+                AbrController::Stats abr_stats = abr->GetStats();
+                throughput_estimate_bps_ = abr_stats.estimate_bps;
+                abr_switches_down_ = abr_stats.switches_down;
+                abr_switches_up_ = abr_stats.switches_up;
+                if (decision.switched) {
+                    const PlaylistQuality& variant = abr_variants[decision.variant];
+                    variant_url = variant.url;
+                    abr_bandwidth_ = variant.bandwidth;
+                    pending_discontinuity = true;
+                    if (prefetcher) {
+                        prefetcher->Clear();
+                    }
+                    variant_switched = true;
+                    if (log_callback_) {
+                        const wchar_t* reason = decision.reason == AbrController::Reason::LOW_BUFFER ? L"buffer low" :
+                                                decision.reason == AbrController::Reason::THROUGHPUT ? L"throughput" : L"throughput recovered";
+                        log_callback_(L"[ABR] Switched to " + variant.name + L" (" + std::to_wstring(variant.bandwidth / 1000) + 
+                                     L" kbit/s): " + reason + L", estimate " + std::to_wstring(static_cast<int>(abr_stats.estimate_bps / 1000)) + 
+                                     L" kbit/s, " + std::to_wstring(buffered.count()) + L"ms buffered");
+                    }
+                }
+            }
+            
             // Wait before next playlist refresh, use configurable interval for low-latency
             auto refresh_interval = current_config_.low_latency_mode ? 
                 current_config_.playlist_refresh_interval : 
                 std::chrono::milliseconds(2000);  // Default 2 seconds
+            
+            // A server that can block holds the next reload until the part (or segment) after the last one
+            // listed exists, so it is sent right away; a reload that brought nothing new backs off a little
+            reload_url = current_config_.enable_low_latency_hls ? tsduck_hls::BlockingReloadUrl(playlist_parser, variant_url) : variant_url;
+            if (variant_switched) {
+                reload_url = variant_url;
+                refresh_interval = std::chrono::milliseconds(0);
+            } else if (reload_url != variant_url) {
+                refresh_interval = segments_processed > 0 ? std::chrono::milliseconds(0) : std::chrono::milliseconds(100);
+            } else if (low_latency_parts) {
+                refresh_interval = playlist_parser.GetPartTarget();
+            } else if (poll_scheduled) {
+                refresh_interval = poll_scheduler.DelayFrom(std::chrono::steady_clock::now());
+            }
                 
             // Break the wait into smaller chunks to check cancellation more frequently
             auto chunk_duration = std::chrono::milliseconds(100);
-            auto chunks_needed = refresh_interval.count() / chunk_duration.count();
+            auto refresh_at = std::chrono::steady_clock::now() + refresh_interval;
             
-            for (int i = 0; i < chunks_needed && routing_active_ && !cancel_token; ++i) {
-                std::this_thread::sleep_for(chunk_duration);
+            while (routing_active_ && !cancel_token) {
+                auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(refresh_at - std::chrono::steady_clock::now());
+                if (remaining.count() <= 0) {
+                    break;
+                }
+                std::this_thread::sleep_for(std::min(remaining, chunk_duration));
             }
             
         } catch (const std::exception& e) {
             consecutive_failures++;
+            reload_url = variant_url;
             if (log_callback_) {
                 std::string error_msg = e.what();
                 log_callback_(L"[TS_ROUTER] HLS fetcher error: " + std::wstring(error_msg.begin(), error_msg.end()));
@@ -1044,7 +1000,178 @@ void TransportStreamRouter::HLSFetcherThread(const std::wstring& playlist_url, s
     }
     
     if (log_callback_) {
-        log_callback_(L"[TS_ROUTER] HLS fetcher thread stopped");
+        log_callback_(L"[TS_ROUTER] HLS fetcher thread stopped (" + std::to_wstring(hls_converter_->GetTotalBytesSkipped()) +
+                     L" corrupt bytes skipped, " + std::to_wstring(hls_converter_->GetTotalResyncs()) + L" resyncs)");
+        if (current_config_.enable_discontinuity_splicing) {
+            const DiscontinuitySplicer::Stats& splice_stats = splicer.GetStats();
+            log_callback_(L"[SPLICE] " + std::to_wstring(splice_stats.splices) + L" discontinuities joined, " + 
+                         std::to_wstring(splice_stats.pids_remapped) + L" PID counters remapped, " + 
+                         std::to_wstring(splice_stats.tables_versioned) + L" tables re-versioned, " + 
+                         std::to_wstring(splice_stats.tables_resent) + L" tables re-sent");
+        }
+        if (current_config_.enable_pid_stats) {
+            for (const PIDStatistics::PIDCounters& pid : pid_stats_.GetSnapshot()->pids) {
+                wchar_t pid_text[8];
+                swprintf_s(pid_text, L"0x%04X", pid.pid);
+                log_callback_(L"[PID_STATS] PID " + std::wstring(pid_text) + L": " + std::to_wstring(pid.packets) + L" packets, " + 
+                             std::to_wstring(static_cast<int>(pid.avg_bitrate_bps / 1000)) + L" kbit/s, " + 
+                             std::to_wstring(pid.cc_errors) + L" CC errors, " + std::to_wstring(pid.tei_packets) + L" TEI, " + 
+                             std::to_wstring(pid.scrambled_packets) + L" scrambled, " + std::to_wstring(pid.pcr_interval_violations) + 
+                             L" PCR gaps over " + std::to_wstring(PIDStatistics::MAX_PCR_INTERVAL_MS) + L"ms");
+            }
+        }
+        SegmentPool::Stats pool = segment_pool_.GetStats();
+        log_callback_(L"[POOL] Segment buffers: " + std::to_wstring(pool.hits) + L" reused, " + std::to_wstring(pool.misses) + 
+                     L" allocated, " + std::to_wstring(pool.evictions) + L" freed, " + std::to_wstring(pool.in_use_high_water) + 
+                     L" in use at most, " + std::to_wstring(pool.idle_bytes_high_water / 1024) + L"KB idle at most");
+        if (prefetcher) {
+            SegmentPrefetcher::Stats prefetch = prefetcher->GetStats();
+            log_callback_(L"[PREFETCH] " + std::to_wstring(prefetch.downloads) + L" segments downloaded ahead, " + 
+                         std::to_wstring(prefetch.failures) + L" failed, " + std::to_wstring(prefetch.discarded) + L" discarded, limit " + 
+                         std::to_wstring(prefetch.concurrency) + L"/" + std::to_wstring(current_config_.prefetch_max_concurrency) + L" (" + 
+                         std::to_wstring(prefetch.increases) + L" raised, " + std::to_wstring(prefetch.decreases) + L" lowered), " + 
+                         std::to_wstring(prefetch.in_flight_high_water) + L" in flight at most, " + 
+                         std::to_wstring(static_cast<int>(prefetch.throughput_bps / 1000)) + L" kbit/s");
+        }
+        if (range_fetcher) {
+            tardsplaya::RangeFetcher::Stats ranges = range_fetcher->GetStats();
+            log_callback_(L"[RANGE] " + std::to_wstring(ranges.split_downloads) + L" of " + std::to_wstring(ranges.downloads) + 
+                         L" segments split into " + std::to_wstring(ranges.ranges) + L" extra ranges, " + 
+                         std::to_wstring(ranges.range_retries) + L" ranges resumed, " + std::to_wstring(ranges.unsupported) + 
+                         L" answered without range support, " + std::to_wstring(ranges.failures) + L" failed (" + 
+                         std::to_wstring(ranges.late) + L" at their deadline)");
+        }
+        if (deadline_fetcher) {
+            tardsplaya::DeadlineFetcher::Stats deadline_stats = deadline_fetcher->GetStats();
+            log_callback_(L"[DEADLINE] " + std::to_wstring(segments_late_.load()) + L" segments late, " + 
+                         std::to_wstring(deadline_stats.hedges) + L" hedged requests (" + std::to_wstring(deadline_stats.hedges_won) + 
+                         L" answered first), " + std::to_wstring(deadline_stats.retries) + L" retries, first byte p50/p95/p99 " + 
+                         std::to_wstring(static_cast<int>(deadline_stats.time_to_first_byte.Percentile(0.5))) + L"/" + 
+                         std::to_wstring(static_cast<int>(deadline_stats.time_to_first_byte.Percentile(0.95))) + L"/" + 
+                         std::to_wstring(static_cast<int>(deadline_stats.time_to_first_byte.Percentile(0.99))) + L"ms, download p99 " + 
+                         std::to_wstring(static_cast<int>(deadline_stats.download_time.Percentile(0.99))) + L"ms, max " + 
+                         std::to_wstring(static_cast<int>(deadline_stats.download_time.GetMax())) + L"ms");
+        }
+        if (twitch_prefetch_segments > 0) {
+            log_callback_(L"[TWITCH_PREFETCH] " + std::to_wstring(twitch_prefetch_segments) + 
+                         L" segments played from prefetch tags before the playlist listed them");
+        }
+        if (abr) {
+            AbrController::Stats abr_stats = abr->GetStats();
+            log_callback_(L"[ABR] " + std::to_wstring(abr_stats.switches_down) + L" switches down, " + 
+                         std::to_wstring(abr_stats.switches_up) + L" up, ended on " + abr_variants[abr_stats.variant].name + 
+                         L", throughput estimate " + std::to_wstring(static_cast<int>(abr_stats.estimate_bps / 1000)) + L" kbit/s");
+        }
+        if (poll_scheduler.IsStarted()) {
+            const tsduck_hls::PollScheduler::Stats& polls = poll_scheduler.GetStats();
+            log_callback_(L"[POLL] " + std::to_wstring(polls.polls) + L" playlist polls, " + std::to_wstring(polls.changed) + 
+                         L" with new segments, " + std::to_wstring(polls.unchanged) + L" unchanged, cadence " + 
+                         std::to_wstring(static_cast<int>(polls.cadence_ms)) + L"ms, prediction error " + 
+                         std::to_wstring(static_cast<int>(polls.prediction_error_ms)) + L"ms");
+        }
+        if (ll_cursor.GetFirstMediaSequence() >= 0) {
+            const tsduck_hls::LowLatencyCursor::Stats& parts = ll_cursor.GetStats();
+            log_callback_(L"[LL_HLS] " + std::to_wstring(parts.parts) + L" parts played, " + std::to_wstring(parts.preloads) + 
+                         L" requested from preload hints, " + std::to_wstring(parts.gaps) + L" gaps, " + 
+                         std::to_wstring(parts.jumps) + L" restarts at the live edge");
+        }
+        if (chunker) {
+            const TsChunker::Stats& chunks = chunker->GetStats();
+            log_callback_(L"[PROGRESSIVE] " + std::to_wstring(chunks.segments) + L" segments forwarded while downloading in " + 
+                         std::to_wstring(chunks.chunks) + L" chunks (" + std::to_wstring(chunks.bytes / 1024) + L"KB), " + 
+                         std::to_wstring(chunks.aborted) + L" aborted partway, " + std::to_wstring(chunks.bytes_dropped) + L" bytes dropped");
+        }
+        tardsplaya::HttpClient::Stats http = tardsplaya::HttpClient::Shared().GetStats();
+        log_callback_(L"[HTTP] Connections (all streams): " + std::to_wstring(http.connections_opened) + L" opened, " +
+                     std::to_wstring(static_cast<int>(http.ReuseRatio() * 100 + 0.5)) + L"% of requests reused one, " +
+                     std::to_wstring(static_cast<int64_t>(http.HandshakeMsSaved())) + L"ms of handshakes saved, " +
+                     std::to_wstring(http.stale_retries) + L" stale, " + std::to_wstring(http.idle_evictions) + L" idle closed");
+        uint64_t playlist_received = playlist_bytes_received_.load();
+        uint64_t playlist_decoded = playlist_bytes_decoded_.load();
+        if (playlist_decoded > 0) {
+            log_callback_(L"[HTTP] Playlists of this stream: " + std::to_wstring(playlist_received / 1024) + L"KB received for " + 
+                         std::to_wstring(playlist_decoded / 1024) + L"KB, " + 
+                         std::to_wstring(static_cast<int>(100.0 - 100.0 * playlist_received / playlist_decoded + 0.5)) + L"% saved by compression");
+        }
+        wchar_t copy_ratio[32];
+        swprintf_s(copy_ratio, L"%.2f", http.CopyRatio());
+        log_callback_(L"[HTTP] " + std::to_wstring(http.body_bytes / 1024) + L"KB of bodies received, " + copy_ratio +
+                     L" bytes copied per byte received, " + std::to_wstring(http.encoded_bodies) + L" compressed bodies (" + 
+                     std::to_wstring(static_cast<int>(http.CompressionSavings() * 100 + 0.5)) + L"% saved, " + 
+                     std::to_wstring(http.undecodable) + L" undecodable)");
+    }
+}
+
+void TransportStreamRouter::TrackFrameStatistics(const PacketMeta& meta) {
+    // Frame Number Tagging: Track frame statistics
+    if (meta.frame_number > 0) {
+        // Check for frame drops or duplicates. frame_number is the last of the access units
+        // starting in this packet, so the first one is what must follow the previous packet.
+        uint64_t current_frame = meta.frame_number;
+        uint64_t frames_in_packet = meta.access_units > 0 ? meta.access_units : 1;
+        uint64_t first_frame = current_frame - (frames_in_packet - 1);
+        uint64_t last_frame = last_frame_number_.load();
+        
+        if (first_frame > last_frame + 1) {
+            // Frame drop detected
+            uint32_t dropped = static_cast<uint32_t>(first_frame - last_frame - 1);
+            frames_dropped_ += dropped;
+            
+            if (log_callback_) {
+                log_callback_(L"[FRAME_TAG] Frame drop detected: " + std::to_wstring(dropped) + 
+                             L" frames dropped between #" + std::to_wstring(last_frame) + 
+                             L" and #" + std::to_wstring(current_frame));
+            }
+        } else if (current_frame <= last_frame && last_frame > 0) {
+            // Potential duplicate or reordered frame
+            frames_duplicated_++;
+            
+            if (log_callback_) {
+                log_callback_(L"[FRAME_TAG] Duplicate/reordered frame: #" + std::to_wstring(current_frame) + 
+                             L" (last: #" + std::to_wstring(last_frame) + L")");
+            }
+        }
+        
+        last_frame_number_ = current_frame;
+        total_frames_processed_ += frames_in_packet;
+        if (meta.Has(PacketMeta::KEY_FRAME)) {
+            key_frames_processed_++;
+        }
+        
+        // Video-specific frame tracking
+        if (meta.Has(PacketMeta::VIDEO)) {
+            video_frames_processed_ += frames_in_packet;
+            last_video_frame_number_ = meta.video_frame_number;
+            
+            // Check for video synchronization issues (counted by CheckStreamHealth when queued)
+            if (meta.Has(PacketMeta::VIDEO_SYNC_LOST)) {
+                if (log_callback_) {
+                    log_callback_(L"[VIDEO_SYNC] Video synchronization lost at frame #" + std::to_wstring(current_frame));
+                }
+            }
+        }
+        
+        // Log frame info for key frames or periodically
+        if (meta.Has(PacketMeta::KEY_FRAME) || (current_frame % 300 == 0)) { // Every 300 frames or key frames
+            if (log_callback_) {
+                log_callback_(L"[FRAME_TAG] " + meta.GetFrameDebugInfo());
+            }
+        }
+        
+        // Special handling for video stream health
+        if (meta.Has(PacketMeta::VIDEO)) {
+            auto now = std::chrono::steady_clock::now();
+            auto video_gap = std::chrono::duration_cast<std::chrono::milliseconds>(now - last_video_packet_time_);
+            
+            // If we haven't seen video packets for more than 5 seconds, log warning
+            if (video_gap.count() > 5000) {
+                if (log_callback_) {
+                    log_callback_(L"[VIDEO_HEALTH] Warning: No video packets for " + std::to_wstring(video_gap.count()) + L"ms");
+                }
+            }
+            
+            last_video_packet_time_ = now;
+        }
     }
 }
 
@@ -1076,6 +1203,39 @@ void TransportStreamRouter::TSRouterThread(std::atomic<bool>& cancel_token) {
     auto last_log_time = std::chrono::steady_clock::now();
     auto last_packet_time = std::chrono::steady_clock::now();
     
+    // Coalesce packets into large pipe writes, flushed on size or latency deadline
+    PipePacketSink player_sink(player_stdin);
+    CoalescingPacketWriter packet_writer(player_sink, current_config_.output_batch_bytes,
+                                         std::chrono::duration_cast<std::chrono::microseconds>(current_config_.output_max_latency));
+
+    // Local batch of packets popped from the buffer in one go (metadata only when frame stats are on).
+    // In zero-copy mode only pointers are popped, a full writer batch at a time so runs can go
+    // straight from the segment to the pipe.
+    const bool zero_copy = ts_buffer_->IsZeroCopyMode();
+    const size_t packet_batch_size = zero_copy ? packet_writer.GetMaxBatchBytes() / TS_PACKET_SIZE : 64;
+    std::vector<uint8_t> payload_batch(zero_copy ? 0 : packet_batch_size * TS_PACKET_SIZE);
+    std::vector<const uint8_t*> view_batch(zero_copy ? packet_batch_size : 0);
+    std::vector<PacketMeta> meta_batch(packet_batch_size);
+    const bool track_frames = ts_buffer_->IsMetadataEnabled();
+    
+    // Releases packets against the stream's PCR so the player is not handed a segment at a time
+    PCRScheduler::Config pacing_config;
+    pacing_config.enabled = current_config_.enable_pcr_pacing;
+    pacing_config.max_burst = current_config_.pacing_max_burst;
+    pacing_config.catch_up_rate = current_config_.pacing_catch_up_rate;
+    pacing_config.catch_up_backlog = current_config_.pacing_catch_up_backlog;
+    PCRScheduler output_pacer(pacing_config);
+    uint64_t buffer_gaps = ts_buffer_->GetGapCount();
+    output_lag_ms_ = 0.0;
+    output_jitter_ms_ = 0.0;
+    output_backlog_ms_ = 0.0;
+    output_catching_up_ = false;
+    
+    // Repeats the stream's PAT/PMT between its own copies (rebuilt only when a table changes)
+    const bool repeat_psi = current_config_.enable_pat_pmt_repetition;
+    PSIRepeater psi_repeater(current_config_.pat_pmt_interval);
+    uint8_t psi_packets[2 * TS_PACKET_SIZE];
+
     // Send TS packets to player with natural timing - let the stream flow naturally
     while (routing_active_ && !cancel_token) {
         // Check if player process is still running with better error reporting
@@ -1104,87 +1264,123 @@ void TransportStreamRouter::TSRouterThread(std::atomic<bool>& cancel_token) {
         }
         
         // Get and send packets with timeout optimized for latency mode
-        TSPacket packet;
         auto packet_timeout = current_config_.low_latency_mode ? 
             std::chrono::milliseconds(10) :   // Very fast timeout for low latency
             std::chrono::milliseconds(50);    // Standard timeout
+        
+        // Don't sleep past the pending batch's flush deadline. Rounded up: a wait under a millisecond
+        // truncated to zero would poll the buffer without sleeping until the deadline passes.
+        auto flush_wait = packet_writer.TimeUntilDeadline();
+        if (flush_wait < packet_timeout) {
+            packet_timeout = std::chrono::ceil<std::chrono::milliseconds>(flush_wait);
+        }
             
-        if (ts_buffer_->GetNextPacket(packet, packet_timeout)) {
-            // Frame Number Tagging: Track frame statistics
-            if (packet.frame_number > 0) {
-                // Check for frame drops or duplicates
-                uint64_t current_frame = packet.frame_number;
-                uint64_t last_frame = last_frame_number_.load();
-                
-                if (current_frame > last_frame + 1) {
-                    // Frame drop detected
-                    uint32_t dropped = static_cast<uint32_t>(current_frame - last_frame - 1);
-                    frames_dropped_ += dropped;
-                    
-                    if (log_callback_) {
-                        log_callback_(L"[FRAME_TAG] Frame drop detected: " + std::to_wstring(dropped) + 
-                                     L" frames dropped between #" + std::to_wstring(last_frame) + 
-                                     L" and #" + std::to_wstring(current_frame));
-                    }
-                } else if (current_frame <= last_frame && last_frame > 0) {
-                    // Potential duplicate or reordered frame
-                    frames_duplicated_++;
-                    
-                    if (log_callback_) {
-                        log_callback_(L"[FRAME_TAG] Duplicate/reordered frame: #" + std::to_wstring(current_frame) + 
-                                     L" (last: #" + std::to_wstring(last_frame) + L")");
-                    }
+        // Packets are taken from the buffer in batches; payloads arrive back to back (or as pointers
+        // into the segments) and go to the writer in one call
+        PacketMeta* batch_metas = track_frames ? meta_batch.data() : nullptr;
+        size_t batch_count = zero_copy ?
+            ts_buffer_->GetPacketViews(view_batch.data(), batch_metas, packet_batch_size, packet_timeout) :
+            ts_buffer_->GetPackets(payload_batch.data(), batch_metas, packet_batch_size, packet_timeout);
+
+        if (batch_count > 0) {
+            // The batch starts after a latency skip or drop: its PCRs do not follow the clock
+            uint64_t gaps = ts_buffer_->GetGapCount();
+            if (gaps != buffer_gaps) {
+                buffer_gaps = gaps;
+                output_pacer.Resync();
+            }
+            
+            if (track_frames) {
+                for (size_t i = 0; i < batch_count; ++i) {
+                    TrackFrameStatistics(meta_batch[i]);
                 }
+            }
+            
+            // Write the batch as the pacer releases it. Held packets stay in the local batch (their
+            // segments are pinned until the next Get call) while the router waits for the next PCR slot.
+            output_pacer.SetBacklog(ts_buffer_->GetBufferedPackets(), std::chrono::steady_clock::now());
+            size_t released = 0;
+            while (released < batch_count) {
+                auto now = std::chrono::steady_clock::now();
+                std::chrono::steady_clock::time_point release_at;
+                size_t ready = zero_copy ?
+                    output_pacer.ReleaseViews(view_batch.data() + released, batch_count - released, now, release_at) :
+                    output_pacer.Release(payload_batch.data() + released * TS_PACKET_SIZE, batch_count - released, now, release_at);
                 
-                last_frame_number_ = current_frame;
-                total_frames_processed_++;
-                
-                // Video-specific frame tracking
-                if (packet.is_video_packet) {
-                    video_frames_processed_++;
-                    last_video_frame_number_ = packet.video_frame_number;
-                    
-                    // Check for video synchronization issues
-                    if (packet.video_sync_lost) {
-                        video_sync_loss_count_++;
+                if (ready > 0) {
+                    bool written = zero_copy ?
+                        packet_writer.WritePacketViews(view_batch.data() + released, ready) :
+                        packet_writer.WritePackets(payload_batch.data() + released * TS_PACKET_SIZE, ready);
+                    if (!written) {
                         if (log_callback_) {
-                            log_callback_(L"[VIDEO_SYNC] Video synchronization lost at frame #" + std::to_wstring(current_frame));
+                            log_callback_(L"[TS_ROUTER] Failed to send TS packets to player (error: " + 
+                                         std::to_wstring(player_sink.GetLastErrorCode()) + L") - pipe may be broken");
+                        }
+                        goto cleanup_and_exit;
+                    }
+                    
+                    if (repeat_psi) {
+                        for (size_t i = released; i < released + ready; ++i) {
+                            psi_repeater.OnPacket(zero_copy ? view_batch[i] : payload_batch.data() + i * TS_PACKET_SIZE, now);
+                        }
+                        size_t psi_count = psi_repeater.EmitIfDue(now, psi_packets);
+                        if (psi_count > 0 && !packet_writer.WritePackets(psi_packets, psi_count)) {
+                            if (log_callback_) {
+                                log_callback_(L"[TS_ROUTER] Failed to send PAT/PMT to player (error: " + 
+                                             std::to_wstring(player_sink.GetLastErrorCode()) + L") - pipe may be broken");
+                            }
+                            goto cleanup_and_exit;
                         }
                     }
+                    released += ready;
+                    packets_sent += ready;
+                }
+                if (released == batch_count) {
+                    break;
                 }
                 
-                // Log frame info for key frames or periodically
-                if (packet.is_key_frame || (current_frame % 300 == 0)) { // Every 300 frames or key frames
+                // Everything released so far is due now - don't let it sit in the batch while waiting
+                if (!packet_writer.Flush()) {
                     if (log_callback_) {
-                        log_callback_(L"[FRAME_TAG] " + packet.GetFrameDebugInfo());
+                        log_callback_(L"[TS_ROUTER] Failed to flush TS packets to player (error: " + 
+                                     std::to_wstring(player_sink.GetLastErrorCode()) + L") - pipe may be broken");
                     }
+                    goto cleanup_and_exit;
                 }
-                
-                // Special handling for video stream health
-                if (packet.is_video_packet) {
-                    auto now = std::chrono::steady_clock::now();
-                    auto video_gap = std::chrono::duration_cast<std::chrono::milliseconds>(now - last_video_packet_time_);
-                    
-                    // If we haven't seen video packets for more than 5 seconds, log warning
-                    if (video_gap.count() > 5000) {
-                        if (log_callback_) {
-                            log_callback_(L"[VIDEO_HEALTH] Warning: No video packets for " + std::to_wstring(video_gap.count()) + L"ms");
-                        }
-                    }
-                    
-                    last_video_packet_time_ = now;
+                while (routing_active_ && !cancel_token && std::chrono::steady_clock::now() < release_at) {
+                    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(release_at - std::chrono::steady_clock::now());
+                    std::this_thread::sleep_for(std::min(remaining + std::chrono::milliseconds(1), std::chrono::milliseconds(10)));
+                }
+                if (!routing_active_ || cancel_token) {
+                    goto cleanup_and_exit;
                 }
             }
+            last_packet_time = std::chrono::steady_clock::now();
             
-            if (!SendTSPacketToPlayer(player_stdin, packet)) {
+            const PCRScheduler::Stats& pacing = output_pacer.GetStats();
+            output_lag_ms_ = pacing.lag_ms;
+            output_jitter_ms_ = pacing.jitter_ms;
+            output_backlog_ms_ = pacing.backlog_ms;
+            output_catching_up_ = pacing.catching_up;
+            
+            // A steady trickle of packets must not hold a partial batch past its deadline either
+            if (!packet_writer.FlushIfDue(last_packet_time)) {
                 if (log_callback_) {
-                    log_callback_(L"[TS_ROUTER] Failed to send TS packet to player - pipe may be broken");
+                    log_callback_(L"[TS_ROUTER] Failed to flush TS packets to player (error: " + 
+                                 std::to_wstring(player_sink.GetLastErrorCode()) + L") - pipe may be broken");
                 }
                 goto cleanup_and_exit;
             }
-            packets_sent++;
-            last_packet_time = std::chrono::steady_clock::now();
         } else {
+            // Idle - push out a partial batch once its latency budget is used up
+            if (!packet_writer.FlushIfDue()) {
+                if (log_callback_) {
+                    log_callback_(L"[TS_ROUTER] Failed to flush TS packets to player (error: " + 
+                                 std::to_wstring(player_sink.GetLastErrorCode()) + L") - pipe may be broken");
+                }
+                goto cleanup_and_exit;
+            }
+            
             // No packet available, check if we should continue waiting
             if (!ts_buffer_->IsProducerActive() && ts_buffer_->IsEmpty()) {
                 // Stream ended normally and buffer is empty - clean exit
@@ -1214,6 +1410,9 @@ void TransportStreamRouter::TSRouterThread(std::atomic<bool>& cancel_token) {
     }
     
 cleanup_and_exit:
+    // Push out whatever is still batched before the pipe is closed
+    packet_writer.Flush();
+    
     // Cleanup
     if (player_stdin != INVALID_HANDLE_VALUE) {
         FlushFileBuffers(player_stdin); // Ensure all data is written
@@ -1230,7 +1429,29 @@ cleanup_and_exit:
     }
     
     if (log_callback_) {
-        log_callback_(L"[TS_ROUTER] TS router thread stopped (" + std::to_wstring(packets_sent) + L" packets sent)");
+        const auto& writer_stats = packet_writer.GetStats();
+        log_callback_(L"[TS_ROUTER] TS router thread stopped (" + std::to_wstring(packets_sent) + L" packets sent in " + 
+                     std::to_wstring(writer_stats.write_calls) + L" writes, " + 
+                     std::to_wstring(writer_stats.bytes_copied / 1024) + L"KB copied into batches, " + 
+                     std::to_wstring(ts_buffer_->GetDroppedPackets()) + L" dropped in buffer)");
+        if (output_pacer.IsEnabled()) {
+            const PCRScheduler::Stats& pacing = output_pacer.GetStats();
+            log_callback_(L"[TS_ROUTER] PCR pacing: max lag " + std::to_wstring(static_cast<int>(pacing.max_lag_ms)) + 
+                         L"ms, jitter " + std::to_wstring(static_cast<int>(pacing.jitter_ms)) + L"ms, " + 
+                         std::to_wstring(pacing.late_packets) + L" late PCRs, " + 
+                         std::to_wstring(pacing.clock_resets) + L" clock resets");
+        }
+        if (current_config_.low_latency_mode) {
+            TSBuffer::LatencyStats latency = ts_buffer_->GetLatencyStats();
+            log_callback_(L"[LOW_LATENCY] " + std::to_wstring(latency.skips) + L" key frame skips (" + 
+                         std::to_wstring(latency.frames_skipped) + L" frames, " + std::to_wstring(latency.bytes_skipped / 1024) + 
+                         L"KB), last " + std::to_wstring(latency.last_skip_from_ms) + L"ms -> " + std::to_wstring(latency.last_skip_to_ms) + 
+                         L"ms, " + std::to_wstring(latency.unaligned_drops) + L" packets dropped mid-GOP");
+        }
+        if (repeat_psi) {
+            log_callback_(L"[TS_ROUTER] PAT/PMT repeated " + std::to_wstring(psi_repeater.GetRepeats()) + 
+                         L" times, tables rebuilt " + std::to_wstring(psi_repeater.GetRebuilds()) + L" times");
+        }
     }
 }
 
@@ -1313,32 +1534,6 @@ bool TransportStreamRouter::LaunchMediaPlayer(const RouterConfig& config, HANDLE
     return true;
 }
 
-bool TransportStreamRouter::SendTSPacketToPlayer(HANDLE stdin_handle, const TSPacket& packet) {
-    if (stdin_handle == INVALID_HANDLE_VALUE) {
-        return false;
-    }
-    
-    DWORD bytes_written = 0;
-    BOOL write_result = WriteFile(stdin_handle, packet.data, TS_PACKET_SIZE, &bytes_written, nullptr);
-    
-    if (!write_result) {
-        DWORD error = GetLastError();
-        if (log_callback_) {
-            log_callback_(L"[TS_ROUTER] WriteFile failed, error: " + std::to_wstring(error));
-        }
-        return false;
-    }
-    
-    if (bytes_written != TS_PACKET_SIZE) {
-        if (log_callback_) {
-            log_callback_(L"[TS_ROUTER] Partial write: " + std::to_wstring(bytes_written) + L"/" + std::to_wstring(TS_PACKET_SIZE));
-        }
-        return false;
-    }
-    
-    return true;
-}
-
 bool TransportStreamRouter::FetchHLSSegment(const std::wstring& segment_url, std::vector<uint8_t>& data, std::atomic<bool>* cancel_token) {
     // Use binary HTTP download for proper segment data handling
     return HttpGetBinary(segment_url, data, cancel_token);
@@ -1470,6 +1665,9 @@ void TransportStreamRouter::ResetFrameStatistics() {
     frames_dropped_ = 0;
     frames_duplicated_ = 0;
     last_frame_number_ = 0;
+    key_frames_processed_ = 0;
+    stream_frame_rate_ = 0.0;
+    keyframe_interval_ms_ = 0;
     last_frame_time_ = std::chrono::steady_clock::now();
     stream_start_time_ = std::chrono::steady_clock::now();
     
@@ -1499,18 +1697,18 @@ bool TransportStreamRouter::IsAudioStreamHealthy() const {
     return audio_gap.count() < 3000 && audio_packets_processed_.load() > 0;
 }
 
-void TransportStreamRouter::CheckStreamHealth(const TSPacket& packet) {
+void TransportStreamRouter::CheckStreamHealth(const PacketMeta& meta) {
     auto now = std::chrono::steady_clock::now();
     
-    if (packet.is_video_packet) {
+    if (meta.Has(PacketMeta::VIDEO)) {
         video_packets_processed_++;
         last_video_packet_time_ = now;
         
         // Check for video sync issues
-        if (!packet.IsVideoSyncValid()) {
+        if (meta.Has(PacketMeta::VIDEO_SYNC_LOST)) {
             video_sync_loss_count_++;
         }
-    } else if (packet.is_audio_packet) {
+    } else if (meta.Has(PacketMeta::AUDIO)) {
         audio_packets_processed_++;
         last_audio_packet_time_ = now;
     }
@@ -6,151 +6,32 @@
 #include <vector>
 #include <atomic>
 #include <thread>
-#include <queue>
 #include <mutex>
 #include <chrono>
 #include <functional>
 #include <memory>
 
+#include "ts_packet.h"
+#include "ts_packet_writer.h"
+#include "ts_buffer.h"
+#include "hls_ts_converter.h"
+#include "pcr_scheduler.h"
+#include "psi_tables.h"
+#include "ts_splicer.h"
+#include "ts_pid_stats.h"
+#include "segment_pool.h"
+#include "segment_prefetcher.h"
+#include "ts_chunker.h"
+#include "abr_controller.h"
+#include "playlist_parser.h"
+#include "deadline_fetcher.h"
+
 #define WIN32_LEAN_AND_MEAN
 #define NOMINMAX
 #include <windows.h>
 
 namespace tsduck_transport {
 
-    // Transport Stream packet size (MPEG-TS standard)
-    static constexpr size_t TS_PACKET_SIZE = 188;
-    
-    // Transport Stream packet header structure
-    struct TSPacket {
-        uint8_t data[TS_PACKET_SIZE];
-        std::chrono::steady_clock::time_point timestamp;
-        uint16_t pid = 0;
-        bool payload_unit_start = false;
-        bool discontinuity = false;
-        
-        // Stream type identification
-        bool is_video_packet = false;     // True if this packet contains video data
-        bool is_audio_packet = false;     // True if this packet contains audio data
-        
-        // Frame Number Tagging for lag reduction
-        uint64_t frame_number = 0;        // Global frame sequence number
-        uint32_t segment_frame_number = 0; // Frame number within current segment
-        bool is_key_frame = false;        // Indicates if this is a key/I-frame
-        std::chrono::milliseconds frame_duration{0}; // Expected frame duration for timing
-        
-        // Video synchronization data
-        uint64_t video_frame_number = 0;  // Video-specific frame counter
-        bool video_sync_lost = false;     // True if video synchronization is lost
-        
-        TSPacket() {
-            memset(data, 0, TS_PACKET_SIZE);
-            timestamp = std::chrono::steady_clock::now();
-        }
-        
-        // Parse packet header information
-        void ParseHeader();
-        
-        // Check if this is a valid TS packet
-        bool IsValid() const { return data[0] == 0x47; }
-        
-        // Frame Number Tagging methods
-        void SetFrameInfo(uint64_t global_frame, uint32_t segment_frame, bool key_frame = false, std::chrono::milliseconds duration = std::chrono::milliseconds(0));
-        void SetVideoInfo(uint64_t video_frame, bool is_video, bool is_audio = false);
-        std::wstring GetFrameDebugInfo() const;
-        bool IsFrameDropDetected(const TSPacket& previous_packet) const;
-        bool IsVideoSyncValid() const;
-    };
-    
-    // Transport Stream buffer for smooth re-routing
-    class TSBuffer {
-    public:
-        TSBuffer(size_t max_packets = 25000); // ~4.7MB buffer for smooth multi-stream streaming
-        
-        // Add TS packet to buffer
-        bool AddPacket(const TSPacket& packet);
-        
-        // Get next packet from buffer (blocking until available)
-        bool GetNextPacket(TSPacket& packet, std::chrono::milliseconds timeout = std::chrono::milliseconds(1000));
-        
-        // Get buffer status
-        size_t GetBufferedPackets() const;
-        bool IsEmpty() const;
-        bool IsFull() const;
-        
-        // Clear buffer (for discontinuities)
-        void Clear();
-        
-        // Reset buffer state for new stream
-        void Reset();
-        
-        // Signal end of stream (no more packets will be added)
-        void SignalEndOfStream();
-        
-        // Check if producer is still active
-        bool IsProducerActive() const { return producer_active_.load(); }
-        
-        // Enable low-latency mode for more aggressive packet dropping
-        void SetLowLatencyMode(bool enabled) { low_latency_mode_ = enabled; }
-        
-    private:
-        mutable std::mutex mutex_;
-        std::queue<TSPacket> packet_queue_;
-        size_t max_packets_;
-        std::atomic<bool> producer_active_{true};
-        bool low_latency_mode_{false};
-    };
-    
-    // HLS to Transport Stream converter
-    class HLSToTSConverter {
-    public:
-        HLSToTSConverter();
-        
-        // Convert HLS segment data to TS packets
-        std::vector<TSPacket> ConvertSegment(const std::vector<uint8_t>& hls_data, bool is_first_segment = false);
-        
-        // Set conversion parameters
-        void SetProgramID(uint16_t program_id) { program_id_ = program_id; }
-        void SetPMTPID(uint16_t pmt_pid) { pmt_pid_ = pmt_pid; }
-        
-        // Reset converter state for new stream
-        void Reset();
-        
-    private:
-        uint16_t program_id_ = 1;
-        uint16_t pmt_pid_ = 0x1000;
-        uint16_t video_pid_ = 0x1001;
-        uint16_t audio_pid_ = 0x1002;
-        uint8_t continuity_counter_ = 0;
-        bool pat_sent_ = false;
-        bool pmt_sent_ = false;
-        
-        // Frame Number Tagging state
-        uint64_t global_frame_counter_ = 0;     // Total frames processed across all segments
-        uint32_t segment_frame_counter_ = 0;    // Frames in current segment
-        std::chrono::steady_clock::time_point last_frame_time_;
-        std::chrono::milliseconds estimated_frame_duration_{33}; // Default ~30fps
-        
-        // Stream type detection state
-        uint16_t detected_video_pid_ = 0;
-        uint16_t detected_audio_pid_ = 0;
-        
-        // Generate PAT (Program Association Table)
-        TSPacket GeneratePAT();
-        
-        // Generate PMT (Program Map Table)
-        TSPacket GeneratePMT();
-        
-        // Wrap data in TS packets
-        std::vector<TSPacket> WrapDataInTS(const uint8_t* data, size_t size, uint16_t pid, bool payload_start = false);
-        
-        // Calculate CRC32 for PSI tables
-        uint32_t CalculateCRC32(const uint8_t* data, size_t length);
-        
-        // Detect and classify stream types (video/audio)
-        void DetectStreamTypes(TSPacket& packet);
-    };
-    
     // Transport Stream Router - main component for re-routing streams to media players
     class TransportStreamRouter {
     public:
@@ -166,13 +47,80 @@ namespace tsduck_transport {
             bool enable_pcr_insertion = true;
             std::chrono::milliseconds pcr_interval{40}; // PCR every 40ms
             bool enable_pat_pmt_repetition = true;
-            std::chrono::milliseconds pat_pmt_interval{100}; // PAT/PMT every 100ms
+            bool enable_discontinuity_splicing = true;  // Join HLS discontinuities (ad breaks) into one stream instead of flushing
+            std::chrono::milliseconds pat_pmt_interval{100}; // Repeat the stream's PAT/PMT every 100ms
             
             // Low-latency streaming optimizations
             bool low_latency_mode = true;  // Enable aggressive latency reduction
             size_t max_segments_to_buffer = 2;  // Only buffer latest N segments for live edge
             std::chrono::milliseconds playlist_refresh_interval{500}; // Check for new segments every 500ms
+            
+            // Poll the playlist just before the next segment is predicted to appear, from the segment duration
+            // and the observed publication cadence, backing off while it is unchanged, instead of every
+            // playlist_refresh_interval. Blocking LL-HLS reloads and part polling take precedence.
+            bool enable_adaptive_polling = true;
             bool skip_old_segments = true;  // Skip older segments when catching up
+            
+            // LL-HLS: play a low-latency playlist from its partial segments, starting PART-HOLD-BACK from the
+            // live edge, and reload with _HLS_msn/_HLS_part when the server can block instead of on a timer
+            bool enable_low_latency_hls = true;
+            
+            // Twitch low latency: also play the upcoming segments a playlist advertises with #EXT-X-TWITCH-PREFETCH,
+            // requested at once and forwarded as the edge produces them. They are not fetched again once listed.
+            bool enable_twitch_prefetch = true;
+            std::chrono::milliseconds latency_target{3000}; // Queued stream time before the buffer skips ahead to a key frame
+            
+            // Automatic quality switching between the master playlist's video variants. The requested quality is
+            // the ceiling; the fetcher moves down (and back up) at segment boundaries from measured segment
+            // throughput and buffered stream time. Without variants, or BANDWIDTH for them, the quality stays fixed.
+            bool enable_abr = true;
+            std::vector<PlaylistQuality> abr_variants;
+            AbrConfig abr;
+            
+            // Frame/video statistics - keeps 24 bytes of metadata per buffered packet next to the payload
+            bool enable_frame_stats = true;
+            
+            // Per-PID continuity, PCR and bitrate statistics, counted once per segment
+            bool enable_pid_stats = true;
+            
+            // Buffer pointers into the downloaded segments instead of copying every packet
+            bool zero_copy_segments = true;
+            
+            // Download buffers recycled once the router has written them (idle bytes are also capped across streams)
+            size_t segment_pool_buffers = SegmentPool::DEFAULT_MAX_BUFFERS;
+            
+            // Segments of a playlist refresh download in parallel and are handed over in sequence order.
+            // The limit adapts to measured throughput between 1 and the per-stream maximum.
+            bool enable_segment_prefetch = true;
+            size_t prefetch_max_concurrency = 4;
+            
+            // Split large segments into byte ranges downloaded in parallel on pooled connections (needs segment
+            // prefetch). For links one connection cannot fill, e.g. source quality over long round trips.
+            bool enable_range_download = false;
+            size_t range_connections = 4;
+            
+            // Give each prefetched segment a deadline from its place in the playback queue (buffered stream time plus
+            // the entries before it, plus a grace period). A request without a first byte by the recent p95 is hedged
+            // on another connection; a segment that misses its deadline is abandoned and playback jumps to live.
+            bool enable_segment_deadlines = true;
+            std::chrono::milliseconds deadline_grace{1000};
+            tardsplaya::DeadlineFetcherConfig deadline_fetch;
+            
+            // Forward the segment being waited for in packet-aligned chunks as it downloads instead of after
+            // the whole download (needs segment prefetch). Saves up to a segment's download time of latency.
+            bool enable_progressive_forwarding = true;
+            size_t progressive_chunk_bytes = TsChunker::DEFAULT_CHUNK_BYTES;
+            
+            // Output coalescing - packets are batched into large pipe writes instead of one WriteFile per packet
+            size_t output_batch_bytes = TS_PACKET_SIZE * 348;  // ~64KB cap per write (whole packets only)
+            std::chrono::milliseconds output_max_latency{15};  // Flush a partial batch after this long
+            
+            // PCR pacing - release packets at the stream's own rate instead of a whole segment at a time.
+            // The catch-up rate works off small backlogs; larger ones are skipped by the latency target.
+            bool enable_pcr_pacing = true;
+            std::chrono::milliseconds pacing_max_burst{250};          // Output may run this far ahead of the PCR clock
+            double pacing_catch_up_rate = 1.25;                        // Clock speed while behind live
+            std::chrono::milliseconds pacing_catch_up_backlog{2500};  // Buffered stream time that counts as behind live
         };
         
         // Start routing HLS stream to media player via transport stream
@@ -198,8 +146,10 @@ namespace tsduck_transport {
             uint64_t total_frames_processed = 0;
             uint32_t frames_dropped = 0;
             uint32_t frames_duplicated = 0;
-            double current_fps = 0.0;
+            double current_fps = 0.0;                    // From stream DTS spacing once known
             std::chrono::milliseconds avg_frame_interval{0};
+            uint64_t key_frames_processed = 0;
+            std::chrono::milliseconds keyframe_interval{0}; // PTS distance between the last two key frames
             
             // Video/Audio stream health statistics
             uint64_t video_packets_processed = 0;
@@ -208,6 +158,57 @@ namespace tsduck_transport {
             uint32_t video_sync_loss_count = 0;
             bool video_stream_healthy = true;
             bool audio_stream_healthy = true;
+            
+            // PCR pacing of the output
+            double output_lag_ms = 0.0;       // How late the last PCR arrived for its release slot
+            double output_jitter_ms = 0.0;    // Smoothed deviation of output spacing from PCR spacing
+            double output_backlog_ms = 0.0;   // Stream time buffered behind the output
+            bool output_catching_up = false;
+            
+            // Low-latency skips to key frames (latency_target)
+            uint64_t latency_skips = 0;
+            uint64_t latency_bytes_skipped = 0;
+            uint64_t latency_frames_skipped = 0;
+            std::chrono::milliseconds buffered_latency{0};   // Stream time queued in the buffer
+            std::chrono::milliseconds last_skip_from{0};     // Queued stream time before/after the last skip
+            std::chrono::milliseconds last_skip_to{0};
+            uint64_t unaligned_drops = 0;                    // Packets dropped mid-GOP; frames up to the next key frame are undecodable
+            
+            // Playlist segments that left the live window before they were fetched (media sequence gaps)
+            uint64_t segments_missed = 0;
+            uint64_t segment_gaps = 0;
+            
+            // Playlist polling (enable_adaptive_polling)
+            uint64_t playlist_polls = 0;
+            uint64_t playlist_polls_unchanged = 0;          // Polls that listed nothing new
+            double poll_prediction_error_ms = 0.0;          // Smoothed error of the predicted segment publication
+            
+            // Automatic quality switching (enable_abr)
+            uint64_t abr_bandwidth = 0;                     // BANDWIDTH of the variant playing, 0 without switching
+            uint64_t abr_switches_down = 0;
+            uint64_t abr_switches_up = 0;
+            double throughput_estimate_bps = 0.0;           // From segment download times
+            
+            // Segment deadlines (enable_segment_deadlines)
+            uint64_t segments_late = 0;                     // Abandoned at their deadline; playback jumped to live
+            uint64_t segment_hedges = 0;                    // Duplicate requests for segments without a first byte
+            uint64_t segment_hedges_won = 0;                // Duplicates that answered first
+            double first_byte_p50_ms = 0.0;                 // Segment time to first byte, from histogram buckets
+            double first_byte_p99_ms = 0.0;
+            double download_p99_ms = 0.0;
+            
+            // Playlist transfers; gzip or deflate when the CDN offers it
+            uint64_t playlist_bytes_received = 0;           // As sent on the wire
+            uint64_t playlist_bytes_decoded = 0;            // After decoding; equal when nothing was compressed
+            
+            // Segment buffer recycling
+            uint64_t pool_hits = 0;
+            uint64_t pool_misses = 0;
+            size_t pool_in_use_high_water = 0;      // Segment buffers downloading or queued at once
+            size_t pool_idle_bytes_high_water = 0;
+            
+            // Per-PID table as of the last segment (enable_pid_stats); shared, not copied
+            std::shared_ptr<const PIDStatistics::Snapshot> pid_stats;
         };
         BufferStats GetBufferStats() const;
         
@@ -232,6 +233,9 @@ namespace tsduck_transport {
         std::atomic<uint32_t> frames_dropped_{0};
         std::atomic<uint32_t> frames_duplicated_{0};
         std::atomic<uint64_t> last_frame_number_{0};
+        std::atomic<uint64_t> key_frames_processed_{0};
+        std::atomic<double> stream_frame_rate_{0.0};       // Published by the fetcher from the access unit parser
+        std::atomic<uint32_t> keyframe_interval_ms_{0};
         std::chrono::steady_clock::time_point last_frame_time_;
         std::chrono::steady_clock::time_point stream_start_time_;
         
@@ -244,6 +248,45 @@ namespace tsduck_transport {
         std::chrono::steady_clock::time_point last_video_packet_time_;
         std::chrono::steady_clock::time_point last_audio_packet_time_;
         
+        // Output pacing metrics, published by the router thread
+        std::atomic<double> output_lag_ms_{0.0};
+        std::atomic<double> output_jitter_ms_{0.0};
+        std::atomic<double> output_backlog_ms_{0.0};
+        std::atomic<bool> output_catching_up_{false};
+        
+        // Per-PID statistics, updated by the fetcher a segment at a time
+        PIDStatistics pid_stats_;
+        
+        // Recycled segment download buffers
+        SegmentPool segment_pool_;
+        
+        // Media sequence tracking, published by the fetcher
+        std::atomic<uint64_t> segments_missed_{0};
+        std::atomic<uint64_t> segment_gaps_{0};
+        
+        // Playlist poll scheduling, published by the fetcher
+        std::atomic<uint64_t> playlist_polls_{0};
+        std::atomic<uint64_t> playlist_polls_unchanged_{0};
+        std::atomic<double> poll_prediction_error_ms_{0.0};
+        
+        // Quality switching, published by the fetcher
+        std::atomic<uint64_t> abr_bandwidth_{0};
+        std::atomic<uint64_t> abr_switches_down_{0};
+        std::atomic<uint64_t> abr_switches_up_{0};
+        std::atomic<double> throughput_estimate_bps_{0.0};
+        
+        // Segment deadlines, published by the fetcher
+        std::atomic<uint64_t> segments_late_{0};
+        std::atomic<uint64_t> segment_hedges_{0};
+        std::atomic<uint64_t> segment_hedges_won_{0};
+        std::atomic<double> first_byte_p50_ms_{0.0};
+        std::atomic<double> first_byte_p99_ms_{0.0};
+        std::atomic<double> download_p99_ms_{0.0};
+        
+        // Playlist bytes, published by the fetcher
+        std::atomic<uint64_t> playlist_bytes_received_{0};
+        std::atomic<uint64_t> playlist_bytes_decoded_{0};
+        
         // HLS fetching thread - downloads segments and converts to TS
         void HLSFetcherThread(const std::wstring& playlist_url, std::atomic<bool>& cancel_token);
         
@@ -253,16 +296,17 @@ namespace tsduck_transport {
         // Reset frame statistics (for discontinuities)
         void ResetFrameStatistics();
         
+        // Update frame statistics for one packet leaving the buffer
+        void TrackFrameStatistics(const PacketMeta& meta);
+        
         // Video stream health monitoring
         bool IsVideoStreamHealthy() const;
         bool IsAudioStreamHealthy() const;
-        void CheckStreamHealth(const TSPacket& packet);
+        void CheckStreamHealth(const PacketMeta& meta);
         
         // Launch media player process with transport stream input
         bool LaunchMediaPlayer(const RouterConfig& config, HANDLE& process_handle, HANDLE& stdin_handle);
         
-        // Send TS packet to media player
-        bool SendTSPacketToPlayer(HANDLE stdin_handle, const TSPacket& packet);
         
         // Fetch HLS segment data
         bool FetchHLSSegment(const std::wstring& segment_url, std::vector<uint8_t>& data, std::atomic<bool>* cancel_token = nullptr);
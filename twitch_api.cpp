@@ -10,7 +10,6 @@
 #include <winsock2.h>
 #include <ws2tcpip.h>
 #include <windows.h>
-#include <winhttp.h>
 #include <string>
 #include <vector>
 #include <sstream>
@@ -19,58 +18,21 @@
 #include "urlencode.h"
 #include "tlsclient/tlsclient.h"
 #include "json_minimal.h"
+#include "http_client.h"
 
 // Forward declaration - AddLog is defined in Tardsplaya.cpp
 extern void AddLog(const std::wstring& msg);
 
-// Helper: HTTP GET request (using WinHTTP, wide string version)
+// Helper: HTTP GET request (shared keep-alive connection pool, wide string version)
 bool HttpGetText(const std::wstring& url, std::string& out) {
-    URL_COMPONENTS uc = { sizeof(uc) };
-    wchar_t host[256] = L"", path[2048] = L"";
-    uc.lpszHostName = host; uc.dwHostNameLength = 255;
-    uc.lpszUrlPath = path; uc.dwUrlPathLength = 2047;
-    if (!WinHttpCrackUrl(url.c_str(), 0, 0, &uc)) {
-        // Try TLS client as fallback if URL parsing fails
-        return TLSClientHTTP::HttpGetText(url, out);
-    }
-
-    HINTERNET hSession = WinHttpOpen(L"Tardsplaya/1.0", WINHTTP_ACCESS_TYPE_DEFAULT_PROXY, 0, 0, 0);
-    if (!hSession) {
-        // Try TLS client as fallback
-        return TLSClientHTTP::HttpGetText(url, out);
-    }
-    HINTERNET hConnect = WinHttpConnect(hSession, host, uc.nPort, 0);
-    if (!hConnect) { 
-        WinHttpCloseHandle(hSession); 
+    std::vector<uint8_t> data;
+    tardsplaya::HttpResponse response;
+    // Any answer from the server is returned as before; only an unreachable server falls back
+    if (!tardsplaya::HttpClient::Shared().Get(url, data, nullptr, &response, 1, &tardsplaya::CompressedTextHeaders()) &&
+        response.status == 0) {
         // Try TLS client as fallback
         return TLSClientHTTP::HttpGetText(url, out);
     }
-    HINTERNET hRequest = WinHttpOpenRequest(
-        hConnect, L"GET", path, NULL, WINHTTP_NO_REFERER, WINHTTP_DEFAULT_ACCEPT_TYPES,
-        (uc.nScheme == INTERNET_SCHEME_HTTPS) ? WINHTTP_FLAG_SECURE : 0);
-    BOOL res = WinHttpSendRequest(hRequest, 0, 0, 0, 0, 0, 0) && WinHttpReceiveResponse(hRequest, 0);
-    if (!res) { 
-        WinHttpCloseHandle(hRequest); 
-        WinHttpCloseHandle(hConnect); 
-        WinHttpCloseHandle(hSession); 
-        // Try TLS client as fallback
-        return TLSClientHTTP::HttpGetText(url, out);
-    }
-
-    DWORD dwSize = 0;
-    std::vector<char> data;
-    do {
-        DWORD dwDownloaded = 0;
-        WinHttpQueryDataAvailable(hRequest, &dwSize);
-        if (!dwSize) break;
-        size_t prev_size = data.size();
-        data.resize(prev_size + dwSize);
-        WinHttpReadData(hRequest, data.data() + prev_size, dwSize, &dwDownloaded);
-        if (dwDownloaded < dwSize) data.resize(prev_size + dwDownloaded);
-    } while (dwSize > 0);
-
-    WinHttpCloseHandle(hRequest); WinHttpCloseHandle(hConnect); WinHttpCloseHandle(hSession);
-
     out.assign(data.begin(), data.end());
     return true;
 }
@@ -0,0 +1,259 @@
+// Live latency: regular segments vs. segments advertised with #EXT-X-TWITCH-PREFETCH
+// Twitch lists the segment in production and the next one as prefetch URLs; the edge streams them
+// while they are produced. A client that plays only regular entries starts every segment after a
+// later poll lists it, whole. Against a loopback origin producing 2 s segments in 250 ms parts, two
+// clients run the router's loop - 500 ms polls, the newest two entries at startup, parallel
+// downloads taken in order and forwarded as they arrive - once with regular entries only and once
+// with the prefetch entries too. Latency is how far behind capture time a player starting with the
+// first packet ends up, stalls included. Each segment must be requested once: a prefetched one is
+// not fetched again when it turns up as a regular entry. Last, the prefetch client feeds a throughput
+// estimator the way the router feeds its ABR, over a clean link and over one capped below the stream's
+// bitrate: segments streamed while produced must still give samples, and on the capped link the
+// estimate must be the cap, not the encoder's pace.
+//
+// Build: g++ -std=c++17 -O2 -pthread twitch_prefetch_bench.cpp tsduck_hls_wrapper.cpp ll_hls_origin.cpp segment_prefetcher.cpp abr_controller.cpp segment_pool.cpp http_client.cpp http_client_posix.cpp inflater.cpp loopback_server.cpp -o twitch_prefetch_bench
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <set>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "tsduck_hls_wrapper.h"
+#include "ll_hls_origin.h"
+#include "segment_prefetcher.h"
+#include "abr_controller.h"
+#include "http_client.h"
+
+using tsduck_hls::PlaylistParser;
+using tsduck_hls::MediaSegment;
+using tsduck_transport::SegmentPool;
+using tsduck_transport::SegmentPrefetcher;
+using tsduck_transport::ThroughputEstimator;
+using tardsplaya::HttpClient;
+using tardsplaya::LowLatencyOrigin;
+using tardsplaya::LowLatencyOriginConfig;
+
+namespace {
+
+    const auto RUN_TIME = std::chrono::seconds(10);
+    const size_t PACKET_SIZE = 188;
+    const size_t LIVE_EDGE_ENTRIES = 2;     // RouterConfig::max_segments_to_buffer
+
+    bool Check(bool condition, const std::string& what) {
+        std::cout << (condition ? "  PASS  " : "  FAIL  ") << what << std::endl;
+        return condition;
+    }
+
+    std::wstring JoinUrl(const std::wstring& base, const std::wstring& rel) {
+        if (rel.find(L"http") == 0) return rel;
+        size_t pos = base.rfind(L'/');
+        if (pos == std::wstring::npos) return rel;
+        return base.substr(0, pos + 1) + rel;
+    }
+
+    // Stands in for the player: checks order and keeps the largest delay behind capture time.
+    // Bytes arrive as the network delivers them, so a packet cut at the end waits for its rest.
+    struct Player {
+        const LowLatencyOrigin& origin;
+        int64_t last_sequence = -1;
+        int last_part = 0;
+        size_t next_index = 0;
+        bool in_order = true;
+        uint64_t packets = 0;
+        double latency_ms = 0.0;
+        std::vector<uint8_t> pending;
+
+        explicit Player(const LowLatencyOrigin& source) : origin(source) {}
+
+        void Forward(const uint8_t* data, size_t size) {
+            auto now = std::chrono::steady_clock::now();
+            const LowLatencyOriginConfig& config = origin.GetConfig();
+            pending.insert(pending.end(), data, data + size);
+            size_t offset = 0;
+            for (; offset + PACKET_SIZE <= pending.size(); offset += PACKET_SIZE) {
+                int64_t sequence;
+                int part;
+                size_t index;
+                if (!LowLatencyOrigin::DecodePacket(&pending[offset], sequence, part, index)) {
+                    in_order = false;
+                    continue;
+                }
+                if (last_sequence >= 0) {
+                    bool next_packet = sequence == last_sequence && part == last_part && index == next_index;
+                    bool next_part = index == 0 && next_index == config.packets_per_part &&
+                                     ((sequence == last_sequence && part == last_part + 1) ||
+                                      (sequence == last_sequence + 1 && part == 0 && last_part == config.parts_per_segment - 1));
+                    if (!next_packet && !next_part) {
+                        in_order = false;
+                    }
+                }
+                last_sequence = sequence;
+                last_part = part;
+                next_index = index + 1;
+                double delay = std::chrono::duration<double, std::milli>(now - origin.MediaTime(sequence, part, index)).count();
+                latency_ms = std::max(latency_ms, delay);
+                packets++;
+            }
+            pending.erase(pending.begin(), pending.begin() + offset);
+        }
+    };
+
+    struct ClientResult {
+        double latency_ms = 0.0;
+        bool in_order = false;
+        uint64_t packets = 0;
+        uint64_t segments = 0;
+        uint64_t prefetched = 0;        // Played from a prefetch entry
+        uint64_t requests = 0;          // Segment requests the origin saw
+        uint64_t samples = 0;           // Throughput samples the estimator took
+        uint64_t produced_samples = 0;  // ...of them from segments streamed while produced
+        double estimate_mbps = 0.0;
+    };
+
+    ClientResult Run(LowLatencyOrigin& origin, bool use_prefetch, ThroughputEstimator* estimator = nullptr) {
+        ClientResult result;
+        Player player(origin);
+        SegmentPool pool;
+        SegmentPrefetcher prefetcher(
+            [](const std::wstring& url, const SegmentPrefetcher::ChunkSink& sink, std::atomic<bool>* token) {
+                return HttpClient::Shared().Get(url, sink, token);
+            },
+            pool);
+        SegmentPrefetcher::ProgressFunction forward = [&](const uint8_t* data, size_t size) { player.Forward(data, size); };
+        uint64_t requests_before = origin.GetStats().segments;
+        std::set<int64_t> handled;
+        bool started = false;
+        auto deadline = std::chrono::steady_clock::now() + RUN_TIME;
+        while (std::chrono::steady_clock::now() < deadline) {
+            std::vector<uint8_t> body;
+            PlaylistParser playlist;
+            if (HttpClient::Shared().Get(origin.PlaylistUrl(), body) && playlist.ParsePlaylist(std::string(body.begin(), body.end()))) {
+                std::vector<MediaSegment> entries = playlist.GetSegments();
+                size_t regular = entries.size();
+                if (use_prefetch) {
+                    entries.insert(entries.end(), playlist.GetPrefetchSegments().begin(), playlist.GetPrefetchSegments().end());
+                }
+                size_t first_kept = started || entries.size() <= LIVE_EDGE_ENTRIES ? 0 : entries.size() - LIVE_EDGE_ENTRIES;
+                for (size_t i = first_kept; i < entries.size(); ++i) {
+                    int64_t sequence = static_cast<int64_t>(entries[i].sequence_number);
+                    if (!handled.count(sequence)) {
+                        prefetcher.Enqueue(sequence, JoinUrl(origin.PlaylistUrl(), entries[i].url));
+                    }
+                }
+                for (size_t i = 0; i < entries.size(); ++i) {
+                    int64_t sequence = static_cast<int64_t>(entries[i].sequence_number);
+                    if (handled.count(sequence)) {
+                        continue;
+                    }
+                    handled.insert(sequence);
+                    if (i < first_kept) {
+                        continue;
+                    }
+                    SegmentPrefetcher::Segment segment;
+                    if (prefetcher.Take(sequence, segment, nullptr, &forward) == SegmentPrefetcher::Result::READY) {
+                        player.Forward(segment.data->data() + segment.delivered, segment.data->size() - segment.delivered);
+                        result.segments++;
+                        if (i >= regular) {
+                            result.prefetched++;
+                        }
+                        if (estimator) {
+                            // As the router: a prefetched segment by its back-to-back arrivals, others whole
+                            uint64_t before = estimator->GetSampleCount();
+                            if (i >= regular) {
+                                estimator->AddSample(segment.transfer_bytes,
+                                                     std::chrono::duration_cast<std::chrono::milliseconds>(segment.transfer_time));
+                                result.produced_samples += estimator->GetSampleCount() - before;
+                            } else {
+                                estimator->AddSample(segment.data->size(), segment.download_time);
+                            }
+                        }
+                    }
+                }
+                started = true;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        }
+        result.latency_ms = player.latency_ms;
+        result.in_order = player.in_order;
+        result.packets = player.packets;
+        result.requests = origin.GetStats().segments - requests_before;
+        if (estimator) {
+            result.samples = estimator->GetSampleCount();
+            result.estimate_mbps = estimator->GetEstimateBps() / 1e6;
+        }
+        return result;
+    }
+
+} // namespace
+
+int main() {
+    bool ok = true;
+
+    std::cout << "Parser" << std::endl;
+    PlaylistParser sample;
+    sample.ParsePlaylist("#EXTM3U\n#EXT-X-TARGETDURATION:2\n#EXT-X-MEDIA-SEQUENCE:40\n#EXTINF:2.000,live\nhttps://e/a.ts\n"
+                         "#EXTINF:2.000,live\nhttps://e/b.ts\n#EXT-X-TWITCH-PREFETCH:https://e/c.ts\n#EXT-X-TWITCH-PREFETCH:https://e/d.ts\n");
+    const std::vector<MediaSegment>& prefetch = sample.GetPrefetchSegments();
+    ok &= Check(sample.GetSegments().size() == 2 && prefetch.size() == 2, "prefetch lines kept apart from regular segments");
+    ok &= Check(prefetch.size() == 2 && prefetch[0].url == L"https://e/c.ts" && prefetch[0].sequence_number == 42 &&
+                prefetch[1].sequence_number == 43, "prefetch segments continue the numbering");
+
+    LowLatencyOriginConfig config;
+    config.low_latency = false;
+    config.twitch_prefetch_segments = 2;
+    LowLatencyOrigin origin(config);
+    if (!origin.Start()) {
+        std::cout << "Could not start the loopback origin" << std::endl;
+        return 1;
+    }
+    std::cout << std::endl << "Live edge against a loopback origin (2 s segments produced in 250 ms parts, "
+              << config.rtt_ms << " ms round trip, 2 prefetch entries), " << RUN_TIME.count() << " s per client" << std::endl;
+
+    ClientResult regular = Run(origin, false);
+    ClientResult prefetched = Run(origin, true);
+    origin.Stop();
+
+    std::cout << std::fixed << std::setprecision(0);
+    std::cout << "  regular entries:   latency " << std::setw(5) << regular.latency_ms << " ms, " << regular.segments
+              << " segments, " << regular.requests << " requests" << std::endl;
+    std::cout << "  prefetch entries:  latency " << std::setw(5) << prefetched.latency_ms << " ms, " << prefetched.segments
+              << " segments (" << prefetched.prefetched << " before they were listed), " << prefetched.requests << " requests" << std::endl;
+
+    ok &= Check(regular.in_order && regular.packets > 0, "regular client plays segments in order");
+    ok &= Check(prefetched.in_order && prefetched.packets > 0, "prefetch client plays segments in order");
+    ok &= Check(prefetched.prefetched > 0 && prefetched.prefetched == prefetched.segments, "every segment played from its prefetch entry");
+    ok &= Check(prefetched.requests == prefetched.segments, "no segment fetched again once listed");
+    ok &= Check(prefetched.latency_ms < 3000.0, "prefetch latency under 3 s");
+    ok &= Check(prefetched.latency_ms + 1500.0 < regular.latency_ms, "prefetch at least 1.5 s closer to live");
+
+    // The stream is ~1.2 Mbit/s; the capped link carries 0.8 Mbit/s, so its segments arrive back to back
+    const uint64_t capped_bytes_per_second = 100000;
+    const double capped_mbps = capped_bytes_per_second * 8 / 1e6;
+    std::cout << std::endl << "Throughput samples for quality switching, prefetch client" << std::endl;
+    ClientResult links[2];
+    for (int capped = 0; capped < 2; ++capped) {
+        LowLatencyOriginConfig link_config = config;
+        link_config.bytes_per_second = capped ? capped_bytes_per_second : 0;
+        LowLatencyOrigin link_origin(link_config);
+        if (!link_origin.Start()) {
+            std::cout << "Could not start the loopback origin" << std::endl;
+            return 1;
+        }
+        ThroughputEstimator estimator;
+        links[capped] = Run(link_origin, true, &estimator);
+        link_origin.Stop();
+        std::cout << (capped ? "  capped link:  " : "  clean link:   ") << links[capped].samples << " samples ("
+                  << links[capped].produced_samples << " from segments streamed while produced), estimate "
+                  << std::setprecision(2) << links[capped].estimate_mbps << " Mbit/s" << std::setprecision(0) << std::endl;
+    }
+    ok &= Check(links[0].produced_samples > 0 && links[1].produced_samples > 0, "segments streamed while produced give samples");
+    ok &= Check(links[0].estimate_mbps > 2 * capped_mbps, "clean link: estimate above the cap");
+    ok &= Check(links[1].estimate_mbps > capped_mbps * 0.7 && links[1].estimate_mbps < capped_mbps * 1.3,
+                "capped link: estimate within 30% of the cap");
+
+    std::cout << std::endl << (ok ? "All checks passed" : "SOME CHECKS FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
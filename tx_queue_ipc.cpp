@@ -2,6 +2,11 @@
 #include "stream_thread.h"
 #include "stream_pipe.h"
 #include "tsduck_hls_wrapper.h"
+#include "segment_tracker.h"
+#include "low_latency_hls.h"
+#include "poll_scheduler.h"
+#include "segment_prefetcher.h"
+#include "http_client.h"
 #include <sstream>
 #include <iomanip>
 #include <regex>
@@ -13,7 +18,8 @@
 // Include existing utility functions
 extern std::string WideToUtf8(const std::wstring& w);
 extern std::wstring Utf8ToWide(const std::string& s);
-extern bool HttpGetText(const std::wstring& url, std::string& out, std::atomic<bool>* cancel_token);
+extern bool HttpGetText(const std::wstring& url, std::string& out, std::atomic<bool>* cancel_token,
+                        tardsplaya::HttpResponse* response);
 
 // Helper function to join URLs
 static std::wstring JoinUrl(const std::wstring& base, const std::wstring& rel) {
@@ -29,16 +35,8 @@ using namespace qcstudio;
 using namespace tardsplaya;
 
 namespace {
-    // Helper function for HTTP binary downloads
-    bool HttpGetBinary(const std::wstring& url, std::vector<char>& out, std::atomic<bool>* cancel_token = nullptr) {
-        // Reuse existing HTTP implementation from stream_pipe.cpp
-        std::string text_data;
-        if (!HttpGetText(url, text_data, cancel_token)) {
-            return false;
-        }
-        out.assign(text_data.begin(), text_data.end());
-        return true;
-    }
+    // Slack on top of the queued playback time before a segment download is given up
+    const std::chrono::milliseconds DEADLINE_GRACE(1000);
 }
 
 // TxQueueIPC Implementation
@@ -536,6 +534,10 @@ void TxQueueStreamManager::StopStreaming() {
 
 TxQueueStreamManager::StreamStats TxQueueStreamManager::GetStats() const {
     StreamStats stats = {};
+    stats.segments_missed = segments_missed_.load();
+    stats.segments_late = segments_late_.load();
+    stats.playlist_bytes_received = playlist_bytes_received_.load();
+    stats.playlist_bytes_decoded = playlist_bytes_decoded_.load();
     
     if (ipc_manager_) {
         stats.segments_produced = ipc_manager_->GetProducedCount();
@@ -556,15 +558,32 @@ TxQueueStreamManager::StreamStats TxQueueStreamManager::GetStats() const {
 void TxQueueStreamManager::ProducerThreadFunction(const std::wstring& playlist_url) {
     AddDebugLog(L"[PRODUCER] Starting producer thread for: " + playlist_url);
     
-    std::set<std::wstring> seen_urls;
+    tsduck_hls::SegmentTracker segment_tracker; // Segments already queued, by media sequence number
     int consecutive_errors = 0;
     const int max_errors = 10;
     tsduck_hls::PlaylistParser playlist_parser;
     
+    // New segments of each playlist download in parallel and are queued in sequence order
+    tsduck_transport::SegmentPool segment_pool;
+    tsduck_transport::SegmentPrefetcher prefetcher(
+        [this](const std::wstring& url, const tsduck_transport::SegmentPrefetcher::ChunkSink& sink, std::atomic<bool>* token,
+               std::chrono::steady_clock::time_point deadline) {
+            return deadline_fetcher_.Get(url, deadline, sink, token) == DeadlineFetcher::Result::OK;
+        },
+        segment_pool);
+    tsduck_hls::LowLatencyCursor ll_cursor;     // Position in the parts of an LL-HLS playlist
+    std::wstring reload_url = playlist_url;     // Blocking reload for the next refresh when the server supports it
+    tsduck_hls::PollScheduler poll_scheduler;   // Next refresh from the segment publication cadence
+    
     while (!should_stop_.load() && (!cancel_token_ptr_ || !cancel_token_ptr_->load())) {
         // Download current playlist
         std::string playlist_content;
-        if (!HttpGetText(playlist_url, playlist_content, cancel_token_ptr_)) {
+        tardsplaya::HttpResponse playlist_response;
+        bool playlist_ok = HttpGetText(reload_url, playlist_content, cancel_token_ptr_, &playlist_response);
+        playlist_bytes_received_ += playlist_response.body_bytes;
+        playlist_bytes_decoded_ += playlist_response.decoded_bytes;
+        if (!playlist_ok) {
+            reload_url = playlist_url;
             consecutive_errors++;
             LogMessage(L"[PRODUCER] Failed to download playlist, attempt " + 
                       std::to_wstring(consecutive_errors) + L"/" + std::to_wstring(max_errors));
@@ -579,23 +598,106 @@ void TxQueueStreamManager::ProducerThreadFunction(const std::wstring& playlist_u
         }
         
         consecutive_errors = 0;
+        auto playlist_received = std::chrono::steady_clock::now();
         
         // Parse playlist using TSDuck HLS wrapper for discontinuity detection
         if (!playlist_parser.ParsePlaylist(playlist_content)) {
+            reload_url = playlist_url;
             LogMessage(L"[PRODUCER] Failed to parse playlist with TSDuck wrapper");
             std::this_thread::sleep_for(std::chrono::seconds(2));
             continue;
         }
+        poll_scheduler.OnPlaylist(playlist_parser, playlist_received);
         
         // Get segments with discontinuity information
         auto media_segments = playlist_parser.GetSegments();
         bool playlist_has_discontinuities = playlist_parser.HasDiscontinuities();
         
+        // Twitch low latency: upcoming segments advertised with #EXT-X-TWITCH-PREFETCH are queued as the edge
+        // produces them. They keep their sequence numbers, so once listed regularly they are handled already.
+        for (const auto& prefetch : playlist_parser.GetPrefetchSegments()) {
+            media_segments.push_back(prefetch);
+        }
+        
+        // Segments the playlist moved past before they were queued
+        uint64_t missed_before = segment_tracker.GetStats().missed;
+        segment_tracker.BeginPlaylist(playlist_parser.GetMediaSequence(), media_segments.size());
+        segments_missed_ = segment_tracker.GetStats().missed;
+        if (segment_tracker.GetStats().missed != missed_before) {
+            LogMessage(L"[PRODUCER] Missed " + std::to_wstring(segment_tracker.GetStats().missed - missed_before) + 
+                      L" segments that left the playlist before they were queued");
+        }
+        
         if (playlist_has_discontinuities) {
             LogMessage(L"[PRODUCER] Discontinuities detected in playlist - buffer flushing enabled");
         }
         
+        // LL-HLS: queue the parts the cursor hands out instead of whole segments, each part as one entry.
+        // Whole segments whose parts were queued count as processed, older ones as skipped.
+        const bool low_latency_parts = playlist_parser.IsLowLatency();
+        if (low_latency_parts) {
+            bool started = ll_cursor.GetFirstMediaSequence() >= 0;
+            std::vector<tsduck_hls::PartFetch> parts = ll_cursor.NextParts(playlist_parser);
+            for (const auto& media_segment : media_segments) {
+                const int64_t sequence = static_cast<int64_t>(media_segment.sequence_number);
+                if (!segment_tracker.IsHandled(sequence)) {
+                    if (ll_cursor.GetFirstMediaSequence() >= 0 && sequence >= ll_cursor.GetFirstMediaSequence()) {
+                        segment_tracker.MarkProcessed(sequence);
+                    } else {
+                        segment_tracker.MarkSkipped(sequence);
+                    }
+                }
+            }
+            media_segments.clear();
+            for (const tsduck_hls::PartFetch& part : parts) {
+                tsduck_hls::MediaSegment part_segment(part.url);
+                part_segment.sequence_number = static_cast<double>(part.key);
+                part_segment.has_discontinuity = part.discontinuity;
+                media_segments.push_back(part_segment);
+            }
+            if (!started && !parts.empty()) {
+                LogMessage(L"[PRODUCER] LL-HLS: queuing parts from segment " + std::to_wstring(parts.front().media_sequence) + 
+                          L" part " + std::to_wstring(parts.front().part_index));
+            }
+            tsduck_hls::PartFetch preload;
+            if (!ipc_manager_->IsQueueNearFull() && ll_cursor.PreloadPart(playlist_parser, preload)) {
+                prefetcher.Enqueue(preload.key, JoinUrl(playlist_url, preload.url));
+            }
+        }
+        
+        // Each segment is due once the player has played what is queued before it; roughly a target duration
+        // per queued segment. Nothing is due before the player has taken its first segment.
+        std::chrono::milliseconds entry_duration = low_latency_parts ? playlist_parser.GetPartTarget() : playlist_parser.GetTargetDuration();
+        if (entry_duration.count() <= 0) {
+            entry_duration = std::chrono::milliseconds(2000);
+        }
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+        StreamStats queue_stats = GetStats();
+        if (queue_stats.segments_consumed > 0) {
+            uint64_t queue_depth = queue_stats.segments_produced > queue_stats.segments_consumed ?
+                queue_stats.segments_produced - queue_stats.segments_consumed : 0;
+            deadline = std::chrono::steady_clock::now() + entry_duration * static_cast<int64_t>(queue_depth) + DEADLINE_GRACE;
+        }
+        auto entry_deadline = [&](size_t index) {
+            return deadline == std::chrono::steady_clock::time_point::max() ? deadline : deadline + entry_duration * static_cast<int64_t>(index);
+        };
+        
+        // Start downloading every new segment unless the queue is already near full
+        if (!ipc_manager_->IsQueueNearFull()) {
+            size_t index = 0;
+            for (const auto& media_segment : media_segments) {
+                const int64_t sequence = static_cast<int64_t>(media_segment.sequence_number);
+                if (low_latency_parts || !segment_tracker.IsHandled(sequence)) {
+                    prefetcher.Enqueue(sequence, JoinUrl(playlist_url, media_segment.url), entry_deadline(index++));
+                }
+            }
+        }
+        
         // Download new segments
+        size_t queued = 0;
+        size_t index = 0;
+        bool jump_to_live = false;              // A segment was late: only the newest is still worth queuing
+        bool pending_discontinuity = false;     // Next segment queued follows a gap
         for (const auto& media_segment : media_segments) {
             if (should_stop_.load() || (cancel_token_ptr_ && cancel_token_ptr_->load())) break;
             
@@ -605,9 +707,19 @@ void TxQueueStreamManager::ProducerThreadFunction(const std::wstring& playlist_u
                 segment_url = JoinUrl(playlist_url, segment_url);
             }
             
-            // Skip already downloaded segments
-            if (seen_urls.count(segment_url)) continue;
-            seen_urls.insert(segment_url);
+            const int64_t sequence = static_cast<int64_t>(media_segment.sequence_number);
+            if (jump_to_live && &media_segment != &media_segments.back()) {
+                if (!low_latency_parts && !segment_tracker.IsHandled(sequence)) {
+                    segment_tracker.MarkSkipped(sequence);
+                }
+                continue;
+            }
+            
+            // Skip already downloaded segments (the cursor hands out each part once)
+            if (!low_latency_parts) {
+                if (segment_tracker.IsHandled(sequence)) continue;
+                segment_tracker.MarkProcessed(sequence);
+            }
             
             // Check if queue is getting full
             if (ipc_manager_->IsQueueNearFull()) {
@@ -616,12 +728,36 @@ void TxQueueStreamManager::ProducerThreadFunction(const std::wstring& playlist_u
                 continue;
             }
             
-            // Download segment
+            // Download segment (usually prefetched already)
             std::vector<char> segment_data;
-            if (DownloadSegment(segment_url, segment_data)) {
+            tsduck_transport::SegmentPrefetcher::Segment prefetched;
+            auto prefetch_result = prefetcher.Take(sequence, prefetched, cancel_token_ptr_);
+            bool downloaded = false;
+            bool late = prefetch_result == tsduck_transport::SegmentPrefetcher::Result::LATE;
+            if (prefetch_result == tsduck_transport::SegmentPrefetcher::Result::READY) {
+                segment_data.assign(prefetched.data->begin(), prefetched.data->end());
+                downloaded = true;
+            } else if (prefetch_result == tsduck_transport::SegmentPrefetcher::Result::NOT_QUEUED) {
+                DeadlineFetcher::Result result = DownloadSegment(segment_url, segment_data, entry_deadline(index));
+                downloaded = result == DeadlineFetcher::Result::OK;
+                late = result == DeadlineFetcher::Result::LATE;
+            }
+            index++;
+            if (late) {
+                // The player would stall waiting for it; go on from the newest segment instead
+                segments_late_++;
+                jump_to_live = true;
+                pending_discontinuity = true;
+                LogMessage(L"[PRODUCER] Segment missed its deadline, jumping to live: " + 
+                          segment_url.substr(segment_url.find_last_of(L'/') + 1));
+                continue;
+            }
+            if (downloaded) {
                 // Add to tx-queue with discontinuity information
-                bool has_discontinuity = media_segment.has_discontinuity;
+                bool has_discontinuity = media_segment.has_discontinuity || pending_discontinuity;
+                pending_discontinuity = false;
                 if (ipc_manager_->ProduceSegment(std::move(segment_data), has_discontinuity)) {
+                    queued++;
                     std::wstring disc_info = has_discontinuity ? L" [DISCONTINUITY]" : L"";
                     LogMessage(L"[PRODUCER] Queued segment from: " + 
                               segment_url.substr(segment_url.find_last_of(L'/') + 1) + disc_info);
@@ -639,12 +775,46 @@ void TxQueueStreamManager::ProducerThreadFunction(const std::wstring& playlist_u
             chunk_count_ptr_->store(static_cast<int>(queue_depth));
         }
         
-        // Wait before next playlist fetch
-        std::this_thread::sleep_for(std::chrono::seconds(2));
+        // Wait before next playlist fetch. A server that can block holds the reload until the part (or segment)
+        // after the last one listed exists; one that brought nothing new backs off a little.
+        reload_url = tsduck_hls::BlockingReloadUrl(playlist_parser, playlist_url);
+        if (reload_url != playlist_url) {
+            if (queued == 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+        } else if (low_latency_parts) {
+            std::this_thread::sleep_for(playlist_parser.GetPartTarget());
+        } else {
+            // Just before the next segment is due, sooner again while the playlist stays unchanged
+            std::this_thread::sleep_for(poll_scheduler.DelayFrom(std::chrono::steady_clock::now()));
+        }
     }
     
     // Signal end of stream
     ipc_manager_->SignalEndOfStream();
+    tsduck_transport::SegmentPrefetcher::Stats prefetch = prefetcher.GetStats();
+    LogMessage(L"[PRODUCER] Prefetch: " + std::to_wstring(prefetch.downloads) + L" segments downloaded ahead, " + 
+              std::to_wstring(prefetch.discarded) + L" discarded, limit " + std::to_wstring(prefetch.concurrency) + L", " + 
+              std::to_wstring(prefetch.in_flight_high_water) + L" in flight at most");
+    DeadlineFetcher::Stats deadline_stats = deadline_fetcher_.GetStats();
+    LogMessage(L"[PRODUCER] Deadlines: " + std::to_wstring(segments_late_.load()) + L" segments late, " + 
+              std::to_wstring(deadline_stats.hedges) + L" hedged requests (" + std::to_wstring(deadline_stats.hedges_won) + 
+              L" answered first), first byte p50/p99 " + 
+              std::to_wstring(static_cast<int>(deadline_stats.time_to_first_byte.Percentile(0.5))) + L"/" + 
+              std::to_wstring(static_cast<int>(deadline_stats.time_to_first_byte.Percentile(0.99))) + L"ms, download p99 " + 
+              std::to_wstring(static_cast<int>(deadline_stats.download_time.Percentile(0.99))) + L"ms");
+    if (playlist_bytes_decoded_.load() > 0) {
+        LogMessage(L"[PRODUCER] Playlists: " + std::to_wstring(playlist_bytes_received_.load() / 1024) + L"KB received for " + 
+                  std::to_wstring(playlist_bytes_decoded_.load() / 1024) + L"KB decoded");
+    }
+    if (ll_cursor.GetFirstMediaSequence() >= 0) {
+        LogMessage(L"[PRODUCER] LL-HLS: " + std::to_wstring(ll_cursor.GetStats().parts) + L" parts, " + 
+                  std::to_wstring(ll_cursor.GetStats().preloads) + L" preloads, " + std::to_wstring(ll_cursor.GetStats().jumps) + 
+                  L" restarts at the live edge");
+    }
+    const tsduck_hls::PollScheduler::Stats& polls = poll_scheduler.GetStats();
+    LogMessage(L"[PRODUCER] Playlist polls: " + std::to_wstring(polls.polls) + L", " + std::to_wstring(polls.unchanged) + 
+              L" unchanged, prediction error " + std::to_wstring(static_cast<int>(polls.prediction_error_ms)) + L"ms");
     AddDebugLog(L"[PRODUCER] Producer thread ending");
 }
 
@@ -733,20 +903,19 @@ void TxQueueStreamManager::ConsumerThreadFunction() {
     AddDebugLog(L"[CONSUMER] Consumer thread ending");
 }
 
-bool TxQueueStreamManager::DownloadSegment(const std::wstring& segment_url, std::vector<char>& segment_data) {
-    for (int attempt = 0; attempt < 3; ++attempt) {
-        if (HttpGetBinary(segment_url, segment_data, cancel_token_ptr_)) {
-            return true;
-        }
-        
-        if (should_stop_.load() || (cancel_token_ptr_ && cancel_token_ptr_->load())) {
-            break;
-        }
-        
-        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+DeadlineFetcher::Result TxQueueStreamManager::DownloadSegment(const std::wstring& segment_url, std::vector<char>& segment_data,
+                                                              std::chrono::steady_clock::time_point deadline) {
+    // Retried and hedged within the deadline rather than after fixed sleeps
+    segment_data.clear();
+    HttpBodySink append = [&segment_data](const uint8_t* data, size_t size) {
+        segment_data.insert(segment_data.end(), data, data + size);
+        return true;
+    };
+    DeadlineFetcher::Result result = deadline_fetcher_.Get(segment_url, deadline, append, cancel_token_ptr_);
+    if (result == DeadlineFetcher::Result::OK && segment_data.empty()) {
+        return DeadlineFetcher::Result::FAILED;
     }
-    
-    return false;
+    return result;
 }
 
 void TxQueueStreamManager::LogMessage(const std::wstring& message) {
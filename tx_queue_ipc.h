@@ -17,6 +17,7 @@
 
 // Include tx-queue headers
 #include "tx_queue_wrapper.h"
+#include "deadline_fetcher.h"
 
 // Forward declarations
 void AddDebugLog(const std::wstring& msg);
@@ -185,6 +186,10 @@ public:
         uint64_t segments_produced;
         uint64_t segments_consumed;
         uint64_t segments_dropped;
+        uint64_t segments_missed;    // Left the playlist before they were queued (media sequence gaps)
+        uint64_t segments_late;      // Not downloaded before the player would have needed them; skipped to live
+        uint64_t playlist_bytes_received;   // Playlist bodies as sent, gzip or deflate when the CDN offers it
+        uint64_t playlist_bytes_decoded;
         uint64_t bytes_transferred;
         bool player_running;
         bool queue_ready;
@@ -200,6 +205,11 @@ private:
     std::atomic<bool> streaming_active_{false};
     std::atomic<bool> should_stop_{false};
     std::atomic<uint64_t> bytes_transferred_{0};
+    std::atomic<uint64_t> segments_missed_{0};
+    std::atomic<uint64_t> segments_late_{0};
+    std::atomic<uint64_t> playlist_bytes_received_{0};
+    std::atomic<uint64_t> playlist_bytes_decoded_{0};
+    DeadlineFetcher deadline_fetcher_{HttpClient::Shared()};   // Segment downloads, hedged and bounded by the playback deadline
     
     std::thread producer_thread_;
     std::thread consumer_thread_;
@@ -215,7 +225,8 @@ private:
     
     // Helper functions
     bool DownloadPlaylistSegments(const std::wstring& playlist_url, std::vector<std::wstring>& segment_urls);
-    bool DownloadSegment(const std::wstring& segment_url, std::vector<char>& segment_data);
+    DeadlineFetcher::Result DownloadSegment(const std::wstring& segment_url, std::vector<char>& segment_data,
+                                            std::chrono::steady_clock::time_point deadline);
     void LogMessage(const std::wstring& message);
     void UpdateChunkCount(int count);
 };